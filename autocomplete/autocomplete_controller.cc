@@ -4,6 +4,7 @@
 
 #include "chrome/browser/autocomplete/autocomplete_controller.h"
 
+#include <algorithm>
 #include <set>
 #include <string>
 
@@ -127,6 +128,17 @@ bool IsTrivialAutocompletion(const AutocompleteMatch& match) {
       match.type == AutocompleteMatchType::SEARCH_OTHER_ENGINE;
 }
 
+// Records whether |provider|, started off the main thread, reported its
+// matches within its latency budget.
+void RecordProviderMetDeadline(const AutocompleteProvider& provider,
+                               bool met_deadline) {
+  std::string name =
+      std::string("Omnibox.ProviderMetDeadline.") + provider.GetName();
+  base::HistogramBase* counter = base::BooleanHistogram::FactoryGet(
+      name, base::Histogram::kUmaTargetedHistogramFlag);
+  counter->AddBoolean(met_deadline);
+}
+
 }  // namespace
 
 const int AutocompleteController::kNoItemSelected = -1;
@@ -234,17 +246,36 @@ void AutocompleteController::Start(const AutocompleteInput& input) {
 
   expire_timer_.Stop();
   stop_timer_.Stop();
+  deadline_timer_.Stop();
+  provider_deadlines_.clear();
+
+  // Classifying input needs the matches synchronously, so only queries for
+  // all matches may run providers off the main thread.
+  OmniboxFieldTrial::ProviderLatencyBudgets budgets;
+  if (input.matches_requested() == AutocompleteInput::ALL_MATCHES) {
+    OmniboxFieldTrial::GetOffMainThreadProviderBudgets(
+        input.current_page_classification(), &budgets);
+  }
 
   // Start the new query.
   in_zero_suggest_ = false;
   in_start_ = true;
   base::TimeTicks start_time = base::TimeTicks::Now();
+  query_start_time_ = start_time;
   for (ACProviders::iterator i(providers_.begin()); i != providers_.end();
        ++i) {
     // TODO(mpearson): Remove timing code once bugs 178705 / 237703 / 168933
     // are resolved.
     base::TimeTicks provider_start_time = base::TimeTicks::Now();
-    (*i)->Start(input_, minimal_changes);
+    OmniboxFieldTrial::ProviderLatencyBudgets::const_iterator budget =
+        budgets.find((*i)->type());
+    if ((budget != budgets.end()) && (*i)->CanStartOffMainThread()) {
+      (*i)->StartOffMainThread(input_, minimal_changes);
+      if (!(*i)->done())
+        provider_deadlines_[*i] = start_time + budget->second;
+    } else {
+      (*i)->Start(input_, minimal_changes);
+    }
     if (input.matches_requested() != AutocompleteInput::ALL_MATCHES)
       DCHECK((*i)->done());
     base::TimeTicks provider_end_time = base::TimeTicks::Now();
@@ -283,6 +314,7 @@ void AutocompleteController::Start(const AutocompleteInput& input) {
   if (!done_) {
     StartExpireTimer();
     StartStopTimer();
+    StartDeadlineTimer();
   }
 }
 
@@ -294,6 +326,8 @@ void AutocompleteController::Stop(bool clear_result) {
 
   expire_timer_.Stop();
   stop_timer_.Stop();
+  deadline_timer_.Stop();
+  provider_deadlines_.clear();
   done_ = true;
   if (clear_result && !result_.empty()) {
     result_.Reset();
@@ -348,6 +382,7 @@ void AutocompleteController::OnProviderUpdate(bool updated_matches) {
     result_.SortAndCull(input_, profile_);
     NotifyChanged(true);
   } else {
+    RecordFinishedOffMainThreadProviders();
     CheckIfDone();
     // Multiple providers may provide synchronous results, so we only update the
     // results if we're not in Start().
@@ -639,3 +674,62 @@ void AutocompleteController::StartStopTimer() {
                                base::Unretained(this),
                                false));
 }
+
+void AutocompleteController::RecordFinishedOffMainThreadProviders() {
+  for (ProviderDeadlines::iterator i(provider_deadlines_.begin());
+       i != provider_deadlines_.end(); ) {
+    AutocompleteProvider* provider = i->first;
+    if (!provider->done()) {
+      ++i;
+      continue;
+    }
+    // Unlike Omnibox.ProviderTime, which only covers the time spent on the
+    // main thread, this is the time the user waited for the matches.
+    std::string name =
+        std::string("Omnibox.ProviderOffMainThreadTime.") + provider->GetName();
+    base::HistogramBase* counter = base::Histogram::FactoryGet(
+        name, 1, 5000, 20, base::Histogram::kUmaTargetedHistogramFlag);
+    counter->Add(static_cast<int>(
+        (base::TimeTicks::Now() - query_start_time_).InMilliseconds()));
+    RecordProviderMetDeadline(*provider, true);
+    provider_deadlines_.erase(i++);
+  }
+}
+
+void AutocompleteController::OnProviderDeadline() {
+  const base::TimeTicks now = base::TimeTicks::Now();
+  bool stopped_provider = false;
+  for (ProviderDeadlines::iterator i(provider_deadlines_.begin());
+       i != provider_deadlines_.end(); ) {
+    if (i->second > now) {
+      ++i;
+      continue;
+    }
+    // The provider's matches would now arrive too late to be useful, and
+    // waiting for them would hold up the query being done.
+    i->first->Stop(false);
+    RecordProviderMetDeadline(*i->first, false);
+    provider_deadlines_.erase(i++);
+    stopped_provider = true;
+  }
+  if (stopped_provider) {
+    CheckIfDone();
+    if (done_)
+      UpdateResult(false, false);
+  }
+  StartDeadlineTimer();
+}
+
+void AutocompleteController::StartDeadlineTimer() {
+  if (provider_deadlines_.empty())
+    return;
+
+  base::TimeTicks earliest_deadline = provider_deadlines_.begin()->second;
+  for (ProviderDeadlines::const_iterator i(provider_deadlines_.begin());
+       i != provider_deadlines_.end(); ++i)
+    earliest_deadline = std::min(earliest_deadline, i->second);
+  deadline_timer_.Start(
+      FROM_HERE,
+      std::max(earliest_deadline - base::TimeTicks::Now(), base::TimeDelta()),
+      this, &AutocompleteController::OnProviderDeadline);
+}
@@ -5,6 +5,8 @@
 #ifndef CHROME_BROWSER_AUTOCOMPLETE_AUTOCOMPLETE_CONTROLLER_H_
 #define CHROME_BROWSER_AUTOCOMPLETE_AUTOCOMPLETE_CONTROLLER_H_
 
+#include <map>
+
 #include "base/basictypes.h"
 #include "base/compiler_specific.h"
 #include "base/gtest_prod_util.h"
@@ -41,6 +43,12 @@ class ZeroSuggestProvider;
 // happen on the same thread.  AutocompleteProviders are responsible for doing
 // their own thread management when they need to return matches asynchronously.
 //
+// In the OffMainThreadProviders field trial, providers which support it do
+// the work of their synchronous pass on a worker thread, so that the matches
+// of the other providers are shown without waiting for them.  Each such
+// provider has a latency budget; one which has not reported its matches when
+// its budget expires is stopped, and the query completes without it.
+//
 // The coordinator for autocomplete queries, responsible for combining the
 // matches from a series of providers into one AutocompleteResult.
 class AutocompleteController : public AutocompleteProviderListener {
@@ -136,11 +144,17 @@ class AutocompleteController : public AutocompleteProviderListener {
   }
 
  private:
+  friend class AutocompleteControllerPerfTest;
   friend class AutocompleteProviderTest;
   FRIEND_TEST_ALL_PREFIXES(AutocompleteProviderTest,
                            RedundantKeywordsIgnoredInResult);
   FRIEND_TEST_ALL_PREFIXES(AutocompleteProviderTest, UpdateAssistedQueryStats);
   FRIEND_TEST_ALL_PREFIXES(AutocompleteProviderTest, GetDestinationURL);
+  FRIEND_TEST_ALL_PREFIXES(AutocompleteProviderTest, OffMainThreadProviders);
+
+  // The time by which each provider started off the main thread for the
+  // current query must report its matches.
+  typedef std::map<AutocompleteProvider*, base::TimeTicks> ProviderDeadlines;
 
   // Updates |result_| to reflect the current provider state and fires
   // notifications.  If |regenerate_result| then we clear the result
@@ -186,6 +200,19 @@ class AutocompleteController : public AutocompleteProviderListener {
   // Starts |stop_timer_|.
   void StartStopTimer();
 
+  // Records the latency of the providers in |provider_deadlines_| which have
+  // finished, and stops waiting for them.
+  void RecordFinishedOffMainThreadProviders();
+
+  // Stops the providers in |provider_deadlines_| whose deadlines have passed,
+  // updates the result if the query is now done, and restarts
+  // |deadline_timer_| for the remaining deadlines.
+  void OnProviderDeadline();
+
+  // Starts |deadline_timer_| for the earliest of |provider_deadlines_|, if
+  // any.
+  void StartDeadlineTimer();
+
   AutocompleteControllerDelegate* delegate_;
 
   // A list of all providers.
@@ -224,6 +251,17 @@ class AutocompleteController : public AutocompleteProviderListener {
   // Timer used to tell the providers to Stop() searching for matches.
   base::OneShotTimer<AutocompleteController> stop_timer_;
 
+  // The time the current query was started.
+  base::TimeTicks query_start_time_;
+
+  // The providers started off the main thread which have yet to report their
+  // matches for the current query.
+  ProviderDeadlines provider_deadlines_;
+
+  // Timer used to stop the providers in |provider_deadlines_| which miss
+  // their deadlines.
+  base::OneShotTimer<AutocompleteController> deadline_timer_;
+
   // True if the user is in the "stop timer" field trial.  If so, the
   // controller uses the |stop_timer_|.
   const bool in_stop_timer_field_trial_;
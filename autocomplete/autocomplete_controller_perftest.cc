@@ -0,0 +1,461 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how long each keystroke takes to produce a finished
+// AutocompleteResult.  The profile's history, bookmarks, shortcuts and search
+// engines are filled with synthetic data, then typing sessions are replayed
+// through an AutocompleteController the way OmniboxEditModel drives it, one
+// character at a time, and the latency percentiles of each provider and of
+// the whole query are reported.
+//
+// The number of history URLs defaults to 10,000 and can be set, e.g. to
+// 1,000,000, with --omnibox-perf-urls=N; there are a tenth as many bookmarks,
+// a twentieth as many shortcuts and a thousandth as many keywords.  Sessions
+// can be read from the file given by --omnibox-perf-sessions=PATH, which
+// holds one session per line; each character of a line is a keystroke and
+// '<' stands for backspace.
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/command_line.h"
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/message_loop/message_loop.h"
+#include "base/prefs/pref_service.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/autocomplete/autocomplete_controller.h"
+#include "chrome/browser/autocomplete/autocomplete_controller_delegate.h"
+#include "chrome/browser/autocomplete/autocomplete_input.h"
+#include "chrome/browser/autocomplete/autocomplete_provider.h"
+#include "chrome/browser/autocomplete/autocomplete_provider_listener.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+#include "chrome/browser/bookmarks/bookmark_model_factory.h"
+#include "chrome/browser/history/history_backend.h"
+#include "chrome/browser/history/history_service.h"
+#include "chrome/browser/history/history_service_factory.h"
+#include "chrome/browser/history/in_memory_url_index.h"
+#include "chrome/browser/history/shortcuts_backend.h"
+#include "chrome/browser/history/shortcuts_backend_factory.h"
+#include "chrome/browser/search_engines/template_url.h"
+#include "chrome/browser/search_engines/template_url_service.h"
+#include "chrome/browser/search_engines/template_url_service_factory.h"
+#include "chrome/common/pref_names.h"
+#include "chrome/test/base/testing_profile.h"
+#include "chrome/test/base/ui_test_utils.h"
+#include "chrome/test/perf/perf_test.h"
+#include "content/public/test/test_browser_thread_bundle.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+const char kNumURLsSwitch[] = "omnibox-perf-urls";
+const char kSessionsSwitch[] = "omnibox-perf-sessions";
+
+const int kDefaultNumURLs = 10000;
+
+// Stands for backspace in a typing session.
+const char kBackspace = '<';
+
+const char* kWords[] = {
+  "news", "mail", "search", "video", "shop", "travel", "sports", "weather",
+  "music", "photos", "maps", "docs", "blog", "forum", "wiki", "games",
+  "finance", "health", "recipes", "movies", "books", "jobs", "cars", "homes",
+};
+
+// Used when no sessions file is given.  They mix URL-like and query-like
+// input, corrections and keyword searches.
+const char* kDefaultSessions[] = {
+  "www.news12.com",
+  "mail",
+  "weather paris",
+  "shop<<<<travel deals",
+  "kw3.com recipes",
+  "http://www.wiki",
+  "music videos 2013",
+  "fin<<<<health forum",
+};
+
+typedef std::vector<base::TimeDelta> LatencySamples;
+
+// Stands in for |provider| in the controller so that the time each query
+// takes the provider, from Start() until it is done, can be recorded in
+// |samples|.  Everything else is forwarded to |provider|.
+class TimedProvider : public AutocompleteProvider,
+                      public AutocompleteProviderListener {
+ public:
+  TimedProvider(AutocompleteProviderListener* listener,
+                AutocompleteProvider* provider,
+                LatencySamples* samples)
+      : AutocompleteProvider(listener, NULL, provider->type()),
+        provider_(provider),
+        samples_(samples),
+        recorded_(true) {
+    provider_->set_listener(this);
+  }
+
+  // AutocompleteProvider:
+  virtual void Start(const AutocompleteInput& input,
+                     bool minimal_changes) OVERRIDE {
+    start_time_ = base::TimeTicks::Now();
+    recorded_ = false;
+    provider_->Start(input, minimal_changes);
+    CopyProviderState();
+  }
+
+  virtual bool CanStartOffMainThread() const OVERRIDE {
+    return provider_->CanStartOffMainThread();
+  }
+
+  virtual void StartOffMainThread(const AutocompleteInput& input,
+                                  bool minimal_changes) OVERRIDE {
+    start_time_ = base::TimeTicks::Now();
+    recorded_ = false;
+    provider_->StartOffMainThread(input, minimal_changes);
+    CopyProviderState();
+  }
+
+  virtual void Stop(bool clear_cached_results) OVERRIDE {
+    provider_->Stop(clear_cached_results);
+    matches_ = provider_->matches();
+    done_ = true;
+    // A stopped query never finished, so its latency is not recorded.
+    recorded_ = true;
+  }
+
+  virtual void DeleteMatch(const AutocompleteMatch& match) OVERRIDE {
+    provider_->DeleteMatch(match);
+  }
+
+  virtual void AddProviderInfo(ProvidersInfo* provider_info) const OVERRIDE {
+    provider_->AddProviderInfo(provider_info);
+  }
+
+  virtual void ResetSession() OVERRIDE {
+    provider_->ResetSession();
+  }
+
+  // AutocompleteProviderListener:
+  virtual void OnProviderUpdate(bool updated_matches) OVERRIDE {
+    CopyProviderState();
+    listener_->OnProviderUpdate(updated_matches);
+  }
+
+ private:
+  virtual ~TimedProvider() {}
+
+  // Takes on the matches and state of |provider_|, recording the latency of
+  // the query if the provider has just finished it.
+  void CopyProviderState() {
+    matches_ = provider_->matches();
+    done_ = provider_->done();
+    if (done_ && !recorded_) {
+      samples_->push_back(base::TimeTicks::Now() - start_time_);
+      recorded_ = true;
+    }
+  }
+
+  scoped_refptr<AutocompleteProvider> provider_;
+  LatencySamples* samples_;
+  base::TimeTicks start_time_;
+  // Whether the latency of the current query has been recorded.
+  bool recorded_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimedProvider);
+};
+
+// Prints the 50th, 95th and 99th percentiles of |samples|, in microseconds.
+void PrintPercentiles(const std::string& trace,
+                      LatencySamples* samples,
+                      bool important) {
+  if (samples->empty())
+    return;
+  std::sort(samples->begin(), samples->end());
+  const size_t kPercentiles[] = { 50, 95, 99 };
+  for (size_t i = 0; i < arraysize(kPercentiles); ++i) {
+    const size_t index = std::min(samples->size() - 1,
+                                  samples->size() * kPercentiles[i] / 100);
+    perf_test::PrintResult(
+        "omnibox_keystroke_latency",
+        base::StringPrintf("_p%d", static_cast<int>(kPercentiles[i])), trace,
+        static_cast<size_t>((*samples)[index].InMicroseconds()), "us",
+        important);
+  }
+}
+
+}  // namespace
+
+class AutocompleteControllerPerfTest : public testing::Test,
+                                       public AutocompleteControllerDelegate {
+ public:
+  AutocompleteControllerPerfTest() : num_urls_(kDefaultNumURLs) {}
+
+  // AutocompleteControllerDelegate:
+  virtual void OnResultChanged(bool default_match_changed) OVERRIDE {
+    if (controller_->done() && base::MessageLoop::current()->is_running())
+      base::MessageLoop::current()->Quit();
+  }
+
+ protected:
+  virtual void SetUp() OVERRIDE;
+  virtual void TearDown() OVERRIDE;
+
+  // Fills the history database with |num_urls_| synthetic URLs and rebuilds
+  // the in-memory URL index from it.
+  void FillHistory();
+
+  // Fills the bookmark model, the shortcuts backend and the template URL
+  // service.
+  void FillBookmarks();
+  void FillShortcuts();
+  void FillTemplateURLs();
+
+  // Creates |controller_| with timed stand-ins for its providers.
+  void CreateController();
+
+  // Returns the typing sessions to replay.
+  std::vector<std::string> GetSessions();
+
+  // Types |session| one keystroke at a time, waiting for each query to finish
+  // and recording its latency in |query_samples_|.
+  void ReplaySession(const std::string& session);
+
+  // Returns the synthetic URL and title of the |index|th history item.
+  static GURL URLForIndex(int index);
+  static string16 TitleForIndex(int index);
+
+  content::TestBrowserThreadBundle thread_bundle_;
+  TestingProfile profile_;
+  int num_urls_;
+  scoped_ptr<AutocompleteController> controller_;
+
+  // Keyed by provider name.
+  std::map<std::string, LatencySamples> provider_samples_;
+  LatencySamples query_samples_;
+};
+
+void AutocompleteControllerPerfTest::SetUp() {
+  const CommandLine* command_line = CommandLine::ForCurrentProcess();
+  if (command_line->HasSwitch(kNumURLsSwitch)) {
+    ASSERT_TRUE(base::StringToInt(
+        command_line->GetSwitchValueASCII(kNumURLsSwitch), &num_urls_));
+    ASSERT_GT(num_urls_, 0);
+  }
+
+  ASSERT_TRUE(profile_.CreateHistoryService(true, false));
+  profile_.CreateBookmarkModel(true);
+  ui_test_utils::WaitForBookmarkModelToLoad(&profile_);
+  ShortcutsBackendFactory::GetInstance()->SetTestingFactoryAndUse(
+      &profile_, &ShortcutsBackendFactory::BuildProfileNoDatabaseForTesting);
+  TemplateURLServiceFactory::GetInstance()->SetTestingFactoryAndUse(
+      &profile_, &TemplateURLServiceFactory::BuildInstanceFor);
+  // Suggest requests would measure the network rather than the omnibox.
+  profile_.GetPrefs()->SetBoolean(prefs::kSearchSuggestEnabled, false);
+
+  base::TimeTicks fill_start = base::TimeTicks::Now();
+  FillTemplateURLs();
+  FillHistory();
+  FillBookmarks();
+  FillShortcuts();
+  perf_test::PrintResult("omnibox_fill_time", "", "all",
+                         static_cast<size_t>(
+                             (base::TimeTicks::Now() - fill_start).
+                                 InMilliseconds()),
+                         "ms", false);
+  CreateController();
+}
+
+void AutocompleteControllerPerfTest::TearDown() {
+  controller_.reset();
+  base::MessageLoop::current()->RunUntilIdle();
+}
+
+// static
+GURL AutocompleteControllerPerfTest::URLForIndex(int index) {
+  // A fixed hash of |index| keeps the data reproducible.
+  const uint32 seed = static_cast<uint32>(index) * 2654435761U;
+  return GURL(base::StringPrintf(
+      "http://www.%s%u.com/%s/%d", kWords[(seed >> 8) % arraysize(kWords)],
+      (seed >> 4) % 1000, kWords[(seed >> 16) % arraysize(kWords)], index));
+}
+
+// static
+string16 AutocompleteControllerPerfTest::TitleForIndex(int index) {
+  const uint32 seed = static_cast<uint32>(index) * 2654435761U;
+  return UTF8ToUTF16(base::StringPrintf(
+      "%s and %s %d", kWords[(seed >> 16) % arraysize(kWords)],
+      kWords[(seed >> 8) % arraysize(kWords)], index % 100));
+}
+
+void AutocompleteControllerPerfTest::FillHistory() {
+  HistoryService* history_service = HistoryServiceFactory::GetForProfile(
+      &profile_, Profile::EXPLICIT_ACCESS);
+  ASSERT_TRUE(history_service);
+  const base::Time now = base::Time::Now();
+  const int kBatchSize = 10000;
+  for (int batch_start = 0; batch_start < num_urls_;
+       batch_start += kBatchSize) {
+    history::URLRows rows;
+    for (int i = batch_start;
+         i < std::min(num_urls_, batch_start + kBatchSize); ++i) {
+      const uint32 seed = static_cast<uint32>(i) * 2654435761U;
+      history::URLRow row(URLForIndex(i));
+      row.set_title(TitleForIndex(i));
+      row.set_visit_count(1 + (seed >> 20) % 20);
+      row.set_typed_count((seed >> 24) % 3);
+      row.set_last_visit(now - base::TimeDelta::FromHours((seed >> 12) % 2000));
+      rows.push_back(row);
+    }
+    history_service->AddPagesWithDetails(rows, history::SOURCE_BROWSED);
+  }
+  profile_.BlockUntilHistoryProcessesPendingRequests();
+  // Only typed URLs reach the index through notifications, so rebuild it from
+  // the database as happens when history is loaded.
+  history_service->InMemoryIndex()->RebuildFromHistory(
+      history_service->history_backend_->db());
+}
+
+void AutocompleteControllerPerfTest::FillBookmarks() {
+  BookmarkModel* model = BookmarkModelFactory::GetForProfile(&profile_);
+  ASSERT_TRUE(model);
+  const BookmarkNode* parent = model->other_node();
+  for (int i = 0; i < num_urls_; i += 10)
+    model->AddURL(parent, parent->child_count(), TitleForIndex(i),
+                  URLForIndex(i));
+}
+
+void AutocompleteControllerPerfTest::FillShortcuts() {
+  scoped_refptr<history::ShortcutsBackend> backend =
+      ShortcutsBackendFactory::GetForProfile(&profile_);
+  ASSERT_TRUE(backend.get());
+  const base::Time now = base::Time::Now();
+  for (int i = 0; i < num_urls_; i += 20) {
+    const GURL url(URLForIndex(i));
+    const string16 contents(UTF8ToUTF16(url.spec()));
+    const string16 description(TitleForIndex(i));
+    // The text the user typed to reach the URL is a prefix of its host.
+    history::ShortcutsBackend::Shortcut shortcut(
+        base::StringPrintf("%08d-0000-0000-0000-000000000000", i),
+        UTF8ToUTF16(url.host().substr(4, 3)), url,
+        contents,
+        AutocompleteMatch::ClassificationsFromString("0,1"),
+        description,
+        AutocompleteMatch::ClassificationsFromString("0,0"),
+        now - base::TimeDelta::FromDays(i % 30), 1 + i % 5);
+    backend->AddShortcut(shortcut);
+  }
+}
+
+void AutocompleteControllerPerfTest::FillTemplateURLs() {
+  TemplateURLService* turl_model =
+      TemplateURLServiceFactory::GetForProfile(&profile_);
+  ASSERT_TRUE(turl_model);
+  TemplateURLData data;
+  data.short_name = ASCIIToUTF16("default");
+  data.SetKeyword(ASCIIToUTF16("default.com"));
+  data.SetURL("http://default.com/search?q={searchTerms}");
+  TemplateURL* default_t_url = new TemplateURL(&profile_, data);
+  turl_model->Add(default_t_url);
+  turl_model->SetDefaultSearchProvider(default_t_url);
+  for (int i = 0; i < std::max(num_urls_ / 1000, 10); ++i) {
+    data.short_name = ASCIIToUTF16(base::StringPrintf("kw%d", i));
+    data.SetKeyword(ASCIIToUTF16(base::StringPrintf("kw%d.com", i)));
+    data.SetURL(base::StringPrintf("http://kw%d.com/?q={searchTerms}", i));
+    turl_model->Add(new TemplateURL(&profile_, data));
+  }
+  turl_model->Load();
+}
+
+void AutocompleteControllerPerfTest::CreateController() {
+  // The providers of AutocompleteClassifier::kDefaultOmniboxProviders, apart
+  // from ZeroSuggest, which only runs before the user types.
+  controller_.reset(new AutocompleteController(
+      &profile_, this,
+      AutocompleteProvider::TYPE_BOOKMARK |
+          AutocompleteProvider::TYPE_BUILTIN |
+          AutocompleteProvider::TYPE_HISTORY_QUICK |
+          AutocompleteProvider::TYPE_HISTORY_URL |
+          AutocompleteProvider::TYPE_KEYWORD |
+          AutocompleteProvider::TYPE_SEARCH |
+          AutocompleteProvider::TYPE_SHORTCUTS));
+  for (ACProviders::iterator i(controller_->providers_.begin());
+       i != controller_->providers_.end(); ++i) {
+    TimedProvider* timed_provider = new TimedProvider(
+        controller_.get(), *i, &provider_samples_[(*i)->GetName()]);
+    timed_provider->AddRef();
+    // |timed_provider| holds its own reference to the original provider.
+    (*i)->Release();
+    *i = timed_provider;
+  }
+}
+
+std::vector<std::string> AutocompleteControllerPerfTest::GetSessions() {
+  std::vector<std::string> sessions;
+  const CommandLine* command_line = CommandLine::ForCurrentProcess();
+  if (command_line->HasSwitch(kSessionsSwitch)) {
+    std::string contents;
+    EXPECT_TRUE(file_util::ReadFileToString(
+        command_line->GetSwitchValuePath(kSessionsSwitch), &contents));
+    base::SplitString(contents, '\n', &sessions);
+    sessions.erase(std::remove(sessions.begin(), sessions.end(),
+                               std::string()),
+                   sessions.end());
+  } else {
+    sessions.assign(kDefaultSessions,
+                    kDefaultSessions + arraysize(kDefaultSessions));
+  }
+  return sessions;
+}
+
+void AutocompleteControllerPerfTest::ReplaySession(
+    const std::string& session) {
+  controller_->ResetSession();
+  string16 text;
+  for (size_t i = 0; i < session.length(); ++i) {
+    if (session[i] == kBackspace) {
+      if (text.empty())
+        continue;
+      text.erase(text.length() - 1);
+    } else {
+      text.push_back(static_cast<char16>(session[i]));
+    }
+    if (text.empty())
+      continue;
+
+    // This is what OmniboxEditModel::StartAutocomplete() asks for while the
+    // user types.
+    base::TimeTicks start_time = base::TimeTicks::Now();
+    controller_->Start(AutocompleteInput(
+        text, string16::npos, string16(), GURL(), AutocompleteInput::OTHER,
+        false, false, true, AutocompleteInput::ALL_MATCHES));
+    if (!controller_->done())
+      base::MessageLoop::current()->Run();
+    query_samples_.push_back(base::TimeTicks::Now() - start_time);
+  }
+  controller_->Stop(true);
+}
+
+TEST_F(AutocompleteControllerPerfTest, TypingSessions) {
+  const std::vector<std::string> sessions = GetSessions();
+  ASSERT_FALSE(sessions.empty());
+  for (std::vector<std::string>::const_iterator session = sessions.begin();
+       session != sessions.end(); ++session)
+    ReplaySession(*session);
+
+  const std::string scale = base::IntToString(num_urls_) + "_urls";
+  PrintPercentiles("total_" + scale, &query_samples_, true);
+  for (std::map<std::string, LatencySamples>::iterator i =
+           provider_samples_.begin();
+       i != provider_samples_.end(); ++i)
+    PrintPercentiles(i->first + "_" + scale, &i->second, false);
+}
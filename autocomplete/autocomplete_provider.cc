@@ -60,6 +60,15 @@ const char* AutocompleteProvider::TypeToString(Type type) {
   }
 }
 
+bool AutocompleteProvider::CanStartOffMainThread() const {
+  return false;
+}
+
+void AutocompleteProvider::StartOffMainThread(const AutocompleteInput& input,
+                                              bool minimal_changes) {
+  NOTREACHED();
+}
+
 void AutocompleteProvider::Stop(bool clear_cached_results) {
   done_ = true;
 }
@@ -178,6 +178,18 @@ class AutocompleteProvider
   // OmniboxPopupModel::StartAutocomplete().
   virtual void Start(const AutocompleteInput& input, bool minimal_changes) = 0;
 
+  // Returns whether the provider can do the work of its synchronous pass on
+  // a worker thread, i.e. whether StartOffMainThread() may be called.
+  virtual bool CanStartOffMainThread() const;
+
+  // Like Start(), except that matching is done on a worker thread instead of
+  // before this returns.  The provider is not done() on return unless it has
+  // nothing to do; its matches are reported through OnProviderUpdate() as an
+  // asynchronous provider's would be.  Called only for queries requesting
+  // ALL_MATCHES, and only if CanStartOffMainThread() returns true.
+  virtual void StartOffMainThread(const AutocompleteInput& input,
+                                  bool minimal_changes);
+
   // Called when a provider must not make any more callbacks for the current
   // query. This will be called regardless of whether the provider is already
   // done.  If the provider caches any results, it should clear the cache based
@@ -8,6 +8,7 @@
 #include "base/command_line.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/message_loop/message_loop.h"
+#include "base/metrics/field_trial.h"
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
@@ -19,10 +20,12 @@
 #include "chrome/browser/autocomplete/keyword_provider.h"
 #include "chrome/browser/autocomplete/search_provider.h"
 #include "chrome/browser/chrome_notification_types.h"
+#include "chrome/browser/omnibox/omnibox_field_trial.h"
 #include "chrome/browser/search_engines/template_url.h"
 #include "chrome/browser/search_engines/template_url_service.h"
 #include "chrome/browser/search_engines/template_url_service_factory.h"
 #include "chrome/common/chrome_switches.h"
+#include "chrome/common/metrics/variations/variations_util.h"
 #include "chrome/test/base/testing_browser_process.h"
 #include "chrome/test/base/testing_profile.h"
 #include "content/public/browser/notification_observer.h"
@@ -147,6 +150,82 @@ void TestProvider::AddResultsWithSearchTermsArgs(
   }
 }
 
+// Autocomplete provider which, when started off the main thread, reports one
+// match later on if |reports_matches|.  Started on the main thread, it has no
+// matches.
+class OffMainThreadTestProvider : public AutocompleteProvider {
+ public:
+  OffMainThreadTestProvider(Type type,
+                            int relevance,
+                            const string16& fill_into_edit,
+                            bool reports_matches,
+                            Profile* profile)
+      : AutocompleteProvider(NULL, profile, type),
+        relevance_(relevance),
+        fill_into_edit_(fill_into_edit),
+        reports_matches_(reports_matches),
+        stopped_(false) {
+  }
+
+  virtual void Start(const AutocompleteInput& input,
+                     bool minimal_changes) OVERRIDE {
+    matches_.clear();
+    done_ = true;
+  }
+
+  virtual bool CanStartOffMainThread() const OVERRIDE { return true; }
+
+  virtual void StartOffMainThread(const AutocompleteInput& input,
+                                  bool minimal_changes) OVERRIDE {
+    matches_.clear();
+    done_ = false;
+    if (reports_matches_) {
+      base::MessageLoop::current()->PostTask(
+          FROM_HERE, base::Bind(&OffMainThreadTestProvider::Run, this));
+    }
+  }
+
+  virtual void Stop(bool clear_cached_results) OVERRIDE {
+    if (!done_)
+      stopped_ = true;
+    AutocompleteProvider::Stop(clear_cached_results);
+  }
+
+  void set_listener(AutocompleteProviderListener* listener) {
+    listener_ = listener;
+  }
+
+  // Whether the provider was stopped before reporting its matches.
+  bool stopped() const { return stopped_; }
+
+ private:
+  virtual ~OffMainThreadTestProvider() {}
+
+  void Run() {
+    if (done_)
+      return;
+    AutocompleteMatch match(this, relevance_, false,
+                            AutocompleteMatchType::HISTORY_URL);
+    match.fill_into_edit = fill_into_edit_;
+    match.destination_url = GURL(UTF16ToUTF8(fill_into_edit_));
+    match.allowed_to_be_default_match = true;
+    match.contents = fill_into_edit_;
+    match.contents_class.push_back(
+        ACMatchClassification(0, ACMatchClassification::NONE));
+    match.description = fill_into_edit_;
+    match.description_class.push_back(
+        ACMatchClassification(0, ACMatchClassification::NONE));
+    matches_.push_back(match);
+    done_ = true;
+    listener_->OnProviderUpdate(true);
+  }
+
+  const int relevance_;
+  const string16 fill_into_edit_;
+  const bool reports_matches_;
+  bool stopped_;
+};
+
 class AutocompleteProviderTest : public testing::Test,
                                  public content::NotificationObserver {
  protected:
@@ -186,6 +265,14 @@ class AutocompleteProviderTest : public testing::Test,
 
   void ResetControllerWithKeywordAndSearchProviders();
   void ResetControllerWithKeywordProvider();
+
+  // Resets |controller_| with a TestProvider and two providers which run off
+  // the main thread: |reporting_provider|, a HistoryQuick provider which
+  // reports a match, and |silent_provider|, a Bookmark provider which never
+  // does.
+  void ResetControllerWithOffMainThreadProviders(
+      OffMainThreadTestProvider** reporting_provider,
+      OffMainThreadTestProvider** silent_provider);
   void RunExactKeymatchTest(bool allow_exact_keyword_match);
 
   void CopyResults();
@@ -336,6 +423,40 @@ void AutocompleteProviderTest::ResetControllerWithKeywordProvider() {
       &profile_, NULL, AutocompleteProvider::TYPE_KEYWORD));
 }
 
+void AutocompleteProviderTest::ResetControllerWithOffMainThreadProviders(
+    OffMainThreadTestProvider** reporting_provider,
+    OffMainThreadTestProvider** silent_provider) {
+  RegisterTemplateURL(ASCIIToUTF16(kTestTemplateURLKeyword),
+                      "http://aqs/{searchTerms}/{google:assistedQueryStats}");
+
+  ACProviders providers;
+  TestProvider* test_provider = new TestProvider(
+      kResultsPerProvider, ASCIIToUTF16("http://a"), &profile_, string16());
+  test_provider->AddRef();
+  providers.push_back(test_provider);
+  *reporting_provider = new OffMainThreadTestProvider(
+      AutocompleteProvider::TYPE_HISTORY_QUICK, 1000,
+      ASCIIToUTF16("http://quick/"), true, &profile_);
+  (*reporting_provider)->AddRef();
+  providers.push_back(*reporting_provider);
+  *silent_provider = new OffMainThreadTestProvider(
+      AutocompleteProvider::TYPE_BOOKMARK, 1000,
+      ASCIIToUTF16("http://bookmark/"), false, &profile_);
+  (*silent_provider)->AddRef();
+  providers.push_back(*silent_provider);
+
+  controller_.reset(new AutocompleteController(&profile_, NULL, 0));
+  EXPECT_TRUE(controller_->providers_.empty());
+  controller_->providers_.swap(providers);
+  test_provider->set_listener(controller_.get());
+  (*reporting_provider)->set_listener(controller_.get());
+  (*silent_provider)->set_listener(controller_.get());
+
+  registrar_.Add(this,
+                 chrome::NOTIFICATION_AUTOCOMPLETE_CONTROLLER_RESULT_READY,
+                 content::Source<AutocompleteController>(controller_.get()));
+}
+
 void AutocompleteProviderTest::RunTest() {
   RunQuery(ASCIIToUTF16("a"));
 }
@@ -656,3 +777,57 @@ TEST_F(AutocompleteProviderTest, GetDestinationURL) {
                                        base::TimeDelta::FromMilliseconds(2456));
   EXPECT_EQ("//aqs=chrome.0.69i57j69i58j5l2j0l3j69i59.2456j1j4&", url.path());
 }
+
+// Tests that providers with a latency budget are started off the main thread,
+// that the other providers' matches are published without waiting for them,
+// and that a provider which misses its deadline is stopped.
+TEST_F(AutocompleteProviderTest, OffMainThreadProviders) {
+  base::FieldTrialList field_trial_list(NULL);
+  {
+    std::map<std::string, std::string> params;
+    params[std::string(OmniboxFieldTrial::kOffMainThreadProvidersRule) +
+           ":*:*"] =
+        base::IntToString(AutocompleteProvider::TYPE_HISTORY_QUICK) +
+        ":60000," + base::IntToString(AutocompleteProvider::TYPE_BOOKMARK) +
+        ":0";
+    ASSERT_TRUE(chrome_variations::AssociateVariationParams(
+        OmniboxFieldTrial::kBundledExperimentFieldTrialName, "A", params));
+  }
+  base::FieldTrialList::CreateFieldTrial(
+      OmniboxFieldTrial::kBundledExperimentFieldTrialName, "A");
+
+  OffMainThreadTestProvider* reporting_provider = NULL;
+  OffMainThreadTestProvider* silent_provider = NULL;
+  ResetControllerWithOffMainThreadProviders(&reporting_provider,
+                                            &silent_provider);
+
+  controller_->Start(AutocompleteInput(
+      ASCIIToUTF16("a"), string16::npos, string16(), GURL(),
+      AutocompleteInput::INVALID_SPEC, true, false, true,
+      AutocompleteInput::ALL_MATCHES));
+  // Only the synchronous match of the TestProvider is available so far.
+  EXPECT_FALSE(controller_->done());
+  EXPECT_EQ(2u, controller_->provider_deadlines_.size());
+  ASSERT_EQ(1u, controller_->result().size());
+  EXPECT_EQ(AutocompleteProvider::TYPE_SEARCH,
+            controller_->result().match_at(0)->provider->type());
+
+  base::MessageLoop::current()->Run();
+  EXPECT_TRUE(controller_->done());
+  EXPECT_TRUE(controller_->provider_deadlines_.empty());
+  EXPECT_FALSE(reporting_provider->stopped());
+  EXPECT_TRUE(silent_provider->stopped());
+  ASSERT_NE(result_.end(), result_.default_match());
+  EXPECT_EQ(reporting_provider, result_.default_match()->provider);
+  for (size_t i = 0; i < result_.size(); ++i)
+    EXPECT_NE(silent_provider, result_.match_at(i)->provider);
+
+  // Queries which need their matches synchronously run every provider on the
+  // main thread.
+  controller_->Start(AutocompleteInput(
+      ASCIIToUTF16("a"), string16::npos, string16(), GURL(),
+      AutocompleteInput::INVALID_SPEC, true, false, true,
+      AutocompleteInput::BEST_MATCH));
+  EXPECT_TRUE(controller_->done());
+  EXPECT_TRUE(controller_->provider_deadlines_.empty());
+}
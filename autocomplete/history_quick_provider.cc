@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/i18n/break_iterator.h"
 #include "base/logging.h"
@@ -61,21 +62,9 @@ HistoryQuickProvider::HistoryQuickProvider(
 
 void HistoryQuickProvider::Start(const AutocompleteInput& input,
                                  bool minimal_changes) {
-  matches_.clear();
-  if (disabled_)
-    return;
-
-  // Don't bother with INVALID and FORCED_QUERY.  Also pass when looking for
-  // BEST_MATCH and there is no inline autocompletion because none of the HQP
-  // matches can score highly enough to qualify.
-  if ((input.type() == AutocompleteInput::INVALID) ||
-      (input.type() == AutocompleteInput::FORCED_QUERY) ||
-      (input.matches_requested() == AutocompleteInput::BEST_MATCH &&
-       input.prevent_inline_autocomplete()))
+  if (!StartQuery(input))
     return;
 
-  autocomplete_input_ = input;
-
   // TODO(pkasting): We should just block here until this loads.  Any time
   // someone unloads the history backend, we'll get inconsistent inline
   // autocomplete behavior here.
@@ -94,6 +83,33 @@ void HistoryQuickProvider::Start(const AutocompleteInput& input,
   }
 }
 
+bool HistoryQuickProvider::CanStartOffMainThread() const {
+  return true;
+}
+
+void HistoryQuickProvider::StartOffMainThread(const AutocompleteInput& input,
+                                              bool minimal_changes) {
+  if (!StartQuery(input))
+    return;
+
+  history::InMemoryURLIndex* index = GetIndex();
+  if (!index)
+    return;
+  done_ = false;
+  index->StartHistoryItemsForTerms(
+      autocomplete_input_.text(),
+      autocomplete_input_.cursor_position(),
+      cancel_flag_.get(),
+      base::Bind(&HistoryQuickProvider::OnHistoryItemsForTerms, this,
+                 cancel_flag_));
+}
+
+void HistoryQuickProvider::Stop(bool clear_cached_results) {
+  if (cancel_flag_.get())
+    cancel_flag_->Cancel();
+  HistoryProvider::Stop(clear_cached_results);
+}
+
 void HistoryQuickProvider::DeleteMatch(const AutocompleteMatch& match) {
   DCHECK(match.deletable);
   DCHECK(match.destination_url.is_valid());
@@ -104,11 +120,51 @@ void HistoryQuickProvider::DeleteMatch(const AutocompleteMatch& match) {
 
 HistoryQuickProvider::~HistoryQuickProvider() {}
 
+bool HistoryQuickProvider::StartQuery(const AutocompleteInput& input) {
+  matches_.clear();
+  done_ = true;
+  // A new query supersedes any still being scored.
+  if (cancel_flag_.get())
+    cancel_flag_->Cancel();
+  cancel_flag_ = new history::ScoringCancellationFlag;
+  if (disabled_)
+    return false;
+
+  // Don't bother with INVALID and FORCED_QUERY.  Also pass when looking for
+  // BEST_MATCH and there is no inline autocompletion because none of the HQP
+  // matches can score highly enough to qualify.
+  if ((input.type() == AutocompleteInput::INVALID) ||
+      (input.type() == AutocompleteInput::FORCED_QUERY) ||
+      (input.matches_requested() == AutocompleteInput::BEST_MATCH &&
+       input.prevent_inline_autocomplete()))
+    return false;
+
+  autocomplete_input_ = input;
+  return true;
+}
+
+void HistoryQuickProvider::OnHistoryItemsForTerms(
+    scoped_refptr<history::ScoringCancellationFlag> cancel_flag,
+    const ScoredHistoryMatches& matches) {
+  // Stop() or a newer query has superseded the one these matches are for.
+  if (cancel_flag->IsCanceled())
+    return;
+  DCHECK_EQ(cancel_flag_.get(), cancel_flag.get());
+  AddMatches(matches);
+  UpdateStarredStateOfMatches();
+  done_ = true;
+  listener_->OnProviderUpdate(!matches_.empty());
+}
+
 void HistoryQuickProvider::DoAutocomplete() {
   // Get the matching URLs from the DB.
-  ScoredHistoryMatches matches = GetIndex()->HistoryItemsForTerms(
+  AddMatches(GetIndex()->HistoryItemsForTerms(
       autocomplete_input_.text(),
-      autocomplete_input_.cursor_position());
+      autocomplete_input_.cursor_position(),
+      cancel_flag_.get()));
+}
+
+void HistoryQuickProvider::AddMatches(const ScoredHistoryMatches& matches) {
   if (matches.empty())
     return;
 
@@ -14,6 +14,7 @@
 #include "chrome/browser/autocomplete/history_provider.h"
 #include "chrome/browser/history/history_types.h"
 #include "chrome/browser/history/in_memory_url_index.h"
+#include "chrome/browser/history/parallel_scoring.h"
 
 class Profile;
 class TermMatches;
@@ -36,6 +37,15 @@ class HistoryQuickProvider : public HistoryProvider {
   virtual void Start(const AutocompleteInput& input,
                      bool minimal_changes) OVERRIDE;
 
+  // Scores the history matches on a worker thread; the conversion to
+  // AutocompleteMatches is done on the calling thread once they arrive.
+  virtual bool CanStartOffMainThread() const OVERRIDE;
+  virtual void StartOffMainThread(const AutocompleteInput& input,
+                                  bool minimal_changes) OVERRIDE;
+
+  // Cancels the scoring of the current query, if any is still in progress.
+  virtual void Stop(bool clear_cached_results) OVERRIDE;
+
   virtual void DeleteMatch(const AutocompleteMatch& match) OVERRIDE;
 
   // Disable this provider. For unit testing purposes only. This is required
@@ -52,9 +62,23 @@ class HistoryQuickProvider : public HistoryProvider {
 
   virtual ~HistoryQuickProvider();
 
+  // Supersedes the previous query with the one for |input|. Returns false if
+  // there is nothing to look up for |input|.
+  bool StartQuery(const AutocompleteInput& input);
+
+  // Receives the history matches of a query started by StartOffMainThread()
+  // and notifies the listener, unless |cancel_flag| shows that the query has
+  // been superseded or stopped.
+  void OnHistoryItemsForTerms(
+      scoped_refptr<history::ScoringCancellationFlag> cancel_flag,
+      const history::ScoredHistoryMatches& matches);
+
   // Performs the autocomplete matching and scoring.
   void DoAutocomplete();
 
+  // Converts the history matches |matches| into matches_.
+  void AddMatches(const history::ScoredHistoryMatches& matches);
+
   // Creates an AutocompleteMatch from |history_match|, assigning it
   // the score |score|.
   AutocompleteMatch QuickMatchToACMatch(
@@ -79,6 +103,10 @@ class HistoryQuickProvider : public HistoryProvider {
   AutocompleteInput autocomplete_input_;
   std::string languages_;
 
+  // Set when the query it was created for is superseded, so that the index
+  // stops scoring that query's candidates.
+  scoped_refptr<history::ScoringCancellationFlag> cancel_flag_;
+
   // Only used for testing.
   scoped_ptr<history::InMemoryURLIndex> index_for_testing_;
 
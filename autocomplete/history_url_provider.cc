@@ -21,6 +21,7 @@
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/history/history_types.h"
+#include "chrome/browser/history/url_trigram_index.h"
 #include "chrome/browser/omnibox/omnibox_field_trial.h"
 #include "chrome/browser/profiles/profile.h"
 #include "chrome/browser/search_engines/template_url_service.h"
@@ -299,6 +300,7 @@ HistoryURLProviderParams::HistoryURLProviderParams(
       input(input),
       prevent_inline_autocomplete(input.prevent_inline_autocomplete()),
       trim_http(trim_http),
+      trigram_index(NULL),
       failed(false),
       languages(languages),
       dont_suggest_exact_input(false),
@@ -472,11 +474,15 @@ void HistoryURLProvider::DoAutocomplete(history::HistoryBackend* backend,
       // prefix type, in hopes this will give us far more than enough
       // to work with.  CullRedirects() will then reduce the list to
       // the best kMaxMatches results.
-      db->AutocompleteForPrefix(
-          UTF16ToUTF8(i->prefix + params->input.text()),
-          kMaxMatches * 2,
-          (backend == NULL),
-          &url_matches);
+      const std::string prefix(UTF16ToUTF8(i->prefix + params->input.text()));
+      if (params->trigram_index &&
+          history::URLTrigramIndex::IsSelectivePrefix(prefix)) {
+        params->trigram_index->AutocompleteForPrefix(
+            prefix, kMaxMatches * 2, (backend == NULL), &url_matches);
+      } else {
+        db->AutocompleteForPrefix(
+            prefix, kMaxMatches * 2, (backend == NULL), &url_matches);
+      }
       for (history::URLRows::const_iterator j(url_matches.begin());
            j != url_matches.end(); ++j) {
         const URLPrefix* best_prefix =
@@ -686,7 +692,9 @@ void HistoryURLProvider::RunAutocompletePasses(
     // someone unloads the history backend, we'll get inconsistent inline
     // autocomplete behavior here.
     if (url_db) {
+      params->trigram_index = history_service->InMemoryTrigramIndex();
       DoAutocomplete(NULL, url_db, params.get());
+      params->trigram_index = NULL;
       // params->matches now has the matches we should expose to the provider.
       // Pass 2 expects a "clean slate" set of matches.
       matches_.clear();
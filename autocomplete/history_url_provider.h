@@ -26,6 +26,7 @@ class MessageLoop;
 namespace history {
 class HistoryBackend;
 class URLDatabase;
+class URLTrigramIndex;
 }
 
 // How history autocomplete works
@@ -41,7 +42,8 @@ class URLDatabase;
 //         -> SuggestExactInput
 //         [params_ allocated]
 //         -> DoAutocomplete (for inline autocomplete)
-//           -> URLDatabase::AutocompleteForPrefix (on in-memory DB)
+//           -> URLTrigramIndex::AutocompleteForPrefix (or, failing that,
+//              URLDatabase::AutocompleteForPrefix on in-memory DB)
 //         -> HistoryService::ScheduleAutocomplete
 //         (return to controller) ----
 //                                   /
@@ -110,6 +112,12 @@ struct HistoryURLProviderParams {
   // Set when "http://" should be trimmed from the beginning of the URLs.
   bool trim_http;
 
+  // The in-memory index of every history URL, which the first pass uses for
+  // prefix matching instead of the in-memory database when it is available
+  // and the prefix is selective enough for it.
+  // It may only be used on the main thread, so it is NULL for the second pass.
+  const history::URLTrigramIndex* trigram_index;
+
   // Set by the main thread to cancel this request.  If this flag is set when
   // the query runs, the query will be abandoned.  This allows us to avoid
   // running queries that are no longer needed.  Since we don't care if we run
@@ -14,6 +14,7 @@
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/json/json_reader.h"
+#include "base/json/json_string_value_serializer.h"
 #include "base/json/json_writer.h"
 #include "base/json/string_escape.h"
 #include "base/path_service.h"
@@ -36,9 +37,9 @@
 #include "chrome/browser/automation/automation_tab_tracker.h"
 #include "chrome/browser/automation/automation_util.h"
 #include "chrome/browser/automation/automation_window_tracker.h"
+#include "chrome/browser/bookmarks/bookmark_codec.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/browser/bookmarks/bookmark_model_factory.h"
-#include "chrome/browser/bookmarks/bookmark_storage.h"
 #include "chrome/browser/browser_process.h"
 #include "chrome/browser/browser_shutdown.h"
 #include "chrome/browser/chrome_notification_types.h"
@@ -1247,11 +1248,11 @@ void TestingAutomationProvider::GetBookmarksAsJSON(
     reply.SendError("Bookmark model is not loaded");
     return;
   }
-  scoped_refptr<BookmarkStorage> storage(
-      new BookmarkStorage(browser->profile(),
-                          bookmark_model,
-                          browser->profile()->GetIOTaskRunner().get()));
-  if (!storage->SerializeData(&bookmarks_as_json)) {
+  BookmarkCodec codec;
+  scoped_ptr<Value> bookmarks_value(codec.Encode(bookmark_model));
+  JSONStringValueSerializer serializer(&bookmarks_as_json);
+  serializer.set_pretty_print(true);
+  if (!serializer.Serialize(*bookmarks_value)) {
     reply.SendError("Failed to serialize bookmarks");
     return;
   }
@@ -5,10 +5,15 @@
 #include "chrome/browser/bookmarks/bookmark_codec.h"
 
 #include <algorithm>
+#include <map>
+#include <vector>
 
+#include "base/compiler_specific.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
+#include "base/strings/utf_string_conversions.h"
 #include "base/values.h"
+#include "chrome/browser/bookmarks/bookmark_json_reader.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "grit/generated_resources.h"
 #include "ui/base/l10n/l10n_util.h"
@@ -37,6 +42,522 @@ const char* BookmarkCodec::kTypeFolder = "folder";
 // Current version of the file.
 static const int kCurrentVersion = 1;
 
+// BookmarkCodec::JSONDecoder -------------------------------------------------
+
+// Builds the nodes from the events of a BookmarkJSONReader, applying the same
+// rules DecodeHelper() and DecodeNode() do.  The members of a node may come in
+// any order, and the writer puts "children" before the others, so a folder's
+// children are added to a node created before its type is known, which is
+// dropped if the node turns out not to be a valid folder.
+class BookmarkCodec::JSONDecoder : public BookmarkJSONReader::Delegate {
+ public:
+  JSONDecoder(BookmarkCodec* codec,
+              BookmarkNode* bb_node,
+              BookmarkNode* other_folder_node,
+              BookmarkNode* mobile_folder_node);
+  virtual ~JSONDecoder();
+
+  // Checks that the file had everything required, updates the checksum and
+  // sets up the permanent nodes.  Returns false, leaving the permanent nodes
+  // without children, if the file was not a valid bookmarks file.
+  bool Finish();
+
+  // Deletes the nodes decoded so far.
+  void Abandon();
+
+  // BookmarkJSONReader::Delegate implementation.
+  virtual bool OnStartObject() OVERRIDE;
+  virtual bool OnKey(const std::string& key) OVERRIDE;
+  virtual bool OnEndObject() OVERRIDE;
+  virtual bool OnStartArray() OVERRIDE;
+  virtual bool OnEndArray() OVERRIDE;
+  virtual bool OnString(const std::string& value) OVERRIDE;
+  virtual bool OnLiteral(const base::StringPiece& text) OVERRIDE;
+
+ private:
+  enum Context {
+    // The top level dictionary, the roots dictionary, a node's dictionary and
+    // a folder's list of children.
+    FILE_CONTEXT,
+    ROOTS_CONTEXT,
+    NODE_CONTEXT,
+    CHILDREN_CONTEXT,
+  };
+
+  // The members of a node's dictionary read so far.
+  struct NodeValues {
+    NodeValues();
+    ~NodeValues();
+
+    // Returns the string member named |key|, setting |found| to whether it
+    // was read, or NULL if |key| is not a string member of a node.
+    std::string* GetMember(const std::string& key, bool** found);
+
+    bool has_id;
+    std::string id;
+    bool has_name;
+    std::string name;
+    bool has_date_added;
+    std::string date_added;
+    bool has_date_modified;
+    std::string date_modified;
+    bool has_type;
+    std::string type;
+    bool has_url;
+    std::string url;
+    bool has_meta_info;
+    std::string meta_info;
+
+    // Whether "children" was a list, and whether all its members were
+    // dictionaries.  Members after one which was not are ignored.
+    bool has_children;
+    bool children_valid;
+  };
+
+  struct Frame {
+    Frame();
+    ~Frame();
+
+    Context context;
+
+    // For NODE_CONTEXT, the node the dictionary is decoded to, if it is known
+    // yet, and the folder to add it to, which is NULL for permanent nodes.
+    BookmarkNode* node;
+    BookmarkNode* parent;
+    NodeValues values;
+  };
+
+  // The id, title and URL of a node as they were in the file, kept for the
+  // few nodes where they differ from what the node has, as the checksum is of
+  // what was in the file.
+  struct FileValues {
+    std::string id;
+    string16 title;
+    std::string url;
+  };
+  typedef std::map<const BookmarkNode*, FileValues> FileValuesMap;
+
+  // Starts reading a value, which is not a container, in the current context.
+  void OnScalar(const std::string* string_value);
+
+  // Starts ignoring a list or dictionary.
+  bool Skip();
+
+  // Creates the node of the dictionary that just ended and adds it to its
+  // folder, or drops it if it is not valid.
+  void FinishNode(Frame* frame);
+
+  // Updates the checksum with |node| and its children.
+  void UpdateChecksum(const BookmarkNode* node);
+
+  // Deletes |node| and its children, or only its children if it is a
+  // permanent node.
+  void DropNode(BookmarkNode* node);
+
+  BookmarkCodec* codec_;
+
+  // The bookmark bar, other and mobile nodes, their ids before decoding,
+  // whether the file had them and whether they were valid.
+  BookmarkNode* permanent_nodes_[3];
+  int64 permanent_node_ids_[3];
+  bool found_permanent_nodes_[3];
+  bool decoded_permanent_nodes_[3];
+
+  std::vector<Frame> stack_;
+
+  // The key of the member whose value is being read.
+  std::string key_;
+
+  // When positive, the depth of the list or dictionary being ignored.
+  int skip_depth_;
+
+  bool found_roots_;
+  bool checksum_valid_;
+  int version_;
+
+  FileValuesMap file_values_;
+
+  DISALLOW_COPY_AND_ASSIGN(JSONDecoder);
+};
+
+BookmarkCodec::JSONDecoder::NodeValues::NodeValues()
+    : has_id(false),
+      has_name(false),
+      has_date_added(false),
+      has_date_modified(false),
+      has_type(false),
+      has_url(false),
+      has_meta_info(false),
+      has_children(false),
+      children_valid(false) {
+}
+
+BookmarkCodec::JSONDecoder::NodeValues::~NodeValues() {
+}
+
+std::string* BookmarkCodec::JSONDecoder::NodeValues::GetMember(
+    const std::string& key,
+    bool** found) {
+  if (key == kIdKey) {
+    *found = &has_id;
+    return &id;
+  }
+  if (key == kNameKey) {
+    *found = &has_name;
+    return &name;
+  }
+  if (key == kDateAddedKey) {
+    *found = &has_date_added;
+    return &date_added;
+  }
+  if (key == kDateModifiedKey) {
+    *found = &has_date_modified;
+    return &date_modified;
+  }
+  if (key == kTypeKey) {
+    *found = &has_type;
+    return &type;
+  }
+  if (key == kURLKey) {
+    *found = &has_url;
+    return &url;
+  }
+  if (key == kMetaInfo) {
+    *found = &has_meta_info;
+    return &meta_info;
+  }
+  return NULL;
+}
+
+BookmarkCodec::JSONDecoder::Frame::Frame()
+    : context(FILE_CONTEXT),
+      node(NULL),
+      parent(NULL) {
+}
+
+BookmarkCodec::JSONDecoder::Frame::~Frame() {
+}
+
+BookmarkCodec::JSONDecoder::JSONDecoder(BookmarkCodec* codec,
+                                        BookmarkNode* bb_node,
+                                        BookmarkNode* other_folder_node,
+                                        BookmarkNode* mobile_folder_node)
+    : codec_(codec),
+      skip_depth_(0),
+      found_roots_(false),
+      checksum_valid_(true),
+      version_(0) {
+  permanent_nodes_[0] = bb_node;
+  permanent_nodes_[1] = other_folder_node;
+  permanent_nodes_[2] = mobile_folder_node;
+  for (size_t i = 0; i < arraysize(permanent_nodes_); ++i) {
+    permanent_node_ids_[i] = permanent_nodes_[i]->id();
+    found_permanent_nodes_[i] = false;
+    decoded_permanent_nodes_[i] = false;
+  }
+}
+
+BookmarkCodec::JSONDecoder::~JSONDecoder() {
+  // Delete the folders of dictionaries which did not end.
+  for (size_t i = 0; i < stack_.size(); ++i) {
+    if (stack_[i].context == NODE_CONTEXT && stack_[i].parent)
+      delete stack_[i].node;
+  }
+}
+
+bool BookmarkCodec::JSONDecoder::Finish() {
+  if (version_ != kCurrentVersion || !checksum_valid_ || !found_roots_ ||
+      !found_permanent_nodes_[0] || !found_permanent_nodes_[1]) {
+    Abandon();
+    codec_->model_meta_info_.clear();
+    return false;
+  }
+
+  for (size_t i = 0; i < arraysize(permanent_nodes_); ++i) {
+    if (decoded_permanent_nodes_[i])
+      UpdateChecksum(permanent_nodes_[i]);
+  }
+  if (!found_permanent_nodes_[2] && codec_->ids_valid_) {
+    // See DecodeHelper().
+    codec_->ReassignIDsHelper(permanent_nodes_[2]);
+  }
+  codec_->ResetPermanentNodes(permanent_nodes_[0], permanent_nodes_[1],
+                              permanent_nodes_[2]);
+  return true;
+}
+
+void BookmarkCodec::JSONDecoder::Abandon() {
+  for (size_t i = 0; i < arraysize(permanent_nodes_); ++i) {
+    DropNode(permanent_nodes_[i]);
+    permanent_nodes_[i]->set_id(permanent_node_ids_[i]);
+  }
+  codec_->ResetPermanentNodes(permanent_nodes_[0], permanent_nodes_[1],
+                              permanent_nodes_[2]);
+}
+
+bool BookmarkCodec::JSONDecoder::OnStartObject() {
+  if (skip_depth_)
+    return Skip();
+  if (stack_.empty()) {
+    stack_.push_back(Frame());
+    return true;
+  }
+
+  Frame frame;
+  Frame& top = stack_.back();
+  switch (top.context) {
+    case FILE_CONTEXT:
+      if (key_ != kRootsKey)
+        break;
+      found_roots_ = true;
+      frame.context = ROOTS_CONTEXT;
+      stack_.push_back(frame);
+      return true;
+
+    case ROOTS_CONTEXT: {
+      const char* keys[] = {
+        kRootFolderNameKey,
+        kOtherBookmarkFolderNameKey,
+        kMobileBookmarkFolderNameKey,
+      };
+      for (size_t i = 0; i < arraysize(keys); ++i) {
+        if (key_ == keys[i]) {
+          found_permanent_nodes_[i] = true;
+          frame.context = NODE_CONTEXT;
+          frame.node = permanent_nodes_[i];
+          stack_.push_back(frame);
+          return true;
+        }
+      }
+      break;
+    }
+
+    case NODE_CONTEXT:
+      break;
+
+    case CHILDREN_CONTEXT: {
+      Frame& folder = stack_[stack_.size() - 2];
+      if (!folder.values.children_valid)
+        break;
+      frame.context = NODE_CONTEXT;
+      frame.parent = folder.node;
+      stack_.push_back(frame);
+      return true;
+    }
+  }
+  OnScalar(NULL);
+  return Skip();
+}
+
+bool BookmarkCodec::JSONDecoder::OnKey(const std::string& key) {
+  if (!skip_depth_)
+    key_ = key;
+  return true;
+}
+
+bool BookmarkCodec::JSONDecoder::OnEndObject() {
+  if (skip_depth_) {
+    --skip_depth_;
+    return true;
+  }
+  if (stack_.back().context == NODE_CONTEXT)
+    FinishNode(&stack_.back());
+  stack_.pop_back();
+  return true;
+}
+
+bool BookmarkCodec::JSONDecoder::OnStartArray() {
+  if (skip_depth_ || stack_.empty())
+    return Skip();
+
+  Frame& top = stack_.back();
+  if (top.context == NODE_CONTEXT && key_ == kChildrenKey) {
+    if (!top.node)
+      top.node = new BookmarkNode(0, GURL());
+    top.values.has_children = true;
+    top.values.children_valid = true;
+    Frame frame;
+    frame.context = CHILDREN_CONTEXT;
+    stack_.push_back(frame);
+    return true;
+  }
+  OnScalar(NULL);
+  return Skip();
+}
+
+bool BookmarkCodec::JSONDecoder::OnEndArray() {
+  if (skip_depth_) {
+    --skip_depth_;
+    return true;
+  }
+  stack_.pop_back();
+  return true;
+}
+
+bool BookmarkCodec::JSONDecoder::OnString(const std::string& value) {
+  if (!skip_depth_)
+    OnScalar(&value);
+  return true;
+}
+
+bool BookmarkCodec::JSONDecoder::OnLiteral(const base::StringPiece& text) {
+  if (skip_depth_ || stack_.empty())
+    return true;
+  if (stack_.back().context == FILE_CONTEXT && key_ == kVersionKey) {
+    if (!base::StringToInt(text, &version_))
+      version_ = 0;
+    return true;
+  }
+  OnScalar(NULL);
+  return true;
+}
+
+void BookmarkCodec::JSONDecoder::OnScalar(const std::string* string_value) {
+  if (stack_.empty())
+    return;
+  Frame& top = stack_.back();
+  switch (top.context) {
+    case FILE_CONTEXT:
+      if (key_ == kChecksumKey) {
+        if (string_value)
+          codec_->stored_checksum_ = *string_value;
+        else
+          checksum_valid_ = false;
+      } else if (key_ == kVersionKey && string_value) {
+        version_ = 0;
+      }
+      break;
+
+    case ROOTS_CONTEXT:
+      if (key_ == kMetaInfo && string_value)
+        codec_->model_meta_info_ = *string_value;
+      break;
+
+    case NODE_CONTEXT: {
+      bool* found = NULL;
+      std::string* member = top.values.GetMember(key_, &found);
+      if (member) {
+        *found = string_value != NULL;
+        if (string_value)
+          *member = *string_value;
+      } else if (key_ == kChildrenKey) {
+        top.values.has_children = false;
+      }
+      break;
+    }
+
+    case CHILDREN_CONTEXT:
+      stack_[stack_.size() - 2].values.children_valid = false;
+      break;
+  }
+}
+
+bool BookmarkCodec::JSONDecoder::Skip() {
+  ++skip_depth_;
+  return true;
+}
+
+void BookmarkCodec::JSONDecoder::FinishNode(Frame* frame) {
+  const NodeValues& values = frame->values;
+  const bool permanent = !frame->parent;
+
+  int64 id = 0;
+  if (codec_->ids_valid_) {
+    if (!values.has_id || !base::StringToInt64(values.id, &id) ||
+        codec_->ids_.count(id) != 0) {
+      codec_->ids_valid_ = false;
+    } else {
+      codec_->ids_.insert(id);
+    }
+  }
+  codec_->maximum_id_ = std::max(codec_->maximum_id_, id);
+
+  BookmarkNode* node = NULL;
+  if (values.has_type && values.type == kTypeURL) {
+    GURL url(values.has_url ? values.url : std::string());
+    if (!permanent && url.is_valid()) {
+      node = new BookmarkNode(id, url);
+      frame->parent->Add(node, frame->parent->child_count());
+    }
+  } else if (values.has_type && values.type == kTypeFolder &&
+             values.has_children) {
+    node = frame->node;
+    node->set_id(id);
+    node->set_type(BookmarkNode::FOLDER);
+    int64 internal_time = Time::Now().ToInternalValue();
+    if (values.has_date_modified)
+      base::StringToInt64(values.date_modified, &internal_time);
+    node->set_date_folder_modified(Time::FromInternalValue(internal_time));
+    if (!permanent)
+      frame->parent->Add(node, frame->parent->child_count());
+    for (size_t i = 0; i < arraysize(permanent_nodes_); ++i) {
+      if (node == permanent_nodes_[i])
+        decoded_permanent_nodes_[i] = true;
+    }
+  }
+  if (node != frame->node)
+    DropNode(frame->node);
+  frame->node = NULL;
+  if (!node)
+    return;  // Node invalid.
+
+  const string16 title =
+      values.has_name ? UTF8ToUTF16(values.name) : string16();
+  if (node->is_url() || values.children_valid) {
+    node->SetTitle(title);
+    int64 internal_time = Time::Now().ToInternalValue();
+    if (values.has_date_added)
+      base::StringToInt64(values.date_added, &internal_time);
+    node->set_date_added(Time::FromInternalValue(internal_time));
+    if (values.has_meta_info)
+      node->set_meta_info_str(values.meta_info);
+  }
+
+  const std::string id_string = values.has_id ? values.id : std::string();
+  if (id_string != base::Int64ToString(node->id()) ||
+      title != node->GetTitle() ||
+      (node->is_url() && values.url != node->url().possibly_invalid_spec())) {
+    FileValues& file_values = file_values_[node];
+    file_values.id = id_string;
+    file_values.title = title;
+    file_values.url = values.url;
+  }
+}
+
+void BookmarkCodec::JSONDecoder::UpdateChecksum(const BookmarkNode* node) {
+  FileValuesMap::const_iterator i = file_values_.find(node);
+  const bool changed = i != file_values_.end();
+  const std::string id =
+      changed ? i->second.id : base::Int64ToString(node->id());
+  const string16& title = changed ? i->second.title : node->GetTitle();
+  if (node->is_url()) {
+    codec_->UpdateChecksumWithUrlNode(
+        id, title,
+        changed ? i->second.url : node->url().possibly_invalid_spec());
+    return;
+  }
+  codec_->UpdateChecksumWithFolderNode(id, title);
+  for (int j = 0; j < node->child_count(); ++j)
+    UpdateChecksum(node->GetChild(j));
+}
+
+void BookmarkCodec::JSONDecoder::DropNode(BookmarkNode* node) {
+  if (!node)
+    return;
+  file_values_.erase(node);
+  for (int i = node->child_count() - 1; i >= 0; --i)
+    DropNode(node->GetChild(i));
+  for (size_t i = 0; i < arraysize(permanent_nodes_); ++i) {
+    if (node == permanent_nodes_[i])
+      return;
+  }
+  if (node->parent())
+    node->parent()->Remove(node);
+  delete node;
+}
+
+// BookmarkCodec --------------------------------------------------------------
+
 BookmarkCodec::BookmarkCodec()
     : ids_reassigned_(false),
       ids_valid_(true),
@@ -97,6 +618,39 @@ bool BookmarkCodec::Decode(BookmarkNode* bb_node,
   return success;
 }
 
+bool BookmarkCodec::DecodeJSON(BookmarkNode* bb_node,
+                               BookmarkNode* other_folder_node,
+                               BookmarkNode* mobile_folder_node,
+                               int64* max_id,
+                               const base::StringPiece& json) {
+  ids_.clear();
+  ids_reassigned_ = false;
+  ids_valid_ = true;
+  maximum_id_ = 0;
+  stored_checksum_.clear();
+  InitializeChecksum();
+  JSONDecoder decoder(this, bb_node, other_folder_node, mobile_folder_node);
+  if (!BookmarkJSONReader::Read(json, &decoder)) {
+    decoder.Abandon();
+    ids_.clear();
+    ids_valid_ = true;
+    maximum_id_ = 0;
+    stored_checksum_.clear();
+    computed_checksum_.clear();
+    model_meta_info_.clear();
+    *max_id = 1;
+    return false;
+  }
+  bool success = decoder.Finish();
+  FinalizeChecksum();
+  // If either the checksums differ or some IDs were missing/not unique,
+  // reassign IDs.
+  if (!ids_valid_ || computed_checksum() != stored_checksum())
+    ReassignIDs(bb_node, other_folder_node, mobile_folder_node);
+  *max_id = maximum_id_ + 1;
+  return success;
+}
+
 Value* BookmarkCodec::EncodeNode(const BookmarkNode* node) {
   DictionaryValue* value = new DictionaryValue();
   std::string id = base::Int64ToString(node->id());
@@ -191,6 +745,13 @@ bool BookmarkCodec::DecodeHelper(BookmarkNode* bb_node,
 
   roots_d_value->GetString(kMetaInfo, &model_meta_info_);
 
+  ResetPermanentNodes(bb_node, other_folder_node, mobile_folder_node);
+  return true;
+}
+
+void BookmarkCodec::ResetPermanentNodes(BookmarkNode* bb_node,
+                                        BookmarkNode* other_folder_node,
+                                        BookmarkNode* mobile_folder_node) {
   // Need to reset the type as decoding resets the type to FOLDER. Similarly
   // we need to reset the title as the title is persisted and restored from
   // the file.
@@ -202,8 +763,6 @@ bool BookmarkCodec::DecodeHelper(BookmarkNode* bb_node,
       l10n_util::GetStringUTF16(IDS_BOOKMARK_BAR_OTHER_FOLDER_NAME));
   mobile_folder_node->SetTitle(
         l10n_util::GetStringUTF16(IDS_BOOKMARK_BAR_MOBILE_FOLDER_NAME));
-
-  return true;
 }
 
 bool BookmarkCodec::DecodeChildren(const ListValue& child_value_list,
@@ -11,6 +11,7 @@
 #include "base/basictypes.h"
 #include "base/md5.h"
 #include "base/strings/string16.h"
+#include "base/strings/string_piece.h"
 
 class BookmarkModel;
 class BookmarkNode;
@@ -57,6 +58,17 @@ class BookmarkCodec {
               int64* max_node_id,
               const base::Value& value);
 
+  // Decodes the JSON text of a bookmarks file like Decode() does, but builds
+  // the nodes as the text is read, without parsing it into a base::Value
+  // first.  If |json| is not valid JSON false is returned, the nodes are left
+  // without children and the checksums are empty, as if nothing had been
+  // decoded.
+  bool DecodeJSON(BookmarkNode* bb_node,
+                  BookmarkNode* other_folder_node,
+                  BookmarkNode* mobile_folder_node,
+                  int64* max_node_id,
+                  const base::StringPiece& json);
+
   // Returns the checksum computed during last encoding/decoding call.
   const std::string& computed_checksum() const { return computed_checksum_; }
 
@@ -95,6 +107,10 @@ class BookmarkCodec {
   static const char* kTypeFolder;
 
  private:
+  // Receives the contents of the text given to DecodeJSON().
+  class JSONDecoder;
+  friend class JSONDecoder;
+
   // Encodes node and all its children into a Value object and returns it.
   // The caller takes ownership of the returned object.
   base::Value* EncodeNode(const BookmarkNode* node);
@@ -105,6 +121,11 @@ class BookmarkCodec {
                     BookmarkNode* mobile_folder_node,
                     const base::Value& value);
 
+  // Sets the types and titles of the permanent nodes after decoding.
+  void ResetPermanentNodes(BookmarkNode* bb_node,
+                           BookmarkNode* other_folder_node,
+                           BookmarkNode* mobile_folder_node);
+
   // Decodes the children of the specified node. Returns true on success.
   bool DecodeChildren(const base::ListValue& child_value_list,
                       BookmarkNode* parent);
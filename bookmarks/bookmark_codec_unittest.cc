@@ -5,6 +5,7 @@
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/json/json_file_value_serializer.h"
+#include "base/json/json_string_value_serializer.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/path_service.h"
 #include "base/strings/string_util.h"
@@ -360,3 +361,60 @@ TEST_F(BookmarkCodecTest, EncodeAndDecodeMetaInfo) {
   EXPECT_EQ("value2", meta_value);
   EXPECT_FALSE(child->GetMetaInfo("other_key", &meta_value));
 }
+
+TEST_F(BookmarkCodecTest, DecodeJSONMatchesDecode) {
+  scoped_ptr<BookmarkModel> model(CreateTestModel3());
+  model->SetNodeMetaInfo(model->root_node(), "model_info", "value1");
+  model->SetNodeMetaInfo(model->bookmark_bar_node()->GetChild(1),
+                         "node_info", "value2");
+  model->AddURL(model->other_node(), 0, ASCIIToUTF16("\"quoted\" \xC3\xA9"),
+                GURL(kUrl3Url));
+  std::string checksum;
+  scoped_ptr<Value> value(EncodeHelper(model.get(), &checksum));
+  std::string json;
+  JSONStringValueSerializer serializer(&json);
+  serializer.set_pretty_print(true);
+  ASSERT_TRUE(serializer.Serialize(*value));
+
+  BookmarkModel decoded_model(NULL);
+  BookmarkCodec decoder;
+  int64 max_id;
+  ASSERT_TRUE(decoder.DecodeJSON(AsMutable(decoded_model.bookmark_bar_node()),
+                                 AsMutable(decoded_model.other_node()),
+                                 AsMutable(decoded_model.mobile_node()),
+                                 &max_id, json));
+  EXPECT_EQ(checksum, decoder.stored_checksum());
+  EXPECT_EQ(checksum, decoder.computed_checksum());
+  EXPECT_FALSE(decoder.ids_reassigned());
+  decoded_model.set_next_node_id(max_id);
+  AsMutable(decoded_model.root_node())->set_meta_info_str(
+      decoder.model_meta_info());
+  BookmarkModelTestUtils::AssertModelsEqual(model.get(), &decoded_model, true);
+  std::string meta_value;
+  EXPECT_TRUE(decoded_model.root_node()->GetMetaInfo("model_info",
+                                                     &meta_value));
+  EXPECT_EQ("value1", meta_value);
+}
+
+TEST_F(BookmarkCodecTest, DecodeJSONInvalidText) {
+  scoped_ptr<BookmarkModel> model(CreateTestModel3());
+  std::string checksum;
+  scoped_ptr<Value> value(EncodeHelper(model.get(), &checksum));
+  std::string json;
+  JSONStringValueSerializer serializer(&json);
+  ASSERT_TRUE(serializer.Serialize(*value));
+
+  // A file cut short decodes to no bookmarks at all.
+  BookmarkModel decoded_model(NULL);
+  BookmarkCodec decoder;
+  int64 max_id;
+  EXPECT_FALSE(decoder.DecodeJSON(AsMutable(decoded_model.bookmark_bar_node()),
+                                  AsMutable(decoded_model.other_node()),
+                                  AsMutable(decoded_model.mobile_node()),
+                                  &max_id, json.substr(0, json.size() - 2)));
+  EXPECT_EQ(0, decoded_model.bookmark_bar_node()->child_count());
+  EXPECT_EQ(0, decoded_model.other_node()->child_count());
+  EXPECT_EQ(0, decoded_model.mobile_node()->child_count());
+  EXPECT_EQ("", decoder.stored_checksum());
+  EXPECT_FALSE(decoder.ids_reassigned());
+}
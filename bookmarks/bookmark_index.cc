@@ -5,11 +5,14 @@
 #include "chrome/browser/bookmarks/bookmark_index.h"
 
 #include <algorithm>
-#include <iterator>
-#include <list>
+#include <utility>
 
-#include "base/i18n/case_conversion.h"
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/memory/scoped_vector.h"
+#include "base/sequenced_task_runner.h"
 #include "base/strings/string16.h"
+#include "base/task_runner_util.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/browser/bookmarks/bookmark_title_match.h"
 #include "chrome/browser/history/history_service.h"
@@ -17,42 +20,37 @@
 #include "chrome/browser/history/query_parser.h"
 #include "chrome/browser/history/url_database.h"
 
-// Used when finding the set of bookmarks that match a query. Each match
-// represents a set of terms (as an interator into the Index) matching the
-// query as well as the set of nodes that contain those terms in their titles.
-struct BookmarkIndex::Match {
-  // List of terms matching the query.
-  std::list<Index::const_iterator> terms;
-
-  // The set of nodes matching the terms. As an optimization this is empty
-  // when we match only one term, and is filled in when we get more than one
-  // term. We can do this as when we have only one matching term we know
-  // the set of matching nodes is terms.front()->second.
-  //
-  // Use nodes_begin() and nodes_end() to get an iterator over the set as
-  // it handles the necessary switching between nodes and terms.front().
-  NodeSet nodes;
-
-  // Returns an iterator to the beginning of the matching nodes. See
-  // description of nodes for why this should be used over nodes.begin().
-  NodeSet::const_iterator nodes_begin() const;
-
-  // Returns an iterator to the beginning of the matching nodes. See
-  // description of nodes for why this should be used over nodes.end().
-  NodeSet::const_iterator nodes_end() const;
-};
-
-BookmarkIndex::NodeSet::const_iterator
-    BookmarkIndex::Match::nodes_begin() const {
-  return nodes.empty() ? terms.front()->second.begin() : nodes.begin();
+namespace {
+
+// How many changed bookmarks queries search one by one before they are
+// merged into a new snapshot.
+const size_t kMaxChangedBookmarks = 64;
+
+typedef std::pair<int, const BookmarkNode*> NodeTypedCountPair;
+
+bool NodeTypedCountPairSortFunc(const NodeTypedCountPair& a,
+                                const NodeTypedCountPair& b) {
+  return a.first > b.first;
 }
 
-BookmarkIndex::NodeSet::const_iterator BookmarkIndex::Match::nodes_end() const {
-  return nodes.empty() ? terms.front()->second.end() : nodes.end();
+scoped_refptr<BookmarkIndexSnapshot> MergeSnapshot(
+    scoped_refptr<BookmarkIndexSnapshot> previous,
+    const std::set<int64>& changed_ids,
+    std::vector<BookmarkIndexSnapshot::Bookmark>* changed_bookmarks,
+    const BookmarkIndexSnapshot::TypedCountMap& typed_counts) {
+  return BookmarkIndexSnapshot::Create(previous.get(), changed_ids,
+                                       changed_bookmarks, typed_counts);
 }
 
-BookmarkIndex::BookmarkIndex(content::BrowserContext* browser_context)
-    : browser_context_(browser_context) {
+}  // namespace
+
+BookmarkIndex::BookmarkIndex(content::BrowserContext* browser_context,
+                             base::SequencedTaskRunner* task_runner)
+    : browser_context_(browser_context),
+      task_runner_(task_runner),
+      merging_(false),
+      typed_counts_loaded_(false),
+      weak_factory_(this) {
 }
 
 BookmarkIndex::~BookmarkIndex() {
@@ -61,215 +59,233 @@ BookmarkIndex::~BookmarkIndex() {
 void BookmarkIndex::Add(const BookmarkNode* node) {
   if (!node->is_url())
     return;
-  std::vector<string16> terms = ExtractQueryWords(node->GetTitle());
-  for (size_t i = 0; i < terms.size(); ++i)
-    RegisterNode(terms[i], node);
+  nodes_[node->id()] = node;
+  if (typed_counts_loaded_) {
+    history::URLDatabase* url_db = GetURLDatabase();
+    history::URLRow row;
+    if (url_db && url_db->GetRowForURL(node->url(), &row))
+      changed_typed_counts_[node->url()] = row.typed_count();
+  }
+  OnNodeChanged(node->id());
 }
 
 void BookmarkIndex::Remove(const BookmarkNode* node) {
   if (!node->is_url())
     return;
+  nodes_.erase(node->id());
+  OnNodeChanged(node->id());
+}
 
-  std::vector<string16> terms = ExtractQueryWords(node->GetTitle());
-  for (size_t i = 0; i < terms.size(); ++i)
-    UnregisterNode(terms[i], node);
+void BookmarkIndex::LoadTypedCounts() {
+  history::URLDatabase* url_db = GetURLDatabase();
+  if (!url_db)
+    return;
+  typed_counts_loaded_ = true;
+
+  std::set<GURL> urls;
+  for (NodeMap::const_iterator i = nodes_.begin(); i != nodes_.end(); ++i)
+    urls.insert(i->second->url());
+  // The in-memory database has only the typed URLs, which are few.
+  history::URLDatabase::URLEnumerator enumerator;
+  if (!url_db->InitURLEnumeratorForEverything(&enumerator))
+    return;
+  history::URLRow row;
+  while (enumerator.GetNextURL(&row)) {
+    if (urls.find(row.url()) != urls.end())
+      changed_typed_counts_[row.url()] = row.typed_count();
+  }
+  if (snapshot_.get())
+    MergeChanges();
+}
+
+void BookmarkIndex::UpdateTypedCounts(const history::URLRows& rows) {
+  for (size_t i = 0; i < rows.size(); ++i)
+    changed_typed_counts_[rows[i].url()] = rows[i].typed_count();
+  if (snapshot_.get() && GetChangeCount() >= kMaxChangedBookmarks)
+    MergeChanges();
+}
+
+void BookmarkIndex::BuildSnapshot() {
+  DCHECK(!merging_);
+  if (snapshot_.get() && GetChangeCount() == 0)
+    return;
+  std::vector<BookmarkIndexSnapshot::Bookmark> bookmarks;
+  CopyChangedBookmarks(&bookmarks);
+  snapshot_ = BookmarkIndexSnapshot::Create(snapshot_.get(), changed_ids_,
+                                            &bookmarks, changed_typed_counts_);
+  changed_ids_.clear();
+  changed_typed_counts_.clear();
 }
 
 void BookmarkIndex::GetBookmarksWithTitlesMatching(
     const string16& query,
     size_t max_count,
     std::vector<BookmarkTitleMatch>* results) {
-  std::vector<string16> terms = ExtractQueryWords(query);
+  std::vector<string16> terms =
+      BookmarkIndexSnapshot::ExtractQueryWords(query);
   if (terms.empty())
     return;
 
-  Matches matches;
-  for (size_t i = 0; i < terms.size(); ++i) {
-    if (!GetBookmarksWithTitleMatchingTerm(terms[i], i == 0, &matches))
-      return;
+  std::vector<NodeTypedCountPair> node_typed_counts;
+  if (snapshot_.get()) {
+    std::vector<const BookmarkIndexSnapshot::Bookmark*> bookmarks;
+    snapshot_->GetBookmarksMatchingTerms(terms, &bookmarks);
+    for (size_t i = 0; i < bookmarks.size(); ++i) {
+      if (IsChanged(bookmarks[i]->id))
+        continue;
+      NodeMap::const_iterator node = nodes_.find(bookmarks[i]->id);
+      DCHECK(node != nodes_.end());
+      node_typed_counts.push_back(NodeTypedCountPair(
+          GetTypedCount(bookmarks[i]->url, bookmarks[i]->typed_count),
+          node->second));
+    }
   }
+  std::vector<const BookmarkNode*> nodes;
+  GetChangedNodesMatchingTerms(changed_ids_, std::set<int64>(), terms,
+                               &nodes);
+  GetChangedNodesMatchingTerms(merging_ids_, changed_ids_, terms, &nodes);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    node_typed_counts.push_back(
+        NodeTypedCountPair(GetChangedNodeTypedCount(nodes[i]), nodes[i]));
+  }
+  std::stable_sort(node_typed_counts.begin(), node_typed_counts.end(),
+                   &NodeTypedCountPairSortFunc);
 
-  NodeTypedCountPairs node_typed_counts;
-  SortMatches(matches, &node_typed_counts);
-
-  // We use a QueryParser to fill in match positions for us. It's not the most
-  // efficient way to go about this, but by the time we get here we know what
-  // matches and so this shouldn't be performance critical.
+  // The highest typed counts should be at the beginning of the results
+  // vector so that the best matches will always be included in the results.
+  //
+  // We use a QueryParser to fill in match positions for us.  It also checks
+  // that the result matches the query: the search above was a simple
+  // per-word search, while the more complex matching of QueryParser may
+  // filter it out.  For example, the query ["thi"] will match the bookmark
+  // titled [Thinking], but since ["thi"] is quoted we don't want to do a
+  // prefix match.
   QueryParser parser;
   ScopedVector<QueryNode> query_nodes;
   parser.ParseQueryNodes(query, &query_nodes.get());
-
-  // The highest typed counts should be at the beginning of the results vector
-  // so that the best matches will always be included in the results. The loop
-  // that calculates result relevance in HistoryContentsProvider::ConvertResults
-  // will run backwards to assure higher relevance will be attributed to the
-  // best matches.
-  for (NodeTypedCountPairs::const_iterator i = node_typed_counts.begin();
-       i != node_typed_counts.end() && results->size() < max_count; ++i)
-    AddMatchToResults(i->first, &parser, query_nodes.get(), results);
+  for (size_t i = 0;
+       i < node_typed_counts.size() && results->size() < max_count; ++i) {
+    const BookmarkNode* node = node_typed_counts[i].second;
+    BookmarkTitleMatch title_match;
+    if (parser.DoesQueryMatch(node->GetTitle(), query_nodes.get(),
+                              &title_match.match_positions)) {
+      title_match.node = node;
+      results->push_back(title_match);
+    }
+  }
 }
 
-void BookmarkIndex::SortMatches(const Matches& matches,
-                                NodeTypedCountPairs* node_typed_counts) const {
-  HistoryService* const history_service = browser_context_ ?
-      HistoryServiceFactory::GetForProfile(
-          Profile::FromBrowserContext(browser_context_),
-          Profile::EXPLICIT_ACCESS) : NULL;
+scoped_refptr<BookmarkIndexSnapshot> BookmarkIndex::GetSnapshot() {
+  MergeChanges();
+  return snapshot_;
+}
 
-  history::URLDatabase* url_db = history_service ?
-      history_service->InMemoryDatabase() : NULL;
+void BookmarkIndex::OnNodeChanged(int64 id) {
+  changed_ids_.insert(id);
+  // Until the loaded bookmarks are in a snapshot, they are only collected.
+  if (snapshot_.get() && GetChangeCount() >= kMaxChangedBookmarks)
+    MergeChanges();
+}
 
-  for (Matches::const_iterator i = matches.begin(); i != matches.end(); ++i)
-    ExtractBookmarkNodePairs(url_db, *i, node_typed_counts);
+bool BookmarkIndex::IsChanged(int64 id) const {
+  return changed_ids_.find(id) != changed_ids_.end() ||
+      merging_ids_.find(id) != merging_ids_.end();
+}
 
-  std::sort(node_typed_counts->begin(), node_typed_counts->end(),
-            &NodeTypedCountPairSortFunc);
-  // Eliminate duplicates.
-  node_typed_counts->erase(std::unique(node_typed_counts->begin(),
-                                       node_typed_counts->end()),
-                           node_typed_counts->end());
+size_t BookmarkIndex::GetChangeCount() const {
+  return changed_ids_.size() + changed_typed_counts_.size();
 }
 
-void BookmarkIndex::ExtractBookmarkNodePairs(
-    history::URLDatabase* url_db,
-    const Match& match,
-    NodeTypedCountPairs* node_typed_counts) const {
-
-  for (NodeSet::const_iterator i = match.nodes_begin();
-       i != match.nodes_end(); ++i) {
-    history::URLRow url;
-    if (url_db)
-      url_db->GetRowForURL((*i)->url(), &url);
-    NodeTypedCountPair pair(*i, url.typed_count());
-    node_typed_counts->push_back(pair);
-  }
+history::URLDatabase* BookmarkIndex::GetURLDatabase() const {
+  HistoryService* const history_service = browser_context_ ?
+      HistoryServiceFactory::GetForProfile(
+          Profile::FromBrowserContext(browser_context_),
+          Profile::EXPLICIT_ACCESS) : NULL;
+  return history_service ? history_service->InMemoryDatabase() : NULL;
 }
 
-void BookmarkIndex::AddMatchToResults(
-    const BookmarkNode* node,
-    QueryParser* parser,
-    const std::vector<QueryNode*>& query_nodes,
-    std::vector<BookmarkTitleMatch>* results) {
-  BookmarkTitleMatch title_match;
-  // Check that the result matches the query.  The previous search
-  // was a simple per-word search, while the more complex matching
-  // of QueryParser may filter it out.  For example, the query
-  // ["thi"] will match the bookmark titled [Thinking], but since
-  // ["thi"] is quoted we don't want to do a prefix match.
-  if (parser->DoesQueryMatch(node->GetTitle(), query_nodes,
-                             &(title_match.match_positions))) {
-    title_match.node = node;
-    results->push_back(title_match);
-  }
+int BookmarkIndex::GetTypedCount(const GURL& url, int snapshot_count) const {
+  BookmarkIndexSnapshot::TypedCountMap::const_iterator typed_count =
+      changed_typed_counts_.find(url);
+  if (typed_count != changed_typed_counts_.end())
+    return typed_count->second;
+  typed_count = merging_typed_counts_.find(url);
+  if (typed_count != merging_typed_counts_.end())
+    return typed_count->second;
+  return snapshot_count;
 }
 
-bool BookmarkIndex::GetBookmarksWithTitleMatchingTerm(const string16& term,
-                                                      bool first_term,
-                                                      Matches* matches) {
-  Index::const_iterator i = index_.lower_bound(term);
-  if (i == index_.end())
-    return false;
-
-  if (!QueryParser::IsWordLongEnoughForPrefixSearch(term)) {
-    // Term is too short for prefix match, compare using exact match.
-    if (i->first != term)
-      return false;  // No bookmarks with this term.
-
-    if (first_term) {
-      Match match;
-      match.terms.push_back(i);
-      matches->push_back(match);
-      return true;
-    }
-    CombineMatchesInPlace(i, matches);
-  } else if (first_term) {
-    // This is the first term and we're doing a prefix match. Loop through
-    // index adding all entries that start with term to matches.
-    while (i != index_.end() &&
-           i->first.size() >= term.size() &&
-           term.compare(0, term.size(), i->first, 0, term.size()) == 0) {
-      Match match;
-      match.terms.push_back(i);
-      matches->push_back(match);
-      ++i;
-    }
-  } else {
-    // Prefix match and not the first term. Loop through index combining
-    // current matches in matches with term, placing result in result.
-    Matches result;
-    while (i != index_.end() &&
-           i->first.size() >= term.size() &&
-           term.compare(0, term.size(), i->first, 0, term.size()) == 0) {
-      CombineMatches(i, *matches, &result);
-      ++i;
-    }
-    matches->swap(result);
-  }
-  return !matches->empty();
+int BookmarkIndex::GetChangedNodeTypedCount(const BookmarkNode* node) const {
+  // A retitled bookmark keeps its typed count in the snapshot.
+  const BookmarkIndexSnapshot::Bookmark* bookmark =
+      snapshot_.get() ? snapshot_->GetBookmark(node->id()) : NULL;
+  return GetTypedCount(node->url(),
+                       bookmark && bookmark->url == node->url() ?
+                           bookmark->typed_count : 0);
 }
 
-void BookmarkIndex::CombineMatchesInPlace(const Index::const_iterator& index_i,
-                                          Matches* matches) {
-  for (size_t i = 0; i < matches->size(); ) {
-    Match* match = &((*matches)[i]);
-    NodeSet intersection;
-    std::set_intersection(match->nodes_begin(), match->nodes_end(),
-                          index_i->second.begin(), index_i->second.end(),
-                          std::inserter(intersection, intersection.begin()));
-    if (intersection.empty()) {
-      matches->erase(matches->begin() + i);
-    } else {
-      match->terms.push_back(index_i);
-      match->nodes.swap(intersection);
-      ++i;
+void BookmarkIndex::GetChangedNodesMatchingTerms(
+    const std::set<int64>& ids,
+    const std::set<int64>& skip_ids,
+    const std::vector<string16>& terms,
+    std::vector<const BookmarkNode*>* nodes) const {
+  for (std::set<int64>::const_iterator i = ids.begin(); i != ids.end(); ++i) {
+    if (skip_ids.find(*i) != skip_ids.end())
+      continue;
+    NodeMap::const_iterator node = nodes_.find(*i);
+    if (node != nodes_.end() &&
+        BookmarkIndexSnapshot::TitleMatchesTerms(node->second->GetTitle(),
+                                                 terms)) {
+      nodes->push_back(node->second);
     }
   }
 }
 
-void BookmarkIndex::CombineMatches(const Index::const_iterator& index_i,
-                                   const Matches& current_matches,
-                                   Matches* result) {
-  for (size_t i = 0; i < current_matches.size(); ++i) {
-    const Match& match = current_matches[i];
-    NodeSet intersection;
-    std::set_intersection(match.nodes_begin(), match.nodes_end(),
-                          index_i->second.begin(), index_i->second.end(),
-                          std::inserter(intersection, intersection.begin()));
-    if (!intersection.empty()) {
-      result->push_back(Match());
-      Match& combined_match = result->back();
-      combined_match.terms = match.terms;
-      combined_match.terms.push_back(index_i);
-      combined_match.nodes.swap(intersection);
-    }
+void BookmarkIndex::MergeChanges() {
+  if (merging_)
+    return;
+  if (!task_runner_.get()) {
+    BuildSnapshot();
+    return;
   }
-}
+  if (GetChangeCount() == 0)
+    return;
 
-std::vector<string16> BookmarkIndex::ExtractQueryWords(const string16& query) {
-  std::vector<string16> terms;
-  if (query.empty())
-    return std::vector<string16>();
-  QueryParser parser;
-  // TODO(brettw): use ICU normalization:
-  // http://userguide.icu-project.org/transforms/normalization
-  parser.ParseQueryWords(base::i18n::ToLower(query), &terms);
-  return terms;
+  std::vector<BookmarkIndexSnapshot::Bookmark>* bookmarks =
+      new std::vector<BookmarkIndexSnapshot::Bookmark>;
+  CopyChangedBookmarks(bookmarks);
+  merging_ids_.swap(changed_ids_);
+  merging_typed_counts_.swap(changed_typed_counts_);
+  merging_ = true;
+  base::PostTaskAndReplyWithResult(
+      task_runner_.get(), FROM_HERE,
+      base::Bind(&MergeSnapshot, snapshot_, merging_ids_,
+                 base::Owned(bookmarks), merging_typed_counts_),
+      base::Bind(&BookmarkIndex::OnChangesMerged,
+                 weak_factory_.GetWeakPtr()));
 }
 
-void BookmarkIndex::RegisterNode(const string16& term,
-                                 const BookmarkNode* node) {
-  index_[term].insert(node);
+void BookmarkIndex::CopyChangedBookmarks(
+    std::vector<BookmarkIndexSnapshot::Bookmark>* bookmarks) const {
+  for (std::set<int64>::const_iterator i = changed_ids_.begin();
+       i != changed_ids_.end(); ++i) {
+    NodeMap::const_iterator node = nodes_.find(*i);
+    if (node == nodes_.end())
+      continue;  // Removed.
+    bookmarks->push_back(BookmarkIndexSnapshot::Bookmark());
+    bookmarks->back().id = *i;
+    bookmarks->back().title = node->second->GetTitle();
+    bookmarks->back().url = node->second->url();
+    bookmarks->back().typed_count = GetChangedNodeTypedCount(node->second);
+  }
 }
 
-void BookmarkIndex::UnregisterNode(const string16& term,
-                                   const BookmarkNode* node) {
-  Index::iterator i = index_.find(term);
-  if (i == index_.end()) {
-    // We can get here if the node has the same term more than once. For
-    // example, a bookmark with the title 'foo foo' would end up here.
-    return;
-  }
-  i->second.erase(node);
-  if (i->second.empty())
-    index_.erase(i);
+void BookmarkIndex::OnChangesMerged(
+    scoped_refptr<BookmarkIndexSnapshot> snapshot) {
+  snapshot_ = snapshot;
+  merging_ids_.clear();
+  merging_typed_counts_.clear();
+  merging_ = false;
+  if (GetChangeCount() >= kMaxChangedBookmarks)
+    MergeChanges();
 }
@@ -10,12 +10,18 @@
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/weak_ptr.h"
 #include "base/strings/string16.h"
+#include "chrome/browser/bookmarks/bookmark_index_snapshot.h"
+#include "chrome/browser/history/history_types.h"
 
 class BookmarkNode;
 struct BookmarkTitleMatch;
-class QueryNode;
-class QueryParser;
+
+namespace base {
+class SequencedTaskRunner;
+}
 
 namespace content {
 class BrowserContext;
@@ -29,12 +35,22 @@ class URLDatabase;
 // look up. BookmarkIndex is owned and maintained by BookmarkModel, you
 // shouldn't need to interact directly with BookmarkIndex.
 //
-// BookmarkIndex maintains the index (index_) as a map of sets. The map (type
-// Index) maps from a lower case string to the set (type NodeSet) of
-// BookmarkNodes that contain that string in their title.
+// The titles are indexed by an immutable BookmarkIndexSnapshot, which knows
+// the bookmarks by id.  The bookmarks added, removed or retitled since it was
+// built are kept aside, and searched one by one by queries, until there are
+// enough of them to merge into a new snapshot.  The merge runs on
+// |task_runner_|, leaving the thread that owns the model only the copying of
+// the changed bookmarks.
+//
+// The snapshot also keeps the typed count of each bookmark, which queries
+// sort the matches by.  The counts are read from history once, and then
+// kept up to date from its notifications, the changed ones being merged
+// like the changed bookmarks.
 class BookmarkIndex {
  public:
-  explicit BookmarkIndex(content::BrowserContext* browser_context);
+  // Snapshots are merged on |task_runner|, or synchronously if it is NULL.
+  BookmarkIndex(content::BrowserContext* browser_context,
+                base::SequencedTaskRunner* task_runner);
   ~BookmarkIndex();
 
   // Invoked when a bookmark has been added to the model.
@@ -43,91 +59,104 @@ class BookmarkIndex {
   // Invoked when a bookmark has been removed from the model.
   void Remove(const BookmarkNode* node);
 
-  // Returns up to |max_count| of bookmarks containing the text |query|.
+  // Reads the typed counts of all the bookmarks from the in-memory history
+  // database, if history has loaded.  Invoked on the UI thread once the model
+  // has loaded, and again when history loads.
+  void LoadTypedCounts();
+
+  // Invoked when history reports the typed counts of |rows|, which are all
+  // bookmarked URLs.
+  void UpdateTypedCounts(const history::URLRows& rows);
+
+  // Merges all the changes into a new snapshot on the calling thread.  Called
+  // on the background thread that loads the bookmarks, once it has added them.
+  void BuildSnapshot();
+
+  // Returns up to |max_count| of bookmarks containing the text |query|, most
+  // often typed first.
   void GetBookmarksWithTitlesMatching(
       const string16& query,
       size_t max_count,
       std::vector<BookmarkTitleMatch>* results);
 
+  // Returns the latest snapshot of the index, which may be queried on any
+  // thread, after starting to merge any changes it lacks.  Unless snapshots
+  // are merged synchronously it may not have the latest changes to the model.
+  scoped_refptr<BookmarkIndexSnapshot> GetSnapshot();
+
  private:
-  typedef std::set<const BookmarkNode*> NodeSet;
-  typedef std::map<string16, NodeSet> Index;
-
-  struct Match;
-  typedef std::vector<Match> Matches;
-
-  // Pairs BookmarkNodes and the number of times the nodes' URLs were typed.
-  // Used to sort Matches in decreasing order of typed count.
-  typedef std::pair<const BookmarkNode*, int> NodeTypedCountPair;
-  typedef std::vector<NodeTypedCountPair> NodeTypedCountPairs;
-
-  // Extracts |matches.nodes| into NodeTypedCountPairs, sorts the pairs in
-  // decreasing order of typed count, and then de-dupes the matches.
-  void SortMatches(const Matches& matches,
-                   NodeTypedCountPairs* node_typed_counts) const;
-
-  // Extracts BookmarkNodes from |match| and retrieves typed counts for each
-  // node from the in-memory database. Inserts pairs containing the node and
-  // typed count into the vector |node_typed_counts|. |node_typed_counts| is
-  // sorted in decreasing order of typed count.
-  void ExtractBookmarkNodePairs(history::URLDatabase* url_db,
-                                const Match& match,
-                                NodeTypedCountPairs* node_typed_counts) const;
-
-  // Sort function for NodeTypedCountPairs. We sort in decreasing order of typed
-  // count so that the best matches will always be added to the results.
-  static bool NodeTypedCountPairSortFunc(const NodeTypedCountPair& a,
-                                         const NodeTypedCountPair& b) {
-      return a.second > b.second;
-  }
-
-  // Add |node| to |results| if the node matches the query.
-  void AddMatchToResults(const BookmarkNode* node,
-                         QueryParser* parser,
-                         const std::vector<QueryNode*>& query_nodes,
-                         std::vector<BookmarkTitleMatch>* results);
-
-  // Populates |matches| for the specified term. If |first_term| is true, this
-  // is the first term in the query. Returns true if there is at least one node
-  // matching the term.
-  bool GetBookmarksWithTitleMatchingTerm(const string16& term,
-                                         bool first_term,
-                                         Matches* matches);
-
-  // Iterates over |matches| updating each Match's nodes to contain the
-  // intersection of the Match's current nodes and the nodes at |index_i|.
-  // If the intersection is empty, the Match is removed.
-  //
-  // This is invoked from GetBookmarksWithTitleMatchingTerm.
-  void CombineMatchesInPlace(const Index::const_iterator& index_i,
-                             Matches* matches);
-
-  // Iterates over |current_matches| calculating the intersection between the
-  // Match's nodes and the nodes at |index_i|. If the intersection between the
-  // two is non-empty, a new match is added to |result|.
-  //
-  // This differs from CombineMatchesInPlace in that if the intersection is
-  // non-empty the result is added to result, not combined in place. This
-  // variant is used for prefix matching.
-  //
-  // This is invoked from GetBookmarksWithTitleMatchingTerm.
-  void CombineMatches(const Index::const_iterator& index_i,
-                      const Matches& current_matches,
-                      Matches* result);
-
-  // Returns the set of query words from |query|.
-  std::vector<string16> ExtractQueryWords(const string16& query);
-
-  // Adds |node| to |index_|.
-  void RegisterNode(const string16& term, const BookmarkNode* node);
-
-  // Removes |node| from |index_|.
-  void UnregisterNode(const string16& term, const BookmarkNode* node);
-
-  Index index_;
+  typedef std::map<int64, const BookmarkNode*> NodeMap;
+
+  // Records that the bookmark |id| has been added, removed or retitled, and
+  // starts a merge if there are enough such changes.
+  void OnNodeChanged(int64 id);
+
+  // Returns true if |id| has changed since |snapshot_| was built.
+  bool IsChanged(int64 id) const;
+
+  // Returns the number of bookmarks and typed counts changed since
+  // |snapshot_| was built which are not yet being merged.
+  size_t GetChangeCount() const;
+
+  // Returns the in-memory history database, or NULL if history has not
+  // loaded.
+  history::URLDatabase* GetURLDatabase() const;
+
+  // Returns the typed count of |url| reported since |snapshot_| was built,
+  // or |snapshot_count| if there is none.
+  int GetTypedCount(const GURL& url, int snapshot_count) const;
+
+  // Returns the typed count of the changed bookmark |node|.
+  int GetChangedNodeTypedCount(const BookmarkNode* node) const;
+
+  // Appends to |nodes| the live bookmarks among |ids| whose title matches
+  // |terms|, skipping those in |skip_ids|.
+  void GetChangedNodesMatchingTerms(
+      const std::set<int64>& ids,
+      const std::set<int64>& skip_ids,
+      const std::vector<string16>& terms,
+      std::vector<const BookmarkNode*>* nodes) const;
+
+  // Starts merging |changed_ids_| and |changed_typed_counts_| into a new
+  // snapshot, unless a merge is already running.
+  void MergeChanges();
+
+  // Copies the live bookmarks among |changed_ids_| into |bookmarks|.
+  void CopyChangedBookmarks(
+      std::vector<BookmarkIndexSnapshot::Bookmark>* bookmarks) const;
+
+  // Replaces |snapshot_| with the merged |snapshot|.
+  void OnChangesMerged(scoped_refptr<BookmarkIndexSnapshot> snapshot);
 
   content::BrowserContext* browser_context_;
 
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
+
+  // The bookmarks with a URL, by id.
+  NodeMap nodes_;
+
+  // The snapshot queries start from, which may be NULL.
+  scoped_refptr<BookmarkIndexSnapshot> snapshot_;
+
+  // The ids of the bookmarks changed since |snapshot_| was built, split
+  // into those not yet being merged and those being merged, which is empty
+  // unless a merge is running.
+  std::set<int64> changed_ids_;
+  std::set<int64> merging_ids_;
+
+  // Likewise for the typed counts history reported for bookmarked URLs.
+  BookmarkIndexSnapshot::TypedCountMap changed_typed_counts_;
+  BookmarkIndexSnapshot::TypedCountMap merging_typed_counts_;
+
+  // True while a merge is running on |task_runner_|.
+  bool merging_;
+
+  // True once the typed counts have been read from history, after which the
+  // typed counts of added bookmarks are read as they are added.
+  bool typed_counts_loaded_;
+
+  base::WeakPtrFactory<BookmarkIndex> weak_factory_;
+
   DISALLOW_COPY_AND_ASSIGN(BookmarkIndex);
 };
 
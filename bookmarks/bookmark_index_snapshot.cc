@@ -0,0 +1,230 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_index_snapshot.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "base/i18n/case_conversion.h"
+#include "chrome/browser/history/query_parser.h"
+
+BookmarkIndexSnapshot::Bookmark::Bookmark() : id(0), typed_count(0) {
+}
+
+BookmarkIndexSnapshot::Bookmark::~Bookmark() {
+}
+
+namespace {
+
+bool IdLess(const BookmarkIndexSnapshot::Bookmark& a,
+            const BookmarkIndexSnapshot::Bookmark& b) {
+  return a.id < b.id;
+}
+
+// Returns true if |word| matches the query term |term|: it starts with it,
+// or is equal to it if it is too short for a prefix search.
+bool WordMatchesTerm(const string16& word, const string16& term) {
+  if (!QueryParser::IsWordLongEnoughForPrefixSearch(term))
+    return word == term;
+  return word.size() >= term.size() &&
+      word.compare(0, term.size(), term) == 0;
+}
+
+}  // namespace
+
+// static
+scoped_refptr<BookmarkIndexSnapshot> BookmarkIndexSnapshot::Create(
+    const BookmarkIndexSnapshot* previous,
+    const std::set<int64>& changed_ids,
+    std::vector<Bookmark>* changed_bookmarks,
+    const TypedCountMap& typed_counts) {
+  scoped_refptr<BookmarkIndexSnapshot> snapshot(new BookmarkIndexSnapshot);
+
+  std::vector<Bookmark>& bookmarks = snapshot->bookmarks_;
+  if (previous && changed_ids.empty() && changed_bookmarks->empty()) {
+    // Only typed counts changed, so the terms are those of |previous|.
+    bookmarks = previous->bookmarks_;
+    snapshot->term_chars_ = previous->term_chars_;
+    snapshot->term_starts_ = previous->term_starts_;
+    snapshot->postings_ = previous->postings_;
+    snapshot->posting_starts_ = previous->posting_starts_;
+    snapshot->SetTypedCounts(typed_counts);
+    return snapshot;
+  }
+
+  bookmarks.swap(*changed_bookmarks);
+  if (previous) {
+    bookmarks.reserve(bookmarks.size() + previous->bookmarks_.size());
+    for (std::vector<Bookmark>::const_iterator i =
+             previous->bookmarks_.begin();
+         i != previous->bookmarks_.end(); ++i) {
+      if (changed_ids.find(i->id) == changed_ids.end())
+        bookmarks.push_back(*i);
+    }
+  }
+  std::sort(bookmarks.begin(), bookmarks.end(), IdLess);
+  snapshot->SetTypedCounts(typed_counts);
+
+  // Pairs each title word with the index of a bookmark having it.  Sorting
+  // them groups the bookmarks by word, in the order of the words.
+  std::vector<std::pair<string16, uint32> > term_postings;
+  for (size_t i = 0; i < bookmarks.size(); ++i) {
+    std::vector<string16> terms = ExtractQueryWords(bookmarks[i].title);
+    for (size_t j = 0; j < terms.size(); ++j)
+      term_postings.push_back(std::make_pair(terms[j], static_cast<uint32>(i)));
+  }
+  std::sort(term_postings.begin(), term_postings.end());
+  // A title may have the same word more than once, as in 'foo foo'.
+  term_postings.erase(std::unique(term_postings.begin(), term_postings.end()),
+                      term_postings.end());
+
+  snapshot->postings_.reserve(term_postings.size());
+  for (size_t i = 0; i < term_postings.size(); ++i) {
+    if (i == 0 || term_postings[i].first != term_postings[i - 1].first) {
+      snapshot->term_starts_.push_back(
+          static_cast<uint32>(snapshot->term_chars_.size()));
+      snapshot->term_chars_.append(term_postings[i].first);
+      snapshot->posting_starts_.push_back(
+          static_cast<uint32>(snapshot->postings_.size()));
+    }
+    snapshot->postings_.push_back(term_postings[i].second);
+  }
+  snapshot->term_starts_.push_back(
+      static_cast<uint32>(snapshot->term_chars_.size()));
+  snapshot->posting_starts_.push_back(
+      static_cast<uint32>(snapshot->postings_.size()));
+  return snapshot;
+}
+
+const BookmarkIndexSnapshot::Bookmark* BookmarkIndexSnapshot::GetBookmark(
+    int64 id) const {
+  Bookmark key;
+  key.id = id;
+  std::vector<Bookmark>::const_iterator i =
+      std::lower_bound(bookmarks_.begin(), bookmarks_.end(), key, IdLess);
+  return i != bookmarks_.end() && i->id == id ? &*i : NULL;
+}
+
+void BookmarkIndexSnapshot::GetBookmarksMatchingTerms(
+    const std::vector<string16>& terms,
+    std::vector<const Bookmark*>* matches) const {
+  if (terms.empty())
+    return;
+
+  // Every term must match.
+  std::vector<uint32> indices;
+  for (size_t i = 0; i < terms.size(); ++i) {
+    std::vector<uint32> term_matches;
+    GetBookmarksMatchingTerm(terms[i], &term_matches);
+    if (i == 0) {
+      indices.swap(term_matches);
+    } else {
+      std::vector<uint32> intersection;
+      std::set_intersection(indices.begin(), indices.end(),
+                            term_matches.begin(), term_matches.end(),
+                            std::back_inserter(intersection));
+      indices.swap(intersection);
+    }
+    if (indices.empty())
+      return;
+  }
+
+  matches->reserve(matches->size() + indices.size());
+  for (size_t i = 0; i < indices.size(); ++i)
+    matches->push_back(&bookmarks_[indices[i]]);
+}
+
+// static
+bool BookmarkIndexSnapshot::TitleMatchesTerms(
+    const string16& title,
+    const std::vector<string16>& terms) {
+  if (terms.empty())
+    return false;
+  std::vector<string16> words = ExtractQueryWords(title);
+  for (size_t i = 0; i < terms.size(); ++i) {
+    bool found = false;
+    for (size_t j = 0; j < words.size() && !found; ++j)
+      found = WordMatchesTerm(words[j], terms[i]);
+    if (!found)
+      return false;
+  }
+  return true;
+}
+
+// static
+std::vector<string16> BookmarkIndexSnapshot::ExtractQueryWords(
+    const string16& query) {
+  std::vector<string16> terms;
+  if (query.empty())
+    return std::vector<string16>();
+  QueryParser parser;
+  // TODO(brettw): use ICU normalization:
+  // http://userguide.icu-project.org/transforms/normalization
+  parser.ParseQueryWords(base::i18n::ToLower(query), &terms);
+  return terms;
+}
+
+BookmarkIndexSnapshot::BookmarkIndexSnapshot() {
+}
+
+BookmarkIndexSnapshot::~BookmarkIndexSnapshot() {
+}
+
+void BookmarkIndexSnapshot::SetTypedCounts(const TypedCountMap& typed_counts) {
+  if (typed_counts.empty())
+    return;
+  for (std::vector<Bookmark>::iterator i = bookmarks_.begin();
+       i != bookmarks_.end(); ++i) {
+    TypedCountMap::const_iterator typed_count = typed_counts.find(i->url);
+    if (typed_count != typed_counts.end())
+      i->typed_count = typed_count->second;
+  }
+}
+
+int BookmarkIndexSnapshot::CompareTerm(size_t i, const string16& term) const {
+  return term_chars_.compare(term_starts_[i],
+                             term_starts_[i + 1] - term_starts_[i], term);
+}
+
+bool BookmarkIndexSnapshot::TermHasPrefix(size_t i,
+                                          const string16& prefix) const {
+  return term_starts_[i + 1] - term_starts_[i] >= prefix.size() &&
+      term_chars_.compare(term_starts_[i], prefix.size(), prefix) == 0;
+}
+
+void BookmarkIndexSnapshot::GetBookmarksMatchingTerm(
+    const string16& term,
+    std::vector<uint32>* matches) const {
+  // Find the first term not less than |term|.
+  size_t begin = 0;
+  size_t end = term_count();
+  while (begin < end) {
+    const size_t middle = begin + (end - begin) / 2;
+    if (CompareTerm(middle, term) < 0)
+      begin = middle + 1;
+    else
+      end = middle;
+  }
+
+  if (!QueryParser::IsWordLongEnoughForPrefixSearch(term)) {
+    // Term is too short for prefix match, compare using exact match.
+    if (begin < term_count() && CompareTerm(begin, term) == 0) {
+      matches->assign(postings_.begin() + posting_starts_[begin],
+                      postings_.begin() + posting_starts_[begin + 1]);
+    }
+    return;
+  }
+
+  // The terms starting with |term| follow it, and so do their postings.
+  end = begin;
+  while (end < term_count() && TermHasPrefix(end, term))
+    ++end;
+  matches->assign(postings_.begin() + posting_starts_[begin],
+                  postings_.begin() + posting_starts_[end]);
+  std::sort(matches->begin(), matches->end());
+  matches->erase(std::unique(matches->begin(), matches->end()),
+                 matches->end());
+}
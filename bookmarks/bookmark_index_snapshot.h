@@ -0,0 +1,114 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_BOOKMARKS_BOOKMARK_INDEX_SNAPSHOT_H_
+#define CHROME_BROWSER_BOOKMARKS_BOOKMARK_INDEX_SNAPSHOT_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/strings/string16.h"
+#include "url/gurl.h"
+
+// BookmarkIndexSnapshot is an immutable index of the titles of bookmarks,
+// built by BookmarkIndex.  It holds its own copies of the ids, titles and
+// URLs of the bookmarks, never pointers to the nodes, and so may be kept
+// and queried on any thread.
+//
+// The title words are kept sorted in one buffer, with the bookmarks having
+// each word in a second one, so that the words beginning with a prefix are
+// a contiguous run found by binary search.
+class BookmarkIndexSnapshot
+    : public base::RefCountedThreadSafe<BookmarkIndexSnapshot> {
+ public:
+  // A bookmark as it was when the snapshot was built.
+  struct Bookmark {
+    Bookmark();
+    ~Bookmark();
+
+    int64 id;
+    string16 title;
+    GURL url;
+
+    // How many times the URL was typed, as history last reported it.
+    int typed_count;
+  };
+
+  // The typed counts of URLs, as reported by history.
+  typedef std::map<GURL, int> TypedCountMap;
+
+  // Builds a snapshot from the bookmarks of |previous|, except those whose
+  // id is in |changed_ids|, and |changed_bookmarks|, which it takes the
+  // contents of, setting the typed count of the bookmarks whose URL is in
+  // |typed_counts|.  |previous| may be NULL.  Unless only typed counts
+  // changed this tokenizes every title, so it should not be called on the UI
+  // thread.
+  static scoped_refptr<BookmarkIndexSnapshot> Create(
+      const BookmarkIndexSnapshot* previous,
+      const std::set<int64>& changed_ids,
+      std::vector<Bookmark>* changed_bookmarks,
+      const TypedCountMap& typed_counts);
+
+  // Returns the bookmark |id|, or NULL if the snapshot does not have it.
+  const Bookmark* GetBookmark(int64 id) const;
+
+  // Fills |matches| with the bookmarks that have, for every one of |terms|,
+  // a title word starting with it, or equal to it if it is too short for a
+  // prefix search.  The matches are in the order of their ids, and are
+  // valid as long as the snapshot is.
+  void GetBookmarksMatchingTerms(
+      const std::vector<string16>& terms,
+      std::vector<const Bookmark*>* matches) const;
+
+  // Returns true if |title| would be among the matches of |terms| above.
+  static bool TitleMatchesTerms(const string16& title,
+                                const std::vector<string16>& terms);
+
+  // Returns the lower case words of |query|.
+  static std::vector<string16> ExtractQueryWords(const string16& query);
+
+  size_t bookmark_count() const { return bookmarks_.size(); }
+  size_t term_count() const { return term_starts_.size() - 1; }
+
+ private:
+  friend class base::RefCountedThreadSafe<BookmarkIndexSnapshot>;
+
+  BookmarkIndexSnapshot();
+  ~BookmarkIndexSnapshot();
+
+  // Sets the typed count of the bookmarks whose URL is in |typed_counts|.
+  void SetTypedCounts(const TypedCountMap& typed_counts);
+
+  // Compares term |i| with |term| the way string16::compare() does.
+  int CompareTerm(size_t i, const string16& term) const;
+
+  // Returns true if term |i| starts with |prefix|.
+  bool TermHasPrefix(size_t i, const string16& prefix) const;
+
+  // Fills |matches| with the sorted indices into |bookmarks_| of the
+  // bookmarks with a title word matching |term|.  Long enough terms match
+  // the start of words, others only whole words.
+  void GetBookmarksMatchingTerm(const string16& term,
+                                std::vector<uint32>* matches) const;
+
+  // Sorted by id, so the postings of a term are sorted too.
+  std::vector<Bookmark> bookmarks_;
+
+  // The sorted terms, term |i| being [term_starts_[i], term_starts_[i + 1])
+  // of |term_chars_|.
+  string16 term_chars_;
+  std::vector<uint32> term_starts_;
+
+  // The indices into |bookmarks_| of the bookmarks with term |i| are
+  // [posting_starts_[i], posting_starts_[i + 1]) of |postings_|.
+  std::vector<uint32> postings_;
+  std::vector<uint32> posting_starts_;
+
+  DISALLOW_COPY_AND_ASSIGN(BookmarkIndexSnapshot);
+};
+
+#endif  // CHROME_BROWSER_BOOKMARKS_BOOKMARK_INDEX_SNAPSHOT_H_
@@ -8,18 +8,25 @@
 #include <vector>
 
 #include "base/message_loop/message_loop.h"
+#include "base/run_loop.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "chrome/browser/bookmarks/bookmark_index_snapshot.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/browser/bookmarks/bookmark_model_factory.h"
 #include "chrome/browser/bookmarks/bookmark_title_match.h"
+#include "chrome/browser/chrome_notification_types.h"
+#include "chrome/browser/history/history_notifications.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/history/url_database.h"
 #include "chrome/test/base/testing_profile.h"
 #include "chrome/test/base/ui_test_utils.h"
+#include "content/public/browser/notification_details.h"
+#include "content/public/browser/notification_service.h"
+#include "content/public/browser/notification_source.h"
 #include "content/public/test/test_browser_thread_bundle.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -230,6 +237,69 @@ TEST_F(BookmarkIndexTest, EmptyMatchOnMultiwideLowercaseString) {
   EXPECT_TRUE(matches[0].match_positions.empty());
 }
 
+// Makes sure a snapshot is not changed by later changes to the model, which
+// queries of the model see before they are merged into a new snapshot.
+TEST_F(BookmarkIndexTest, Snapshot) {
+  const char* input[] = { "abcd efgh", "abce", "xyz" };
+  AddBookmarksWithTitles(input, ARRAYSIZE_UNSAFE(input));
+
+  scoped_refptr<BookmarkIndexSnapshot> snapshot = model_->GetIndexSnapshot();
+  ASSERT_TRUE(snapshot.get());
+  EXPECT_EQ(3U, snapshot->bookmark_count());
+  EXPECT_EQ(4U, snapshot->term_count());
+  EXPECT_EQ(snapshot.get(), model_->GetIndexSnapshot().get());
+
+  model_->SetTitle(model_->other_node()->GetChild(1), ASCIIToUTF16("xyzzy"));
+  model_->Remove(model_->other_node(), 2);
+  const char* abc_matches[] = { "abcd efgh" };
+  ExpectMatches("abc", abc_matches, ARRAYSIZE_UNSAFE(abc_matches));
+  const char* xyz_matches[] = { "xyzzy" };
+  ExpectMatches("xyz", xyz_matches, ARRAYSIZE_UNSAFE(xyz_matches));
+
+  std::vector<const BookmarkIndexSnapshot::Bookmark*> matches;
+  snapshot->GetBookmarksMatchingTerms(
+      BookmarkIndexSnapshot::ExtractQueryWords(ASCIIToUTF16("abc")),
+      &matches);
+  EXPECT_EQ(2U, matches.size());
+
+  scoped_refptr<BookmarkIndexSnapshot> new_snapshot =
+      model_->GetIndexSnapshot();
+  EXPECT_NE(snapshot.get(), new_snapshot.get());
+  EXPECT_EQ(2U, new_snapshot->bookmark_count());
+  matches.clear();
+  new_snapshot->GetBookmarksMatchingTerms(
+      BookmarkIndexSnapshot::ExtractQueryWords(ASCIIToUTF16("abc")),
+      &matches);
+  ASSERT_EQ(1U, matches.size());
+  EXPECT_EQ(ASCIIToUTF16("abcd efgh"), matches[0]->title);
+  matches.clear();
+  new_snapshot->GetBookmarksMatchingTerms(
+      BookmarkIndexSnapshot::ExtractQueryWords(ASCIIToUTF16("xyz")),
+      &matches);
+  ASSERT_EQ(1U, matches.size());
+  EXPECT_EQ(ASCIIToUTF16("xyzzy"), matches[0]->title);
+
+  ExpectMatches("abc", abc_matches, ARRAYSIZE_UNSAFE(abc_matches));
+  ExpectMatches("xyz", xyz_matches, ARRAYSIZE_UNSAFE(xyz_matches));
+}
+
+// Makes sure queries are right while enough changes to be merged are made.
+TEST_F(BookmarkIndexTest, ManyChanges) {
+  ASSERT_TRUE(model_->GetIndexSnapshot().get());
+
+  std::vector<std::string> titles;
+  for (int i = 0; i < 200; ++i)
+    titles.push_back("page " + base::IntToString(i));
+  AddBookmarksWithTitles(titles);
+  ExpectMatches("page", titles);
+
+  for (int i = 0; i < 100; ++i)
+    model_->Remove(model_->other_node(), 0);
+  titles.erase(titles.begin(), titles.begin() + 100);
+  ExpectMatches("page", titles);
+  EXPECT_EQ(100U, model_->GetIndexSnapshot()->bookmark_count());
+}
+
 TEST_F(BookmarkIndexTest, GetResultsSortedByTypedCount) {
   // This ensures MessageLoop::current() will exist, which is needed by
   // TestingProfile::BlockUntilHistoryProcessesPendingRequests().
@@ -309,4 +379,25 @@ TEST_F(BookmarkIndexTest, GetResultsSortedByTypedCount) {
   EXPECT_EQ(2, static_cast<int>(matches.size()));
   EXPECT_EQ(data[0].url, matches[0].node->url());
   EXPECT_EQ(data[3].url, matches[1].node->url());
+
+  // The typed counts history reports are used from then on, before and
+  // after they are merged into the snapshot.
+  history::URLsModifiedDetails modified_details;
+  history::URLRow maps_row(data[1].url);
+  maps_row.set_typed_count(200);
+  modified_details.changed_urls.push_back(maps_row);
+  content::NotificationService::current()->Notify(
+      chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+      content::Source<Profile>(&profile),
+      content::Details<history::URLsModifiedDetails>(&modified_details));
+  for (int i = 0; i < 2; ++i) {
+    matches.clear();
+    model->GetBookmarksWithTitlesMatching(ASCIIToUTF16("google"), 2, &matches);
+    ASSERT_EQ(2U, matches.size());
+    EXPECT_EQ(data[1].url, matches[0].node->url());
+    EXPECT_EQ(data[0].url, matches[1].node->url());
+
+    ASSERT_TRUE(model->GetIndexSnapshot().get());
+    base::RunLoop().RunUntilIdle();
+  }
 }
@@ -0,0 +1,379 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_journal.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "base/json/json_reader.h"
+#include "base/json/json_writer.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/values.h"
+#include "chrome/browser/bookmarks/bookmark_codec.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+
+namespace {
+
+typedef std::map<int64, BookmarkNode*> NodeMap;
+
+// Adds |node| and its descendants to |nodes|.
+void AddToNodeMap(BookmarkNode* node, NodeMap* nodes) {
+  (*nodes)[node->id()] = node;
+  for (int i = 0; i < node->child_count(); ++i)
+    AddToNodeMap(node->GetChild(i), nodes);
+}
+
+// Removes |node| and its descendants from |nodes|.
+void RemoveFromNodeMap(const BookmarkNode* node, NodeMap* nodes) {
+  nodes->erase(node->id());
+  for (int i = 0; i < node->child_count(); ++i)
+    RemoveFromNodeMap(node->GetChild(i), nodes);
+}
+
+bool IsPermanentNode(const BookmarkNode* node) {
+  return node->type() == BookmarkNode::BOOKMARK_BAR ||
+      node->type() == BookmarkNode::OTHER_NODE ||
+      node->type() == BookmarkNode::MOBILE;
+}
+
+// Encodes |node| the way BookmarkCodec does, leaving out its children.
+base::DictionaryValue* EncodeNode(const BookmarkNode* node) {
+  base::DictionaryValue* value = new base::DictionaryValue();
+  value->SetString(BookmarkCodec::kIdKey, base::Int64ToString(node->id()));
+  value->SetString(BookmarkCodec::kNameKey, node->GetTitle());
+  value->SetString(BookmarkCodec::kDateAddedKey,
+                   base::Int64ToString(node->date_added().ToInternalValue()));
+  if (node->is_url()) {
+    value->SetString(BookmarkCodec::kTypeKey, BookmarkCodec::kTypeURL);
+    value->SetString(BookmarkCodec::kURLKey,
+                     node->url().possibly_invalid_spec());
+  } else {
+    value->SetString(BookmarkCodec::kTypeKey, BookmarkCodec::kTypeFolder);
+    value->SetString(
+        BookmarkCodec::kDateModifiedKey,
+        base::Int64ToString(node->date_folder_modified().ToInternalValue()));
+  }
+  if (!node->meta_info_str().empty())
+    value->SetString(BookmarkCodec::kMetaInfo, node->meta_info_str());
+  return value;
+}
+
+// Reads an id written by EncodeNode() or for a folder's children.
+bool GetId(const base::Value* value, int64* id) {
+  std::string id_string;
+  return value->GetAsString(&id_string) &&
+      base::StringToInt64(id_string, id);
+}
+
+// Reads a date written by EncodeNode(), leaving |date| alone if there is
+// none.
+bool GetDate(const base::DictionaryValue& value,
+             const char* key,
+             base::Time* date) {
+  std::string date_string;
+  int64 internal_value;
+  if (!value.GetString(key, &date_string))
+    return true;
+  if (!base::StringToInt64(date_string, &internal_value))
+    return false;
+  *date = base::Time::FromInternalValue(internal_value);
+  return true;
+}
+
+// Sets the values of the node encoded in |value|, creating it if it is not
+// in |nodes|.  New nodes are added to |nodes| and |detached_nodes|.
+bool UpsertNode(const base::DictionaryValue& value,
+                NodeMap* nodes,
+                std::set<BookmarkNode*>* detached_nodes,
+                int64* max_node_id) {
+  const base::Value* id_value;
+  int64 id;
+  std::string type;
+  if (!value.Get(BookmarkCodec::kIdKey, &id_value) ||
+      !GetId(id_value, &id) ||
+      !value.GetString(BookmarkCodec::kTypeKey, &type) ||
+      (type != BookmarkCodec::kTypeURL && type != BookmarkCodec::kTypeFolder)) {
+    return false;
+  }
+
+  BookmarkNode* node;
+  NodeMap::const_iterator i = nodes->find(id);
+  if (i != nodes->end()) {
+    node = i->second;
+  } else {
+    node = new BookmarkNode(id, GURL());
+    node->set_type(type == BookmarkCodec::kTypeURL ? BookmarkNode::URL :
+                                                     BookmarkNode::FOLDER);
+    (*nodes)[id] = node;
+    detached_nodes->insert(node);
+    *max_node_id = std::max(*max_node_id, id + 1);
+  }
+
+  base::Time date_added = node->date_added();
+  base::Time date_modified = node->date_folder_modified();
+  if (!GetDate(value, BookmarkCodec::kDateAddedKey, &date_added) ||
+      !GetDate(value, BookmarkCodec::kDateModifiedKey, &date_modified)) {
+    return false;
+  }
+  node->set_date_added(date_added);
+  node->set_date_folder_modified(date_modified);
+
+  std::string meta_info;
+  value.GetString(BookmarkCodec::kMetaInfo, &meta_info);
+  node->set_meta_info_str(meta_info);
+
+  // The titles of the permanent nodes are localized rather than read.
+  if (!IsPermanentNode(node)) {
+    string16 title;
+    value.GetString(BookmarkCodec::kNameKey, &title);
+    node->SetTitle(title);
+  }
+
+  std::string url;
+  if (node->is_url() && value.GetString(BookmarkCodec::kURLKey, &url))
+    node->set_url(GURL(url));
+  return true;
+}
+
+// Returns the folder whose children |folder_value| lists, or NULL if it is
+// not in |nodes|.  Returns false if |folder_value| can't be read.
+bool GetFolder(const base::DictionaryValue& folder_value,
+               const NodeMap& nodes,
+               BookmarkNode** folder,
+               const base::ListValue** children) {
+  const base::Value* id_value;
+  int64 id;
+  if (!folder_value.Get(BookmarkCodec::kIdKey, &id_value) ||
+      !GetId(id_value, &id) ||
+      !folder_value.GetList(BookmarkCodec::kChildrenKey, children)) {
+    return false;
+  }
+  NodeMap::const_iterator i = nodes.find(id);
+  *folder = (i != nodes.end() && i->second->is_folder()) ? i->second : NULL;
+  return true;
+}
+
+// Detaches the children of |folder| into |detached_nodes|.
+void DetachChildren(BookmarkNode* folder,
+                    std::set<BookmarkNode*>* detached_nodes) {
+  while (folder->child_count()) {
+    BookmarkNode* child = folder->GetChild(folder->child_count() - 1);
+    folder->Remove(child);
+    detached_nodes->insert(child);
+  }
+}
+
+// Gives |folder| the |children| listed for it, taking them from wherever
+// they are.  That may be a folder which was removed after they were moved
+// out of it, so the entry doesn't list its children.
+bool AttachChildren(BookmarkNode* folder,
+                    const base::ListValue& children,
+                    const NodeMap& nodes) {
+  for (size_t i = 0; i < children.GetSize(); ++i) {
+    const base::Value* child_value;
+    int64 child_id;
+    if (!children.Get(i, &child_value) || !GetId(child_value, &child_id))
+      return false;
+    NodeMap::const_iterator child = nodes.find(child_id);
+    if (child == nodes.end() || IsPermanentNode(child->second) ||
+        folder->HasAncestor(child->second)) {
+      continue;
+    }
+    if (child->second->parent() == folder)
+      continue;  // Listed twice.
+    if (child->second->parent())
+      child->second->parent()->Remove(child->second);
+    folder->Add(child->second, folder->child_count());
+  }
+  return true;
+}
+
+// Applies one entry of a journal.
+bool ReplayEntry(const base::DictionaryValue& entry,
+                 NodeMap* nodes,
+                 std::string* model_meta_info,
+                 int64* max_node_id) {
+  std::set<BookmarkNode*> detached_nodes;
+  bool success = true;
+
+  const base::ListValue* node_values;
+  if (entry.GetList(BookmarkJournal::kNodesKey, &node_values)) {
+    for (size_t i = 0; success && i < node_values->GetSize(); ++i) {
+      const base::DictionaryValue* node_value;
+      success = node_values->GetDictionary(i, &node_value) &&
+          UpsertNode(*node_value, nodes, &detached_nodes, max_node_id);
+    }
+  }
+
+  // A node moved between two of the folders is only attached to its new
+  // folder once all of them have been emptied.
+  std::vector<std::pair<BookmarkNode*, const base::ListValue*> > folders;
+  const base::ListValue* folder_values;
+  if (success && entry.GetList(BookmarkJournal::kFoldersKey, &folder_values)) {
+    for (size_t i = 0; success && i < folder_values->GetSize(); ++i) {
+      const base::DictionaryValue* folder_value;
+      BookmarkNode* folder;
+      const base::ListValue* children;
+      success = folder_values->GetDictionary(i, &folder_value) &&
+          GetFolder(*folder_value, *nodes, &folder, &children);
+      if (success && folder) {
+        DetachChildren(folder, &detached_nodes);
+        folders.push_back(std::make_pair(folder, children));
+      }
+    }
+  }
+  for (size_t i = 0; success && i < folders.size(); ++i)
+    success = AttachChildren(folders[i].first, *folders[i].second, *nodes);
+
+  // Whatever was left out of its folder was removed.  Collect the nodes
+  // first, as deleting one deletes the detached nodes inside it.
+  std::vector<BookmarkNode*> removed_nodes;
+  for (std::set<BookmarkNode*>::const_iterator i = detached_nodes.begin();
+       i != detached_nodes.end(); ++i) {
+    if (!(*i)->parent())
+      removed_nodes.push_back(*i);
+  }
+  for (size_t i = 0; i < removed_nodes.size(); ++i) {
+    RemoveFromNodeMap(removed_nodes[i], nodes);
+    delete removed_nodes[i];
+  }
+
+  if (success)
+    entry.GetString(BookmarkCodec::kMetaInfo, model_meta_info);
+  return success;
+}
+
+}  // namespace
+
+const char* BookmarkJournal::kNodesKey = "nodes";
+const char* BookmarkJournal::kFoldersKey = "folders";
+
+BookmarkJournal::BookmarkJournal() : model_meta_info_changed_(false) {
+}
+
+BookmarkJournal::~BookmarkJournal() {
+}
+
+void BookmarkJournal::NodeChanged(const BookmarkNode* node) {
+  if (node->parent())
+    changed_nodes_.insert(node->id());
+  else
+    model_meta_info_changed_ = true;
+}
+
+void BookmarkJournal::ChildrenChanged(const BookmarkNode* folder) {
+  changed_folders_.insert(folder->id());
+}
+
+bool BookmarkJournal::empty() const {
+  return changed_nodes_.empty() && changed_folders_.empty() &&
+      !model_meta_info_changed_;
+}
+
+void BookmarkJournal::Clear() {
+  changed_nodes_.clear();
+  changed_folders_.clear();
+  model_meta_info_changed_ = false;
+}
+
+// static
+std::string BookmarkJournal::CreateHeader(const std::string& checksum) {
+  base::DictionaryValue header;
+  header.SetString(BookmarkCodec::kChecksumKey, checksum);
+  std::string json;
+  base::JSONWriter::Write(&header, &json);
+  return json + "\n";
+}
+
+std::string BookmarkJournal::TakeEntry(BookmarkModel* model) {
+  base::ListValue* node_values = new base::ListValue();
+  base::ListValue* folder_values = new base::ListValue();
+
+  // Walk the bookmarks once, in the order they are in the file.
+  std::vector<const BookmarkNode*> pending;
+  pending.push_back(model->mobile_node());
+  pending.push_back(model->other_node());
+  pending.push_back(model->bookmark_bar_node());
+  while (!pending.empty()) {
+    const BookmarkNode* node = pending.back();
+    pending.pop_back();
+    if (changed_nodes_.count(node->id()))
+      node_values->Append(EncodeNode(node));
+    if (changed_folders_.count(node->id())) {
+      base::DictionaryValue* folder_value = new base::DictionaryValue();
+      folder_value->SetString(BookmarkCodec::kIdKey,
+                              base::Int64ToString(node->id()));
+      base::ListValue* children = new base::ListValue();
+      for (int i = 0; i < node->child_count(); ++i) {
+        children->AppendString(
+            base::Int64ToString(node->GetChild(i)->id()));
+      }
+      folder_value->Set(BookmarkCodec::kChildrenKey, children);
+      folder_values->Append(folder_value);
+    }
+    for (int i = node->child_count() - 1; i >= 0; --i)
+      pending.push_back(node->GetChild(i));
+  }
+
+  base::DictionaryValue entry;
+  entry.Set(kNodesKey, node_values);
+  entry.Set(kFoldersKey, folder_values);
+  if (model_meta_info_changed_) {
+    entry.SetString(BookmarkCodec::kMetaInfo,
+                    model->root_node()->meta_info_str());
+  }
+  Clear();
+
+  std::string json;
+  base::JSONWriter::Write(&entry, &json);
+  return json + "\n";
+}
+
+// static
+bool BookmarkJournal::Replay(const std::string& journal,
+                             const std::string& checksum,
+                             BookmarkNode* bb_node,
+                             BookmarkNode* other_folder_node,
+                             BookmarkNode* mobile_folder_node,
+                             std::string* model_meta_info,
+                             int64* max_node_id) {
+  NodeMap nodes;
+  AddToNodeMap(bb_node, &nodes);
+  AddToNodeMap(other_folder_node, &nodes);
+  AddToNodeMap(mobile_folder_node, &nodes);
+
+  size_t start = 0;
+  bool is_header = true;
+  while (start < journal.size()) {
+    const size_t end = journal.find('\n', start);
+    // A line without its line break was cut short while being written.
+    if (end == std::string::npos)
+      return false;
+    scoped_ptr<base::Value> value(
+        base::JSONReader::Read(journal.substr(start, end - start)));
+    start = end + 1;
+    base::DictionaryValue* entry;
+    if (!value.get() || !value->GetAsDictionary(&entry))
+      return false;
+
+    if (is_header) {
+      // A journal left behind by an earlier file is of no use.
+      std::string journal_checksum;
+      if (!entry->GetString(BookmarkCodec::kChecksumKey, &journal_checksum) ||
+          journal_checksum != checksum) {
+        return false;
+      }
+      is_header = false;
+      continue;
+    }
+    if (!ReplayEntry(*entry, &nodes, model_meta_info, max_node_id))
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_BOOKMARKS_BOOKMARK_JOURNAL_H_
+#define CHROME_BROWSER_BOOKMARKS_BOOKMARK_JOURNAL_H_
+
+#include <set>
+#include <string>
+
+#include "base/basictypes.h"
+
+class BookmarkModel;
+class BookmarkNode;
+
+// BookmarkJournal keeps track of the bookmarks which changed since the
+// bookmarks file was written, so that BookmarkStorage can append them to a
+// journal next to the file instead of rewriting all of it, and replays the
+// journal onto the bookmarks decoded from the file.
+//
+// The journal starts with a line holding the checksum of the file it
+// belongs to, so that a journal left behind by an earlier file is ignored.
+// Each line after it is a JSON dictionary with the changed nodes, encoded as
+// in the bookmarks file but without their children, and the ids of the
+// children of each folder whose children were added, removed or moved.
+class BookmarkJournal {
+ public:
+  // Names of the keys of an entry.
+  static const char* kNodesKey;
+  static const char* kFoldersKey;
+
+  BookmarkJournal();
+  ~BookmarkJournal();
+
+  // Records that the title, URL, dates or meta info of |node| changed.  For
+  // the root node this is the meta info of the model.
+  void NodeChanged(const BookmarkNode* node);
+
+  // Records that children were added to, removed from or moved in |folder|.
+  void ChildrenChanged(const BookmarkNode* folder);
+
+  // Returns true if nothing changed since the last entry.
+  bool empty() const;
+
+  // Forgets the changes, as when the whole file is written.
+  void Clear();
+
+  // Returns the first line of a journal for the file with |checksum|.
+  static std::string CreateHeader(const std::string& checksum);
+
+  // Returns an entry, including the line break, with the current state in
+  // |model| of what changed, and forgets the changes.
+  std::string TakeEntry(BookmarkModel* model);
+
+  // Applies the entries of |journal| to the nodes decoded from the bookmarks
+  // file with |checksum| and to |model_meta_info|, raising |max_node_id|
+  // above the ids of any nodes it adds.  Returns false if the journal is not
+  // for that file or an entry could not be read, in which case the entries
+  // before it have been applied.
+  static bool Replay(const std::string& journal,
+                     const std::string& checksum,
+                     BookmarkNode* bb_node,
+                     BookmarkNode* other_folder_node,
+                     BookmarkNode* mobile_folder_node,
+                     std::string* model_meta_info,
+                     int64* max_node_id);
+
+ private:
+  std::set<int64> changed_nodes_;
+  std::set<int64> changed_folders_;
+  bool model_meta_info_changed_;
+
+  DISALLOW_COPY_AND_ASSIGN(BookmarkJournal);
+};
+
+#endif  // CHROME_BROWSER_BOOKMARKS_BOOKMARK_JOURNAL_H_
@@ -0,0 +1,144 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_journal.h"
+
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/values.h"
+#include "chrome/browser/bookmarks/bookmark_codec.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+#include "chrome/browser/bookmarks/bookmark_model_test_utils.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+BookmarkNode* AsMutable(const BookmarkNode* node) {
+  return const_cast<BookmarkNode*>(node);
+}
+
+class BookmarkJournalTest : public testing::Test {
+ public:
+  BookmarkJournalTest() : model_(NULL), file_model_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    const BookmarkNode* bb = model_.bookmark_bar_node();
+    model_.AddURL(bb, 0, ASCIIToUTF16("url1"), GURL("http://www.url1.com"));
+    folder_ = model_.AddFolder(bb, 1, ASCIIToUTF16("folder1"));
+    model_.AddURL(folder_, 0, ASCIIToUTF16("url2"),
+                  GURL("http://www.url2.com"));
+    model_.AddURL(model_.other_node(), 0, ASCIIToUTF16("url3"),
+                  GURL("http://www.url3.com"));
+    WriteFile();
+  }
+
+ protected:
+  // Encodes |model_| as the bookmarks file, and starts a journal for it.
+  void WriteFile() {
+    BookmarkCodec codec;
+    file_value_.reset(codec.Encode(&model_));
+    journal_text_ = BookmarkJournal::CreateHeader(codec.stored_checksum());
+    journal_.Clear();
+  }
+
+  void AppendEntry() {
+    journal_text_ += journal_.TakeEntry(&model_);
+  }
+
+  // Decodes the file into |file_model_| and replays |journal| onto it.
+  bool Replay(const std::string& journal) {
+    BookmarkCodec codec;
+    int64 max_id;
+    EXPECT_TRUE(codec.Decode(AsMutable(file_model_.bookmark_bar_node()),
+                             AsMutable(file_model_.other_node()),
+                             AsMutable(file_model_.mobile_node()),
+                             &max_id, *file_value_));
+    std::string meta_info = codec.model_meta_info();
+    bool result = BookmarkJournal::Replay(
+        journal, codec.stored_checksum(),
+        AsMutable(file_model_.bookmark_bar_node()),
+        AsMutable(file_model_.other_node()),
+        AsMutable(file_model_.mobile_node()), &meta_info, &max_id);
+    file_model_.set_next_node_id(max_id);
+    AsMutable(file_model_.root_node())->set_meta_info_str(meta_info);
+    return result;
+  }
+
+  BookmarkModel model_;
+  BookmarkModel file_model_;
+  const BookmarkNode* folder_;
+  BookmarkJournal journal_;
+  scoped_ptr<Value> file_value_;
+  std::string journal_text_;
+};
+
+TEST_F(BookmarkJournalTest, ReplayChanges) {
+  const BookmarkNode* bb = model_.bookmark_bar_node();
+  const BookmarkNode* other = model_.other_node();
+
+  model_.SetTitle(bb->GetChild(0), ASCIIToUTF16("changed"));
+  journal_.NodeChanged(bb->GetChild(0));
+  model_.SetNodeMetaInfo(model_.root_node(), "key", "value");
+  journal_.NodeChanged(model_.root_node());
+  AppendEntry();
+
+  // Move a bookmark out of a folder which is then removed, and add a new
+  // folder with a bookmark in it.
+  const BookmarkNode* url2 = folder_->GetChild(0);
+  model_.Move(url2, other, 1);
+  journal_.ChildrenChanged(folder_);
+  journal_.ChildrenChanged(other);
+  journal_.NodeChanged(other);
+  model_.Remove(bb, 1);
+  journal_.ChildrenChanged(bb);
+  const BookmarkNode* folder2 =
+      model_.AddFolder(other, 0, ASCIIToUTF16("folder2"));
+  const BookmarkNode* url4 = model_.AddURL(folder2, 0, ASCIIToUTF16("url4"),
+                                           GURL("http://www.url4.com"));
+  journal_.NodeChanged(folder2);
+  journal_.NodeChanged(url4);
+  journal_.ChildrenChanged(folder2);
+  journal_.ChildrenChanged(other);
+  AppendEntry();
+  EXPECT_TRUE(journal_.empty());
+
+  ASSERT_TRUE(Replay(journal_text_));
+  BookmarkModelTestUtils::AssertModelsEqual(&model_, &file_model_, true);
+  EXPECT_LT(url4->id(), file_model_.next_node_id());
+  std::string meta_value;
+  EXPECT_TRUE(file_model_.root_node()->GetMetaInfo("key", &meta_value));
+  EXPECT_EQ("value", meta_value);
+}
+
+TEST_F(BookmarkJournalTest, IgnoreJournalOfOtherFile) {
+  model_.SetTitle(folder_, ASCIIToUTF16("changed"));
+  journal_.NodeChanged(folder_);
+  AppendEntry();
+  const std::string old_journal = journal_text_;
+
+  model_.SetTitle(folder_, ASCIIToUTF16("changed again"));
+  WriteFile();
+
+  EXPECT_FALSE(Replay(old_journal));
+  BookmarkModelTestUtils::AssertModelsEqual(&model_, &file_model_, true);
+}
+
+TEST_F(BookmarkJournalTest, StopAtPartialEntry) {
+  const BookmarkNode* url1 = model_.bookmark_bar_node()->GetChild(0);
+  model_.SetTitle(url1, ASCIIToUTF16("changed"));
+  journal_.NodeChanged(url1);
+  AppendEntry();
+
+  model_.SetTitle(url1, ASCIIToUTF16("changed again"));
+  journal_.NodeChanged(url1);
+  AppendEntry();
+
+  // The first entry is applied, and the one cut short isn't.
+  EXPECT_FALSE(Replay(journal_text_.substr(0, journal_text_.size() - 1)));
+  EXPECT_EQ(ASCIIToUTF16("changed"),
+            file_model_.bookmark_bar_node()->GetChild(0)->GetTitle());
+}
+
+}  // namespace
@@ -0,0 +1,318 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_json_reader.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "base/logging.h"
+#include "base/strings/string_util.h"
+#include "base/strings/utf_string_conversion_utils.h"
+#include "third_party/icu/source/common/unicode/utf16.h"
+
+namespace {
+
+const char kUTF8ByteOrderMark[] = "\xEF\xBB\xBF";
+
+// Reads one JSON value.  Rather than recursing into arrays and objects,
+// keeps the containers it is inside on a stack, so that deep nesting cannot
+// overflow the thread's stack.
+class Parser {
+ public:
+  Parser(const base::StringPiece& json, BookmarkJSONReader::Delegate* delegate)
+      : pos_(json.data()),
+        end_(json.data() + json.size()),
+        delegate_(delegate),
+        container_opened_(false) {
+  }
+
+  bool Parse();
+
+ private:
+  // Skips whitespace and comments.  Returns false on an unterminated
+  // comment.
+  bool SkipWhitespace();
+
+  // Reads a value, reporting it to the delegate.  An array or object is
+  // only opened; Parse() reads its contents.
+  bool ReadValue();
+
+  // Reads an object member's key and the colon after it.
+  bool ReadKey();
+
+  bool ReadString(std::string* value);
+  bool ReadEscape(std::string* value);
+  bool ReadHexDigits(int count, uint32* value);
+  bool ReadLiteral();
+  bool ReadDigits();
+
+  const char* pos_;
+  const char* end_;
+  BookmarkJSONReader::Delegate* delegate_;
+
+  // '{' or '[' for each container being read, innermost last.
+  std::vector<char> stack_;
+
+  // True if the innermost container was opened by the last value read, so
+  // it may be closed without a comma.
+  bool container_opened_;
+
+  DISALLOW_COPY_AND_ASSIGN(Parser);
+};
+
+bool Parser::Parse() {
+  if (base::StringPiece(pos_, end_ - pos_).starts_with(kUTF8ByteOrderMark))
+    pos_ += arraysize(kUTF8ByteOrderMark) - 1;
+
+  if (!ReadValue())
+    return false;
+  while (!stack_.empty()) {
+    if (!SkipWhitespace() || pos_ == end_)
+      return false;
+    const bool in_object = stack_.back() == '{';
+    if (*pos_ == (in_object ? '}' : ']')) {
+      ++pos_;
+      stack_.pop_back();
+      container_opened_ = false;
+      if (!(in_object ? delegate_->OnEndObject() : delegate_->OnEndArray()))
+        return false;
+      continue;
+    }
+    if (!container_opened_) {
+      if (*pos_ != ',')
+        return false;
+      ++pos_;
+    }
+    container_opened_ = false;
+    if (in_object && !ReadKey())
+      return false;
+    if (!ReadValue())
+      return false;
+  }
+  return SkipWhitespace() && pos_ == end_;
+}
+
+bool Parser::SkipWhitespace() {
+  while (pos_ != end_) {
+    switch (*pos_) {
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\n':
+        ++pos_;
+        break;
+      case '/':
+        if (end_ - pos_ < 2)
+          return false;
+        if (pos_[1] == '/') {
+          while (pos_ != end_ && *pos_ != '\n' && *pos_ != '\r')
+            ++pos_;
+        } else if (pos_[1] == '*') {
+          const size_t close =
+              base::StringPiece(pos_, end_ - pos_).find("*/", 2);
+          if (close == base::StringPiece::npos)
+            return false;
+          pos_ += close + 2;
+        } else {
+          return false;
+        }
+        break;
+      default:
+        return true;
+    }
+  }
+  return true;
+}
+
+bool Parser::ReadValue() {
+  if (!SkipWhitespace() || pos_ == end_)
+    return false;
+  switch (*pos_) {
+    case '{':
+    case '[': {
+      if (stack_.size() >= static_cast<size_t>(
+              BookmarkJSONReader::kStackMaxDepth)) {
+        return false;
+      }
+      const char open = *pos_++;
+      stack_.push_back(open);
+      container_opened_ = true;
+      return open == '{' ? delegate_->OnStartObject() :
+                           delegate_->OnStartArray();
+    }
+    case '"': {
+      std::string value;
+      return ReadString(&value) && delegate_->OnString(value);
+    }
+    default:
+      return ReadLiteral();
+  }
+}
+
+bool Parser::ReadKey() {
+  std::string key;
+  if (!SkipWhitespace() || pos_ == end_ || *pos_ != '"' ||
+      !ReadString(&key) || !SkipWhitespace() || pos_ == end_ ||
+      *pos_ != ':') {
+    return false;
+  }
+  ++pos_;
+  return delegate_->OnKey(key);
+}
+
+bool Parser::ReadString(std::string* value) {
+  DCHECK_EQ('"', *pos_);
+  ++pos_;
+  while (pos_ != end_) {
+    // Copy runs of plain characters at once.
+    const char* run = pos_;
+    bool ascii = true;
+    while (pos_ != end_ && *pos_ != '"' && *pos_ != '\\') {
+      ascii = ascii && !(*pos_ & 0x80);
+      ++pos_;
+    }
+    if (pos_ != run) {
+      const std::string text(run, pos_ - run);
+      if (!ascii && !IsStringUTF8(text))
+        return false;
+      value->append(text);
+    }
+    if (pos_ == end_)
+      return false;
+    if (*pos_ == '"') {
+      ++pos_;
+      return true;
+    }
+    ++pos_;
+    if (!ReadEscape(value))
+      return false;
+  }
+  return false;
+}
+
+bool Parser::ReadEscape(std::string* value) {
+  if (pos_ == end_)
+    return false;
+  const char escape = *pos_++;
+  switch (escape) {
+    case '"':
+    case '\\':
+    case '/':
+      value->push_back(escape);
+      return true;
+    case 'b':
+      value->push_back('\b');
+      return true;
+    case 'f':
+      value->push_back('\f');
+      return true;
+    case 'n':
+      value->push_back('\n');
+      return true;
+    case 'r':
+      value->push_back('\r');
+      return true;
+    case 't':
+      value->push_back('\t');
+      return true;
+    case 'v':
+      value->push_back('\v');
+      return true;
+    case 'x': {
+      // Like base::JSONReader, allow "\xXX" for a Latin-1 character.
+      uint32 code_point;
+      if (!ReadHexDigits(2, &code_point))
+        return false;
+      base::WriteUnicodeCharacter(code_point, value);
+      return true;
+    }
+    case 'u': {
+      uint32 code_unit;
+      if (!ReadHexDigits(4, &code_unit))
+        return false;
+      if (U16_IS_TRAIL(code_unit))
+        return false;
+      uint32 code_point = code_unit;
+      if (U16_IS_LEAD(code_unit)) {
+        // The other half of the surrogate pair must follow.
+        uint32 trail;
+        if (end_ - pos_ < 2 || pos_[0] != '\\' || pos_[1] != 'u')
+          return false;
+        pos_ += 2;
+        if (!ReadHexDigits(4, &trail) || !U16_IS_TRAIL(trail))
+          return false;
+        code_point = U16_GET_SUPPLEMENTARY(code_unit, trail);
+      }
+      base::WriteUnicodeCharacter(code_point, value);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool Parser::ReadHexDigits(int count, uint32* value) {
+  if (end_ - pos_ < count)
+    return false;
+  *value = 0;
+  for (int i = 0; i < count; ++i, ++pos_) {
+    if (!IsHexDigit(*pos_))
+      return false;
+    *value = *value * 16 + HexDigitToInt(*pos_);
+  }
+  return true;
+}
+
+bool Parser::ReadLiteral() {
+  const char* start = pos_;
+  static const char* const kKeywords[] = { "true", "false", "null" };
+  for (size_t i = 0; i < arraysize(kKeywords); ++i) {
+    if (base::StringPiece(pos_, end_ - pos_).starts_with(kKeywords[i])) {
+      pos_ += strlen(kKeywords[i]);
+      return delegate_->OnLiteral(base::StringPiece(start, pos_ - start));
+    }
+  }
+
+  // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][-+]?[0-9]+)?
+  if (pos_ != end_ && *pos_ == '-')
+    ++pos_;
+  if (pos_ != end_ && *pos_ == '0') {
+    ++pos_;
+  } else if (!ReadDigits()) {
+    return false;
+  }
+  if (pos_ != end_ && *pos_ == '.') {
+    ++pos_;
+    if (!ReadDigits())
+      return false;
+  }
+  if (pos_ != end_ && (*pos_ == 'e' || *pos_ == 'E')) {
+    ++pos_;
+    if (pos_ != end_ && (*pos_ == '-' || *pos_ == '+'))
+      ++pos_;
+    if (!ReadDigits())
+      return false;
+  }
+  return delegate_->OnLiteral(base::StringPiece(start, pos_ - start));
+}
+
+bool Parser::ReadDigits() {
+  const char* start = pos_;
+  while (pos_ != end_ && IsAsciiDigit(*pos_))
+    ++pos_;
+  return pos_ != start;
+}
+
+}  // namespace
+
+const int BookmarkJSONReader::kStackMaxDepth = 100;
+
+// static
+bool BookmarkJSONReader::Read(const base::StringPiece& json,
+                              Delegate* delegate) {
+  Parser parser(json, delegate);
+  return parser.Parse();
+}
@@ -0,0 +1,60 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_BOOKMARKS_BOOKMARK_JSON_READER_H_
+#define CHROME_BROWSER_BOOKMARKS_BOOKMARK_JSON_READER_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+
+// BookmarkJSONReader reads JSON text the way base::JSONReader does, but
+// rather than building a base::Value tree it reports what it reads, in
+// order, to a Delegate.  This lets BookmarkCodec build the bookmark nodes
+// straight from the bookmarks file, without holding a second copy of all of
+// the bookmarks as Values.
+//
+// As with base::JSONReader, the text must be UTF-8 and may start with a
+// byte order mark and contain comments, but trailing commas are not
+// allowed.
+class BookmarkJSONReader {
+ public:
+  // Receives the contents of the text as they are read.  Returning false
+  // from any method stops reading.
+  class Delegate {
+   public:
+    // An object's members are reported as a key followed by its value.
+    virtual bool OnStartObject() = 0;
+    virtual bool OnKey(const std::string& key) = 0;
+    virtual bool OnEndObject() = 0;
+
+    virtual bool OnStartArray() = 0;
+    virtual bool OnEndArray() = 0;
+
+    // |value| is UTF-8, with the escapes replaced.
+    virtual bool OnString(const std::string& value) = 0;
+
+    // Called for a number, true, false or null, with the text of it.
+    virtual bool OnLiteral(const base::StringPiece& text) = 0;
+
+   protected:
+    virtual ~Delegate() {}
+  };
+
+  // The maximum nesting of arrays and objects, the same as base::JSONReader
+  // allows.
+  static const int kStackMaxDepth;
+
+  // Reads |json|, which must hold a single value, reporting its contents to
+  // |delegate|.  Returns false if the text is not valid JSON or the delegate
+  // stopped reading, in which case the delegate may have been told about
+  // only part of it.
+  static bool Read(const base::StringPiece& json, Delegate* delegate);
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(BookmarkJSONReader);
+};
+
+#endif  // CHROME_BROWSER_BOOKMARKS_BOOKMARK_JSON_READER_H_
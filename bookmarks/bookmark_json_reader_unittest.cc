@@ -0,0 +1,188 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_json_reader.h"
+
+#include <string>
+
+#include "base/compiler_specific.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+// Records what the reader reports as a string of space separated events,
+// optionally stopping the read after some number of them.
+class RecordingDelegate : public BookmarkJSONReader::Delegate {
+ public:
+  explicit RecordingDelegate(int max_events)
+      : max_events_(max_events),
+        event_count_(0) {
+  }
+  virtual ~RecordingDelegate() {}
+
+  virtual bool OnStartObject() OVERRIDE { return Record("{"); }
+  virtual bool OnKey(const std::string& key) OVERRIDE {
+    return Record("k(" + key + ")");
+  }
+  virtual bool OnEndObject() OVERRIDE { return Record("}"); }
+  virtual bool OnStartArray() OVERRIDE { return Record("["); }
+  virtual bool OnEndArray() OVERRIDE { return Record("]"); }
+  virtual bool OnString(const std::string& value) OVERRIDE {
+    return Record("s(" + value + ")");
+  }
+  virtual bool OnLiteral(const base::StringPiece& text) OVERRIDE {
+    return Record("l(" + text.as_string() + ")");
+  }
+
+  const std::string& events() const { return events_; }
+
+ private:
+  bool Record(const std::string& event) {
+    if (!events_.empty())
+      events_.push_back(' ');
+    events_.append(event);
+    return ++event_count_ != max_events_;
+  }
+
+  const int max_events_;
+  int event_count_;
+  std::string events_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordingDelegate);
+};
+
+// Reads |json|, returning the events reported, or "FAILED" if the read
+// failed.
+std::string Read(const std::string& json) {
+  RecordingDelegate delegate(-1);
+  if (!BookmarkJSONReader::Read(json, &delegate))
+    return "FAILED";
+  return delegate.events();
+}
+
+}  // namespace
+
+TEST(BookmarkJSONReaderTest, Values) {
+  EXPECT_EQ("{ k(a) [ l(1) l(-2.5e3) l(0.25) l(true) l(false) l(null) ] "
+            "k(b) s(x) k(c) { } k(d) [ ] }",
+            Read("{\"a\": [1, -2.5e3, 0.25, true, false, null],\n"
+                 " \"b\" : \"x\", \"c\": {}, \"d\": []}"));
+  EXPECT_EQ("l(0)", Read(" 0 "));
+  EXPECT_EQ("s()", Read("\"\""));
+}
+
+TEST(BookmarkJSONReaderTest, StringEscapes) {
+  EXPECT_EQ("s(\"\\/\b\f\n\r\t\vA)",
+            Read("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\v\\x41\""));
+  EXPECT_EQ("s(a\xC3\xA9z)", Read("\"a\\u00e9z\""));
+  EXPECT_EQ("s(\xC3\xA9)", Read("\"\\xe9\""));
+  // UTF-8 in the text is copied as it is.
+  EXPECT_EQ("s(\xE2\x82\xAC)", Read("\"\xE2\x82\xAC\""));
+
+  EXPECT_EQ("FAILED", Read("\"\\q\""));
+  EXPECT_EQ("FAILED", Read("\"\\u00e\""));
+  EXPECT_EQ("FAILED", Read("\"\\u00eg\""));
+  EXPECT_EQ("FAILED", Read("\"\\x4\""));
+  EXPECT_EQ("FAILED", Read("\"\\"));
+  // Invalid UTF-8.
+  EXPECT_EQ("FAILED", Read("\"\xC3\""));
+  EXPECT_EQ("FAILED", Read("\"\xFF\xFE\""));
+}
+
+TEST(BookmarkJSONReaderTest, SurrogatePairs) {
+  EXPECT_EQ("s(\xF0\x9F\x98\x80)", Read("\"\\uD83D\\uDE00\""));
+  EXPECT_EQ("s(a\xF0\x90\x80\x80z)", Read("\"a\\ud800\\udc00z\""));
+
+  // A lead surrogate must be followed by a trail one, which may not appear
+  // on its own.
+  EXPECT_EQ("FAILED", Read("\"\\uD83D\""));
+  EXPECT_EQ("FAILED", Read("\"\\uD83Dx\""));
+  EXPECT_EQ("FAILED", Read("\"\\uD83D\\u0041\""));
+  EXPECT_EQ("FAILED", Read("\"\\uD83D\\uD83D\""));
+  EXPECT_EQ("FAILED", Read("\"\\uDE00\""));
+  EXPECT_EQ("FAILED", Read("\"\\uDE00\\uD83D\""));
+}
+
+TEST(BookmarkJSONReaderTest, Comments) {
+  EXPECT_EQ("[ l(1) l(2) ]", Read("// Start.\n[1, /* two */ 2] // End."));
+  EXPECT_EQ("{ k(a) l(1) }", Read("{/**/\"a\"/*\n*/:// x\r1}"));
+  EXPECT_EQ("s(/* not a comment */)", Read("\"/* not a comment */\""));
+
+  EXPECT_EQ("FAILED", Read("[1] /* unterminated"));
+  EXPECT_EQ("FAILED", Read("[1] /"));
+  EXPECT_EQ("FAILED", Read("[1 /x 2]"));
+}
+
+TEST(BookmarkJSONReaderTest, TrailingCommas) {
+  EXPECT_EQ("FAILED", Read("[1,]"));
+  EXPECT_EQ("FAILED", Read("[1, ]"));
+  EXPECT_EQ("FAILED", Read("{\"a\": 1,}"));
+  EXPECT_EQ("FAILED", Read("[,]"));
+  EXPECT_EQ("FAILED", Read("{,}"));
+  EXPECT_EQ("FAILED", Read("[1,,2]"));
+}
+
+TEST(BookmarkJSONReaderTest, ByteOrderMark) {
+  EXPECT_EQ("[ l(1) ]", Read("\xEF\xBB\xBF[1]"));
+  // Only at the very start.
+  EXPECT_EQ("FAILED", Read(" \xEF\xBB\xBF[1]"));
+  EXPECT_EQ("FAILED", Read("[\xEF\xBB\xBF" "1]"));
+  EXPECT_EQ("FAILED", Read("\xEF\xBB\xBF\xEF\xBB\xBF[1]"));
+}
+
+TEST(BookmarkJSONReaderTest, StackMaxDepth) {
+  const int depth = BookmarkJSONReader::kStackMaxDepth;
+  EXPECT_EQ(100, depth);
+
+  std::string deepest(depth, '[');
+  deepest.append(depth, ']');
+  std::string expected;
+  for (int i = 0; i < depth; ++i)
+    expected.append("[ ");
+  for (int i = 0; i < depth; ++i)
+    expected.append(i ? " ]" : "]");
+  EXPECT_EQ(expected, Read(deepest));
+
+  std::string too_deep(depth + 1, '[');
+  too_deep.append(depth + 1, ']');
+  EXPECT_EQ("FAILED", Read(too_deep));
+
+  // Objects count towards the depth too.
+  std::string too_deep_objects;
+  for (int i = 0; i < depth; ++i)
+    too_deep_objects.append("{\"a\":");
+  too_deep_objects.append("[]");
+  too_deep_objects.append(depth, '}');
+  EXPECT_EQ("FAILED", Read(too_deep_objects));
+}
+
+TEST(BookmarkJSONReaderTest, Malformed) {
+  EXPECT_EQ("FAILED", Read(""));
+  EXPECT_EQ("FAILED", Read("  "));
+  EXPECT_EQ("FAILED", Read("["));
+  EXPECT_EQ("FAILED", Read("]"));
+  EXPECT_EQ("FAILED", Read("[1"));
+  EXPECT_EQ("FAILED", Read("[1 2]"));
+  EXPECT_EQ("FAILED", Read("[1}"));
+  EXPECT_EQ("FAILED", Read("{\"a\"}"));
+  EXPECT_EQ("FAILED", Read("{\"a\" 1}"));
+  EXPECT_EQ("FAILED", Read("{1: 2}"));
+  EXPECT_EQ("FAILED", Read("{a: 1}"));
+  EXPECT_EQ("FAILED", Read("\"abc"));
+  EXPECT_EQ("FAILED", Read("[1] 2"));
+  EXPECT_EQ("FAILED", Read("01"));
+  EXPECT_EQ("FAILED", Read("1."));
+  EXPECT_EQ("FAILED", Read("1e"));
+  EXPECT_EQ("FAILED", Read("-"));
+  EXPECT_EQ("FAILED", Read(".5"));
+  EXPECT_EQ("FAILED", Read("tru"));
+  EXPECT_EQ("FAILED", Read("nul"));
+  EXPECT_EQ("FAILED", Read("'a'"));
+}
+
+TEST(BookmarkJSONReaderTest, DelegateStops) {
+  RecordingDelegate delegate(3);
+  EXPECT_FALSE(BookmarkJSONReader::Read("{\"a\": [1, 2]}", &delegate));
+  EXPECT_EQ("{ k(a) [", delegate.events());
+}
@@ -25,6 +25,7 @@
 #include "chrome/browser/favicon/favicon_changed_details.h"
 #include "chrome/browser/favicon/favicon_service.h"
 #include "chrome/browser/favicon/favicon_service_factory.h"
+#include "chrome/browser/history/history_notifications.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/profiles/profile.h"
@@ -72,6 +73,22 @@ const char16 kInvalidChars[] = {
   0
 };
 
+// Returns the rows among |rows| whose URL is bookmarked in |model|, with a
+// typed count of 0 if |deleted|.
+history::URLRows GetBookmarkedRows(BookmarkModel* model,
+                                   const history::URLRows& rows,
+                                   bool deleted) {
+  history::URLRows bookmarked_rows;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    if (!model->IsBookmarked(rows[i].url()))
+      continue;
+    bookmarked_rows.push_back(rows[i]);
+    if (deleted)
+      bookmarked_rows.back().set_typed_count(0);
+  }
+  return bookmarked_rows;
+}
+
 }  // namespace
 
 // BookmarkNode ---------------------------------------------------------------
@@ -228,7 +245,7 @@ BookmarkModel::BookmarkModel(Profile* profile)
       extensive_changes_(0) {
   if (!profile_) {
     // Profile is null during testing.
-    DoneLoading(CreateLoadDetails());
+    DoneLoading(CreateLoadDetails(NULL));
   }
 }
 
@@ -269,9 +286,20 @@ void BookmarkModel::Load(
   registrar_.Add(this, chrome::NOTIFICATION_FAVICON_CHANGED,
                  content::Source<Profile>(profile_));
 
+  // Listen for history changes to keep the typed counts the index sorts
+  // matches by up to date.
+  registrar_.Add(this, chrome::NOTIFICATION_HISTORY_LOADED,
+                 content::Source<Profile>(profile_));
+  registrar_.Add(this, chrome::NOTIFICATION_HISTORY_URL_VISITED,
+                 content::Source<Profile>(profile_));
+  registrar_.Add(this, chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+                 content::Source<Profile>(profile_));
+  registrar_.Add(this, chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+                 content::Source<Profile>(profile_));
+
   // Load the bookmarks. BookmarkStorage notifies us when done.
   store_ = new BookmarkStorage(profile_, this, task_runner.get());
-  store_->LoadBookmarks(CreateLoadDetails());
+  store_->LoadBookmarks(CreateLoadDetails(task_runner.get()));
 }
 
 const BookmarkNode* BookmarkModel::GetParentForNewNodes() {
@@ -376,8 +404,10 @@ void BookmarkModel::Move(const BookmarkNode* node,
   BookmarkNode* mutable_new_parent = AsMutable(new_parent);
   mutable_new_parent->Add(AsMutable(node), index);
 
-  if (store_.get())
-    store_->ScheduleSave();
+  if (store_.get()) {
+    store_->ScheduleSaveChildren(old_parent);
+    store_->ScheduleSaveChildren(new_parent);
+  }
 
   FOR_EACH_OBSERVER(BookmarkModelObserver, observers_,
                     BookmarkNodeMoved(this, old_parent, old_index,
@@ -405,9 +435,6 @@ void BookmarkModel::Copy(const BookmarkNode* node,
   // CloneBookmarkNode will use BookmarkModel methods to do the job, so we
   // don't need to send notifications here.
   bookmark_utils::CloneBookmarkNode(this, elements, new_parent, index);
-
-  if (store_.get())
-    store_->ScheduleSave();
 }
 
 const gfx::Image& BookmarkModel::GetFavicon(const BookmarkNode* node) {
@@ -443,7 +470,7 @@ void BookmarkModel::SetTitle(const BookmarkNode* node, const string16& title) {
   index_->Add(node);
 
   if (store_.get())
-    store_->ScheduleSave();
+    store_->ScheduleSaveNode(node);
 
   FOR_EACH_OBSERVER(BookmarkModelObserver, observers_,
                     BookmarkNodeChanged(this, node));
@@ -487,7 +514,7 @@ void BookmarkModel::SetURL(const BookmarkNode* node, const GURL& url) {
   }
 
   if (store_.get())
-    store_->ScheduleSave();
+    store_->ScheduleSaveNode(node);
 
   FOR_EACH_OBSERVER(BookmarkModelObserver, observers_,
                     BookmarkNodeChanged(this, node));
@@ -497,13 +524,13 @@ void BookmarkModel::SetNodeMetaInfo(const BookmarkNode* node,
                                     const std::string& key,
                                     const std::string& value) {
   if (AsMutable(node)->SetMetaInfo(key, value) && store_.get())
-    store_->ScheduleSave();
+    store_->ScheduleSaveNode(node);
 }
 
 void BookmarkModel::DeleteNodeMetaInfo(const BookmarkNode* node,
                                        const std::string& key) {
   if (AsMutable(node)->DeleteMetaInfo(key) && store_.get())
-    store_->ScheduleSave();
+    store_->ScheduleSaveNode(node);
 }
 
 void BookmarkModel::SetDateAdded(const BookmarkNode* node,
@@ -524,12 +551,11 @@ void BookmarkModel::SetDateAdded(const BookmarkNode* node,
   AsMutable(node)->set_date_added(date_added);
 
   // Syncing might result in dates newer than the folder's last modified date.
-  if (date_added > node->parent()->date_folder_modified()) {
-    // Will trigger store_->ScheduleSave().
+  if (date_added > node->parent()->date_folder_modified())
     SetDateFolderModified(node->parent(), date_added);
-  } else if (store_.get()) {
-    store_->ScheduleSave();
-  }
+
+  if (store_.get())
+    store_->ScheduleSaveNode(node);
 }
 
 void BookmarkModel::GetNodesByURL(const GURL& url,
@@ -667,7 +693,7 @@ void BookmarkModel::SortChildren(const BookmarkNode* parent) {
             SortComparator(collator.get()));
 
   if (store_.get())
-    store_->ScheduleSave();
+    store_->ScheduleSaveChildren(parent);
 
   FOR_EACH_OBSERVER(BookmarkModelObserver, observers_,
                     BookmarkNodeChildrenReordered(this, parent));
@@ -688,7 +714,7 @@ void BookmarkModel::ReorderChildren(
       *(reinterpret_cast<const std::vector<BookmarkNode*>*>(&ordered_nodes)));
 
   if (store_.get())
-    store_->ScheduleSave();
+    store_->ScheduleSaveChildren(parent);
 
   FOR_EACH_OBSERVER(BookmarkModelObserver, observers_,
                     BookmarkNodeChildrenReordered(this, parent));
@@ -700,7 +726,7 @@ void BookmarkModel::SetDateFolderModified(const BookmarkNode* parent,
   AsMutable(parent)->set_date_folder_modified(time);
 
   if (store_.get())
-    store_->ScheduleSave();
+    store_->ScheduleSaveNode(parent);
 }
 
 void BookmarkModel::ResetDateFolderModified(const BookmarkNode* node) {
@@ -717,6 +743,13 @@ void BookmarkModel::GetBookmarksWithTitlesMatching(
   index_->GetBookmarksWithTitlesMatching(text, max_count, matches);
 }
 
+scoped_refptr<BookmarkIndexSnapshot> BookmarkModel::GetIndexSnapshot() {
+  if (!loaded_)
+    return NULL;
+
+  return index_->GetSnapshot();
+}
+
 void BookmarkModel::ClearStore() {
   registrar_.RemoveAll();
   store_ = NULL;
@@ -818,6 +851,8 @@ void BookmarkModel::DoneLoading(BookmarkLoadDetails* details_delete_me) {
 
   loaded_signal_.Signal();
 
+  index_->LoadTypedCounts();
+
   // Notify our direct observers.
   FOR_EACH_OBSERVER(BookmarkModelObserver, observers_,
                     Loaded(this, details->ids_reassigned()));
@@ -840,7 +875,7 @@ void BookmarkModel::RemoveAndDeleteNode(BookmarkNode* delete_me) {
   }
 
   if (store_.get())
-    store_->ScheduleSave();
+    store_->ScheduleSaveChildren(parent);
 
   NotifyHistoryAboutRemovedBookmarks(removed_urls);
 
@@ -895,8 +930,10 @@ BookmarkNode* BookmarkModel::AddNode(BookmarkNode* parent,
                                      BookmarkNode* node) {
   parent->Add(node, index);
 
-  if (store_.get())
-    store_->ScheduleSave();
+  if (store_.get()) {
+    store_->ScheduleSaveNode(node);
+    store_->ScheduleSaveChildren(parent);
+  }
 
   FOR_EACH_OBSERVER(BookmarkModelObserver, observers_,
                     BookmarkNodeAdded(this, parent, index));
@@ -1026,6 +1063,52 @@ void BookmarkModel::Observe(int type,
       break;
     }
 
+    case chrome::NOTIFICATION_HISTORY_LOADED:
+      if (loaded_)
+        index_->LoadTypedCounts();
+      break;
+
+    case chrome::NOTIFICATION_HISTORY_URL_VISITED: {
+      if (!loaded_)
+        break;
+      content::Details<history::URLVisitedDetails> visited_details(details);
+      index_->UpdateTypedCounts(GetBookmarkedRows(
+          this, history::URLRows(1, visited_details->row), false));
+      break;
+    }
+
+    case chrome::NOTIFICATION_HISTORY_URLS_MODIFIED: {
+      if (!loaded_)
+        break;
+      content::Details<history::URLsModifiedDetails> modified_details(details);
+      index_->UpdateTypedCounts(
+          GetBookmarkedRows(this, modified_details->changed_urls, false));
+      break;
+    }
+
+    case chrome::NOTIFICATION_HISTORY_URLS_DELETED: {
+      if (!loaded_)
+        break;
+      content::Details<history::URLsDeletedDetails> deleted_details(details);
+      if (!deleted_details->all_history) {
+        index_->UpdateTypedCounts(
+            GetBookmarkedRows(this, deleted_details->rows, true));
+        break;
+      }
+      history::URLRows rows;
+      {
+        base::AutoLock url_lock(url_lock_);
+        for (NodesOrderedByURLSet::const_iterator i =
+                 nodes_ordered_by_url_set_.begin();
+             i != nodes_ordered_by_url_set_.end(); ++i) {
+          if (rows.empty() || rows.back().url() != (*i)->url())
+            rows.push_back(history::URLRow((*i)->url()));
+        }
+      }
+      index_->UpdateTypedCounts(rows);
+      break;
+    }
+
     default:
       NOTREACHED();
       break;
@@ -1045,7 +1128,8 @@ int64 BookmarkModel::generate_next_node_id() {
   return next_node_id_++;
 }
 
-BookmarkLoadDetails* BookmarkModel::CreateLoadDetails() {
+BookmarkLoadDetails* BookmarkModel::CreateLoadDetails(
+    base::SequencedTaskRunner* task_runner) {
   BookmarkPermanentNode* bb_node =
       CreatePermanentNode(BookmarkNode::BOOKMARK_BAR);
   BookmarkPermanentNode* other_node =
@@ -1053,6 +1137,6 @@ BookmarkLoadDetails* BookmarkModel::CreateLoadDetails() {
   BookmarkPermanentNode* mobile_node =
       CreatePermanentNode(BookmarkNode::MOBILE);
   return new BookmarkLoadDetails(bb_node, other_node, mobile_node,
-                                 new BookmarkIndex(profile_),
+                                 new BookmarkIndex(profile_, task_runner),
                                  next_node_id_);
 }
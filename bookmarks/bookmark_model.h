@@ -27,6 +27,7 @@
 
 class BookmarkExpandedStateTracker;
 class BookmarkIndex;
+class BookmarkIndexSnapshot;
 class BookmarkLoadDetails;
 class BookmarkModel;
 class BookmarkModelObserver;
@@ -389,6 +390,11 @@ class BookmarkModel : public content::NotificationObserver,
       size_t max_count,
       std::vector<BookmarkTitleMatch>* matches);
 
+  // Returns an immutable snapshot of the index of bookmark titles, which,
+  // unlike the model, may be queried on any thread.  It may lack the latest
+  // changes to the model.  Returns NULL if the model is not loaded.
+  scoped_refptr<BookmarkIndexSnapshot> GetIndexSnapshot();
+
   // Sets the store to NULL, making it so the BookmarkModel does not persist
   // any changes to disk. This is only useful during testing to speed up
   // testing.
@@ -502,9 +508,11 @@ class BookmarkModel : public content::NotificationObserver,
   // decoding since during decoding codec assigns node IDs.
   void set_next_node_id(int64 id) { next_node_id_ = id; }
 
-  // Creates and returns a new BookmarkLoadDetails. It's up to the caller to
-  // delete the returned object.
-  BookmarkLoadDetails* CreateLoadDetails();
+  // Creates and returns a new BookmarkLoadDetails, whose index merges its
+  // snapshots on |task_runner|. It's up to the caller to delete the returned
+  // object.
+  BookmarkLoadDetails* CreateLoadDetails(
+      base::SequencedTaskRunner* task_runner);
 
   content::NotificationRegistrar registrar_;
 
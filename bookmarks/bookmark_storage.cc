@@ -8,9 +8,10 @@
 #include "base/compiler_specific.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
-#include "base/json/json_file_value_serializer.h"
+#include "base/files/important_file_writer.h"
 #include "base/json/json_string_value_serializer.h"
 #include "base/metrics/histogram.h"
+#include "base/task_runner_util.h"
 #include "base/time/time.h"
 #include "chrome/browser/bookmarks/bookmark_codec.h"
 #include "chrome/browser/bookmarks/bookmark_index.h"
@@ -28,9 +29,36 @@ namespace {
 // Extension used for backup files (copy of main file created during startup).
 const base::FilePath::CharType kBackupExtension[] = FILE_PATH_LITERAL("bak");
 
+// Extension used for the journal of changes since the file was written.
+const base::FilePath::CharType kJournalExtension[] =
+    FILE_PATH_LITERAL("journal");
+
 // How often we save.
 const int kSaveDelayMS = 2500;
 
+// Files smaller than this are always written whole, as that is about as
+// cheap as appending to the journal.
+const int64 kMinJournaledFileSize = 64 * 1024;
+
+// The journal may grow to this fraction of the size of the file before the
+// file is written again.
+const int64 kMaxJournalFileSizeRatio = 4;
+
+// Encodes |model| as the text of the bookmarks file.
+bool EncodeModel(BookmarkModel* model,
+                 std::string* output,
+                 std::string* checksum) {
+  BookmarkCodec codec;
+  scoped_ptr<Value> value(codec.Encode(model));
+  JSONStringValueSerializer serializer(output);
+  serializer.set_pretty_print(true);
+  if (!serializer.Serialize(*(value.get())))
+    return false;
+  if (checksum)
+    *checksum = codec.stored_checksum();
+  return true;
+}
+
 void BackupCallback(const base::FilePath& path) {
   base::FilePath backup_path = path.ReplaceExtension(kBackupExtension);
   base::CopyFile(path, backup_path);
@@ -48,40 +76,88 @@ void AddBookmarksToIndex(BookmarkLoadDetails* details,
   }
 }
 
+// A partially written entry stops the replay of the journal, which then
+// has the whole file written again, so a failure here loses changes but
+// never corrupts the bookmarks.
+void AppendJournalCallback(const base::FilePath& path,
+                           const std::string& data,
+                           bool truncate) {
+  int size = static_cast<int>(data.size());
+  if (truncate || !base::PathExists(path))
+    file_util::WriteFile(path, data.data(), size);
+  else
+    file_util::AppendToFile(path, data.data(), size);
+}
+
+// Writes the whole file and, only if that worked, deletes the journal of
+// changes to the previous one.
+bool WriteFileCallback(const base::FilePath& path,
+                       const base::FilePath& journal_path,
+                       const std::string& data) {
+  if (!base::ImportantFileWriter::WriteFileAtomically(path, data))
+    return false;
+  base::DeleteFile(journal_path, false);
+  return true;
+}
+
 void LoadCallback(const base::FilePath& path,
                   BookmarkStorage* storage,
                   BookmarkLoadDetails* details) {
   startup_metric_utils::ScopedSlowStartupUMA
       scoped_timer("Startup.SlowStartupBookmarksLoad");
-  bool bookmark_file_exists = base::PathExists(path);
-  if (bookmark_file_exists) {
-    JSONFileValueSerializer serializer(path);
-    scoped_ptr<Value> root(serializer.Deserialize(NULL, NULL));
-
-    if (root.get()) {
-      // Building the index can take a while, so we do it on the background
-      // thread.
-      int64 max_node_id = 0;
-      BookmarkCodec codec;
-      TimeTicks start_time = TimeTicks::Now();
-      codec.Decode(details->bb_node(), details->other_folder_node(),
-                   details->mobile_folder_node(), &max_node_id, *root.get());
-      details->set_max_id(std::max(max_node_id, details->max_id()));
-      details->set_computed_checksum(codec.computed_checksum());
-      details->set_stored_checksum(codec.stored_checksum());
-      details->set_ids_reassigned(codec.ids_reassigned());
-      details->set_model_meta_info(codec.model_meta_info());
-      UMA_HISTOGRAM_TIMES("Bookmarks.DecodeTime",
-                          TimeTicks::Now() - start_time);
-
-      start_time = TimeTicks::Now();
-      AddBookmarksToIndex(details, details->bb_node());
-      AddBookmarksToIndex(details, details->other_folder_node());
-      AddBookmarksToIndex(details, details->mobile_folder_node());
-      UMA_HISTOGRAM_TIMES("Bookmarks.CreateBookmarkIndexTime",
-                          TimeTicks::Now() - start_time);
+  TimeTicks load_start_time = TimeTicks::Now();
+  std::string contents;
+  if (file_util::ReadFileToString(path, &contents)) {
+    // Decode the text straight into nodes, rather than first parsing it to
+    // a Value tree holding another copy of the bookmarks.
+    int64 max_node_id = 0;
+    BookmarkCodec codec;
+    TimeTicks start_time = TimeTicks::Now();
+    bool decoded = codec.DecodeJSON(details->bb_node(),
+                                    details->other_folder_node(),
+                                    details->mobile_folder_node(),
+                                    &max_node_id, contents);
+    details->set_computed_checksum(codec.computed_checksum());
+    details->set_stored_checksum(codec.stored_checksum());
+    details->set_ids_reassigned(codec.ids_reassigned());
+    std::string model_meta_info = codec.model_meta_info();
+    UMA_HISTOGRAM_TIMES("Bookmarks.DecodeTime",
+                        TimeTicks::Now() - start_time);
+
+    if (decoded) {
+      details->set_file_size(contents.size());
+
+      // Reassigned ids don't match those in the journal, and as the file is
+      // to be written again anyway it is left out.
+      std::string journal;
+      if (!codec.ids_reassigned() &&
+          file_util::ReadFileToString(path.ReplaceExtension(kJournalExtension),
+                                      &journal)) {
+        details->set_journal_valid(BookmarkJournal::Replay(
+            journal, codec.stored_checksum(), details->bb_node(),
+            details->other_folder_node(), details->mobile_folder_node(),
+            &model_meta_info, &max_node_id));
+        if (details->journal_valid())
+          details->set_journal_size(journal.size());
+      }
     }
+    details->set_max_id(std::max(max_node_id, details->max_id()));
+    details->set_model_meta_info(model_meta_info);
+
+    // Building the index can take a while, so we do it on the background
+    // thread.
+    start_time = TimeTicks::Now();
+    AddBookmarksToIndex(details, details->bb_node());
+    AddBookmarksToIndex(details, details->other_folder_node());
+    AddBookmarksToIndex(details, details->mobile_folder_node());
+    UMA_HISTOGRAM_TIMES("Bookmarks.CreateBookmarkIndexTime",
+                        TimeTicks::Now() - start_time);
+    UMA_HISTOGRAM_TIMES("Bookmarks.LoadTime",
+                        TimeTicks::Now() - load_start_time);
   }
+  // The first snapshot of the index is taken here too, so that the UI thread
+  // only ever merges changes into it.
+  details->index()->BuildSnapshot();
 
   BrowserThread::PostTask(
       BrowserThread::UI, FROM_HERE,
@@ -103,7 +179,10 @@ BookmarkLoadDetails::BookmarkLoadDetails(
       mobile_folder_node_(mobile_folder_node),
       index_(index),
       max_id_(max_id),
-      ids_reassigned_(false) {
+      ids_reassigned_(false),
+      file_size_(0),
+      journal_size_(0),
+      journal_valid_(true) {
 }
 
 BookmarkLoadDetails::~BookmarkLoadDetails() {
@@ -116,17 +195,18 @@ BookmarkStorage::BookmarkStorage(
     BookmarkModel* model,
     base::SequencedTaskRunner* sequenced_task_runner)
     : model_(model),
-      writer_(context->GetPath().Append(chrome::kBookmarksFileName),
-              sequenced_task_runner) {
+      path_(context->GetPath().Append(chrome::kBookmarksFileName)),
+      journal_path_(path_.ReplaceExtension(kJournalExtension)),
+      file_save_pending_(false),
+      file_writes_pending_(0),
+      file_size_(0),
+      journal_size_(0) {
   sequenced_task_runner_ = sequenced_task_runner;
-  writer_.set_commit_interval(base::TimeDelta::FromMilliseconds(kSaveDelayMS));
   sequenced_task_runner_->PostTask(FROM_HERE,
-                                   base::Bind(&BackupCallback, writer_.path()));
+                                   base::Bind(&BackupCallback, path_));
 }
 
 BookmarkStorage::~BookmarkStorage() {
-  if (writer_.HasPendingWrite())
-    writer_.DoScheduledWrite();
 }
 
 void BookmarkStorage::LoadBookmarks(BookmarkLoadDetails* details) {
@@ -135,48 +215,119 @@ void BookmarkStorage::LoadBookmarks(BookmarkLoadDetails* details) {
   details_.reset(details);
   sequenced_task_runner_->PostTask(
       FROM_HERE,
-      base::Bind(&LoadCallback, writer_.path(), make_scoped_refptr(this),
+      base::Bind(&LoadCallback, path_, make_scoped_refptr(this),
                  details_.get()));
 }
 
 void BookmarkStorage::ScheduleSave() {
-  writer_.ScheduleWrite(this);
+  file_save_pending_ = true;
+  StartSaveTimer();
+}
+
+void BookmarkStorage::ScheduleSaveNode(const BookmarkNode* node) {
+  journal_.NodeChanged(node);
+  StartSaveTimer();
+}
+
+void BookmarkStorage::ScheduleSaveChildren(const BookmarkNode* folder) {
+  journal_.ChildrenChanged(folder);
+  StartSaveTimer();
 }
 
 void BookmarkStorage::BookmarkModelDeleted() {
   // We need to save now as otherwise by the time SaveNow is invoked
   // the model is gone.
-  if (writer_.HasPendingWrite())
+  if (save_timer_.IsRunning()) {
+    save_timer_.Stop();
     SaveNow();
+  }
   model_ = NULL;
 }
 
-bool BookmarkStorage::SerializeData(std::string* output) {
-  BookmarkCodec codec;
-  scoped_ptr<Value> value(codec.Encode(model_));
-  JSONStringValueSerializer serializer(output);
-  serializer.set_pretty_print(true);
-  return serializer.Serialize(*(value.get()));
-}
-
 void BookmarkStorage::OnLoadFinished() {
   if (!model_)
     return;
 
+  checksum_ = details_->stored_checksum();
+  file_size_ = details_->file_size();
+  journal_size_ = details_->journal_size();
+  if (!details_->journal_valid())
+    ScheduleSave();
+
   model_->DoneLoading(details_.release());
 }
 
-bool BookmarkStorage::SaveNow() {
+void BookmarkStorage::StartSaveTimer() {
+  if (save_timer_.IsRunning())
+    return;
+  save_timer_.Start(FROM_HERE,
+                    base::TimeDelta::FromMilliseconds(kSaveDelayMS),
+                    this, &BookmarkStorage::SaveNow);
+}
+
+void BookmarkStorage::SaveNow() {
   if (!model_ || !model_->loaded()) {
     // We should only get here if we have a valid model and it's finished
     // loading.
     NOTREACHED();
-    return false;
+    return;
   }
 
+  // While the file is being written the journal may still belong to the
+  // previous one, so changes are only ever saved by writing it again.
+  if (!file_save_pending_ && file_writes_pending_ == 0 &&
+      file_size_ >= kMinJournaledFileSize) {
+    if (journal_.empty())
+      return;
+    std::string entry = journal_.TakeEntry(model_);
+    // A new journal starts with the checksum of the file it belongs to.
+    const bool new_journal = journal_size_ == 0;
+    if (new_journal)
+      entry.insert(0, BookmarkJournal::CreateHeader(checksum_));
+    if (journal_size_ + static_cast<int64>(entry.size()) <=
+        file_size_ / kMaxJournalFileSizeRatio) {
+      journal_size_ += entry.size();
+      UMA_HISTOGRAM_COUNTS("Bookmarks.JournalSaveSize",
+                           static_cast<int>(entry.size()));
+      sequenced_task_runner_->PostTask(
+          FROM_HERE,
+          base::Bind(&AppendJournalCallback, journal_path_, entry,
+                     new_journal));
+      return;
+    }
+  }
+  SaveFile();
+}
+
+void BookmarkStorage::SaveFile() {
   std::string data;
-  if (!SerializeData(&data))
-    return false;
-  writer_.WriteNow(data);
-  return true;
+  std::string checksum;
+  if (!EncodeModel(model_, &data, &checksum))
+    return;
+  file_save_pending_ = false;
+  journal_.Clear();
+  ++file_writes_pending_;
+  UMA_HISTOGRAM_COUNTS("Bookmarks.FileSaveSizeKB",
+                       static_cast<int>(data.size() / 1024));
+  base::PostTaskAndReplyWithResult(
+      sequenced_task_runner_.get(), FROM_HERE,
+      base::Bind(&WriteFileCallback, path_, journal_path_, data),
+      base::Bind(&BookmarkStorage::OnFileWritten, this, checksum,
+                 static_cast<int64>(data.size())));
+}
+
+void BookmarkStorage::OnFileWritten(const std::string& checksum,
+                                    int64 file_size,
+                                    bool success) {
+  DCHECK_GT(file_writes_pending_, 0);
+  --file_writes_pending_;
+  if (!success) {
+    // The previous file and its journal are still there, and the changes
+    // taken from |journal_| are only in the model now.
+    file_save_pending_ = true;
+    return;
+  }
+  checksum_ = checksum;
+  file_size_ = file_size;
+  journal_size_ = 0;
 }
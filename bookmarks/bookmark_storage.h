@@ -5,12 +5,15 @@
 #ifndef CHROME_BROWSER_BOOKMARKS_BOOKMARK_STORAGE_H_
 #define CHROME_BROWSER_BOOKMARKS_BOOKMARK_STORAGE_H_
 
-#include "base/files/important_file_writer.h"
+#include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/timer/timer.h"
+#include "chrome/browser/bookmarks/bookmark_journal.h"
 
 class BookmarkIndex;
 class BookmarkModel;
+class BookmarkNode;
 class BookmarkPermanentNode;
 
 namespace base {
@@ -83,6 +86,21 @@ class BookmarkLoadDetails {
   void set_ids_reassigned(bool value) { ids_reassigned_ = value; }
   bool ids_reassigned() const { return ids_reassigned_; }
 
+  // Size of the bookmarks file, or 0 if there was none or it couldn't be
+  // decoded.
+  void set_file_size(int64 value) { file_size_ = value; }
+  int64 file_size() const { return file_size_; }
+
+  // Size of the journal of changes made since the file was written, or 0 if
+  // it wasn't replayed.
+  void set_journal_size(int64 value) { journal_size_ = value; }
+  int64 journal_size() const { return journal_size_; }
+
+  // Whether the whole journal was replayed.  If it wasn't the file needs to
+  // be written again, as the next changes can't be appended to it.
+  void set_journal_valid(bool value) { journal_valid_ = value; }
+  bool journal_valid() const { return journal_valid_; }
+
  private:
   scoped_ptr<BookmarkPermanentNode> bb_node_;
   scoped_ptr<BookmarkPermanentNode> other_folder_node_;
@@ -93,6 +111,9 @@ class BookmarkLoadDetails {
   std::string computed_checksum_;
   std::string stored_checksum_;
   bool ids_reassigned_;
+  int64 file_size_;
+  int64 journal_size_;
+  bool journal_valid_;
 
   DISALLOW_COPY_AND_ASSIGN(BookmarkLoadDetails);
 };
@@ -102,8 +123,10 @@ class BookmarkLoadDetails {
 // as notifying the BookmarkStorage every time the model changes.
 //
 // Internally BookmarkStorage uses BookmarkCodec to do the actual read/write.
-class BookmarkStorage : public base::ImportantFileWriter::DataSerializer,
-                        public base::RefCountedThreadSafe<BookmarkStorage> {
+// Changes to a few nodes are appended to a journal next to the file rather
+// than rewriting all of it, until the journal grows too big compared to the
+// file.  Loading replays the journal onto the file.
+class BookmarkStorage : public base::RefCountedThreadSafe<BookmarkStorage> {
  public:
   // Creates a BookmarkStorage for the specified model
   BookmarkStorage(content::BrowserContext* context,
@@ -114,9 +137,16 @@ class BookmarkStorage : public base::ImportantFileWriter::DataSerializer,
   // takes ownership of |details|. See BookmarkLoadDetails for details.
   void LoadBookmarks(BookmarkLoadDetails* details);
 
-  // Schedules saving the bookmark bar model to disk.
+  // Schedules writing the whole bookmark bar model to disk.
   void ScheduleSave();
 
+  // Schedules saving the title, URL, dates and meta info of |node|, which
+  // is the meta info of the model for the root node.
+  void ScheduleSaveNode(const BookmarkNode* node);
+
+  // Schedules saving which nodes are the children of |folder|, in order.
+  void ScheduleSaveChildren(const BookmarkNode* folder);
+
   // Notification the bookmark bar model is going to be deleted. If there is
   // a pending save, it is saved immediately.
   void BookmarkModelDeleted();
@@ -124,23 +154,58 @@ class BookmarkStorage : public base::ImportantFileWriter::DataSerializer,
   // Callback from backend after loading the bookmark file.
   void OnLoadFinished();
 
-  // ImportantFileWriter::DataSerializer implementation.
-  virtual bool SerializeData(std::string* output) OVERRIDE;
-
  private:
   friend class base::RefCountedThreadSafe<BookmarkStorage>;
 
   virtual ~BookmarkStorage();
 
-  // Serializes the data and schedules save using ImportantFileWriter.
-  // Returns true on successful serialization.
-  bool SaveNow();
+  // Starts |save_timer_| if it isn't running.
+  void StartSaveTimer();
+
+  // Appends the changes to the journal, or writes the whole file if a full
+  // save was scheduled, the journal would grow too big or a write of the
+  // whole file has not finished yet.
+  void SaveNow();
+
+  // Serializes the data and writes it using ImportantFileWriter, then
+  // deletes the journal if the write succeeded.
+  void SaveFile();
+
+  // Called once the file with |checksum| and |file_size| has been written,
+  // or |success| is false.
+  void OnFileWritten(const std::string& checksum,
+                     int64 file_size,
+                     bool success);
 
   // The model. The model is NULL once BookmarkModelDeleted has been invoked.
   BookmarkModel* model_;
 
-  // Helper to write bookmark data safely.
-  base::ImportantFileWriter writer_;
+  // Path of the bookmarks file.
+  const base::FilePath path_;
+
+  // Path of the journal.
+  base::FilePath journal_path_;
+
+  // Runs SaveNow() a little after the first change, so that a burst of
+  // changes is saved at once.
+  base::OneShotTimer<BookmarkStorage> save_timer_;
+
+  // Whether the whole file is to be written by the next save.
+  bool file_save_pending_;
+
+  // Number of writes of the whole file not yet finished.
+  int file_writes_pending_;
+
+  // The changes not yet appended to the journal.
+  BookmarkJournal journal_;
+
+  // Checksum of the last file successfully written, which the journal starts
+  // with.
+  std::string checksum_;
+
+  // Sizes of the last file written and of the journal appended to it.
+  int64 file_size_;
+  int64 journal_size_;
 
   // See class description of BookmarkLoadDetails for details on this.
   scoped_ptr<BookmarkLoadDetails> details_;
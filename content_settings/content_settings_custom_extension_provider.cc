@@ -31,6 +31,16 @@ RuleIterator* CustomExtensionProvider::GetRuleIterator(
                                                incognito);
 }
 
+RuleIterator* CustomExtensionProvider::GetRuleIteratorForURL(
+    const GURL& primary_url,
+    ContentSettingsType content_type,
+    const ResourceIdentifier& resource_identifier,
+    bool incognito) const {
+  // The extension settings are spread over several maps, so they are not
+  // indexed.
+  return GetRuleIterator(content_type, resource_identifier, incognito);
+}
+
 bool CustomExtensionProvider::SetWebsiteSetting(
     const ContentSettingsPattern& primary_pattern,
     const ContentSettingsPattern& secondary_pattern,
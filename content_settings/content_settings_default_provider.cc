@@ -249,6 +249,15 @@ RuleIterator* DefaultProvider::GetRuleIterator(
   return new EmptyRuleIterator();
 }
 
+RuleIterator* DefaultProvider::GetRuleIteratorForURL(
+    const GURL& primary_url,
+    ContentSettingsType content_type,
+    const ResourceIdentifier& resource_identifier,
+    bool incognito) const {
+  // There is only the default setting, which matches every URL.
+  return GetRuleIterator(content_type, resource_identifier, incognito);
+}
+
 void DefaultProvider::ClearAllContentSettingsRules(
     ContentSettingsType content_type) {
   // TODO(markusheintz): This method is only called when the
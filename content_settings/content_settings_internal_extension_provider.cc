@@ -52,6 +52,15 @@ RuleIterator* InternalExtensionProvider::GetRuleIterator(
   return value_map_.GetRuleIterator(content_type, resource_identifier, &lock_);
 }
 
+RuleIterator* InternalExtensionProvider::GetRuleIteratorForURL(
+    const GURL& primary_url,
+    ContentSettingsType content_type,
+    const ResourceIdentifier& resource_identifier,
+    bool incognito) const {
+  return value_map_.GetRuleIteratorForURL(primary_url, content_type,
+                                          resource_identifier, &lock_);
+}
+
 bool InternalExtensionProvider::SetWebsiteSetting(
     const ContentSettingsPattern& primary_pattern,
     const ContentSettingsPattern& secondary_pattern,
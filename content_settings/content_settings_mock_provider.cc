@@ -22,6 +22,15 @@ RuleIterator* MockProvider::GetRuleIterator(
   return value_map_.GetRuleIterator(content_type, resource_identifier, NULL);
 }
 
+RuleIterator* MockProvider::GetRuleIteratorForURL(
+    const GURL& primary_url,
+    ContentSettingsType content_type,
+    const ResourceIdentifier& resource_identifier,
+    bool incognito) const {
+  return value_map_.GetRuleIteratorForURL(primary_url, content_type,
+                                          resource_identifier, NULL);
+}
+
 bool MockProvider::SetWebsiteSetting(
     const ContentSettingsPattern& requesting_url_pattern,
     const ContentSettingsPattern& embedding_url_pattern,
@@ -4,20 +4,102 @@
 
 #include "chrome/browser/content_settings/content_settings_origin_identifier_value_map.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "base/compiler_specific.h"
+#include "base/containers/hash_tables.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/strings/string_util.h"
 #include "base/synchronization/lock.h"
 #include "base/values.h"
 #include "chrome/browser/content_settings/content_settings_rule.h"
 #include "chrome/browser/content_settings/content_settings_utils.h"
 #include "chrome/common/content_settings_types.h"
+#include "chrome/common/url_constants.h"
 #include "url/gurl.h"
 
 namespace content_settings {
 
+// An immutable copy of the rules for one content type and resource
+// identifier, indexed by the hosts their primary patterns match.
+class RuleIndex : public base::RefCountedThreadSafe<RuleIndex> {
+ public:
+  explicit RuleIndex(const OriginIdentifierValueMap::Rules& rules);
+
+  // Sets |candidates| to the positions in rules() of the rules whose primary
+  // pattern may match |url|, in the precedence order of the rules.
+  void GetCandidates(const GURL& url, std::vector<size_t>* candidates) const;
+
+  const std::vector<Rule>& rules() const { return rules_; }
+
+ private:
+  friend class base::RefCountedThreadSafe<RuleIndex>;
+
+  typedef base::hash_map<std::string, std::vector<size_t> > HostRules;
+
+  ~RuleIndex() {}
+
+  static void AppendRules(const HostRules& host_rules,
+                          const std::string& host,
+                          std::vector<size_t>* candidates);
+
+  // The rules, in precedence order.
+  std::vector<Rule> rules_;
+
+  // The rules for any host, and those whose host the index can't tell.
+  std::vector<size_t> any_host_rules_;
+
+  // The rules by the host their primary pattern matches, not matching its
+  // subdomains, and by the domain it matches with all of its subdomains.
+  HostRules host_rules_;
+  HostRules domain_rules_;
+
+  DISALLOW_COPY_AND_ASSIGN(RuleIndex);
+};
+
 namespace {
 
+const char kDomainWildcard[] = "[*.]";
+
+// Sets |host| to the host |pattern| matches, and |domain_wildcard| to
+// whether it matches the subdomains of |host| too. Returns false if the
+// pattern matches any host, or if its host can't be told from the pattern.
+bool GetPatternHost(const ContentSettingsPattern& pattern,
+                    std::string* host,
+                    bool* domain_wildcard) {
+  if (pattern.MatchesAllHosts())
+    return false;
+  const std::string spec = pattern.ToString();
+  size_t start = spec.find("://");
+  if (start == std::string::npos) {
+    start = 0;
+  } else if (spec.compare(0, start, chrome::kFileScheme) == 0) {
+    // File patterns match by path, whatever the host of the URL.
+    return false;
+  } else {
+    start += 3;
+  }
+  *domain_wildcard =
+      spec.compare(start, arraysize(kDomainWildcard) - 1, kDomainWildcard) ==
+      0;
+  if (*domain_wildcard)
+    start += arraysize(kDomainWildcard) - 1;
+  size_t end;
+  if (start < spec.size() && spec[start] == '[') {
+    // An IPv6 address.
+    end = spec.find(']', start);
+    if (end == std::string::npos)
+      return false;
+    ++end;
+  } else {
+    end = spec.find_first_of(":/", start);
+  }
+  *host = StringToLowerASCII(spec.substr(start, end - start));
+  return !host->empty() && host->find('*') == std::string::npos;
+}
+
 // This iterator is used for iterating the rules for |content_type| and
 // |resource_identifier| in the precedence order of the rules.
 class RuleIteratorImpl : public RuleIterator {
@@ -53,8 +135,80 @@ class RuleIteratorImpl : public RuleIterator {
   scoped_ptr<base::AutoLock> auto_lock_;
 };
 
+// This iterator reads the rules of a |RuleIndex| which may match a URL.
+class IndexedRuleIterator : public RuleIterator {
+ public:
+  IndexedRuleIterator(RuleIndex* index, const GURL& url)
+      : index_(index),
+        position_(0) {
+    index_->GetCandidates(url, &candidates_);
+  }
+  virtual ~IndexedRuleIterator() {}
+
+  virtual bool HasNext() const OVERRIDE {
+    return position_ < candidates_.size();
+  }
+
+  virtual Rule Next() OVERRIDE {
+    DCHECK(HasNext());
+    const Rule& rule = index_->rules()[candidates_[position_++]];
+    return Rule(rule.primary_pattern, rule.secondary_pattern,
+                rule.value->DeepCopy());
+  }
+
+ private:
+  scoped_refptr<RuleIndex> index_;
+  std::vector<size_t> candidates_;
+  size_t position_;
+};
+
 }  // namespace
 
+RuleIndex::RuleIndex(const OriginIdentifierValueMap::Rules& rules) {
+  rules_.reserve(rules.size());
+  for (OriginIdentifierValueMap::Rules::const_iterator it = rules.begin();
+       it != rules.end(); ++it) {
+    const size_t position = rules_.size();
+    rules_.push_back(Rule(it->first.primary_pattern,
+                          it->first.secondary_pattern,
+                          it->second->DeepCopy()));
+    std::string host;
+    bool domain_wildcard = false;
+    if (!GetPatternHost(it->first.primary_pattern, &host, &domain_wildcard))
+      any_host_rules_.push_back(position);
+    else if (domain_wildcard)
+      domain_rules_[host].push_back(position);
+    else
+      host_rules_[host].push_back(position);
+  }
+}
+
+void RuleIndex::GetCandidates(const GURL& url,
+                              std::vector<size_t>* candidates) const {
+  candidates->assign(any_host_rules_.begin(), any_host_rules_.end());
+  const std::string& host = url.host();
+  AppendRules(host_rules_, host, candidates);
+  // A domain wildcard matches the domain and its subdomains, so look up
+  // each suffix of the host which starts a label.
+  for (size_t start = 0; start != std::string::npos;) {
+    AppendRules(domain_rules_, host.substr(start), candidates);
+    start = host.find('.', start);
+    if (start != std::string::npos)
+      ++start;
+  }
+  std::sort(candidates->begin(), candidates->end());
+}
+
+// static
+void RuleIndex::AppendRules(const HostRules& host_rules,
+                            const std::string& host,
+                            std::vector<size_t>* candidates) {
+  HostRules::const_iterator it = host_rules.find(host);
+  if (it != host_rules.end())
+    candidates->insert(candidates->end(), it->second.begin(),
+                       it->second.end());
+}
+
 OriginIdentifierValueMap::EntryMapKey::EntryMapKey(
     ContentSettingsType content_type,
     const ResourceIdentifier& resource_identifier)
@@ -108,6 +262,28 @@ RuleIterator* OriginIdentifierValueMap::GetRuleIterator(
                               auto_lock.release());
 }
 
+RuleIterator* OriginIdentifierValueMap::GetRuleIteratorForURL(
+    const GURL& primary_url,
+    ContentSettingsType content_type,
+    const ResourceIdentifier& resource_identifier,
+    base::Lock* lock) const {
+  EntryMapKey key(content_type, resource_identifier);
+  scoped_refptr<RuleIndex> index;
+  {
+    scoped_ptr<base::AutoLock> auto_lock;
+    if (lock)
+      auto_lock.reset(new base::AutoLock(*lock));
+    EntryMap::const_iterator it = entries_.find(key);
+    if (it == entries_.end())
+      return new EmptyRuleIterator();
+    scoped_refptr<RuleIndex>& cached_index = indexes_[key];
+    if (!cached_index.get())
+      cached_index = new RuleIndex(it->second);
+    index = cached_index;
+  }
+  return new IndexedRuleIterator(index.get(), primary_url);
+}
+
 size_t OriginIdentifierValueMap::size() const {
   size_t size = 0;
   EntryMap::const_iterator it;
@@ -156,6 +332,7 @@ void OriginIdentifierValueMap::SetValue(
   PatternPair patterns(primary_pattern, secondary_pattern);
   // This will create the entry and the linked_ptr if needed.
   entries_[key][patterns].reset(value);
+  indexes_.erase(key);
 }
 
 void OriginIdentifierValueMap::DeleteValue(
@@ -169,6 +346,7 @@ void OriginIdentifierValueMap::DeleteValue(
   if (entries_[key].empty()) {
     entries_.erase(key);
   }
+  indexes_.erase(key);
 }
 
 void OriginIdentifierValueMap::DeleteValues(
@@ -176,11 +354,13 @@ void OriginIdentifierValueMap::DeleteValues(
       const ResourceIdentifier& resource_identifier) {
   EntryMapKey key(content_type, resource_identifier);
   entries_.erase(key);
+  indexes_.erase(key);
 }
 
 void OriginIdentifierValueMap::clear() {
   // Delete all owned value objects.
   entries_.clear();
+  indexes_.clear();
 }
 
 }  // namespace content_settings
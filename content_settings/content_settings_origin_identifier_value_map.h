@@ -9,6 +9,7 @@
 #include <string>
 
 #include "base/memory/linked_ptr.h"
+#include "base/memory/ref_counted.h"
 #include "chrome/common/content_settings_pattern.h"
 #include "chrome/common/content_settings_types.h"
 
@@ -21,6 +22,7 @@ class Value;
 
 namespace content_settings {
 
+class RuleIndex;
 class RuleIterator;
 
 class OriginIdentifierValueMap {
@@ -77,6 +79,20 @@ class OriginIdentifierValueMap {
                                 const ResourceIdentifier& resource_identifier,
                                 base::Lock* lock) const;
 
+  // Returns an iterator for reading, in the same order, those rules for
+  // |content_type| and |resource_identifier| whose primary pattern may match
+  // |primary_url|; most of the others are left out. The caller takes the
+  // ownership of the iterator. The iterator reads an index of the rules which
+  // is built on first use and kept until they change, so unlike the one
+  // returned by |GetRuleIterator| it does not hold |lock|, and the map may be
+  // changed while it is alive. |lock| is only held while the index is looked
+  // up.
+  RuleIterator* GetRuleIteratorForURL(
+      const GURL& primary_url,
+      ContentSettingsType content_type,
+      const ResourceIdentifier& resource_identifier,
+      base::Lock* lock) const;
+
   OriginIdentifierValueMap();
   ~OriginIdentifierValueMap();
 
@@ -117,8 +133,14 @@ class OriginIdentifierValueMap {
   void clear();
 
  private:
+  typedef std::map<EntryMapKey, scoped_refptr<RuleIndex> > RuleIndexMap;
+
   EntryMap entries_;
 
+  // The indexes of the rules in |entries_| which have been looked up since
+  // they last changed.
+  mutable RuleIndexMap indexes_;
+
   DISALLOW_COPY_AND_ASSIGN(OriginIdentifierValueMap);
 };
 
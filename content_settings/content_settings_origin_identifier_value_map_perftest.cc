@@ -0,0 +1,111 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Times looking up the cookie setting of URLs among 10000 rules, as
+// enterprise policy may set, by going through all of the rules and by going
+// through those the index of the map finds for the URL.
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "chrome/browser/content_settings/content_settings_origin_identifier_value_map.h"
+#include "chrome/browser/content_settings/content_settings_rule.h"
+#include "chrome/browser/content_settings/content_settings_utils.h"
+#include "chrome/common/content_settings.h"
+#include "chrome/common/content_settings_pattern.h"
+#include "chrome/test/perf/perf_test.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "url/gurl.h"
+
+namespace content_settings {
+namespace {
+
+const int kRuleCount = 10000;
+
+const int kLookupCount = 1000;
+
+// Returns the host of the |i|th site.
+std::string SiteHost(int i) {
+  return "site" + base::IntToString(i) + ".example.com";
+}
+
+// Adds rules for |kRuleCount| sites, a third of them for a single host and
+// the rest for a domain and its subdomains, and one for any other site.
+void AddRules(OriginIdentifierValueMap* map) {
+  for (int i = 0; i < kRuleCount; ++i) {
+    const std::string spec = (i % 3 == 0) ? SiteHost(i) : "[*.]" + SiteHost(i);
+    map->SetValue(ContentSettingsPattern::FromString(spec),
+                  ContentSettingsPattern::Wildcard(),
+                  CONTENT_SETTINGS_TYPE_COOKIES, std::string(),
+                  Value::CreateIntegerValue(CONTENT_SETTING_BLOCK));
+  }
+  map->SetValue(ContentSettingsPattern::Wildcard(),
+                ContentSettingsPattern::Wildcard(),
+                CONTENT_SETTINGS_TYPE_COOKIES, std::string(),
+                Value::CreateIntegerValue(CONTENT_SETTING_ALLOW));
+}
+
+// Looks up the |i|th URL, half of which have a rule of their own.
+GURL LookupURL(int i) {
+  const int site = (i * 7919) % (2 * kRuleCount);
+  return GURL("http://www." + SiteHost(site) + "/");
+}
+
+void PrintLookupTime(const std::string& trace, base::TimeDelta elapsed) {
+  perf_test::PrintResult(
+      "content_settings_lookup", "", trace,
+      static_cast<size_t>(elapsed.InMicroseconds() * 1000 / kLookupCount),
+      "ns", true);
+}
+
+TEST(OriginIdentifierValueMapPerfTest, Lookup10000Rules) {
+  OriginIdentifierValueMap map;
+  AddRules(&map);
+  const GURL secondary_url("http://www.google.com/");
+
+  int blocked = 0;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kLookupCount; ++i) {
+    scoped_ptr<RuleIterator> rule_iterator(
+        map.GetRuleIterator(CONTENT_SETTINGS_TYPE_COOKIES, std::string(),
+                            NULL));
+    scoped_ptr<Value> value(GetContentSettingValueAndPatterns(
+        rule_iterator.get(), LookupURL(i), secondary_url, NULL, NULL));
+    if (ValueToContentSetting(value.get()) == CONTENT_SETTING_BLOCK)
+      ++blocked;
+  }
+  PrintLookupTime("all_rules", base::TimeTicks::Now() - start);
+
+  // The first lookup builds the index.
+  start = base::TimeTicks::Now();
+  delete map.GetRuleIteratorForURL(LookupURL(0), CONTENT_SETTINGS_TYPE_COOKIES,
+                                   std::string(), NULL);
+  perf_test::PrintResult(
+      "content_settings_index", "", "build",
+      static_cast<size_t>((base::TimeTicks::Now() - start).InMicroseconds()),
+      "us", true);
+
+  int indexed_blocked = 0;
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kLookupCount; ++i) {
+    scoped_ptr<RuleIterator> rule_iterator(map.GetRuleIteratorForURL(
+        LookupURL(i), CONTENT_SETTINGS_TYPE_COOKIES, std::string(), NULL));
+    scoped_ptr<Value> value(GetContentSettingValueAndPatterns(
+        rule_iterator.get(), LookupURL(i), secondary_url, NULL, NULL));
+    if (ValueToContentSetting(value.get()) == CONTENT_SETTING_BLOCK)
+      ++indexed_blocked;
+  }
+  PrintLookupTime("indexed", base::TimeTicks::Now() - start);
+
+  EXPECT_EQ(blocked, indexed_blocked);
+  EXPECT_LT(0, blocked);
+  EXPECT_GT(kLookupCount, blocked);
+}
+
+}  // namespace
+}  // namespace content_settings
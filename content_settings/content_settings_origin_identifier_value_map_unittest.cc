@@ -209,3 +209,62 @@ TEST(OriginIdentifierValueMapTest, IterateNonempty) {
   EXPECT_EQ(pattern, rule.primary_pattern);
   EXPECT_EQ(1, content_settings::ValueToContentSetting(rule.value.get()));
 }
+
+TEST(OriginIdentifierValueMapTest, IterateForURL) {
+  content_settings::OriginIdentifierValueMap map;
+  ContentSettingsPattern pattern =
+      ContentSettingsPattern::FromString("[*.]google.com");
+  ContentSettingsPattern sub_pattern =
+      ContentSettingsPattern::FromString("sub.google.com");
+  ContentSettingsPattern other_pattern =
+      ContentSettingsPattern::FromString("[*.]youtube.com");
+  map.SetValue(pattern,
+               ContentSettingsPattern::Wildcard(),
+               CONTENT_SETTINGS_TYPE_COOKIES,
+               std::string(),
+               Value::CreateIntegerValue(1));
+  map.SetValue(other_pattern,
+               ContentSettingsPattern::Wildcard(),
+               CONTENT_SETTINGS_TYPE_COOKIES,
+               std::string(),
+               Value::CreateIntegerValue(1));
+  map.SetValue(ContentSettingsPattern::Wildcard(),
+               ContentSettingsPattern::Wildcard(),
+               CONTENT_SETTINGS_TYPE_COOKIES,
+               std::string(),
+               Value::CreateIntegerValue(2));
+
+  // The rules for other hosts are left out, and the rest keep their order.
+  scoped_ptr<content_settings::RuleIterator> rule_iterator(
+      map.GetRuleIteratorForURL(GURL("http://sub.google.com"),
+                                CONTENT_SETTINGS_TYPE_COOKIES, std::string(),
+                                NULL));
+  ASSERT_TRUE(rule_iterator->HasNext());
+  EXPECT_EQ(pattern, rule_iterator->Next().primary_pattern);
+  ASSERT_TRUE(rule_iterator->HasNext());
+  EXPECT_EQ(ContentSettingsPattern::Wildcard(),
+            rule_iterator->Next().primary_pattern);
+  EXPECT_FALSE(rule_iterator->HasNext());
+
+  // The index is rebuilt when the rules change.
+  map.SetValue(sub_pattern,
+               ContentSettingsPattern::Wildcard(),
+               CONTENT_SETTINGS_TYPE_COOKIES,
+               std::string(),
+               Value::CreateIntegerValue(2));
+  scoped_ptr<content_settings::RuleIterator> new_rule_iterator(
+      map.GetRuleIteratorForURL(GURL("http://sub.google.com"),
+                                CONTENT_SETTINGS_TYPE_COOKIES, std::string(),
+                                NULL));
+  ASSERT_TRUE(new_rule_iterator->HasNext());
+  EXPECT_EQ(sub_pattern, new_rule_iterator->Next().primary_pattern);
+  ASSERT_TRUE(new_rule_iterator->HasNext());
+  EXPECT_EQ(pattern, new_rule_iterator->Next().primary_pattern);
+
+  map.clear();
+  scoped_ptr<content_settings::RuleIterator> empty_rule_iterator(
+      map.GetRuleIteratorForURL(GURL("http://sub.google.com"),
+                                CONTENT_SETTINGS_TYPE_COOKIES, std::string(),
+                                NULL));
+  EXPECT_FALSE(empty_rule_iterator->HasNext());
+}
@@ -241,6 +241,15 @@ RuleIterator* PolicyProvider::GetRuleIterator(
   return value_map_.GetRuleIterator(content_type, resource_identifier, &lock_);
 }
 
+RuleIterator* PolicyProvider::GetRuleIteratorForURL(
+    const GURL& primary_url,
+    ContentSettingsType content_type,
+    const ResourceIdentifier& resource_identifier,
+    bool incognito) const {
+  return value_map_.GetRuleIteratorForURL(primary_url, content_type,
+                                          resource_identifier, &lock_);
+}
+
 void PolicyProvider::GetContentSettingsFromPreferences(
     OriginIdentifierValueMap* value_map) {
   for (size_t i = 0; i < arraysize(kPrefsForManagedContentSettingsMap); ++i) {
@@ -227,6 +227,19 @@ RuleIterator* PrefProvider::GetRuleIterator(
   return value_map_.GetRuleIterator(content_type, resource_identifier, &lock_);
 }
 
+RuleIterator* PrefProvider::GetRuleIteratorForURL(
+    const GURL& primary_url,
+    ContentSettingsType content_type,
+    const ResourceIdentifier& resource_identifier,
+    bool incognito) const {
+  if (incognito) {
+    return incognito_value_map_.GetRuleIteratorForURL(
+        primary_url, content_type, resource_identifier, &lock_);
+  }
+  return value_map_.GetRuleIteratorForURL(primary_url, content_type,
+                                          resource_identifier, &lock_);
+}
+
 // ////////////////////////////////////////////////////////////////////////////
 // Private
 
@@ -16,6 +16,7 @@
 #include "chrome/common/content_settings_types.h"
 
 class ContentSettingsPattern;
+class GURL;
 
 namespace content_settings {
 
@@ -41,6 +42,16 @@ class ProviderInterface {
       const ResourceIdentifier& resource_identifier,
       bool incognito) const = 0;
 
+  // Returns a |RuleIterator| like |GetRuleIterator| does, except that rules
+  // whose primary pattern does not match |primary_url| may be left out. This
+  // is used for looking up the setting for a URL, which need not go through
+  // every rule. The same restrictions apply to the returned iterator.
+  virtual RuleIterator* GetRuleIteratorForURL(
+      const GURL& primary_url,
+      ContentSettingsType content_type,
+      const ResourceIdentifier& resource_identifier,
+      bool incognito) const = 0;
+
   // Asks the provider to set the website setting for a particular
   // |primary_pattern|, |secondary_pattern|, |content_type| tuple. If the
   // provider accepts the setting it returns true and takes the ownership of the
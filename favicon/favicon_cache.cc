@@ -0,0 +1,234 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/favicon/favicon_cache.h"
+
+#include "base/logging.h"
+#include "base/metrics/histogram.h"
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "ui/gfx/image/image_skia.h"
+
+namespace {
+
+// Rough bookkeeping cost of an entry beyond its payload, for the memory
+// budget.
+const size_t kEntryOverhead = 64;
+
+}  // namespace
+
+FaviconCache::Key::Key()
+    : type(PAGE_URL),
+      icon_types(0),
+      desired_size_in_dip(0) {
+}
+
+FaviconCache::Key::Key(KeyType type,
+                       const GURL& url,
+                       int icon_types,
+                       int desired_size_in_dip,
+                       const std::vector<ui::ScaleFactor>& scale_factors)
+    : type(type),
+      url(url),
+      icon_types(icon_types),
+      desired_size_in_dip(desired_size_in_dip),
+      scale_factors(scale_factors) {
+}
+
+FaviconCache::Key::~Key() {
+}
+
+bool FaviconCache::Key::operator<(const Key& other) const {
+  if (type != other.type)
+    return type < other.type;
+  if (url != other.url)
+    return url < other.url;
+  if (icon_types != other.icon_types)
+    return icon_types < other.icon_types;
+  if (desired_size_in_dip != other.desired_size_in_dip)
+    return desired_size_in_dip < other.desired_size_in_dip;
+  return scale_factors < other.scale_factors;
+}
+
+FaviconCache::Entry::Entry() : has_image(false) {
+}
+
+FaviconCache::Entry::~Entry() {
+}
+
+FaviconCache::FaviconCache(size_t max_bytes, size_t max_image_bytes)
+    : entries_(EntryMap::NO_AUTO_EVICT),
+      max_bytes_(max_bytes),
+      max_image_bytes_(max_image_bytes),
+      memory_usage_(0),
+      image_memory_usage_(0),
+      generation_(0),
+      hit_count_(0),
+      image_hit_count_(0),
+      miss_count_(0),
+      eviction_count_(0) {
+}
+
+FaviconCache::~FaviconCache() {
+}
+
+FaviconCache::LookupResult FaviconCache::Lookup(
+    const Key& key,
+    std::vector<chrome::FaviconBitmapResult>* results,
+    chrome::FaviconImageResult* image_result) {
+  LookupResult lookup_result = NOT_CACHED;
+  EntryMap::iterator it = entries_.Get(key);
+  if (it == entries_.end()) {
+    ++miss_count_;
+  } else if (image_result && it->second.has_image) {
+    ++hit_count_;
+    ++image_hit_count_;
+    *image_result = it->second.image_result;
+    lookup_result = CACHED_IMAGE;
+  } else {
+    ++hit_count_;
+    *results = it->second.results;
+    lookup_result = CACHED_RESULTS;
+  }
+  UMA_HISTOGRAM_ENUMERATION("Favicons.CacheLookup", lookup_result,
+                            LOOKUP_RESULT_MAX);
+  return lookup_result;
+}
+
+void FaviconCache::PutResults(
+    const Key& key,
+    const std::vector<chrome::FaviconBitmapResult>& results,
+    uint64 generation) {
+  if (generation != generation_)
+    return;
+
+  EntryMap::iterator it = entries_.Peek(key);
+  if (it != entries_.end())
+    Erase(it);
+  Entry entry;
+  entry.results = results;
+  entries_.Put(key, entry);
+  memory_usage_ += ResultsSize(key, entry);
+  EvictToBudget();
+}
+
+void FaviconCache::PutImage(const Key& key,
+                            const chrome::FaviconImageResult& image_result,
+                            uint64 generation) {
+  if (generation != generation_)
+    return;
+
+  EntryMap::iterator it = entries_.Peek(key);
+  if (it == entries_.end())
+    return;
+  Entry& entry = it->second;
+  if (entry.has_image) {
+    memory_usage_ -= ImageSize(entry);
+    image_memory_usage_ -= ImageSize(entry);
+  }
+  entry.has_image = true;
+  entry.image_result = image_result;
+  memory_usage_ += ImageSize(entry);
+  image_memory_usage_ += ImageSize(entry);
+  EvictToBudget();
+}
+
+void FaviconCache::Invalidate(const std::set<GURL>& page_urls,
+                              const std::set<GURL>& icon_urls) {
+  ++generation_;
+  std::set<GURL> changed_icon_urls(icon_urls);
+  for (EntryMap::const_iterator it = entries_.begin(); it != entries_.end();
+       ++it) {
+    if (it->first.type != PAGE_URL || !page_urls.count(it->first.url))
+      continue;
+    for (size_t i = 0; i < it->second.results.size(); ++i)
+      changed_icon_urls.insert(it->second.results[i].icon_url);
+  }
+
+  for (EntryMap::iterator it = entries_.begin(); it != entries_.end(); ) {
+    if ((it->first.type == PAGE_URL && page_urls.count(it->first.url)) ||
+        HasIcon(it->first, it->second, changed_icon_urls)) {
+      it = Erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void FaviconCache::Clear() {
+  ++generation_;
+  entries_.Clear();
+  memory_usage_ = 0;
+  image_memory_usage_ = 0;
+}
+
+// static
+bool FaviconCache::HasIcon(const Key& key,
+                           const Entry& entry,
+                           const std::set<GURL>& icon_urls) {
+  if (key.type == ICON_URL && icon_urls.count(key.url))
+    return true;
+  for (size_t i = 0; i < entry.results.size(); ++i) {
+    if (icon_urls.count(entry.results[i].icon_url))
+      return true;
+  }
+  return false;
+}
+
+// static
+size_t FaviconCache::ResultsSize(const Key& key, const Entry& entry) {
+  size_t size = kEntryOverhead + sizeof(Key) + sizeof(Entry) +
+      key.url.spec().size();
+  for (size_t i = 0; i < entry.results.size(); ++i) {
+    const chrome::FaviconBitmapResult& result = entry.results[i];
+    size += sizeof(result) + result.icon_url.spec().size();
+    if (result.bitmap_data.get())
+      size += result.bitmap_data->size();
+  }
+  return size;
+}
+
+// static
+size_t FaviconCache::ImageSize(const Entry& entry) {
+  if (!entry.has_image || entry.image_result.image.IsEmpty())
+    return 0;
+  const std::vector<gfx::ImageSkiaRep>& reps =
+      entry.image_result.image.AsImageSkia().image_reps();
+  size_t size = 0;
+  for (size_t i = 0; i < reps.size(); ++i)
+    size += reps[i].sk_bitmap().getSize();
+  return size;
+}
+
+FaviconCache::EntryMap::iterator FaviconCache::Erase(EntryMap::iterator it) {
+  const size_t image_size = ImageSize(it->second);
+  DCHECK_GE(image_memory_usage_, image_size);
+  image_memory_usage_ -= image_size;
+  const size_t size = ResultsSize(it->first, it->second) + image_size;
+  DCHECK_GE(memory_usage_, size);
+  memory_usage_ -= size;
+  return entries_.Erase(it);
+}
+
+void FaviconCache::EvictToBudget() {
+  for (EntryMap::reverse_iterator it = entries_.rbegin();
+       image_memory_usage_ > max_image_bytes_ && it != entries_.rend();
+       ++it) {
+    if (!it->second.has_image)
+      continue;
+    const size_t image_size = ImageSize(it->second);
+    image_memory_usage_ -= image_size;
+    memory_usage_ -= image_size;
+    it->second.has_image = false;
+    it->second.image_result = chrome::FaviconImageResult();
+  }
+
+  while (memory_usage_ > max_bytes_ && !entries_.empty()) {
+    EntryMap::reverse_iterator oldest = entries_.rbegin();
+    const size_t image_size = ImageSize(oldest->second);
+    image_memory_usage_ -= image_size;
+    memory_usage_ -= ResultsSize(oldest->first, oldest->second) + image_size;
+    entries_.Erase(oldest);
+    ++eviction_count_;
+  }
+}
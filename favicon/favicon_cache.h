@@ -0,0 +1,173 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_FAVICON_FAVICON_CACHE_H_
+#define CHROME_BROWSER_FAVICON_FAVICON_CACHE_H_
+
+#include <set>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/mru_cache.h"
+#include "chrome/common/favicon/favicon_types.h"
+#include "ui/base/layout.h"
+#include "url/gurl.h"
+
+// Caches the favicon bitmaps which FaviconService gets from the history
+// database, so that pages which show the same favicons again and again, like
+// the New Tab Page, do not have to wait for the history thread each time.
+//
+// An entry holds the PNG encoded bitmaps history returned for a request, or
+// a record that it returned none.  The entries for requests which want a
+// gfx::Image also hold the image decoded from them, so that it is not
+// decoded again; the least recently used images are dropped to keep the
+// decoded images within their own budget, leaving their PNG bitmaps.  The
+// least recently used entries are evicted to keep the PNG bitmaps within
+// the cache's budget.
+//
+// Entries are removed when the favicons of their page, or the icons they
+// hold, change.  Results
+// which were requested before a removal are not cached, as they may
+// predate the change.
+//
+// Not thread-safe.  FaviconService uses it on the UI thread, where the
+// notifications of favicon changes are sent.
+class FaviconCache {
+ public:
+  enum KeyType {
+    PAGE_URL,
+    ICON_URL,
+  };
+
+  // Identifies a request for favicons.  |url| is a page URL or an icon URL,
+  // as given by |type|.
+  struct Key {
+    Key();
+    Key(KeyType type,
+        const GURL& url,
+        int icon_types,
+        int desired_size_in_dip,
+        const std::vector<ui::ScaleFactor>& scale_factors);
+    ~Key();
+
+    bool operator<(const Key& other) const;
+
+    KeyType type;
+    GURL url;
+    int icon_types;
+    int desired_size_in_dip;
+    std::vector<ui::ScaleFactor> scale_factors;
+  };
+
+  // Reported to the Favicons.CacheLookup histogram; do not reorder.
+  enum LookupResult {
+    // Nothing is cached for the request.
+    NOT_CACHED,
+
+    // The bitmaps for the request were found, but the image was not.
+    CACHED_RESULTS,
+
+    // The decoded image for the request was found.
+    CACHED_IMAGE,
+
+    LOOKUP_RESULT_MAX
+  };
+
+  FaviconCache(size_t max_bytes, size_t max_image_bytes);
+  ~FaviconCache();
+
+  // Looks up |key|, making its entry the most recently used.  If
+  // |image_result| is not NULL and the entry has an image, sets it and
+  // returns CACHED_IMAGE; otherwise sets |results| if there is an entry.
+  LookupResult Lookup(const Key& key,
+                      std::vector<chrome::FaviconBitmapResult>* results,
+                      chrome::FaviconImageResult* image_result);
+
+  // Incremented whenever entries are removed because favicons changed.
+  // Results requested at an earlier generation are not cached.
+  uint64 generation() const { return generation_; }
+
+  // Caches the |results| history returned for |key|, which was requested at
+  // |generation|.
+  void PutResults(const Key& key,
+                  const std::vector<chrome::FaviconBitmapResult>& results,
+                  uint64 generation);
+
+  // Caches |image_result|, which was decoded from the results cached for
+  // |key|.  Does nothing if they are no longer cached.
+  void PutImage(const Key& key,
+                const chrome::FaviconImageResult& image_result,
+                uint64 generation);
+
+  // Removes the entries for the pages in |page_urls|.  The bitmaps of an
+  // icon are shared by all the pages mapped to it, so the entries keyed by,
+  // or holding bitmaps of, the icons in |icon_urls| or those cached for the
+  // pages are removed as well.
+  void Invalidate(const std::set<GURL>& page_urls,
+                  const std::set<GURL>& icon_urls);
+
+  void Clear();
+
+  size_t size() const { return entries_.size(); }
+
+  // Approximate bytes used by the entries, and the part of that used by
+  // decoded images.
+  size_t memory_usage() const { return memory_usage_; }
+  size_t image_memory_usage() const { return image_memory_usage_; }
+
+  // Lookups which found an entry, those which found its decoded image, and
+  // those which found nothing, and entries evicted to stay within the
+  // budget.
+  size_t hit_count() const { return hit_count_; }
+  size_t image_hit_count() const { return image_hit_count_; }
+  size_t miss_count() const { return miss_count_; }
+  size_t eviction_count() const { return eviction_count_; }
+
+ private:
+  struct Entry {
+    Entry();
+    ~Entry();
+
+    // Empty if history had no favicon for the request.
+    std::vector<chrome::FaviconBitmapResult> results;
+
+    bool has_image;
+    chrome::FaviconImageResult image_result;
+  };
+  typedef base::MRUCache<Key, Entry> EntryMap;
+
+  static size_t ResultsSize(const Key& key, const Entry& entry);
+  static size_t ImageSize(const Entry& entry);
+
+  // Returns true if |key| is, or |entry| holds bitmaps of, an icon in
+  // |icon_urls|.
+  static bool HasIcon(const Key& key,
+                      const Entry& entry,
+                      const std::set<GURL>& icon_urls);
+
+  EntryMap::iterator Erase(EntryMap::iterator it);
+
+  // Drops the images of the least recently used entries until the images
+  // fit their budget, then evicts the least recently used entries until the
+  // cache fits its budget.
+  void EvictToBudget();
+
+  EntryMap entries_;
+
+  const size_t max_bytes_;
+  const size_t max_image_bytes_;
+  size_t memory_usage_;
+  size_t image_memory_usage_;
+
+  uint64 generation_;
+
+  size_t hit_count_;
+  size_t image_hit_count_;
+  size_t miss_count_;
+  size_t eviction_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(FaviconCache);
+};
+
+#endif  // CHROME_BROWSER_FAVICON_FAVICON_CACHE_H_
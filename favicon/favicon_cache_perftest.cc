@@ -0,0 +1,143 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Times the favicon work of loading a New Tab Page with 100 tiles, each
+// asking for the favicon of its page, when the favicons are decoded from
+// the PNG bitmaps history returns, when those bitmaps are cached, and when
+// the decoded images are cached.  The history round trip which the cache
+// also saves is not included.
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/favicon/favicon_cache.h"
+#include "chrome/browser/favicon/favicon_util.h"
+#include "chrome/test/perf/perf_test.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "ui/gfx/codec/png_codec.h"
+#include "ui/gfx/favicon_size.h"
+
+namespace {
+
+const size_t kTileCount = 100;
+
+const size_t kLoadCount = 100;
+
+// Returns the bitmaps history would have for a page: a favicon at 1x and
+// at 2x.
+std::vector<chrome::FaviconBitmapResult> MakeResults(const GURL& icon_url,
+                                                     SkColor color) {
+  std::vector<chrome::FaviconBitmapResult> results;
+  for (int scale = 1; scale <= 2; ++scale) {
+    const int size = gfx::kFaviconSize * scale;
+    SkBitmap bitmap;
+    bitmap.setConfig(SkBitmap::kARGB_8888_Config, size, size);
+    bitmap.allocPixels();
+    bitmap.eraseColor(color);
+
+    chrome::FaviconBitmapResult result;
+    scoped_refptr<base::RefCountedBytes> data(new base::RefCountedBytes());
+    EXPECT_TRUE(gfx::PNGCodec::EncodeBGRASkBitmap(bitmap, false,
+                                                  &data->data()));
+    result.bitmap_data = data;
+    result.pixel_size = gfx::Size(size, size);
+    result.icon_url = icon_url;
+    result.icon_type = chrome::FAVICON;
+    results.push_back(result);
+  }
+  return results;
+}
+
+chrome::FaviconImageResult Decode(
+    const std::vector<chrome::FaviconBitmapResult>& results) {
+  chrome::FaviconImageResult image_result;
+  image_result.image = FaviconUtil::SelectFaviconFramesFromPNGs(
+      results, FaviconUtil::GetFaviconScaleFactors(), gfx::kFaviconSize);
+  image_result.icon_url = results[0].icon_url;
+  return image_result;
+}
+
+void PrintLoadTime(const std::string& trace, base::TimeDelta elapsed) {
+  perf_test::PrintResult(
+      "ntp_favicons", "", trace,
+      static_cast<size_t>(elapsed.InMicroseconds() / kLoadCount),
+      "us", true);
+}
+
+TEST(FaviconCachePerfTest, NewTabPage) {
+  std::vector<FaviconCache::Key> keys;
+  std::vector<std::vector<chrome::FaviconBitmapResult> > tile_results;
+  for (size_t i = 0; i < kTileCount; ++i) {
+    const std::string host =
+        "http://www.site" + base::Uint64ToString(i) + ".com/";
+    keys.push_back(FaviconCache::Key(
+        FaviconCache::PAGE_URL, GURL(host), chrome::FAVICON,
+        gfx::kFaviconSize, FaviconUtil::GetFaviconScaleFactors()));
+    tile_results.push_back(MakeResults(GURL(host + "favicon.ico"),
+                                       SkColorSetRGB(i, 255 - i, 128)));
+  }
+
+  size_t decoded = 0;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t load = 0; load < kLoadCount; ++load) {
+    for (size_t i = 0; i < kTileCount; ++i) {
+      if (!Decode(tile_results[i]).image.IsEmpty())
+        ++decoded;
+    }
+  }
+  PrintLoadTime("uncached", base::TimeTicks::Now() - start);
+  EXPECT_EQ(kLoadCount * kTileCount, decoded);
+
+  // Only the bitmaps are cached, as for requests which do not want images.
+  FaviconCache png_cache(4 * 1024 * 1024, 0);
+  for (size_t i = 0; i < kTileCount; ++i)
+    png_cache.PutResults(keys[i], tile_results[i], png_cache.generation());
+  decoded = 0;
+  start = base::TimeTicks::Now();
+  for (size_t load = 0; load < kLoadCount; ++load) {
+    for (size_t i = 0; i < kTileCount; ++i) {
+      std::vector<chrome::FaviconBitmapResult> results;
+      chrome::FaviconImageResult image_result;
+      if (png_cache.Lookup(keys[i], &results, &image_result) ==
+              FaviconCache::CACHED_RESULTS &&
+          !Decode(results).image.IsEmpty()) {
+        ++decoded;
+      }
+    }
+  }
+  PrintLoadTime("cached_png", base::TimeTicks::Now() - start);
+  EXPECT_EQ(kLoadCount * kTileCount, decoded);
+
+  FaviconCache image_cache(4 * 1024 * 1024, 3 * 1024 * 1024);
+  for (size_t i = 0; i < kTileCount; ++i) {
+    image_cache.PutResults(keys[i], tile_results[i],
+                           image_cache.generation());
+    image_cache.PutImage(keys[i], Decode(tile_results[i]),
+                         image_cache.generation());
+  }
+  size_t image_hits = 0;
+  start = base::TimeTicks::Now();
+  for (size_t load = 0; load < kLoadCount; ++load) {
+    for (size_t i = 0; i < kTileCount; ++i) {
+      std::vector<chrome::FaviconBitmapResult> results;
+      chrome::FaviconImageResult image_result;
+      if (image_cache.Lookup(keys[i], &results, &image_result) ==
+          FaviconCache::CACHED_IMAGE) {
+        ++image_hits;
+      }
+    }
+  }
+  PrintLoadTime("cached_image", base::TimeTicks::Now() - start);
+  EXPECT_EQ(kLoadCount * kTileCount, image_hits);
+
+  perf_test::PrintResult("ntp_favicons", "", "image_cache_bytes",
+                         image_cache.memory_usage(), "bytes", true);
+}
+
+}  // namespace
@@ -0,0 +1,197 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/favicon/favicon_cache.h"
+
+#include <set>
+#include <vector>
+
+#include "base/memory/ref_counted_memory.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "ui/gfx/image/image.h"
+
+namespace {
+
+const size_t kBitmapBytes = 1000;
+
+FaviconCache::Key MakeKey(FaviconCache::KeyType type, const GURL& url) {
+  std::vector<ui::ScaleFactor> scale_factors;
+  scale_factors.push_back(ui::SCALE_FACTOR_100P);
+  return FaviconCache::Key(type, url, chrome::FAVICON, 16, scale_factors);
+}
+
+std::vector<chrome::FaviconBitmapResult> MakeResults(const GURL& icon_url) {
+  chrome::FaviconBitmapResult result;
+  result.bitmap_data = new base::RefCountedBytes(
+      std::vector<unsigned char>(kBitmapBytes, 'a'));
+  result.pixel_size = gfx::Size(16, 16);
+  result.icon_url = icon_url;
+  result.icon_type = chrome::FAVICON;
+  return std::vector<chrome::FaviconBitmapResult>(1, result);
+}
+
+// Returns an image of 16x16 pixels, which takes 1024 bytes.
+chrome::FaviconImageResult MakeImageResult(const GURL& icon_url) {
+  SkBitmap bitmap;
+  bitmap.setConfig(SkBitmap::kARGB_8888_Config, 16, 16);
+  bitmap.allocPixels();
+  bitmap.eraseColor(SK_ColorRED);
+  chrome::FaviconImageResult image_result;
+  image_result.image = gfx::Image::CreateFrom1xBitmap(bitmap);
+  image_result.icon_url = icon_url;
+  return image_result;
+}
+
+}  // namespace
+
+TEST(FaviconCacheTest, ResultsAndImages) {
+  FaviconCache cache(1024 * 1024, 1024 * 1024);
+  const GURL page_url("http://www.google.com/");
+  const GURL icon_url("http://www.google.com/favicon.ico");
+  const FaviconCache::Key key = MakeKey(FaviconCache::PAGE_URL, page_url);
+
+  std::vector<chrome::FaviconBitmapResult> results;
+  chrome::FaviconImageResult image_result;
+  EXPECT_EQ(FaviconCache::NOT_CACHED,
+            cache.Lookup(key, &results, &image_result));
+
+  // An image is only kept along with the results it was decoded from.
+  cache.PutImage(key, MakeImageResult(icon_url), cache.generation());
+  EXPECT_EQ(0U, cache.size());
+
+  cache.PutResults(key, MakeResults(icon_url), cache.generation());
+  EXPECT_EQ(FaviconCache::CACHED_RESULTS,
+            cache.Lookup(key, &results, &image_result));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(icon_url, results[0].icon_url);
+  EXPECT_EQ(kBitmapBytes, results[0].bitmap_data->size());
+
+  cache.PutImage(key, MakeImageResult(icon_url), cache.generation());
+  EXPECT_EQ(1024U, cache.image_memory_usage());
+  EXPECT_EQ(FaviconCache::CACHED_IMAGE,
+            cache.Lookup(key, &results, &image_result));
+  EXPECT_EQ(icon_url, image_result.icon_url);
+  EXPECT_EQ(16, image_result.image.Width());
+
+  // Lookups which do not want an image get the bitmaps.
+  results.clear();
+  EXPECT_EQ(FaviconCache::CACHED_RESULTS, cache.Lookup(key, &results, NULL));
+  EXPECT_EQ(1U, results.size());
+
+  // The same page at another size is another request.
+  std::vector<ui::ScaleFactor> scale_factors(1, ui::SCALE_FACTOR_100P);
+  const FaviconCache::Key large_key(FaviconCache::PAGE_URL, page_url,
+                                    chrome::FAVICON, 32, scale_factors);
+  EXPECT_EQ(FaviconCache::NOT_CACHED, cache.Lookup(large_key, &results, NULL));
+
+  EXPECT_EQ(3U, cache.hit_count());
+  EXPECT_EQ(1U, cache.image_hit_count());
+  EXPECT_EQ(2U, cache.miss_count());
+}
+
+TEST(FaviconCacheTest, NoFavicon) {
+  FaviconCache cache(1024 * 1024, 1024 * 1024);
+  const FaviconCache::Key key =
+      MakeKey(FaviconCache::PAGE_URL, GURL("http://www.google.com/"));
+
+  cache.PutResults(key, std::vector<chrome::FaviconBitmapResult>(),
+                   cache.generation());
+  std::vector<chrome::FaviconBitmapResult> results;
+  EXPECT_EQ(FaviconCache::CACHED_RESULTS, cache.Lookup(key, &results, NULL));
+  EXPECT_TRUE(results.empty());
+}
+
+TEST(FaviconCacheTest, Invalidate) {
+  FaviconCache cache(1024 * 1024, 1024 * 1024);
+  const GURL page_url1("http://www.google.com/");
+  const GURL page_url2("http://maps.google.com/");
+  const GURL page_url3("http://www.example.com/");
+  const GURL icon_url1("http://www.google.com/favicon.ico");
+  const GURL icon_url2("http://www.example.com/favicon.ico");
+  const FaviconCache::Key page_key1 =
+      MakeKey(FaviconCache::PAGE_URL, page_url1);
+  const FaviconCache::Key page_key2 =
+      MakeKey(FaviconCache::PAGE_URL, page_url2);
+  const FaviconCache::Key page_key3 =
+      MakeKey(FaviconCache::PAGE_URL, page_url3);
+  const FaviconCache::Key icon_key1 =
+      MakeKey(FaviconCache::ICON_URL, icon_url1);
+  const FaviconCache::Key icon_key2 =
+      MakeKey(FaviconCache::ICON_URL, icon_url2);
+  cache.PutResults(page_key1, MakeResults(icon_url1), cache.generation());
+  cache.PutResults(page_key2, MakeResults(icon_url1), cache.generation());
+  cache.PutResults(page_key3, MakeResults(icon_url2), cache.generation());
+  cache.PutResults(icon_key1, MakeResults(icon_url1), cache.generation());
+  cache.PutResults(icon_key2, MakeResults(icon_url2), cache.generation());
+  EXPECT_EQ(5U, cache.size());
+
+  // The icon of the first page is shared by the second one.  Results
+  // requested before the favicons changed are not cached.
+  const uint64 generation = cache.generation();
+  std::set<GURL> page_urls;
+  page_urls.insert(page_url1);
+  cache.Invalidate(page_urls, std::set<GURL>());
+  cache.PutResults(page_key1, MakeResults(icon_url1), generation);
+
+  std::vector<chrome::FaviconBitmapResult> results;
+  EXPECT_EQ(FaviconCache::NOT_CACHED,
+            cache.Lookup(page_key1, &results, NULL));
+  EXPECT_EQ(FaviconCache::NOT_CACHED,
+            cache.Lookup(page_key2, &results, NULL));
+  EXPECT_EQ(FaviconCache::NOT_CACHED,
+            cache.Lookup(icon_key1, &results, NULL));
+  EXPECT_EQ(FaviconCache::CACHED_RESULTS,
+            cache.Lookup(page_key3, &results, NULL));
+  EXPECT_EQ(FaviconCache::CACHED_RESULTS,
+            cache.Lookup(icon_key2, &results, NULL));
+  EXPECT_EQ(2U, cache.size());
+
+  // A page which is not cached may be given the icon of one which is.
+  page_urls.clear();
+  page_urls.insert(page_url1);
+  std::set<GURL> icon_urls;
+  icon_urls.insert(icon_url2);
+  cache.Invalidate(page_urls, icon_urls);
+  EXPECT_EQ(0U, cache.size());
+
+  cache.PutResults(page_key1, MakeResults(icon_url1), cache.generation());
+  cache.Clear();
+  EXPECT_EQ(0U, cache.size());
+  EXPECT_EQ(0U, cache.memory_usage());
+}
+
+TEST(FaviconCacheTest, Budgets) {
+  // Room for the bitmaps of several pages, but the images of only two.
+  FaviconCache cache(10 * kBitmapBytes, 2 * 1024);
+  std::vector<FaviconCache::Key> keys;
+  const GURL icon_url("http://www.google.com/favicon.ico");
+  for (int i = 0; i < 3; ++i) {
+    const GURL page_url("http://www.google.com/" + std::string(1, 'a' + i));
+    keys.push_back(MakeKey(FaviconCache::PAGE_URL, page_url));
+    cache.PutResults(keys.back(), MakeResults(icon_url), cache.generation());
+    cache.PutImage(keys.back(), MakeImageResult(icon_url), cache.generation());
+  }
+  EXPECT_EQ(2048U, cache.image_memory_usage());
+
+  // The least recently used image was dropped, leaving its bitmaps.
+  std::vector<chrome::FaviconBitmapResult> results;
+  chrome::FaviconImageResult image_result;
+  EXPECT_EQ(FaviconCache::CACHED_RESULTS,
+            cache.Lookup(keys[0], &results, &image_result));
+  EXPECT_EQ(FaviconCache::CACHED_IMAGE,
+            cache.Lookup(keys[2], &results, &image_result));
+  EXPECT_EQ(0U, cache.eviction_count());
+
+  // Adding pages evicts the least recently used ones.
+  for (int i = 0; i < 20; ++i) {
+    const GURL page_url("http://www.example.com/" + std::string(1, 'a' + i));
+    cache.PutResults(MakeKey(FaviconCache::PAGE_URL, page_url),
+                     MakeResults(page_url), cache.generation());
+  }
+  EXPECT_LE(cache.memory_usage(), 10 * kBitmapBytes);
+  EXPECT_LT(0U, cache.eviction_count());
+  EXPECT_EQ(FaviconCache::NOT_CACHED, cache.Lookup(keys[0], &results, NULL));
+  EXPECT_EQ(0U, cache.image_memory_usage());
+}
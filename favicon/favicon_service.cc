@@ -6,6 +6,8 @@
 
 #include "base/hash.h"
 #include "base/message_loop/message_loop_proxy.h"
+#include "chrome/browser/chrome_notification_types.h"
+#include "chrome/browser/favicon/favicon_changed_details.h"
 #include "chrome/browser/favicon/favicon_util.h"
 #include "chrome/browser/history/history_backend.h"
 #include "chrome/browser/history/history_service.h"
@@ -15,6 +17,9 @@
 #include "chrome/common/favicon/favicon_types.h"
 #include "chrome/common/importer/imported_favicon_usage.h"
 #include "chrome/common/url_constants.h"
+#include "content/public/browser/notification_details.h"
+#include "content/public/browser/notification_service.h"
+#include "content/public/browser/notification_source.h"
 #include "extensions/common/constants.h"
 #include "third_party/skia/include/core/SkBitmap.h"
 #include "ui/gfx/codec/png_codec.h"
@@ -25,6 +30,11 @@ using base::Bind;
 
 namespace {
 
+// Budgets for the cached favicons, and for the part of that which is decoded
+// images.  These are enough for the favicons of a few hundred pages.
+const size_t kMaxCacheBytes = 4 * 1024 * 1024;
+const size_t kMaxCacheImageBytes = 3 * 1024 * 1024;
+
 void CancelOrRunFaviconResultsCallback(
     const CancelableTaskTracker::IsCanceledCallback& is_canceled,
     const FaviconService::FaviconResultsCallback& callback,
@@ -48,7 +58,14 @@ CancelableTaskTracker::TaskId RunWithEmptyResultAsync(
 }  // namespace
 
 FaviconService::FaviconService(HistoryService* history_service)
-    : history_service_(history_service) {
+    : history_service_(history_service),
+      cache_(kMaxCacheBytes, kMaxCacheImageBytes) {
+  if (history_service_) {
+    registrar_.Add(this, chrome::NOTIFICATION_FAVICON_CHANGED,
+                   content::NotificationService::AllSources());
+    registrar_.Add(this, chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+                   content::NotificationService::AllSources());
+  }
 }
 
 // static
@@ -64,15 +81,24 @@ CancelableTaskTracker::TaskId FaviconService::GetFaviconImage(
     int desired_size_in_dip,
     const FaviconImageCallback& callback,
     CancelableTaskTracker* tracker) {
+  FaviconCache::Key key(FaviconCache::ICON_URL, icon_url, icon_type,
+                        desired_size_in_dip,
+                        FaviconUtil::GetFaviconScaleFactors());
   FaviconResultsCallback callback_runner =
       Bind(&FaviconService::RunFaviconImageCallbackWithBitmapResults,
-           base::Unretained(this), callback, desired_size_in_dip);
+           base::Unretained(this), CacheImage(key, callback),
+           desired_size_in_dip);
   if (history_service_) {
+    CancelableTaskTracker::TaskId id =
+        RunWithCachedResultsAsync(key, callback, callback_runner, tracker);
+    if (id != CancelableTaskTracker::kBadTaskId)
+      return id;
+
     std::vector<GURL> icon_urls;
     icon_urls.push_back(icon_url);
     return history_service_->GetFavicons(
-        icon_urls, icon_type, desired_size_in_dip,
-        FaviconUtil::GetFaviconScaleFactors(), callback_runner, tracker);
+        icon_urls, icon_type, desired_size_in_dip, key.scale_factors,
+        CacheResults(key, callback_runner), tracker);
   } else {
     return RunWithEmptyResultAsync(callback_runner, tracker);
   }
@@ -91,14 +117,20 @@ CancelableTaskTracker::TaskId FaviconService::GetRawFavicon(
            callback, desired_size_in_dip, desired_scale_factor);
 
   if (history_service_) {
-    std::vector<GURL> icon_urls;
-    icon_urls.push_back(icon_url);
     std::vector<ui::ScaleFactor> desired_scale_factors;
     desired_scale_factors.push_back(desired_scale_factor);
+    FaviconCache::Key key(FaviconCache::ICON_URL, icon_url, icon_type,
+                          desired_size_in_dip, desired_scale_factors);
+    CancelableTaskTracker::TaskId id = RunWithCachedResultsAsync(
+        key, FaviconImageCallback(), callback_runner, tracker);
+    if (id != CancelableTaskTracker::kBadTaskId)
+      return id;
 
+    std::vector<GURL> icon_urls;
+    icon_urls.push_back(icon_url);
     return history_service_->GetFavicons(
         icon_urls, icon_type, desired_size_in_dip, desired_scale_factors,
-        callback_runner, tracker);
+        CacheResults(key, callback_runner), tracker);
   } else {
     return RunWithEmptyResultAsync(callback_runner, tracker);
   }
@@ -111,11 +143,19 @@ CancelableTaskTracker::TaskId FaviconService::GetFavicon(
     const FaviconResultsCallback& callback,
     CancelableTaskTracker* tracker) {
   if (history_service_) {
+    FaviconCache::Key key(FaviconCache::ICON_URL, icon_url, icon_type,
+                          desired_size_in_dip,
+                          FaviconUtil::GetFaviconScaleFactors());
+    CancelableTaskTracker::TaskId id = RunWithCachedResultsAsync(
+        key, FaviconImageCallback(), callback, tracker);
+    if (id != CancelableTaskTracker::kBadTaskId)
+      return id;
+
     std::vector<GURL> icon_urls;
     icon_urls.push_back(icon_url);
     return history_service_->GetFavicons(
-        icon_urls, icon_type, desired_size_in_dip,
-        FaviconUtil::GetFaviconScaleFactors(), callback, tracker);
+        icon_urls, icon_type, desired_size_in_dip, key.scale_factors,
+        CacheResults(key, callback), tracker);
   } else {
     return RunWithEmptyResultAsync(callback, tracker);
   }
@@ -129,6 +169,7 @@ CancelableTaskTracker::TaskId FaviconService::UpdateFaviconMappingsAndFetch(
     const FaviconResultsCallback& callback,
     CancelableTaskTracker* tracker) {
   if (history_service_) {
+    InvalidatePage(page_url, GURL());
     return history_service_->UpdateFaviconMappingsAndFetch(
         page_url, icon_urls, icon_types, desired_size_in_dip,
         FaviconUtil::GetFaviconScaleFactors(), callback, tracker);
@@ -141,12 +182,18 @@ CancelableTaskTracker::TaskId FaviconService::GetFaviconImageForURL(
     const FaviconForURLParams& params,
     const FaviconImageCallback& callback,
     CancelableTaskTracker* tracker) {
+  const std::vector<ui::ScaleFactor>& desired_scale_factors =
+      FaviconUtil::GetFaviconScaleFactors();
+  FaviconCache::Key key(FaviconCache::PAGE_URL, params.page_url,
+                        params.icon_types, params.desired_size_in_dip,
+                        desired_scale_factors);
   return GetFaviconForURLImpl(
       params,
-      FaviconUtil::GetFaviconScaleFactors(),
+      desired_scale_factors,
+      callback,
       Bind(&FaviconService::RunFaviconImageCallbackWithBitmapResults,
            base::Unretained(this),
-           callback,
+           CacheImage(key, callback),
            params.desired_size_in_dip),
       tracker);
 }
@@ -161,6 +208,7 @@ CancelableTaskTracker::TaskId FaviconService::GetRawFaviconForURL(
   return GetFaviconForURLImpl(
       params,
       desired_scale_factors,
+      FaviconImageCallback(),
       Bind(&FaviconService::RunFaviconRawCallbackWithBitmapResults,
            base::Unretained(this),
            callback,
@@ -175,6 +223,7 @@ CancelableTaskTracker::TaskId FaviconService::GetFaviconForURL(
     CancelableTaskTracker* tracker) {
   return GetFaviconForURLImpl(params,
                               FaviconUtil::GetFaviconScaleFactors(),
+                              FaviconImageCallback(),
                               callback,
                               tracker);
 }
@@ -202,20 +251,26 @@ CancelableTaskTracker::TaskId FaviconService::GetLargestRawFaviconForID(
 }
 
 void FaviconService::SetFaviconOutOfDateForPage(const GURL& page_url) {
-  if (history_service_)
+  if (history_service_) {
+    InvalidatePage(page_url, GURL());
     history_service_->SetFaviconsOutOfDateForPage(page_url);
+  }
 }
 
 void FaviconService::CloneFavicon(const GURL& old_page_url,
                                   const GURL& new_page_url) {
-  if (history_service_)
+  if (history_service_) {
+    InvalidatePage(new_page_url, GURL());
     history_service_->CloneFavicons(old_page_url, new_page_url);
+  }
 }
 
 void FaviconService::SetImportedFavicons(
     const std::vector<ImportedFaviconUsage>& favicon_usage) {
-  if (history_service_)
+  if (history_service_) {
+    cache_.Clear();
     history_service_->SetImportedFavicons(favicon_usage);
+  }
 }
 
 void FaviconService::MergeFavicon(
@@ -225,6 +280,7 @@ void FaviconService::MergeFavicon(
     scoped_refptr<base::RefCountedMemory> bitmap_data,
     const gfx::Size& pixel_size) {
   if (history_service_) {
+    InvalidatePage(page_url, icon_url);
     history_service_->MergeFavicon(page_url, icon_url, icon_type, bitmap_data,
                                    pixel_size);
   }
@@ -258,6 +314,7 @@ void FaviconService::SetFavicons(const GURL& page_url,
     }
   }
 
+  InvalidatePage(page_url, icon_url);
   history_service_->SetFavicons(page_url, icon_type, favicon_bitmap_data);
 }
 
@@ -275,11 +332,29 @@ void FaviconService::ClearUnableToDownloadFavicons() {
   missing_favicon_urls_.clear();
 }
 
+void FaviconService::Observe(int type,
+                             const content::NotificationSource& source,
+                             const content::NotificationDetails& details) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  switch (type) {
+    case chrome::NOTIFICATION_FAVICON_CHANGED:
+      cache_.Invalidate(content::Details<FaviconChangedDetails>(details)->urls,
+                        std::set<GURL>());
+      break;
+    case chrome::NOTIFICATION_HISTORY_URLS_DELETED:
+      cache_.Clear();
+      break;
+    default:
+      NOTREACHED();
+  }
+}
+
 FaviconService::~FaviconService() {}
 
 CancelableTaskTracker::TaskId FaviconService::GetFaviconForURLImpl(
     const FaviconForURLParams& params,
     const std::vector<ui::ScaleFactor>& desired_scale_factors,
+    const FaviconImageCallback& image_callback,
     const FaviconResultsCallback& callback,
     CancelableTaskTracker* tracker) {
   if (params.page_url.SchemeIs(chrome::kChromeUIScheme) ||
@@ -294,17 +369,93 @@ CancelableTaskTracker::TaskId FaviconService::GetFaviconForURLImpl(
         params.profile, params.page_url, desired_scale_factors, cancelable_cb);
     return id;
   } else if (history_service_) {
+    FaviconCache::Key key(FaviconCache::PAGE_URL, params.page_url,
+                          params.icon_types, params.desired_size_in_dip,
+                          desired_scale_factors);
+    CancelableTaskTracker::TaskId id =
+        RunWithCachedResultsAsync(key, image_callback, callback, tracker);
+    if (id != CancelableTaskTracker::kBadTaskId)
+      return id;
+
     return history_service_->GetFaviconsForURL(params.page_url,
                                                params.icon_types,
                                                params.desired_size_in_dip,
                                                desired_scale_factors,
-                                               callback,
+                                               CacheResults(key, callback),
                                                tracker);
   } else {
     return RunWithEmptyResultAsync(callback, tracker);
   }
 }
 
+CancelableTaskTracker::TaskId FaviconService::RunWithCachedResultsAsync(
+    const FaviconCache::Key& key,
+    const FaviconImageCallback& image_callback,
+    const FaviconResultsCallback& callback,
+    CancelableTaskTracker* tracker) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  std::vector<chrome::FaviconBitmapResult> results;
+  chrome::FaviconImageResult image_result;
+  switch (cache_.Lookup(key, &results,
+                        image_callback.is_null() ? NULL : &image_result)) {
+    case FaviconCache::CACHED_IMAGE:
+      return tracker->PostTask(base::MessageLoopProxy::current().get(),
+                               FROM_HERE,
+                               Bind(image_callback, image_result));
+    case FaviconCache::CACHED_RESULTS:
+      return tracker->PostTask(base::MessageLoopProxy::current().get(),
+                               FROM_HERE,
+                               Bind(callback, results));
+    default:
+      return CancelableTaskTracker::kBadTaskId;
+  }
+}
+
+FaviconService::FaviconResultsCallback FaviconService::CacheResults(
+    const FaviconCache::Key& key,
+    const FaviconResultsCallback& callback) {
+  return Bind(&FaviconService::CacheResultsAndRun, base::Unretained(this),
+              key, cache_.generation(), callback);
+}
+
+FaviconService::FaviconImageCallback FaviconService::CacheImage(
+    const FaviconCache::Key& key,
+    const FaviconImageCallback& callback) {
+  return Bind(&FaviconService::CacheImageAndRun, base::Unretained(this),
+              key, cache_.generation(), callback);
+}
+
+void FaviconService::CacheResultsAndRun(
+    const FaviconCache::Key& key,
+    uint64 generation,
+    const FaviconResultsCallback& callback,
+    const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  cache_.PutResults(key, favicon_bitmap_results, generation);
+  callback.Run(favicon_bitmap_results);
+}
+
+void FaviconService::CacheImageAndRun(
+    const FaviconCache::Key& key,
+    uint64 generation,
+    const FaviconImageCallback& callback,
+    const chrome::FaviconImageResult& image_result) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  cache_.PutImage(key, image_result, generation);
+  callback.Run(image_result);
+}
+
+void FaviconService::InvalidatePage(const GURL& page_url,
+                                    const GURL& icon_url) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  std::set<GURL> page_urls;
+  page_urls.insert(page_url);
+  std::set<GURL> icon_urls;
+  if (!icon_url.is_empty())
+    icon_urls.insert(icon_url);
+  cache_.Invalidate(page_urls, icon_urls);
+}
+
 void FaviconService::RunFaviconImageCallbackWithBitmapResults(
     const FaviconImageCallback& callback,
     int desired_size_in_dip,
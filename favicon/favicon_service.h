@@ -10,11 +10,15 @@
 #include "base/callback.h"
 #include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
+#include "base/threading/thread_checker.h"
 #include "chrome/browser/common/cancelable_request.h"
+#include "chrome/browser/favicon/favicon_cache.h"
 #include "chrome/common/cancelable_task_tracker.h"
 #include "chrome/common/favicon/favicon_types.h"
 #include "chrome/common/ref_counted_util.h"
 #include "components/browser_context_keyed_service/browser_context_keyed_service.h"
+#include "content/public/browser/notification_observer.h"
+#include "content/public/browser/notification_registrar.h"
 #include "ui/base/layout.h"
 
 class GURL;
@@ -29,10 +33,14 @@ struct FaviconImageResult;
 // The favicon service provides methods to access favicons. It calls the history
 // backend behind the scenes.
 //
-// This service is thread safe. Each request callback is invoked in the
-// thread that made the request.
+// The favicons got from history are cached in memory, keyed by the request,
+// and the cached favicons of a page are dropped when history reports that
+// they changed, along with those of the other pages sharing their icons.
+// Because of the cache this service is not thread safe; it must only be used
+// on the UI thread, where the notifications of the changes are sent.
 class FaviconService : public CancelableRequestProvider,
-                       public BrowserContextKeyedService {
+                       public BrowserContextKeyedService,
+                       public content::NotificationObserver {
  public:
   explicit FaviconService(HistoryService* history_service);
 
@@ -233,19 +241,63 @@ class FaviconService : public CancelableRequestProvider,
   bool WasUnableToDownloadFavicon(const GURL& icon_url) const;
   void ClearUnableToDownloadFavicons();
 
+  // content::NotificationObserver implementation.
+  virtual void Observe(int type,
+                       const content::NotificationSource& source,
+                       const content::NotificationDetails& details) OVERRIDE;
+
  private:
   typedef uint32 MissingFaviconURLHash;
   base::hash_set<MissingFaviconURLHash> missing_favicon_urls_;
   HistoryService* history_service_;
 
+  // The favicons recently got from |history_service_|.
+  FaviconCache cache_;
+
+  content::NotificationRegistrar registrar_;
+
+  base::ThreadChecker thread_checker_;
+
   // Helper function for GetFaviconImageForURL(), GetRawFaviconForURL() and
-  // GetFaviconForURL().
+  // GetFaviconForURL().  |image_callback| is run instead of |callback| if
+  // the image is cached; it is null for the latter two.
   CancelableTaskTracker::TaskId GetFaviconForURLImpl(
       const FaviconForURLParams& params,
       const std::vector<ui::ScaleFactor>& desired_scale_factors,
+      const FaviconImageCallback& image_callback,
+      const FaviconResultsCallback& callback,
+      CancelableTaskTracker* tracker);
+
+  // Runs |image_callback| asynchronously with the image cached for |key| if
+  // it is not null and there is one, and otherwise |callback| with the
+  // cached bitmaps.  Returns kBadTaskId if nothing is cached for |key|.
+  CancelableTaskTracker::TaskId RunWithCachedResultsAsync(
+      const FaviconCache::Key& key,
+      const FaviconImageCallback& image_callback,
       const FaviconResultsCallback& callback,
       CancelableTaskTracker* tracker);
 
+  // Return callbacks which cache what they are run with for |key| before
+  // running |callback|, unless favicons change in the meantime.
+  FaviconResultsCallback CacheResults(const FaviconCache::Key& key,
+                                      const FaviconResultsCallback& callback);
+  FaviconImageCallback CacheImage(const FaviconCache::Key& key,
+                                  const FaviconImageCallback& callback);
+  void CacheResultsAndRun(
+      const FaviconCache::Key& key,
+      uint64 generation,
+      const FaviconResultsCallback& callback,
+      const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results);
+  void CacheImageAndRun(const FaviconCache::Key& key,
+                        uint64 generation,
+                        const FaviconImageCallback& callback,
+                        const chrome::FaviconImageResult& image_result);
+
+  // Drops the cached favicons of |page_url| and of the pages sharing its
+  // icons or |icon_url|, which may be empty, before history is asked to
+  // change them.
+  void InvalidatePage(const GURL& page_url, const GURL& icon_url);
+
   // Intermediate callback for GetFaviconImage() and GetFaviconImageForURL()
   // so that history service can deal solely with FaviconResultsCallback.
   // Builds chrome::FaviconImageResult from |favicon_bitmap_results| and runs
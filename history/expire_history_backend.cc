@@ -14,6 +14,9 @@
 #include "base/files/file_enumerator.h"
 #include "base/logging.h"
 #include "base/message_loop/message_loop.h"
+#include "base/metrics/histogram.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
 #include "chrome/browser/bookmarks/bookmark_service.h"
 #include "chrome/browser/chrome_notification_types.h"
 #include "chrome/browser/history/archived_database.h"
@@ -144,6 +147,17 @@ const int kIndexExpirationDelayMin = 2;
 // the history index files.
 const int kStoreHistoryIndexesForMonths = 3;
 
+// The bounds on the number of visits one chunk of an
+// ExpireHistoryBetweenInChunks() request deletes. Chunks start at the
+// maximum.
+const int kMinVisitsPerExpirationChunk = 16;
+const int kMaxVisitsPerExpirationChunk = 1024;
+
+// How long a chunk should take, in milliseconds. The chunk size is halved
+// after a chunk which takes longer and doubled after one which takes less than
+// half as long.
+const int kExpirationChunkBudgetMs = 50;
+
 }  // namespace
 
 struct ExpireHistoryBackend::DeleteDependencies {
@@ -180,18 +194,32 @@ ExpireHistoryBackend::ExpireHistoryBackend(
       archived_db_(NULL),
       thumb_db_(NULL),
       weak_factory_(this),
+      expiration_chunk_scheduled_(false),
+      max_visits_per_chunk_(kMaxVisitsPerExpirationChunk),
       bookmark_service_(bookmark_service) {
 }
 
 ExpireHistoryBackend::~ExpireHistoryBackend() {
 }
 
+ExpireHistoryBackend::ChunkedExpiration::ChunkedExpiration()
+    : chunks(0),
+      visits_deleted(0),
+      urls_deleted(0),
+      bytes_reclaimed(0) {
+}
+
+ExpireHistoryBackend::ChunkedExpiration::~ChunkedExpiration() {
+}
+
 void ExpireHistoryBackend::SetDatabases(HistoryDatabase* main_db,
                                         ArchivedDatabase* archived_db,
                                         ThumbnailDatabase* thumb_db) {
   main_db_ = main_db;
   archived_db_ = archived_db;
   thumb_db_ = thumb_db;
+  if (!main_db_)
+    AbandonChunkedExpirations();
 }
 
 void ExpireHistoryBackend::DeleteURL(const GURL& url) {
@@ -282,8 +310,13 @@ void ExpireHistoryBackend::ExpireHistoryForTimes(
 }
 
 void ExpireHistoryBackend::ExpireVisits(const VisitVector& visits) {
+  ExpireVisitsAndCountURLs(visits);
+}
+
+size_t ExpireHistoryBackend::ExpireVisitsAndCountURLs(
+    const VisitVector& visits) {
   if (visits.empty())
-    return;
+    return 0;
 
   DeleteDependencies dependencies;
   DeleteVisitRelatedInfo(visits, &dependencies);
@@ -300,6 +333,201 @@ void ExpireHistoryBackend::ExpireVisits(const VisitVector& visits) {
 
   // Pick up any bits possibly left over.
   ParanoidExpireHistory();
+  return dependencies.deleted_urls.size();
+}
+
+void ExpireHistoryBackend::ExpireHistoryBetweenInChunks(
+    const std::set<GURL>& restrict_urls,
+    Time begin_time,
+    Time end_time,
+    const base::Closure& done) {
+  if (!main_db_) {
+    // Nothing can be deleted, but the caller must not be left waiting.
+    if (!done.is_null())
+      done.Run();
+    return;
+  }
+
+  // Visits made after the request must survive it, as they would if it were
+  // carried out at once.
+  if (end_time.is_null() || end_time.is_max())
+    end_time = Time::Now();
+
+  ChunkedExpiration expiration;
+  expiration.restrict_urls = restrict_urls;
+  expiration.begin_time = begin_time;
+  expiration.end_time = end_time;
+  expiration.done = done;
+  chunked_expirations_.push_back(expiration);
+  SavePendingExpirations();
+  ScheduleExpirationChunk(TimeDelta());
+}
+
+void ExpireHistoryBackend::ResumePendingExpirations() {
+  if (!main_db_)
+    return;
+
+  // Each line holds the begin and end times followed by any restricting URLs,
+  // separated by spaces, which URLs never contain.
+  std::vector<std::string> lines;
+  base::SplitString(main_db_->GetPendingExpirations(), '\n', &lines);
+  for (std::vector<std::string>::const_iterator line = lines.begin();
+       line != lines.end(); ++line) {
+    std::vector<std::string> fields;
+    base::SplitString(*line, ' ', &fields);
+    int64 begin_time, end_time;
+    if (fields.size() < 2 || !base::StringToInt64(fields[0], &begin_time) ||
+        !base::StringToInt64(fields[1], &end_time))
+      continue;
+    ChunkedExpiration expiration;
+    expiration.begin_time = Time::FromInternalValue(begin_time);
+    expiration.end_time = Time::FromInternalValue(end_time);
+    for (size_t i = 2; i < fields.size(); ++i)
+      expiration.restrict_urls.insert(GURL(fields[i]));
+    chunked_expirations_.push_back(expiration);
+  }
+  UMA_HISTOGRAM_COUNTS_100("History.ChunkedExpiration.Resumed",
+                           chunked_expirations_.size());
+  if (!chunked_expirations_.empty())
+    ScheduleExpirationChunk(TimeDelta());
+}
+
+void ExpireHistoryBackend::SavePendingExpirations() {
+  std::string pending_expirations;
+  for (std::deque<ChunkedExpiration>::const_iterator expiration =
+           chunked_expirations_.begin();
+       expiration != chunked_expirations_.end(); ++expiration) {
+    pending_expirations +=
+        base::Int64ToString(expiration->begin_time.ToInternalValue()) + " " +
+        base::Int64ToString(expiration->end_time.ToInternalValue());
+    for (std::set<GURL>::const_iterator url =
+             expiration->restrict_urls.begin();
+         url != expiration->restrict_urls.end(); ++url) {
+      if (url->is_valid())
+        pending_expirations += " " + url->spec();
+    }
+    pending_expirations += "\n";
+  }
+  main_db_->SetPendingExpirations(pending_expirations);
+}
+
+void ExpireHistoryBackend::ScheduleExpirationChunk(TimeDelta delay) {
+  if (expiration_chunk_scheduled_)
+    return;
+  expiration_chunk_scheduled_ = true;
+  base::MessageLoop::current()->PostDelayedTask(
+      FROM_HERE,
+      base::Bind(&ExpireHistoryBackend::DoExpirationChunk,
+                 weak_factory_.GetWeakPtr()),
+      delay);
+}
+
+void ExpireHistoryBackend::DoExpirationChunk() {
+  expiration_chunk_scheduled_ = false;
+  if (!main_db_) {
+    AbandonChunkedExpirations();
+    return;
+  }
+  if (chunked_expirations_.empty())
+    return;
+
+  ChunkedExpiration& expiration = chunked_expirations_.front();
+  base::TimeTicks start_time = base::TimeTicks::Now();
+  int64 free_space = main_db_->GetFreeSpace();
+
+  VisitVector visits;
+  bool more_to_expire = ReadChunkedExpirationVisits(
+      expiration, max_visits_per_chunk_, &visits);
+  size_t urls_deleted = ExpireVisitsAndCountURLs(visits);
+
+  expiration.chunks++;
+  expiration.visits_deleted += visits.size();
+  expiration.urls_deleted += urls_deleted;
+  expiration.bytes_reclaimed +=
+      std::max(main_db_->GetFreeSpace() - free_space, static_cast<int64>(0));
+  TimeDelta elapsed = base::TimeTicks::Now() - start_time;
+  expiration.time_spent += elapsed;
+
+  // Keep each chunk within the time budget.
+  const TimeDelta budget =
+      TimeDelta::FromMilliseconds(kExpirationChunkBudgetMs);
+  if (elapsed > budget) {
+    max_visits_per_chunk_ =
+        std::max(max_visits_per_chunk_ / 2, kMinVisitsPerExpirationChunk);
+  } else if (elapsed < budget / 2) {
+    max_visits_per_chunk_ =
+        std::min(max_visits_per_chunk_ * 2, kMaxVisitsPerExpirationChunk);
+  }
+
+  if (!more_to_expire) {
+    UMA_HISTOGRAM_COUNTS("History.ChunkedExpiration.VisitsDeleted",
+                         expiration.visits_deleted);
+    UMA_HISTOGRAM_COUNTS("History.ChunkedExpiration.URLsDeleted",
+                         expiration.urls_deleted);
+    UMA_HISTOGRAM_MEMORY_KB("History.ChunkedExpiration.KBReclaimed",
+                            expiration.bytes_reclaimed / 1024);
+    UMA_HISTOGRAM_COUNTS_10000("History.ChunkedExpiration.Chunks",
+                               expiration.chunks);
+    UMA_HISTOGRAM_LONG_TIMES("History.ChunkedExpiration.Time",
+                             expiration.time_spent);
+    base::Closure done = expiration.done;
+    chunked_expirations_.pop_front();
+    SavePendingExpirations();
+    if (!done.is_null())
+      done.Run();
+  }
+
+  // Give the history thread back for as long as the chunk took, so the
+  // requests are never using more than half of it.
+  if (!chunked_expirations_.empty())
+    ScheduleExpirationChunk(elapsed);
+}
+
+void ExpireHistoryBackend::AbandonChunkedExpirations() {
+  // The requests are still saved in the main database, and are resumed when
+  // it is next opened, but their callers are not kept waiting until then.
+  std::deque<ChunkedExpiration> abandoned;
+  abandoned.swap(chunked_expirations_);
+  for (std::deque<ChunkedExpiration>::const_iterator expiration =
+           abandoned.begin();
+       expiration != abandoned.end(); ++expiration) {
+    if (!expiration->done.is_null())
+      expiration->done.Run();
+  }
+}
+
+bool ExpireHistoryBackend::ReadChunkedExpirationVisits(
+    const ChunkedExpiration& expiration,
+    int max_visits,
+    VisitVector* visits) {
+  visits->clear();
+  if (expiration.restrict_urls.empty()) {
+    main_db_->GetAllVisitsInRange(expiration.begin_time, expiration.end_time,
+                                  max_visits, visits);
+    return static_cast<int>(visits->size()) == max_visits;
+  }
+
+  for (std::set<GURL>::const_iterator url = expiration.restrict_urls.begin();
+       url != expiration.restrict_urls.end(); ++url) {
+    URLID url_id = main_db_->GetRowForURL(*url, NULL);
+    if (!url_id)
+      continue;
+    VisitVector url_visits;
+    main_db_->GetVisitsForURL(url_id, &url_visits);
+    for (VisitVector::const_iterator visit = url_visits.begin();
+         visit != url_visits.end(); ++visit) {
+      // The same range as GetAllVisitsInRange(): the begin time is inclusive
+      // and the end time exclusive.
+      if ((!expiration.begin_time.is_null() &&
+           visit->visit_time < expiration.begin_time) ||
+          visit->visit_time >= expiration.end_time)
+        continue;
+      if (static_cast<int>(visits->size()) == max_visits)
+        return true;
+      visits->push_back(*visit);
+    }
+  }
+  return false;
 }
 
 void ExpireHistoryBackend::ArchiveHistoryBefore(Time end_time) {
@@ -434,7 +662,8 @@ void ExpireHistoryBackend::DeleteOneURL(
         thumb_db_->DeleteIconMappings(url_row.url());
       }
     }
-    // Last, delete the URL entry.
+    // Last, delete the page text and the URL entry.
+    main_db_->DeletePageText(url_row.id());
     main_db_->DeleteURLRow(url_row.id());
   }
 }
@@ -5,11 +5,13 @@
 #ifndef CHROME_BROWSER_HISTORY_EXPIRE_HISTORY_BACKEND_H_
 #define CHROME_BROWSER_HISTORY_EXPIRE_HISTORY_BACKEND_H_
 
+#include <deque>
 #include <queue>
 #include <set>
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/callback.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/weak_ptr.h"
@@ -92,6 +94,23 @@ class ExpireHistoryBackend {
   void ExpireHistoryBetween(const std::set<GURL>& restrict_urls,
                             base::Time begin_time, base::Time end_time);
 
+  // Like ExpireHistoryBetween(), but removes the visits a bounded chunk at a
+  // time, pausing between chunks so that other work on the history thread,
+  // such as queries, is never held up for long. A null or maximum |end_time|
+  // stops at the current time. The request is saved in the main database
+  // along with the deletions, so one which is interrupted by the browser
+  // exiting is finished by ResumePendingExpirations(). |done| runs once the
+  // last visit is gone, or as soon as the databases are closed if that comes
+  // first, so it always runs exactly once.
+  void ExpireHistoryBetweenInChunks(const std::set<GURL>& restrict_urls,
+                                    base::Time begin_time,
+                                    base::Time end_time,
+                                    const base::Closure& done);
+
+  // Restarts the chunked expirations which were in progress when the main
+  // database was last closed.
+  void ResumePendingExpirations();
+
   // Removes all visits to all URLs with the given times, updating the
   // URLs accordingly.  |times| must be in reverse chronological order
   // and not contain any duplicates.
@@ -119,10 +138,60 @@ class ExpireHistoryBackend {
   FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ArchiveSomeOldHistory);
   FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ExpiringVisitsReader);
   FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ArchiveSomeOldHistoryWithSource);
+  FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ExpireInChunks);
+  FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ExpireInChunksRestricted);
+  FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ExpireInChunksResumes);
+  FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ExpireInChunksDoneWhenClosed);
   friend class ::TestingProfile;
 
   struct DeleteDependencies;
 
+  // A request made through ExpireHistoryBetweenInChunks(), and what it has
+  // done so far.
+  struct ChunkedExpiration {
+    ChunkedExpiration();
+    ~ChunkedExpiration();
+
+    std::set<GURL> restrict_urls;
+    base::Time begin_time;
+    base::Time end_time;
+    base::Closure done;
+
+    // Totals for the chunks run so far.
+    int chunks;
+    int64 visits_deleted;
+    int64 urls_deleted;
+    int64 bytes_reclaimed;
+    base::TimeDelta time_spent;
+  };
+
+  // Deletes the given visits and the URLs left without any, and returns the
+  // number of URLs deleted. See ExpireVisits().
+  size_t ExpireVisitsAndCountURLs(const VisitVector& visits);
+
+  // Saves the restrictions and time ranges of |chunked_expirations_| in the
+  // main database.
+  void SavePendingExpirations();
+
+  // Schedules a call to DoExpirationChunk, after a pause as long as the last
+  // chunk took.
+  void ScheduleExpirationChunk(base::TimeDelta delay);
+
+  // Deletes up to |max_visits_per_chunk_| visits for the first of
+  // |chunked_expirations_|, finishing it if there are none left, and schedules
+  // the next chunk if there is more to do.
+  void DoExpirationChunk();
+
+  // Drops |chunked_expirations_| once the main database is closed, running
+  // their |done| callbacks.
+  void AbandonChunkedExpirations();
+
+  // Fills |visits| with up to |max_visits| of the visits |expiration| is to
+  // delete. Returns true if there may be more.
+  bool ReadChunkedExpirationVisits(const ChunkedExpiration& expiration,
+                                   int max_visits,
+                                   VisitVector* visits);
+
   // Deletes the visit-related stuff for all the visits in the given list, and
   // adds the rows for unique URLs affected to the affected_urls list in
   // the dependencies structure.
@@ -275,6 +344,17 @@ class ExpireHistoryBackend {
   // iterations.
   std::queue<const ExpiringVisitsReader*> work_queue_;
 
+  // The requests to ExpireHistoryBetweenInChunks() not yet finished, oldest
+  // first. Only the first is worked on.
+  std::deque<ChunkedExpiration> chunked_expirations_;
+
+  // Whether a call to DoExpirationChunk() is scheduled.
+  bool expiration_chunk_scheduled_;
+
+  // The most visits a chunk may delete. It is lowered when chunks take longer
+  // than the time budget and raised again when they are quick.
+  int max_visits_per_chunk_;
+
   // Readers for various types of visits.
   // TODO(dglazkov): If you are adding another one, please consider reorganizing
   // into a map.
@@ -7,14 +7,17 @@
 #include <utility>
 
 #include "base/basictypes.h"
+#include "base/bind.h"
 #include "base/compiler_specific.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/path_service.h"
+#include "base/run_loop.h"
 #include "base/stl_util.h"
 #include "base/strings/string16.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/browser/bookmarks/bookmark_utils.h"
@@ -50,6 +53,14 @@ static const base::FilePath::CharType kThumbnailFile[] =
 // to work. It also eliminates a bunch of ugly "history::".
 namespace history {
 
+namespace {
+
+void IncrementCount(int* count) {
+  ++*count;
+}
+
+}  // namespace
+
 // ExpireHistoryTest -----------------------------------------------------------
 
 class ExpireHistoryTest : public testing::Test,
@@ -718,6 +729,130 @@ TEST_F(ExpireHistoryTest, FlushRecentURLsStarred) {
   // EXPECT_TRUE(HasThumbnail(new_url_row2.id()));
 }
 
+// Expires all the example visits, one chunk at a time.
+TEST_F(ExpireHistoryTest, ExpireInChunks) {
+  URLID url_ids[3];
+  Time visit_times[4];
+  AddExampleData(url_ids, visit_times);
+
+  base::RunLoop run_loop;
+  expirer_.ExpireHistoryBetweenInChunks(
+      std::set<GURL>(), visit_times[0],
+      visit_times[3] + TimeDelta::FromSeconds(1), run_loop.QuitClosure());
+
+  // Nothing is deleted until the first chunk runs, but the request is saved.
+  VisitVector visits;
+  main_db_->GetAllVisitsInRange(Time(), Time(), 0, &visits);
+  EXPECT_EQ(4U, visits.size());
+  EXPECT_FALSE(main_db_->GetPendingExpirations().empty());
+
+  expirer_.max_visits_per_chunk_ = 1;
+  expirer_.DoExpirationChunk();
+  main_db_->GetAllVisitsInRange(Time(), Time(), 0, &visits);
+  EXPECT_EQ(3U, visits.size());
+
+  run_loop.Run();
+  main_db_->GetAllVisitsInRange(Time(), Time(), 0, &visits);
+  EXPECT_TRUE(visits.empty());
+  URLRow row;
+  for (int i = 0; i < 3; i++)
+    EXPECT_FALSE(main_db_->GetURLRow(url_ids[i], &row));
+  EXPECT_TRUE(main_db_->GetPendingExpirations().empty());
+}
+
+// Same as FlushRecentURLsUnstarredRestricted, but in chunks.
+TEST_F(ExpireHistoryTest, ExpireInChunksRestricted) {
+  URLID url_ids[3];
+  Time visit_times[4];
+  AddExampleData(url_ids, visit_times);
+
+  std::set<GURL> restrict_urls;
+  restrict_urls.insert(GURL("http://www.google.com/2"));
+  expirer_.ExpireHistoryBetweenInChunks(
+      restrict_urls, visit_times[2],
+      visit_times[3] + TimeDelta::FromSeconds(1), base::Closure());
+  while (!expirer_.chunked_expirations_.empty())
+    expirer_.DoExpirationChunk();
+
+  // Only the last visit to the middle URL is gone.
+  VisitVector visits;
+  main_db_->GetVisitsForURL(url_ids[1], &visits);
+  ASSERT_EQ(1U, visits.size());
+  EXPECT_EQ(visit_times[1], visits[0].visit_time);
+  visits.clear();
+  main_db_->GetVisitsForURL(url_ids[2], &visits);
+  EXPECT_EQ(1U, visits.size());
+  EXPECT_TRUE(main_db_->GetPendingExpirations().empty());
+}
+
+// Expirations saved by an earlier session are carried out when resumed.
+TEST_F(ExpireHistoryTest, ExpireInChunksResumes) {
+  URLID url_ids[3];
+  Time visit_times[4];
+  AddExampleData(url_ids, visit_times);
+
+  // An unrestricted request for the first two visits, then a request for the
+  // last visit to the last URL, and a line which can't be parsed.
+  const Time end_time = visit_times[3] + TimeDelta::FromSeconds(1);
+  main_db_->SetPendingExpirations(
+      base::Int64ToString(visit_times[0].ToInternalValue()) + " " +
+      base::Int64ToString(visit_times[2].ToInternalValue()) + "\n" +
+      base::Int64ToString(visit_times[3].ToInternalValue()) + " " +
+      base::Int64ToString(end_time.ToInternalValue()) +
+      " http://www.google.com/3\n" +
+      "garbage\n");
+  expirer_.ResumePendingExpirations();
+  ASSERT_EQ(2U, expirer_.chunked_expirations_.size());
+  while (!expirer_.chunked_expirations_.empty())
+    expirer_.DoExpirationChunk();
+
+  URLRow row;
+  EXPECT_FALSE(main_db_->GetURLRow(url_ids[0], &row));
+  EXPECT_TRUE(main_db_->GetURLRow(url_ids[1], &row));
+  EXPECT_FALSE(main_db_->GetURLRow(url_ids[2], &row));
+  VisitVector visits;
+  main_db_->GetAllVisitsInRange(Time(), Time(), 0, &visits);
+  ASSERT_EQ(1U, visits.size());
+  EXPECT_EQ(visit_times[2], visits[0].visit_time);
+  EXPECT_TRUE(main_db_->GetPendingExpirations().empty());
+}
+
+// Requests still pending when the databases are closed, or made after that,
+// report that they are done rather than leaving their callers waiting. Those
+// which were saved are resumed when the main database is next opened.
+TEST_F(ExpireHistoryTest, ExpireInChunksDoneWhenClosed) {
+  URLID url_ids[3];
+  Time visit_times[4];
+  AddExampleData(url_ids, visit_times);
+
+  int done_count = 0;
+  expirer_.ExpireHistoryBetweenInChunks(
+      std::set<GURL>(), visit_times[0],
+      visit_times[3] + TimeDelta::FromSeconds(1),
+      base::Bind(&IncrementCount, &done_count));
+  expirer_.SetDatabases(NULL, NULL, NULL);
+  EXPECT_EQ(1, done_count);
+  EXPECT_TRUE(expirer_.chunked_expirations_.empty());
+
+  // The chunk which was scheduled finds nothing to do.
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, done_count);
+
+  expirer_.ExpireHistoryBetweenInChunks(
+      std::set<GURL>(), visit_times[0],
+      visit_times[3] + TimeDelta::FromSeconds(1),
+      base::Bind(&IncrementCount, &done_count));
+  EXPECT_EQ(2, done_count);
+
+  VisitVector visits;
+  main_db_->GetAllVisitsInRange(Time(), Time(), 0, &visits);
+  EXPECT_EQ(4U, visits.size());
+  EXPECT_FALSE(main_db_->GetPendingExpirations().empty());
+  expirer_.SetDatabases(main_db_.get(), archived_db_.get(), thumb_db_.get());
+  expirer_.ResumePendingExpirations();
+  EXPECT_EQ(1U, expirer_.chunked_expirations_.size());
+}
+
 TEST_F(ExpireHistoryTest, ArchiveHistoryBeforeUnstarred) {
   URLID url_ids[3];
   Time visit_times[4];
@@ -15,6 +15,7 @@
 #include "base/bind.h"
 #include "base/compiler_specific.h"
 #include "base/files/file_enumerator.h"
+#include "base/i18n/case_conversion.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/scoped_vector.h"
 #include "base/message_loop/message_loop.h"
@@ -31,8 +32,11 @@
 #include "chrome/browser/history/history_db_task.h"
 #include "chrome/browser/history/history_notifications.h"
 #include "chrome/browser/history/history_publisher.h"
+#include "chrome/browser/history/history_write_batch.h"
 #include "chrome/browser/history/in_memory_history_backend.h"
+#include "chrome/browser/history/page_text_index.h"
 #include "chrome/browser/history/page_usage_data.h"
+#include "chrome/browser/history/query_parser.h"
 #include "chrome/browser/history/select_favicon_frames.h"
 #include "chrome/browser/history/top_sites.h"
 #include "chrome/browser/history/typed_url_syncable_service.h"
@@ -104,6 +108,14 @@ static const int kArchiveDaysThreshold = 90;
 static const size_t kPageVisitStatsMaxTopSites = 50;
 #endif
 
+// The bounds on the page text kept for full text search: how many characters
+// of each page's text are stored, how many pages have their text stored, and
+// how many bytes the in-memory index of the text may use. The oldest texts are
+// dropped first.
+static const size_t kMaxPageTextLength = 4096;
+static const int kMaxPageTextPages = 2000;
+static const size_t kMaxPageTextIndexBytes = 8 * 1024 * 1024;
+
 // Converts from PageUsageData to MostVisitedURL. |redirects| is a
 // list of redirects for this URL. Empty list means no redirects.
 MostVisitedURL MakeMostVisitedURL(const PageUsageData& page_data,
@@ -191,6 +203,10 @@ HistoryBackend::~HistoryBackend() {
   android_provider_backend_.reset();
 #endif
 
+  // Tell the expirer before the databases go, so that the callers of any
+  // unfinished chunked expiration hear back from it.
+  expirer_.SetDatabases(NULL, NULL, NULL);
+
   // First close the databases before optionally running the "destroy" task.
   CloseAllDatabases();
 
@@ -686,6 +702,9 @@ void HistoryBackend::InitImpl(const std::string& languages) {
   // Start expiring old stuff.
   expirer_.StartArchivingOldStuff(TimeDelta::FromDays(kArchiveDaysThreshold));
 
+  // Finish any expirations the last session was in the middle of.
+  expirer_.ResumePendingExpirations();
+
 #if defined(OS_ANDROID)
   if (thumbnail_db_) {
     android_provider_backend_.reset(new AndroidProviderBackend(
@@ -708,9 +727,13 @@ void HistoryBackend::OnMemoryPressure(
     thumbnail_db_->TrimMemory(trim_aggressively);
   if (archived_db_)
     archived_db_->TrimMemory(trim_aggressively);
+  // The page text index is loaded again by the next text query.
+  if (trim_aggressively)
+    page_text_index_.reset();
 }
 
 void HistoryBackend::CloseAllDatabases() {
+  page_text_index_.reset();
   if (db_) {
     // Commit the long-running transaction.
     db_->CommitTransaction();
@@ -939,6 +962,71 @@ void HistoryBackend::SetPageTitle(const GURL& url,
   }
 }
 
+void HistoryBackend::SetPageContents(const GURL& url,
+                                     const string16& contents) {
+  if (!db_)
+    return;
+
+  // Only pages which show up in history are searched.
+  URLRow row;
+  URLID url_id = db_->GetRowForURL(url, &row);
+  if (!url_id || row.hidden())
+    return;
+
+  string16 body = CollapseWhitespace(contents, true);
+  if (body.length() > kMaxPageTextLength)
+    body.resize(kMaxPageTextLength);
+  if (body.empty())
+    return;
+  db_->SetPageText(url_id, body, Time::Now());
+
+  // Keep the index up to date if it has been loaded. Otherwise it is loaded
+  // with the new text by the next text query.
+  if (page_text_index_) {
+    page_text_index_->AddPage(url_id, row.title(), body);
+    TrimPageTextIndex();
+  } else {
+    db_->TrimPageText(kMaxPageTextPages);
+  }
+  ScheduleCommit();
+}
+
+void HistoryBackend::ProcessWriteBatch(HistoryWriteBatch* batch) {
+  HistoryWriteBatch::Operations operations;
+  size_t num_coalesced = 0;
+  batch->TakeOperations(&operations, &num_coalesced);
+  if (!db_ || operations.empty())
+    return;
+
+  // The operations all run in the transaction kept open between commits and
+  // share the database's cached statements, so none is prepared twice.
+  base::TimeTicks start_time = base::TimeTicks::Now();
+  for (HistoryWriteBatch::Operations::const_iterator i = operations.begin();
+       i != operations.end(); ++i) {
+    switch (i->type) {
+      case HistoryWriteBatch::ADD_PAGE:
+        AddPage(i->add_page_args);
+        break;
+      case HistoryWriteBatch::SET_PAGE_TITLE:
+        SetPageTitle(i->url, i->title);
+        break;
+      case HistoryWriteBatch::SET_FAVICONS:
+        SetFavicons(i->url, i->icon_type, i->favicon_bitmap_data);
+        break;
+    }
+  }
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start_time;
+
+  UMA_HISTOGRAM_COUNTS_100("History.WriteBatchSize", operations.size());
+  UMA_HISTOGRAM_COUNTS_100("History.WriteBatchCoalesced", num_coalesced);
+  UMA_HISTOGRAM_TIMES("History.WriteBatchTime", elapsed);
+  if (elapsed > base::TimeDelta()) {
+    UMA_HISTOGRAM_COUNTS("History.WriteBatchWritesPerSecond",
+                         static_cast<int>(operations.size() /
+                                          elapsed.InSecondsF()));
+  }
+}
+
 void HistoryBackend::AddPageNoVisitForBookmark(const GURL& url,
                                                const string16& title) {
   if (!db_)
@@ -1294,10 +1382,11 @@ void HistoryBackend::QueryHistory(scoped_refptr<QueryHistoryRequest> request,
     }
   }
 
+  const base::TimeDelta query_duration = TimeTicks::Now() - beginning_time;
+  request->value.set_query_duration(query_duration);
   request->ForwardResult(request->handle(), &request->value);
 
-  UMA_HISTOGRAM_TIMES("History.QueryHistory",
-                      TimeTicks::Now() - beginning_time);
+  UMA_HISTOGRAM_TIMES("History.QueryHistory", query_duration);
 }
 
 // Basic time-based querying of history.
@@ -1364,15 +1453,24 @@ void HistoryBackend::QueryHistoryText(URLDatabase* url_db,
   URLRows text_matches;
   url_db->GetTextMatches(text_query, &text_matches);
 
+  // Only the main database has page text.
+  std::map<URLID, Snippet> snippets;
+  if (url_db == db_.get())
+    GetPageTextMatches(text_query, &text_matches, &snippets);
+
   std::vector<URLResult> matching_visits;
   VisitVector visits;    // Declare outside loop to prevent re-construction.
   for (size_t i = 0; i < text_matches.size(); i++) {
     const URLRow& text_match = text_matches[i];
+    std::map<URLID, Snippet>::const_iterator snippet =
+        snippets.find(text_match.id());
     // Get all visits for given URL match.
     visit_db->GetVisitsForURLWithOptions(text_match.id(), options, &visits);
     for (size_t j = 0; j < visits.size(); j++) {
       URLResult url_result(text_match);
       url_result.set_visit_time(visits[j].visit_time);
+      if (snippet != snippets.end())
+        url_result.snippet_ = snippet->second;
       matching_visits.push_back(url_result);
     }
   }
@@ -1392,6 +1490,128 @@ void HistoryBackend::QueryHistoryText(URLDatabase* url_db,
     result->set_reached_beginning(true);
 }
 
+void HistoryBackend::GetPageTextMatches(const string16& text_query,
+                                        URLRows* text_matches,
+                                        std::map<URLID, Snippet>* snippets) {
+  TimeTicks beginning_time = TimeTicks::Now();
+  LoadPageTextIndex();
+
+  QueryParser parser;
+  ScopedVector<QueryNode> query_nodes;
+  parser.ParseQueryNodes(text_query, &query_nodes.get());
+  std::vector<URLID> candidates;
+  page_text_index_->FindCandidates(query_nodes.get(), &candidates);
+
+  std::set<URLID> matched_url_ids;
+  for (URLRows::const_iterator i = text_matches->begin();
+       i != text_matches->end(); ++i)
+    matched_url_ids.insert(i->id());
+
+  for (std::vector<URLID>::const_iterator i = candidates.begin();
+       i != candidates.end(); ++i) {
+    URLRow row;
+    string16 body;
+    if (!db_->GetURLRow(*i, &row) || row.hidden() || !row.url().is_valid() ||
+        !db_->GetPageText(*i, &body))
+      continue;
+
+    // The index only says the page has the words; check that they are where
+    // the query needs them, such as next to each other for a phrase.
+    std::vector<QueryWord> words;
+    parser.ExtractQueryWords(base::i18n::ToLower(row.title()), &words);
+    parser.ExtractQueryWords(base::i18n::ToLower(body), &words);
+    if (!parser.DoesQueryMatch(words, query_nodes.get()))
+      continue;
+
+    Snippet::MatchPositions match_positions;
+    parser.DoesQueryMatch(body, query_nodes.get(), &match_positions);
+    std::string utf8_body =
+        ConvertToUTF8AndAdjustMatchPositions(body, &match_positions);
+    (*snippets)[*i].ComputeSnippet(match_positions, utf8_body);
+    if (matched_url_ids.insert(*i).second)
+      text_matches->push_back(row);
+  }
+
+  UMA_HISTOGRAM_TIMES("History.PageTextSearchTime",
+                      TimeTicks::Now() - beginning_time);
+}
+
+// static
+std::string HistoryBackend::ConvertToUTF8AndAdjustMatchPositions(
+    const string16& text,
+    Snippet::MatchPositions* match_positions) {
+  // The positions are sorted and don't overlap, so the text can be converted
+  // a piece at a time, noting where each match lands.
+  std::string utf8_text;
+  size_t converted = 0;
+  for (Snippet::MatchPositions::iterator i = match_positions->begin();
+       i != match_positions->end(); ++i) {
+    utf8_text += UTF16ToUTF8(text.substr(converted, i->first - converted));
+    converted = i->first;
+    i->first = utf8_text.length();
+    utf8_text += UTF16ToUTF8(text.substr(converted, i->second - converted));
+    converted = i->second;
+    i->second = utf8_text.length();
+  }
+  utf8_text += UTF16ToUTF8(text.substr(converted));
+  return utf8_text;
+}
+
+void HistoryBackend::LoadPageTextIndex() {
+  if (page_text_index_)
+    return;
+
+  TimeTicks beginning_time = TimeTicks::Now();
+  page_text_index_.reset(new PageTextIndex);
+  bool index_full = false;
+  {
+    // The texts come newest first, so reading stops as soon as the index is
+    // full; the older ones would only be trimmed.
+    PageTextDatabase::PageTextEnumerator enumerator;
+    if (db_->InitPageTextEnumerator(&enumerator)) {
+      URLID url_id;
+      string16 title;
+      string16 body;
+      while (enumerator.GetNextPageText(&url_id, &title, &body)) {
+        if (IsPageTextIndexFull()) {
+          index_full = true;
+          break;
+        }
+        page_text_index_->AddOlderPage(url_id, title, body);
+      }
+    }
+  }
+  page_text_index_->FinishAddingOlderPages();
+  // Delete the texts which were not read, as TrimPageTextIndex() would have.
+  if (index_full)
+    db_->TrimPageText(static_cast<int>(page_text_index_->page_count()));
+  TrimPageTextIndex();
+
+  UMA_HISTOGRAM_TIMES("History.PageTextIndex.LoadTime",
+                      TimeTicks::Now() - beginning_time);
+  UMA_HISTOGRAM_COUNTS_10000("History.PageTextIndex.Pages",
+                             page_text_index_->page_count());
+  UMA_HISTOGRAM_MEMORY_KB("History.PageTextIndex.MemoryKB",
+                          page_text_index_->EstimateMemoryUsage() / 1024);
+}
+
+bool HistoryBackend::IsPageTextIndexFull() const {
+  return page_text_index_->page_count() >=
+             static_cast<size_t>(kMaxPageTextPages) ||
+         page_text_index_->EstimateMemoryUsage() >= kMaxPageTextIndexBytes;
+}
+
+void HistoryBackend::TrimPageTextIndex() {
+  while (page_text_index_->page_count() > 0 &&
+         (page_text_index_->page_count() >
+              static_cast<size_t>(kMaxPageTextPages) ||
+          page_text_index_->EstimateMemoryUsage() > kMaxPageTextIndexBytes)) {
+    URLID oldest = page_text_index_->GetOldestPage();
+    page_text_index_->RemovePage(oldest);
+    db_->DeletePageText(oldest);
+  }
+}
+
 // Frontend to GetMostRecentRedirectsFrom from the history thread.
 void HistoryBackend::QueryRedirectsFrom(
     scoped_refptr<QueryRedirectsRequest> request,
@@ -2502,6 +2722,7 @@ void HistoryBackend::Commit() {
   // some cases) but it hasn't been important yet.
   CancelScheduledCommit();
 
+  base::TimeTicks start_time = base::TimeTicks::Now();
   db_->CommitTransaction();
   DCHECK(db_->transaction_nesting() == 0) << "Somebody left a transaction open";
   db_->BeginTransaction();
@@ -2517,6 +2738,8 @@ void HistoryBackend::Commit() {
     archived_db_->CommitTransaction();
     archived_db_->BeginTransaction();
   }
+  UMA_HISTOGRAM_TIMES("History.CommitTime",
+                      base::TimeTicks::Now() - start_time);
 }
 
 void HistoryBackend::ScheduleCommit() {
@@ -2624,6 +2847,34 @@ void HistoryBackend::ExpireHistoryBetween(
     db_->GetStartDate(&first_recorded_time_);
 }
 
+void HistoryBackend::ExpireHistoryBetweenInChunks(
+    const std::set<GURL>& restrict_urls,
+    Time begin_time,
+    Time end_time,
+    const base::Closure& reply) {
+  if (!db_ || (begin_time.is_null() &&
+               (end_time.is_null() || end_time.is_max()) &&
+               restrict_urls.empty())) {
+    // Deleting all history is already fast, and there is nothing to chunk.
+    ExpireHistoryBetween(restrict_urls, begin_time, end_time);
+    reply.Run();
+    return;
+  }
+  expirer_.ExpireHistoryBetweenInChunks(
+      restrict_urls, begin_time, end_time,
+      base::Bind(&HistoryBackend::OnChunkedExpirationDone,
+                 base::Unretained(this), reply));
+}
+
+void HistoryBackend::OnChunkedExpirationDone(const base::Closure& reply) {
+  // Force a commit, if the user is deleting something for privacy reasons,
+  // we want to get it on disk ASAP.
+  Commit();
+  if (db_)
+    db_->GetStartDate(&first_recorded_time_);
+  reply.Run();
+}
+
 void HistoryBackend::ExpireHistoryForTimes(
     const std::set<base::Time>& times,
     base::Time begin_time, base::Time end_time) {
@@ -2734,6 +2985,11 @@ void HistoryBackend::KillHistoryDatabase() {
   if (!db_)
     return;
 
+  // The expirer keeps tabs on the active databases. Tell it about the
+  // databases which will be closed. This is done first since it finishes any
+  // chunked expiration, which commits.
+  expirer_.SetDatabases(NULL, NULL, NULL);
+
   // Rollback transaction because Raze() cannot be called from within a
   // transaction.
   db_->RollbackTransaction();
@@ -2745,10 +3001,6 @@ void HistoryBackend::KillHistoryDatabase() {
   android_provider_backend_.reset();
 #endif
 
-  // The expirer keeps tabs on the active databases. Tell it about the
-  // databases which will be closed.
-  expirer_.SetDatabases(NULL, NULL, NULL);
-
   // Reopen a new transaction for |db_| for the sake of CloseAllDatabases().
   db_->BeginTransaction();
   CloseAllDatabases();
@@ -2774,6 +3026,20 @@ void HistoryBackend::ProcessDBTask(
 void HistoryBackend::BroadcastNotifications(
     int type,
     HistoryDetails* details_deleted) {
+  // Deleted pages are no longer searchable. The expirer has already deleted
+  // their text.
+  if (page_text_index_ && type == chrome::NOTIFICATION_HISTORY_URLS_DELETED) {
+    URLsDeletedDetails* deleted_details =
+        static_cast<URLsDeletedDetails*>(details_deleted);
+    if (deleted_details->all_history) {
+      page_text_index_->Clear();
+    } else {
+      for (URLRows::const_iterator i = deleted_details->rows.begin();
+           i != deleted_details->rows.end(); ++i)
+        page_text_index_->RemovePage(i->id());
+    }
+  }
+
   // |delegate_| may be NULL if |this| is in the process of closing (closed by
   // HistoryService -> HistoryBackend::Closing().
   if (delegate_)
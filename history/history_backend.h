@@ -5,6 +5,7 @@
 #ifndef CHROME_BROWSER_HISTORY_HISTORY_BACKEND_H_
 #define CHROME_BROWSER_HISTORY_HISTORY_BACKEND_H_
 
+#include <map>
 #include <set>
 #include <string>
 #include <utility>
@@ -20,6 +21,7 @@
 #include "chrome/browser/history/history_database.h"
 #include "chrome/browser/history/history_marshaling.h"
 #include "chrome/browser/history/history_types.h"
+#include "chrome/browser/history/snippet.h"
 #include "chrome/browser/history/thumbnail_database.h"
 #include "chrome/browser/history/visit_tracker.h"
 #include "chrome/browser/search_engines/template_url_id.h"
@@ -38,6 +40,8 @@ class AndroidProviderBackend;
 
 class CommitLaterTask;
 class HistoryPublisher;
+class HistoryWriteBatch;
+class PageTextIndex;
 class VisitFilter;
 struct DownloadRow;
 
@@ -148,8 +152,13 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
   // |request.time| must be unique with high probability.
   void AddPage(const HistoryAddPageArgs& request);
   virtual void SetPageTitle(const GURL& url, const string16& title);
+  void SetPageContents(const GURL& url, const string16& contents);
   void AddPageNoVisitForBookmark(const GURL& url, const string16& title);
 
+  // Runs the page visits, title updates and favicon changes of |batch| in the
+  // order they were made. See HistoryWriteBatch.
+  void ProcessWriteBatch(HistoryWriteBatch* batch);
+
   // Updates the database backend with a page's ending time stamp information.
   // The page can be identified by the combination of the pointer to
   // a RenderProcessHost, the page id and the url.
@@ -441,6 +450,15 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
       base::Time begin_time,
       base::Time end_time);
 
+  // Like ExpireHistoryBetween(), but has the expirer delete the visits a
+  // chunk at a time, letting other history tasks run in between. |reply| is
+  // run on the history thread once the expiration has been committed.
+  void ExpireHistoryBetweenInChunks(
+      const std::set<GURL>& restrict_urls,
+      base::Time begin_time,
+      base::Time end_time,
+      const base::Closure& reply);
+
   // Finds the URLs visited at |times| and expires all their visits within
   // [|begin_time|, |end_time|). All times in |times| should be in
   // [|begin_time|, |end_time|). This is used when expiration request is from
@@ -654,6 +672,31 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
                         const QueryOptions& options,
                         QueryResults* result);
 
+  // Appends to |text_matches| the pages whose text matches |text_query| which
+  // it does not already have, and puts a snippet of the text of each matching
+  // page in |snippets|.
+  void GetPageTextMatches(const string16& text_query,
+                          URLRows* text_matches,
+                          std::map<URLID, Snippet>* snippets);
+
+  // Converts |text| to UTF-8, adjusting |match_positions| from offsets into
+  // |text| to byte offsets into the result, as Snippet expects.
+  static std::string ConvertToUTF8AndAdjustMatchPositions(
+      const string16& text,
+      Snippet::MatchPositions* match_positions);
+
+  // Builds |page_text_index_| from the stored page text, unless it is built.
+  // Only as many of the newest texts as fit within the index's bounds are
+  // read; the rest are deleted.
+  void LoadPageTextIndex();
+
+  // Returns whether |page_text_index_| has reached one of its bounds.
+  bool IsPageTextIndexFull() const;
+
+  // Drops the oldest pages from |page_text_index_| and the database until the
+  // index is within its bounds.
+  void TrimPageTextIndex();
+
   // Committing ----------------------------------------------------------------
 
   // We always keep a transaction open on the history database so that multiple
@@ -673,6 +716,10 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
   // does nothing.
   void CancelScheduledCommit();
 
+  // Commits the deletions of an ExpireHistoryBetweenInChunks() request once
+  // the expirer is done with it, then runs |reply|.
+  void OnChunkedExpirationDone(const base::Closure& reply);
+
   // Segments ------------------------------------------------------------------
 
   // Walks back a segment chain to find the last visit with a non null segment
@@ -869,6 +916,10 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
   // Stores old history in a larger, slower database.
   scoped_ptr<ArchivedDatabase> archived_db_;
 
+  // Indexes the stored page text for full text search. Loaded by the first
+  // text query, and NULL until then.
+  scoped_ptr<PageTextIndex> page_text_index_;
+
   // Manages expiration between the various databases.
   ExpireHistoryBackend expirer_;
 
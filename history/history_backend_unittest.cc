@@ -29,6 +29,7 @@
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/history/in_memory_database.h"
 #include "chrome/browser/history/in_memory_history_backend.h"
+#include "chrome/browser/history/url_trigram_index.h"
 #include "chrome/browser/history/visit_filter.h"
 #include "chrome/common/chrome_constants.h"
 #include "chrome/common/chrome_paths.h"
@@ -651,6 +652,62 @@ TEST_F(HistoryBackendTest, DeleteAllThenAddData) {
   ASSERT_EQ(0U, all_visits.size());
 }
 
+// Checks that the in-memory trigram index holds untyped as well as typed URLs
+// and follows the modification and deletion notifications.
+TEST_F(HistoryBackendTest, TrigramIndexFollowsHistory) {
+  ASSERT_TRUE(mem_backend_.get());
+  const URLTrigramIndex* index = mem_backend_->trigram_index();
+  ASSERT_TRUE(index);
+  EXPECT_EQ(0U, index->size());
+
+  URLRow row(GURL("http://news.google.com/world"), 7);
+  row.set_title(UTF8ToUTF16("World News"));
+  row.set_visit_count(1);
+  URLsModifiedDetails* modified = new URLsModifiedDetails;
+  modified->changed_urls.push_back(row);
+  BroadcastNotifications(chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+                         modified);
+
+  // The untyped URL is not in the in-memory database, but is in the index.
+  EXPECT_FALSE(mem_backend_->db_->GetRowForURL(row.url(), NULL));
+  URLRows results;
+  EXPECT_TRUE(index->AutocompleteForPrefix("http://news.g", 10, false,
+                                           &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(7, results[0].id());
+  EXPECT_FALSE(index->AutocompleteForPrefix("http://news.g", 10, true,
+                                            &results));
+
+  // A new title replaces the old one.
+  row.set_title(UTF8ToUTF16("Local Weather"));
+  modified = new URLsModifiedDetails;
+  modified->changed_urls.push_back(row);
+  BroadcastNotifications(chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+                         modified);
+  EXPECT_TRUE(index->AutocompleteForPrefix("http://news.g", 10, false,
+                                           &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(UTF8ToUTF16("Local Weather"), results[0].title());
+  EXPECT_EQ(1U, index->size());
+
+  URLsDeletedDetails* deleted = new URLsDeletedDetails;
+  deleted->rows.push_back(row);
+  BroadcastNotifications(chrome::NOTIFICATION_HISTORY_URLS_DELETED, deleted);
+  EXPECT_EQ(0U, index->size());
+  EXPECT_FALSE(index->AutocompleteForPrefix("http://news.g", 10, false,
+                                            &results));
+
+  modified = new URLsModifiedDetails;
+  modified->changed_urls.push_back(row);
+  BroadcastNotifications(chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+                         modified);
+  EXPECT_EQ(1U, index->size());
+  deleted = new URLsDeletedDetails;
+  deleted->all_history = true;
+  BroadcastNotifications(chrome::NOTIFICATION_HISTORY_URLS_DELETED, deleted);
+  EXPECT_EQ(0U, index->size());
+}
+
 TEST_F(HistoryBackendTest, URLsNoLongerBookmarked) {
   GURL favicon_url1("http://www.google.com/favicon.ico");
   GURL favicon_url2("http://news.google.com/favicon.ico");
@@ -31,6 +31,9 @@ const int kCurrentVersionNumber = 28;
 const int kCompatibleVersionNumber = 16;
 const char kEarlyExpirationThresholdKey[] = "early_expiration_threshold";
 
+// Key in the meta table holding the chunked expirations still in progress.
+const char kPendingExpirationsKey[] = "pending_expirations";
+
 // Key in the meta table used to determine if we need to migrate thumbnails out
 // of history.
 const char kNeedsThumbnailMigrationKey[] = "needs_thumbnail_migration";
@@ -90,7 +93,7 @@ sql::InitStatus HistoryDatabase::Init(const base::FilePath& history_name) {
     return sql::INIT_FAILURE;
   if (!CreateURLTable(false) || !InitVisitTable() ||
       !InitKeywordSearchTermsTable() || !InitDownloadTable() ||
-      !InitSegmentTables())
+      !InitSegmentTables() || !InitPageTextTable())
     return sql::INIT_FAILURE;
   CreateMainURLIndex();
   CreateKeywordSearchTermsIndices();
@@ -224,6 +227,11 @@ bool HistoryDatabase::RecreateAllTablesButURL() {
   if (!InitSegmentTables())
     return false;
 
+  if (!DropPageTextTable())
+    return false;
+  if (!InitPageTextTable())
+    return false;
+
   // We also add the supplementary URL indices at this point. This index is
   // over parts of the URL table that weren't automatically created when the
   // temporary URL table was
@@ -300,6 +308,28 @@ void HistoryDatabase::UpdateEarlyExpirationThreshold(base::Time threshold) {
   cached_early_expiration_threshold_ = threshold;
 }
 
+std::string HistoryDatabase::GetPendingExpirations() {
+  std::string pending_expirations;
+  meta_table_.GetValue(kPendingExpirationsKey, &pending_expirations);
+  return pending_expirations;
+}
+
+void HistoryDatabase::SetPendingExpirations(
+    const std::string& pending_expirations) {
+  if (pending_expirations.empty())
+    meta_table_.DeleteKey(kPendingExpirationsKey);
+  else
+    meta_table_.SetValue(kPendingExpirationsKey, pending_expirations);
+}
+
+int64 HistoryDatabase::GetFreeSpace() {
+  sql::Statement page_size(db_.GetUniqueStatement("PRAGMA page_size"));
+  sql::Statement free_pages(db_.GetUniqueStatement("PRAGMA freelist_count"));
+  if (!page_size.Step() || !free_pages.Step())
+    return 0;
+  return page_size.ColumnInt64(0) * free_pages.ColumnInt64(0);
+}
+
 sql::Connection& HistoryDatabase::GetDB() {
   return db_;
 }
@@ -11,6 +11,7 @@
 #include "build/build_config.h"
 #include "chrome/browser/history/download_database.h"
 #include "chrome/browser/history/history_types.h"
+#include "chrome/browser/history/page_text_database.h"
 #include "chrome/browser/history/url_database.h"
 #include "chrome/browser/history/visit_database.h"
 #include "chrome/browser/history/visitsegment_database.h"
@@ -43,6 +44,7 @@ class HistoryDatabase : public DownloadDatabase,
                         public AndroidURLsDatabase,
                         public AndroidCacheDatabase,
 #endif
+                        public PageTextDatabase,
                         public URLDatabase,
                         public VisitDatabase,
                         public VisitSegmentDatabase {
@@ -170,6 +172,16 @@ class HistoryDatabase : public DownloadDatabase,
   virtual base::Time GetEarlyExpirationThreshold();
   virtual void UpdateEarlyExpirationThreshold(base::Time threshold);
 
+  // Retrieves/Updates the serialized list of expirations which
+  // ExpireHistoryBackend has started but not yet finished. Setting an empty
+  // list removes it.
+  std::string GetPendingExpirations();
+  void SetPendingExpirations(const std::string& pending_expirations);
+
+  // Returns the number of bytes in the database's free pages, which deleted
+  // rows leave behind until the database is vacuumed.
+  int64 GetFreeSpace();
+
  private:
 #if defined(OS_ANDROID)
   // AndroidProviderBackend uses the |db_|.
@@ -358,6 +358,31 @@ TEST_F(HistoryQueryTest, TextSearchPrefix) {
   EXPECT_TRUE(NthResultIs(results, 1, 3));
 }
 
+// Tests that text queries match the page text passed to SetPageContents.
+TEST_F(HistoryQueryTest, TextSearchPageContents) {
+  ASSERT_TRUE(history_.get());
+
+  history_->SetPageContents(GURL(test_entries[6].url),
+                            UTF8ToUTF16("Welcome to the xylophone museum"));
+
+  QueryOptions options;
+  QueryResults results;
+  QueryHistory("xylophone", options, &results);
+  ASSERT_EQ(1U, results.size());
+  EXPECT_TRUE(NthResultIs(results, 0, 6));
+  EXPECT_FALSE(results[0].snippet().text().empty());
+
+  // Prefixes, phrases, and words from both the title and the text.
+  QueryHistory("xylo", options, &results);
+  EXPECT_EQ(1U, results.size());
+  QueryHistory("\"xylophone museum\"", options, &results);
+  EXPECT_EQ(1U, results.size());
+  QueryHistory("four museum", options, &results);
+  EXPECT_EQ(1U, results.size());
+  QueryHistory("\"museum xylophone\"", options, &results);
+  EXPECT_EQ(0U, results.size());
+}
+
 // Tests max_count feature for text search queries.
 TEST_F(HistoryQueryTest, TextSearchCount) {
   ASSERT_TRUE(history_.get());
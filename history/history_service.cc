@@ -108,6 +108,22 @@ class URLIteratorFromURLRows
   DISALLOW_COPY_AND_ASSIGN(URLIteratorFromURLRows);
 };
 
+// Runs |callback| unless the request it answers was canceled.
+void RunIfNotCanceled(
+    const CancelableTaskTracker::IsCanceledCallback& is_canceled,
+    const base::Closure& callback) {
+  if (is_canceled.Run() || callback.is_null())
+    return;
+  callback.Run();
+}
+
+// Posts |callback| to |task_runner|. Used to reply to the main thread from
+// history thread work which finishes after the task that started it.
+void PostCallback(const scoped_refptr<base::SingleThreadTaskRunner>& runner,
+                  const base::Closure& callback) {
+  runner->PostTask(FROM_HERE, callback);
+}
+
 // Callback from WebHistoryService::ExpireWebHistory().
 void ExpireWebHistoryComplete(
     history::WebHistoryService::Request* request,
@@ -326,6 +342,14 @@ history::URLDatabase* HistoryService::InMemoryDatabase() {
   return NULL;
 }
 
+const history::URLTrigramIndex* HistoryService::InMemoryTrigramIndex() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  LoadBackendIfNecessary();
+  if (in_memory_backend_)
+    return in_memory_backend_->trigram_index();
+  return NULL;
+}
+
 bool HistoryService::GetTypedCountForURL(const GURL& url, int* typed_count) {
   DCHECK(thread_checker_.CalledOnValidThread());
   history::URLRow url_row;
@@ -453,6 +477,7 @@ HistoryService::Handle HistoryService::QuerySegmentDurationSince(
 }
 
 void HistoryService::FlushForTest(const base::Closure& flushed) {
+  SealWriteBatch();
   thread_->message_loop_proxy()->PostTaskAndReply(
       FROM_HERE, base::Bind(&base::DoNothing), flushed);
 }
@@ -517,7 +542,7 @@ void HistoryService::AddPage(const history::HistoryAddPageArgs& add_page_args) {
     }
   }
 
-  ScheduleAndForget(PRIORITY_NORMAL, &HistoryBackend::AddPage, add_page_args);
+  ScheduleWrite(history::HistoryWriteBatch::Operation::AddPage(add_page_args));
 }
 
 void HistoryService::AddPageNoVisitForBookmark(const GURL& url,
@@ -533,7 +558,18 @@ void HistoryService::AddPageNoVisitForBookmark(const GURL& url,
 void HistoryService::SetPageTitle(const GURL& url,
                                   const string16& title) {
   DCHECK(thread_checker_.CalledOnValidThread());
-  ScheduleAndForget(PRIORITY_NORMAL, &HistoryBackend::SetPageTitle, url, title);
+  ScheduleWrite(
+      history::HistoryWriteBatch::Operation::SetPageTitle(url, title));
+}
+
+void HistoryService::SetPageContents(const GURL& url,
+                                     const string16& contents) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (!CanAddURL(url))
+    return;
+
+  ScheduleAndForget(PRIORITY_LOW, &HistoryBackend::SetPageContents,
+                    url, contents);
 }
 
 void HistoryService::UpdateWithPageEndTime(const void* host,
@@ -614,6 +650,7 @@ CancelableTaskTracker::TaskId HistoryService::GetFavicons(
 
   std::vector<chrome::FaviconBitmapResult>* results =
       new std::vector<chrome::FaviconBitmapResult>();
+  SealWriteBatch();
   return tracker->PostTaskAndReply(
       thread_->message_loop_proxy().get(),
       FROM_HERE,
@@ -639,6 +676,7 @@ CancelableTaskTracker::TaskId HistoryService::GetFaviconsForURL(
 
   std::vector<chrome::FaviconBitmapResult>* results =
       new std::vector<chrome::FaviconBitmapResult>();
+  SealWriteBatch();
   return tracker->PostTaskAndReply(
       thread_->message_loop_proxy().get(),
       FROM_HERE,
@@ -663,6 +701,7 @@ CancelableTaskTracker::TaskId HistoryService::GetFaviconForID(
 
   std::vector<chrome::FaviconBitmapResult>* results =
       new std::vector<chrome::FaviconBitmapResult>();
+  SealWriteBatch();
   return tracker->PostTaskAndReply(
       thread_->message_loop_proxy().get(),
       FROM_HERE,
@@ -688,6 +727,7 @@ CancelableTaskTracker::TaskId HistoryService::UpdateFaviconMappingsAndFetch(
 
   std::vector<chrome::FaviconBitmapResult>* results =
       new std::vector<chrome::FaviconBitmapResult>();
+  SealWriteBatch();
   return tracker->PostTaskAndReply(
       thread_->message_loop_proxy().get(),
       FROM_HERE,
@@ -724,8 +764,8 @@ void HistoryService::SetFavicons(
   if (!CanAddURL(page_url))
     return;
 
-  ScheduleAndForget(PRIORITY_NORMAL, &HistoryBackend::SetFavicons, page_url,
-      icon_type, favicon_bitmap_data);
+  ScheduleWrite(history::HistoryWriteBatch::Operation::SetFavicons(
+      page_url, icon_type, favicon_bitmap_data));
 }
 
 void HistoryService::SetFaviconsOutOfDateForPage(const GURL& page_url) {
@@ -769,6 +809,7 @@ void HistoryService::CreateDownload(
   DCHECK(thread_checker_.CalledOnValidThread());
   LoadBackendIfNecessary();
   bool* success = new bool(false);
+  SealWriteBatch();
   thread_->message_loop_proxy()->PostTaskAndReply(
       FROM_HERE,
       base::Bind(&HistoryBackend::CreateDownload,
@@ -784,6 +825,7 @@ void HistoryService::GetNextDownloadId(
   DCHECK(thread_checker_.CalledOnValidThread());
   LoadBackendIfNecessary();
   uint32* next_id = new uint32(content::DownloadItem::kInvalidId);
+  SealWriteBatch();
   thread_->message_loop_proxy()->PostTaskAndReply(
       FROM_HERE,
       base::Bind(&HistoryBackend::GetNextDownloadId,
@@ -806,6 +848,7 @@ void HistoryService::QueryDownloads(
   // base::Passed(&scoped_rows) nullifies |scoped_rows|, and compilers do not
   // guarantee that the first Bind's arguments are evaluated before the second
   // Bind's arguments.
+  SealWriteBatch();
   thread_->message_loop_proxy()->PostTaskAndReply(
       FROM_HERE,
       base::Bind(&HistoryBackend::QueryDownloads, history_backend_.get(), rows),
@@ -990,10 +1033,37 @@ void HistoryService::ScheduleTask(SchedulePriority priority,
   DCHECK(thread_checker_.CalledOnValidThread());
   CHECK(thread_);
   CHECK(thread_->message_loop());
+  SealWriteBatch();
   // TODO(brettw): Do prioritization.
   thread_->message_loop()->PostTask(FROM_HERE, task);
 }
 
+void HistoryService::ScheduleWrite(
+    const history::HistoryWriteBatch::Operation& operation) {
+  DCHECK(thread_) << "History service being called after cleanup";
+  DCHECK(thread_checker_.CalledOnValidThread());
+  LoadBackendIfNecessary();
+  if (pending_write_batch_.get() && pending_write_batch_->Append(operation))
+    return;
+
+  scoped_refptr<history::HistoryWriteBatch> batch(
+      new history::HistoryWriteBatch);
+  ScheduleTask(PRIORITY_NORMAL,
+               base::Bind(&HistoryBackend::ProcessWriteBatch,
+                          history_backend_.get(), batch));
+  bool appended = batch->Append(operation);
+  DCHECK(appended);
+  pending_write_batch_ = batch;
+}
+
+void HistoryService::SealWriteBatch() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (pending_write_batch_.get()) {
+    pending_write_batch_->Seal();
+    pending_write_batch_ = NULL;
+  }
+}
+
 // static
 bool HistoryService::CanAddURL(const GURL& url) {
   if (!url.is_valid())
@@ -1111,14 +1181,15 @@ void HistoryService::ExpireHistoryBetween(
   DCHECK(thread_);
   DCHECK(thread_checker_.CalledOnValidThread());
   DCHECK(history_backend_.get());
-  tracker->PostTaskAndReply(thread_->message_loop_proxy().get(),
-                            FROM_HERE,
-                            base::Bind(&HistoryBackend::ExpireHistoryBetween,
-                                       history_backend_,
-                                       restrict_urls,
-                                       begin_time,
-                                       end_time),
-                            callback);
+  CancelableTaskTracker::IsCanceledCallback is_canceled;
+  tracker->NewTrackedTaskId(&is_canceled);
+  base::Closure reply =
+      base::Bind(&PostCallback, base::ThreadTaskRunnerHandle::Get(),
+                 base::Bind(&RunIfNotCanceled, is_canceled, callback));
+  ScheduleTask(PRIORITY_UI,
+               base::Bind(&HistoryBackend::ExpireHistoryBetweenInChunks,
+                          history_backend_, restrict_urls, begin_time,
+                          end_time, reply));
 }
 
 void HistoryService::ExpireHistory(
@@ -1128,6 +1199,7 @@ void HistoryService::ExpireHistory(
   DCHECK(thread_);
   DCHECK(thread_checker_.CalledOnValidThread());
   DCHECK(history_backend_.get());
+  SealWriteBatch();
   tracker->PostTaskAndReply(
       thread_->message_loop_proxy().get(),
       FROM_HERE,
@@ -24,6 +24,7 @@
 #include "chrome/browser/favicon/favicon_service.h"
 #include "chrome/browser/history/delete_directive_handler.h"
 #include "chrome/browser/history/history_types.h"
+#include "chrome/browser/history/history_write_batch.h"
 #include "chrome/browser/history/typed_url_syncable_service.h"
 #include "chrome/browser/search_engines/template_url_id.h"
 #include "chrome/common/cancelable_task_tracker.h"
@@ -69,6 +70,7 @@ class InMemoryHistoryBackend;
 class InMemoryURLIndex;
 class InMemoryURLIndexTest;
 class URLDatabase;
+class URLTrigramIndex;
 class VisitDatabaseObserver;
 class VisitFilter;
 struct DownloadRow;
@@ -146,6 +148,10 @@ class HistoryService : public CancelableRequestProvider,
   // TODO(brettw) this should return the InMemoryHistoryBackend.
   history::URLDatabase* InMemoryDatabase();
 
+  // Like InMemoryDatabase(), returns the in-memory index of every URL in
+  // history, or NULL if it is not loaded yet. The same caveats apply.
+  const history::URLTrigramIndex* InMemoryTrigramIndex();
+
   // Following functions get URL information from in-memory database.
   // They return false if database is not available (e.g. not loaded yet) or the
   // URL does not exist.
@@ -225,6 +231,12 @@ class HistoryService : public CancelableRequestProvider,
   // title in the full text index.
   void SetPageTitle(const GURL& url, const string16& title);
 
+  // Stores the text extracted from the given page for full text search, along
+  // with its current title, replacing any text stored for it before. The page
+  // should be in history. If it is not, this operation is ignored. Only the
+  // beginning of the text of the most recently loaded pages is kept.
+  void SetPageContents(const GURL& url, const string16& contents);
+
   // Updates the history database with a page's ending time stamp information.
   // The page can be identified by the combination of the pointer to
   // a RenderProcessHost, the page id and the url.
@@ -271,8 +283,8 @@ class HistoryService : public CancelableRequestProvider,
   // the given |text_query|. If empty, all results matching the given options
   // will be returned.
   //
-  // This isn't totally hooked up yet, this will query the "new" full text
-  // database (see SetPageContents) which won't generally be set yet.
+  // Text queries match the URL and title of each page, as well as the text
+  // stored for it by SetPageContents.
   Handle QueryHistory(const string16& text_query,
                       const history::QueryOptions& options,
                       CancelableRequestConsumerBase* consumer,
@@ -400,6 +412,9 @@ class HistoryService : public CancelableRequestProvider,
   // either direction.
   // If |restrict_urls| is not empty, only visits to the URLs in this set are
   // removed.
+  // Unless all history is being deleted, the visits are removed a chunk at a
+  // time so that queries keep being answered in the meantime, and the
+  // expiration carries on after a restart if the browser exits first.
   void ExpireHistoryBetween(const std::set<GURL>& restrict_urls,
                             base::Time begin_time,
                             base::Time end_time,
@@ -631,6 +646,7 @@ class HistoryService : public CancelableRequestProvider,
 #if defined(OS_ANDROID)
   friend class AndroidHistoryProviderService;
 #endif
+  friend class AutocompleteControllerPerfTest;
   friend class base::RefCountedThreadSafe<HistoryService>;
   friend class BackendDelegate;
   friend class FaviconService;
@@ -836,6 +852,15 @@ class HistoryService : public CancelableRequestProvider,
   // specified priority. The task will have ownership taken.
   void ScheduleTask(SchedulePriority priority, const base::Closure& task);
 
+  // Adds |operation| to |pending_write_batch_|, first scheduling a new batch
+  // if there is none or the history thread has already taken it.
+  void ScheduleWrite(const history::HistoryWriteBatch::Operation& operation);
+
+  // Stops any more writes joining |pending_write_batch_|. This must be called
+  // before any task other than a write batch is posted to the history thread,
+  // so that the batched writes run before it.
+  void SealWriteBatch();
+
   // Schedule ------------------------------------------------------------------
   //
   // Functions for scheduling operations on the history thread that have a
@@ -1052,6 +1077,10 @@ class HistoryService : public CancelableRequestProvider,
   // more calls should be made to the history thread.
   scoped_refptr<history::HistoryBackend> history_backend_;
 
+  // The batch which page visits, title updates and favicon changes are added
+  // to until another task is scheduled. NULL if there is none.
+  scoped_refptr<history::HistoryWriteBatch> pending_write_batch_;
+
   // A cache of the user-typed URLs kept in memory that is used by the
   // autocomplete system. This will be NULL until the database has been created
   // on the background thread.
@@ -6,6 +6,7 @@
 
 #include <utility>
 
+#include "chrome/browser/chrome_notification_types.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/prerender/prerender_contents.h"
@@ -13,6 +14,7 @@
 #include "chrome/browser/prerender/prerender_manager_factory.h"
 #include "chrome/browser/profiles/profile.h"
 #include "chrome/common/render_messages.h"
+#include "chrome/common/translate/language_detection_details.h"
 #include "content/public/browser/navigation_details.h"
 #include "content/public/browser/navigation_entry.h"
 #include "content/public/browser/notification_details.h"
@@ -37,6 +39,8 @@ HistoryTabHelper::HistoryTabHelper(WebContents* web_contents)
       received_page_title_(false) {
   registrar_.Add(this, content::NOTIFICATION_WEB_CONTENTS_TITLE_UPDATED,
                  content::Source<WebContents>(web_contents));
+  registrar_.Add(this, chrome::NOTIFICATION_TAB_LANGUAGE_DETERMINED,
+                 content::Source<WebContents>(web_contents));
 }
 
 HistoryTabHelper::~HistoryTabHelper() {
@@ -130,6 +134,13 @@ void HistoryTabHelper::DidNavigateAnyFrame(
 void HistoryTabHelper::Observe(int type,
                                const content::NotificationSource& source,
                                const content::NotificationDetails& details) {
+  if (type == chrome::NOTIFICATION_TAB_LANGUAGE_DETERMINED) {
+    const LanguageDetectionDetails* language_details =
+        content::Details<const LanguageDetectionDetails>(details).ptr();
+    OnPageContents(language_details->url, language_details->contents);
+    return;
+  }
+
   DCHECK(type == content::NOTIFICATION_WEB_CONTENTS_TITLE_UPDATED);
   std::pair<content::NavigationEntry*, bool>* title =
       content::Details<std::pair<content::NavigationEntry*, bool> >(
@@ -144,6 +155,16 @@ void HistoryTabHelper::Observe(int type,
   }
 }
 
+void HistoryTabHelper::OnPageContents(const GURL& url,
+                                      const string16& contents) {
+  // The text may arrive after the tab has moved on to another page.
+  if (web_contents()->GetURL() != url)
+    return;
+  HistoryService* hs = GetHistoryService();
+  if (hs)
+    hs->SetPageContents(url, contents);
+}
+
 HistoryService* HistoryTabHelper::GetHistoryService() {
   Profile* profile =
       Profile::FromBrowserContext(web_contents()->GetBrowserContext());
@@ -59,9 +59,9 @@ class HistoryTabHelper : public content::WebContentsObserver,
                        const content::NotificationSource& source,
                        const content::NotificationDetails& details) OVERRIDE;
 
-  void OnPageContents(const GURL& url,
-                      int32 page_id,
-                      const string16& contents);
+  // Sends the text of the page at |url|, which the renderer extracted for
+  // language detection, to the history service for full text search.
+  void OnPageContents(const GURL& url, const string16& contents);
 
   // Helper function to return the history service.  May return NULL.
   HistoryService* GetHistoryService();
@@ -153,6 +153,7 @@ const size_t* QueryResults::MatchesForURL(const GURL& url,
 void QueryResults::Swap(QueryResults* other) {
   std::swap(first_time_searched_, other->first_time_searched_);
   std::swap(reached_beginning_, other->reached_beginning_);
+  std::swap(query_duration_, other->query_duration_);
   results_.swap(other->results_);
   url_to_results_.swap(other->url_to_results_);
 }
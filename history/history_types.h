@@ -357,6 +357,12 @@ class QueryResults {
   void set_reached_beginning(bool reached) { reached_beginning_ = reached; }
   bool reached_beginning() { return reached_beginning_; }
 
+  // How long the history thread took to answer the query.
+  base::TimeDelta query_duration() const { return query_duration_; }
+  void set_query_duration(base::TimeDelta duration) {
+    query_duration_ = duration;
+  }
+
   size_t size() const { return results_.size(); }
   bool empty() const { return results_.empty(); }
 
@@ -419,6 +425,8 @@ class QueryResults {
   // Whether the query reaches the beginning of the database.
   bool reached_beginning_;
 
+  base::TimeDelta query_duration_;
+
   // The ordered list of results. The pointers inside this are owned by this
   // QueryResults object.
   ScopedVector<URLResult> results_;
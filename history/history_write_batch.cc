@@ -0,0 +1,116 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/history_write_batch.h"
+
+#include <set>
+#include <utility>
+
+namespace history {
+
+// HistoryWriteBatch::Operation ------------------------------------------------
+
+HistoryWriteBatch::Operation::Operation()
+    : type(ADD_PAGE),
+      icon_type(chrome::INVALID_ICON) {
+}
+
+HistoryWriteBatch::Operation::~Operation() {}
+
+// static
+HistoryWriteBatch::Operation HistoryWriteBatch::Operation::AddPage(
+    const HistoryAddPageArgs& add_page_args) {
+  Operation operation;
+  operation.type = ADD_PAGE;
+  operation.add_page_args = add_page_args;
+  operation.url = add_page_args.url;
+  return operation;
+}
+
+// static
+HistoryWriteBatch::Operation HistoryWriteBatch::Operation::SetPageTitle(
+    const GURL& url,
+    const string16& title) {
+  Operation operation;
+  operation.type = SET_PAGE_TITLE;
+  operation.url = url;
+  operation.title = title;
+  return operation;
+}
+
+// static
+HistoryWriteBatch::Operation HistoryWriteBatch::Operation::SetFavicons(
+    const GURL& page_url,
+    chrome::IconType icon_type,
+    const std::vector<chrome::FaviconBitmapData>& favicon_bitmap_data) {
+  Operation operation;
+  operation.type = SET_FAVICONS;
+  operation.url = page_url;
+  operation.icon_type = icon_type;
+  operation.favicon_bitmap_data = favicon_bitmap_data;
+  return operation;
+}
+
+// HistoryWriteBatch -----------------------------------------------------------
+
+HistoryWriteBatch::HistoryWriteBatch() : sealed_(false) {}
+
+HistoryWriteBatch::~HistoryWriteBatch() {}
+
+bool HistoryWriteBatch::Append(const Operation& operation) {
+  base::AutoLock lock(lock_);
+  if (sealed_)
+    return false;
+  operations_.push_back(operation);
+  return true;
+}
+
+void HistoryWriteBatch::Seal() {
+  base::AutoLock lock(lock_);
+  sealed_ = true;
+}
+
+void HistoryWriteBatch::TakeOperations(Operations* operations,
+                                       size_t* num_coalesced) {
+  Operations taken;
+  {
+    base::AutoLock lock(lock_);
+    sealed_ = true;
+    taken.swap(operations_);
+  }
+
+  // Walk backwards remembering which pages have their title or favicons set
+  // later on. Adding a page can change what an update applies to, through
+  // redirects, so nothing is dropped across one.
+  std::vector<bool> keep(taken.size(), true);
+  std::set<GURL> later_titles;
+  std::set<std::pair<GURL, chrome::IconType> > later_favicons;
+  for (size_t i = taken.size(); i-- > 0;) {
+    const Operation& operation = taken[i];
+    switch (operation.type) {
+      case ADD_PAGE:
+        later_titles.clear();
+        later_favicons.clear();
+        break;
+      case SET_PAGE_TITLE:
+        keep[i] = later_titles.insert(operation.url).second;
+        break;
+      case SET_FAVICONS:
+        keep[i] = later_favicons.insert(
+            std::make_pair(operation.url, operation.icon_type)).second;
+        break;
+    }
+  }
+
+  operations->clear();
+  *num_coalesced = 0;
+  for (size_t i = 0; i < taken.size(); ++i) {
+    if (keep[i])
+      operations->push_back(taken[i]);
+    else
+      ++*num_coalesced;
+  }
+}
+
+}  // namespace history
@@ -0,0 +1,97 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_HISTORY_WRITE_BATCH_H_
+#define CHROME_BROWSER_HISTORY_HISTORY_WRITE_BATCH_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/strings/string16.h"
+#include "base/synchronization/lock.h"
+#include "chrome/browser/history/history_types.h"
+#include "url/gurl.h"
+
+namespace history {
+
+// The page visits, title updates and favicon changes which HistoryService has
+// been asked for since it last scheduled a task on the history thread. They
+// are written by one HistoryBackend::ProcessWriteBatch() task rather than one
+// task each, so while the history thread is busy the writes issued in the
+// meantime pile up in a single batch.
+//
+// HistoryService adds operations on the main thread until it schedules any
+// other task, at which point it seals the batch so that every write runs
+// before the tasks scheduled after it, exactly as if each had been scheduled
+// on its own. The history thread seals the batch when it takes the
+// operations, after which HistoryService starts a new one.
+class HistoryWriteBatch : public base::RefCountedThreadSafe<HistoryWriteBatch> {
+ public:
+  enum OperationType {
+    ADD_PAGE,
+    SET_PAGE_TITLE,
+    SET_FAVICONS,
+  };
+
+  struct Operation {
+    Operation();
+    ~Operation();
+
+    static Operation AddPage(const HistoryAddPageArgs& add_page_args);
+    static Operation SetPageTitle(const GURL& url, const string16& title);
+    static Operation SetFavicons(
+        const GURL& page_url,
+        chrome::IconType icon_type,
+        const std::vector<chrome::FaviconBitmapData>& favicon_bitmap_data);
+
+    OperationType type;
+
+    // For ADD_PAGE.
+    HistoryAddPageArgs add_page_args;
+
+    // The page whose title or favicons are set.
+    GURL url;
+
+    // For SET_PAGE_TITLE.
+    string16 title;
+
+    // For SET_FAVICONS.
+    chrome::IconType icon_type;
+    std::vector<chrome::FaviconBitmapData> favicon_bitmap_data;
+  };
+  typedef std::vector<Operation> Operations;
+
+  HistoryWriteBatch();
+
+  // Called on the main thread. Appends |operation| and returns true, unless
+  // the batch has been sealed, in which case it returns false and the caller
+  // must start a new batch.
+  bool Append(const Operation& operation);
+
+  // Called on the main thread when a task which must run after the batch's
+  // operations is scheduled. No more operations may be added.
+  void Seal();
+
+  // Called on the history thread. Seals the batch and moves its operations
+  // into |operations| in the order they were added, leaving out each title
+  // or favicon update which a later one for the same page replaces before
+  // any page is added. The number left out is put in |num_coalesced|.
+  void TakeOperations(Operations* operations, size_t* num_coalesced);
+
+ private:
+  friend class base::RefCountedThreadSafe<HistoryWriteBatch>;
+  ~HistoryWriteBatch();
+
+  // Guards |sealed_| and |operations_|, which are used on both threads.
+  base::Lock lock_;
+  bool sealed_;
+  Operations operations_;
+
+  DISALLOW_COPY_AND_ASSIGN(HistoryWriteBatch);
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_HISTORY_WRITE_BATCH_H_
@@ -0,0 +1,82 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/strings/utf_string_conversions.h"
+#include "chrome/browser/history/history_write_batch.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace history {
+
+namespace {
+
+typedef HistoryWriteBatch::Operation Operation;
+
+HistoryAddPageArgs AddPageArgs(const char* url) {
+  return HistoryAddPageArgs(GURL(url), base::Time::Now(), NULL, 0, GURL(),
+                            RedirectList(), content::PAGE_TRANSITION_LINK,
+                            SOURCE_BROWSED, false);
+}
+
+Operation SetFavicons(const char* page_url, chrome::IconType icon_type) {
+  return Operation::SetFavicons(GURL(page_url), icon_type,
+                                std::vector<chrome::FaviconBitmapData>());
+}
+
+}  // namespace
+
+TEST(HistoryWriteBatchTest, SealedBatchRejectsOperations) {
+  scoped_refptr<HistoryWriteBatch> batch(new HistoryWriteBatch);
+  EXPECT_TRUE(batch->Append(Operation::AddPage(AddPageArgs("http://a.com/"))));
+  batch->Seal();
+  EXPECT_FALSE(batch->Append(
+      Operation::SetPageTitle(GURL("http://a.com/"), ASCIIToUTF16("A"))));
+
+  HistoryWriteBatch::Operations operations;
+  size_t num_coalesced = 0;
+  batch->TakeOperations(&operations, &num_coalesced);
+  ASSERT_EQ(1U, operations.size());
+  EXPECT_EQ(HistoryWriteBatch::ADD_PAGE, operations[0].type);
+  EXPECT_EQ(GURL("http://a.com/"), operations[0].add_page_args.url);
+  EXPECT_EQ(0U, num_coalesced);
+
+  // Taking the operations also seals the batch.
+  batch = new HistoryWriteBatch;
+  batch->TakeOperations(&operations, &num_coalesced);
+  EXPECT_TRUE(operations.empty());
+  EXPECT_FALSE(batch->Append(Operation::AddPage(AddPageArgs("http://a.com/"))));
+}
+
+TEST(HistoryWriteBatchTest, CoalescesReplacedUpdates) {
+  const GURL a("http://a.com/");
+  const GURL b("http://b.com/");
+  scoped_refptr<HistoryWriteBatch> batch(new HistoryWriteBatch);
+  // Kept: a page is added after it.
+  batch->Append(Operation::SetPageTitle(a, ASCIIToUTF16("a1")));
+  batch->Append(Operation::AddPage(AddPageArgs("http://c.com/")));
+  // Replaced by "a3".
+  batch->Append(Operation::SetPageTitle(a, ASCIIToUTF16("a2")));
+  // Kept: a different page.
+  batch->Append(Operation::SetPageTitle(b, ASCIIToUTF16("b1")));
+  // Replaced by the later favicon of the same type.
+  batch->Append(SetFavicons("http://a.com/", chrome::FAVICON));
+  // Kept: a different icon type.
+  batch->Append(SetFavicons("http://a.com/", chrome::TOUCH_ICON));
+  batch->Append(Operation::SetPageTitle(a, ASCIIToUTF16("a3")));
+  batch->Append(SetFavicons("http://a.com/", chrome::FAVICON));
+
+  HistoryWriteBatch::Operations operations;
+  size_t num_coalesced = 0;
+  batch->TakeOperations(&operations, &num_coalesced);
+  EXPECT_EQ(2U, num_coalesced);
+  ASSERT_EQ(6U, operations.size());
+  EXPECT_EQ(ASCIIToUTF16("a1"), operations[0].title);
+  EXPECT_EQ(HistoryWriteBatch::ADD_PAGE, operations[1].type);
+  EXPECT_EQ(ASCIIToUTF16("b1"), operations[2].title);
+  EXPECT_EQ(chrome::TOUCH_ICON, operations[3].icon_type);
+  EXPECT_EQ(ASCIIToUTF16("a3"), operations[4].title);
+  EXPECT_EQ(HistoryWriteBatch::SET_FAVICONS, operations[5].type);
+  EXPECT_EQ(chrome::FAVICON, operations[5].icon_type);
+}
+
+}  // namespace history
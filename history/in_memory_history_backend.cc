@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "base/command_line.h"
+#include "base/metrics/histogram.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/time/time.h"
 #include "chrome/browser/browser_process.h"
@@ -15,6 +16,7 @@
 #include "chrome/browser/history/history_notifications.h"
 #include "chrome/browser/history/in_memory_database.h"
 #include "chrome/browser/history/url_database.h"
+#include "chrome/browser/history/url_trigram_index.h"
 #include "chrome/browser/profiles/profile.h"
 #include "content/public/browser/notification_details.h"
 #include "content/public/browser/notification_source.h"
@@ -30,7 +32,22 @@ InMemoryHistoryBackend::~InMemoryHistoryBackend() {}
 bool InMemoryHistoryBackend::Init(const base::FilePath& history_filename,
                                   URLDatabase* db) {
   db_.reset(new InMemoryDatabase);
-  return db_->InitFromDisk(history_filename);
+  if (!db_->InitFromDisk(history_filename))
+    return false;
+  // This runs on the history thread, before the backend is handed to the
+  // main thread, so building the index does not block the UI.
+  const base::TimeTicks start_time = base::TimeTicks::Now();
+  trigram_index_.reset(new URLTrigramIndex);
+  // A missing index only costs the callers which use it a trip to SQLite.
+  if (!trigram_index_->Init(db)) {
+    trigram_index_.reset();
+    return true;
+  }
+  UMA_HISTOGRAM_TIMES("History.URLTrigramIndex.BuildTime",
+                      base::TimeTicks::Now() - start_time);
+  UMA_HISTOGRAM_MEMORY_KB("History.URLTrigramIndex.MemoryKB",
+                          trigram_index_->EstimateMemoryUsage() / 1024);
+  return true;
 }
 
 void InMemoryHistoryBackend::AttachToHistoryService(Profile* profile) {
@@ -67,6 +84,8 @@ void InMemoryHistoryBackend::Observe(
   switch (type) {
     case chrome::NOTIFICATION_HISTORY_URL_VISITED: {
       content::Details<history::URLVisitedDetails> visited_details(details);
+      if (trigram_index_)
+        trigram_index_->AddOrUpdateURL(visited_details->row);
       content::PageTransition primary_type =
           content::PageTransitionStripQualifier(visited_details->transition);
       if (visited_details->row.typed_count() > 0 ||
@@ -83,6 +102,8 @@ void InMemoryHistoryBackend::Observe(
           *content::Details<history::KeywordSearchTermDetails>(details).ptr());
       break;
     case chrome::NOTIFICATION_HISTORY_URLS_MODIFIED:
+      OnURLsModified(
+          *content::Details<history::URLsModifiedDetails>(details).ptr());
       OnTypedURLsModified(
           *content::Details<history::URLsModifiedDetails>(details).ptr());
       break;
@@ -123,9 +144,28 @@ void InMemoryHistoryBackend::OnTypedURLsModified(
   }
 }
 
+void InMemoryHistoryBackend::OnURLsModified(
+    const URLsModifiedDetails& details) {
+  if (!trigram_index_)
+    return;
+  for (URLRows::const_iterator i = details.changed_urls.begin();
+       i != details.changed_urls.end(); ++i)
+    trigram_index_->AddOrUpdateURL(*i);
+}
+
 void InMemoryHistoryBackend::OnURLsDeleted(const URLsDeletedDetails& details) {
   DCHECK(db_);
 
+  if (trigram_index_) {
+    if (details.all_history) {
+      trigram_index_->Clear();
+    } else {
+      for (URLRows::const_iterator row = details.rows.begin();
+           row != details.rows.end(); ++row)
+        trigram_index_->DeleteURL(row->id());
+    }
+  }
+
   if (details.all_history) {
     // When all history is deleted, the individual URLs won't be listed. Just
     // create a new database to quickly clear everything out.
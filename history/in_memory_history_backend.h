@@ -4,7 +4,8 @@
 
 // Contains the history backend wrapper around the in-memory URL database. This
 // object maintains an in-memory cache of the subset of history required to do
-// in-line autocomplete.
+// in-line autocomplete, and a trigram index of every URL in history for prefix
+// matching.
 //
 // It is created on the history thread and passed to the main thread where
 // operations can be completed synchronously. It listens for notifications
@@ -34,6 +35,7 @@ class InMemoryDatabase;
 class InMemoryURLIndex;
 struct KeywordSearchTermDetails;
 class URLDatabase;
+class URLTrigramIndex;
 struct URLsDeletedDetails;
 struct URLsModifiedDetails;
 
@@ -43,8 +45,8 @@ class InMemoryHistoryBackend : public content::NotificationObserver {
   virtual ~InMemoryHistoryBackend();
 
   // Initializes the backend from the history database pointed to by the
-  // full path in |history_filename|. |db| is used for setting up the
-  // InMemoryDatabase.
+  // full path in |history_filename|. |db| is the main history database, from
+  // which the trigram index is built.
   bool Init(const base::FilePath& history_filename, URLDatabase* db);
 
   // Does initialization work when this object is attached to the history
@@ -59,6 +61,12 @@ class InMemoryHistoryBackend : public content::NotificationObserver {
     return db_.get();
   }
 
+  // Returns the index of every URL in history. Unlike db(), which holds only
+  // typed URLs, it can answer prefix queries over all of them.
+  const URLTrigramIndex* trigram_index() const {
+    return trigram_index_.get();
+  }
+
   // Notification callback.
   virtual void Observe(int type,
                        const content::NotificationSource& source,
@@ -66,10 +74,14 @@ class InMemoryHistoryBackend : public content::NotificationObserver {
 
  private:
   FRIEND_TEST_ALL_PREFIXES(HistoryBackendTest, DeleteAll);
+  FRIEND_TEST_ALL_PREFIXES(HistoryBackendTest, TrigramIndexFollowsHistory);
 
   // Handler for NOTIFY_HISTORY_TYPED_URLS_MODIFIED.
   void OnTypedURLsModified(const URLsModifiedDetails& details);
 
+  // Updates the trigram index with every row in |details|, typed or not.
+  void OnURLsModified(const URLsModifiedDetails& details);
+
   // Handler for NOTIFY_HISTORY_URLS_DELETED.
   void OnURLsDeleted(const URLsDeletedDetails& details);
 
@@ -83,6 +95,8 @@ class InMemoryHistoryBackend : public content::NotificationObserver {
 
   scoped_ptr<InMemoryDatabase> db_;
 
+  scoped_ptr<URLTrigramIndex> trigram_index_;
+
   // The profile that this object is attached. May be NULL before
   // initialization.
   Profile* profile_;
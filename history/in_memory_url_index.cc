@@ -4,9 +4,12 @@
 
 #include "chrome/browser/history/in_memory_url_index.h"
 
+#include "base/bind.h"
 #include "base/debug/trace_event.h"
 #include "base/file_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/task_runner_util.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/browser/bookmarks/bookmark_model_factory.h"
 #include "chrome/browser/bookmarks/bookmark_service.h"
@@ -14,6 +17,7 @@
 #include "chrome/browser/history/history_notifications.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/history_service_factory.h"
+#include "chrome/browser/history/parallel_scoring.h"
 #include "chrome/browser/history/url_database.h"
 #include "chrome/browser/history/url_index_private_data.h"
 #include "chrome/browser/profiles/profile.h"
@@ -27,6 +31,14 @@ using in_memory_url_index::InMemoryURLIndexCacheItem;
 
 namespace history {
 
+// The number of updated history items which are collected before their
+// records are appended to the journal.
+const size_t kJournalFlushThreshold = 20;
+
+// The number of journal records beyond which the index file is rewritten,
+// which also empties the journal.
+const size_t kMaxJournalRecords = 2000;
+
 // Called by DoSaveToCacheFile to delete any old cache file at |path| when
 // there is no private data to save. Runs on the FILE thread.
 void DeleteCacheFile(const base::FilePath& path) {
@@ -34,6 +46,57 @@ void DeleteCacheFile(const base::FilePath& path) {
   base::DeleteFile(path, false);
 }
 
+// Deletes the protobuf cache file, the index file and its journal. Runs on the
+// FILE thread so that it is ordered with respect to index file writes.
+void DeleteCacheFiles(const base::FilePath& cache_path,
+                      const base::FilePath& index_path,
+                      const base::FilePath& journal_path) {
+  DeleteCacheFile(cache_path);
+  DeleteCacheFile(index_path);
+  DeleteCacheFile(journal_path);
+}
+
+// Restores the private data from the index file and its journal or, failing
+// that, from a protobuf cache file left by an earlier version. Runs on the
+// FILE thread.
+scoped_refptr<URLIndexPrivateData> RestorePrivateDataFromFiles(
+    const base::FilePath& cache_path,
+    const base::FilePath& index_path,
+    const base::FilePath& journal_path,
+    const std::string& languages) {
+  scoped_refptr<URLIndexPrivateData> private_data =
+      URLIndexPrivateData::RestoreFromIndexFile(index_path, journal_path,
+                                                languages);
+  if (private_data.get())
+    return private_data;
+  return URLIndexPrivateData::RestoreFromFile(cache_path, languages);
+}
+
+// Searches |private_data| for StartHistoryItemsForTerms(). Runs on a worker
+// thread. Bookmarks do not affect scoring, so no BookmarkService is passed;
+// the bookmark model may be destroyed along with the profile while this runs.
+ScoredHistoryMatches SearchPrivateData(
+    scoped_refptr<URLIndexPrivateData> private_data,
+    const string16& term_string,
+    size_t cursor_position,
+    const std::string& languages,
+    scoped_refptr<ScoringCancellationFlag> cancel_flag) {
+  if (cancel_flag->IsCanceled())
+    return ScoredHistoryMatches();
+  return private_data->HistoryItemsForTerms(term_string, cursor_position,
+                                            languages, NULL,
+                                            cancel_flag.get());
+}
+
+// Ends a search started by StartHistoryItemsForTerms(), applying any updates
+// to |private_data| deferred while it ran, and hands |matches| to |callback|.
+void FinishSearch(scoped_refptr<URLIndexPrivateData> private_data,
+                  const InMemoryURLIndex::HistoryItemsCallback& callback,
+                  const ScoredHistoryMatches& matches) {
+  private_data->EndSearch();
+  callback.Run(matches);
+}
+
 // Initializes a whitelist of URL schemes.
 void InitializeSchemeWhitelist(std::set<std::string>* whitelist) {
   DCHECK(whitelist);
@@ -100,7 +163,9 @@ InMemoryURLIndex::InMemoryURLIndex(Profile* profile,
       save_cache_observer_(NULL),
       shutdown_(false),
       restored_(false),
-      needs_to_be_cached_(false) {
+      needs_to_be_cached_(false),
+      journal_record_count_(0),
+      index_file_is_current_(false) {
   InitializeSchemeWhitelist(&scheme_whitelist_);
   if (profile) {
     // TODO(mrossetti): Register for language change notifications.
@@ -120,7 +185,9 @@ InMemoryURLIndex::InMemoryURLIndex()
       save_cache_observer_(NULL),
       shutdown_(false),
       restored_(false),
-      needs_to_be_cached_(false) {
+      needs_to_be_cached_(false),
+      journal_record_count_(0),
+      index_file_is_current_(false) {
   InitializeSchemeWhitelist(&scheme_whitelist_);
 }
 
@@ -138,11 +205,33 @@ void InMemoryURLIndex::ShutDown() {
   registrar_.RemoveAll();
   cache_reader_consumer_.CancelAllRequests();
   shutdown_ = true;
-  base::FilePath path;
-  if (!GetCacheFilePath(&path))
+  base::FilePath index_path;
+  base::FilePath journal_path;
+  if (!GetIndexFilePaths(&index_path, &journal_path))
     return;
   private_data_->CancelPendingUpdates();
-  URLIndexPrivateData::WritePrivateDataToCacheFileTask(private_data_, path);
+  // The final write is posted to the file thread, like every other write of
+  // the index and journal, so that it runs after any still pending there
+  // rather than racing them. The index no longer changes once notifications
+  // have been unregistered, so the private data itself can be handed over.
+  if (index_file_is_current_) {
+    // Only the items updated since the last flush need to be written.
+    std::string records;
+    private_data_->AppendJournalRecords(journal_pending_ids_, &records);
+    content::BrowserThread::PostTask(
+        content::BrowserThread::FILE, FROM_HERE,
+        base::Bind(
+            base::IgnoreResult(&URLIndexPrivateData::AppendToJournalFileTask),
+            journal_path, records));
+  } else {
+    content::BrowserThread::PostTask(
+        content::BrowserThread::FILE, FROM_HERE,
+        base::Bind(
+            base::IgnoreResult(
+                &URLIndexPrivateData::WritePrivateDataToIndexFileTask),
+            private_data_, index_path, journal_path));
+  }
+  journal_pending_ids_.clear();
   needs_to_be_cached_ = false;
 }
 
@@ -157,21 +246,74 @@ bool InMemoryURLIndex::GetCacheFilePath(base::FilePath* file_path) {
   return true;
 }
 
+bool InMemoryURLIndex::GetIndexFilePaths(base::FilePath* index_path,
+                                         base::FilePath* journal_path) {
+  if (history_dir_.empty())
+    return false;
+  *index_path =
+      history_dir_.Append(FILE_PATH_LITERAL("History Provider Index"));
+  *journal_path =
+      history_dir_.Append(FILE_PATH_LITERAL("History Provider Index Journal"));
+  return true;
+}
+
 // Querying --------------------------------------------------------------------
 
 ScoredHistoryMatches InMemoryURLIndex::HistoryItemsForTerms(
     const string16& term_string,
     size_t cursor_position) {
+  return HistoryItemsForTerms(term_string, cursor_position, NULL);
+}
+
+ScoredHistoryMatches InMemoryURLIndex::HistoryItemsForTerms(
+    const string16& term_string,
+    size_t cursor_position,
+    const ScoringCancellationFlag* cancel_flag) {
   return private_data_->HistoryItemsForTerms(
       term_string,
       cursor_position,
       languages_,
-      BookmarkModelFactory::GetForProfile(profile_));
+      BookmarkModelFactory::GetForProfile(profile_),
+      cancel_flag);
+}
+
+void InMemoryURLIndex::StartHistoryItemsForTerms(
+    const string16& term_string,
+    size_t cursor_position,
+    ScoringCancellationFlag* cancel_flag,
+    const HistoryItemsCallback& callback) {
+  DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
+  DCHECK(cancel_flag);
+  // The scoring statics must not be lazily initialized on the worker.
+  ScoredHistoryMatch::PrepareForConcurrentScoring();
+  if (!search_task_runner_.get()) {
+    base::SequencedWorkerPool* pool = content::BrowserThread::GetBlockingPool();
+    search_task_runner_ = pool->GetSequencedTaskRunnerWithShutdownBehavior(
+        pool->GetSequenceToken(),
+        base::SequencedWorkerPool::SKIP_ON_SHUTDOWN);
+  }
+  // The search holds its own reference to the private data, which therefore
+  // outlives this index or its replacement by a restore or rebuild. The data
+  // is not modified until the reply ends the search, so the worker reads it
+  // without blocking updates on this thread.
+  private_data_->BeginSearch();
+  base::PostTaskAndReplyWithResult(
+      search_task_runner_.get(),
+      FROM_HERE,
+      base::Bind(&SearchPrivateData, private_data_, term_string,
+                 cursor_position, languages_,
+                 make_scoped_refptr(cancel_flag)),
+      base::Bind(&FinishSearch, private_data_, callback));
 }
 
 // Updating --------------------------------------------------------------------
 
 void InMemoryURLIndex::DeleteURL(const GURL& url) {
+  if (private_data_->being_searched()) {
+    private_data_->RunWhenNotSearched(
+        base::Bind(&InMemoryURLIndex::DeleteURL, AsWeakPtr(), url));
+    return;
+  }
   private_data_->DeleteURL(url);
 }
 
@@ -203,32 +345,66 @@ void InMemoryURLIndex::Observe(int notification_type,
 }
 
 void InMemoryURLIndex::OnURLVisited(const URLVisitedDetails* details) {
-  HistoryService* service =
-      HistoryServiceFactory::GetForProfile(profile_,
-                                           Profile::EXPLICIT_ACCESS);
-  needs_to_be_cached_ |= private_data_->UpdateURL(
-      service, details->row, languages_, scheme_whitelist_);
+  UpdateRows(URLRows(1, details->row));
 }
 
 void InMemoryURLIndex::OnURLsModified(const URLsModifiedDetails* details) {
+  UpdateRows(details->changed_urls);
+}
+
+void InMemoryURLIndex::OnURLsDeleted(const URLsDeletedDetails* details) {
+  if (details->all_history)
+    DeleteAllRows();
+  else
+    DeleteRows(details->rows);
+}
+
+void InMemoryURLIndex::UpdateRows(const URLRows& rows) {
+  if (private_data_->being_searched()) {
+    private_data_->RunWhenNotSearched(
+        base::Bind(&InMemoryURLIndex::UpdateRows, AsWeakPtr(), rows));
+    return;
+  }
   HistoryService* service =
       HistoryServiceFactory::GetForProfile(profile_,
                                            Profile::EXPLICIT_ACCESS);
-  for (URLRows::const_iterator row = details->changed_urls.begin();
-       row != details->changed_urls.end(); ++row)
-    needs_to_be_cached_ |=
-        private_data_->UpdateURL(service, *row, languages_, scheme_whitelist_);
+  for (URLRows::const_iterator row = rows.begin(); row != rows.end(); ++row) {
+    if (private_data_->UpdateURL(service, *row, languages_,
+                                 scheme_whitelist_)) {
+      needs_to_be_cached_ = true;
+      journal_pending_ids_.insert(row->id());
+    }
+  }
+  MaybeFlushJournal();
 }
 
-void InMemoryURLIndex::OnURLsDeleted(const URLsDeletedDetails* details) {
-  if (details->all_history) {
-    ClearPrivateData();
-    needs_to_be_cached_ = true;
-  } else {
-    for (URLRows::const_iterator row = details->rows.begin();
-         row != details->rows.end(); ++row)
-      needs_to_be_cached_ |= private_data_->DeleteURL(row->url());
+void InMemoryURLIndex::DeleteRows(const URLRows& rows) {
+  if (private_data_->being_searched()) {
+    private_data_->RunWhenNotSearched(
+        base::Bind(&InMemoryURLIndex::DeleteRows, AsWeakPtr(), rows));
+    return;
+  }
+  for (URLRows::const_iterator row = rows.begin(); row != rows.end(); ++row) {
+    if (private_data_->DeleteURL(row->url())) {
+      needs_to_be_cached_ = true;
+      journal_pending_ids_.insert(row->id());
+    }
   }
+  MaybeFlushJournal();
+}
+
+void InMemoryURLIndex::DeleteAllRows() {
+  if (private_data_->being_searched()) {
+    private_data_->RunWhenNotSearched(
+        base::Bind(&InMemoryURLIndex::DeleteAllRows, AsWeakPtr()));
+    return;
+  }
+  ClearPrivateData();
+  needs_to_be_cached_ = true;
+  // Replaying deletions of everything would be pointless; the next save
+  // writes the (empty) index in full.
+  journal_pending_ids_.clear();
+  index_file_is_current_ = false;
 }
 
 // Restoring from Cache --------------------------------------------------------
@@ -238,7 +414,10 @@ void InMemoryURLIndex::PostRestoreFromCacheFileTask() {
   TRACE_EVENT0("browser", "InMemoryURLIndex::PostRestoreFromCacheFileTask");
 
   base::FilePath path;
-  if (!GetCacheFilePath(&path) || shutdown_) {
+  base::FilePath index_path;
+  base::FilePath journal_path;
+  if (!GetCacheFilePath(&path) ||
+      !GetIndexFilePaths(&index_path, &journal_path) || shutdown_) {
     restored_ = true;
     if (restore_cache_observer_)
       restore_cache_observer_->OnCacheRestoreFinished(false);
@@ -248,7 +427,8 @@ void InMemoryURLIndex::PostRestoreFromCacheFileTask() {
   content::BrowserThread::PostTaskAndReplyWithResult
       <scoped_refptr<URLIndexPrivateData> >(
       content::BrowserThread::FILE, FROM_HERE,
-      base::Bind(&URLIndexPrivateData::RestoreFromFile, path, languages_),
+      base::Bind(&RestorePrivateDataFromFiles, path, index_path, journal_path,
+                 languages_),
       base::Bind(&InMemoryURLIndex::OnCacheLoadDone, AsWeakPtr()));
 }
 
@@ -257,17 +437,27 @@ void InMemoryURLIndex::OnCacheLoadDone(
   if (private_data.get() && !private_data->Empty()) {
     private_data_ = private_data;
     restored_ = true;
+    index_file_is_current_ = private_data->restored_from_index_file();
+    journal_record_count_ = private_data->replayed_journal_records();
+    // Migrate a protobuf cache to the index file format, and compact an
+    // index whose journal has grown long.
+    if (!index_file_is_current_ || journal_record_count_ > kMaxJournalRecords)
+      PostSaveToCacheFileTask();
     if (restore_cache_observer_)
       restore_cache_observer_->OnCacheRestoreFinished(true);
   } else if (profile_) {
-    // When unable to restore from the cache file delete the cache file, if
-    // it exists, and then rebuild from the history database if it's available,
+    // When unable to restore from the cache files delete them, if they
+    // exist, and then rebuild from the history database if it's available,
     // otherwise wait until the history database loaded and then rebuild.
     base::FilePath path;
-    if (!GetCacheFilePath(&path) || shutdown_)
+    base::FilePath index_path;
+    base::FilePath journal_path;
+    if (!GetCacheFilePath(&path) ||
+        !GetIndexFilePaths(&index_path, &journal_path) || shutdown_)
       return;
-    content::BrowserThread::PostBlockingPoolTask(
-        FROM_HERE, base::Bind(DeleteCacheFile, path));
+    content::BrowserThread::PostTask(
+        content::BrowserThread::FILE, FROM_HERE,
+        base::Bind(DeleteCacheFiles, path, index_path, journal_path));
     HistoryService* service =
         HistoryServiceFactory::GetForProfileWithoutCreating(profile_);
     if (service && service->backend_loaded()) {
@@ -299,7 +489,11 @@ void InMemoryURLIndex::DoneRebuidingPrivateDataFromHistoryDB(
     private_data_ = private_data;
     PostSaveToCacheFileTask();  // Cache the newly rebuilt index.
   } else {
-    private_data_->Clear();  // Dump the old private data.
+    // Dump the old private data, once no search is reading it. The data owns
+    // the deferred update, so the update need not hold a reference to it.
+    private_data_->RunWhenNotSearched(
+        base::Bind(&URLIndexPrivateData::Clear,
+                   base::Unretained(private_data_.get())));
     // There is no need to do anything with the cache file as it was deleted
     // when the rebuild from the history operation was kicked off.
   }
@@ -318,8 +512,15 @@ void InMemoryURLIndex::RebuildFromHistory(HistoryDatabase* history_db) {
 
 void InMemoryURLIndex::PostSaveToCacheFileTask() {
   base::FilePath path;
-  if (!GetCacheFilePath(&path))
+  base::FilePath index_path;
+  base::FilePath journal_path;
+  if (!GetCacheFilePath(&path) ||
+      !GetIndexFilePaths(&index_path, &journal_path))
     return;
+  // The new index file includes every pending update and supersedes the
+  // journal.
+  journal_pending_ids_.clear();
+  journal_record_count_ = 0;
   // If there is anything in our private data then make a copy of it and tell
   // it to save itself to a file.
   if (private_data_.get() && !private_data_->Empty()) {
@@ -329,15 +530,46 @@ void InMemoryURLIndex::PostSaveToCacheFileTask() {
         private_data_->Duplicate();
     content::BrowserThread::PostTaskAndReplyWithResult<bool>(
         content::BrowserThread::FILE, FROM_HERE,
-        base::Bind(&URLIndexPrivateData::WritePrivateDataToCacheFileTask,
-                   private_data_copy, path),
+        base::Bind(&URLIndexPrivateData::WritePrivateDataToIndexFileTask,
+                   private_data_copy, index_path, journal_path),
         base::Bind(&InMemoryURLIndex::OnCacheSaveDone, AsWeakPtr()));
-  } else {
-    // If there is no data in our index then delete any existing cache file.
-    content::BrowserThread::PostBlockingPoolTask(
-        FROM_HERE,
+    // Any protobuf cache left by an earlier version is now obsolete.
+    content::BrowserThread::PostTask(
+        content::BrowserThread::FILE, FROM_HERE,
         base::Bind(DeleteCacheFile, path));
+    index_file_is_current_ = true;
+  } else {
+    // If there is no data in our index then delete any existing cache files.
+    content::BrowserThread::PostTask(
+        content::BrowserThread::FILE, FROM_HERE,
+        base::Bind(DeleteCacheFiles, path, index_path, journal_path));
+    index_file_is_current_ = false;
+  }
+}
+
+void InMemoryURLIndex::MaybeFlushJournal() {
+  // Without a current index file there is nothing to journal against; the
+  // next full save will capture the updates.
+  if (!index_file_is_current_ ||
+      journal_pending_ids_.size() < kJournalFlushThreshold)
+    return;
+  base::FilePath index_path;
+  base::FilePath journal_path;
+  if (!GetIndexFilePaths(&index_path, &journal_path))
+    return;
+  journal_record_count_ += journal_pending_ids_.size();
+  if (journal_record_count_ > kMaxJournalRecords) {
+    PostSaveToCacheFileTask();
+    return;
   }
+  std::string records;
+  private_data_->AppendJournalRecords(journal_pending_ids_, &records);
+  journal_pending_ids_.clear();
+  content::BrowserThread::PostTask(
+      content::BrowserThread::FILE, FROM_HERE,
+      base::Bind(
+          base::IgnoreResult(&URLIndexPrivateData::AppendToJournalFileTask),
+          journal_path, records));
 }
 
 void InMemoryURLIndex::OnCacheSaveDone(bool succeeded) {
@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/callback_forward.h"
 #include "base/files/file_path.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/ref_counted.h"
@@ -28,10 +29,12 @@
 #include "content/public/browser/notification_registrar.h"
 #include "sql/connection.h"
 
+class AutocompleteControllerPerfTest;
 class HistoryQuickProviderTest;
 class Profile;
 
 namespace base {
+class SequencedTaskRunner;
 class Time;
 }
 
@@ -44,6 +47,7 @@ namespace history {
 namespace imui = in_memory_url_index;
 
 class HistoryDatabase;
+class ScoringCancellationFlag;
 class URLIndexPrivateData;
 struct URLsDeletedDetails;
 struct URLsModifiedDetails;
@@ -123,6 +127,27 @@ class InMemoryURLIndex : public content::NotificationObserver,
   ScoredHistoryMatches HistoryItemsForTerms(const string16& term_string,
                                             size_t cursor_position);
 
+  // Same as above, except that scoring stops, and no matches are returned,
+  // if |cancel_flag| becomes set because a newer query has superseded this
+  // one.
+  ScoredHistoryMatches HistoryItemsForTerms(
+      const string16& term_string,
+      size_t cursor_position,
+      const ScoringCancellationFlag* cancel_flag);
+
+  typedef base::Callback<void(const ScoredHistoryMatches&)>
+      HistoryItemsCallback;
+
+  // Like the above, except that the index is searched on a worker thread and
+  // |callback| is run on the calling thread with the matches. Searches run
+  // one at a time in the order they were started, so a search whose
+  // |cancel_flag| is set while it waits returns no matches without scoring.
+  // Must be called on the UI thread.
+  void StartHistoryItemsForTerms(const string16& term_string,
+                                 size_t cursor_position,
+                                 ScoringCancellationFlag* cancel_flag,
+                                 const HistoryItemsCallback& callback);
+
   // Deletes the index entry, if any, for the given |url|.
   void DeleteURL(const GURL& url);
 
@@ -142,6 +167,7 @@ class InMemoryURLIndex : public content::NotificationObserver,
   }
 
  private:
+  friend class ::AutocompleteControllerPerfTest;
   friend class ::HistoryQuickProviderTest;
   friend class InMemoryURLIndexTest;
   friend class InMemoryURLIndexCacheTest;
@@ -184,6 +210,12 @@ class InMemoryURLIndex : public content::NotificationObserver,
   // provided as a hook for unit testing.)
   bool GetCacheFilePath(base::FilePath* file_path);
 
+  // Constructs the paths of the flat index file and of its update journal,
+  // which live alongside the cache file. Returns false if there is no history
+  // directory.
+  bool GetIndexFilePaths(base::FilePath* index_path,
+                         base::FilePath* journal_path);
+
   // Restores the index's private data from the cache file stored in the
   // profile directory.
   void PostRestoreFromCacheFileTask();
@@ -225,6 +257,11 @@ class InMemoryURLIndex : public content::NotificationObserver,
   // Provided for unit testing so that a test cache file can be used.
   void DoSaveToCacheFile(const base::FilePath& path);
 
+  // Appends records for the items in |journal_pending_ids_| to the journal
+  // once enough have accumulated, or rewrites the index file instead if the
+  // journal has grown too long.
+  void MaybeFlushJournal();
+
   // Notifies the observer, if any, of the success of the private data caching.
   // |succeeded| is true on a successful save.
   void OnCacheSaveDone(bool succeeded);
@@ -239,6 +276,13 @@ class InMemoryURLIndex : public content::NotificationObserver,
   void OnURLsModified(const URLsModifiedDetails* details);
   void OnURLsDeleted(const URLsDeletedDetails* details);
 
+  // Apply history changes to the index. While a search started by
+  // StartHistoryItemsForTerms() is running on a worker thread they are
+  // deferred until it finishes, since the search reads the index unlocked.
+  void UpdateRows(const URLRows& rows);
+  void DeleteRows(const URLRows& rows);
+  void DeleteAllRows();
+
   // Sets the directory wherein the cache file will be maintained.
   // For unit test usage only.
   void set_history_dir(const base::FilePath& dir_path) {
@@ -268,6 +312,10 @@ class InMemoryURLIndex : public content::NotificationObserver,
   // The index's durable private data.
   scoped_refptr<URLIndexPrivateData> private_data_;
 
+  // Runs the searches started by StartHistoryItemsForTerms(). Created on
+  // first use.
+  scoped_refptr<base::SequencedTaskRunner> search_task_runner_;
+
   // Observers to notify upon restoral or save of the private data cache.
   RestoreCacheObserver* restore_cache_observer_;
   SaveCacheObserver* save_cache_observer_;
@@ -289,6 +337,19 @@ class InMemoryURLIndex : public content::NotificationObserver,
   // http://crbug.com/83659
   bool needs_to_be_cached_;
 
+  // The items updated or deleted since the journal was last appended to.
+  HistoryIDSet journal_pending_ids_;
+
+  // The number of records in the journal on disk, including those posted to
+  // the file thread but not yet written.
+  size_t journal_record_count_;
+
+  // True when the index file on disk (once pending file thread tasks have
+  // run) plus the journal reflect |private_data_| apart from
+  // |journal_pending_ids_|. When false, updates are not journaled and the
+  // next save rewrites the index file in full.
+  bool index_file_is_current_;
+
   DISALLOW_COPY_AND_ASSIGN(InMemoryURLIndex);
 };
 
@@ -170,4 +170,16 @@ void RowWordStarts::Clear() {
   title_word_starts_.clear();
 }
 
+// RowTermMatches --------------------------------------------------------------
+
+RowTermMatches::RowTermMatches() {}
+RowTermMatches::~RowTermMatches() {}
+
+void RowTermMatches::Swap(RowTermMatches* other) {
+  url_.swap(other->url_);
+  title_.swap(other->title_);
+  url_term_matches_.swap(other->url_term_matches_);
+  title_term_matches_.swap(other->title_term_matches_);
+}
+
 }  // namespace history
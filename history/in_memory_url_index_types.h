@@ -183,6 +183,24 @@ struct RowWordStarts {
 };
 typedef std::map<HistoryID, RowWordStarts> WordStartsMap;
 
+// The cleaned-up URL and page title of a history item together with the
+// matches of each search term within them. Retained for the items matching
+// every term of a search so that, when the user extends the search string,
+// the terms which are unchanged need not be matched again.
+struct RowTermMatches {
+  RowTermMatches();
+  ~RowTermMatches();
+
+  // Exchanges the contents of this object with those of |other|.
+  void Swap(RowTermMatches* other);
+
+  string16 url_;
+  string16 title_;
+  std::vector<TermMatches> url_term_matches_;  // Indexed by term number.
+  std::vector<TermMatches> title_term_matches_;  // Indexed by term number.
+};
+typedef std::map<HistoryID, RowTermMatches> RowTermMatchesMap;
+
 }  // namespace history
 
 #endif  // CHROME_BROWSER_HISTORY_IN_MEMORY_URL_INDEX_TYPES_H_
@@ -6,6 +6,7 @@
 #include <fstream>
 
 #include "base/auto_reset.h"
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
@@ -13,7 +14,9 @@
 #include "base/path_service.h"
 #include "base/strings/string16.h"
 #include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/thread.h"
 #include "chrome/browser/autocomplete/autocomplete_provider.h"
 #include "chrome/browser/chrome_notification_types.h"
 #include "chrome/browser/history/history_backend.h"
@@ -23,6 +26,7 @@
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/history/in_memory_url_index.h"
 #include "chrome/browser/history/in_memory_url_index_types.h"
+#include "chrome/browser/history/parallel_scoring.h"
 #include "chrome/browser/history/url_index_private_data.h"
 #include "chrome/common/chrome_paths.h"
 #include "chrome/test/base/history_index_restore_observer.h"
@@ -97,9 +101,12 @@ class InMemoryURLIndexTest : public testing::Test {
 
   // Pass-through functions to simplify our friendship with InMemoryURLIndex.
   URLIndexPrivateData* GetPrivateData() const;
+  void SetPrivateData(scoped_refptr<URLIndexPrivateData> private_data);
   void ClearPrivateData();
   void set_history_dir(const base::FilePath& dir_path);
   bool GetCacheFilePath(base::FilePath* file_path) const;
+  bool GetIndexFilePaths(base::FilePath* index_path,
+                         base::FilePath* journal_path) const;
   void PostRestoreFromCacheFileTask();
   void PostSaveToCacheFileTask();
   void Observe(int notification_type,
@@ -142,6 +149,11 @@ URLIndexPrivateData* InMemoryURLIndexTest::GetPrivateData() const {
   return url_index_->private_data();
 }
 
+void InMemoryURLIndexTest::SetPrivateData(
+    scoped_refptr<URLIndexPrivateData> private_data) {
+  url_index_->private_data_ = private_data;
+}
+
 void InMemoryURLIndexTest::ClearPrivateData() {
   return url_index_->ClearPrivateData();
 }
@@ -155,6 +167,12 @@ bool InMemoryURLIndexTest::GetCacheFilePath(base::FilePath* file_path) const {
   return url_index_->GetCacheFilePath(file_path);
 }
 
+bool InMemoryURLIndexTest::GetIndexFilePaths(
+    base::FilePath* index_path,
+    base::FilePath* journal_path) const {
+  return url_index_->GetIndexFilePaths(index_path, journal_path);
+}
+
 void InMemoryURLIndexTest::PostRestoreFromCacheFileTask() {
   url_index_->PostRestoreFromCacheFileTask();
 }
@@ -301,7 +319,7 @@ void InMemoryURLIndexTest::ExpectPrivateDataNotEmpty(
   EXPECT_TRUE(data.available_words_.empty());
   EXPECT_FALSE(data.word_map_.empty());
   EXPECT_FALSE(data.char_word_map_.empty());
-  EXPECT_FALSE(data.word_id_history_map_.empty());
+  EXPECT_FALSE(data.posting_index_.empty());
   EXPECT_FALSE(data.history_id_word_map_.empty());
   EXPECT_FALSE(data.history_info_map_.empty());
 }
@@ -312,7 +330,7 @@ void InMemoryURLIndexTest::ExpectPrivateDataEmpty(
   EXPECT_TRUE(data.available_words_.empty());
   EXPECT_TRUE(data.word_map_.empty());
   EXPECT_TRUE(data.char_word_map_.empty());
-  EXPECT_TRUE(data.word_id_history_map_.empty());
+  EXPECT_TRUE(data.posting_index_.empty());
   EXPECT_TRUE(data.history_id_word_map_.empty());
   EXPECT_TRUE(data.history_info_map_.empty());
 }
@@ -342,8 +360,6 @@ void InMemoryURLIndexTest::ExpectPrivateDataEqual(
   EXPECT_EQ(expected.word_list_.size(), actual.word_list_.size());
   EXPECT_EQ(expected.word_map_.size(), actual.word_map_.size());
   EXPECT_EQ(expected.char_word_map_.size(), actual.char_word_map_.size());
-  EXPECT_EQ(expected.word_id_history_map_.size(),
-            actual.word_id_history_map_.size());
   EXPECT_EQ(expected.history_id_word_map_.size(),
             actual.history_id_word_map_.size());
   EXPECT_EQ(expected.history_info_map_.size(), actual.history_info_map_.size());
@@ -355,8 +371,20 @@ void InMemoryURLIndexTest::ExpectPrivateDataEqual(
 
   ExpectMapOfContainersIdentical(expected.char_word_map_,
                                  actual.char_word_map_);
-  ExpectMapOfContainersIdentical(expected.word_id_history_map_,
-                                 actual.word_id_history_map_);
+  // Every word must have the same postings.
+  for (WordMap::const_iterator iter = expected.word_map_.begin();
+       iter != expected.word_map_.end(); ++iter) {
+    const PostingList* expected_postings =
+        expected.posting_index_.GetPostingList(iter->second);
+    const PostingList* actual_postings =
+        actual.posting_index_.GetPostingList(iter->second);
+    ASSERT_TRUE(expected_postings && actual_postings);
+    HistoryIDVector expected_history_ids;
+    expected_postings->DecodeTo(&expected_history_ids);
+    HistoryIDVector actual_history_ids;
+    actual_postings->DecodeTo(&actual_history_ids);
+    EXPECT_EQ(expected_history_ids, actual_history_ids);
+  }
   ExpectMapOfContainersIdentical(expected.history_id_word_map_,
                                  actual.history_id_word_map_);
 
@@ -667,6 +695,99 @@ TEST_F(InMemoryURLIndexTest, HugeResultSet) {
             private_data.post_scoring_item_count_);
 }
 
+namespace {
+
+void SearchPrivateData(scoped_refptr<URLIndexPrivateData> private_data,
+                       const string16& query,
+                       ScoredHistoryMatches* matches) {
+  *matches = private_data->HistoryItemsForTerms(query, string16::npos,
+                                                "en,ja,hi,zh", NULL, NULL);
+}
+
+// Searches |private_data| for |query| on a thread other than the UI thread,
+// where the candidates may be scored on several threads.
+ScoredHistoryMatches SearchOffUIThread(URLIndexPrivateData* private_data,
+                                       const string16& query) {
+  ScoredHistoryMatches matches;
+  base::Thread search_thread("HQPSearch");
+  EXPECT_TRUE(search_thread.Start());
+  search_thread.message_loop()->PostTask(
+      FROM_HERE,
+      base::Bind(&SearchPrivateData, make_scoped_refptr(private_data), query,
+                 &matches));
+  search_thread.Stop();
+  return matches;
+}
+
+}  // namespace
+
+TEST_F(InMemoryURLIndexTest, ParallelScoring) {
+  // Create enough qualifying history items, with differing scores, to be
+  // scored in several shards.
+  for (URLID row_id = 5000; row_id < 6000; ++row_id) {
+    URLRow new_row(GURL(base::StringPrintf(
+        "http://www.brokeandaloneinmanitoba.com/page%d",
+        static_cast<int>(row_id))), row_id);
+    new_row.set_last_visit(base::Time::Now());
+    new_row.set_visit_count(static_cast<int>(row_id % 7));
+    new_row.set_typed_count(static_cast<int>(row_id % 3));
+    EXPECT_TRUE(UpdateURL(new_row));
+  }
+
+  // Scoring on several threads must give exactly the serial results.
+  const char* kQueries[] = { "b", "broke", "manitoba page5", "page59" };
+  URLIndexPrivateData* private_data = GetPrivateData();
+  for (size_t i = 0; i < arraysize(kQueries); ++i) {
+    SCOPED_TRACE(kQueries[i]);
+    string16 query(ASCIIToUTF16(kQueries[i]));
+    private_data->set_scoring_threads(1);
+    private_data->last_search_.Clear();
+    ScoredHistoryMatches serial_matches =
+        SearchOffUIThread(private_data, query);
+    private_data->set_scoring_threads(4);
+    private_data->last_search_.Clear();
+    ScoredHistoryMatches parallel_matches =
+        SearchOffUIThread(private_data, query);
+    ASSERT_FALSE(serial_matches.empty());
+    ASSERT_EQ(serial_matches.size(), parallel_matches.size());
+    for (size_t j = 0; j < serial_matches.size(); ++j) {
+      EXPECT_EQ(serial_matches[j].url_info.id(),
+                parallel_matches[j].url_info.id());
+      EXPECT_EQ(serial_matches[j].raw_score, parallel_matches[j].raw_score);
+    }
+  }
+
+  // A canceled query returns nothing, and is not refined from later.
+  scoped_refptr<ScoringCancellationFlag> cancel_flag(
+      new ScoringCancellationFlag);
+  cancel_flag->Cancel();
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("broke"), string16::npos, cancel_flag.get()).empty());
+  url_index_->HistoryItemsForTerms(ASCIIToUTF16("broken"), string16::npos);
+  EXPECT_FALSE(private_data->search_was_refined_);
+}
+
+TEST_F(InMemoryURLIndexTest, PostingListsFollowUpdates) {
+  URLIndexPrivateData* private_data = GetPrivateData();
+  URLRow new_row(GURL("http://www.brokeandaloneinmanitoba.com/"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  EXPECT_TRUE(UpdateURL(new_row));
+  WordMap::const_iterator word_iter =
+      private_data->word_map_.find(ASCIIToUTF16("brokeandaloneinmanitoba"));
+  ASSERT_TRUE(word_iter != private_data->word_map_.end());
+  const WordID word_id = word_iter->second;
+  EXPECT_TRUE(private_data->posting_index_.HasPostings(word_id));
+  EXPECT_EQ(1U, url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("brokeandalone"), string16::npos).size());
+
+  // Removing the only item containing the word frees the word's slot.
+  EXPECT_TRUE(DeleteURL(new_row.url()));
+  EXPECT_FALSE(private_data->posting_index_.HasPostings(word_id));
+  EXPECT_EQ(1U, private_data->available_words_.count(word_id));
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("brokeandalone"), string16::npos).empty());
+}
+
 TEST_F(InMemoryURLIndexTest, TitleSearch) {
   // Signal if someone has changed the test DB.
   EXPECT_EQ(29U, GetPrivateData()->history_info_map_.size());
@@ -807,6 +928,55 @@ TEST_F(InMemoryURLIndexTest, TypedCharacterCaching) {
   CheckTerm(cache, ASCIIToUTF16("rec"));
 }
 
+TEST_F(InMemoryURLIndexTest, RefineSearch) {
+  // Simulate typing, with each search refined from the previous one, and
+  // verify that every refined search returns exactly what a search from
+  // scratch does.
+  const char* kSearches[] = {
+    "m", "mo", "mor", "mort", "mort ", "mort r", "mort re", "mort reco",
+  };
+  URLIndexPrivateData* private_data = GetPrivateData();
+  for (size_t i = 0; i < arraysize(kSearches); ++i) {
+    SCOPED_TRACE(kSearches[i]);
+    string16 search(ASCIIToUTF16(kSearches[i]));
+    ScoredHistoryMatches refined_matches =
+        url_index_->HistoryItemsForTerms(search, string16::npos);
+    EXPECT_EQ(i > 0, private_data->search_was_refined_);
+
+    private_data->last_search_.Clear();
+    ScoredHistoryMatches matches =
+        url_index_->HistoryItemsForTerms(search, string16::npos);
+    EXPECT_FALSE(private_data->search_was_refined_);
+    ASSERT_EQ(matches.size(), refined_matches.size());
+    for (size_t j = 0; j < matches.size(); ++j) {
+      EXPECT_EQ(matches[j].url_info.id(), refined_matches[j].url_info.id());
+      EXPECT_EQ(matches[j].raw_score, refined_matches[j].raw_score);
+      EXPECT_EQ(matches[j].can_inline, refined_matches[j].can_inline);
+      EXPECT_EQ(matches[j].url_matches.size(),
+                refined_matches[j].url_matches.size());
+      EXPECT_EQ(matches[j].title_matches.size(),
+                refined_matches[j].title_matches.size());
+    }
+  }
+
+  // Deleting a character starts a new search.
+  url_index_->HistoryItemsForTerms(ASCIIToUTF16("mort rec"), string16::npos);
+  EXPECT_FALSE(private_data->search_was_refined_);
+
+  // So does any change to the index.
+  url_index_->HistoryItemsForTerms(ASCIIToUTF16("drudge"), string16::npos);
+  URLRow new_row(GURL("http://www.drudgereport.com/new"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  EXPECT_TRUE(UpdateURL(new_row));
+  ScoredHistoryMatches matches = url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("drudgere"), string16::npos);
+  EXPECT_FALSE(private_data->search_was_refined_);
+  bool found_new_row = false;
+  for (size_t i = 0; i < matches.size(); ++i)
+    found_new_row |= (matches[i].url_info.id() == new_row.id());
+  EXPECT_TRUE(found_new_row);
+}
+
 TEST_F(InMemoryURLIndexTest, AddNewRows) {
   // Verify that the row we're going to add does not already exist.
   URLID new_row_id = 87654321;
@@ -868,6 +1038,44 @@ TEST_F(InMemoryURLIndexTest, ExpireRow) {
       ASCIIToUTF16("DrudgeReport"), string16::npos).empty());
 }
 
+TEST_F(InMemoryURLIndexTest, UpdatesDeferredDuringSearch) {
+  // While a search is reading the index on a worker thread, history changes
+  // are held back and then applied, in order, once it ends.
+  URLIndexPrivateData* private_data = GetPrivateData();
+  private_data->BeginSearch();
+
+  URLRow new_row(GURL("http://www.brokeandaloneinmanitoba.com/"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  URLsModifiedDetails modified_details;
+  modified_details.changed_urls.push_back(new_row);
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&modified_details));
+
+  ScoredHistoryMatches matches = url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), string16::npos);
+  ASSERT_EQ(1U, matches.size());
+  URLsDeletedDetails deleted_details;
+  deleted_details.all_history = false;
+  deleted_details.rows.push_back(matches[0].url_info);
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&deleted_details));
+
+  EXPECT_TRUE(private_data->being_searched());
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("brokeandalone"), string16::npos).empty());
+  EXPECT_EQ(1U, url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), string16::npos).size());
+
+  private_data->EndSearch();
+  EXPECT_FALSE(private_data->being_searched());
+  EXPECT_EQ(1U, url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("brokeandalone"), string16::npos).size());
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), string16::npos).empty());
+}
+
 TEST_F(InMemoryURLIndexTest, WhitelistedURLs) {
   struct TestData {
     const std::string url_spec;
@@ -1007,7 +1215,7 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   EXPECT_TRUE(private_data.available_words_.empty());
   EXPECT_FALSE(private_data.word_map_.empty());
   EXPECT_FALSE(private_data.char_word_map_.empty());
-  EXPECT_FALSE(private_data.word_id_history_map_.empty());
+  EXPECT_FALSE(private_data.posting_index_.empty());
   EXPECT_FALSE(private_data.history_id_word_map_.empty());
   EXPECT_FALSE(private_data.history_info_map_.empty());
   EXPECT_FALSE(private_data.word_starts_map_.empty());
@@ -1033,7 +1241,7 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   EXPECT_TRUE(private_data.available_words_.empty());
   EXPECT_TRUE(private_data.word_map_.empty());
   EXPECT_TRUE(private_data.char_word_map_.empty());
-  EXPECT_TRUE(private_data.word_id_history_map_.empty());
+  EXPECT_TRUE(private_data.posting_index_.empty());
   EXPECT_TRUE(private_data.history_id_word_map_.empty());
   EXPECT_TRUE(private_data.history_info_map_.empty());
   EXPECT_TRUE(private_data.word_starts_map_.empty());
@@ -1057,6 +1265,84 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   ExpectPrivateDataEqual(*old_data.get(), new_data);
 }
 
+TEST_F(InMemoryURLIndexTest, JournalReplay) {
+  base::ScopedTempDir temp_directory;
+  ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
+  set_history_dir(temp_directory.path());
+  base::FilePath index_path;
+  base::FilePath journal_path;
+  ASSERT_TRUE(GetIndexFilePaths(&index_path, &journal_path));
+
+  CacheFileSaverObserver save_observer(&message_loop_);
+  url_index_->set_save_cache_observer(&save_observer);
+  PostSaveToCacheFileTask();
+  message_loop_.Run();
+  EXPECT_TRUE(save_observer.succeeded_);
+  EXPECT_TRUE(base::PathExists(index_path));
+  EXPECT_FALSE(base::PathExists(journal_path));
+
+  // Delete one item and retitle another. The updates are appended to the
+  // journal rather than causing the index file to be rewritten.
+  ScoredHistoryMatches matches = url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), string16::npos);
+  ASSERT_EQ(1U, matches.size());
+  URLsDeletedDetails deleted_details;
+  deleted_details.all_history = false;
+  deleted_details.rows.push_back(matches[0].url_info);
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&deleted_details));
+
+  matches = url_index_->HistoryItemsForTerms(ASCIIToUTF16("lebronomics"),
+                                             string16::npos);
+  ASSERT_EQ(1U, matches.size());
+  URLsModifiedDetails modified_details;
+  URLRow row(matches[0].url_info);
+  row.set_title(ASCIIToUTF16("Journaled Title"));
+  modified_details.changed_urls.push_back(row);
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&modified_details));
+
+  // Shutting down writes the updates, which are fewer than the flush
+  // threshold, to the journal on the file thread.
+  url_index_->ShutDown();
+  message_loop_.RunUntilIdle();
+  EXPECT_TRUE(base::PathExists(journal_path));
+
+  scoped_refptr<URLIndexPrivateData> restored_data =
+      URLIndexPrivateData::RestoreFromIndexFile(index_path, journal_path,
+                                                "en,ja,hi,zh");
+  ASSERT_TRUE(restored_data.get());
+  EXPECT_TRUE(restored_data->restored_from_index_file());
+  EXPECT_EQ(2U, restored_data->replayed_journal_records());
+  SetPrivateData(restored_data);
+
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), string16::npos).empty());
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("lebronomics"), string16::npos).empty());
+  matches = url_index_->HistoryItemsForTerms(ASCIIToUTF16("journaled"),
+                                             string16::npos);
+  ASSERT_EQ(1U, matches.size());
+  EXPECT_EQ(row.url(), matches[0].url_info.url());
+
+  // The words only the deleted and retitled items used left free slots,
+  // which must still be reusable after saving and restoring the index.
+  EXPECT_FALSE(restored_data->available_words_.empty());
+  PostSaveToCacheFileTask();
+  message_loop_.Run();
+  EXPECT_TRUE(save_observer.succeeded_);
+  EXPECT_FALSE(base::PathExists(journal_path));
+  scoped_refptr<URLIndexPrivateData> resaved_data =
+      URLIndexPrivateData::RestoreFromIndexFile(index_path, journal_path,
+                                                "en,ja,hi,zh");
+  ASSERT_TRUE(resaved_data.get());
+  EXPECT_EQ(0U, resaved_data->replayed_journal_records());
+  EXPECT_TRUE(restored_data->available_words_ ==
+              resaved_data->available_words_);
+}
+
 TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   base::ScopedTempDir temp_directory;
   ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
@@ -1071,7 +1357,7 @@ TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   EXPECT_TRUE(private_data.available_words_.empty());
   EXPECT_FALSE(private_data.word_map_.empty());
   EXPECT_FALSE(private_data.char_word_map_.empty());
-  EXPECT_FALSE(private_data.word_id_history_map_.empty());
+  EXPECT_FALSE(private_data.posting_index_.empty());
   EXPECT_FALSE(private_data.history_id_word_map_.empty());
   EXPECT_FALSE(private_data.history_info_map_.empty());
   EXPECT_FALSE(private_data.word_starts_map_.empty());
@@ -1102,7 +1388,7 @@ TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   EXPECT_TRUE(private_data.available_words_.empty());
   EXPECT_TRUE(private_data.word_map_.empty());
   EXPECT_TRUE(private_data.char_word_map_.empty());
-  EXPECT_TRUE(private_data.word_id_history_map_.empty());
+  EXPECT_TRUE(private_data.posting_index_.empty());
   EXPECT_TRUE(private_data.history_id_word_map_.empty());
   EXPECT_TRUE(private_data.history_info_map_.empty());
   EXPECT_TRUE(private_data.word_starts_map_.empty());
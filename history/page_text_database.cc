@@ -0,0 +1,105 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/page_text_database.h"
+
+#include "sql/connection.h"
+
+// The page_text table holds the text extracted from visited pages.
+//
+// page_text
+//   url_id             ID of the page in the urls table. Primary key.
+//   time               When the text was stored, used to keep only the most
+//                      recent pages.
+//   body               The text of the page.
+
+namespace history {
+
+PageTextDatabase::PageTextEnumerator::PageTextEnumerator() {
+}
+
+PageTextDatabase::PageTextEnumerator::~PageTextEnumerator() {
+}
+
+bool PageTextDatabase::PageTextEnumerator::GetNextPageText(URLID* url_id,
+                                                           string16* title,
+                                                           string16* body) {
+  if (!statement_.Step())
+    return false;
+  *url_id = statement_.ColumnInt64(0);
+  *title = statement_.ColumnString16(1);
+  *body = statement_.ColumnString16(2);
+  return true;
+}
+
+PageTextDatabase::PageTextDatabase() {
+}
+
+PageTextDatabase::~PageTextDatabase() {
+}
+
+bool PageTextDatabase::SetPageText(URLID url_id,
+                                   const string16& body,
+                                   base::Time time) {
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "INSERT OR REPLACE INTO page_text (url_id, time, body) "
+      "VALUES (?, ?, ?)"));
+  statement.BindInt64(0, url_id);
+  statement.BindInt64(1, time.ToInternalValue());
+  statement.BindString16(2, body);
+  return statement.Run();
+}
+
+bool PageTextDatabase::GetPageText(URLID url_id, string16* body) {
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "SELECT body FROM page_text WHERE url_id = ?"));
+  statement.BindInt64(0, url_id);
+  if (!statement.Step())
+    return false;
+  *body = statement.ColumnString16(0);
+  return true;
+}
+
+bool PageTextDatabase::DeletePageText(URLID url_id) {
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "DELETE FROM page_text WHERE url_id = ?"));
+  statement.BindInt64(0, url_id);
+  return statement.Run();
+}
+
+bool PageTextDatabase::TrimPageText(int max_pages) {
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "DELETE FROM page_text WHERE url_id NOT IN "
+      "(SELECT url_id FROM page_text ORDER BY time DESC LIMIT ?)"));
+  statement.BindInt(0, max_pages);
+  return statement.Run();
+}
+
+bool PageTextDatabase::InitPageTextEnumerator(
+    PageTextEnumerator* enumerator) {
+  enumerator->statement_.Assign(GetDB().GetUniqueStatement(
+      "SELECT page_text.url_id, urls.title, page_text.body "
+      "FROM page_text JOIN urls ON page_text.url_id = urls.id "
+      "ORDER BY page_text.time DESC"));
+  return enumerator->statement_.is_valid();
+}
+
+bool PageTextDatabase::InitPageTextTable() {
+  if (!GetDB().DoesTableExist("page_text")) {
+    if (!GetDB().Execute("CREATE TABLE page_text ("
+        "url_id INTEGER PRIMARY KEY,"
+        "time INTEGER NOT NULL,"
+        "body LONGVARCHAR)"))
+      return false;
+  }
+  return GetDB().Execute(
+      "CREATE INDEX IF NOT EXISTS page_text_time ON page_text(time)");
+}
+
+bool PageTextDatabase::DropPageTextTable() {
+  // This will also drop the index over the table.
+  return GetDB().Execute("DROP TABLE IF EXISTS page_text");
+}
+
+}  // namespace history
@@ -0,0 +1,81 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_PAGE_TEXT_DATABASE_H_
+#define CHROME_BROWSER_HISTORY_PAGE_TEXT_DATABASE_H_
+
+#include "base/basictypes.h"
+#include "base/strings/string16.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/history_types.h"
+#include "sql/statement.h"
+
+namespace sql {
+class Connection;
+}
+
+namespace history {
+
+// Stores the text extracted from visited pages, which PageTextIndex indexes
+// for full text history search. Each URL has at most one text, the one its
+// last load produced.
+class PageTextDatabase {
+ public:
+  // Enumerates the stored texts, newest first.
+  class PageTextEnumerator {
+   public:
+    PageTextEnumerator();
+    ~PageTextEnumerator();
+
+    // Retrieves the ID, title and text of the next page. Returns false when
+    // there are no more.
+    bool GetNextPageText(URLID* url_id, string16* title, string16* body);
+
+   private:
+    friend class PageTextDatabase;
+
+    sql::Statement statement_;
+
+    DISALLOW_COPY_AND_ASSIGN(PageTextEnumerator);
+  };
+
+  // Must call InitPageTextTable before using any other part of this class.
+  PageTextDatabase();
+  virtual ~PageTextDatabase();
+
+  // Stores |body| as the text of the page with |url_id|, replacing any text it
+  // had, and marks it as stored at |time|. Returns true on success.
+  bool SetPageText(URLID url_id, const string16& body, base::Time time);
+
+  // Reads the text of the page with |url_id| into |body|. Returns false if the
+  // page has no text.
+  bool GetPageText(URLID url_id, string16* body);
+
+  // Deletes the text of the page with |url_id|, if any.
+  bool DeletePageText(URLID url_id);
+
+  // Deletes the texts of all but the |max_pages| most recently stored pages.
+  bool TrimPageText(int max_pages);
+
+  // Initializes |enumerator| to read every stored text along with the title
+  // of its page. Returns true on success.
+  bool InitPageTextEnumerator(PageTextEnumerator* enumerator);
+
+ protected:
+  // Returns the database for the functions in this interface.
+  virtual sql::Connection& GetDB() = 0;
+
+  // Creates the page text table if necessary. Returns true on success.
+  bool InitPageTextTable();
+
+  // Deletes the page text table, returning true on success.
+  bool DropPageTextTable();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PageTextDatabase);
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_PAGE_TEXT_DATABASE_H_
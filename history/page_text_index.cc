@@ -0,0 +1,277 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/page_text_index.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "base/i18n/case_conversion.h"
+#include "base/logging.h"
+#include "chrome/browser/history/query_parser.h"
+
+namespace history {
+
+namespace {
+
+// Longer words are not indexed; they are almost always junk such as encoded
+// data, and would only bloat the index.
+const size_t kMaxWordLength = 64;
+
+// Rough per-entry overheads of the maps, for EstimateMemoryUsage().
+const size_t kTermOverhead = 64;
+const size_t kPageOverhead = 96;
+
+}  // namespace
+
+PageTextIndex::Page::Page() : sequence_number(0) {
+}
+
+PageTextIndex::Page::~Page() {
+}
+
+PageTextIndex::PageTextIndex()
+    : next_sequence_number_(0),
+      first_sequence_number_(0),
+      posting_list_bytes_(0),
+      term_bytes_(0),
+      page_term_count_(0) {
+}
+
+PageTextIndex::~PageTextIndex() {
+}
+
+void PageTextIndex::AddPage(URLID url_id,
+                            const string16& title,
+                            const string16& body) {
+  DCHECK(pending_postings_.empty());
+  RemovePage(url_id);
+  const std::vector<TermID>& terms =
+      AddPageTerms(url_id, next_sequence_number_++, title, body);
+  for (std::vector<TermID>::const_iterator i = terms.begin();
+       i != terms.end(); ++i) {
+    PostingList& posting_list = posting_lists_[*i];
+    posting_list_bytes_ -= posting_list.EstimateMemoryUsage();
+    posting_list.Insert(url_id);
+    posting_list_bytes_ += posting_list.EstimateMemoryUsage();
+  }
+}
+
+void PageTextIndex::AddOlderPage(URLID url_id,
+                                 const string16& title,
+                                 const string16& body) {
+  if (HasPage(url_id))
+    return;
+  const std::vector<TermID>& terms =
+      AddPageTerms(url_id, --first_sequence_number_, title, body);
+  for (std::vector<TermID>::const_iterator i = terms.begin();
+       i != terms.end(); ++i)
+    pending_postings_.push_back(std::make_pair(*i, url_id));
+}
+
+void PageTextIndex::FinishAddingOlderPages() {
+  std::sort(pending_postings_.begin(), pending_postings_.end());
+  std::vector<URLID> url_ids;
+  PendingPostings::const_iterator i = pending_postings_.begin();
+  while (i != pending_postings_.end()) {
+    const TermID term = i->first;
+    PostingList& posting_list = posting_lists_[term];
+    url_ids.clear();
+    posting_list.DecodeTo(&url_ids);
+    const size_t old_size = url_ids.size();
+    for (; i != pending_postings_.end() && i->first == term; ++i)
+      url_ids.push_back(i->second);
+    // The pages were not in the index before, so no ID is in both halves.
+    std::inplace_merge(url_ids.begin(), url_ids.begin() + old_size,
+                       url_ids.end());
+    posting_list_bytes_ -= posting_list.EstimateMemoryUsage();
+    posting_list.Assign(url_ids);
+    posting_list_bytes_ += posting_list.EstimateMemoryUsage();
+  }
+  PendingPostings().swap(pending_postings_);
+}
+
+void PageTextIndex::RemovePage(URLID url_id) {
+  DCHECK(pending_postings_.empty());
+  PageMap::iterator page = pages_.find(url_id);
+  if (page == pages_.end())
+    return;
+  for (std::vector<TermID>::const_iterator i = page->second.terms.begin();
+       i != page->second.terms.end(); ++i) {
+    PostingList& posting_list = posting_lists_[*i];
+    posting_list_bytes_ -= posting_list.EstimateMemoryUsage();
+    posting_list.Erase(url_id);
+    posting_list_bytes_ += posting_list.EstimateMemoryUsage();
+    if (posting_list.empty())
+      RemoveTerm(*i);
+  }
+  page_term_count_ -= page->second.terms.size();
+  pages_by_sequence_number_.erase(page->second.sequence_number);
+  pages_.erase(page);
+}
+
+void PageTextIndex::Clear() {
+  terms_.clear();
+  term_words_.clear();
+  posting_lists_.clear();
+  free_term_ids_.clear();
+  pages_.clear();
+  pages_by_sequence_number_.clear();
+  PendingPostings().swap(pending_postings_);
+  posting_list_bytes_ = 0;
+  term_bytes_ = 0;
+  page_term_count_ = 0;
+}
+
+bool PageTextIndex::HasPage(URLID url_id) const {
+  return pages_.find(url_id) != pages_.end();
+}
+
+void PageTextIndex::FindCandidates(const std::vector<QueryNode*>& query_nodes,
+                                   std::vector<URLID>* url_ids) const {
+  url_ids->clear();
+  for (size_t i = 0; i < query_nodes.size(); ++i) {
+    std::vector<URLID> node_url_ids;
+    FindCandidatesForNode(*query_nodes[i], &node_url_ids);
+    if (i == 0) {
+      url_ids->swap(node_url_ids);
+    } else {
+      std::vector<URLID> intersection;
+      std::set_intersection(url_ids->begin(), url_ids->end(),
+                            node_url_ids.begin(), node_url_ids.end(),
+                            std::back_inserter(intersection));
+      url_ids->swap(intersection);
+    }
+    if (url_ids->empty())
+      return;
+  }
+}
+
+URLID PageTextIndex::GetOldestPage() const {
+  return pages_by_sequence_number_.empty() ?
+      0 : pages_by_sequence_number_.begin()->second;
+}
+
+size_t PageTextIndex::EstimateMemoryUsage() const {
+  // Each pending posting takes at least a byte once encoded.
+  return posting_list_bytes_ + pending_postings_.size() + term_bytes_ +
+      terms_.size() * (kTermOverhead + sizeof(TermMap::iterator)) +
+      page_term_count_ * sizeof(TermID) + pages_.size() * kPageOverhead;
+}
+
+// static
+void PageTextIndex::ExtractWords(const string16& text,
+                                 std::vector<string16>* words) {
+  // Split the text the way QueryParser does, so that the words match the ones
+  // it extracts from queries.
+  QueryParser parser;
+  std::vector<QueryWord> query_words;
+  parser.ExtractQueryWords(base::i18n::ToLower(text), &query_words);
+  for (std::vector<QueryWord>::const_iterator i = query_words.begin();
+       i != query_words.end(); ++i) {
+    if (i->word.length() <= kMaxWordLength)
+      words->push_back(i->word);
+  }
+}
+
+const std::vector<PageTextIndex::TermID>& PageTextIndex::AddPageTerms(
+    URLID url_id,
+    int64 sequence_number,
+    const string16& title,
+    const string16& body) {
+  std::vector<string16> words;
+  ExtractWords(title, &words);
+  ExtractWords(body, &words);
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+
+  Page& page = pages_[url_id];
+  page.sequence_number = sequence_number;
+  pages_by_sequence_number_[sequence_number] = url_id;
+  page.terms.reserve(words.size());
+  for (std::vector<string16>::const_iterator i = words.begin();
+       i != words.end(); ++i)
+    page.terms.push_back(AddTerm(*i));
+  page_term_count_ += page.terms.size();
+  return page.terms;
+}
+
+PageTextIndex::TermID PageTextIndex::AddTerm(const string16& word) {
+  TermMap::iterator existing = terms_.find(word);
+  if (existing != terms_.end())
+    return existing->second;
+
+  TermID term;
+  if (free_term_ids_.empty()) {
+    term = posting_lists_.size();
+    posting_lists_.push_back(PostingList());
+    term_words_.push_back(terms_.end());
+  } else {
+    term = free_term_ids_.back();
+    free_term_ids_.pop_back();
+  }
+  term_words_[term] = terms_.insert(std::make_pair(word, term)).first;
+  term_bytes_ += word.length() * sizeof(char16);
+  return term;
+}
+
+void PageTextIndex::RemoveTerm(TermID term) {
+  DCHECK(posting_lists_[term].empty());
+  posting_lists_[term] = PostingList();
+  term_bytes_ -= term_words_[term]->first.length() * sizeof(char16);
+  terms_.erase(term_words_[term]);
+  term_words_[term] = terms_.end();
+  free_term_ids_.push_back(term);
+}
+
+void PageTextIndex::FindCandidatesForNode(const QueryNode& node,
+                                          std::vector<URLID>* url_ids) const {
+  url_ids->clear();
+  std::vector<string16> words;
+  node.AppendWords(&words);
+  if (words.empty())
+    return;
+
+  if (node.IsWord()) {
+    // A lone word may match as a prefix, so take every term starting with it
+    // which the node accepts.
+    const string16& word = words[0];
+    for (TermMap::const_iterator i = terms_.lower_bound(word);
+         i != terms_.end() && i->first.compare(0, word.length(), word) == 0;
+         ++i) {
+      if (!node.Matches(i->first, false))
+        continue;
+      std::vector<URLID> term_url_ids;
+      posting_lists_[i->second].DecodeTo(&term_url_ids);
+      url_ids->insert(url_ids->end(), term_url_ids.begin(),
+                      term_url_ids.end());
+    }
+    std::sort(url_ids->begin(), url_ids->end());
+    url_ids->erase(std::unique(url_ids->begin(), url_ids->end()),
+                   url_ids->end());
+    return;
+  }
+
+  // The words of a phrase must match exactly, so each has at most one term.
+  for (size_t i = 0; i < words.size(); ++i) {
+    TermMap::const_iterator term = terms_.find(words[i]);
+    if (term == terms_.end()) {
+      url_ids->clear();
+      return;
+    }
+    std::vector<URLID> term_url_ids;
+    posting_lists_[term->second].DecodeTo(&term_url_ids);
+    if (i == 0) {
+      url_ids->swap(term_url_ids);
+    } else {
+      std::vector<URLID> intersection;
+      std::set_intersection(url_ids->begin(), url_ids->end(),
+                            term_url_ids.begin(), term_url_ids.end(),
+                            std::back_inserter(intersection));
+      url_ids->swap(intersection);
+    }
+  }
+}
+
+}  // namespace history
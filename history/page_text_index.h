@@ -0,0 +1,139 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_PAGE_TEXT_INDEX_H_
+#define CHROME_BROWSER_HISTORY_PAGE_TEXT_INDEX_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/string16.h"
+#include "chrome/browser/history/history_types.h"
+#include "chrome/browser/history/url_index_posting_list.h"
+
+class QueryNode;
+
+namespace history {
+
+// An in-memory inverted index from the words of page titles and texts to the
+// pages containing them, used by HistoryBackend for full text history search.
+// Pages are added as their text arrives and removed as they are deleted, so
+// the index never has to be rebuilt.
+//
+// To keep the index small, each word's list of pages is stored as a
+// PostingList of variable length deltas between the sorted URL IDs.
+class PageTextIndex {
+ public:
+  PageTextIndex();
+  ~PageTextIndex();
+
+  // Indexes the words of |title| and |body| as the text of the page with
+  // |url_id|, replacing whatever it was indexed with before. The page becomes
+  // the most recently added one.
+  void AddPage(URLID url_id, const string16& title, const string16& body);
+
+  // Indexes a page which is older than every page in the index, unless the
+  // page is already there. Its posting list entries are only collected, and
+  // FinishAddingOlderPages() then merges them in with a single encoding of
+  // each list, so that loading the stored pages, newest first, takes time
+  // linear in their text. Nothing else may change the index in between.
+  void AddOlderPage(URLID url_id, const string16& title, const string16& body);
+  void FinishAddingOlderPages();
+
+  // Removes the page with |url_id| from the index, if it is there.
+  void RemovePage(URLID url_id);
+
+  // Removes every page.
+  void Clear();
+
+  bool HasPage(URLID url_id) const;
+
+  // Puts into |url_ids|, in ascending order, the pages which have a word
+  // matching each node of |query_nodes|, as parsed by QueryParser. This is a
+  // superset of the pages matching the query: the words of a phrase need not
+  // be adjacent, so the caller must check each page's text.
+  void FindCandidates(const std::vector<QueryNode*>& query_nodes,
+                      std::vector<URLID>* url_ids) const;
+
+  // Returns the page which was added longest ago, or 0 if there is none.
+  URLID GetOldestPage() const;
+
+  // Returns the approximate number of bytes the index uses. Pages added by
+  // AddOlderPage() count as their smallest possible encoding.
+  size_t EstimateMemoryUsage() const;
+
+  size_t page_count() const { return pages_.size(); }
+
+ private:
+  typedef size_t TermID;
+  typedef std::vector<std::pair<TermID, URLID> > PendingPostings;
+
+  struct Page {
+    Page();
+    ~Page();
+
+    // When the page was added, relative to the other pages.
+    int64 sequence_number;
+
+    // The terms the page contains, for removing it.
+    std::vector<TermID> terms;
+  };
+
+  // Puts the distinct lower case words of |text| into |words|.
+  static void ExtractWords(const string16& text, std::vector<string16>* words);
+
+  // Adds |url_id| to |pages_| as a page containing |title| and |body|, with
+  // |sequence_number|, and returns the terms it contains.
+  const std::vector<TermID>& AddPageTerms(URLID url_id,
+                                          int64 sequence_number,
+                                          const string16& title,
+                                          const string16& body);
+
+  // Returns the ID of |word|, adding it as a new term if it is not one.
+  TermID AddTerm(const string16& word);
+
+  // Removes |term|, which no page contains any more.
+  void RemoveTerm(TermID term);
+
+  // Puts the pages matching |node| into |url_ids|.
+  void FindCandidatesForNode(const QueryNode& node,
+                             std::vector<URLID>* url_ids) const;
+
+  // Maps each indexed word to its term ID, in word order so that prefixes can
+  // be looked up.
+  typedef std::map<string16, TermID> TermMap;
+  TermMap terms_;
+
+  // The term for each posting list, and the pages containing it, both
+  // indexed by term ID. Removed terms leave an empty slot which is
+  // listed in |free_term_ids_| for reuse.
+  std::vector<TermMap::iterator> term_words_;
+  std::vector<PostingList> posting_lists_;
+  std::vector<TermID> free_term_ids_;
+
+  // The indexed pages, and their IDs in the order they were added.
+  typedef std::map<URLID, Page> PageMap;
+  PageMap pages_;
+  std::map<int64, URLID> pages_by_sequence_number_;
+  int64 next_sequence_number_;
+
+  // The sequence number of the oldest page added by AddOlderPage(), and the
+  // term and page pairs it has collected for FinishAddingOlderPages().
+  int64 first_sequence_number_;
+  PendingPostings pending_postings_;
+
+  // The sizes which EstimateMemoryUsage() adds up, kept up to date as terms
+  // and pages come and go.
+  size_t posting_list_bytes_;
+  size_t term_bytes_;
+  size_t page_term_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(PageTextIndex);
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_PAGE_TEXT_INDEX_H_
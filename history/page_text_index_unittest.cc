@@ -0,0 +1,129 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/memory/scoped_vector.h"
+#include "base/strings/utf_string_conversions.h"
+#include "chrome/browser/history/page_text_index.h"
+#include "chrome/browser/history/query_parser.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace history {
+
+class PageTextIndexTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    index_.AddPage(1, ASCIIToUTF16("Google"),
+                   ASCIIToUTF16("Search the world's information"));
+    index_.AddPage(2, ASCIIToUTF16("Slashdot"),
+                   ASCIIToUTF16("News for nerds, stuff that matters"));
+    index_.AddPage(300, ASCIIToUTF16("Google News"),
+                   ASCIIToUTF16("Top stories from around the world"));
+  }
+
+  // Returns the candidates for |query|.
+  std::vector<URLID> Find(const char* query) {
+    QueryParser parser;
+    ScopedVector<QueryNode> query_nodes;
+    parser.ParseQueryNodes(ASCIIToUTF16(query), &query_nodes.get());
+    std::vector<URLID> url_ids;
+    index_.FindCandidates(query_nodes.get(), &url_ids);
+    return url_ids;
+  }
+
+  PageTextIndex index_;
+};
+
+TEST_F(PageTextIndexTest, FindCandidates) {
+  // Titles and texts, ignoring case.
+  std::vector<URLID> url_ids = Find("NEWS");
+  ASSERT_EQ(2U, url_ids.size());
+  EXPECT_EQ(2, url_ids[0]);
+  EXPECT_EQ(300, url_ids[1]);
+
+  // Every word must match.
+  url_ids = Find("google world");
+  ASSERT_EQ(2U, url_ids.size());
+  EXPECT_EQ(1, url_ids[0]);
+  EXPECT_EQ(300, url_ids[1]);
+  EXPECT_TRUE(Find("google nerds").empty());
+
+  // Long enough words match as prefixes.
+  EXPECT_EQ(1U, Find("informa").size());
+  EXPECT_EQ(1U, Find("nerd").size());
+  EXPECT_TRUE(Find("ne").empty());
+
+  // Phrase words match exactly, but need not be adjacent.
+  EXPECT_TRUE(Find("\"informa\"").empty());
+  EXPECT_EQ(1U, Find("\"world stories\"").size());
+
+  EXPECT_TRUE(Find("").empty());
+  EXPECT_TRUE(Find("yahoo").empty());
+}
+
+TEST_F(PageTextIndexTest, AddAndRemove) {
+  EXPECT_EQ(3U, index_.page_count());
+  EXPECT_EQ(1, index_.GetOldestPage());
+  const size_t memory_usage = index_.EstimateMemoryUsage();
+
+  // Adding a page again replaces its text and makes it the newest.
+  index_.AddPage(1, ASCIIToUTF16("Google"), ASCIIToUTF16("Images"));
+  EXPECT_EQ(3U, index_.page_count());
+  EXPECT_EQ(2, index_.GetOldestPage());
+  EXPECT_TRUE(Find("information").empty());
+  EXPECT_EQ(1U, Find("images").size());
+  EXPECT_LT(index_.EstimateMemoryUsage(), memory_usage);
+
+  index_.RemovePage(2);
+  EXPECT_FALSE(index_.HasPage(2));
+  EXPECT_EQ(300, index_.GetOldestPage());
+  EXPECT_EQ(1U, Find("news").size());
+  EXPECT_TRUE(Find("nerds").empty());
+  // Removing it again, or a page which was never added, does nothing.
+  index_.RemovePage(2);
+  index_.RemovePage(42);
+  EXPECT_EQ(2U, index_.page_count());
+
+  index_.Clear();
+  EXPECT_EQ(0U, index_.page_count());
+  EXPECT_EQ(0, index_.GetOldestPage());
+  EXPECT_EQ(0U, index_.EstimateMemoryUsage());
+  EXPECT_TRUE(Find("google").empty());
+}
+
+TEST_F(PageTextIndexTest, AddOlderPages) {
+  // Pages loaded newest first are merged in behind the existing ones.
+  const size_t memory_usage = index_.EstimateMemoryUsage();
+  index_.AddOlderPage(200, ASCIIToUTF16("World News"),
+                      ASCIIToUTF16("Breaking stories"));
+  index_.AddOlderPage(100, ASCIIToUTF16("Google Archive"),
+                      ASCIIToUTF16("Search the world"));
+  // A page already in the index keeps its newer text.
+  index_.AddOlderPage(2, ASCIIToUTF16("Slashdot"), ASCIIToUTF16("Old news"));
+  // Their postings count while they are pending, and once merged.
+  EXPECT_GT(index_.EstimateMemoryUsage(), memory_usage);
+  index_.FinishAddingOlderPages();
+  EXPECT_GT(index_.EstimateMemoryUsage(), memory_usage);
+
+  EXPECT_EQ(5U, index_.page_count());
+  EXPECT_EQ(100, index_.GetOldestPage());
+  std::vector<URLID> url_ids = Find("news");
+  ASSERT_EQ(3U, url_ids.size());
+  EXPECT_EQ(2, url_ids[0]);
+  EXPECT_EQ(200, url_ids[1]);
+  EXPECT_EQ(300, url_ids[2]);
+  url_ids = Find("google world");
+  ASSERT_EQ(3U, url_ids.size());
+  EXPECT_EQ(1, url_ids[0]);
+  EXPECT_EQ(100, url_ids[1]);
+  EXPECT_EQ(300, url_ids[2]);
+  EXPECT_TRUE(Find("old").empty());
+  EXPECT_EQ(1U, Find("breaking").size());
+
+  // The pages are removed like any others, oldest first.
+  index_.RemovePage(index_.GetOldestPage());
+  EXPECT_EQ(200, index_.GetOldestPage());
+  EXPECT_EQ(2U, Find("google world").size());
+}
+
+}  // namespace history
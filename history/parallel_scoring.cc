@@ -0,0 +1,99 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/parallel_scoring.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/callback.h"
+#include "base/location.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/worker_pool.h"
+
+namespace history {
+
+namespace {
+
+// The shards of one RunShardsInParallel() call, claimed one at a time by each
+// participating thread until none are left.
+class ShardQueue : public base::RefCountedThreadSafe<ShardQueue> {
+ public:
+  ShardQueue(size_t num_shards, const base::Callback<void(size_t)>& run_shard)
+      : num_shards_(static_cast<base::subtle::Atomic32>(num_shards)),
+        next_shard_(0),
+        finished_shards_(0),
+        all_shards_finished_(true, false),
+        run_shard_(run_shard) {}
+
+  // Runs unclaimed shards until there are none left.
+  void RunShards() {
+    while (true) {
+      base::subtle::Atomic32 shard =
+          base::subtle::NoBarrier_AtomicIncrement(&next_shard_, 1) - 1;
+      if (shard >= num_shards_)
+        return;
+      run_shard_.Run(static_cast<size_t>(shard));
+      // Whichever thread finishes the last shard wakes the caller.
+      if (base::subtle::Barrier_AtomicIncrement(&finished_shards_, 1) ==
+          num_shards_)
+        all_shards_finished_.Signal();
+    }
+  }
+
+  // Blocks until every shard has finished running.
+  void WaitForAllShards() {
+    all_shards_finished_.Wait();
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<ShardQueue>;
+  ~ShardQueue() {}
+
+  const base::subtle::Atomic32 num_shards_;
+  base::subtle::Atomic32 next_shard_;
+  base::subtle::Atomic32 finished_shards_;
+  base::WaitableEvent all_shards_finished_;
+  const base::Callback<void(size_t)> run_shard_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShardQueue);
+};
+
+}  // namespace
+
+// ScoringCancellationFlag -----------------------------------------------------
+
+ScoringCancellationFlag::ScoringCancellationFlag() : canceled_(0) {}
+
+ScoringCancellationFlag::~ScoringCancellationFlag() {}
+
+void ScoringCancellationFlag::Cancel() {
+  base::subtle::Release_Store(&canceled_, 1);
+}
+
+bool ScoringCancellationFlag::IsCanceled() const {
+  return base::subtle::Acquire_Load(&canceled_) != 0;
+}
+
+// RunShardsInParallel ---------------------------------------------------------
+
+void RunShardsInParallel(size_t num_shards,
+                         size_t max_worker_threads,
+                         const base::Callback<void(size_t)>& run_shard) {
+  if (num_shards == 0)
+    return;
+  scoped_refptr<ShardQueue> queue(new ShardQueue(num_shards, run_shard));
+  size_t worker_threads = std::min(max_worker_threads, num_shards - 1);
+  for (size_t i = 0; i < worker_threads; ++i) {
+    base::WorkerPool::PostTask(
+        FROM_HERE, base::Bind(&ShardQueue::RunShards, queue), false);
+  }
+  queue->RunShards();
+  // Every shard has now been claimed; wait for those still running on
+  // workers. A worker which starts after this point finds nothing left to
+  // claim.
+  queue->WaitForAllShards();
+}
+
+}  // namespace history
@@ -0,0 +1,51 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_PARALLEL_SCORING_H_
+#define CHROME_BROWSER_HISTORY_PARALLEL_SCORING_H_
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/callback_forward.h"
+#include "base/memory/ref_counted.h"
+
+namespace history {
+
+// A flag, shared between a query and the threads scoring its candidates,
+// which is set when the query is superseded by a newer one so that the
+// remaining candidates are not scored. Unlike base::CancellationFlag it may
+// be set on any thread.
+class ScoringCancellationFlag
+    : public base::RefCountedThreadSafe<ScoringCancellationFlag> {
+ public:
+  ScoringCancellationFlag();
+
+  void Cancel();
+  bool IsCanceled() const;
+
+ private:
+  friend class base::RefCountedThreadSafe<ScoringCancellationFlag>;
+  ~ScoringCancellationFlag();
+
+  base::subtle::Atomic32 canceled_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScoringCancellationFlag);
+};
+
+// Runs |run_shard| once for each shard index in [0, |num_shards|), on the
+// calling thread and concurrently on up to |max_worker_threads| worker pool
+// threads, and returns once every shard has been run. Shards are claimed in
+// index order but may finish in any order, so |run_shard| must write only to
+// state belonging to its shard; the caller merges the shards' results in
+// index order to get the same outcome as a serial run. Any state |run_shard|
+// reads must not change until this returns. This blocks on the workers, so
+// it must not be called on a thread which disallows waiting, such as the UI
+// thread.
+void RunShardsInParallel(size_t num_shards,
+                         size_t max_worker_threads,
+                         const base::Callback<void(size_t)>& run_shard);
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_PARALLEL_SCORING_H_
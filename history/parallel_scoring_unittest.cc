@@ -0,0 +1,46 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/bind.h"
+#include "base/callback.h"
+#include "chrome/browser/history/parallel_scoring.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace history {
+
+namespace {
+
+void CountShard(std::vector<base::subtle::Atomic32>* runs, size_t shard) {
+  base::subtle::NoBarrier_AtomicIncrement(&(*runs)[shard], 1);
+}
+
+}  // namespace
+
+TEST(ParallelScoringTest, RunsEveryShardOnce) {
+  const size_t kNumShards[] = { 0, 1, 2, 37 };
+  const size_t kWorkerThreads[] = { 0, 1, 3, 100 };
+  for (size_t i = 0; i < arraysize(kNumShards); ++i) {
+    for (size_t j = 0; j < arraysize(kWorkerThreads); ++j) {
+      std::vector<base::subtle::Atomic32> runs(kNumShards[i], 0);
+      RunShardsInParallel(kNumShards[i], kWorkerThreads[j],
+                          base::Bind(&CountShard, &runs));
+      for (size_t shard = 0; shard < runs.size(); ++shard)
+        EXPECT_EQ(1, base::subtle::Acquire_Load(&runs[shard]));
+    }
+  }
+}
+
+TEST(ParallelScoringTest, CancellationFlag) {
+  scoped_refptr<ScoringCancellationFlag> flag(new ScoringCancellationFlag);
+  EXPECT_FALSE(flag->IsCanceled());
+  flag->Cancel();
+  EXPECT_TRUE(flag->IsCanceled());
+  flag->Cancel();
+  EXPECT_TRUE(flag->IsCanceled());
+}
+
+}  // namespace history
@@ -50,6 +50,38 @@ ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
     : HistoryMatch(row, 0, false, false),
       raw_score(0),
       can_inline(false) {
+  RowTermMatches term_matches;
+  Init(row, visits, languages, lower_string, terms, word_starts, now,
+       bookmark_service, 0, &term_matches);
+}
+
+ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
+                                       const VisitInfoVector& visits,
+                                       const std::string& languages,
+                                       const string16& lower_string,
+                                       const String16Vector& terms,
+                                       const RowWordStarts& word_starts,
+                                       const base::Time now,
+                                       BookmarkService* bookmark_service,
+                                       size_t reusable_terms,
+                                       RowTermMatches* term_matches)
+    : HistoryMatch(row, 0, false, false),
+      raw_score(0),
+      can_inline(false) {
+  Init(row, visits, languages, lower_string, terms, word_starts, now,
+       bookmark_service, reusable_terms, term_matches);
+}
+
+void ScoredHistoryMatch::Init(const URLRow& row,
+                              const VisitInfoVector& visits,
+                              const std::string& languages,
+                              const string16& lower_string,
+                              const String16Vector& terms,
+                              const RowWordStarts& word_starts,
+                              const base::Time now,
+                              BookmarkService* bookmark_service,
+                              size_t reusable_terms,
+                              RowTermMatches* term_matches) {
   if (!initialized_) {
     InitializeAlsoDoHUPLikeScoringFieldAndMaxScoreField();
     initialized_ = true;
@@ -60,17 +92,35 @@ ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
     return;
 
   // Figure out where each search term appears in the URL and/or page title
-  // so that we can score as well as provide autocomplete highlighting.
-  string16 url = CleanUpUrlForMatching(gurl, languages);
-  string16 title = CleanUpTitleForMatching(row.title());
-  int term_num = 0;
-  for (String16Vector::const_iterator iter = terms.begin(); iter != terms.end();
-       ++iter, ++term_num) {
-    string16 term = *iter;
-    TermMatches url_term_matches = MatchTermInString(term, url, term_num);
-    TermMatches title_term_matches = MatchTermInString(term, title, term_num);
-    if (url_term_matches.empty() && title_term_matches.empty())
-      return;  // A term was not found in either URL or title - reject.
+  // so that we can score as well as provide autocomplete highlighting. The
+  // matches of terms carried over from an earlier search are reused.
+  DCHECK(term_matches);
+  DCHECK_LE(reusable_terms, term_matches->url_term_matches_.size());
+  DCHECK_LE(reusable_terms, terms.size());
+  if (reusable_terms == 0) {
+    term_matches->url_ = CleanUpUrlForMatching(gurl, languages);
+    term_matches->title_ = CleanUpTitleForMatching(row.title());
+  }
+  term_matches->url_term_matches_.resize(reusable_terms);
+  term_matches->title_term_matches_.resize(reusable_terms);
+  const string16& url = term_matches->url_;
+  const string16& title = term_matches->title_;
+  for (size_t term_num = 0; term_num < terms.size(); ++term_num) {
+    if (term_num >= reusable_terms) {
+      const string16& term = terms[term_num];
+      TermMatches url_term_matches =
+          MatchTermInString(term, url, static_cast<int>(term_num));
+      TermMatches title_term_matches =
+          MatchTermInString(term, title, static_cast<int>(term_num));
+      if (url_term_matches.empty() && title_term_matches.empty())
+        return;  // A term was not found in either URL or title - reject.
+      term_matches->url_term_matches_.push_back(url_term_matches);
+      term_matches->title_term_matches_.push_back(title_term_matches);
+    }
+    const TermMatches& url_term_matches =
+        term_matches->url_term_matches_[term_num];
+    const TermMatches& title_term_matches =
+        term_matches->title_term_matches_[term_num];
     url_matches.insert(url_matches.end(), url_term_matches.begin(),
                        url_term_matches.end());
     title_matches.insert(title_matches.end(), title_term_matches.begin(),
@@ -250,16 +300,17 @@ float ScoredHistoryMatch::GetTopicalityScore(
     const TermMatches& url_matches,
     const TermMatches& title_matches,
     const RowWordStarts& word_starts) {
-  // Because the below thread is not thread safe, we check that we're
-  // only calling it from one thread: the UI thread.  Specifically,
-  // we check "if we've heard of the UI thread then we'd better
-  // be on it."  The first part is necessary so unit tests pass.  (Many
-  // unit tests don't set up the threading naming system; hence
-  // CurrentlyOn(UI thread) will fail.)
-  DCHECK(!content::BrowserThread::IsThreadInitialized(
-             content::BrowserThread::UI) ||
-         content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
   if (raw_term_score_to_topicality_score == NULL) {
+    // Because the lazy initialization below is not thread safe, we check
+    // that it happens on one thread: the UI thread.  Specifically, we check
+    // "if we've heard of the UI thread then we'd better be on it."  The
+    // first part is necessary so unit tests pass.  (Many unit tests don't
+    // set up the threading naming system; hence CurrentlyOn(UI thread) will
+    // fail.)  Scoring on other threads must be preceded by a call to
+    // PrepareForConcurrentScoring().
+    DCHECK(!content::BrowserThread::IsThreadInitialized(
+               content::BrowserThread::UI) ||
+           content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
     raw_term_score_to_topicality_score = new float[kMaxRawTermScore];
     FillInTermScoreToTopicalityScoreArray();
   }
@@ -394,16 +445,11 @@ float* ScoredHistoryMatch::days_ago_to_recency_score = NULL;
 
 // static
 float ScoredHistoryMatch::GetRecencyScore(int last_visit_days_ago) {
-  // Because the below thread is not thread safe, we check that we're
-  // only calling it from one thread: the UI thread.  Specifically,
-  // we check "if we've heard of the UI thread then we'd better
-  // be on it."  The first part is necessary so unit tests pass.  (Many
-  // unit tests don't set up the threading naming system; hence
-  // CurrentlyOn(UI thread) will fail.)
-  DCHECK(!content::BrowserThread::IsThreadInitialized(
-             content::BrowserThread::UI) ||
-         content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
   if (days_ago_to_recency_score == NULL) {
+    // See the comment in GetTopicalityScore().
+    DCHECK(!content::BrowserThread::IsThreadInitialized(
+               content::BrowserThread::UI) ||
+           content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
     days_ago_to_recency_score = new float[kDaysToPrecomputeRecencyScoresFor];
     FillInDaysAgoToRecencyScoreArray();
   }
@@ -513,6 +559,18 @@ float ScoredHistoryMatch::GetFinalRelevancyScore(float topicality_score,
   return std::min(1399.0, 1300 + slope * (intermediate_score - 12.0));
 }
 
+// static
+void ScoredHistoryMatch::PrepareForConcurrentScoring() {
+  if (!initialized_) {
+    InitializeAlsoDoHUPLikeScoringFieldAndMaxScoreField();
+    initialized_ = true;
+  }
+  GetTopicalityScore(1, string16(), TermMatches(), TermMatches(),
+                     RowWordStarts());
+  GetRecencyScore(0);
+  URLPrefix::GetURLPrefixes();
+}
+
 void ScoredHistoryMatch::InitializeAlsoDoHUPLikeScoringFieldAndMaxScoreField() {
   also_do_hup_like_scoring = false;
   // When doing HUP-like scoring, don't allow a non-inlineable match
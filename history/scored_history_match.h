@@ -41,6 +41,23 @@ struct ScoredHistoryMatch : public history::HistoryMatch {
                      const RowWordStarts& word_starts,
                      const base::Time now,
                      BookmarkService* bookmark_service);
+
+  // Same as above, except that the cleaned-up URL and title and the matches
+  // of the first |reusable_terms| terms are taken from |term_matches|, as
+  // left there by scoring the row against an earlier search whose terms
+  // |terms| extend. On return |term_matches| holds the matches of every term
+  // if all of them occur in |row|, otherwise fewer. |reusable_terms| must be
+  // 0 if |term_matches| was not previously filled in for |row|.
+  ScoredHistoryMatch(const URLRow& row,
+                     const VisitInfoVector& visits,
+                     const std::string& languages,
+                     const string16& lower_string,
+                     const String16Vector& terms,
+                     const RowWordStarts& word_starts,
+                     const base::Time now,
+                     BookmarkService* bookmark_service,
+                     size_t reusable_terms,
+                     RowTermMatches* term_matches);
   ~ScoredHistoryMatch();
 
   // Compares two matches by score.  Functor supporting URLIndexPrivateData's
@@ -88,6 +105,11 @@ struct ScoredHistoryMatch : public history::HistoryMatch {
       float topicality_score,
       float frecency_score);
 
+  // Performs the lazy initialization of the static data used in scoring, so
+  // that matches may afterwards be constructed on several threads at once.
+  // Must be called on the UI thread.
+  static void PrepareForConcurrentScoring();
+
   // Sets also_do_hup_like_scoring and
   // max_assigned_score_for_non_inlineable_matches based on the field
   // trial state.
@@ -139,6 +161,19 @@ struct ScoredHistoryMatch : public history::HistoryMatch {
   // will get demoted later in HistoryQuickProvider to non-inlineable scores.
   // Set to -1 to indicate no maximum score.
   static int max_assigned_score_for_non_inlineable_matches;
+
+ private:
+  // Does the work of the constructors.
+  void Init(const URLRow& row,
+            const VisitInfoVector& visits,
+            const std::string& languages,
+            const string16& lower_string,
+            const String16Vector& terms,
+            const RowWordStarts& word_starts,
+            const base::Time now,
+            BookmarkService* bookmark_service,
+            size_t reusable_terms,
+            RowTermMatches* term_matches);
 };
 typedef std::vector<ScoredHistoryMatch> ScoredHistoryMatches;
 
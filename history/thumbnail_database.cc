@@ -14,6 +14,7 @@
 #include "base/memory/ref_counted_memory.h"
 #include "base/metrics/histogram.h"
 #include "base/rand_util.h"
+#include "base/sha1.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_tokenizer.h"
 #include "base/strings/string_util.h"
@@ -67,9 +68,24 @@
 //  last_updated      The time at which this favicon was inserted into the
 //                    table. This is used to determine if it needs to be
 //                    redownloaded from the web.
+//  image_data        Unused since version 8, when the PNG encoded data moved
+//                    to the favicon_bitmap_data table.
+//  width             Pixel width of the bitmap.
+//  height            Pixel height of the bitmap.
+//  data_id           The ID of the row in the favicon_bitmap_data table with
+//                    the PNG encoded data of the bitmap, or 0 if there is no
+//                    data.
+//
+// favicon_bitmap_data  This table contains the PNG encoded data of the
+//                    favicon bitmaps. Identical bitmaps, such as the default
+//                    icons which many sites share, are stored once, and the
+//                    row is deleted when no bitmap refers to it any more.
+//
+//  id                Unique ID.
+//  hash              SHA-1 hash of |image_data|, to find identical bitmaps.
+//  ref_count         The number of rows in favicon_bitmaps which refer to
+//                    this row.
 //  image_data        PNG encoded data of the favicon.
-//  width             Pixel width of |image_data|.
-//  height            Pixel height of |image_data|.
 
 namespace {
 
@@ -278,8 +294,8 @@ void DatabaseErrorCallback(sql::Connection* db,
 namespace history {
 
 // Version number of the database.
-static const int kCurrentVersionNumber = 7;
-static const int kCompatibleVersionNumber = 7;
+static const int kCurrentVersionNumber = 8;
+static const int kCompatibleVersionNumber = 8;
 
 // Use 90 quality (out of 100) which is pretty high, because we're very
 // sensitive to artifacts for these small sized, highly detailed images.
@@ -339,6 +355,7 @@ sql::InitStatus ThumbnailDatabase::Init(
       !InitThumbnailTable() ||
       !InitFaviconBitmapsTable(&db_) ||
       !InitFaviconBitmapsIndex() ||
+      !InitFaviconBitmapDataTable(&db_) ||
       !InitFaviconsTable(&db_) ||
       !InitFaviconsIndex() ||
       !InitIconMappingTable(&db_) ||
@@ -401,9 +418,24 @@ sql::InitStatus ThumbnailDatabase::Init(
       return CantUpgradeToVersion(cur_version);
   }
 
+  // Moving the bitmap data leaves the space it used free, so vacuum to give
+  // it back once the upgrade is committed.
+  bool vacuum = false;
+  if (cur_version == 7) {
+    ++cur_version;
+    if (!UpgradeToVersion8())
+      return CantUpgradeToVersion(cur_version);
+    vacuum = true;
+  }
+
   LOG_IF(WARNING, cur_version < kCurrentVersionNumber) <<
       "Thumbnail database version " << cur_version << " is too old to handle.";
 
+  if (!InitFaviconBitmapDataIndex()) {
+    db_.Close();
+    return sql::INIT_FAILURE;
+  }
+
   // Initialization is complete.
   if (!transaction.Commit()) {
     db_.Close();
@@ -424,6 +456,9 @@ sql::InitStatus ThumbnailDatabase::Init(
     return sql::INIT_FAILURE;
   }
 
+  if (vacuum)
+    Vacuum();
+
   return sql::INIT_OK;
 }
 
@@ -458,6 +493,17 @@ void ThumbnailDatabase::ComputeDatabaseMetrics() {
   UMA_HISTOGRAM_COUNTS_10000(
       "History.NumFaviconsInDB",
       favicon_count.Step() ? favicon_count.ColumnInt(0) : 0);
+
+  // The share of bitmaps whose data is stored with that of another bitmap.
+  sql::Statement bitmap_counts(db_.GetCachedStatement(SQL_FROM_HERE,
+      "SELECT (SELECT COUNT(*) FROM favicon_bitmaps WHERE data_id > 0), "
+      "(SELECT COUNT(*) FROM favicon_bitmap_data)"));
+  if (bitmap_counts.Step() && bitmap_counts.ColumnInt(0) > 0) {
+    const int bitmaps = bitmap_counts.ColumnInt(0);
+    UMA_HISTOGRAM_PERCENTAGE(
+        "History.FaviconBitmapsSharingData",
+        (bitmaps - bitmap_counts.ColumnInt(1)) * 100 / bitmaps);
+  }
 }
 
 bool ThumbnailDatabase::InitThumbnailTable() {
@@ -533,7 +579,8 @@ bool ThumbnailDatabase::InitFaviconBitmapsTable(sql::Connection* db) {
       "last_updated INTEGER DEFAULT 0,"
       "image_data BLOB,"
       "width INTEGER DEFAULT 0,"
-      "height INTEGER DEFAULT 0"
+      "height INTEGER DEFAULT 0,"
+      "data_id INTEGER DEFAULT 0"
       ")";
   return db->Execute(kSql);
 }
@@ -544,6 +591,26 @@ bool ThumbnailDatabase::InitFaviconBitmapsIndex() {
                      "favicon_bitmaps(icon_id)");
 }
 
+bool ThumbnailDatabase::InitFaviconBitmapDataTable(sql::Connection* db) {
+  const char kSql[] =
+      "CREATE TABLE IF NOT EXISTS favicon_bitmap_data"
+      "("
+      "id INTEGER PRIMARY KEY,"
+      "hash BLOB NOT NULL,"
+      "ref_count INTEGER DEFAULT 0,"
+      "image_data BLOB"
+      ")";
+  return db->Execute(kSql);
+}
+
+bool ThumbnailDatabase::InitFaviconBitmapDataIndex() {
+  return
+      db_.Execute("CREATE INDEX IF NOT EXISTS favicon_bitmap_data_hash ON "
+                  "favicon_bitmap_data(hash)") &&
+      db_.Execute("CREATE INDEX IF NOT EXISTS favicon_bitmaps_data_id ON "
+                  "favicon_bitmaps(data_id)");
+}
+
 bool ThumbnailDatabase::IsFaviconDBStructureIncorrect() {
   return !db_.IsSQLValid("SELECT id, url, icon_type FROM favicons");
 }
@@ -707,8 +774,10 @@ bool ThumbnailDatabase::GetFaviconBitmaps(
     std::vector<FaviconBitmap>* favicon_bitmaps) {
   DCHECK(icon_id);
   sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
-      "SELECT id, last_updated, image_data, width, height FROM favicon_bitmaps "
-      "WHERE icon_id=?"));
+      "SELECT b.id, b.last_updated, d.image_data, b.width, b.height "
+      "FROM favicon_bitmaps AS b "
+      "LEFT JOIN favicon_bitmap_data AS d ON (b.data_id = d.id) "
+      "WHERE b.icon_id=?"));
   statement.BindInt64(0, icon_id);
 
   bool result = false;
@@ -741,8 +810,10 @@ bool ThumbnailDatabase::GetFaviconBitmap(
     gfx::Size* pixel_size) {
   DCHECK(bitmap_id);
   sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
-      "SELECT last_updated, image_data, width, height FROM favicon_bitmaps "
-      "WHERE id=?"));
+      "SELECT b.last_updated, d.image_data, b.width, b.height "
+      "FROM favicon_bitmaps AS b "
+      "LEFT JOIN favicon_bitmap_data AS d ON (b.data_id = d.id) "
+      "WHERE b.id=?"));
   statement.BindInt64(0, bitmap_id);
 
   if (!statement.Step())
@@ -770,16 +841,15 @@ FaviconBitmapID ThumbnailDatabase::AddFaviconBitmap(
     base::Time time,
     const gfx::Size& pixel_size) {
   DCHECK(icon_id);
+  int64 data_id;
+  if (!AddBitmapDataRef(icon_data, &data_id))
+    return 0;
+
   sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
-      "INSERT INTO favicon_bitmaps (icon_id, image_data, last_updated, width, "
+      "INSERT INTO favicon_bitmaps (icon_id, data_id, last_updated, width, "
       "height) VALUES (?, ?, ?, ?, ?)"));
   statement.BindInt64(0, icon_id);
-  if (icon_data.get() && icon_data->size()) {
-    statement.BindBlob(1, icon_data->front(),
-                       static_cast<int>(icon_data->size()));
-  } else {
-    statement.BindNull(1);
-  }
+  statement.BindInt64(1, data_id);
   statement.BindInt64(2, time.ToInternalValue());
   statement.BindInt(3, pixel_size.width());
   statement.BindInt(4, pixel_size.height());
@@ -794,18 +864,20 @@ bool ThumbnailDatabase::SetFaviconBitmap(
     scoped_refptr<base::RefCountedMemory> bitmap_data,
     base::Time time) {
   DCHECK(bitmap_id);
+  // Add the reference to the new data first, so that data which did not
+  // change is not deleted.
+  const int64 old_data_id = GetBitmapDataID(bitmap_id);
+  int64 data_id;
+  if (!AddBitmapDataRef(bitmap_data, &data_id))
+    return false;
+
   sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
-      "UPDATE favicon_bitmaps SET image_data=?, last_updated=? WHERE id=?"));
-  if (bitmap_data.get() && bitmap_data->size()) {
-    statement.BindBlob(0, bitmap_data->front(),
-                       static_cast<int>(bitmap_data->size()));
-  } else {
-    statement.BindNull(0);
-  }
+      "UPDATE favicon_bitmaps SET data_id=?, last_updated=? WHERE id=?"));
+  statement.BindInt64(0, data_id);
   statement.BindInt64(1, time.ToInternalValue());
   statement.BindInt64(2, bitmap_id);
 
-  return statement.Run();
+  return statement.Run() && ReleaseBitmapData(old_data_id);
 }
 
 bool ThumbnailDatabase::SetFaviconBitmapLastUpdateTime(
@@ -821,6 +893,9 @@ bool ThumbnailDatabase::SetFaviconBitmapLastUpdateTime(
 
 bool ThumbnailDatabase::DeleteFaviconBitmapsForFavicon(
     chrome::FaviconID icon_id) {
+  if (!ReleaseBitmapDataForFavicon(icon_id))
+    return false;
+
   sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
       "DELETE FROM favicon_bitmaps WHERE icon_id=?"));
   statement.BindInt64(0, icon_id);
@@ -828,12 +903,105 @@ bool ThumbnailDatabase::DeleteFaviconBitmapsForFavicon(
 }
 
 bool ThumbnailDatabase::DeleteFaviconBitmap(FaviconBitmapID bitmap_id) {
+  if (!ReleaseBitmapData(GetBitmapDataID(bitmap_id)))
+    return false;
+
   sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
       "DELETE FROM favicon_bitmaps WHERE id=?"));
   statement.BindInt64(0, bitmap_id);
   return statement.Run();
 }
 
+bool ThumbnailDatabase::AddBitmapDataRef(
+    const scoped_refptr<base::RefCountedMemory>& bitmap_data,
+    int64* data_id) {
+  *data_id = 0;
+  if (!bitmap_data.get() || !bitmap_data->size())
+    return true;
+
+  unsigned char hash[base::kSHA1Length];
+  base::SHA1HashBytes(bitmap_data->front(), bitmap_data->size(), hash);
+
+  // Compare the data as well as the hash, so that a collision cannot give a
+  // page the favicon of another.
+  sql::Statement find(db_.GetCachedStatement(SQL_FROM_HERE,
+      "SELECT id FROM favicon_bitmap_data WHERE hash=? AND image_data=?"));
+  find.BindBlob(0, hash, sizeof(hash));
+  find.BindBlob(1, bitmap_data->front(),
+                static_cast<int>(bitmap_data->size()));
+  if (find.Step()) {
+    *data_id = find.ColumnInt64(0);
+    sql::Statement add_ref(db_.GetCachedStatement(SQL_FROM_HERE,
+        "UPDATE favicon_bitmap_data SET ref_count=ref_count+1 WHERE id=?"));
+    add_ref.BindInt64(0, *data_id);
+    return add_ref.Run();
+  }
+  if (!find.Succeeded())
+    return false;
+
+  sql::Statement insert(db_.GetCachedStatement(SQL_FROM_HERE,
+      "INSERT INTO favicon_bitmap_data (hash, ref_count, image_data) "
+      "VALUES (?, 1, ?)"));
+  insert.BindBlob(0, hash, sizeof(hash));
+  insert.BindBlob(1, bitmap_data->front(),
+                  static_cast<int>(bitmap_data->size()));
+  if (!insert.Run())
+    return false;
+  *data_id = db_.GetLastInsertRowId();
+  return true;
+}
+
+bool ThumbnailDatabase::ReleaseBitmapData(int64 data_id) {
+  if (!data_id)
+    return true;
+
+  sql::Statement release(db_.GetCachedStatement(SQL_FROM_HERE,
+      "UPDATE favicon_bitmap_data SET ref_count=ref_count-1 WHERE id=?"));
+  release.BindInt64(0, data_id);
+  if (!release.Run())
+    return false;
+
+  sql::Statement remove(db_.GetCachedStatement(SQL_FROM_HERE,
+      "DELETE FROM favicon_bitmap_data WHERE id=? AND ref_count<=0"));
+  remove.BindInt64(0, data_id);
+  return remove.Run();
+}
+
+bool ThumbnailDatabase::ReleaseBitmapDataForFavicon(
+    chrome::FaviconID icon_id) {
+  sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
+      "SELECT data_id FROM favicon_bitmaps WHERE icon_id=?"));
+  statement.BindInt64(0, icon_id);
+  std::vector<int64> data_ids;
+  while (statement.Step())
+    data_ids.push_back(statement.ColumnInt64(0));
+  if (!statement.Succeeded())
+    return false;
+
+  for (size_t i = 0; i < data_ids.size(); ++i) {
+    if (!ReleaseBitmapData(data_ids[i]))
+      return false;
+  }
+  return true;
+}
+
+int64 ThumbnailDatabase::GetBitmapDataID(FaviconBitmapID bitmap_id) {
+  sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
+      "SELECT data_id FROM favicon_bitmaps WHERE id=?"));
+  statement.BindInt64(0, bitmap_id);
+  return statement.Step() ? statement.ColumnInt64(0) : 0;
+}
+
+bool ThumbnailDatabase::CompactFaviconBitmapData() {
+  const char kRecountSql[] =
+      "UPDATE favicon_bitmap_data SET ref_count="
+      "(SELECT COUNT(*) FROM favicon_bitmaps "
+      "WHERE favicon_bitmaps.data_id = favicon_bitmap_data.id)";
+  const char kDeleteUnusedSql[] =
+      "DELETE FROM favicon_bitmap_data WHERE ref_count=0";
+  return db_.Execute(kRecountSql) && db_.Execute(kDeleteUnusedSql);
+}
+
 bool ThumbnailDatabase::SetFaviconOutOfDate(chrome::FaviconID icon_id) {
   sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
       "UPDATE favicon_bitmaps SET last_updated=? WHERE icon_id=?"));
@@ -913,7 +1081,7 @@ bool ThumbnailDatabase::DeleteFavicon(chrome::FaviconID id) {
   statement.Assign(db_.GetCachedStatement(SQL_FROM_HERE,
       "DELETE FROM favicons WHERE id = ?"));
   statement.BindInt64(0, id);
-  if (!statement.Run())
+  if (!statement.Run() || !ReleaseBitmapDataForFavicon(id))
     return false;
 
   statement.Assign(db_.GetCachedStatement(SQL_FROM_HERE,
@@ -1134,9 +1302,9 @@ bool ThumbnailDatabase::RetainDataForPageUrls(
         "ALTER TABLE favicon_bitmaps RENAME TO old_favicon_bitmaps";
     const char kCopyFaviconBitmaps[] =
         "INSERT INTO favicon_bitmaps "
-        "  (icon_id, last_updated, image_data, width, height) "
+        "  (icon_id, last_updated, width, height, data_id) "
         "SELECT mapping.new_icon_id, old.last_updated, "
-        "    old.image_data, old.width, old.height "
+        "    old.width, old.height, old.data_id "
         "FROM old_favicon_bitmaps AS old "
         "JOIN temp.icon_id_mapping AS mapping "
         "ON (old.icon_id = mapping.old_icon_id)";
@@ -1155,10 +1323,15 @@ bool ThumbnailDatabase::RetainDataForPageUrls(
   // indices, now re-create them against the new tables.
   if (!InitIconMappingIndex() ||
       !InitFaviconsIndex() ||
-      !InitFaviconBitmapsIndex()) {
+      !InitFaviconBitmapsIndex() ||
+      !InitFaviconBitmapDataIndex()) {
     return false;
   }
 
+  // Drop the data of the bitmaps which were not kept.
+  if (!CompactFaviconBitmapData())
+    return false;
+
   const char kIconMappingDrop[] = "DROP TABLE temp.icon_id_mapping";
   if (!db_.Execute(kIconMappingDrop))
     return false;
@@ -1179,6 +1352,7 @@ bool ThumbnailDatabase::RenameAndDropThumbnails(
     return false;
 
   if (!InitFaviconBitmapsTable(&favicons) ||
+      !InitFaviconBitmapDataTable(&favicons) ||
       !InitFaviconsTable(&favicons) ||
       !InitIconMappingTable(&favicons)) {
     favicons.Close();
@@ -1213,10 +1387,12 @@ bool ThumbnailDatabase::RenameAndDropThumbnails(
     }
   }
 
-  // Move favicons and favicon_bitmaps to new DB.
+  // Move favicons, favicon_bitmaps and favicon_bitmap_data to new DB.
   bool successfully_moved_data =
      db_.Execute("INSERT OR REPLACE INTO new_favicons.favicon_bitmaps "
                  "SELECT * FROM favicon_bitmaps") &&
+     db_.Execute("INSERT OR REPLACE INTO new_favicons.favicon_bitmap_data "
+                 "SELECT * FROM favicon_bitmap_data") &&
      db_.Execute("INSERT OR REPLACE INTO new_favicons.favicons "
                  "SELECT * FROM favicons");
   if (!successfully_moved_data) {
@@ -1243,8 +1419,10 @@ bool ThumbnailDatabase::RenameAndDropThumbnails(
   if (!meta_table_.Init(&db_, kCurrentVersionNumber, kCompatibleVersionNumber))
     return false;
 
-  if (!InitFaviconBitmapsIndex() || !InitFaviconsIndex())
+  if (!InitFaviconBitmapsIndex() || !InitFaviconBitmapDataIndex() ||
+      !InitFaviconsIndex()) {
     return false;
+  }
 
   // Reopen the transaction.
   BeginTransaction();
@@ -1354,4 +1532,51 @@ bool ThumbnailDatabase::UpgradeToVersion7() {
   return true;
 }
 
+bool ThumbnailDatabase::UpgradeToVersion8() {
+  // A database older than version 6 already has the column, as Init()
+  // created favicon_bitmaps.
+  if (!db_.DoesColumnExist("favicon_bitmaps", "data_id") &&
+      !db_.Execute("ALTER TABLE favicon_bitmaps ADD data_id INTEGER "
+                   "DEFAULT 0")) {
+    return false;
+  }
+
+  // Collect the ids first, as the rows are changed below.
+  std::vector<FaviconBitmapID> bitmap_ids;
+  {
+    sql::Statement statement(db_.GetUniqueStatement(
+        "SELECT id FROM favicon_bitmaps WHERE image_data IS NOT NULL"));
+    while (statement.Step())
+      bitmap_ids.push_back(statement.ColumnInt64(0));
+    if (!statement.Succeeded())
+      return false;
+  }
+
+  sql::Statement select(db_.GetUniqueStatement(
+      "SELECT image_data FROM favicon_bitmaps WHERE id=?"));
+  sql::Statement update(db_.GetUniqueStatement(
+      "UPDATE favicon_bitmaps SET data_id=?, image_data=NULL WHERE id=?"));
+  for (size_t i = 0; i < bitmap_ids.size(); ++i) {
+    select.Reset(true);
+    select.BindInt64(0, bitmap_ids[i]);
+    if (!select.Step())
+      return false;
+    scoped_refptr<base::RefCountedBytes> data(new base::RefCountedBytes());
+    select.ColumnBlobAsVector(0, &data->data());
+
+    int64 data_id;
+    if (!AddBitmapDataRef(data, &data_id))
+      return false;
+    update.Reset(true);
+    update.BindInt64(0, data_id);
+    update.BindInt64(1, bitmap_ids[i]);
+    if (!update.Run())
+      return false;
+  }
+
+  meta_table_.SetVersionNumber(8);
+  meta_table_.SetCompatibleVersionNumber(std::min(8, kCompatibleVersionNumber));
+  return true;
+}
+
 }  // namespace history
@@ -295,6 +295,8 @@ class ThumbnailDatabase {
   FRIEND_TEST_ALL_PREFIXES(ThumbnailDatabaseTest, UpgradeToVersion5);
   FRIEND_TEST_ALL_PREFIXES(ThumbnailDatabaseTest, UpgradeToVersion6);
   FRIEND_TEST_ALL_PREFIXES(ThumbnailDatabaseTest, UpgradeToVersion7);
+  FRIEND_TEST_ALL_PREFIXES(ThumbnailDatabaseTest, UpgradeToVersion8);
+  FRIEND_TEST_ALL_PREFIXES(ThumbnailDatabaseTest, SharedBitmapData);
   FRIEND_TEST_ALL_PREFIXES(ThumbnailDatabaseTest, RetainDataForPageUrls);
   FRIEND_TEST_ALL_PREFIXES(HistoryBackendTest, MigrationIconMapping);
 
@@ -320,6 +322,10 @@ class ThumbnailDatabase {
   // Removes sizes column.
   bool UpgradeToVersion7();
 
+  // Moves the bitmap data into favicon_bitmap_data, storing identical bitmaps
+  // once.
+  bool UpgradeToVersion8();
+
   // Migrates the icon mapping data from URL database to Thumbnail database.
   // Return whether the migration succeeds.
   bool MigrateIconMappingData(URLDatabase* url_db);
@@ -348,6 +354,38 @@ class ThumbnailDatabase {
   // table with no index).
   bool InitFaviconBitmapsIndex();
 
+  // Creates the favicon_bitmap_data table, return true if the table already
+  // exists or was successfully created.
+  bool InitFaviconBitmapDataTable(sql::Connection* db);
+
+  // Creates the indices used to find bitmap data by hash and the bitmaps
+  // which refer to it.  The latter is over a column added by
+  // UpgradeToVersion8(), so this is called after the upgrades.
+  bool InitFaviconBitmapDataIndex();
+
+  // Adds a reference to the row of favicon_bitmap_data holding
+  // |bitmap_data|, adding the row if there is none, and sets |data_id| to its
+  // id.  Empty |bitmap_data| needs no row, and sets |data_id| to 0.
+  bool AddBitmapDataRef(
+      const scoped_refptr<base::RefCountedMemory>& bitmap_data,
+      int64* data_id);
+
+  // Drops a reference to the favicon_bitmap_data row with |data_id|,
+  // deleting the row when it has no references left.
+  bool ReleaseBitmapData(int64 data_id);
+
+  // Drops the references of the favicon bitmaps of |icon_id| to their data,
+  // before the bitmaps are deleted.
+  bool ReleaseBitmapDataForFavicon(chrome::FaviconID icon_id);
+
+  // Returns the id of the bitmap data of the favicon bitmap with |bitmap_id|,
+  // or 0 if it has none.
+  int64 GetBitmapDataID(FaviconBitmapID bitmap_id);
+
+  // Recounts the references to each row of favicon_bitmap_data and deletes
+  // the rows which have none, after favicon_bitmaps is rebuilt.
+  bool CompactFaviconBitmapData();
+
   // Creates the icon_map table, return true if the table already exists or was
   // successfully created.
   bool InitIconMappingTable(sql::Connection* db);
@@ -48,6 +48,13 @@ const int64 kPage1 = 1234;
 const gfx::Size kSmallSize = gfx::Size(16, 16);
 const gfx::Size kLargeSize = gfx::Size(32, 32);
 
+template <size_t N>
+bool BitmapDataEqual(const unsigned char (&expected)[N],
+                     const scoped_refptr<base::RefCountedMemory>& data) {
+  return data.get() && data->size() == N &&
+      std::equal(expected, expected + N, data->front());
+}
+
 }  // namespace
 
 class ThumbnailDatabaseTest : public testing::Test {
@@ -470,6 +477,60 @@ TEST_F(ThumbnailDatabaseTest, UpgradeToVersion7) {
   EXPECT_EQ(chrome::TOUCH_ICON, statement.ColumnInt(2));
 }
 
+// Test upgrading database to version 8.
+TEST_F(ThumbnailDatabaseTest, UpgradeToVersion8) {
+  ThumbnailDatabase db;
+  ASSERT_EQ(sql::INIT_OK, db.Init(file_name_, NULL, NULL));
+  db.BeginTransaction();
+
+  EXPECT_TRUE(db.db_.Execute("DROP TABLE favicon_bitmaps"));
+  EXPECT_TRUE(db.db_.Execute("CREATE TABLE favicon_bitmaps ("
+                             "id INTEGER PRIMARY KEY,"
+                             "icon_id INTEGER NOT NULL,"
+                             "last_updated INTEGER DEFAULT 0,"
+                             "image_data BLOB,"
+                             "width INTEGER DEFAULT 0,"
+                             "height INTEGER DEFAULT 0)"));
+
+  // Two favicons share a bitmap, and one has a bitmap of its own.
+  const unsigned char* blobs[] = { blob1, blob1, blob2 };
+  const size_t blob_sizes[] = { sizeof(blob1), sizeof(blob1), sizeof(blob2) };
+  sql::Statement statement;
+  for (size_t i = 0; i < arraysize(blobs); ++i) {
+    statement.Assign(db.db_.GetCachedStatement(SQL_FROM_HERE,
+        "INSERT INTO favicon_bitmaps (icon_id, image_data, width, height) "
+        "VALUES (?, ?, 16, 16)"));
+    statement.BindInt64(0, static_cast<int64>(i + 1));
+    statement.BindBlob(1, blobs[i], static_cast<int>(blob_sizes[i]));
+    EXPECT_TRUE(statement.Run());
+  }
+
+  EXPECT_TRUE(db.UpgradeToVersion8());
+
+  for (size_t i = 0; i < arraysize(blobs); ++i) {
+    std::vector<FaviconBitmap> favicon_bitmaps;
+    EXPECT_TRUE(db.GetFaviconBitmaps(i + 1, &favicon_bitmaps));
+    ASSERT_EQ(1u, favicon_bitmaps.size());
+    ASSERT_TRUE(favicon_bitmaps[0].bitmap_data.get());
+    ASSERT_EQ(blob_sizes[i], favicon_bitmaps[0].bitmap_data->size());
+    EXPECT_TRUE(std::equal(blobs[i], blobs[i] + blob_sizes[i],
+                           favicon_bitmaps[0].bitmap_data->front()));
+  }
+
+  statement.Assign(db.db_.GetCachedStatement(SQL_FROM_HERE,
+      "SELECT COUNT(*) FROM favicon_bitmaps WHERE image_data IS NOT NULL"));
+  ASSERT_TRUE(statement.Step());
+  EXPECT_EQ(0, statement.ColumnInt(0));
+
+  statement.Assign(db.db_.GetCachedStatement(SQL_FROM_HERE,
+      "SELECT ref_count FROM favicon_bitmap_data ORDER BY id"));
+  ASSERT_TRUE(statement.Step());
+  EXPECT_EQ(2, statement.ColumnInt(0));
+  ASSERT_TRUE(statement.Step());
+  EXPECT_EQ(1, statement.ColumnInt(0));
+  EXPECT_FALSE(statement.Step());
+}
+
 TEST_F(ThumbnailDatabaseTest, RetainDataForPageUrls) {
   ThumbnailDatabase db;
 
@@ -515,6 +576,14 @@ TEST_F(ThumbnailDatabaseTest, RetainDataForPageUrls) {
 
   EXPECT_FALSE(db.GetFaviconIDForFaviconURL(unkept_url, false, NULL));
 
+  // The data shared with the bitmap which was not kept is only referred to
+  // by the kept one.
+  sql::Statement statement(db.db_.GetUniqueStatement(
+      "SELECT ref_count FROM favicon_bitmap_data"));
+  ASSERT_TRUE(statement.Step());
+  EXPECT_EQ(1, statement.ColumnInt(0));
+  EXPECT_FALSE(statement.Step());
+
   // Schema should be the same.
   EXPECT_EQ(original_schema, db.db_.GetSchema());
 }
@@ -545,6 +614,62 @@ TEST_F(ThumbnailDatabaseTest, DeleteFavicon) {
   EXPECT_FALSE(db.GetFaviconBitmaps(id, NULL));
 }
 
+// Tests that identical bitmaps share their data, and that the data is deleted
+// along with the last bitmap which uses it.
+TEST_F(ThumbnailDatabaseTest, SharedBitmapData) {
+  ThumbnailDatabase db;
+  ASSERT_EQ(sql::INIT_OK, db.Init(file_name_, NULL, NULL));
+  db.BeginTransaction();
+
+  std::vector<unsigned char> data1(blob1, blob1 + sizeof(blob1));
+  scoped_refptr<base::RefCountedBytes> favicon1(
+      new base::RefCountedBytes(data1));
+  std::vector<unsigned char> data2(blob2, blob2 + sizeof(blob2));
+  scoped_refptr<base::RefCountedBytes> favicon2(
+      new base::RefCountedBytes(data2));
+
+  base::Time last_updated = base::Time::Now();
+  chrome::FaviconID id1 = db.AddFavicon(GURL("http://a.com/favicon.ico"),
+                                        chrome::FAVICON);
+  FaviconBitmapID bitmap_id1 =
+      db.AddFaviconBitmap(id1, favicon1, last_updated, kSmallSize);
+  chrome::FaviconID id2 = db.AddFavicon(GURL("http://b.com/favicon.ico"),
+                                        chrome::FAVICON);
+  db.AddFaviconBitmap(id2, favicon1, last_updated, kSmallSize);
+
+  sql::Statement count(db.db_.GetUniqueStatement(
+      "SELECT COUNT(*), SUM(ref_count) FROM favicon_bitmap_data"));
+  ASSERT_TRUE(count.Step());
+  EXPECT_EQ(1, count.ColumnInt(0));
+  EXPECT_EQ(2, count.ColumnInt(1));
+
+  std::vector<FaviconBitmap> favicon_bitmaps;
+  EXPECT_TRUE(db.GetFaviconBitmaps(id2, &favicon_bitmaps));
+  ASSERT_EQ(1u, favicon_bitmaps.size());
+  EXPECT_TRUE(BitmapDataEqual(blob1, favicon_bitmaps[0].bitmap_data));
+
+  // Changing one bitmap leaves the other's data alone.
+  EXPECT_TRUE(db.SetFaviconBitmap(bitmap_id1, favicon2, last_updated));
+  scoped_refptr<base::RefCountedMemory> bitmap_data;
+  EXPECT_TRUE(db.GetFaviconBitmap(bitmap_id1, NULL, &bitmap_data, NULL));
+  EXPECT_TRUE(BitmapDataEqual(blob2, bitmap_data));
+  favicon_bitmaps.clear();
+  EXPECT_TRUE(db.GetFaviconBitmaps(id2, &favicon_bitmaps));
+  EXPECT_TRUE(BitmapDataEqual(blob1, favicon_bitmaps[0].bitmap_data));
+
+  // Setting the same data again keeps it.
+  EXPECT_TRUE(db.SetFaviconBitmap(bitmap_id1, favicon2, last_updated));
+  bitmap_data = NULL;
+  EXPECT_TRUE(db.GetFaviconBitmap(bitmap_id1, NULL, &bitmap_data, NULL));
+  EXPECT_TRUE(BitmapDataEqual(blob2, bitmap_data));
+
+  EXPECT_TRUE(db.DeleteFavicon(id2));
+  EXPECT_TRUE(db.DeleteFaviconBitmap(bitmap_id1));
+  count.Reset(true);
+  ASSERT_TRUE(count.Step());
+  EXPECT_EQ(0, count.ColumnInt(0));
+}
+
 TEST_F(ThumbnailDatabaseTest, GetIconMappingsForPageURLForReturnOrder) {
   ThumbnailDatabase db;
   ASSERT_EQ(sql::INIT_OK, db.Init(file_name_, NULL, NULL));
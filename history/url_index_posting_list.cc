@@ -0,0 +1,330 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_posting_list.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "base/logging.h"
+
+namespace history {
+
+namespace {
+
+// When one input of an intersection is at least this many times longer than
+// the other, galloping through the longer input beats a linear merge.
+const size_t kGallopRatio = 16;
+
+// Returns the index of the first element in |ids| not less than |target|,
+// searching forward from |start| with exponentially growing steps.
+size_t GallopTo(const HistoryIDVector& ids, size_t start, HistoryID target) {
+  size_t step = 1;
+  size_t high = start;
+  while (high < ids.size() && ids[high] < target) {
+    start = high + 1;
+    high += step;
+    step *= 2;
+  }
+  high = std::min(high + 1, ids.size());
+  return std::lower_bound(ids.begin() + start, ids.begin() + high, target) -
+      ids.begin();
+}
+
+}  // namespace
+
+// PostingList -----------------------------------------------------------------
+
+const size_t PostingList::kMaxPendingChanges = 32;
+
+PostingList::PostingList() : last_(0), size_(0) {}
+
+PostingList::~PostingList() {}
+
+void PostingList::Insert(HistoryID history_id) {
+  DCHECK_GE(history_id, 0);
+  if (data_.empty() || history_id > last_) {
+    AppendVarint(static_cast<uint64>(history_id - last_));
+    last_ = history_id;
+    ++size_;
+    return;
+  }
+  HistoryIDVector::iterator erased =
+      std::lower_bound(erased_.begin(), erased_.end(), history_id);
+  if (erased != erased_.end() && *erased == history_id) {
+    // Still encoded, so it is enough to forget the erase.
+    erased_.erase(erased);
+    ++size_;
+    return;
+  }
+  HistoryIDVector::iterator pos =
+      std::lower_bound(inserted_.begin(), inserted_.end(), history_id);
+  if ((pos != inserted_.end() && *pos == history_id) ||
+      EncodingContains(history_id))
+    return;
+  inserted_.insert(pos, history_id);
+  ++size_;
+  MaybeMergePendingChanges();
+}
+
+bool PostingList::Erase(HistoryID history_id) {
+  HistoryIDVector::iterator inserted =
+      std::lower_bound(inserted_.begin(), inserted_.end(), history_id);
+  if (inserted != inserted_.end() && *inserted == history_id) {
+    inserted_.erase(inserted);
+    --size_;
+    MaybeMergePendingChanges();
+    return true;
+  }
+  if (data_.empty() || history_id > last_)
+    return false;
+  HistoryIDVector::iterator pos =
+      std::lower_bound(erased_.begin(), erased_.end(), history_id);
+  if ((pos != erased_.end() && *pos == history_id) ||
+      !EncodingContains(history_id))
+    return false;
+  erased_.insert(pos, history_id);
+  --size_;
+  MaybeMergePendingChanges();
+  return true;
+}
+
+void PostingList::Assign(const HistoryIDVector& history_ids) {
+  data_.clear();
+  last_ = 0;
+  size_ = 0;
+  HistoryIDVector().swap(inserted_);
+  HistoryIDVector().swap(erased_);
+  for (HistoryIDVector::const_iterator iter = history_ids.begin();
+       iter != history_ids.end(); ++iter) {
+    DCHECK(size_ == 0 || *iter > last_);
+    AppendVarint(static_cast<uint64>(*iter - last_));
+    last_ = *iter;
+    ++size_;
+  }
+  // Lists which are assigned or shrink are rarely grown again; return the
+  // slack.
+  std::vector<uint8>(data_).swap(data_);
+}
+
+void PostingList::DecodeTo(HistoryIDVector* history_ids) const {
+  const size_t start = history_ids->size();
+  history_ids->reserve(start + size_);
+  if (!data_.empty())
+    Decode(&data_[0], data_.size(), history_ids);
+
+  if (!erased_.empty()) {
+    HistoryIDVector::iterator out = history_ids->begin() + start;
+    HistoryIDVector::const_iterator erased = erased_.begin();
+    for (HistoryIDVector::const_iterator iter = out;
+         iter != history_ids->end(); ++iter) {
+      while (erased != erased_.end() && *erased < *iter)
+        ++erased;
+      if (erased == erased_.end() || *erased != *iter)
+        *out++ = *iter;
+    }
+    history_ids->erase(out, history_ids->end());
+  }
+  if (!inserted_.empty()) {
+    const size_t middle = history_ids->size();
+    history_ids->insert(history_ids->end(), inserted_.begin(),
+                        inserted_.end());
+    std::inplace_merge(history_ids->begin() + start,
+                       history_ids->begin() + middle, history_ids->end());
+  }
+}
+
+void PostingList::Encode(std::vector<uint8>* data) const {
+  if (inserted_.empty() && erased_.empty()) {
+    *data = data_;
+    return;
+  }
+  HistoryIDVector history_ids;
+  DecodeTo(&history_ids);
+  PostingList merged;
+  merged.Assign(history_ids);
+  data->swap(merged.data_);
+}
+
+// static
+bool PostingList::Decode(const uint8* data,
+                         size_t length,
+                         HistoryIDVector* history_ids) {
+  HistoryID current = 0;
+  uint64 delta = 0;
+  int shift = 0;
+  for (const uint8* end = data + length; data != end; ++data) {
+    if (shift > 63)
+      return false;
+    delta |= static_cast<uint64>(*data & 0x7f) << shift;
+    if (*data & 0x80) {
+      shift += 7;
+      continue;
+    }
+    current += static_cast<HistoryID>(delta);
+    history_ids->push_back(current);
+    delta = 0;
+    shift = 0;
+  }
+  return shift == 0;
+}
+
+size_t PostingList::EstimateMemoryUsage() const {
+  return data_.capacity() +
+      (inserted_.capacity() + erased_.capacity()) * sizeof(HistoryID);
+}
+
+void PostingList::AppendVarint(uint64 delta) {
+  while (delta >= 0x80) {
+    data_.push_back(static_cast<uint8>(delta) | 0x80);
+    delta >>= 7;
+  }
+  data_.push_back(static_cast<uint8>(delta));
+}
+
+bool PostingList::EncodingContains(HistoryID history_id) const {
+  // Scans the deltas in place; nothing is decoded into memory.
+  HistoryID current = 0;
+  uint64 delta = 0;
+  int shift = 0;
+  for (std::vector<uint8>::const_iterator iter = data_.begin();
+       iter != data_.end(); ++iter) {
+    delta |= static_cast<uint64>(*iter & 0x7f) << shift;
+    if (*iter & 0x80) {
+      shift += 7;
+      continue;
+    }
+    current += static_cast<HistoryID>(delta);
+    if (current >= history_id)
+      return current == history_id;
+    delta = 0;
+    shift = 0;
+  }
+  return false;
+}
+
+void PostingList::MaybeMergePendingChanges() {
+  if (size_ != 0 &&
+      inserted_.size() + erased_.size() < kMaxPendingChanges)
+    return;
+  HistoryIDVector history_ids;
+  DecodeTo(&history_ids);
+  Assign(history_ids);
+}
+
+// PostingListIndex ------------------------------------------------------------
+
+PostingListIndex::PostingListIndex() {}
+
+PostingListIndex::~PostingListIndex() {}
+
+void PostingListIndex::Build(const WordIDHistoryMap& word_id_history_map) {
+  postings_.clear();
+  if (word_id_history_map.empty())
+    return;
+  postings_.resize(word_id_history_map.rbegin()->first + 1);
+  for (WordIDHistoryMap::const_iterator word_iter =
+           word_id_history_map.begin();
+       word_iter != word_id_history_map.end(); ++word_iter) {
+    PostingList& posting_list = postings_[word_iter->first];
+    // HistoryIDSets iterate in ascending order so every insert is an append.
+    for (HistoryIDSet::const_iterator history_iter = word_iter->second.begin();
+         history_iter != word_iter->second.end(); ++history_iter)
+      posting_list.Insert(*history_iter);
+  }
+}
+
+void PostingListIndex::Assign(WordID word_id,
+                              const HistoryIDVector& history_ids) {
+  if (word_id >= postings_.size())
+    postings_.resize(word_id + 1);
+  postings_[word_id].Assign(history_ids);
+}
+
+void PostingListIndex::Add(WordID word_id, HistoryID history_id) {
+  if (word_id >= postings_.size())
+    postings_.resize(word_id + 1);
+  postings_[word_id].Insert(history_id);
+}
+
+void PostingListIndex::Remove(WordID word_id, HistoryID history_id) {
+  if (word_id < postings_.size())
+    postings_[word_id].Erase(history_id);
+}
+
+void PostingListIndex::Clear() {
+  std::vector<PostingList>().swap(postings_);
+}
+
+const PostingList* PostingListIndex::GetPostingList(WordID word_id) const {
+  return word_id < postings_.size() ? &postings_[word_id] : NULL;
+}
+
+bool PostingListIndex::HasPostings(WordID word_id) const {
+  return word_id < postings_.size() && !postings_[word_id].empty();
+}
+
+bool PostingListIndex::empty() const {
+  for (std::vector<PostingList>::const_iterator iter = postings_.begin();
+       iter != postings_.end(); ++iter) {
+    if (!iter->empty())
+      return false;
+  }
+  return true;
+}
+
+void PostingListIndex::HistoryIDsForWords(
+    const WordIDSet& word_id_set,
+    HistoryIDVector* history_ids) const {
+  history_ids->clear();
+  for (WordIDSet::const_iterator iter = word_id_set.begin();
+       iter != word_id_set.end(); ++iter) {
+    if (*iter < postings_.size())
+      postings_[*iter].DecodeTo(history_ids);
+  }
+  // A single word's postings are already sorted and unique.
+  if (word_id_set.size() > 1) {
+    std::sort(history_ids->begin(), history_ids->end());
+    history_ids->erase(std::unique(history_ids->begin(), history_ids->end()),
+                       history_ids->end());
+  }
+}
+
+size_t PostingListIndex::EstimateMemoryUsage() const {
+  size_t memory = postings_.capacity() * sizeof(PostingList);
+  for (std::vector<PostingList>::const_iterator iter = postings_.begin();
+       iter != postings_.end(); ++iter)
+    memory += iter->EstimateMemoryUsage();
+  return memory;
+}
+
+// Algorithm Functions ---------------------------------------------------------
+
+void IntersectSortedHistoryIDs(const HistoryIDVector& a,
+                               const HistoryIDVector& b,
+                               HistoryIDVector* result) {
+  result->clear();
+  const HistoryIDVector& shorter = (a.size() <= b.size()) ? a : b;
+  const HistoryIDVector& longer = (a.size() <= b.size()) ? b : a;
+  if (shorter.empty())
+    return;
+  result->reserve(shorter.size());
+
+  if (longer.size() / shorter.size() < kGallopRatio) {
+    std::set_intersection(shorter.begin(), shorter.end(),
+                          longer.begin(), longer.end(),
+                          std::back_inserter(*result));
+    return;
+  }
+
+  size_t pos = 0;
+  for (HistoryIDVector::const_iterator iter = shorter.begin();
+       iter != shorter.end() && pos < longer.size(); ++iter) {
+    pos = GallopTo(longer, pos, *iter);
+    if (pos < longer.size() && longer[pos] == *iter)
+      result->push_back(*iter);
+  }
+}
+
+}  // namespace history
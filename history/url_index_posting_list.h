@@ -0,0 +1,140 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LIST_H_
+#define CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LIST_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "chrome/browser/history/in_memory_url_index_types.h"
+
+namespace history {
+
+// A sorted set of HistoryIDs stored as a flat byte vector of varint-encoded
+// deltas. Compared to a HistoryIDSet, which allocates a tree node for every
+// element, a posting list typically needs one or two bytes per HistoryID and
+// is decoded with a single sequential scan.
+//
+// Inserting anywhere but at the end, or erasing, would have to re-encode the
+// whole list. Instead such changes are kept in small sorted side buffers,
+// which decoding applies, and merged into the encoding in one pass once
+// kMaxPendingChanges of them have collected.
+class PostingList {
+ public:
+  PostingList();
+  ~PostingList();
+
+  // The number of out of order inserts and erases buffered before they are
+  // merged into the encoding.
+  static const size_t kMaxPendingChanges;
+
+  // Adds |history_id| to the list if not already present. Appending an ID
+  // larger than every ID already in the list (the common case, as new history
+  // rows are assigned increasing IDs) takes constant time; any other insert
+  // scans the encoding for the ID and buffers it.
+  void Insert(HistoryID history_id);
+
+  // Removes |history_id| from the list. Returns true if it was present. Like
+  // an out of order insert this scans the encoding and buffers the change.
+  bool Erase(HistoryID history_id);
+
+  // Replaces the contents of the list with the sorted, unique |history_ids|.
+  void Assign(const HistoryIDVector& history_ids);
+
+  // Appends the HistoryIDs in the list, in ascending order, to |history_ids|.
+  void DecodeTo(HistoryIDVector* history_ids) const;
+
+  // Sets |data| to the varint-encoded deltas of the list, including any
+  // buffered changes, suitable for persisting and later decoding with
+  // Decode().
+  void Encode(std::vector<uint8>* data) const;
+
+  // Appends the HistoryIDs encoded in the |length| bytes at |data| to
+  // |history_ids|. Returns false if the data ends in the middle of a value.
+  static bool Decode(const uint8* data,
+                     size_t length,
+                     HistoryIDVector* history_ids);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns the number of heap bytes used by the list and its buffered
+  // changes.
+  size_t EstimateMemoryUsage() const;
+
+ private:
+  // Appends |delta| to |data_| as a little-endian base-128 varint.
+  void AppendVarint(uint64 delta);
+
+  // Returns true if |history_id| is in |data_|, ignoring buffered changes.
+  bool EncodingContains(HistoryID history_id) const;
+
+  // Merges the buffered changes into |data_| if there are enough of them, or
+  // the list has become empty.
+  void MaybeMergePendingChanges();
+
+  std::vector<uint8> data_;
+  HistoryID last_;  // The largest HistoryID in |data_|.
+  size_t size_;     // The number of HistoryIDs, with the changes applied.
+
+  // HistoryIDs smaller than |last_| inserted since |data_| was encoded, and
+  // HistoryIDs in |data_| erased since. Both are sorted.
+  HistoryIDVector inserted_;
+  HistoryIDVector erased_;
+};
+
+// A one-to-many mapping from a WordID to the HistoryIDs of the history items
+// containing that word, kept as one PostingList per word in a vector indexed
+// by WordID. This is the flat counterpart of WordIDHistoryMap. Copyable.
+class PostingListIndex {
+ public:
+  PostingListIndex();
+  ~PostingListIndex();
+
+  // Replaces the contents of the index with that of |word_id_history_map|.
+  void Build(const WordIDHistoryMap& word_id_history_map);
+
+  // Replaces the postings of |word_id| with the sorted, unique |history_ids|.
+  void Assign(WordID word_id, const HistoryIDVector& history_ids);
+
+  // Adds or removes a reference from |word_id| to |history_id|.
+  void Add(WordID word_id, HistoryID history_id);
+  void Remove(WordID word_id, HistoryID history_id);
+
+  // Removes every posting list.
+  void Clear();
+
+  // Returns the postings of |word_id|, or NULL if it has never had any.
+  const PostingList* GetPostingList(WordID word_id) const;
+
+  // Returns true if any history item references |word_id|.
+  bool HasPostings(WordID word_id) const;
+
+  // Returns true if no history item references any word.
+  bool empty() const;
+
+  // Sets |history_ids| to the sorted union of the postings of every word in
+  // |word_id_set|.
+  void HistoryIDsForWords(const WordIDSet& word_id_set,
+                          HistoryIDVector* history_ids) const;
+
+  // Returns the number of heap bytes used by the index.
+  size_t EstimateMemoryUsage() const;
+
+ private:
+  std::vector<PostingList> postings_;
+};
+
+// Sets |result| to the intersection of the sorted vectors |a| and |b|. When
+// one input is much shorter than the other each of its elements is located
+// in the longer one with a galloping (exponential) search instead of a linear
+// merge, so the cost is proportional to the shorter input.
+void IntersectSortedHistoryIDs(const HistoryIDVector& a,
+                               const HistoryIDVector& b,
+                               HistoryIDVector* result);
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LIST_H_
@@ -0,0 +1,162 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures the memory footprint of the posting lists of a synthetic
+// 200,000-URL HistoryQuickProvider index, against an estimate of the
+// node-based WordIDHistoryMap they replace, and the cost of
+// URLIndexPrivateData::HistoryItemsForTerms() as the user types queries into
+// it, both from cold caches and refining the previous keystroke. Also
+// measures updating rows already in a posting list, which erases and
+// re-inserts them out of order.
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/url_index_posting_list.h"
+#include "chrome/browser/history/url_index_private_data.h"
+#include "chrome/test/perf/perf_test.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace history {
+
+namespace {
+
+const URLID kNumHistoryItems = 200000;
+const int kNumRepetitions = 10;
+
+const char* kWords[] = {
+  "news", "mail", "search", "video", "shop", "travel", "sports", "weather",
+  "music", "photos", "maps", "docs", "blog", "forum", "wiki", "games",
+  "finance", "health", "recipes", "movies", "books", "jobs", "cars", "homes",
+};
+
+// Typed one keystroke at a time.
+const char* kQueries[] = {
+  "travel wiki", "www.shop", "mail 42", "recipes and",
+};
+
+// Approximate per-element cost of a std::set / std::map node: three tree
+// pointers, the color and the value.
+size_t SetNodeBytes(size_t value_size) {
+  return 3 * sizeof(void*) + sizeof(int) + value_size;
+}
+
+void PrintTime(const std::string& trace, base::TimeDelta elapsed) {
+  perf_test::PrintResult("hqp_keystroke", "", trace,
+                         static_cast<size_t>(elapsed.InMicroseconds()),
+                         "us", true);
+}
+
+}  // namespace
+
+class URLIndexPostingListPerfTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    private_data_ = new URLIndexPrivateData;
+    private_data_->set_scoring_threads(1);
+    // A fixed linear congruential generator keeps the history reproducible.
+    uint32 seed = 1;
+    const base::Time now = base::Time::Now();
+    for (URLID row_id = 1; row_id <= kNumHistoryItems; ++row_id) {
+      seed = seed * 1103515245 + 12345;
+      const char* word1 = kWords[(seed >> 8) % arraysize(kWords)];
+      const char* word2 = kWords[(seed >> 16) % arraysize(kWords)];
+      URLRow row(GURL(base::StringPrintf(
+          "http://www.%s%u.com/%s/%d", word1, (seed >> 4) % 1000, word2,
+          static_cast<int>(row_id))), row_id);
+      row.set_title(UTF8ToUTF16(base::StringPrintf(
+          "%s and %s %d", word2, word1, static_cast<int>(row_id % 100))));
+      row.set_visit_count(1 + (seed >> 20) % 20);
+      row.set_typed_count((seed >> 24) % 3);
+      row.set_last_visit(
+          now - base::TimeDelta::FromHours((seed >> 12) % 2000));
+      private_data_->history_info_map_[row_id].url_row = row;
+      RowWordStarts word_starts;
+      private_data_->AddRowWordsToIndex(row, &word_starts, "en");
+      private_data_->word_starts_map_[row_id] = word_starts;
+    }
+  }
+
+  // Returns the memory a WordIDHistoryMap holding the same postings would
+  // use.
+  size_t EstimateMapMemory() const {
+    const PostingListIndex& index = private_data_->posting_index_;
+    size_t memory = 0;
+    for (WordMap::const_iterator iter = private_data_->word_map_.begin();
+         iter != private_data_->word_map_.end(); ++iter) {
+      memory += SetNodeBytes(sizeof(WordID) + sizeof(HistoryIDSet));
+      memory += index.GetPostingList(iter->second)->size() *
+          SetNodeBytes(sizeof(HistoryID));
+    }
+    return memory;
+  }
+
+  // Types every query one keystroke at a time, |kNumRepetitions| times, and
+  // returns the mean time per keystroke. Unless |refine| is set the caches
+  // of the previous keystroke are dropped before each one.
+  base::TimeDelta TimeKeystrokes(bool refine) {
+    base::TimeTicks start = base::TimeTicks::Now();
+    size_t keystrokes = 0;
+    for (int i = 0; i < kNumRepetitions; ++i) {
+      for (size_t j = 0; j < arraysize(kQueries); ++j) {
+        const string16 query(ASCIIToUTF16(kQueries[j]));
+        private_data_->search_term_cache_.clear();
+        private_data_->last_search_.Clear();
+        for (size_t length = 1; length <= query.length(); ++length) {
+          if (!refine) {
+            private_data_->search_term_cache_.clear();
+            private_data_->last_search_.Clear();
+          }
+          private_data_->HistoryItemsForTerms(
+              query.substr(0, length), string16::npos, "en", NULL, NULL);
+          ++keystrokes;
+        }
+      }
+    }
+    return (base::TimeTicks::Now() - start) / keystrokes;
+  }
+
+  scoped_refptr<URLIndexPrivateData> private_data_;
+};
+
+TEST_F(URLIndexPostingListPerfTest, MemoryAndKeystrokes) {
+  perf_test::PrintResult("url_index_memory", "", "maps",
+                         EstimateMapMemory() / 1024, "KB", true);
+  perf_test::PrintResult(
+      "url_index_memory", "", "posting_lists",
+      private_data_->posting_index_.EstimateMemoryUsage() / 1024, "KB", true);
+
+  PrintTime("cold", TimeKeystrokes(false));
+  PrintTime("refined", TimeKeystrokes(true));
+}
+
+TEST(URLIndexPostingListPerfTest, UpdateRows) {
+  // The postings of one of |kWords|, which is in about one row in twelve.
+  PostingList posting_list;
+  for (URLID row_id = 1; row_id <= kNumHistoryItems; row_id += 12)
+    posting_list.Insert(row_id);
+
+  const int kNumUpdates = 10000;
+  uint32 seed = 1;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kNumUpdates; ++i) {
+    seed = seed * 1103515245 + 12345;
+    const URLID row_id = 1 + 12 * ((seed >> 8) % (kNumHistoryItems / 12));
+    posting_list.Erase(row_id);
+    posting_list.Insert(row_id);
+  }
+  perf_test::PrintResult(
+      "url_index_update", "", "erase_and_insert",
+      static_cast<size_t>(
+          (base::TimeTicks::Now() - start).InMicroseconds() / kNumUpdates),
+      "us", true);
+  EXPECT_EQ(static_cast<size_t>(kNumHistoryItems / 12 + 1),
+            posting_list.size());
+}
+
+}  // namespace history
@@ -0,0 +1,212 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <iterator>
+
+#include "chrome/browser/history/url_index_posting_list.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace history {
+
+namespace {
+
+HistoryIDVector Decode(const PostingList& posting_list) {
+  HistoryIDVector history_ids;
+  posting_list.DecodeTo(&history_ids);
+  return history_ids;
+}
+
+}  // namespace
+
+TEST(URLIndexPostingListTest, AppendAndDecode) {
+  PostingList posting_list;
+  EXPECT_TRUE(posting_list.empty());
+
+  // Include deltas which need one, two and several varint bytes.
+  const HistoryID kIDs[] = { 1, 2, 130, 20000, 20001, GG_INT64_C(1) << 40 };
+  for (size_t i = 0; i < arraysize(kIDs); ++i)
+    posting_list.Insert(kIDs[i]);
+  EXPECT_EQ(arraysize(kIDs), posting_list.size());
+  EXPECT_EQ(HistoryIDVector(kIDs, kIDs + arraysize(kIDs)),
+            Decode(posting_list));
+
+  // Inserting an existing ID is a no-op.
+  posting_list.Insert(130);
+  EXPECT_EQ(arraysize(kIDs), posting_list.size());
+}
+
+TEST(URLIndexPostingListTest, InsertOutOfOrderAndErase) {
+  PostingList posting_list;
+  posting_list.Insert(50);
+  posting_list.Insert(10);
+  posting_list.Insert(30);
+  posting_list.Insert(60);
+
+  HistoryIDVector expected;
+  expected.push_back(10);
+  expected.push_back(30);
+  expected.push_back(50);
+  expected.push_back(60);
+  EXPECT_EQ(expected, Decode(posting_list));
+
+  EXPECT_FALSE(posting_list.Erase(20));
+  EXPECT_FALSE(posting_list.Erase(70));
+  EXPECT_TRUE(posting_list.Erase(30));
+  EXPECT_TRUE(posting_list.Erase(60));
+  expected.erase(expected.begin() + 3);
+  expected.erase(expected.begin() + 1);
+  EXPECT_EQ(expected, Decode(posting_list));
+
+  // Appending after erasing the last element must encode against the new
+  // last element.
+  posting_list.Insert(55);
+  expected.push_back(55);
+  EXPECT_EQ(expected, Decode(posting_list));
+
+  EXPECT_TRUE(posting_list.Erase(10));
+  EXPECT_TRUE(posting_list.Erase(50));
+  EXPECT_TRUE(posting_list.Erase(55));
+  EXPECT_TRUE(posting_list.empty());
+  EXPECT_TRUE(Decode(posting_list).empty());
+}
+
+TEST(URLIndexPostingListTest, BufferedChanges) {
+  PostingList posting_list;
+  HistoryIDSet expected;
+  for (HistoryID history_id = 10; history_id <= 1000; history_id += 10) {
+    posting_list.Insert(history_id);
+    expected.insert(history_id);
+  }
+
+  // Enough out of order inserts and erases, mixed with appends, repeats and
+  // changes which cancel out, to be merged into the encoding a few times.
+  uint32 seed = 1;
+  for (size_t i = 0; i < 4 * PostingList::kMaxPendingChanges; ++i) {
+    seed = seed * 1103515245 + 12345;
+    const HistoryID history_id = 1 + (seed >> 8) % 1100;
+    if ((seed >> 20) % 2) {
+      posting_list.Insert(history_id);
+      expected.insert(history_id);
+    } else {
+      EXPECT_EQ(expected.erase(history_id) == 1,
+                posting_list.Erase(history_id));
+    }
+    ASSERT_EQ(expected.size(), posting_list.size());
+    ASSERT_EQ(HistoryIDVector(expected.begin(), expected.end()),
+              Decode(posting_list));
+  }
+
+  // Encode() includes the buffered changes.
+  posting_list.Erase(*expected.begin());
+  expected.erase(expected.begin());
+  posting_list.Insert(5);
+  expected.insert(5);
+  std::vector<uint8> encoded;
+  posting_list.Encode(&encoded);
+  HistoryIDVector decoded;
+  ASSERT_TRUE(PostingList::Decode(&encoded[0], encoded.size(), &decoded));
+  EXPECT_EQ(HistoryIDVector(expected.begin(), expected.end()), decoded);
+}
+
+TEST(URLIndexPostingListTest, IndexMatchesMap) {
+  WordIDHistoryMap word_id_history_map;
+  for (HistoryID history_id = 1; history_id < 200; ++history_id) {
+    word_id_history_map[0].insert(history_id);
+    if (history_id % 3 == 0)
+      word_id_history_map[1].insert(history_id);
+    if (history_id % 7 == 0)
+      word_id_history_map[4].insert(history_id);
+  }
+
+  PostingListIndex index;
+  index.Build(word_id_history_map);
+
+  WordIDSet word_id_set;
+  word_id_set.insert(1);
+  word_id_set.insert(4);
+  HistoryIDSet expected_set(word_id_history_map[1]);
+  expected_set.insert(word_id_history_map[4].begin(),
+                      word_id_history_map[4].end());
+  HistoryIDVector history_ids;
+  index.HistoryIDsForWords(word_id_set, &history_ids);
+  EXPECT_EQ(HistoryIDVector(expected_set.begin(), expected_set.end()),
+            history_ids);
+
+  // Words without postings, including ones past the end, contribute nothing.
+  word_id_set.clear();
+  word_id_set.insert(2);
+  word_id_set.insert(10);
+  index.HistoryIDsForWords(word_id_set, &history_ids);
+  EXPECT_TRUE(history_ids.empty());
+
+  index.Add(10, 500);
+  index.Add(4, 3);
+  index.Remove(4, 7);
+  word_id_set.insert(4);
+  index.HistoryIDsForWords(word_id_set, &history_ids);
+  HistoryIDSet expected_updated(word_id_history_map[4]);
+  expected_updated.insert(3);
+  expected_updated.erase(7);
+  expected_updated.insert(500);
+  EXPECT_EQ(HistoryIDVector(expected_updated.begin(), expected_updated.end()),
+            history_ids);
+
+  EXPECT_GT(index.EstimateMemoryUsage(), 0U);
+
+  // A copy is independent of the original.
+  PostingListIndex copy(index);
+  copy.Assign(1, HistoryIDVector(1, 42));
+  EXPECT_EQ(1U, copy.GetPostingList(1)->size());
+  EXPECT_EQ(word_id_history_map[1].size(), index.GetPostingList(1)->size());
+
+  index.Remove(10, 500);
+  EXPECT_FALSE(index.HasPostings(10));
+  EXPECT_TRUE(index.HasPostings(0));
+  EXPECT_FALSE(index.HasPostings(11));
+  EXPECT_TRUE(index.GetPostingList(11) == NULL);
+  EXPECT_FALSE(index.empty());
+  index.Clear();
+  EXPECT_TRUE(index.empty());
+  EXPECT_FALSE(index.HasPostings(0));
+}
+
+TEST(URLIndexPostingListTest, Intersect) {
+  HistoryIDVector evens;
+  HistoryIDVector sparse;
+  for (HistoryID i = 0; i < 10000; i += 2)
+    evens.push_back(i);
+  // Short enough relative to |evens| to take the galloping path.
+  sparse.push_back(3);
+  sparse.push_back(4);
+  sparse.push_back(5000);
+  sparse.push_back(9998);
+  sparse.push_back(20000);
+
+  HistoryIDVector expected;
+  std::set_intersection(evens.begin(), evens.end(),
+                        sparse.begin(), sparse.end(),
+                        std::back_inserter(expected));
+  HistoryIDVector result;
+  IntersectSortedHistoryIDs(evens, sparse, &result);
+  EXPECT_EQ(expected, result);
+  IntersectSortedHistoryIDs(sparse, evens, &result);
+  EXPECT_EQ(expected, result);
+
+  // Comparable sizes take the linear merge path.
+  HistoryIDVector threes;
+  for (HistoryID i = 0; i < 10000; i += 3)
+    threes.push_back(i);
+  expected.clear();
+  std::set_intersection(evens.begin(), evens.end(),
+                        threes.begin(), threes.end(),
+                        std::back_inserter(expected));
+  IntersectSortedHistoryIDs(evens, threes, &result);
+  EXPECT_EQ(expected, result);
+
+  IntersectSortedHistoryIDs(evens, HistoryIDVector(), &result);
+  EXPECT_TRUE(result.empty());
+}
+
+}  // namespace history
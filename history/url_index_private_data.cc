@@ -13,11 +13,17 @@
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/bind.h"
 #include "base/file_util.h"
+#include "base/files/important_file_writer.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/i18n/case_conversion.h"
+#include "base/memory/scoped_vector.h"
 #include "base/metrics/histogram.h"
+#include "base/pickle.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
 #include "base/time/time.h"
 #include "chrome/browser/autocomplete/autocomplete_provider.h"
 #include "chrome/browser/autocomplete/url_prefix.h"
@@ -26,6 +32,7 @@
 #include "chrome/browser/history/history_db_task.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/in_memory_url_index.h"
+#include "chrome/browser/history/parallel_scoring.h"
 #include "content/public/browser/browser_thread.h"
 #include "content/public/browser/notification_details.h"
 #include "content/public/browser/notification_service.h"
@@ -44,6 +51,42 @@ using in_memory_url_index::InMemoryURLIndexCacheItem;
 
 namespace {
 static const size_t kMaxVisitsToStoreInCache = 10u;
+
+// Identifies a flat index file ("HQPI").
+const uint32 kIndexFileMagic = 0x49505148;
+
+// The types of journal records.
+enum JournalRecordType {
+  // The complete current state of an indexed history item.
+  JOURNAL_RECORD_UPDATE = 1,
+  // The removal of a history item from the index.
+  JOURNAL_RECORD_DELETE = 2,
+};
+
+// Candidates are scored in runs of this many items, each run being the unit
+// of work handed to a scoring thread.
+const size_t kCandidatesPerShard = 128;
+
+// Smaller candidate sets are scored serially: scoring them takes too little
+// time for waking worker threads to pay off. Tune with
+// url_index_scoring_perftest.
+const size_t kMinCandidatesForParallelScoring = 2 * kCandidatesPerShard;
+
+// The most threads, including the searching thread, used to score the
+// candidates of one search.
+const int kMaxScoringThreads = 4;
+
+// Returns true if an index last rebuilt from history at |last_rebuild| should
+// be rebuilt again rather than restored.
+bool IsRebuildStale(const base::Time& last_rebuild) {
+  const base::TimeDelta rebuilt_ago = base::Time::Now() - last_rebuild;
+  // Rebuild a week-old index so that synced entries appear and expired
+  // entries disappear, and one from the future, allowing a day of slack for
+  // simple system clock changes such as time zone changes.
+  return (rebuilt_ago > base::TimeDelta::FromDays(7)) ||
+      (rebuilt_ago < base::TimeDelta::FromDays(-1));
+}
+
 }  // anonymous namespace
 
 namespace history {
@@ -77,6 +120,31 @@ bool LengthGreater(const string16& string_a, const string16& string_b) {
   return string_a.length() > string_b.length();
 }
 
+// Returns true if |current| is what |previous| becomes when the user types
+// more characters at its end: each string of |previous| other than the last
+// is unchanged, the last may have been extended, and strings may follow.
+bool ExtendsSearchStrings(const String16Vector& previous,
+                          const String16Vector& current) {
+  if (previous.empty() || current.size() < previous.size())
+    return false;
+  size_t last = previous.size() - 1;
+  for (size_t i = 0; i < last; ++i) {
+    if (current[i] != previous[i])
+      return false;
+  }
+  return StartsWith(current[last], previous[last], true);
+}
+
+// Returns the number of leading strings |previous| and |current| share.
+size_t CountCommonLeadingStrings(const String16Vector& previous,
+                                 const String16Vector& current) {
+  size_t count = 0;
+  while (count < previous.size() && count < current.size() &&
+         previous[count] == current[count])
+    ++count;
+  return count;
+}
+
 
 // UpdateRecentVisitsFromHistoryDBTask -----------------------------------------
 
@@ -145,16 +213,23 @@ UpdateRecentVisitsFromHistoryDBTask::~UpdateRecentVisitsFromHistoryDBTask() {
 URLIndexPrivateData::URLIndexPrivateData()
     : restored_cache_version_(0),
       saved_cache_version_(kCurrentCacheFileVersion),
+      restored_from_index_file_(false),
+      replayed_journal_records_(0),
       pre_filter_item_count_(0),
       post_filter_item_count_(0),
-      post_scoring_item_count_(0) {
+      post_scoring_item_count_(0),
+      search_was_refined_(false),
+      searches_in_progress_(0),
+      scoring_threads_(std::min(base::SysInfo::NumberOfProcessors(),
+                                kMaxScoringThreads)) {
 }
 
 ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
     string16 search_string,
     size_t cursor_position,
     const std::string& languages,
-    BookmarkService* bookmark_service) {
+    BookmarkService* bookmark_service,
+    const ScoringCancellationFlag* cancel_flag) {
   // If cursor position is set and useful (not at either end of the
   // string), allow the search string to be broken at cursor position.
   // We do this by pretending there's a space where the cursor is.
@@ -163,9 +238,37 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
       (cursor_position > 0)) {
     search_string.insert(cursor_position, ASCIIToUTF16(" "));
   }
-  pre_filter_item_count_ = 0;
-  post_filter_item_count_ = 0;
-  post_scoring_item_count_ = 0;
+
+  // Take the caches for this search, so that a search on another thread
+  // never waits for it.
+  SearchState state;
+  {
+    base::AutoLock lock(lock_);
+    state.search_term_cache_.swap(search_term_cache_);
+    state.last_search_.Swap(&last_search_);
+  }
+  ScoredHistoryMatches scored_items = SearchIndex(
+      search_string, languages, bookmark_service, cancel_flag, &state);
+  {
+    base::AutoLock lock(lock_);
+    search_term_cache_.swap(state.search_term_cache_);
+    last_search_.Swap(&state.last_search_);
+    pre_filter_item_count_ = state.pre_filter_item_count_;
+    post_filter_item_count_ = state.post_filter_item_count_;
+    post_scoring_item_count_ = state.post_scoring_item_count_;
+    search_was_refined_ = state.search_was_refined_;
+  }
+  return scored_items;
+}
+
+ScoredHistoryMatches URLIndexPrivateData::SearchIndex(
+    const string16& search_string,
+    const std::string& languages,
+    BookmarkService* bookmark_service,
+    const ScoringCancellationFlag* cancel_flag,
+    SearchState* state) const {
+  SearchTermCacheMap& search_term_cache = state->search_term_cache_;
+  RefinableSearch& last_search = state->last_search_;
   // The search string we receive may contain escaped characters. For reducing
   // the index we need individual, lower-cased words, ignoring escapings. For
   // the final filtering we need whitespace separated substrings possibly
@@ -184,42 +287,41 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
   // Do nothing if we have indexed no words (probably because we've not been
   // initialized yet) or the search string has no words.
   if (word_list_.empty() || lower_words.empty()) {
-    search_term_cache_.clear();  // Invalidate the term cache.
+    search_term_cache.clear();  // Invalidate the term cache.
+    last_search.Clear();
     return scored_items;
   }
 
-  // Reset used_ flags for search_term_cache_. We use a basic mark-and-sweep
+  // Reset used_ flags for |search_term_cache|. We use a basic mark-and-sweep
   // approach.
-  ResetSearchTermCache();
+  ResetSearchTermCache(&search_term_cache);
 
-  HistoryIDSet history_id_set = HistoryIDSetFromWords(lower_words);
+  HistoryIDVector candidates =
+      HistoryIDsFromWords(lower_words, &search_term_cache);
 
   // Trim the candidate pool if it is large. Note that we do not filter out
   // items that do not contain the search terms as proper substrings -- doing
   // so is the performance-costly operation we are trying to avoid in order
   // to maintain omnibox responsiveness.
   const size_t kItemsToScoreLimit = 500;
-  pre_filter_item_count_ = history_id_set.size();
+  state->pre_filter_item_count_ = candidates.size();
   // If we trim the results set we do not want to cache the results for next
   // time as the user's ultimately desired result could easily be eliminated
   // in this early rough filter.
-  bool was_trimmed = (pre_filter_item_count_ > kItemsToScoreLimit);
+  bool was_trimmed = (state->pre_filter_item_count_ > kItemsToScoreLimit);
   if (was_trimmed) {
-    HistoryIDVector history_ids;
-    std::copy(history_id_set.begin(), history_id_set.end(),
-              std::back_inserter(history_ids));
     // Trim down the set by sorting by typed-count, visit-count, and last
     // visit.
     HistoryItemFactorGreater
         item_factor_functor(history_info_map_);
-    std::partial_sort(history_ids.begin(),
-                      history_ids.begin() + kItemsToScoreLimit,
-                      history_ids.end(),
+    std::partial_sort(candidates.begin(),
+                      candidates.begin() + kItemsToScoreLimit,
+                      candidates.end(),
                       item_factor_functor);
-    history_id_set.clear();
-    std::copy(history_ids.begin(), history_ids.begin() + kItemsToScoreLimit,
-              std::inserter(history_id_set, history_id_set.end()));
-    post_filter_item_count_ = history_id_set.size();
+    candidates.resize(kItemsToScoreLimit);
+    // Score the survivors in HistoryID order, as untrimmed candidates are.
+    std::sort(candidates.begin(), candidates.end());
+    state->post_filter_item_count_ = candidates.size();
   }
 
   // Pass over all of the candidates filtering out any without a proper
@@ -242,11 +344,80 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
     // function that gives a reasonable order to matches when there
     // are no terms (i.e., all the words are some form of whitespace),
     // but this is such a rare edge case that it's not worth the time.
+    last_search.Clear();
     return scored_items;
   }
-  scored_items = std::for_each(history_id_set.begin(), history_id_set.end(),
-      AddHistoryMatch(*this, languages, bookmark_service, lower_raw_string,
-                      lower_raw_terms, base::Time::Now())).ScoredMatches();
+
+  // If the user has only typed more characters since the last search then
+  // narrow the candidates to the items which contained every term of that
+  // search, and reuse the matches of the terms which have not changed. As
+  // neither the index nor the previous candidates were trimmed this yields
+  // exactly the matches a full search would.
+  size_t reusable_terms = 0;
+  RowTermMatchesMap previous_term_matches;
+  if (!was_trimmed &&
+      ExtendsSearchStrings(last_search.lower_words_, lower_words) &&
+      ExtendsSearchStrings(last_search.lower_terms_, lower_raw_terms)) {
+    const RowTermMatchesMap& last_matches = last_search.row_term_matches_;
+    HistoryIDVector refined_ids;
+    for (HistoryIDVector::const_iterator iter = candidates.begin();
+         iter != candidates.end(); ++iter) {
+      if (last_matches.find(*iter) != last_matches.end())
+        refined_ids.push_back(*iter);
+    }
+    candidates.swap(refined_ids);
+    previous_term_matches.swap(last_search.row_term_matches_);
+    reusable_terms = CountCommonLeadingStrings(last_search.lower_terms_,
+                                               lower_raw_terms);
+    state->search_was_refined_ = true;
+  }
+  last_search.Clear();
+
+  // Score the candidates in shards, possibly on several threads. Each shard
+  // collects its own results, which are then concatenated in candidate order
+  // so that the outcome is the same as scoring the candidates serially.
+  // Concurrent shards look up |previous_term_matches| but each only takes
+  // the entries of its own candidates.
+  const size_t num_shards =
+      (candidates.size() + kCandidatesPerShard - 1) / kCandidatesPerShard;
+  std::vector<RowTermMatchesMap> shard_term_matches(num_shards);
+  ScopedVector<AddHistoryMatch> matchers;
+  const base::Time now = base::Time::Now();
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    matchers.push_back(new AddHistoryMatch(
+        *this, languages, bookmark_service, lower_raw_string, lower_raw_terms,
+        now, reusable_terms, &previous_term_matches,
+        &shard_term_matches[shard]));
+  }
+  base::Callback<void(size_t)> score_shard =
+      base::Bind(&URLIndexPrivateData::ScoreCandidateShard, &candidates,
+                 &matchers.get(), base::Unretained(cancel_flag));
+  // Waiting for the workers is not allowed on the UI thread, so searches
+  // made there are always scored serially.
+  if (scoring_threads_ > 1 &&
+      candidates.size() >= kMinCandidatesForParallelScoring &&
+      !content::BrowserThread::CurrentlyOn(content::BrowserThread::UI)) {
+    ScoredHistoryMatch::PrepareForConcurrentScoring();
+    RunShardsInParallel(num_shards, scoring_threads_ - 1, score_shard);
+  } else {
+    for (size_t shard = 0; shard < num_shards; ++shard)
+      score_shard.Run(shard);
+  }
+  if (cancel_flag && cancel_flag->IsCanceled()) {
+    last_search.Clear();
+    return ScoredHistoryMatches();
+  }
+  RowTermMatchesMap row_term_matches;
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    const ScoredHistoryMatches& shard_matches =
+        matchers[shard]->ScoredMatches();
+    scored_items.insert(scored_items.end(), shard_matches.begin(),
+                        shard_matches.end());
+    row_term_matches.insert(shard_term_matches[shard].begin(),
+                            shard_term_matches[shard].end());
+  }
+  UMA_HISTOGRAM_BOOLEAN("History.InMemoryURLIndexSearchRefined",
+                        state->search_was_refined_);
 
   // Select and sort only the top kMaxMatches results.
   if (scored_items.size() > AutocompleteProvider::kMaxMatches) {
@@ -260,16 +431,19 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
     std::sort(scored_items.begin(), scored_items.end(),
               ScoredHistoryMatch::MatchScoreGreater);
   }
-  post_scoring_item_count_ = scored_items.size();
+  state->post_scoring_item_count_ = scored_items.size();
 
   if (was_trimmed) {
-    search_term_cache_.clear();  // Invalidate the term cache.
+    search_term_cache.clear();  // Invalidate the term cache.
   } else {
+    last_search.lower_words_ = lower_words;
+    last_search.lower_terms_ = lower_raw_terms;
+    last_search.row_term_matches_.swap(row_term_matches);
     // Remove any stale SearchTermCacheItems.
-    for (SearchTermCacheMap::iterator cache_iter = search_term_cache_.begin();
-         cache_iter != search_term_cache_.end(); ) {
+    for (SearchTermCacheMap::iterator cache_iter = search_term_cache.begin();
+         cache_iter != search_term_cache.end(); ) {
       if (!cache_iter->second.used_)
-        search_term_cache_.erase(cache_iter++);
+        search_term_cache.erase(cache_iter++);
       else
         ++cache_iter;
     }
@@ -278,11 +452,34 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
   return scored_items;
 }
 
+void URLIndexPrivateData::BeginSearch() {
+  ++searches_in_progress_;
+}
+
+void URLIndexPrivateData::EndSearch() {
+  DCHECK_GT(searches_in_progress_, 0);
+  if (--searches_in_progress_ > 0)
+    return;
+  std::vector<base::Closure> updates;
+  updates.swap(deferred_updates_);
+  for (std::vector<base::Closure>::const_iterator iter = updates.begin();
+       iter != updates.end(); ++iter)
+    iter->Run();
+}
+
+void URLIndexPrivateData::RunWhenNotSearched(const base::Closure& update) {
+  if (being_searched())
+    deferred_updates_.push_back(update);
+  else
+    update.Run();
+}
+
 bool URLIndexPrivateData::UpdateURL(
     HistoryService* history_service,
     const URLRow& row,
     const std::string& languages,
     const std::set<std::string>& scheme_whitelist) {
+  DCHECK(!being_searched());
   // The row may or may not already be in our index. If it is not already
   // indexed and it qualifies then it gets indexed. If it is already
   // indexed and still qualifies then it gets updated, otherwise it
@@ -330,14 +527,23 @@ bool URLIndexPrivateData::UpdateURL(
     RemoveRowFromIndex(row);
     row_was_updated = true;
   }
-  if (row_was_updated)
+  if (row_was_updated) {
     search_term_cache_.clear();  // This invalidates the cache.
+    last_search_.Clear();
+  }
   return row_was_updated;
 }
 
 void URLIndexPrivateData::UpdateRecentVisits(
     URLID url_id,
     const VisitVector& recent_visits) {
+  if (being_searched()) {
+    // This object owns the deferred update, so it need not hold a reference.
+    RunWhenNotSearched(base::Bind(&URLIndexPrivateData::UpdateRecentVisits,
+                                  base::Unretained(this), url_id,
+                                  recent_visits));
+    return;
+  }
   HistoryInfoMap::iterator row_pos = history_info_map_.find(url_id);
   if (row_pos != history_info_map_.end()) {
     VisitInfoVector* visits = &row_pos->second.visits;
@@ -379,6 +585,7 @@ class HistoryInfoMapItemHasURL {
 };
 
 bool URLIndexPrivateData::DeleteURL(const GURL& url) {
+  DCHECK(!being_searched());
   // Find the matching entry in the history_info_map_.
   HistoryInfoMap::iterator pos = std::find_if(
       history_info_map_.begin(),
@@ -388,6 +595,7 @@ bool URLIndexPrivateData::DeleteURL(const GURL& url) {
     return false;
   RemoveRowFromIndex(pos->second.url_row);
   search_term_cache_.clear();  // This invalidates the cache.
+  last_search_.Clear();
   return true;
 }
 
@@ -458,6 +666,9 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RebuildFromHistory(
                              rebuilt_data->word_map_.size());
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLChars",
                              rebuilt_data->char_word_map_.size());
+  UMA_HISTOGRAM_MEMORY_KB(
+      "History.InMemoryURLPostingListMemory",
+      rebuilt_data->posting_index_.EstimateMemoryUsage() / 1024);
   return rebuilt_data;
 }
 
@@ -470,8 +681,119 @@ bool URLIndexPrivateData::WritePrivateDataToCacheFileTask(
   return private_data->SaveToFile(file_path);
 }
 
+// static
+scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RestoreFromIndexFile(
+    const base::FilePath& index_path,
+    const base::FilePath& journal_path,
+    const std::string& languages) {
+  base::TimeTicks beginning_time = base::TimeTicks::Now();
+  scoped_refptr<URLIndexPrivateData> restored_data(new URLIndexPrivateData);
+  {
+    // The index is built straight from the mapped pages; the scoping unmaps
+    // the file as soon as it has been consumed.
+    base::MemoryMappedFile mapped_file;
+    if (!mapped_file.Initialize(index_path) ||
+        mapped_file.length() > static_cast<size_t>(kint32max))
+      return NULL;
+    Pickle pickle(reinterpret_cast<const char*>(mapped_file.data()),
+                  static_cast<int>(mapped_file.length()));
+    if (!restored_data->RestoreIndex(pickle, languages)) {
+      LOG(WARNING) << "Failed to restore URLIndexPrivateData from "
+                   << index_path.value();
+      return NULL;
+    }
+  }
+
+  if (base::PathExists(journal_path)) {
+    base::MemoryMappedFile mapped_journal;
+    if (mapped_journal.Initialize(journal_path) &&
+        !restored_data->ReplayJournal(
+            reinterpret_cast<const char*>(mapped_journal.data()),
+            mapped_journal.length(), languages)) {
+      LOG(WARNING) << "Failed to replay the InMemoryURLIndex journal "
+                   << journal_path.value();
+      return NULL;
+    }
+  }
+  restored_data->restored_from_index_file_ = true;
+
+  UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexRestoreIndexFileTime",
+                      base::TimeTicks::Now() - beginning_time);
+  UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLIndexJournalRecords",
+                             restored_data->replayed_journal_records_);
+  UMA_HISTOGRAM_COUNTS("History.InMemoryURLHistoryItems",
+                       restored_data->history_id_word_map_.size());
+  if (restored_data->Empty())
+    return NULL;  // 'No data' is the same as a failed reload.
+  return restored_data;
+}
+
+// static
+bool URLIndexPrivateData::WritePrivateDataToIndexFileTask(
+    scoped_refptr<URLIndexPrivateData> private_data,
+    const base::FilePath& index_path,
+    const base::FilePath& journal_path) {
+  DCHECK(private_data.get());
+  DCHECK(!index_path.empty());
+  base::TimeTicks beginning_time = base::TimeTicks::Now();
+  Pickle pickle;
+  private_data->SaveIndex(&pickle);
+  if (!base::ImportantFileWriter::WriteFileAtomically(
+          index_path,
+          std::string(static_cast<const char*>(pickle.data()),
+                      pickle.size()))) {
+    LOG(WARNING) << "Failed to write " << index_path.value();
+    return false;
+  }
+  base::DeleteFile(journal_path, false);
+  UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexSaveIndexFileTime",
+                      base::TimeTicks::Now() - beginning_time);
+  UMA_HISTOGRAM_COUNTS("History.InMemoryURLIndexFileSize", pickle.size());
+  return true;
+}
+
+// static
+bool URLIndexPrivateData::AppendToJournalFileTask(
+    const base::FilePath& journal_path,
+    const std::string& records) {
+  if (records.empty())
+    return true;
+  int size = static_cast<int>(records.size());
+  int written = base::PathExists(journal_path) ?
+      file_util::AppendToFile(journal_path, records.data(), size) :
+      file_util::WriteFile(journal_path, records.data(), size);
+  // A partially written record is ignored on replay, along with anything
+  // appended after it, so a failure here loses updates but never corrupts
+  // the index.
+  return written == size;
+}
+
+void URLIndexPrivateData::AppendJournalRecords(
+    const HistoryIDSet& history_ids,
+    std::string* records) const {
+  for (HistoryIDSet::const_iterator iter = history_ids.begin();
+       iter != history_ids.end(); ++iter) {
+    Pickle record;
+    HistoryInfoMap::const_iterator info = history_info_map_.find(*iter);
+    if (info != history_info_map_.end()) {
+      record.WriteInt(JOURNAL_RECORD_UPDATE);
+      WriteHistoryInfo(info->first, info->second, &record);
+    } else {
+      record.WriteInt(JOURNAL_RECORD_DELETE);
+      record.WriteInt64(*iter);
+    }
+    // Each record is framed by its length so that replay can detect a record
+    // torn by a crash.
+    uint32 record_size = static_cast<uint32>(record.size());
+    records->append(reinterpret_cast<const char*>(&record_size),
+                    sizeof(record_size));
+    records->append(static_cast<const char*>(record.data()), record.size());
+  }
+}
+
 void URLIndexPrivateData::CancelPendingUpdates() {
   recent_visits_consumer_.CancelAllRequests();
+  deferred_updates_.clear();
 }
 
 scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::Duplicate() const {
@@ -481,13 +803,14 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::Duplicate() const {
   data_copy->available_words_ = available_words_;
   data_copy->word_map_ = word_map_;
   data_copy->char_word_map_ = char_word_map_;
-  data_copy->word_id_history_map_ = word_id_history_map_;
+  data_copy->posting_index_ = posting_index_;
   data_copy->history_id_word_map_ = history_id_word_map_;
   data_copy->history_info_map_ = history_info_map_;
   data_copy->word_starts_map_ = word_starts_map_;
   return data_copy;
   // Not copied:
   //    search_term_cache_
+  //    last_search_
   //    pre_filter_item_count_
   //    post_filter_item_count_
   //    post_scoring_item_count_
@@ -498,58 +821,60 @@ bool URLIndexPrivateData::Empty() const {
 }
 
 void URLIndexPrivateData::Clear() {
+  DCHECK(!being_searched());
   last_time_rebuilt_from_history_ = base::Time();
   word_list_.clear();
   available_words_.clear();
   word_map_.clear();
   char_word_map_.clear();
-  word_id_history_map_.clear();
+  posting_index_.Clear();
   history_id_word_map_.clear();
   history_info_map_.clear();
   word_starts_map_.clear();
+  last_search_.Clear();
 }
 
 URLIndexPrivateData::~URLIndexPrivateData() {}
 
-HistoryIDSet URLIndexPrivateData::HistoryIDSetFromWords(
-    const String16Vector& unsorted_words) {
-  // Break the terms down into individual terms (words), get the candidate
-  // set for each term, and intersect each to get a final candidate list.
+HistoryIDVector URLIndexPrivateData::HistoryIDsFromWords(
+    const String16Vector& unsorted_words,
+    SearchTermCacheMap* search_term_cache) const {
+  // Break the terms down into individual terms (words), get the candidates
+  // for each term, and intersect each to get a final candidate list.
   // Note that a single 'term' from the user's perspective might be
   // a string like "http://www.somewebsite.com" which, from our perspective,
   // is four words: 'http', 'www', 'somewebsite', and 'com'.
-  HistoryIDSet history_id_set;
   String16Vector words(unsorted_words);
   // Sort the words into the longest first as such are likely to narrow down
   // the results quicker. Also, single character words are the most expensive
   // to process so save them for last.
   std::sort(words.begin(), words.end(), LengthGreater);
+  HistoryIDVector history_ids;
+  HistoryIDVector intersection;
   for (String16Vector::iterator iter = words.begin(); iter != words.end();
        ++iter) {
-    string16 uni_word = *iter;
-    HistoryIDSet term_history_set = HistoryIDsForTerm(uni_word);
-    if (term_history_set.empty()) {
-      history_id_set.clear();
-      break;
-    }
+    HistoryIDVector term_history_ids =
+        HistoryIDsForTerm(*iter, search_term_cache);
+    if (term_history_ids.empty())
+      return HistoryIDVector();
     if (iter == words.begin()) {
-      history_id_set.swap(term_history_set);
-    } else {
-      HistoryIDSet new_history_id_set;
-      std::set_intersection(history_id_set.begin(), history_id_set.end(),
-                            term_history_set.begin(), term_history_set.end(),
-                            std::inserter(new_history_id_set,
-                                          new_history_id_set.begin()));
-      history_id_set.swap(new_history_id_set);
+      history_ids.swap(term_history_ids);
+      continue;
     }
+    // A short candidate list gallops through a long one.
+    IntersectSortedHistoryIDs(history_ids, term_history_ids, &intersection);
+    history_ids.swap(intersection);
+    if (history_ids.empty())
+      break;
   }
-  return history_id_set;
+  return history_ids;
 }
 
-HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
-    const string16& term) {
+HistoryIDVector URLIndexPrivateData::HistoryIDsForTerm(
+    const string16& term,
+    SearchTermCacheMap* search_term_cache) const {
   if (term.empty())
-    return HistoryIDSet();
+    return HistoryIDVector();
 
   // TODO(mrossetti): Consider optimizing for very common terms such as
   // 'http[s]', 'www', 'com', etc. Or collect the top 100 more frequently
@@ -559,11 +884,11 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
   WordIDSet word_id_set;
   if (term_length > 1) {
     // See if this term or a prefix thereof is present in the cache.
-    SearchTermCacheMap::iterator best_prefix(search_term_cache_.end());
-    for (SearchTermCacheMap::iterator cache_iter = search_term_cache_.begin();
-         cache_iter != search_term_cache_.end(); ++cache_iter) {
+    SearchTermCacheMap::iterator best_prefix(search_term_cache->end());
+    for (SearchTermCacheMap::iterator cache_iter = search_term_cache->begin();
+         cache_iter != search_term_cache->end(); ++cache_iter) {
       if (StartsWith(term, cache_iter->first, false) &&
-          (best_prefix == search_term_cache_.end() ||
+          (best_prefix == search_term_cache->end() ||
            cache_iter->first.length() > best_prefix->first.length()))
         best_prefix = cache_iter;
     }
@@ -572,21 +897,21 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
     // for further refining the results from that prefix.
     Char16Set prefix_chars;
     string16 leftovers(term);
-    if (best_prefix != search_term_cache_.end()) {
+    if (best_prefix != search_term_cache->end()) {
       // If the prefix is an exact match for the term then grab the cached
       // results and we're done.
       size_t prefix_length = best_prefix->first.length();
       if (prefix_length == term_length) {
         best_prefix->second.used_ = true;
-        return best_prefix->second.history_id_set_;
+        return best_prefix->second.history_ids_;
       }
 
       // Otherwise we have a handy starting point.
       // If there are no history results for this prefix then we can bail early
       // as there will be no history results for the full term.
-      if (best_prefix->second.history_id_set_.empty()) {
-        search_term_cache_[term] = SearchTermCacheItem();
-        return HistoryIDSet();
+      if (best_prefix->second.history_ids_.empty()) {
+        (*search_term_cache)[term] = SearchTermCacheItem();
+        return HistoryIDVector();
       }
       word_id_set = best_prefix->second.word_id_set_;
       prefix_chars = Char16SetFromString16(best_prefix->first);
@@ -605,8 +930,8 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
       WordIDSet leftover_set(WordIDSetForTermChars(unique_chars));
       // We might come up empty on the leftovers.
       if (leftover_set.empty()) {
-        search_term_cache_[term] = SearchTermCacheItem();
-        return HistoryIDSet();
+        (*search_term_cache)[term] = SearchTermCacheItem();
+        return HistoryIDVector();
       }
       // Or there may not have been a prefix from which to start.
       if (prefix_chars.empty()) {
@@ -634,42 +959,37 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
     word_id_set = WordIDSetForTermChars(Char16SetFromString16(term));
   }
 
-  // If any words resulted then we can compose a set of history IDs by unioning
-  // the sets from each word.
-  HistoryIDSet history_id_set;
-  if (!word_id_set.empty()) {
-    for (WordIDSet::iterator word_id_iter = word_id_set.begin();
-         word_id_iter != word_id_set.end(); ++word_id_iter) {
-      WordID word_id = *word_id_iter;
-      WordIDHistoryMap::iterator word_iter = word_id_history_map_.find(word_id);
-      if (word_iter != word_id_history_map_.end()) {
-        HistoryIDSet& word_history_id_set(word_iter->second);
-        history_id_set.insert(word_history_id_set.begin(),
-                              word_history_id_set.end());
-      }
-    }
-  }
+  // If any words resulted then we can compose the history IDs by unioning
+  // the postings of each word.
+  HistoryIDVector history_ids = HistoryIDsForWordIDs(word_id_set);
 
   // Record a new cache entry for this word if the term is longer than
   // a single character.
   if (term_length > 1)
-    search_term_cache_[term] = SearchTermCacheItem(word_id_set, history_id_set);
+    (*search_term_cache)[term] = SearchTermCacheItem(word_id_set, history_ids);
 
-  return history_id_set;
+  return history_ids;
+}
+
+HistoryIDVector URLIndexPrivateData::HistoryIDsForWordIDs(
+    const WordIDSet& word_id_set) const {
+  HistoryIDVector history_ids;
+  posting_index_.HistoryIDsForWords(word_id_set, &history_ids);
+  return history_ids;
 }
 
 WordIDSet URLIndexPrivateData::WordIDSetForTermChars(
-    const Char16Set& term_chars) {
+    const Char16Set& term_chars) const {
   WordIDSet word_id_set;
   for (Char16Set::const_iterator c_iter = term_chars.begin();
        c_iter != term_chars.end(); ++c_iter) {
-    CharWordIDMap::iterator char_iter = char_word_map_.find(*c_iter);
+    CharWordIDMap::const_iterator char_iter = char_word_map_.find(*c_iter);
     if (char_iter == char_word_map_.end()) {
       // A character was not found so there are no matching results: bail.
       word_id_set.clear();
       break;
     }
-    WordIDSet& char_word_id_set(char_iter->second);
+    const WordIDSet& char_word_id_set(char_iter->second);
     // It is possible for there to no longer be any words associated with
     // a particular character. Give up in that case.
     if (char_word_id_set.empty()) {
@@ -771,6 +1091,7 @@ void URLIndexPrivateData::AddRowWordsToIndex(const URLRow& row,
     AddWordToIndex(*word_iter, history_id);
 
   search_term_cache_.clear();  // Invalidate the term cache.
+  last_search_.Clear();
 }
 
 void URLIndexPrivateData::AddWordToIndex(const string16& term,
@@ -794,9 +1115,8 @@ void URLIndexPrivateData::AddWordHistory(const string16& term,
   }
   word_map_[term] = word_id;
 
-  HistoryIDSet history_id_set;
-  history_id_set.insert(history_id);
-  word_id_history_map_[word_id] = history_id_set;
+  DCHECK(!posting_index_.HasPostings(word_id));
+  posting_index_.Add(word_id, history_id);
   AddToHistoryIDWordMap(history_id, word_id);
 
   // For each character in the newly added word (i.e. a word that is not
@@ -821,10 +1141,8 @@ void URLIndexPrivateData::AddWordHistory(const string16& term,
 
 void URLIndexPrivateData::UpdateWordHistory(WordID word_id,
                                             HistoryID history_id) {
-  WordIDHistoryMap::iterator history_pos = word_id_history_map_.find(word_id);
-  DCHECK(history_pos != word_id_history_map_.end());
-  HistoryIDSet& history_id_set(history_pos->second);
-  history_id_set.insert(history_id);
+  DCHECK(posting_index_.HasPostings(word_id));
+  posting_index_.Add(word_id, history_id);
   AddToHistoryIDWordMap(history_id, word_id);
 }
 
@@ -849,8 +1167,8 @@ void URLIndexPrivateData::RemoveRowFromIndex(const URLRow& row) {
 }
 
 void URLIndexPrivateData::RemoveRowWordsFromIndex(const URLRow& row) {
-  // Remove the entries in history_id_word_map_ and word_id_history_map_ for
-  // this row.
+  // Remove the entries in history_id_word_map_ and posting_index_ for this
+  // row.
   HistoryID history_id = static_cast<HistoryID>(row.id());
   WordIDSet word_id_set = history_id_word_map_[history_id];
   history_id_word_map_.erase(history_id);
@@ -859,8 +1177,8 @@ void URLIndexPrivateData::RemoveRowWordsFromIndex(const URLRow& row) {
   for (WordIDSet::iterator word_id_iter = word_id_set.begin();
        word_id_iter != word_id_set.end(); ++word_id_iter) {
     WordID word_id = *word_id_iter;
-    word_id_history_map_[word_id].erase(history_id);
-    if (!word_id_history_map_[word_id].empty())
+    posting_index_.Remove(word_id, history_id);
+    if (posting_index_.HasPostings(word_id))
       continue;  // The word is still in use.
 
     // The word is no longer in use. Reconcile any changes to character usage.
@@ -875,16 +1193,17 @@ void URLIndexPrivateData::RemoveRowWordsFromIndex(const URLRow& row) {
     }
 
     // Complete the removal of references to the word.
-    word_id_history_map_.erase(word_id);
     word_map_.erase(word);
     word_list_[word_id] = string16();
     available_words_.insert(word_id);
   }
 }
 
-void URLIndexPrivateData::ResetSearchTermCache() {
-  for (SearchTermCacheMap::iterator iter = search_term_cache_.begin();
-       iter != search_term_cache_.end(); ++iter)
+// static
+void URLIndexPrivateData::ResetSearchTermCache(
+    SearchTermCacheMap* search_term_cache) {
+  for (SearchTermCacheMap::iterator iter = search_term_cache->begin();
+       iter != search_term_cache->end(); ++iter)
     iter->second.used_ = false;
 }
 
@@ -968,20 +1287,23 @@ void URLIndexPrivateData::SaveCharWordMap(
 
 void URLIndexPrivateData::SaveWordIDHistoryMap(
     InMemoryURLIndexCacheItem* cache) const {
-  if (word_id_history_map_.empty())
+  if (word_map_.empty())
     return;
+  // Every word in |word_map_| has postings, and no other word does.
   WordIDHistoryMapItem* map_item = cache->mutable_word_id_history_map();
-  map_item->set_item_count(word_id_history_map_.size());
-  for (WordIDHistoryMap::const_iterator iter = word_id_history_map_.begin();
-       iter != word_id_history_map_.end(); ++iter) {
+  map_item->set_item_count(word_map_.size());
+  HistoryIDVector history_ids;
+  for (WordMap::const_iterator iter = word_map_.begin();
+       iter != word_map_.end(); ++iter) {
     WordIDHistoryMapEntry* map_entry =
         map_item->add_word_id_history_map_entry();
-    map_entry->set_word_id(iter->first);
-    const HistoryIDSet& history_id_set(iter->second);
-    map_entry->set_item_count(history_id_set.size());
-    for (HistoryIDSet::const_iterator set_iter = history_id_set.begin();
-         set_iter != history_id_set.end(); ++set_iter)
-      map_entry->add_history_id(*set_iter);
+    map_entry->set_word_id(iter->second);
+    history_ids.clear();
+    posting_index_.GetPostingList(iter->second)->DecodeTo(&history_ids);
+    map_entry->set_item_count(history_ids.size());
+    for (HistoryIDVector::const_iterator id_iter = history_ids.begin();
+         id_iter != history_ids.end(); ++id_iter)
+      map_entry->add_history_id(*id_iter);
   }
 }
 
@@ -1046,17 +1368,8 @@ bool URLIndexPrivateData::RestorePrivateData(
     const std::string& languages) {
   last_time_rebuilt_from_history_ =
       base::Time::FromInternalValue(cache.last_rebuild_timestamp());
-  const base::TimeDelta rebuilt_ago =
-      base::Time::Now() - last_time_rebuilt_from_history_;
-  if ((rebuilt_ago > base::TimeDelta::FromDays(7)) ||
-      (rebuilt_ago < base::TimeDelta::FromDays(-1))) {
-    // Cache is more than a week old or, somehow, from some time in the future.
-    // It's probably a good time to rebuild the index from history to
-    // allow synced entries to now appear, expired entries to disappear, etc.
-    // Allow one day in the future to make the cache not rebuild on simple
-    // system clock changes such as time zone changes.
+  if (IsRebuildStale(last_time_rebuilt_from_history_))
     return false;
-  }
   if (cache.has_version()) {
     if (cache.version() < kCurrentCacheFileVersion) {
       // Don't try to restore an old format cache file.  (This will cause
@@ -1142,6 +1455,7 @@ bool URLIndexPrivateData::RestoreWordIDHistoryMap(
     return false;
   const RepeatedPtrField<WordIDHistoryMapEntry>&
       entries(list_item.word_id_history_map_entry());
+  HistoryIDVector history_ids;
   for (RepeatedPtrField<WordIDHistoryMapEntry>::const_iterator iter =
        entries.begin(); iter != entries.end(); ++iter) {
     expected_item_count = iter->item_count();
@@ -1149,14 +1463,17 @@ bool URLIndexPrivateData::RestoreWordIDHistoryMap(
     if (actual_item_count == 0 || actual_item_count != expected_item_count)
       return false;
     WordID word_id = iter->word_id();
-    HistoryIDSet history_id_set;
-    const RepeatedField<int64>& history_ids(iter->history_id());
-    for (RepeatedField<int64>::const_iterator jiter = history_ids.begin();
-         jiter != history_ids.end(); ++jiter) {
-      history_id_set.insert(*jiter);
-      AddToHistoryIDWordMap(*jiter, word_id);
-    }
-    word_id_history_map_[word_id] = history_id_set;
+    if (word_id >= word_list_.size())
+      return false;
+    history_ids.assign(iter->history_id().begin(), iter->history_id().end());
+    // Each list is encoded once, from its sorted IDs.
+    std::sort(history_ids.begin(), history_ids.end());
+    history_ids.erase(std::unique(history_ids.begin(), history_ids.end()),
+                      history_ids.end());
+    for (HistoryIDVector::const_iterator id_iter = history_ids.begin();
+         id_iter != history_ids.end(); ++id_iter)
+      AddToHistoryIDWordMap(*id_iter, word_id);
+    posting_index_.Assign(word_id, history_ids);
   }
   return true;
 }
@@ -1247,6 +1564,250 @@ bool URLIndexPrivateData::RestoreWordStartsMap(
   return true;
 }
 
+void URLIndexPrivateData::SaveIndex(Pickle* pickle) const {
+  pickle->WriteUInt32(kIndexFileMagic);
+  pickle->WriteInt(kCurrentIndexFileVersion);
+  pickle->WriteInt64(last_time_rebuilt_from_history_.ToInternalValue());
+
+  // Words, in WordID order. Unused slots are kept, as empty strings, so that
+  // WordIDs remain valid.
+  pickle->WriteUInt64(word_list_.size());
+  for (String16Vector::const_iterator iter = word_list_.begin();
+       iter != word_list_.end(); ++iter)
+    pickle->WriteString16(*iter);
+
+  // Each word's history items as its delta-encoded posting list. The word and
+  // character maps and the history/word map are derived from these on
+  // restore rather than stored. Every word in |word_map_| has postings, and
+  // no other word does.
+  pickle->WriteUInt64(word_map_.size());
+  std::vector<uint8> encoded;
+  for (WordMap::const_iterator iter = word_map_.begin();
+       iter != word_map_.end(); ++iter) {
+    posting_index_.GetPostingList(iter->second)->Encode(&encoded);
+    pickle->WriteUInt64(iter->second);
+    pickle->WriteData(
+        encoded.empty() ? NULL : reinterpret_cast<const char*>(&encoded[0]),
+        static_cast<int>(encoded.size()));
+  }
+
+  pickle->WriteUInt64(history_info_map_.size());
+  for (HistoryInfoMap::const_iterator iter = history_info_map_.begin();
+       iter != history_info_map_.end(); ++iter)
+    WriteHistoryInfo(iter->first, iter->second, pickle);
+
+  pickle->WriteUInt64(word_starts_map_.size());
+  for (WordStartsMap::const_iterator iter = word_starts_map_.begin();
+       iter != word_starts_map_.end(); ++iter) {
+    pickle->WriteInt64(iter->first);
+    const WordStarts* starts[] = { &iter->second.url_word_starts_,
+                                   &iter->second.title_word_starts_ };
+    for (size_t i = 0; i < arraysize(starts); ++i) {
+      pickle->WriteUInt64(starts[i]->size());
+      for (WordStarts::const_iterator start_iter = starts[i]->begin();
+           start_iter != starts[i]->end(); ++start_iter)
+        pickle->WriteUInt32(static_cast<uint32>(*start_iter));
+    }
+  }
+}
+
+bool URLIndexPrivateData::RestoreIndex(const Pickle& pickle,
+                                       const std::string& languages) {
+  PickleIterator iter(pickle);
+  uint32 magic;
+  int version;
+  int64 last_rebuild;
+  if (!iter.ReadUInt32(&magic) || magic != kIndexFileMagic ||
+      !iter.ReadInt(&version) || version != kCurrentIndexFileVersion ||
+      !iter.ReadInt64(&last_rebuild))
+    return false;
+  last_time_rebuilt_from_history_ = base::Time::FromInternalValue(last_rebuild);
+  if (IsRebuildStale(last_time_rebuilt_from_history_))
+    return false;
+  restored_cache_version_ = version;
+
+  // Every entry takes at least four bytes, which bounds the counts read below
+  // by the size of the file.
+  uint64 word_count;
+  if (!iter.ReadUInt64(&word_count) || word_count > pickle.size())
+    return false;
+  word_list_.reserve(static_cast<size_t>(word_count));
+  for (WordID word_id = 0; word_id < word_count; ++word_id) {
+    string16 word;
+    if (!iter.ReadString16(&word))
+      return false;
+    word_list_.push_back(word);
+    if (word.empty()) {
+      // A slot freed by a removed word, to be reused by the next new word.
+      available_words_.insert(word_id);
+      continue;
+    }
+    word_map_[word] = word_id;
+    Char16Set characters = Char16SetFromString16(word);
+    for (Char16Set::iterator char_iter = characters.begin();
+         char_iter != characters.end(); ++char_iter)
+      char_word_map_[*char_iter].insert(word_id);
+  }
+
+  uint64 posting_count;
+  if (!iter.ReadUInt64(&posting_count))
+    return false;
+  HistoryIDVector history_ids;
+  for (uint64 i = 0; i < posting_count; ++i) {
+    uint64 raw_word_id;
+    const char* data;
+    int length;
+    if (!iter.ReadUInt64(&raw_word_id) || raw_word_id >= word_list_.size() ||
+        !iter.ReadData(&data, &length))
+      return false;
+    WordID word_id = static_cast<WordID>(raw_word_id);
+    history_ids.clear();
+    if (!PostingList::Decode(reinterpret_cast<const uint8*>(data), length,
+                             &history_ids) || history_ids.empty() ||
+        std::adjacent_find(history_ids.begin(), history_ids.end(),
+                           std::greater_equal<HistoryID>()) !=
+            history_ids.end())
+      return false;
+    for (HistoryIDVector::const_iterator history_iter = history_ids.begin();
+         history_iter != history_ids.end(); ++history_iter)
+      AddToHistoryIDWordMap(*history_iter, word_id);
+    posting_index_.Assign(word_id, history_ids);
+  }
+
+  uint64 item_count;
+  if (!iter.ReadUInt64(&item_count))
+    return false;
+  for (uint64 i = 0; i < item_count; ++i) {
+    HistoryID history_id;
+    HistoryInfoMapValue info;
+    if (!ReadHistoryInfo(&iter, &history_id, &info))
+      return false;
+    history_info_map_[history_id] = info;
+  }
+
+  uint64 starts_count;
+  if (!iter.ReadUInt64(&starts_count))
+    return false;
+  for (uint64 i = 0; i < starts_count; ++i) {
+    HistoryID history_id;
+    if (!iter.ReadInt64(&history_id))
+      return false;
+    RowWordStarts& row_starts = word_starts_map_[history_id];
+    WordStarts* starts[] = { &row_starts.url_word_starts_,
+                             &row_starts.title_word_starts_ };
+    for (size_t j = 0; j < arraysize(starts); ++j) {
+      uint64 count;
+      if (!iter.ReadUInt64(&count))
+        return false;
+      for (uint64 k = 0; k < count; ++k) {
+        uint32 start;
+        if (!iter.ReadUInt32(&start))
+          return false;
+        starts[j]->push_back(start);
+      }
+    }
+  }
+  return true;
+}
+
+bool URLIndexPrivateData::ReplayJournal(const char* data,
+                                        size_t length,
+                                        const std::string& languages) {
+  const char* end = data + length;
+  while (static_cast<size_t>(end - data) >= sizeof(uint32)) {
+    uint32 record_size;
+    memcpy(&record_size, data, sizeof(record_size));
+    data += sizeof(record_size);
+    if (record_size > static_cast<size_t>(end - data))
+      break;  // Torn by a crash while appending; drop it.
+    Pickle record(data, static_cast<int>(record_size));
+    data += record_size;
+
+    PickleIterator iter(record);
+    int type;
+    if (!iter.ReadInt(&type))
+      return false;
+    HistoryID history_id;
+    HistoryInfoMapValue info;
+    if (type == JOURNAL_RECORD_UPDATE) {
+      if (!ReadHistoryInfo(&iter, &history_id, &info))
+        return false;
+    } else if (type != JOURNAL_RECORD_DELETE || !iter.ReadInt64(&history_id)) {
+      return false;
+    }
+
+    // Both kinds of record replace whatever the index holds for the item.
+    HistoryInfoMap::iterator existing = history_info_map_.find(history_id);
+    if (existing != history_info_map_.end()) {
+      URLRow old_row(existing->second.url_row);
+      RemoveRowFromIndex(old_row);
+    }
+    if (type == JOURNAL_RECORD_UPDATE) {
+      history_info_map_[history_id] = info;
+      RowWordStarts word_starts;
+      AddRowWordsToIndex(info.url_row, &word_starts, languages);
+      word_starts_map_[history_id] = word_starts;
+    }
+    ++replayed_journal_records_;
+  }
+  return true;
+}
+
+// static
+void URLIndexPrivateData::WriteHistoryInfo(HistoryID history_id,
+                                           const HistoryInfoMapValue& info,
+                                           Pickle* pickle) {
+  const URLRow& url_row(info.url_row);
+  pickle->WriteInt64(history_id);
+  pickle->WriteString(url_row.url().spec());
+  pickle->WriteString16(url_row.title());
+  pickle->WriteInt(url_row.visit_count());
+  pickle->WriteInt(url_row.typed_count());
+  pickle->WriteInt64(url_row.last_visit().ToInternalValue());
+  pickle->WriteUInt64(info.visits.size());
+  for (VisitInfoVector::const_iterator iter = info.visits.begin();
+       iter != info.visits.end(); ++iter) {
+    pickle->WriteInt64(iter->first.ToInternalValue());
+    pickle->WriteInt(iter->second);
+  }
+}
+
+// static
+bool URLIndexPrivateData::ReadHistoryInfo(PickleIterator* iter,
+                                          HistoryID* history_id,
+                                          HistoryInfoMapValue* info) {
+  std::string url;
+  string16 title;
+  int visit_count;
+  int typed_count;
+  int64 last_visit;
+  uint64 visits_size;
+  if (!iter->ReadInt64(history_id) || !iter->ReadString(&url) ||
+      !iter->ReadString16(&title) || !iter->ReadInt(&visit_count) ||
+      !iter->ReadInt(&typed_count) || !iter->ReadInt64(&last_visit) ||
+      !iter->ReadUInt64(&visits_size) ||
+      visits_size > kMaxVisitsToStoreInCache)
+    return false;
+  URLRow url_row(GURL(url), *history_id);
+  url_row.set_title(title);
+  url_row.set_visit_count(visit_count);
+  url_row.set_typed_count(typed_count);
+  url_row.set_last_visit(base::Time::FromInternalValue(last_visit));
+  info->url_row = url_row;
+  info->visits.clear();
+  info->visits.reserve(static_cast<size_t>(visits_size));
+  for (uint64 i = 0; i < visits_size; ++i) {
+    int64 visit_time;
+    int transition;
+    if (!iter->ReadInt64(&visit_time) || !iter->ReadInt(&transition))
+      return false;
+    info->visits.push_back(std::make_pair(
+        base::Time::FromInternalValue(visit_time),
+        static_cast<content::PageTransition>(transition)));
+  }
+  return true;
+}
+
 // static
 bool URLIndexPrivateData::URLSchemeIsWhitelisted(
     const GURL& gurl,
@@ -1259,9 +1820,9 @@ bool URLIndexPrivateData::URLSchemeIsWhitelisted(
 
 URLIndexPrivateData::SearchTermCacheItem::SearchTermCacheItem(
     const WordIDSet& word_id_set,
-    const HistoryIDSet& history_id_set)
+    const HistoryIDVector& history_ids)
     : word_id_set_(word_id_set),
-      history_id_set_(history_id_set),
+      history_ids_(history_ids),
       used_(true) {}
 
 URLIndexPrivateData::SearchTermCacheItem::SearchTermCacheItem()
@@ -1270,6 +1831,36 @@ URLIndexPrivateData::SearchTermCacheItem::SearchTermCacheItem()
 URLIndexPrivateData::SearchTermCacheItem::~SearchTermCacheItem() {}
 
 
+// URLIndexPrivateData::RefinableSearch ----------------------------------------
+
+URLIndexPrivateData::RefinableSearch::RefinableSearch() {}
+
+URLIndexPrivateData::RefinableSearch::~RefinableSearch() {}
+
+void URLIndexPrivateData::RefinableSearch::Clear() {
+  lower_words_.clear();
+  lower_terms_.clear();
+  row_term_matches_.clear();
+}
+
+void URLIndexPrivateData::RefinableSearch::Swap(RefinableSearch* other) {
+  lower_words_.swap(other->lower_words_);
+  lower_terms_.swap(other->lower_terms_);
+  row_term_matches_.swap(other->row_term_matches_);
+}
+
+// URLIndexPrivateData::SearchState --------------------------------------------
+
+URLIndexPrivateData::SearchState::SearchState()
+    : pre_filter_item_count_(0),
+      post_filter_item_count_(0),
+      post_scoring_item_count_(0),
+      search_was_refined_(false) {
+}
+
+URLIndexPrivateData::SearchState::~SearchState() {}
+
+
 // URLIndexPrivateData::AddHistoryMatch ----------------------------------------
 
 URLIndexPrivateData::AddHistoryMatch::AddHistoryMatch(
@@ -1278,13 +1869,19 @@ URLIndexPrivateData::AddHistoryMatch::AddHistoryMatch(
     BookmarkService* bookmark_service,
     const string16& lower_string,
     const String16Vector& lower_terms,
-    const base::Time now)
+    const base::Time now,
+    size_t reusable_terms,
+    RowTermMatchesMap* previous_term_matches,
+    RowTermMatchesMap* row_term_matches)
   : private_data_(private_data),
     languages_(languages),
     bookmark_service_(bookmark_service),
     lower_string_(lower_string),
     lower_terms_(lower_terms),
-    now_(now) {}
+    now_(now),
+    reusable_terms_(reusable_terms),
+    previous_term_matches_(previous_term_matches),
+    row_term_matches_(row_term_matches) {}
 
 URLIndexPrivateData::AddHistoryMatch::~AddHistoryMatch() {}
 
@@ -1298,11 +1895,37 @@ void URLIndexPrivateData::AddHistoryMatch::operator()(
     WordStartsMap::const_iterator starts_pos =
         private_data_.word_starts_map_.find(history_id);
     DCHECK(starts_pos != private_data_.word_starts_map_.end());
+    RowTermMatches term_matches;
+    size_t reusable_terms = 0;
+    RowTermMatchesMap::iterator previous =
+        previous_term_matches_->find(history_id);
+    if (previous != previous_term_matches_->end()) {
+      term_matches.Swap(&previous->second);
+      reusable_terms = reusable_terms_;
+    }
     ScoredHistoryMatch match(hist_item, visits, languages_, lower_string_,
                              lower_terms_, starts_pos->second, now_,
-                             bookmark_service_);
+                             bookmark_service_, reusable_terms, &term_matches);
     if (match.raw_score > 0)
       scored_matches_.push_back(match);
+    if (term_matches.url_term_matches_.size() == lower_terms_.size())
+      (*row_term_matches_)[history_id].Swap(&term_matches);
+  }
+}
+
+
+// static
+void URLIndexPrivateData::ScoreCandidateShard(
+    const HistoryIDVector* candidates,
+    std::vector<AddHistoryMatch*>* matchers,
+    const ScoringCancellationFlag* cancel_flag,
+    size_t shard) {
+  AddHistoryMatch* matcher = (*matchers)[shard];
+  size_t end = std::min((shard + 1) * kCandidatesPerShard, candidates->size());
+  for (size_t i = shard * kCandidatesPerShard; i < end; ++i) {
+    if (cancel_flag && cancel_flag->IsCanceled())
+      return;
+    (*matcher)((*candidates)[i]);
   }
 }
 
@@ -7,19 +7,25 @@
 
 #include <set>
 #include <string>
+#include <vector>
 
+#include "base/callback.h"
 #include "base/files/file_path.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/ref_counted.h"
+#include "base/synchronization/lock.h"
 #include "chrome/browser/common/cancelable_request.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/in_memory_url_index_cache.pb.h"
 #include "chrome/browser/history/in_memory_url_index_types.h"
 #include "chrome/browser/history/scored_history_match.h"
+#include "chrome/browser/history/url_index_posting_list.h"
 #include "content/public/browser/notification_details.h"
 
 class BookmarkService;
 class HistoryQuickProviderTest;
+class Pickle;
+class PickleIterator;
 
 namespace in_memory_url_index {
 class InMemoryURLIndexCacheItem;
@@ -32,17 +38,26 @@ namespace imui = in_memory_url_index;
 class HistoryDatabase;
 class InMemoryURLIndex;
 class RefCountedBool;
+class ScoringCancellationFlag;
 
 // Current version of the cache file.
 static const int kCurrentCacheFileVersion = 3;
 
+// Current version of the flat index file. Unlike the protobuf cache file,
+// which is kept only as a migration source, this is what the index is saved
+// to and restored from.
+static const int kCurrentIndexFileVersion = 1;
+
 // A structure private to InMemoryURLIndex describing its internal data and
 // providing for restoring, rebuilding and updating that internal data. As
 // this class is for exclusive use by the InMemoryURLIndex class there should
 // be no calls from any other class.
 //
 // All public member functions are called on the main thread unless otherwise
-// annotated.
+// annotated. HistoryItemsForTerms() may also be called on a worker thread,
+// bracketed by BeginSearch() and EndSearch() on the main thread; the index is
+// not modified in between, so the search runs without blocking the main
+// thread.
 class URLIndexPrivateData
     : public base::RefCountedThreadSafe<URLIndexPrivateData> {
  public:
@@ -66,11 +81,34 @@ class URLIndexPrivateData
   // |kItemsToScoreLimit| limit) will be retained and used for subsequent calls
   // to this function. |bookmark_service| is used to boost a result's score if
   // its URL is referenced by one or more of the user's bookmarks.  |languages|
-  // is used to help parse/format the URLs in the history index.
-  ScoredHistoryMatches HistoryItemsForTerms(string16 term_string,
-                                            size_t cursor_position,
-                                            const std::string& languages,
-                                            BookmarkService* bookmark_service);
+  // is used to help parse/format the URLs in the history index. Large
+  // candidate sets are scored on several threads, unless called on the UI
+  // thread, which must not wait for them. If |cancel_flag| is not
+  // NULL and becomes set while scoring, the remaining candidates are skipped
+  // and no matches are returned.
+  ScoredHistoryMatches HistoryItemsForTerms(
+      string16 term_string,
+      size_t cursor_position,
+      const std::string& languages,
+      BookmarkService* bookmark_service,
+      const ScoringCancellationFlag* cancel_flag);
+
+  // Called on the main thread before and after a search of this data on a
+  // worker thread. While any such search is in progress updates to the index
+  // are deferred with RunWhenNotSearched().
+  void BeginSearch();
+  void EndSearch();
+  bool being_searched() const { return searches_in_progress_ > 0; }
+
+  // Runs |update| now if no search is in progress, otherwise once the last
+  // one ends. Deferred updates run in the order they were made.
+  void RunWhenNotSearched(const base::Closure& update);
+
+  // Sets the maximum number of threads, including the calling thread, used
+  // to score the candidates of a search. 1 scores them serially.
+  void set_scoring_threads(size_t scoring_threads) {
+    scoring_threads_ = scoring_threads;
+  }
 
   // Adds the history item in |row| to the index if it does not already already
   // exist and it meets the minimum 'quick' criteria. If the row already exists
@@ -88,7 +126,8 @@ class URLIndexPrivateData
 
   // Updates the entry for |url_id| in the index, replacing its
   // recent visits information with |recent_visits|.  If |url_id|
-  // is not in the index, does nothing.
+  // is not in the index, does nothing. Deferred while the index is being
+  // searched.
   void UpdateRecentVisits(URLID url_id,
                           const VisitVector& recent_visits);
 
@@ -129,8 +168,40 @@ class URLIndexPrivateData
       scoped_refptr<URLIndexPrivateData> private_data,
       const base::FilePath& file_path);
 
-  // Stops all pending updates to recent visits fields.  This should be
-  // called during shutdown.
+  // Constructs a new object by memory-mapping the flat index file at
+  // |index_path| and building the index directly from the mapped bytes, then
+  // replaying any updates recorded in the journal at |journal_path|. Returns
+  // NULL if the index file is missing, stale or corrupt. A torn record at the
+  // end of the journal, as left by a crash mid-append, is ignored. This
+  // function should be run on the file thread.
+  static scoped_refptr<URLIndexPrivateData> RestoreFromIndexFile(
+      const base::FilePath& index_path,
+      const base::FilePath& journal_path,
+      const std::string& languages);
+
+  // Atomically replaces the flat index file at |index_path| with the contents
+  // of |private_data| and deletes the journal at |journal_path|, whose
+  // updates the new file now includes. Returns success. This function should
+  // be run on the file thread.
+  static bool WritePrivateDataToIndexFileTask(
+      scoped_refptr<URLIndexPrivateData> private_data,
+      const base::FilePath& index_path,
+      const base::FilePath& journal_path);
+
+  // Appends |records|, as produced by AppendJournalRecords(), to the journal
+  // at |journal_path|, creating it if needed. Returns success. This function
+  // should be run on the file thread.
+  static bool AppendToJournalFileTask(const base::FilePath& journal_path,
+                                      const std::string& records);
+
+  // Appends to |records| one journal record for each of |history_ids|
+  // describing its current state: the full item if it is indexed, otherwise
+  // its removal.
+  void AppendJournalRecords(const HistoryIDSet& history_ids,
+                            std::string* records) const;
+
+  // Stops all pending updates to recent visits fields, and drops the updates
+  // deferred by RunWhenNotSearched().  This should be called during shutdown.
   void CancelPendingUpdates();
 
   // Creates a copy of ourself.
@@ -139,6 +210,11 @@ class URLIndexPrivateData
   // Returns true if there is no data in the index.
   bool Empty() const;
 
+  // Returns true if this object was restored by RestoreFromIndexFile(), and
+  // the number of journal records that were replayed in doing so.
+  bool restored_from_index_file() const { return restored_from_index_file_; }
+  size_t replayed_journal_records() const { return replayed_journal_records_; }
+
   // Initializes all index data members in preparation for restoring the index
   // from the cache or a complete rebuild from the history database.
   void Clear();
@@ -150,9 +226,15 @@ class URLIndexPrivateData
   friend class AddHistoryMatch;
   friend class ::HistoryQuickProviderTest;
   friend class InMemoryURLIndexTest;
+  friend class URLIndexPostingListPerfTest;
+  friend class URLIndexScoringPerfTest;
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, CacheSaveRestore);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, HugeResultSet);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, JournalReplay);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, ParallelScoring);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, PostingListsFollowUpdates);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, ReadVisitsFromHistory);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, RefineSearch);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, Scoring);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, TitleSearch);
@@ -171,7 +253,7 @@ class URLIndexPrivateData
   // no longer needed.
   //
   // Items stored in the search term cache. If a search term exactly matches one
-  // in the cache then we can quickly supply the proper |history_id_set_| (and
+  // in the cache then we can quickly supply the proper |history_ids_| (and
   // marking the cache item as being |used_|. If we find a prefix for a search
   // term in the cache (which is very likely to occur as the user types each
   // term into the omnibox) then we can short-circuit the index search for those
@@ -179,20 +261,59 @@ class URLIndexPrivateData
   // not mark the item as being |used_|.
   struct SearchTermCacheItem {
     SearchTermCacheItem(const WordIDSet& word_id_set,
-                        const HistoryIDSet& history_id_set);
+                        const HistoryIDVector& history_ids);
     // Creates a cache item for a term which has no results.
     SearchTermCacheItem();
 
     ~SearchTermCacheItem();
 
     WordIDSet word_id_set_;
-    HistoryIDSet history_id_set_;
+    HistoryIDVector history_ids_;  // Sorted.
     bool used_;  // True if this item has been used for the current term search.
   };
   typedef std::map<string16, SearchTermCacheItem> SearchTermCacheMap;
 
+  // The words, terms and term matches of the most recent search, retained so
+  // that a search which extends it, as happens with each keystroke while the
+  // user types, can be refined from it rather than run from scratch. Any
+  // history item matching the extended search also matched the previous one
+  // so only the items in |row_term_matches_| need to be considered, and the
+  // matches of the terms the user has not changed can be reused. Empty if the
+  // most recent search cannot be refined.
+  struct RefinableSearch {
+    RefinableSearch();
+    ~RefinableSearch();
+
+    void Clear();
+    void Swap(RefinableSearch* other);
+
+    String16Vector lower_words_;
+    String16Vector lower_terms_;
+    // The term matches of every candidate item which contained all terms.
+    RowTermMatchesMap row_term_matches_;
+  };
+
+  // The caches a search works with, and the counts it records. A search
+  // takes the caches from this object when it starts and puts them back when
+  // it is done, holding |lock_| only for that, so that searches never wait
+  // for one another. A search which runs meanwhile starts with empty caches.
+  struct SearchState {
+    SearchState();
+    ~SearchState();
+
+    SearchTermCacheMap search_term_cache_;
+    RefinableSearch last_search_;
+    size_t pre_filter_item_count_;
+    size_t post_filter_item_count_;
+    size_t post_scoring_item_count_;
+    bool search_was_refined_;
+  };
+
   // A helper class which performs the final filter on each candidate
   // history URL match, inserting accepted matches into |scored_matches_|.
+  // The term matches of candidates containing every term are moved into
+  // |row_term_matches|. When refining a search, the matches of the first
+  // |reusable_terms| terms are taken from |previous_term_matches|.
   class AddHistoryMatch : public std::unary_function<HistoryID, void> {
    public:
     AddHistoryMatch(const URLIndexPrivateData& private_data,
@@ -200,12 +321,17 @@ class URLIndexPrivateData
                     BookmarkService* bookmark_service,
                     const string16& lower_string,
                     const String16Vector& lower_terms,
-                    const base::Time now);
+                    const base::Time now,
+                    size_t reusable_terms,
+                    RowTermMatchesMap* previous_term_matches,
+                    RowTermMatchesMap* row_term_matches);
     ~AddHistoryMatch();
 
     void operator()(const HistoryID history_id);
 
-    ScoredHistoryMatches ScoredMatches() const { return scored_matches_; }
+    const ScoredHistoryMatches& ScoredMatches() const {
+      return scored_matches_;
+    }
 
    private:
     const URLIndexPrivateData& private_data_;
@@ -215,8 +341,19 @@ class URLIndexPrivateData
     const string16& lower_string_;
     const String16Vector& lower_terms_;
     const base::Time now_;
+    size_t reusable_terms_;
+    RowTermMatchesMap* previous_term_matches_;
+    RowTermMatchesMap* row_term_matches_;
   };
 
+  // Scores the candidates in the |shard|th run of |kCandidatesPerShard| items
+  // of |candidates| using the |shard|th matcher of |matchers|, stopping early
+  // if |cancel_flag| is set. Runs on the calling thread or a worker thread.
+  static void ScoreCandidateShard(const HistoryIDVector* candidates,
+                                  std::vector<AddHistoryMatch*>* matchers,
+                                  const ScoringCancellationFlag* cancel_flag,
+                                  size_t shard);
+
   // A helper predicate class used to filter excess history items when the
   // candidate results set is too large.
   class HistoryItemFactorGreater
@@ -233,16 +370,33 @@ class URLIndexPrivateData
 
   // URL History indexing support functions.
 
-  // Composes a set of history item IDs by intersecting the set for each word
-  // in |unsorted_words|.
-  HistoryIDSet HistoryIDSetFromWords(const String16Vector& unsorted_words);
-
-  // Helper function to HistoryIDSetFromWords which composes a set of history
+  // Does the work of HistoryItemsForTerms() for |search_string|, with the
+  // caches and counts in |state|.
+  ScoredHistoryMatches SearchIndex(const string16& search_string,
+                                   const std::string& languages,
+                                   BookmarkService* bookmark_service,
+                                   const ScoringCancellationFlag* cancel_flag,
+                                   SearchState* state) const;
+
+  // Composes the sorted history item IDs found in every word of
+  // |unsorted_words| by intersecting the IDs for each word, looking up and
+  // adding to |search_term_cache|.
+  HistoryIDVector HistoryIDsFromWords(
+      const String16Vector& unsorted_words,
+      SearchTermCacheMap* search_term_cache) const;
+
+  // Helper function to HistoryIDsFromWords which composes the sorted history
   // ids for the given term given in |term|.
-  HistoryIDSet HistoryIDsForTerm(const string16& term);
+  HistoryIDVector HistoryIDsForTerm(
+      const string16& term,
+      SearchTermCacheMap* search_term_cache) const;
+
+  // Composes the sorted history ids referenced by any of the words in
+  // |word_id_set|.
+  HistoryIDVector HistoryIDsForWordIDs(const WordIDSet& word_id_set) const;
 
   // Given a set of Char16s, finds words containing those characters.
-  WordIDSet WordIDSetForTermChars(const Char16Set& term_chars);
+  WordIDSet WordIDSetForTermChars(const Char16Set& term_chars) const;
 
   // Indexes one URL history item as described by |row|. Returns true if the
   // row was actually indexed. |languages| gives a list of language encodings by
@@ -277,7 +431,7 @@ class URLIndexPrivateData
   void AddWordHistory(const string16& uni_word, HistoryID history_id);
 
   // Updates an existing entry in the word/history index by adding the
-  // |history_id| to set for |word_id| in the word_id_history_map_.
+  // |history_id| to the postings for |word_id| in |posting_index_|.
   void UpdateWordHistory(WordID word_id, HistoryID history_id);
 
   // Adds |word_id| to |history_id|'s entry in the history/word map,
@@ -290,8 +444,8 @@ class URLIndexPrivateData
   // Removes all words and characters associated with |row| from the index.
   void RemoveRowWordsFromIndex(const URLRow& row);
 
-  // Clears |used_| for each item in the search term cache.
-  void ResetSearchTermCache();
+  // Clears |used_| for each item in |search_term_cache|.
+  static void ResetSearchTermCache(SearchTermCacheMap* search_term_cache);
 
   // Caches the index private data and writes the cache file to the profile
   // directory.  Called by WritePrivateDataToCacheFileTask.
@@ -319,6 +473,29 @@ class URLIndexPrivateData
   bool RestoreWordStartsMap(const imui::InMemoryURLIndexCacheItem& cache,
                             const std::string& languages);
 
+  // Encodes the index into |pickle| in the flat index file format.
+  void SaveIndex(Pickle* pickle) const;
+
+  // Decodes the index from the flat index file format. Returns false if
+  // there is any kind of failure.
+  bool RestoreIndex(const Pickle& pickle, const std::string& languages);
+
+  // Applies the journal records in the |length| bytes at |data|, stopping at
+  // the first incomplete record. Returns false if a complete record cannot be
+  // decoded.
+  bool ReplayJournal(const char* data,
+                     size_t length,
+                     const std::string& languages);
+
+  // Encode and decode a single history item, as used by both the flat index
+  // file and the journal.
+  static void WriteHistoryInfo(HistoryID history_id,
+                               const HistoryInfoMapValue& info,
+                               Pickle* pickle);
+  static bool ReadHistoryInfo(PickleIterator* iter,
+                              HistoryID* history_id,
+                              HistoryInfoMapValue* info);
+
   // Determines if |gurl| has a whitelisted scheme and returns true if so.
   static bool URLSchemeIsWhitelisted(const GURL& gurl,
                                      const std::set<std::string>& whitelist);
@@ -326,6 +503,9 @@ class URLIndexPrivateData
   // Cache of search terms.
   SearchTermCacheMap search_term_cache_;
 
+  // The most recent search, which the next one may be refined from.
+  RefinableSearch last_search_;
+
   // Allows canceling pending requests to update recent visits information.
   CancelableRequestConsumer recent_visits_consumer_;
 
@@ -363,8 +543,9 @@ class URLIndexPrivateData
   CharWordIDMap char_word_map_;
 
   // A one-to-many mapping from a WordID to all HistoryIDs (the row_id as
-  // used in the history database) of history items in which the word occurs.
-  WordIDHistoryMap word_id_history_map_;
+  // used in the history database) of history items in which the word occurs,
+  // kept as one delta-encoded posting list per word.
+  PostingListIndex posting_index_;
 
   // A one-to-many mapping from a HistoryID to all WordIDs of words that occur
   // in the URL and/or page title of the history item referenced by that
@@ -386,11 +567,28 @@ class URLIndexPrivateData
   // restore.
   int saved_cache_version_;
 
+  // See restored_from_index_file() and replayed_journal_records().
+  bool restored_from_index_file_;
+  size_t replayed_journal_records_;
+
   // Used for unit testing only. Records the number of candidate history items
   // at three stages in the index searching process.
   size_t pre_filter_item_count_;    // After word index is queried.
   size_t post_filter_item_count_;   // After trimming large result set.
   size_t post_scoring_item_count_;  // After performing final filter/scoring.
+  bool search_was_refined_;  // Whether |last_search_| was refined.
+
+  // Held by searches while they take and put back |search_term_cache_|,
+  // |last_search_| and the counts above; see SearchState. Updates do not take
+  // it; they are deferred instead. See BeginSearch().
+  base::Lock lock_;
+
+  // See BeginSearch() and RunWhenNotSearched(). Only used on the main thread.
+  int searches_in_progress_;
+  std::vector<base::Closure> deferred_updates_;
+
+  // See set_scoring_threads().
+  size_t scoring_threads_;
 };
 
 }  // namespace history
@@ -0,0 +1,123 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures HistoryQuickProvider candidate scoring, serially and on several
+// threads, against a synthetic history of 500,000 URLs.
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/url_index_private_data.h"
+#include "chrome/test/perf/perf_test.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace history {
+
+namespace {
+
+const URLID kNumHistoryItems = 500000;
+const int kNumRepetitions = 20;
+
+const char* kWords[] = {
+  "news", "mail", "search", "video", "shop", "travel", "sports", "weather",
+  "music", "photos", "maps", "docs", "blog", "forum", "wiki", "games",
+  "finance", "health", "recipes", "movies", "books", "jobs", "cars", "homes",
+};
+
+const char* kQueries[] = {
+  "n", "ne", "new", "news", "news m", "news mail", "shop travel", "wiki 12",
+};
+
+}  // namespace
+
+class URLIndexScoringPerfTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    private_data_ = new URLIndexPrivateData;
+    // A fixed linear congruential generator keeps the history reproducible.
+    uint32 seed = 1;
+    const base::Time now = base::Time::Now();
+    for (URLID row_id = 1; row_id <= kNumHistoryItems; ++row_id) {
+      seed = seed * 1103515245 + 12345;
+      const char* word1 = kWords[(seed >> 8) % arraysize(kWords)];
+      const char* word2 = kWords[(seed >> 16) % arraysize(kWords)];
+      URLRow row(GURL(base::StringPrintf(
+          "http://www.%s%u.com/%s/%d", word1, (seed >> 4) % 1000, word2,
+          static_cast<int>(row_id))), row_id);
+      row.set_title(UTF8ToUTF16(base::StringPrintf(
+          "%s and %s %d", word2, word1, static_cast<int>(row_id % 100))));
+      row.set_visit_count(1 + (seed >> 20) % 20);
+      row.set_typed_count((seed >> 24) % 3);
+      row.set_last_visit(
+          now - base::TimeDelta::FromHours((seed >> 12) % 2000));
+
+      HistoryInfoMapValue& info = private_data_->history_info_map_[row_id];
+      info.url_row = row;
+      for (int visit = 0; visit < row.visit_count() && visit < 10; ++visit) {
+        info.visits.push_back(VisitInfo(
+            row.last_visit() - base::TimeDelta::FromDays(visit),
+            (visit < row.typed_count()) ? content::PAGE_TRANSITION_TYPED
+                                        : content::PAGE_TRANSITION_LINK));
+      }
+      RowWordStarts word_starts;
+      private_data_->AddRowWordsToIndex(row, &word_starts, "en");
+      private_data_->word_starts_map_[row_id] = word_starts;
+    }
+  }
+
+  // Runs every query |kNumRepetitions| times from scratch using at most
+  // |scoring_threads| threads and returns the mean time per query.
+  base::TimeDelta TimeQueries(size_t scoring_threads,
+                              std::vector<ScoredHistoryMatches>* results) {
+    private_data_->set_scoring_threads(scoring_threads);
+    results->clear();
+    base::TimeTicks start = base::TimeTicks::Now();
+    for (int i = 0; i < kNumRepetitions; ++i) {
+      for (size_t j = 0; j < arraysize(kQueries); ++j) {
+        // Score every candidate rather than refining the previous search.
+        private_data_->last_search_.Clear();
+        ScoredHistoryMatches matches = private_data_->HistoryItemsForTerms(
+            ASCIIToUTF16(kQueries[j]), string16::npos, "en", NULL, NULL);
+        if (i == 0)
+          results->push_back(matches);
+      }
+    }
+    return (base::TimeTicks::Now() - start) /
+        (kNumRepetitions * arraysize(kQueries));
+  }
+
+  scoped_refptr<URLIndexPrivateData> private_data_;
+};
+
+TEST_F(URLIndexScoringPerfTest, SerialAndParallelScoring) {
+  std::vector<ScoredHistoryMatches> serial_results;
+  base::TimeDelta serial_time = TimeQueries(1, &serial_results);
+  std::vector<ScoredHistoryMatches> parallel_results;
+  base::TimeDelta parallel_time = TimeQueries(4, &parallel_results);
+
+  // The parallel results must match the serial ones exactly.
+  ASSERT_EQ(serial_results.size(), parallel_results.size());
+  for (size_t i = 0; i < serial_results.size(); ++i) {
+    ASSERT_EQ(serial_results[i].size(), parallel_results[i].size());
+    for (size_t j = 0; j < serial_results[i].size(); ++j) {
+      EXPECT_EQ(serial_results[i][j].url_info.id(),
+                parallel_results[i][j].url_info.id());
+      EXPECT_EQ(serial_results[i][j].raw_score,
+                parallel_results[i][j].raw_score);
+    }
+  }
+
+  perf_test::PrintResult("hqp_scoring", "", "serial",
+                         static_cast<size_t>(serial_time.InMicroseconds()),
+                         "us", true);
+  perf_test::PrintResult("hqp_scoring", "", "parallel",
+                         static_cast<size_t>(parallel_time.InMicroseconds()),
+                         "us", true);
+}
+
+}  // namespace history
@@ -0,0 +1,242 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_trigram_index.h"
+
+#include <algorithm>
+
+#include "base/strings/string_util.h"
+#include "chrome/browser/history/url_database.h"
+#include "url/gurl.h"
+
+namespace history {
+
+namespace {
+
+// The length of each indexed sequence, in bytes.
+const size_t kTrigramLength = 3;
+
+// The separator which ends the scheme of a URL spec, and the host label which
+// so many URLs begin with that it narrows down nothing.
+const char kSchemeSeparator[] = "://";
+const char kWWW[] = "www.";
+
+// Rough per-entry overheads of the maps, for EstimateMemoryUsage().
+const size_t kRowOverhead = 48;
+const size_t kTrigramOverhead = 16;
+
+bool IsShorterList(const PostingList* a, const PostingList* b) {
+  return a->size() < b->size();
+}
+
+}  // namespace
+
+// Orders rows the way URLDatabase::AutocompleteForPrefix() does.
+bool URLTrigramIndex::RowHasHigherRank(const RowMap::value_type* a,
+                                       const RowMap::value_type* b) {
+  if (a->second.typed_count != b->second.typed_count)
+    return a->second.typed_count > b->second.typed_count;
+  if (a->second.visit_count != b->second.visit_count)
+    return a->second.visit_count > b->second.visit_count;
+  return a->second.last_visit > b->second.last_visit;
+}
+
+URLTrigramIndex::IndexedRow::IndexedRow()
+    : visit_count(0),
+      typed_count(0),
+      hidden(false) {
+}
+
+URLTrigramIndex::IndexedRow::IndexedRow(const URLRow& row)
+    : spec(row.url().spec()),
+      title(row.title()),
+      visit_count(row.visit_count()),
+      typed_count(row.typed_count()),
+      last_visit(row.last_visit()),
+      hidden(row.hidden()) {
+}
+
+URLTrigramIndex::IndexedRow::~IndexedRow() {}
+
+URLTrigramIndex::URLTrigramIndex() {}
+
+URLTrigramIndex::~URLTrigramIndex() {}
+
+bool URLTrigramIndex::Init(URLDatabase* db) {
+  Clear();
+  URLDatabase::URLEnumerator enumerator;
+  if (!db || !db->InitURLEnumeratorForEverything(&enumerator))
+    return false;
+  URLRow row;
+  while (enumerator.GetNextURL(&row))
+    AddOrUpdateURL(row);
+  return true;
+}
+
+void URLTrigramIndex::AddOrUpdateURL(const URLRow& row) {
+  if (!row.id())
+    return;
+  if (!row.url().is_valid()) {
+    // No prefix query can match it.
+    DeleteURL(row.id());
+    return;
+  }
+  RowMap::iterator existing = rows_.find(row.id());
+  if (existing != rows_.end()) {
+    // The spec is only reindexed if it changed.
+    if (existing->second.spec != row.url().spec()) {
+      UnindexSpec(existing->second.spec, row.id());
+      IndexSpec(row.url().spec(), row.id());
+    }
+    existing->second = IndexedRow(row);
+    return;
+  }
+  IndexSpec(row.url().spec(), row.id());
+  rows_.insert(std::make_pair(row.id(), IndexedRow(row)));
+}
+
+void URLTrigramIndex::DeleteURL(URLID id) {
+  RowMap::iterator existing = rows_.find(id);
+  if (existing == rows_.end())
+    return;
+  UnindexSpec(existing->second.spec, id);
+  rows_.erase(existing);
+}
+
+void URLTrigramIndex::Clear() {
+  rows_.clear();
+  trigrams_.clear();
+}
+
+bool URLTrigramIndex::AutocompleteForPrefix(const std::string& prefix,
+                                            size_t max_results,
+                                            bool typed_only,
+                                            URLRows* results) const {
+  results->clear();
+  HistoryIDVector candidates;
+  FindCandidates(prefix, &candidates);
+  std::vector<const RowMap::value_type*> matches;
+  for (HistoryIDVector::const_iterator i = candidates.begin();
+       i != candidates.end(); ++i) {
+    const RowMap::value_type& entry = *rows_.find(*i);
+    const IndexedRow& row = entry.second;
+    if (row.hidden || (typed_only && row.typed_count <= 0) ||
+        !StartsWithASCII(row.spec, prefix, true))
+      continue;
+    matches.push_back(&entry);
+  }
+  // Only the rows returned are turned back into URLRows.
+  const size_t result_count = std::min(max_results, matches.size());
+  std::partial_sort(matches.begin(), matches.begin() + result_count,
+                    matches.end(), &RowHasHigherRank);
+  for (size_t i = 0; i < result_count; ++i) {
+    const IndexedRow& row = matches[i]->second;
+    URLRow result(GURL(row.spec), matches[i]->first);
+    result.set_title(row.title);
+    result.set_visit_count(row.visit_count);
+    result.set_typed_count(row.typed_count);
+    result.set_last_visit(row.last_visit);
+    results->push_back(result);
+  }
+  return !results->empty();
+}
+
+// static
+bool URLTrigramIndex::IsSelectivePrefix(const std::string& prefix) {
+  size_t start = prefix.find(kSchemeSeparator);
+  start = (start == std::string::npos) ? 0 :
+      start + arraysize(kSchemeSeparator) - 1;
+  if (prefix.compare(start, arraysize(kWWW) - 1, kWWW) == 0)
+    start += arraysize(kWWW) - 1;
+  return prefix.length() >= start + kTrigramLength;
+}
+
+size_t URLTrigramIndex::EstimateMemoryUsage() const {
+  size_t memory = rows_.size() * (sizeof(RowMap::value_type) + kRowOverhead);
+  for (RowMap::const_iterator i = rows_.begin(); i != rows_.end(); ++i) {
+    memory += i->second.spec.capacity() +
+        i->second.title.capacity() * sizeof(char16);
+  }
+  memory += trigrams_.size() *
+      (sizeof(TrigramMap::value_type) + kTrigramOverhead);
+  for (TrigramMap::const_iterator i = trigrams_.begin(); i != trigrams_.end();
+       ++i) {
+    memory += i->second.EstimateMemoryUsage();
+  }
+  return memory;
+}
+
+// static
+void URLTrigramIndex::ExtractTrigrams(const std::string& text,
+                                      std::vector<Trigram>* trigrams) {
+  if (text.length() < kTrigramLength)
+    return;
+  const size_t first = trigrams->size();
+  for (size_t i = 0; i + kTrigramLength <= text.length(); ++i) {
+    trigrams->push_back(
+        (static_cast<Trigram>(static_cast<uint8>(text[i])) << 16) |
+        (static_cast<Trigram>(static_cast<uint8>(text[i + 1])) << 8) |
+        static_cast<Trigram>(static_cast<uint8>(text[i + 2])));
+  }
+  std::sort(trigrams->begin() + first, trigrams->end());
+  trigrams->erase(std::unique(trigrams->begin() + first, trigrams->end()),
+                  trigrams->end());
+}
+
+void URLTrigramIndex::IndexSpec(const std::string& spec, URLID id) {
+  std::vector<Trigram> trigrams;
+  ExtractTrigrams(StringToLowerASCII(spec), &trigrams);
+  // Rows are mostly added in ID order, so these are usually appends.
+  for (std::vector<Trigram>::const_iterator i = trigrams.begin();
+       i != trigrams.end(); ++i)
+    trigrams_[*i].Insert(id);
+}
+
+void URLTrigramIndex::UnindexSpec(const std::string& spec, URLID id) {
+  std::vector<Trigram> trigrams;
+  ExtractTrigrams(StringToLowerASCII(spec), &trigrams);
+  for (std::vector<Trigram>::const_iterator i = trigrams.begin();
+       i != trigrams.end(); ++i) {
+    TrigramMap::iterator entry = trigrams_.find(*i);
+    if (entry == trigrams_.end())
+      continue;
+    entry->second.Erase(id);
+    if (entry->second.empty())
+      trigrams_.erase(entry);
+  }
+}
+
+void URLTrigramIndex::FindCandidates(const std::string& text,
+                                     HistoryIDVector* ids) const {
+  ids->clear();
+  std::vector<Trigram> trigrams;
+  ExtractTrigrams(StringToLowerASCII(text), &trigrams);
+  if (trigrams.empty()) {
+    // Too short to narrow down; every row is a candidate.
+    for (RowMap::const_iterator i = rows_.begin(); i != rows_.end(); ++i)
+      ids->push_back(i->first);
+    return;
+  }
+
+  // Intersect the shortest lists first to keep the intermediate sets small.
+  std::vector<const PostingList*> lists;
+  for (std::vector<Trigram>::const_iterator i = trigrams.begin();
+       i != trigrams.end(); ++i) {
+    TrigramMap::const_iterator entry = trigrams_.find(*i);
+    if (entry == trigrams_.end())
+      return;
+    lists.push_back(&entry->second);
+  }
+  std::sort(lists.begin(), lists.end(), &IsShorterList);
+  lists.front()->DecodeTo(ids);
+  for (size_t i = 1; i < lists.size() && !ids->empty(); ++i) {
+    HistoryIDVector list_ids;
+    lists[i]->DecodeTo(&list_ids);
+    HistoryIDVector intersection;
+    IntersectSortedHistoryIDs(*ids, list_ids, &intersection);
+    ids->swap(intersection);
+  }
+}
+
+}  // namespace history
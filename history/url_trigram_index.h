@@ -0,0 +1,121 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_URL_TRIGRAM_INDEX_H_
+#define CHROME_BROWSER_HISTORY_URL_TRIGRAM_INDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+#include "base/strings/string16.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/history_types.h"
+#include "chrome/browser/history/url_index_posting_list.h"
+
+namespace history {
+
+class URLDatabase;
+
+// An in-memory index of every URL in the history database, which answers
+// URL prefix queries without going to SQLite.
+//
+// Each URL's lowercased spec is broken into overlapping three byte sequences
+// (trigrams), and each trigram maps to a PostingList of the IDs of the rows
+// containing it. A query intersects the lists of its own trigrams to find
+// candidates, then checks each candidate against the query itself, so results
+// are exact.
+// Queries shorter than a trigram check every row, and the trigrams of queries
+// which are little more than a scheme are in nearly every row, so callers
+// send both to the database instead; see IsSelectivePrefix().
+//
+// The index is keyed by the row IDs of the main history database, which the
+// history notifications carry, and is kept in step with them by
+// InMemoryHistoryBackend. It is not thread safe.
+class URLTrigramIndex {
+ public:
+  URLTrigramIndex();
+  ~URLTrigramIndex();
+
+  // Replaces the contents of the index with every row of |db|. Returns false
+  // if |db| could not be read, leaving the index empty.
+  bool Init(URLDatabase* db);
+
+  // Adds |row|, or updates it if a row with the same ID is already indexed.
+  // Rows without an ID are ignored.
+  void AddOrUpdateURL(const URLRow& row);
+
+  // Removes the row with |id|, if it is indexed.
+  void DeleteURL(URLID id);
+
+  void Clear();
+
+  // Fills |results| with the non-hidden rows whose URL spec starts with
+  // |prefix|, which is matched case-sensitively, as
+  // URLDatabase::AutocompleteForPrefix() does, and returns the same rows in
+  // the same order. Returns whether any rows were found.
+  bool AutocompleteForPrefix(const std::string& prefix,
+                             size_t max_results,
+                             bool typed_only,
+                             URLRows* results) const;
+
+  // Returns whether |prefix| has at least a trigram's worth of text past its
+  // scheme, such as "http://", and any leading "www.". The trigrams of
+  // shorter prefixes are in most rows, so callers should query the database
+  // for them instead.
+  static bool IsSelectivePrefix(const std::string& prefix);
+
+  // Returns the approximate number of heap bytes used by the index.
+  size_t EstimateMemoryUsage() const;
+
+  size_t size() const { return rows_.size(); }
+
+ private:
+  // The parts of a row which queries check and return. Holding these rather
+  // than the URLRow spares a parsed GURL per row.
+  struct IndexedRow {
+    IndexedRow();
+    explicit IndexedRow(const URLRow& row);
+    ~IndexedRow();
+
+    std::string spec;
+    string16 title;
+    int visit_count;
+    int typed_count;
+    base::Time last_visit;
+    bool hidden;
+  };
+
+  typedef uint32 Trigram;
+  typedef base::hash_map<Trigram, PostingList> TrigramMap;
+  typedef std::map<URLID, IndexedRow> RowMap;
+
+  // Appends the distinct trigrams of |text| to |trigrams|.
+  static void ExtractTrigrams(const std::string& text,
+                              std::vector<Trigram>* trigrams);
+
+  // Adds or removes |id| from the posting lists of every trigram of |spec|,
+  // which is lowercased first.
+  void IndexSpec(const std::string& spec, URLID id);
+  void UnindexSpec(const std::string& spec, URLID id);
+
+  // Fills |ids| with the IDs of the rows containing every trigram of the
+  // lowercased |text|, or of every row if |text| has no trigrams.
+  void FindCandidates(const std::string& text, HistoryIDVector* ids) const;
+
+  // Returns whether |a| sorts before |b| in query results.
+  static bool RowHasHigherRank(const RowMap::value_type* a,
+                               const RowMap::value_type* b);
+
+  RowMap rows_;
+  TrigramMap trigrams_;
+
+  DISALLOW_COPY_AND_ASSIGN(URLTrigramIndex);
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_URL_TRIGRAM_INDEX_H_
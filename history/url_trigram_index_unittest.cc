@@ -0,0 +1,186 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/url_trigram_index.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "url/gurl.h"
+
+namespace history {
+
+namespace {
+
+URLRow MakeRow(URLID id,
+               const char* url,
+               const char* title,
+               int typed_count,
+               int visit_count) {
+  URLRow row(GURL(url), id);
+  row.set_title(UTF8ToUTF16(title));
+  row.set_typed_count(typed_count);
+  row.set_visit_count(visit_count);
+  row.set_last_visit(base::Time::Now() - base::TimeDelta::FromDays(id));
+  return row;
+}
+
+}  // namespace
+
+class URLTrigramIndexTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    index_.AddOrUpdateURL(MakeRow(1, "http://www.google.com/", "Google", 3, 9));
+    index_.AddOrUpdateURL(
+        MakeRow(2, "http://www.google.com/maps", "Google Maps", 0, 4));
+    index_.AddOrUpdateURL(
+        MakeRow(3, "http://news.example.com/Sports", "Example News", 1, 2));
+    index_.AddOrUpdateURL(
+        MakeRow(4, "http://www.goodreads.com/", "Goodreads", 1, 20));
+    URLRow hidden(
+        MakeRow(5, "http://www.google.com/hidden", "Hidden Google", 5, 5));
+    hidden.set_hidden(true);
+    index_.AddOrUpdateURL(hidden);
+  }
+
+  // Returns the IDs of |results| in order.
+  static std::vector<URLID> IDs(const URLRows& results) {
+    std::vector<URLID> ids;
+    for (URLRows::const_iterator i = results.begin(); i != results.end(); ++i)
+      ids.push_back(i->id());
+    return ids;
+  }
+
+  URLTrigramIndex index_;
+};
+
+TEST_F(URLTrigramIndexTest, Prefix) {
+  URLRows results;
+  EXPECT_TRUE(index_.AutocompleteForPrefix("http://www.goo", 10, false,
+                                           &results));
+  // Ordered by typed count, then visit count; hidden rows are left out.
+  std::vector<URLID> ids = IDs(results);
+  ASSERT_EQ(3U, ids.size());
+  EXPECT_EQ(1, ids[0]);
+  EXPECT_EQ(4, ids[1]);
+  EXPECT_EQ(2, ids[2]);
+
+  EXPECT_TRUE(index_.AutocompleteForPrefix("http://www.goo", 10, true,
+                                           &results));
+  EXPECT_EQ(2U, results.size());
+
+  EXPECT_TRUE(index_.AutocompleteForPrefix("http://www.goo", 1, false,
+                                           &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(1, results[0].id());
+
+  // Prefixes are matched from the start and with case, like the database.
+  EXPECT_FALSE(index_.AutocompleteForPrefix("www.goo", 10, false, &results));
+  EXPECT_FALSE(index_.AutocompleteForPrefix("http://news.example.com/sp", 10,
+                                            false, &results));
+  EXPECT_TRUE(index_.AutocompleteForPrefix("http://news.example.com/Sp", 10,
+                                           false, &results));
+
+  // Prefixes shorter than a trigram still work.
+  EXPECT_TRUE(index_.AutocompleteForPrefix("ht", 10, false, &results));
+  EXPECT_EQ(4U, results.size());
+}
+
+TEST_F(URLTrigramIndexTest, ResultsCarryRowData) {
+  const URLRow row(
+      MakeRow(6, "http://www.example.org/Page", "Example Page", 2, 7));
+  index_.AddOrUpdateURL(row);
+  URLRows results;
+  EXPECT_TRUE(index_.AutocompleteForPrefix("http://www.example.org/", 10,
+                                           false, &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(row.id(), results[0].id());
+  EXPECT_EQ(row.url(), results[0].url());
+  EXPECT_EQ(row.title(), results[0].title());
+  EXPECT_EQ(row.typed_count(), results[0].typed_count());
+  EXPECT_EQ(row.visit_count(), results[0].visit_count());
+  EXPECT_EQ(row.last_visit(), results[0].last_visit());
+  EXPECT_FALSE(results[0].hidden());
+}
+
+TEST_F(URLTrigramIndexTest, SelectivePrefixes) {
+  // Nothing, or too little, past the scheme and "www.".
+  EXPECT_FALSE(URLTrigramIndex::IsSelectivePrefix(std::string()));
+  EXPECT_FALSE(URLTrigramIndex::IsSelectivePrefix("g"));
+  EXPECT_FALSE(URLTrigramIndex::IsSelectivePrefix("http://"));
+  EXPECT_FALSE(URLTrigramIndex::IsSelectivePrefix("http://g"));
+  EXPECT_FALSE(URLTrigramIndex::IsSelectivePrefix("https://www."));
+  EXPECT_FALSE(URLTrigramIndex::IsSelectivePrefix("http://www.go"));
+
+  EXPECT_TRUE(URLTrigramIndex::IsSelectivePrefix("goo"));
+  EXPECT_TRUE(URLTrigramIndex::IsSelectivePrefix("http://goo"));
+  EXPECT_TRUE(URLTrigramIndex::IsSelectivePrefix("http://www.goo"));
+  EXPECT_TRUE(URLTrigramIndex::IsSelectivePrefix("ftp://ftp.x"));
+}
+
+TEST_F(URLTrigramIndexTest, UpdateAndDelete) {
+  URLRows results;
+  index_.AddOrUpdateURL(
+      MakeRow(2, "http://www.google.com/directions", "Directions", 0, 4));
+  EXPECT_EQ(5U, index_.size());
+  EXPECT_FALSE(index_.AutocompleteForPrefix("http://www.google.com/m", 10,
+                                            false, &results));
+  EXPECT_TRUE(index_.AutocompleteForPrefix("http://www.google.com/d", 10,
+                                           false, &results));
+
+  index_.DeleteURL(2);
+  EXPECT_EQ(4U, index_.size());
+  EXPECT_FALSE(index_.AutocompleteForPrefix("http://www.google.com/d", 10,
+                                            false, &results));
+  // Deleting it again, or a row which never existed, does nothing.
+  index_.DeleteURL(2);
+  index_.DeleteURL(42);
+  EXPECT_EQ(4U, index_.size());
+
+  // Rows without an ID are ignored.
+  index_.AddOrUpdateURL(URLRow(GURL("http://www.noid.com/")));
+  EXPECT_EQ(4U, index_.size());
+
+  index_.Clear();
+  EXPECT_EQ(0U, index_.size());
+  EXPECT_FALSE(index_.AutocompleteForPrefix("http://www.goo", 10, false,
+                                            &results));
+}
+
+TEST_F(URLTrigramIndexTest, ManyRows) {
+  const size_t initial_memory = index_.EstimateMemoryUsage();
+  EXPECT_GT(initial_memory, 0U);
+
+  // Rows added out of ID order, and removed again, are found the same way.
+  for (URLID id = 200; id > 100; --id) {
+    index_.AddOrUpdateURL(MakeRow(
+        id, ("http://www.many.com/" + base::Int64ToString(id)).c_str(),
+        "Many", 0, 1));
+  }
+  EXPECT_EQ(105U, index_.size());
+  EXPECT_GT(index_.EstimateMemoryUsage(), initial_memory);
+  URLRows results;
+  EXPECT_TRUE(index_.AutocompleteForPrefix("http://www.many.com/1", 200,
+                                           false, &results));
+  EXPECT_EQ(99U, results.size());
+  for (URLID id = 101; id <= 200; id += 2)
+    index_.DeleteURL(id);
+  EXPECT_TRUE(index_.AutocompleteForPrefix("http://www.many.com/15", 200,
+                                           false, &results));
+  std::vector<URLID> ids = IDs(results);
+  std::sort(ids.begin(), ids.end());
+  ASSERT_EQ(5U, ids.size());
+  EXPECT_EQ(150, ids[0]);
+  EXPECT_EQ(158, ids[4]);
+
+  for (URLID id = 102; id <= 200; id += 2)
+    index_.DeleteURL(id);
+  EXPECT_EQ(5U, index_.size());
+  EXPECT_FALSE(index_.AutocompleteForPrefix("http://www.many.com/", 200,
+                                            false, &results));
+}
+
+}  // namespace history
@@ -13,17 +13,16 @@
 #include "base/strings/string_util.h"
 #include "base/task_runner_util.h"
 #include "base/threading/sequenced_worker_pool.h"
+#include "chrome/browser/policy/url_filter_index.h"
 #include "content/public/browser/browser_thread.h"
-#include "extensions/common/matcher/url_matcher.h"
 #include "url/gurl.h"
 
 using content::BrowserThread;
-using extensions::URLMatcher;
-using extensions::URLMatcherConditionSet;
+using policy::URLFilterIndex;
 
 struct ManagedModeURLFilter::Contents {
-  URLMatcher url_matcher;
-  std::map<URLMatcherConditionSet::ID, int> matcher_site_map;
+  URLFilterIndex url_index;
+  std::map<URLFilterIndex::ID, int> index_site_map;
   base::hash_multimap<std::string, int> hash_site_map;
   std::vector<ManagedModeSiteList::Site> sites;
 };
@@ -63,13 +62,12 @@ class FilterBuilder {
 
  private:
   scoped_ptr<ManagedModeURLFilter::Contents> contents_;
-  URLMatcherConditionSet::Vector all_conditions_;
-  URLMatcherConditionSet::ID matcher_id_;
+  URLFilterIndex::ID filter_id_;
 };
 
 FilterBuilder::FilterBuilder()
     : contents_(new ManagedModeURLFilter::Contents()),
-      matcher_id_(0) {}
+      filter_id_(0) {}
 
 FilterBuilder::~FilterBuilder() {
   DCHECK(!contents_.get());
@@ -89,12 +87,9 @@ bool FilterBuilder::AddPattern(const std::string& pattern, int site_id) {
     return false;
   }
 
-  scoped_refptr<extensions::URLMatcherConditionSet> condition_set =
-      policy::URLBlacklist::CreateConditionSet(
-          &contents_->url_matcher, ++matcher_id_,
-          scheme, host, match_subdomains, port, path);
-  all_conditions_.push_back(condition_set);
-  contents_->matcher_site_map[matcher_id_] = site_id;
+  contents_->url_index.AddFilter(++filter_id_, scheme, host,
+                                 match_subdomains, port, path);
+  contents_->index_site_map[filter_id_] = site_id;
   return true;
 #else
   NOTREACHED();
@@ -134,7 +129,6 @@ void FilterBuilder::AddSiteList(ManagedModeSiteList* site_list) {
 
 scoped_ptr<ManagedModeURLFilter::Contents> FilterBuilder::Build() {
   DCHECK(BrowserThread::GetBlockingPool()->RunsTasksOnCurrentThread());
-  contents_->url_matcher.AddConditionSets(all_conditions_);
   return contents_.Pass();
 }
 
@@ -232,8 +226,8 @@ ManagedModeURLFilter::GetFilteringBehaviorForURL(const GURL& url) const {
     return ALLOW;
 
   // Check the list of URL patterns.
-  std::set<URLMatcherConditionSet::ID> matching_ids =
-      contents_->url_matcher.MatchURL(url);
+  std::vector<URLFilterIndex::ID> matching_ids;
+  contents_->url_index.MatchURL(url, &matching_ids);
   if (!matching_ids.empty())
     return ALLOW;
 
@@ -250,13 +244,13 @@ ManagedModeURLFilter::GetFilteringBehaviorForURL(const GURL& url) const {
 void ManagedModeURLFilter::GetSites(
     const GURL& url,
     std::vector<ManagedModeSiteList::Site*>* sites) const {
-  std::set<URLMatcherConditionSet::ID> matching_ids =
-      contents_->url_matcher.MatchURL(url);
-  for (std::set<URLMatcherConditionSet::ID>::const_iterator it =
+  std::vector<URLFilterIndex::ID> matching_ids;
+  contents_->url_index.MatchURL(url, &matching_ids);
+  for (std::vector<URLFilterIndex::ID>::const_iterator it =
            matching_ids.begin(); it != matching_ids.end(); ++it) {
-    std::map<URLMatcherConditionSet::ID, int>::const_iterator entry =
-        contents_->matcher_site_map.find(*it);
-    if (entry == contents_->matcher_site_map.end()) {
+    std::map<URLFilterIndex::ID, int>::const_iterator entry =
+        contents_->index_site_map.find(*it);
+    if (entry == contents_->index_site_map.end()) {
       NOTREACHED();
       continue;
     }
@@ -96,7 +96,7 @@ class ManagedModeURLFilter
   friend class base::RefCountedThreadSafe<ManagedModeURLFilter>;
   ~ManagedModeURLFilter();
 
-  void SetContents(scoped_ptr<Contents> url_matcher);
+  void SetContents(scoped_ptr<Contents> contents);
 
   ObserverList<Observer> observers_;
 
@@ -260,6 +260,31 @@ bool OmniboxFieldTrial::ReorderForLegalDefaultMatch(
       kReorderForLegalDefaultMatchRuleEnabled;
 }
 
+void OmniboxFieldTrial::GetOffMainThreadProviderBudgets(
+    AutocompleteInput::PageClassification current_page_classification,
+    ProviderLatencyBudgets* budgets) {
+  budgets->clear();
+  const std::string budget_rule =
+      OmniboxFieldTrial::GetValueForRuleInContext(
+          kOffMainThreadProvidersRule,
+          current_page_classification);
+  // The value of the OffMainThreadProviders rule is a comma-separated list of
+  // {ProviderType + ":" + Number} where ProviderType is an
+  // AutocompleteProvider::Type enum represented as an integer and Number is
+  // the provider's latency budget in milliseconds.
+  base::StringPairs kv_pairs;
+  if (base::SplitStringIntoKeyValuePairs(budget_rule, ':', ',', &kv_pairs)) {
+    for (base::StringPairs::const_iterator it = kv_pairs.begin();
+         it != kv_pairs.end(); ++it) {
+      // As with DemoteByType, this is a best-effort conversion.
+      int k, v;
+      base::StringToInt(it->first, &k);
+      base::StringToInt(it->second, &v);
+      (*budgets)[k] = base::TimeDelta::FromMilliseconds(v);
+    }
+  }
+}
+
 const char OmniboxFieldTrial::kBundledExperimentFieldTrialName[] =
     "OmniboxBundledExperimentV1";
 const char OmniboxFieldTrial::kShortcutsScoringMaxRelevanceRule[] =
@@ -268,6 +293,8 @@ const char OmniboxFieldTrial::kSearchHistoryRule[] = "SearchHistory";
 const char OmniboxFieldTrial::kDemoteByTypeRule[] = "DemoteByType";
 const char OmniboxFieldTrial::kReorderForLegalDefaultMatchRule[] =
     "ReorderForLegalDefaultMatch";
+const char OmniboxFieldTrial::kOffMainThreadProvidersRule[] =
+    "OffMainThreadProviders";
 const char OmniboxFieldTrial::kReorderForLegalDefaultMatchRuleEnabled[] =
     "ReorderForLegalDefaultMatch";
 
@@ -11,6 +11,7 @@
 
 #include "base/basictypes.h"
 #include "base/gtest_prod_util.h"
+#include "base/time/time.h"
 #include "chrome/browser/autocomplete/autocomplete_input.h"
 #include "chrome/common/autocomplete_match_type.h"
 
@@ -22,6 +23,11 @@ class OmniboxFieldTrial {
   // given number.  Omitted types are assumed to have multipliers of 1.0.
   typedef std::map<AutocompleteMatchType::Type, float> DemotionMultipliers;
 
+  // A mapping from AutocompleteProvider::Type values to the time within
+  // which providers of that type should report their matches when they are
+  // run off the main thread.  Omitted types run on the main thread.
+  typedef std::map<int, base::TimeDelta> ProviderLatencyBudgets;
+
   // Creates the static field trial groups.
   // *** MUST NOT BE CALLED MORE THAN ONCE. ***
   static void ActivateStaticTrials();
@@ -152,6 +158,18 @@ class OmniboxFieldTrial {
   static bool ReorderForLegalDefaultMatch(
       AutocompleteInput::PageClassification current_page_classification);
 
+  // ---------------------------------------------------------
+  // For the OffMainThreadProviders experiment that's part of the bundled
+  // omnibox field trial.
+
+  // If the user is in an experiment group that, in the provided
+  // |current_page_classification| context, runs some providers' synchronous
+  // passes off the main thread, populates |budgets| with the latency budget
+  // of each such provider type.  Otherwise, clears |budgets|.
+  static void GetOffMainThreadProviderBudgets(
+      AutocompleteInput::PageClassification current_page_classification,
+      ProviderLatencyBudgets* budgets);
+
   // ---------------------------------------------------------
   // Exposed publicly for the sake of unittests.
   static const char kBundledExperimentFieldTrialName[];
@@ -160,6 +178,7 @@ class OmniboxFieldTrial {
   static const char kSearchHistoryRule[];
   static const char kDemoteByTypeRule[];
   static const char kReorderForLegalDefaultMatchRule[];
+  static const char kOffMainThreadProvidersRule[];
   // Rule values.
   static const char kReorderForLegalDefaultMatchRuleEnabled[];
 
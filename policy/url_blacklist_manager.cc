@@ -30,12 +30,6 @@
 #endif
 
 using content::BrowserThread;
-using extensions::URLMatcher;
-using extensions::URLMatcherCondition;
-using extensions::URLMatcherConditionFactory;
-using extensions::URLMatcherConditionSet;
-using extensions::URLMatcherPortFilter;
-using extensions::URLMatcherSchemeFilter;
 
 namespace policy {
 
@@ -86,8 +80,7 @@ struct URLBlacklist::FilterComponents {
   bool allow;
 };
 
-URLBlacklist::URLBlacklist() : id_(0),
-                               url_matcher_(new URLMatcher) {
+URLBlacklist::URLBlacklist() : id_(0) {
 }
 
 URLBlacklist::~URLBlacklist() {
@@ -95,7 +88,6 @@ URLBlacklist::~URLBlacklist() {
 
 void URLBlacklist::AddFilters(bool allow,
                               const base::ListValue* list) {
-  URLMatcherConditionSet::Vector all_conditions;
   size_t size = std::min(kMaxFiltersPerPolicy, list->GetSize());
   for (size_t i = 0; i < size; ++i) {
     std::string pattern;
@@ -110,13 +102,11 @@ void URLBlacklist::AddFilters(bool allow,
       continue;
     }
 
-    all_conditions.push_back(
-        CreateConditionSet(url_matcher_.get(), ++id_, components.scheme,
-                           components.host, components.match_subdomains,
-                           components.port, components.path));
+    index_.AddFilter(++id_, components.scheme, components.host,
+                     components.match_subdomains, components.port,
+                     components.path);
     filters_[id_] = components;
   }
-  url_matcher_->AddConditionSets(all_conditions);
 }
 
 void URLBlacklist::Block(const base::ListValue* filters) {
@@ -128,11 +118,12 @@ void URLBlacklist::Allow(const base::ListValue* filters) {
 }
 
 bool URLBlacklist::IsURLBlocked(const GURL& url) const {
-  std::set<URLMatcherConditionSet::ID> matching_ids =
-      url_matcher_->MatchURL(url);
+  std::vector<URLFilterIndex::ID> matching_ids;
+  index_.MatchURL(url, &matching_ids);
 
   const FilterComponents* max = NULL;
-  for (std::set<URLMatcherConditionSet::ID>::iterator id = matching_ids.begin();
+  for (std::vector<URLFilterIndex::ID>::const_iterator id =
+           matching_ids.begin();
        id != matching_ids.end(); ++id) {
     std::map<int, FilterComponents>::const_iterator it = filters_.find(*id);
     DCHECK(it != filters_.end());
@@ -235,38 +226,6 @@ bool URLBlacklist::FilterToComponents(const std::string& filter,
   return true;
 }
 
-// static
-scoped_refptr<extensions::URLMatcherConditionSet>
-URLBlacklist::CreateConditionSet(
-    extensions::URLMatcher* url_matcher,
-    int id,
-    const std::string& scheme,
-    const std::string& host,
-    bool match_subdomains,
-    uint16 port,
-    const std::string& path) {
-  URLMatcherConditionFactory* condition_factory =
-      url_matcher->condition_factory();
-  std::set<URLMatcherCondition> conditions;
-  conditions.insert(match_subdomains ?
-      condition_factory->CreateHostSuffixPathPrefixCondition(host, path) :
-      condition_factory->CreateHostEqualsPathPrefixCondition(host, path));
-
-  scoped_ptr<URLMatcherSchemeFilter> scheme_filter;
-  if (!scheme.empty())
-    scheme_filter.reset(new URLMatcherSchemeFilter(scheme));
-
-  scoped_ptr<URLMatcherPortFilter> port_filter;
-  if (port != 0) {
-    std::vector<URLMatcherPortFilter::Range> ranges;
-    ranges.push_back(URLMatcherPortFilter::CreateRange(port));
-    port_filter.reset(new URLMatcherPortFilter(ranges));
-  }
-
-  return new URLMatcherConditionSet(id, conditions,
-                                    scheme_filter.Pass(), port_filter.Pass());
-}
-
 // static
 bool URLBlacklist::FilterTakesPrecedence(const FilterComponents& lhs,
                                          const FilterComponents& rhs) {
@@ -15,7 +15,7 @@
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/weak_ptr.h"
 #include "base/prefs/pref_change_registrar.h"
-#include "extensions/common/matcher/url_matcher.h"
+#include "chrome/browser/policy/url_filter_index.h"
 
 class GURL;
 class PrefService;
@@ -62,8 +62,7 @@ class URLBlacklist {
   // Splits a URL filter into its components. A GURL isn't used because these
   // can be invalid URLs e.g. "google.com".
   // Returns false if the URL couldn't be parsed.
-  // The |host| is preprocessed so it can be passed to URLMatcher for the
-  // appropriate condition.
+  // The |host| is preprocessed so it can be passed to URLFilterIndex.
   // The optional username and password are ignored.
   // |match_subdomains| specifies whether the filter should include subdomains
   // of the hostname (if it is one.)
@@ -76,18 +75,6 @@ class URLBlacklist {
                                  uint16* port,
                                  std::string* path);
 
-  // Creates a condition set that can be used with the |url_matcher|. |id| needs
-  // to be a unique number that will be returned by the |url_matcher| if the URL
-  // matches that condition set.
-  static scoped_refptr<extensions::URLMatcherConditionSet> CreateConditionSet(
-      extensions::URLMatcher* url_matcher,
-      extensions::URLMatcherConditionSet::ID id,
-      const std::string& scheme,
-      const std::string& host,
-      bool match_subdomains,
-      uint16 port,
-      const std::string& path);
-
  private:
   struct FilterComponents;
 
@@ -95,9 +82,9 @@ class URLBlacklist {
   static bool FilterTakesPrecedence(const FilterComponents& lhs,
                                     const FilterComponents& rhs);
 
-  extensions::URLMatcherConditionSet::ID id_;
-  std::map<extensions::URLMatcherConditionSet::ID, FilterComponents> filters_;
-  scoped_ptr<extensions::URLMatcher> url_matcher_;
+  URLFilterIndex::ID id_;
+  std::map<URLFilterIndex::ID, FilterComponents> filters_;
+  URLFilterIndex index_;
 
   DISALLOW_COPY_AND_ASSIGN(URLBlacklist);
 };
@@ -0,0 +1,94 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/policy/url_filter_index.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "url/gurl.h"
+
+namespace policy {
+
+URLFilterIndex::Filter::Filter() : id(0), port(0) {
+}
+
+URLFilterIndex::Filter::~Filter() {
+}
+
+URLFilterIndex::URLFilterIndex() : size_(0) {
+}
+
+URLFilterIndex::~URLFilterIndex() {
+}
+
+void URLFilterIndex::AddFilter(ID id,
+                               const std::string& scheme,
+                               const std::string& host,
+                               bool match_subdomains,
+                               uint16 port,
+                               const std::string& path) {
+  Filter filter;
+  filter.id = id;
+  filter.scheme = scheme;
+  filter.port = port;
+  filter.path = path;
+  ++size_;
+
+  if (!match_subdomains) {
+    host_filters_[host].push_back(filter);
+  } else if (host.empty()) {
+    any_host_filters_.push_back(filter);
+  } else {
+    // FilterToComponents puts a dot in front of the domains whose subdomains
+    // match, so that they only match at label boundaries.
+    DCHECK_EQ('.', host[0]);
+    domain_filters_[host.substr(1)].push_back(filter);
+  }
+}
+
+void URLFilterIndex::MatchURL(const GURL& url, std::vector<ID>* ids) const {
+  const size_t first_match = ids->size();
+  MatchFilters(any_host_filters_, url, ids);
+
+  const std::string& host = url.host();
+  HostMap::const_iterator it = host_filters_.find(host);
+  if (it != host_filters_.end())
+    MatchFilters(it->second, url, ids);
+
+  if (!domain_filters_.empty()) {
+    // Try the host itself and then each of its parent domains.
+    size_t pos = 0;
+    while (pos < host.size()) {
+      it = domain_filters_.find(host.substr(pos));
+      if (it != domain_filters_.end())
+        MatchFilters(it->second, url, ids);
+      pos = host.find('.', pos);
+      if (pos == std::string::npos)
+        break;
+      ++pos;
+    }
+  }
+
+  std::sort(ids->begin() + first_match, ids->end());
+}
+
+// static
+void URLFilterIndex::MatchFilters(const FilterList& filters,
+                                  const GURL& url,
+                                  std::vector<ID>* ids) {
+  const std::string& path = url.path();
+  for (FilterList::const_iterator it = filters.begin(); it != filters.end();
+       ++it) {
+    if (!it->scheme.empty() && it->scheme != url.scheme())
+      continue;
+    if (it->port != 0 && it->port != url.EffectiveIntPort())
+      continue;
+    if (path.compare(0, it->path.size(), it->path) != 0)
+      continue;
+    ids->push_back(it->id);
+  }
+}
+
+}  // namespace policy
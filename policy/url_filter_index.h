@@ -0,0 +1,88 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_POLICY_URL_FILTER_INDEX_H_
+#define CHROME_BROWSER_POLICY_URL_FILTER_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+
+class GURL;
+
+namespace policy {
+
+// Matches URLs against a set of filters, each given as the components that
+// URLBlacklist::FilterToComponents returns. The filters are grouped by the
+// host they apply to, so a URL is only checked against the filters for its
+// host and its parent domains, plus the filters that apply to any host.
+// Building the index is linear in the number of filters, and a lookup costs
+// a hash lookup per label of the URL's host.
+//
+// The index is not thread-safe. It is meant to be built on a background
+// thread and then handed over to the thread that does the lookups.
+class URLFilterIndex {
+ public:
+  typedef int ID;
+
+  URLFilterIndex();
+  ~URLFilterIndex();
+
+  // Adds a filter, which MatchURL reports as |id| for the URLs it matches.
+  // The arguments are as returned by URLBlacklist::FilterToComponents: an
+  // empty |scheme| matches any scheme, a |port| of 0 matches any port, and
+  // an empty |host| with |match_subdomains| set matches any host.
+  void AddFilter(ID id,
+                 const std::string& scheme,
+                 const std::string& host,
+                 bool match_subdomains,
+                 uint16 port,
+                 const std::string& path);
+
+  // Appends to |ids| the IDs of the filters that match |url|, in ascending
+  // order.
+  void MatchURL(const GURL& url, std::vector<ID>* ids) const;
+
+  // Returns the number of filters added.
+  size_t size() const { return size_; }
+
+ private:
+  struct Filter {
+    Filter();
+    ~Filter();
+
+    ID id;
+    std::string scheme;
+    uint16 port;
+    std::string path;
+  };
+  typedef std::vector<Filter> FilterList;
+  typedef base::hash_map<std::string, FilterList> HostMap;
+
+  // Appends to |ids| the IDs of the |filters| whose scheme, port and path
+  // match |url|.
+  static void MatchFilters(const FilterList& filters,
+                           const GURL& url,
+                           std::vector<ID>* ids);
+
+  // Filters for a single host, keyed by that host.
+  HostMap host_filters_;
+
+  // Filters for a domain and all its subdomains, keyed by the domain without
+  // its leading dot.
+  HostMap domain_filters_;
+
+  // Filters that apply to any host.
+  FilterList any_host_filters_;
+
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(URLFilterIndex);
+};
+
+}  // namespace policy
+
+#endif  // CHROME_BROWSER_POLICY_URL_FILTER_INDEX_H_
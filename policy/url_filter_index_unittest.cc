@@ -0,0 +1,82 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/policy/url_filter_index.h"
+
+#include <string>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+#include "url/gurl.h"
+
+namespace policy {
+
+namespace {
+
+std::vector<URLFilterIndex::ID> Match(const URLFilterIndex& index,
+                                      const std::string& url) {
+  std::vector<URLFilterIndex::ID> ids;
+  index.MatchURL(GURL(url), &ids);
+  return ids;
+}
+
+}  // namespace
+
+TEST(URLFilterIndexTest, Hosts) {
+  URLFilterIndex index;
+  // "google.com", "mail.google.com" and ".google.com".
+  index.AddFilter(1, std::string(), ".google.com", true, 0, std::string());
+  index.AddFilter(2, std::string(), ".mail.google.com", true, 0,
+                  std::string());
+  index.AddFilter(3, std::string(), "google.com", false, 0, std::string());
+  EXPECT_EQ(3U, index.size());
+
+  std::vector<URLFilterIndex::ID> ids = Match(index, "http://google.com/");
+  ASSERT_EQ(2U, ids.size());
+  EXPECT_EQ(1, ids[0]);
+  EXPECT_EQ(3, ids[1]);
+
+  ids = Match(index, "http://x.mail.google.com/");
+  ASSERT_EQ(2U, ids.size());
+  EXPECT_EQ(1, ids[0]);
+  EXPECT_EQ(2, ids[1]);
+
+  EXPECT_TRUE(Match(index, "http://notgoogle.com/").empty());
+  EXPECT_TRUE(Match(index, "http://google.com.au/").empty());
+  EXPECT_TRUE(Match(index, "http://mail.google.com.evil.org/").empty());
+}
+
+TEST(URLFilterIndexTest, AnyHost) {
+  URLFilterIndex index;
+  // "*" and "ftp://*".
+  index.AddFilter(1, std::string(), std::string(), true, 0, std::string());
+  index.AddFilter(2, "ftp", std::string(), true, 0, std::string());
+
+  std::vector<URLFilterIndex::ID> ids = Match(index, "ftp://example.com/");
+  ASSERT_EQ(2U, ids.size());
+  EXPECT_EQ(1, ids[0]);
+  EXPECT_EQ(2, ids[1]);
+  EXPECT_EQ(1U, Match(index, "http://example.com/").size());
+  EXPECT_EQ(1U, Match(index, "http://127.0.0.1/").size());
+}
+
+TEST(URLFilterIndexTest, SchemePortAndPath) {
+  URLFilterIndex index;
+  // "https://example.com:8443/a" and "http://10.0.0.1/b".
+  index.AddFilter(1, "https", ".example.com", true, 8443, "/a");
+  index.AddFilter(2, "http", "10.0.0.1", false, 0, "/b");
+
+  EXPECT_EQ(1U, Match(index, "https://example.com:8443/a").size());
+  EXPECT_EQ(1U, Match(index, "https://www.example.com:8443/abc").size());
+  EXPECT_TRUE(Match(index, "https://example.com/a").empty());
+  EXPECT_TRUE(Match(index, "http://example.com:8443/a").empty());
+  EXPECT_TRUE(Match(index, "https://example.com:8443/").empty());
+
+  EXPECT_EQ(1U, Match(index, "http://10.0.0.1/b/c").size());
+  EXPECT_EQ(1U, Match(index, "http://10.0.0.1:80/b").size());
+  EXPECT_TRUE(Match(index, "http://10.0.0.1/c").empty());
+  EXPECT_TRUE(Match(index, "http://10.0.0.10/b").empty());
+}
+
+}  // namespace policy
@@ -512,6 +512,7 @@ HistoryModel.prototype.addResults = function(info, results) {
   this.isQueryFinished_ = info.finished;
   this.queryStartTime = info.queryStartTime;
   this.queryEndTime = info.queryEndTime;
+  this.queryDurationMs = info.queryDurationMs;
 
   var lastVisit = this.visits_.slice(-1)[0];
   var lastDay = lastVisit ? lastVisit.dateRelativeDay : null;
@@ -1261,6 +1262,9 @@ HistoryView.prototype.displayResults_ = function(doneLoading) {
       var header = document.createElement('h3');
       header.textContent = loadTimeData.getStringF('searchResultsFor',
                                                    searchText);
+      // Expose how long the history backend took to answer the search, for
+      // tests and for anyone looking into slow searches.
+      header.dataset.queryDurationMs = this.model_.queryDurationMs;
       this.resultDiv_.appendChild(header);
     }
 
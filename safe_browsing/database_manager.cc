@@ -90,8 +90,9 @@ void SafeBrowsingDatabaseManager::Client::OnSafeBrowsingResult(
     switch (check.check_type) {
       case safe_browsing_util::MALWARE:
       case safe_browsing_util::PHISH:
-        DCHECK_EQ(1u, check.urls.size());
-        OnCheckBrowseUrlResult(check.urls[0], check.url_results[0]);
+        // More than one url when the check came from CheckBrowseUrls().
+        for (size_t i = 0; i < check.urls.size(); ++i)
+          OnCheckBrowseUrlResult(check.urls[i], check.url_results[i]);
         break;
       case safe_browsing_util::BINURL:
         DCHECK_EQ(check.urls.size(), check.url_results.size());
@@ -365,6 +366,77 @@ bool SafeBrowsingDatabaseManager::CheckBrowseUrl(const GURL& url,
   return false;
 }
 
+bool SafeBrowsingDatabaseManager::CheckBrowseUrls(
+    const std::vector<GURL>& urls,
+    Client* client) {
+  DCHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
+  if (!enabled_)
+    return true;
+
+  std::vector<GURL> checked_urls;
+  for (size_t i = 0; i < urls.size(); ++i) {
+    if (CanCheckUrl(urls[i]))
+      checked_urls.push_back(urls[i]);
+  }
+  if (checked_urls.empty())
+    return true;
+
+  const base::TimeTicks start = base::TimeTicks::Now();
+  if (!MakeDatabaseAvailable()) {
+    // DatabaseLoadComplete() checks queued urls one at a time, which still
+    // gives the client a result for each of them.
+    for (size_t i = 0; i < checked_urls.size(); ++i) {
+      QueuedCheck check;
+      check.check_type = safe_browsing_util::MALWARE;  // or PHISH
+      check.client = client;
+      check.url = checked_urls[i];
+      check.start = start;
+      queued_checks_.push_back(check);
+    }
+    return false;
+  }
+
+  std::vector<SBPrefix> prefix_hits;
+  std::vector<SBFullHashResult> full_hits;
+
+  bool prefix_match =
+      database_->ContainsBrowseUrls(checked_urls, &prefix_hits, &full_hits,
+          sb_service_->protocol_manager()->last_update());
+
+  UMA_HISTOGRAM_TIMES("SB2.FilterCheckBatch", base::TimeTicks::Now() - start);
+
+  if (!prefix_match)
+    return true;  // All the urls are okay.
+
+  // The cached full hashes only settle the check if they cover every prefix
+  // hit; otherwise ask for all of them in one GetHash request.
+  std::set<SBPrefix> cached_prefixes;
+  for (size_t i = 0; i < full_hits.size(); ++i)
+    cached_prefixes.insert(full_hits[i].hash.prefix);
+  bool need_get_hash = false;
+  for (size_t i = 0; i < prefix_hits.size(); ++i) {
+    if (cached_prefixes.count(prefix_hits[i]) == 0) {
+      need_get_hash = true;
+      break;
+    }
+  }
+
+  SafeBrowsingCheck* check = new SafeBrowsingCheck(checked_urls,
+                                                   std::vector<SBFullHash>(),
+                                                   client,
+                                                   safe_browsing_util::MALWARE);
+  check->need_get_hash = need_get_hash;
+  check->prefix_hits.swap(prefix_hits);
+  check->full_hits.swap(full_hits);
+  checks_.insert(check);
+
+  BrowserThread::PostTask(
+      BrowserThread::IO, FROM_HERE,
+      base::Bind(&SafeBrowsingDatabaseManager::OnCheckDone, this, check));
+
+  return false;
+}
+
 void SafeBrowsingDatabaseManager::CancelCheck(Client* client) {
   DCHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
   for (CurrentChecks::iterator i = checks_.begin(); i != checks_.end(); ++i) {
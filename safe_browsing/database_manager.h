@@ -131,6 +131,13 @@ class SafeBrowsingDatabaseManager
   // result when it is ready.
   virtual bool CheckBrowseUrl(const GURL& url, Client* client);
 
+  // Like CheckBrowseUrl(), but for all of |urls| at once, such as a redirect
+  // chain or the resources of a page.  The prefixes of all the urls are
+  // looked up together, and any GetHash request covering them is sent as one.
+  // Returns true if all of |urls| are known to be safe.  Otherwise "client"
+  // is called asynchronously with the result of each url which CanCheckUrl().
+  virtual bool CheckBrowseUrls(const std::vector<GURL>& urls, Client* client);
+
   // Check if the prefix for |url| is in safebrowsing download add lists.
   // Result will be passed to callback in |client|.
   virtual bool CheckDownloadUrl(const std::vector<GURL>& url_chain,
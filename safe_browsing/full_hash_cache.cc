@@ -0,0 +1,159 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/safe_browsing/full_hash_cache.h"
+
+#include "base/logging.h"
+#include "base/metrics/stats_counters.h"
+#include "chrome/browser/safe_browsing/prefix_set.h"
+
+namespace {
+
+// Rough bookkeeping cost of an entry beyond its payload, for the
+// memory budget.
+const size_t kEntryOverhead = 64;
+
+}  // namespace
+
+namespace safe_browsing {
+
+// Matches the time the protocol allows full hashes to be used for
+// without an update.
+const int FullHashCache::kPositiveExpiryMinutes = 45;
+
+// About the time between updates, which is how long misses used to be
+// cached for.
+const int FullHashCache::kNegativeExpiryMinutes = 30;
+
+FullHashCache::Entry::Entry() {
+}
+
+FullHashCache::Entry::~Entry() {
+}
+
+FullHashCache::FullHashCache(size_t max_bytes)
+    : entries_(EntryMap::NO_AUTO_EVICT),
+      max_bytes_(max_bytes),
+      memory_usage_(0),
+      hit_count_(0),
+      miss_count_(0),
+      eviction_count_(0) {
+}
+
+FullHashCache::~FullHashCache() {
+}
+
+void FullHashCache::Insert(const std::vector<SBPrefix>& prefixes,
+                           const std::vector<SBFullHashResult>& full_hits,
+                           base::Time now) {
+  Entry miss;
+  miss.expire_time =
+      now + base::TimeDelta::FromMinutes(kNegativeExpiryMinutes);
+  for (size_t i = 0; i < prefixes.size(); ++i)
+    Put(prefixes[i], miss);
+
+  // Group the full hashes by prefix.  A response only has a few, so
+  // there is no need to sort them.
+  std::set<SBPrefix> hit_prefixes;
+  for (size_t i = 0; i < full_hits.size(); ++i)
+    hit_prefixes.insert(full_hits[i].hash.prefix);
+  for (std::set<SBPrefix>::const_iterator iter = hit_prefixes.begin();
+       iter != hit_prefixes.end(); ++iter) {
+    Entry hit;
+    hit.expire_time =
+        now + base::TimeDelta::FromMinutes(kPositiveExpiryMinutes);
+    for (size_t i = 0; i < full_hits.size(); ++i) {
+      if (full_hits[i].hash.prefix == *iter)
+        hit.full_hits.push_back(full_hits[i]);
+    }
+    Put(*iter, hit);
+  }
+
+  EvictToBudget();
+}
+
+FullHashCache::LookupResult FullHashCache::Lookup(
+    SBPrefix prefix,
+    base::Time now,
+    std::vector<SBFullHashResult>* full_hits) {
+  EntryMap::iterator it = entries_.Get(prefix);
+  if (it != entries_.end() && it->second.expire_time <= now) {
+    Erase(it);
+    it = entries_.end();
+  }
+
+  if (it == entries_.end()) {
+    ++miss_count_;
+    base::StatsCounter("SB2.FullHashCacheMiss").Increment();
+    return NOT_CACHED;
+  }
+
+  ++hit_count_;
+  base::StatsCounter("SB2.FullHashCacheHit").Increment();
+  const Entry& entry = it->second;
+  if (entry.full_hits.empty())
+    return CACHED_MISS;
+  full_hits->insert(full_hits->end(),
+                    entry.full_hits.begin(), entry.full_hits.end());
+  return CACHED_HIT;
+}
+
+void FullHashCache::RemoveUnlisted(const PrefixSet& prefix_set) {
+  for (EntryMap::iterator it = entries_.begin(); it != entries_.end(); ) {
+    if (prefix_set.Exists(it->first)) {
+      ++it;
+    } else {
+      it = Erase(it);
+    }
+  }
+}
+
+void FullHashCache::RemovePrefixes(const std::set<SBPrefix>& prefixes) {
+  for (std::set<SBPrefix>::const_iterator iter = prefixes.begin();
+       iter != prefixes.end(); ++iter) {
+    EntryMap::iterator it = entries_.Peek(*iter);
+    if (it != entries_.end())
+      Erase(it);
+  }
+}
+
+void FullHashCache::Clear() {
+  entries_.Clear();
+  memory_usage_ = 0;
+}
+
+// static
+size_t FullHashCache::EntrySize(const Entry& entry) {
+  size_t size = kEntryOverhead + sizeof(SBPrefix) + sizeof(Entry);
+  for (size_t i = 0; i < entry.full_hits.size(); ++i)
+    size += sizeof(SBFullHashResult) + entry.full_hits[i].list_name.size();
+  return size;
+}
+
+void FullHashCache::Put(SBPrefix prefix, const Entry& entry) {
+  EntryMap::iterator it = entries_.Peek(prefix);
+  if (it != entries_.end())
+    memory_usage_ -= EntrySize(it->second);
+  entries_.Put(prefix, entry);
+  memory_usage_ += EntrySize(entry);
+}
+
+FullHashCache::EntryMap::iterator FullHashCache::Erase(
+    EntryMap::iterator it) {
+  DCHECK_GE(memory_usage_, EntrySize(it->second));
+  memory_usage_ -= EntrySize(it->second);
+  return entries_.Erase(it);
+}
+
+void FullHashCache::EvictToBudget() {
+  while (memory_usage_ > max_bytes_ && !entries_.empty()) {
+    EntryMap::reverse_iterator oldest = entries_.rbegin();
+    memory_usage_ -= EntrySize(oldest->second);
+    entries_.Erase(oldest);
+    ++eviction_count_;
+    base::StatsCounter("SB2.FullHashCacheEviction").Increment();
+  }
+}
+
+}  // namespace safe_browsing
@@ -0,0 +1,126 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_SAFE_BROWSING_FULL_HASH_CACHE_H_
+#define CHROME_BROWSER_SAFE_BROWSING_FULL_HASH_CACHE_H_
+
+#include <set>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/mru_cache.h"
+#include "base/time/time.h"
+#include "chrome/browser/safe_browsing/safe_browsing_util.h"
+
+namespace safe_browsing {
+
+class PrefixSet;
+
+// Caches the results of GetHash requests by prefix, so that lookups
+// which hit the prefix filter do not have to go to the server every
+// time.  The entry for a prefix holds either the full hashes the
+// server returned for it, or a record that it returned none.  Both
+// kinds expire a fixed time after they are received, and the least
+// recently used entries are evicted to keep the cache within a fixed
+// memory budget.
+//
+// Entries survive database updates which leave their prefix alone.
+// An update whose add or sub chunks touch a prefix can change the
+// server's full hashes for it, so its entry is dropped, as is the
+// entry for a prefix the update removes from the database.
+//
+// Not thread-safe.  SafeBrowsingDatabaseNew guards it with its lookup
+// lock.
+class FullHashCache {
+ public:
+  enum LookupResult {
+    // Nothing, or nothing current, is cached for the prefix.
+    NOT_CACHED,
+
+    // The server returned no full hashes for the prefix.
+    CACHED_MISS,
+
+    // The server's full hashes for the prefix were added to |full_hits|.
+    CACHED_HIT,
+  };
+
+  // How long full hashes, and the lack of them, are cached.
+  static const int kPositiveExpiryMinutes;
+  static const int kNegativeExpiryMinutes;
+
+  explicit FullHashCache(size_t max_bytes);
+  ~FullHashCache();
+
+  // Caches the response to a GetHash request for |prefixes|, received
+  // at |now|.  Each prefix without an item in |full_hits| is cached as
+  // a miss.
+  void Insert(const std::vector<SBPrefix>& prefixes,
+              const std::vector<SBFullHashResult>& full_hits,
+              base::Time now);
+
+  // Looks up |prefix| as of |now|, making its entry the most recently
+  // used.  Expired entries are removed.
+  LookupResult Lookup(SBPrefix prefix,
+                      base::Time now,
+                      std::vector<SBFullHashResult>* full_hits);
+
+  // Removes the entries for prefixes which are not in |prefix_set|, as
+  // when an update has removed them from the database.
+  void RemoveUnlisted(const PrefixSet& prefix_set);
+
+  // Removes the entries for |prefixes|, as when an update has added or
+  // subbed items for them.
+  void RemovePrefixes(const std::set<SBPrefix>& prefixes);
+
+  void Clear();
+
+  size_t size() const { return entries_.size(); }
+
+  // Approximate bytes used by the entries.
+  size_t memory_usage() const { return memory_usage_; }
+
+  // Lookups which found a current entry, and those which did not, and
+  // entries evicted to stay within the budget.  These are also kept as
+  // stats counters for about:stats.
+  size_t hit_count() const { return hit_count_; }
+  size_t miss_count() const { return miss_count_; }
+  size_t eviction_count() const { return eviction_count_; }
+
+ private:
+  struct Entry {
+    Entry();
+    ~Entry();
+
+    base::Time expire_time;
+
+    // Empty for a cached miss.
+    std::vector<SBFullHashResult> full_hits;
+  };
+  typedef base::HashingMRUCache<SBPrefix, Entry> EntryMap;
+
+  static size_t EntrySize(const Entry& entry);
+
+  // Replaces the entry for |prefix| with |entry|.
+  void Put(SBPrefix prefix, const Entry& entry);
+
+  EntryMap::iterator Erase(EntryMap::iterator it);
+
+  // Evicts least recently used entries until the cache fits its budget.
+  void EvictToBudget();
+
+  EntryMap entries_;
+
+  const size_t max_bytes_;
+  size_t memory_usage_;
+
+  size_t hit_count_;
+  size_t miss_count_;
+  size_t eviction_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(FullHashCache);
+};
+
+}  // namespace safe_browsing
+
+#endif  // CHROME_BROWSER_SAFE_BROWSING_FULL_HASH_CACHE_H_
@@ -0,0 +1,176 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/safe_browsing/full_hash_cache.h"
+
+#include <set>
+#include <vector>
+
+#include "chrome/browser/safe_browsing/prefix_set.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace safe_browsing {
+
+namespace {
+
+SBFullHashResult MakeResult(SBPrefix prefix, int add_chunk_id) {
+  SBFullHashResult result;
+  result.hash = SBFullHash();
+  result.hash.prefix = prefix;
+  result.hash.full_hash[sizeof(SBPrefix)] = static_cast<char>(add_chunk_id);
+  result.list_name = safe_browsing_util::kMalwareList;
+  result.add_chunk_id = add_chunk_id;
+  return result;
+}
+
+}  // namespace
+
+TEST(FullHashCacheTest, HitsAndMisses) {
+  FullHashCache cache(1024 * 1024);
+  const base::Time now = base::Time::Now();
+
+  std::vector<SBPrefix> prefixes;
+  prefixes.push_back(1);
+  prefixes.push_back(2);
+  prefixes.push_back(3);
+  std::vector<SBFullHashResult> full_hits;
+  full_hits.push_back(MakeResult(2, 10));
+  full_hits.push_back(MakeResult(2, 11));
+  cache.Insert(prefixes, full_hits, now);
+  EXPECT_EQ(3U, cache.size());
+
+  std::vector<SBFullHashResult> results;
+  EXPECT_EQ(FullHashCache::CACHED_MISS, cache.Lookup(1, now, &results));
+  EXPECT_EQ(FullHashCache::CACHED_HIT, cache.Lookup(2, now, &results));
+  ASSERT_EQ(2U, results.size());
+  EXPECT_EQ(10, results[0].add_chunk_id);
+  EXPECT_EQ(11, results[1].add_chunk_id);
+  EXPECT_EQ(FullHashCache::NOT_CACHED, cache.Lookup(4, now, &results));
+  EXPECT_EQ(2U, results.size());
+
+  EXPECT_EQ(2U, cache.hit_count());
+  EXPECT_EQ(1U, cache.miss_count());
+
+  cache.Clear();
+  EXPECT_EQ(0U, cache.size());
+  EXPECT_EQ(0U, cache.memory_usage());
+}
+
+TEST(FullHashCacheTest, Expiry) {
+  FullHashCache cache(1024 * 1024);
+  const base::Time now = base::Time::Now();
+
+  cache.Insert(std::vector<SBPrefix>(1, 1),
+               std::vector<SBFullHashResult>(1, MakeResult(2, 10)),
+               now);
+  std::vector<SBFullHashResult> results;
+
+  // Misses expire before hits do.
+  const base::Time later = now + base::TimeDelta::FromMinutes(
+      FullHashCache::kNegativeExpiryMinutes);
+  EXPECT_EQ(FullHashCache::NOT_CACHED, cache.Lookup(1, later, &results));
+  EXPECT_EQ(FullHashCache::CACHED_HIT, cache.Lookup(2, later, &results));
+  EXPECT_EQ(1U, cache.size());
+
+  const base::Time much_later = now + base::TimeDelta::FromMinutes(
+      FullHashCache::kPositiveExpiryMinutes);
+  EXPECT_EQ(FullHashCache::NOT_CACHED,
+            cache.Lookup(2, much_later, &results));
+  EXPECT_EQ(0U, cache.size());
+  EXPECT_EQ(0U, cache.memory_usage());
+}
+
+TEST(FullHashCacheTest, EvictsLeastRecentlyUsed) {
+  const base::Time now = base::Time::Now();
+
+  // Find out how much room an entry takes, and allow for three.
+  size_t entry_size;
+  {
+    FullHashCache cache(1024 * 1024);
+    cache.Insert(std::vector<SBPrefix>(1, 1),
+                 std::vector<SBFullHashResult>(), now);
+    entry_size = cache.memory_usage();
+  }
+  FullHashCache cache(3 * entry_size);
+  for (SBPrefix prefix = 1; prefix <= 3; ++prefix) {
+    cache.Insert(std::vector<SBPrefix>(1, prefix),
+                 std::vector<SBFullHashResult>(), now);
+  }
+  EXPECT_EQ(3U, cache.size());
+
+  // Using 1 leaves 2 as the oldest.
+  std::vector<SBFullHashResult> results;
+  EXPECT_EQ(FullHashCache::CACHED_MISS, cache.Lookup(1, now, &results));
+  cache.Insert(std::vector<SBPrefix>(1, 4),
+               std::vector<SBFullHashResult>(), now);
+  EXPECT_EQ(3U, cache.size());
+  EXPECT_EQ(1U, cache.eviction_count());
+  EXPECT_LE(cache.memory_usage(), 3 * entry_size);
+  EXPECT_EQ(FullHashCache::NOT_CACHED, cache.Lookup(2, now, &results));
+  EXPECT_EQ(FullHashCache::CACHED_MISS, cache.Lookup(1, now, &results));
+  EXPECT_EQ(FullHashCache::CACHED_MISS, cache.Lookup(3, now, &results));
+  EXPECT_EQ(FullHashCache::CACHED_MISS, cache.Lookup(4, now, &results));
+
+  // An entry which does not fit at all is not kept.
+  std::vector<SBFullHashResult> full_hits;
+  for (int i = 0; i < 100; ++i)
+    full_hits.push_back(MakeResult(5, i));
+  cache.Insert(std::vector<SBPrefix>(1, 5), full_hits, now);
+  EXPECT_EQ(0U, cache.size());
+  EXPECT_EQ(0U, cache.memory_usage());
+}
+
+TEST(FullHashCacheTest, RemoveUnlisted) {
+  const base::Time now = base::Time::Now();
+  FullHashCache cache(1024 * 1024);
+
+  std::vector<SBPrefix> prefixes;
+  prefixes.push_back(1);
+  prefixes.push_back(2);
+  prefixes.push_back(3);
+  cache.Insert(prefixes,
+               std::vector<SBFullHashResult>(1, MakeResult(2, 10)), now);
+
+  std::vector<SBPrefix> listed;
+  listed.push_back(2);
+  listed.push_back(3);
+  listed.push_back(7);
+  cache.RemoveUnlisted(PrefixSet(listed));
+  EXPECT_EQ(2U, cache.size());
+
+  std::vector<SBFullHashResult> results;
+  EXPECT_EQ(FullHashCache::NOT_CACHED, cache.Lookup(1, now, &results));
+  EXPECT_EQ(FullHashCache::CACHED_HIT, cache.Lookup(2, now, &results));
+  EXPECT_EQ(FullHashCache::CACHED_MISS, cache.Lookup(3, now, &results));
+}
+
+TEST(FullHashCacheTest, RemovePrefixes) {
+  const base::Time now = base::Time::Now();
+  FullHashCache cache(1024 * 1024);
+
+  std::vector<SBPrefix> prefixes;
+  prefixes.push_back(1);
+  prefixes.push_back(2);
+  prefixes.push_back(3);
+  cache.Insert(prefixes,
+               std::vector<SBFullHashResult>(1, MakeResult(2, 10)), now);
+
+  std::set<SBPrefix> touched;
+  touched.insert(2);
+  touched.insert(3);
+  touched.insert(7);
+  cache.RemovePrefixes(touched);
+  EXPECT_EQ(1U, cache.size());
+
+  std::vector<SBFullHashResult> results;
+  EXPECT_EQ(FullHashCache::CACHED_MISS, cache.Lookup(1, now, &results));
+  EXPECT_EQ(FullHashCache::NOT_CACHED, cache.Lookup(2, now, &results));
+  EXPECT_EQ(FullHashCache::NOT_CACHED, cache.Lookup(3, now, &results));
+
+  cache.RemovePrefixes(std::set<SBPrefix>(prefixes.begin(), prefixes.end()));
+  EXPECT_EQ(0U, cache.size());
+  EXPECT_EQ(0U, cache.memory_usage());
+}
+
+}  // namespace safe_browsing
@@ -20,7 +20,14 @@ namespace {
 static uint32 kMagic = 0x864088dd;
 
 // Current version the code writes out.
-static uint32 kVersion = 0x1;
+static uint32 kVersion = 0x2;
+
+// Version 1 stored the index offsets as size_t.
+static uint32 kVersion1 = 0x1;
+typedef std::pair<SBPrefix, size_t> IndexPairVersion1;
+
+// How many lookups |ExistsMany()| interleaves.
+const size_t kExistsManyBatch = 16;
 
 typedef struct {
   uint32 magic;
@@ -29,10 +36,89 @@ typedef struct {
   uint32 deltas_size;
 } FileHeader;
 
-// For |std::upper_bound()| to find a prefix w/in a vector of pairs.
-bool PrefixLess(const std::pair<SBPrefix,size_t>& a,
-                const std::pair<SBPrefix,size_t>& b) {
-  return a.first < b.first;
+// Regenerate the sorted prefixes encoded by |index| and |deltas| into
+// |prefixes|.
+template <typename IndexPairT>
+void DecodePrefixes(const std::vector<IndexPairT>& index,
+                    const std::vector<uint16>& deltas,
+                    std::vector<SBPrefix>* prefixes) {
+  prefixes->reserve(index.size() + deltas.size());
+
+  for (size_t ii = 0; ii < index.size(); ++ii) {
+    // The deltas for this |index| entry run to the next index entry,
+    // or the end of the deltas.
+    const size_t deltas_end =
+        (ii + 1 < index.size()) ? index[ii + 1].second : deltas.size();
+
+    SBPrefix current = index[ii].first;
+    prefixes->push_back(current);
+    for (size_t di = index[ii].second; di < deltas_end; ++di) {
+      current += deltas[di];
+      prefixes->push_back(current);
+    }
+  }
+}
+
+// Read the index and deltas described by |header| from |fp|, which is
+// |file_size| bytes long and positioned after the header, checking
+// the digest.  Returns |true| on success.
+template <typename IndexPairT>
+bool ReadPayload(FILE* fp, int64 file_size, const FileHeader& header,
+                 std::vector<IndexPairT>* index,
+                 std::vector<uint16>* deltas) {
+  using base::MD5Digest;
+  const size_t index_bytes = sizeof(IndexPairT) * header.index_size;
+  const size_t deltas_bytes = sizeof(uint16) * header.deltas_size;
+
+  // Check for bogus sizes before allocating any space.
+  const size_t expected_bytes =
+      sizeof(header) + index_bytes + deltas_bytes + sizeof(MD5Digest);
+  if (static_cast<int64>(expected_bytes) != file_size)
+    return false;
+
+  // The file looks valid, start building the digest.
+  base::MD5Context context;
+  base::MD5Init(&context);
+  base::MD5Update(&context,
+                  base::StringPiece(reinterpret_cast<const char*>(&header),
+                                    sizeof(header)));
+
+  // Read the index vector.  Herb Sutter indicates that vectors are
+  // guaranteed to be contiuguous, so reading to where element 0 lives
+  // is valid.
+  if (header.index_size) {
+    index->resize(header.index_size);
+    size_t read = fread(&((*index)[0]), sizeof((*index)[0]), index->size(),
+                        fp);
+    if (read != index->size())
+      return false;
+    base::MD5Update(&context,
+                    base::StringPiece(reinterpret_cast<char*>(&((*index)[0])),
+                                      index_bytes));
+  }
+
+  // Read vector of deltas.
+  if (header.deltas_size) {
+    deltas->resize(header.deltas_size);
+    size_t read = fread(&((*deltas)[0]), sizeof((*deltas)[0]), deltas->size(),
+                        fp);
+    if (read != deltas->size())
+      return false;
+    base::MD5Update(&context,
+                    base::StringPiece(
+                        reinterpret_cast<char*>(&((*deltas)[0])),
+                        deltas_bytes));
+  }
+
+  base::MD5Digest calculated_digest;
+  base::MD5Final(&calculated_digest, &context);
+
+  base::MD5Digest file_digest;
+  size_t read = fread(&file_digest, sizeof(file_digest), 1, fp);
+  if (read != 1)
+    return false;
+
+  return 0 == memcmp(&file_digest, &calculated_digest, sizeof(file_digest));
 }
 
 }  // namespace
@@ -51,7 +137,7 @@ PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
     // Lead with the first prefix.
     SBPrefix prev_prefix = sorted_prefixes[0];
     size_t run_length = 0;
-    index_.push_back(std::make_pair(prev_prefix, deltas_.size()));
+    index_.push_back(IndexPair(prev_prefix, 0));
 
     for (size_t i = 1; i < sorted_prefixes.size(); ++i) {
       // Skip duplicates.
@@ -67,7 +153,8 @@ PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
       // New index ref if the delta doesn't fit, or if too many
       // consecutive deltas have been encoded.
       if (delta != static_cast<unsigned>(delta16) || run_length >= kMaxRun) {
-        index_.push_back(std::make_pair(sorted_prefixes[i], deltas_.size()));
+        index_.push_back(IndexPair(sorted_prefixes[i],
+                                   static_cast<uint32>(deltas_.size())));
         run_length = 0;
       } else {
         // Continue the run of deltas.
@@ -89,68 +176,123 @@ PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
                               bits_used / unique_prefixes,
                               kMaxBitsPerPrefix);
   }
+
+  BuildEytzinger();
 }
 
-PrefixSet::PrefixSet(std::vector<std::pair<SBPrefix,size_t> > *index,
-                     std::vector<uint16> *deltas) {
+PrefixSet::PrefixSet(std::vector<IndexPair>* index,
+                     std::vector<uint16>* deltas) {
   DCHECK(index && deltas);
   index_.swap(*index);
   deltas_.swap(*deltas);
+  BuildEytzinger();
 }
 
 PrefixSet::~PrefixSet() {}
 
-bool PrefixSet::Exists(SBPrefix prefix) const {
-  if (index_.empty())
-    return false;
+void PrefixSet::BuildEytzinger() {
+  eytzinger_.resize(index_.empty() ? 0 : index_.size() + 1);
+  const size_t filled = FillEytzinger(1, 0);
+  DCHECK_EQ(filled, index_.size());
+}
 
-  // Find the first position after |prefix| in |index_|.
-  std::vector<std::pair<SBPrefix,size_t> >::const_iterator
-      iter = std::upper_bound(index_.begin(), index_.end(),
-                              std::pair<SBPrefix,size_t>(prefix, 0),
-                              PrefixLess);
+size_t PrefixSet::FillEytzinger(size_t node, size_t rank) {
+  if (node >= eytzinger_.size())
+    return rank;
 
-  // |prefix| comes before anything that's in the set.
-  if (iter == index_.begin())
-    return false;
+  // An in-order walk of the tree visits the index in sorted order.
+  rank = FillEytzinger(2 * node, rank);
+  eytzinger_[node].prefix = index_[rank].first;
+  eytzinger_[node].rank = static_cast<uint32>(rank);
+  return FillEytzinger(2 * node + 1, rank + 1);
+}
 
-  // Capture the upper bound of our target entry's deltas.
-  const size_t bound = (iter == index_.end() ? deltas_.size() : iter->second);
+// static
+size_t PrefixSet::PredecessorNode(size_t node) {
+  // Each step of the search appended a bit to |node|, set where the
+  // search went right, past a prefix not greater than the target.
+  // The last such prefix is the predecessor, so drop the trailing
+  // left turns and then that right turn.
+  DCHECK(node);
+  while ((node & 1) == 0)
+    node >>= 1;
+  return node >> 1;
+}
 
-  // Back up to the entry our target is in.
-  --iter;
+bool PrefixSet::ExistsInRun(SBPrefix prefix, size_t node) const {
+  // |prefix| comes before anything that's in the set.
+  if (!node)
+    return false;
 
   // All prefixes in |index_| are in the set.
-  SBPrefix current = iter->first;
+  const size_t rank = eytzinger_[node].rank;
+  SBPrefix current = index_[rank].first;
   if (current == prefix)
     return true;
 
   // Scan forward accumulating deltas while a match is possible.
-  for (size_t di = iter->second; di < bound && current < prefix; ++di) {
+  const size_t bound =
+      (rank + 1 < index_.size() ? index_[rank + 1].second : deltas_.size());
+  for (size_t di = index_[rank].second; di < bound && current < prefix; ++di) {
     current += deltas_[di];
   }
 
   return current == prefix;
 }
 
-void PrefixSet::GetPrefixes(std::vector<SBPrefix>* prefixes) const {
-  prefixes->reserve(index_.size() + deltas_.size());
+bool PrefixSet::Exists(SBPrefix prefix) const {
+  if (index_.empty())
+    return false;
 
-  for (size_t ii = 0; ii < index_.size(); ++ii) {
-    // The deltas for this |index_| entry run to the next index entry,
-    // or the end of the deltas.
-    const size_t deltas_end =
-        (ii + 1 < index_.size()) ? index_[ii + 1].second : deltas_.size();
+  // Descend until falling off the tree.  Comparing and indexing rather
+  // than branching keeps mispredictions out of the loop.
+  const size_t size = eytzinger_.size();
+  size_t node = 1;
+  while (node < size)
+    node = 2 * node + (eytzinger_[node].prefix <= prefix);
 
-    SBPrefix current = index_[ii].first;
-    prefixes->push_back(current);
-    for (size_t di = index_[ii].second; di < deltas_end; ++di) {
-      current += deltas_[di];
-      prefixes->push_back(current);
+  return ExistsInRun(prefix, PredecessorNode(node));
+}
+
+void PrefixSet::ExistsMany(const std::vector<SBPrefix>& prefixes,
+                           std::vector<SBPrefix>* hits) const {
+  if (index_.empty())
+    return;
+
+  // Run a batch of searches a level at a time, so that each level's
+  // loads are independent of each other.
+  const size_t size = eytzinger_.size();
+  for (size_t begin = 0; begin < prefixes.size();
+       begin += kExistsManyBatch) {
+    const size_t count = std::min(kExistsManyBatch, prefixes.size() - begin);
+    size_t nodes[kExistsManyBatch];
+    std::fill(nodes, nodes + count, 1);
+
+    // All searches fall off the tree at the same depth, give or take
+    // one level.
+    bool descending = true;
+    while (descending) {
+      descending = false;
+      for (size_t i = 0; i < count; ++i) {
+        if (nodes[i] < size) {
+          nodes[i] = 2 * nodes[i] +
+              (eytzinger_[nodes[i]].prefix <= prefixes[begin + i]);
+          descending = true;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      if (ExistsInRun(prefixes[begin + i], PredecessorNode(nodes[i])))
+        hits->push_back(prefixes[begin + i]);
     }
   }
 }
 
+void PrefixSet::GetPrefixes(std::vector<SBPrefix>* prefixes) const {
+  DecodePrefixes(index_, deltas_, prefixes);
+}
+
 // static
 PrefixSet* PrefixSet::LoadFile(const base::FilePath& filter_name) {
   int64 size_64;
@@ -169,60 +311,25 @@ PrefixSet* PrefixSet::LoadFile(const base::FilePath& filter_name) {
   if (read != 1)
     return NULL;
 
-  if (header.magic != kMagic || header.version != kVersion)
+  if (header.magic != kMagic)
     return NULL;
 
-  std::vector<std::pair<SBPrefix,size_t> > index;
-  const size_t index_bytes = sizeof(index[0]) * header.index_size;
-
   std::vector<uint16> deltas;
-  const size_t deltas_bytes = sizeof(deltas[0]) * header.deltas_size;
-
-  // Check for bogus sizes before allocating any space.
-  const size_t expected_bytes =
-      sizeof(header) + index_bytes + deltas_bytes + sizeof(MD5Digest);
-  if (static_cast<int64>(expected_bytes) != size_64)
-    return NULL;
-
-  // The file looks valid, start building the digest.
-  base::MD5Context context;
-  base::MD5Init(&context);
-  base::MD5Update(&context, base::StringPiece(reinterpret_cast<char*>(&header),
-                                              sizeof(header)));
-
-  // Read the index vector.  Herb Sutter indicates that vectors are
-  // guaranteed to be contiuguous, so reading to where element 0 lives
-  // is valid.
-  if (header.index_size) {
-    index.resize(header.index_size);
-    read = fread(&(index[0]), sizeof(index[0]), index.size(), file.get());
-    if (read != index.size())
+  if (header.version == kVersion1) {
+    // Convert to the current layout, which has shorter runs.
+    std::vector<IndexPairVersion1> index;
+    if (!ReadPayload(file.get(), size_64, header, &index, &deltas))
       return NULL;
-    base::MD5Update(&context,
-                    base::StringPiece(reinterpret_cast<char*>(&(index[0])),
-                                      index_bytes));
+    std::vector<SBPrefix> prefixes;
+    DecodePrefixes(index, deltas, &prefixes);
+    return new PrefixSet(prefixes);
   }
 
-  // Read vector of deltas.
-  if (header.deltas_size) {
-    deltas.resize(header.deltas_size);
-    read = fread(&(deltas[0]), sizeof(deltas[0]), deltas.size(), file.get());
-    if (read != deltas.size())
-      return NULL;
-    base::MD5Update(&context,
-                    base::StringPiece(reinterpret_cast<char*>(&(deltas[0])),
-                                      deltas_bytes));
-  }
-
-  base::MD5Digest calculated_digest;
-  base::MD5Final(&calculated_digest, &context);
-
-  base::MD5Digest file_digest;
-  read = fread(&file_digest, sizeof(file_digest), 1, file.get());
-  if (read != 1)
+  if (header.version != kVersion)
     return NULL;
 
-  if (0 != memcmp(&file_digest, &calculated_digest, sizeof(file_digest)))
+  std::vector<IndexPair> index;
+  if (!ReadPayload(file.get(), size_64, header, &index, &deltas))
     return NULL;
 
   // Steals contents of |index| and |deltas| via swap().
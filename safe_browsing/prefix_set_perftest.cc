@@ -0,0 +1,139 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Compares PrefixSet lookups against the layout it used before the
+// Eytzinger index: a binary search of an index of (prefix, size_t)
+// pairs, followed by a scan of up to 100 deltas.
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/rand_util.h"
+#include "base/time/time.h"
+#include "chrome/browser/safe_browsing/prefix_set.h"
+#include "chrome/test/perf/perf_test.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+// About the size of the browse list.
+const size_t kPrefixCount = 650000;
+
+const size_t kLookupCount = 1000000;
+
+// Roughly how many prefixes ContainsBrowseUrl() checks per URL.
+const size_t kBatchSize = 20;
+
+// The previous PrefixSet layout, for comparison.
+class LegacyPrefixSet {
+ public:
+  explicit LegacyPrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
+    size_t run_length = 0;
+    for (size_t i = 0; i < sorted_prefixes.size(); ++i) {
+      if (i > 0 && sorted_prefixes[i] == sorted_prefixes[i - 1])
+        continue;
+      const unsigned delta =
+          i > 0 ? sorted_prefixes[i] - sorted_prefixes[i - 1] : 0;
+      if (index_.empty() || delta > 0xFFFF || run_length >= kMaxRun) {
+        index_.push_back(std::make_pair(sorted_prefixes[i], deltas_.size()));
+        run_length = 0;
+      } else {
+        deltas_.push_back(static_cast<uint16>(delta));
+        ++run_length;
+      }
+    }
+  }
+
+  bool Exists(SBPrefix prefix) const {
+    if (index_.empty())
+      return false;
+    std::vector<std::pair<SBPrefix, size_t> >::const_iterator iter =
+        std::upper_bound(index_.begin(), index_.end(),
+                         std::pair<SBPrefix, size_t>(prefix, 0), PrefixLess);
+    if (iter == index_.begin())
+      return false;
+    const size_t bound =
+        (iter == index_.end() ? deltas_.size() : iter->second);
+    --iter;
+    SBPrefix current = iter->first;
+    for (size_t di = iter->second; di < bound && current < prefix; ++di)
+      current += deltas_[di];
+    return current == prefix;
+  }
+
+ private:
+  static const size_t kMaxRun = 100;
+
+  static bool PrefixLess(const std::pair<SBPrefix, size_t>& a,
+                         const std::pair<SBPrefix, size_t>& b) {
+    return a.first < b.first;
+  }
+
+  std::vector<std::pair<SBPrefix, size_t> > index_;
+  std::vector<uint16> deltas_;
+
+  DISALLOW_COPY_AND_ASSIGN(LegacyPrefixSet);
+};
+
+void PrintLookupTime(const std::string& trace, base::TimeDelta elapsed) {
+  perf_test::PrintResult(
+      "prefix_set_lookup", "", trace,
+      static_cast<size_t>(elapsed.InMicroseconds() * 1000 / kLookupCount),
+      "ns", true);
+}
+
+TEST(PrefixSetPerfTest, Lookup) {
+  std::vector<SBPrefix> prefixes;
+  for (size_t i = 0; i < kPrefixCount; ++i)
+    prefixes.push_back(static_cast<SBPrefix>(base::RandUint64()));
+  std::sort(prefixes.begin(), prefixes.end());
+
+  // Mostly misses, as for real browsing, with some hits.
+  std::vector<SBPrefix> lookups;
+  for (size_t i = 0; i < kLookupCount; ++i) {
+    if (i % 10 == 0) {
+      lookups.push_back(prefixes[base::RandGenerator(prefixes.size())]);
+    } else {
+      lookups.push_back(static_cast<SBPrefix>(base::RandUint64()));
+    }
+  }
+
+  const LegacyPrefixSet legacy_set(prefixes);
+  const safe_browsing::PrefixSet prefix_set(prefixes);
+
+  size_t legacy_hits = 0;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < lookups.size(); ++i) {
+    if (legacy_set.Exists(lookups[i]))
+      ++legacy_hits;
+  }
+  PrintLookupTime("legacy", base::TimeTicks::Now() - start);
+
+  size_t hits = 0;
+  start = base::TimeTicks::Now();
+  for (size_t i = 0; i < lookups.size(); ++i) {
+    if (prefix_set.Exists(lookups[i]))
+      ++hits;
+  }
+  PrintLookupTime("exists", base::TimeTicks::Now() - start);
+  EXPECT_EQ(legacy_hits, hits);
+
+  std::vector<SBPrefix> batch;
+  std::vector<SBPrefix> batch_hits;
+  size_t many_hits = 0;
+  start = base::TimeTicks::Now();
+  for (size_t i = 0; i < lookups.size(); i += kBatchSize) {
+    batch.assign(lookups.begin() + i,
+                 lookups.begin() + std::min(i + kBatchSize, lookups.size()));
+    batch_hits.clear();
+    prefix_set.ExistsMany(batch, &batch_hits);
+    many_hits += batch_hits.size();
+  }
+  PrintLookupTime("exists_many", base::TimeTicks::Now() - start);
+  EXPECT_EQ(legacy_hits, many_hits);
+}
+
+}  // namespace
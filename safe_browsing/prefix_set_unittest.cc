@@ -144,6 +144,40 @@ class PrefixSetTest : public PlatformTest {
     ASSERT_EQ(new_size_64, size_64);
   }
 
+  // Write |prefixes| to |filename| in the version 1 format, with runs
+  // of up to 100 deltas and the index offsets stored as size_t.
+  static void WriteVersion1File(const base::FilePath& filename,
+                                const std::vector<SBPrefix>& prefixes) {
+    std::vector<std::pair<SBPrefix, size_t> > index;
+    std::vector<uint16> deltas;
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+      if (i > 0 && prefixes[i] == prefixes[i - 1])
+        continue;
+      const unsigned delta = i > 0 ? prefixes[i] - prefixes[i - 1] : 0;
+      if (index.empty() || delta > 0xFFFF ||
+          deltas.size() - index.back().second >= 100) {
+        index.push_back(std::make_pair(prefixes[i], deltas.size()));
+      } else {
+        deltas.push_back(static_cast<uint16>(delta));
+      }
+    }
+
+    const uint32 header[] = {
+      0x864088dd, 1,
+      static_cast<uint32>(index.size()), static_cast<uint32>(deltas.size()),
+    };
+    file_util::ScopedFILE file(file_util::OpenFile(filename, "wb+"));
+    ASSERT_EQ(1U, fwrite(header, sizeof(header), 1, file.get()));
+    ASSERT_EQ(index.size(),
+              fwrite(&index[0], sizeof(index[0]), index.size(), file.get()));
+    ASSERT_EQ(deltas.size(),
+              fwrite(&deltas[0], sizeof(deltas[0]), deltas.size(),
+                     file.get()));
+    base::MD5Digest digest;
+    ASSERT_EQ(1U, fwrite(&digest, sizeof(digest), 1, file.get()));
+    CleanChecksum(file.get());
+  }
+
   // Tests should not modify this shared resource.
   static std::vector<SBPrefix> shared_prefixes_;
 
@@ -158,6 +192,38 @@ TEST_F(PrefixSetTest, Baseline) {
   CheckPrefixes(prefix_set, shared_prefixes_);
 }
 
+// Test that batched lookups match individual lookups.
+TEST_F(PrefixSetTest, ExistsMany) {
+  safe_browsing::PrefixSet prefix_set(shared_prefixes_);
+
+  // Mix present and absent prefixes, with more than one batch.
+  std::vector<SBPrefix> prefixes;
+  for (size_t i = 0; i < 100; ++i) {
+    prefixes.push_back(shared_prefixes_[i * 7]);
+    prefixes.push_back(shared_prefixes_[i * 7] + 1);
+  }
+  prefixes.push_back(shared_prefixes_.front() - 1);
+  prefixes.push_back(shared_prefixes_.back());
+
+  std::vector<SBPrefix> expected;
+  for (size_t i = 0; i < prefixes.size(); ++i) {
+    if (prefix_set.Exists(prefixes[i]))
+      expected.push_back(prefixes[i]);
+  }
+  EXPECT_LE(101U, expected.size());
+
+  std::vector<SBPrefix> hits;
+  prefix_set.ExistsMany(prefixes, &hits);
+  EXPECT_EQ(expected, hits);
+
+  // Nothing is found in an empty set.
+  const std::vector<SBPrefix> empty;
+  safe_browsing::PrefixSet empty_set(empty);
+  hits.clear();
+  empty_set.ExistsMany(prefixes, &hits);
+  EXPECT_TRUE(hits.empty());
+}
+
 // Test that the empty set doesn't appear to have anything in it.
 TEST_F(PrefixSetTest, Empty) {
   const std::vector<SBPrefix> empty;
@@ -350,6 +416,25 @@ TEST_F(PrefixSetTest, ReadWrite) {
   }
 }
 
+// Test that files in the version 1 format are still read.
+TEST_F(PrefixSetTest, ReadVersion1) {
+  ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  const base::FilePath filename =
+      temp_dir_.path().AppendASCII("PrefixSetTest");
+  ASSERT_NO_FATAL_FAILURE(WriteVersion1File(filename, shared_prefixes_));
+
+  scoped_ptr<safe_browsing::PrefixSet>
+      prefix_set(safe_browsing::PrefixSet::LoadFile(filename));
+  ASSERT_TRUE(prefix_set.get());
+  CheckPrefixes(*prefix_set, shared_prefixes_);
+
+  // Writing it back out uses the current format.
+  ASSERT_TRUE(prefix_set->WriteFile(filename));
+  prefix_set.reset(safe_browsing::PrefixSet::LoadFile(filename));
+  ASSERT_TRUE(prefix_set.get());
+  CheckPrefixes(*prefix_set, shared_prefixes_);
+}
+
 // Check that |CleanChecksum()| makes an acceptable checksum.
 TEST_F(PrefixSetTest, CorruptionHelpers) {
   base::FilePath filename;
@@ -4,9 +4,7 @@
 
 #include "chrome/browser/safe_browsing/protocol_manager.h"
 
-#ifndef NDEBUG
-#include "base/base64.h"
-#endif
+#include "base/bind.h"
 #include "base/environment.h"
 #include "base/logging.h"
 #include "base/metrics/histogram.h"
@@ -20,9 +18,11 @@
 #include "chrome/common/env_vars.h"
 #include "google_apis/google_api_keys.h"
 #include "net/base/escape.h"
+#include "net/base/io_buffer.h"
 #include "net/base/load_flags.h"
 #include "net/base/net_errors.h"
 #include "net/url_request/url_fetcher.h"
+#include "net/url_request/url_fetcher_response_writer.h"
 #include "net/url_request/url_request_context_getter.h"
 #include "net/url_request/url_request_status.h"
 
@@ -52,6 +52,40 @@ void RecordUpdateResult(UpdateResult result) {
   UMA_HISTOGRAM_ENUMERATION("SB2.UpdateResult", result, UPDATE_RESULT_MAX);
 }
 
+// Hands the response to a chunk request to |callback| as it arrives,
+// rather than keeping it in memory as the URLFetcher's default writer
+// does.  The callback's parser keeps only the bytes of a chunk which has
+// not fully arrived.  The callback returns what Write() does, so it may
+// hold back the rest of the response while chunks are written.
+class ChunkResponseWriter : public net::URLFetcherResponseWriter {
+ public:
+  typedef base::Callback<int(net::IOBuffer*,
+                             int,
+                             const net::CompletionCallback&)> DataCallback;
+
+  explicit ChunkResponseWriter(const DataCallback& callback)
+      : callback_(callback) {}
+  virtual ~ChunkResponseWriter() {}
+
+  // net::URLFetcherResponseWriter implementation.
+  virtual int Initialize(const net::CompletionCallback& callback) OVERRIDE {
+    return net::OK;
+  }
+  virtual int Write(net::IOBuffer* buffer,
+                    int num_bytes,
+                    const net::CompletionCallback& callback) OVERRIDE {
+    return callback_.Run(buffer, num_bytes, callback);
+  }
+  virtual int Finish(const net::CompletionCallback& callback) OVERRIDE {
+    return net::OK;
+  }
+
+ private:
+  DataCallback callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkResponseWriter);
+};
+
 }  // namespace
 
 // Minimum time, in seconds, from start up before we must issue an update query.
@@ -113,6 +147,8 @@ SafeBrowsingProtocolManager::SafeBrowsingProtocolManager(
                         kSbTimerStartIntervalSecMax))),
       update_state_(FIRST_REQUEST),
       chunk_pending_to_write_(false),
+      pending_chunk_write_bytes_(0),
+      chunk_bytes_parsed_(0),
       version_(config.version),
       update_size_(0),
       client_name_(config.client_name),
@@ -417,32 +453,21 @@ bool SafeBrowsingProtocolManager::HandleServiceResponse(const GURL& url,
                           base::Time::Now() - chunk_request_start_);
 
       const ChunkUrl chunk_url = chunk_request_urls_.front();
-      scoped_ptr<SBChunkList> chunks(new SBChunkList);
-      UMA_HISTOGRAM_COUNTS("SB2.ChunkSize", length);
-      update_size_ += length;
-      if (!parser.ParseChunk(chunk_url.list_name, data, length,
-                             chunks.get())) {
-#ifndef NDEBUG
-        std::string data_str;
-        data_str.assign(data, length);
-        std::string encoded_chunk;
-        base::Base64Encode(data_str, &encoded_chunk);
+      // The response went to |chunk_parser_| through a ChunkResponseWriter
+      // as it arrived, so the fetcher has no data for it.  A fetcher which
+      // kept the response anyway hands it over here instead.
+      DCHECK(chunk_parser_.get());
+      DCHECK(length == 0 || chunk_bytes_parsed_ == 0);
+      const bool parsed_ok =
+          ParseChunkData(data, length) && chunk_parser_->Finish();
+      UMA_HISTOGRAM_COUNTS("SB2.ChunkSize", chunk_bytes_parsed_);
+      update_size_ += chunk_bytes_parsed_;
+      if (!parsed_ok) {
+        parsed_chunks_->clear();
         VLOG(1) << "ParseChunk error for chunk: " << chunk_url.url
-                << ", Base64Encode(data): " << encoded_chunk
-                << ", length: " << length;
-#endif
+                << ", length: " << chunk_bytes_parsed_;
         return false;
       }
-
-      // Chunks to add to storage.  Pass ownership of |chunks|.
-      if (!chunks->empty()) {
-        chunk_pending_to_write_ = true;
-        delegate_->AddChunks(
-            chunk_url.list_name, chunks.release(),
-            base::Bind(&SafeBrowsingProtocolManager::OnAddChunksComplete,
-                       base::Unretained(this)));
-      }
-
       break;
     }
 
@@ -581,6 +606,14 @@ void SafeBrowsingProtocolManager::IssueChunkRequest() {
       url_fetcher_id_++, chunk_url, net::URLFetcher::GET, this));
   request_->SetLoadFlags(net::LOAD_DISABLE_CACHE);
   request_->SetRequestContext(request_context_getter_.get());
+  // |this| owns |request_|, which owns the writer.
+  request_->SaveResponseWithWriter(scoped_ptr<net::URLFetcherResponseWriter>(
+      new ChunkResponseWriter(
+          base::Bind(&SafeBrowsingProtocolManager::WriteChunkData,
+                     base::Unretained(this)))));
+  chunk_parser_.reset(new SafeBrowsingChunkStreamParser(next_chunk.list_name));
+  chunk_bytes_parsed_ = 0;
+  parsed_chunks_.reset(new SBChunkList);
   chunk_request_start_ = base::Time::Now();
   request_->Start();
 }
@@ -655,6 +688,25 @@ void SafeBrowsingProtocolManager::OnAddChunksComplete() {
   DCHECK(CalledOnValidThread());
   chunk_pending_to_write_ = false;
 
+  // The rest of the response failed to parse after these chunks were given
+  // to the database, and the update has already finished.
+  if (request_type_ != CHUNK_REQUEST)
+    return;
+
+  // Write the chunks parsed in the meantime, and wait for those too before
+  // going on.
+  WriteParsedChunks();
+  if (chunk_pending_to_write_)
+    return;
+
+  // Let the fetcher go on with the response it was held back from.
+  if (!pending_chunk_write_callback_.is_null()) {
+    net::CompletionCallback callback = pending_chunk_write_callback_;
+    pending_chunk_write_callback_.Reset();
+    callback.Run(pending_chunk_write_bytes_);
+    return;
+  }
+
   if (chunk_request_urls_.empty()) {
     UMA_HISTOGRAM_LONG_TIMES("SB2.Update", Time::Now() - last_update_);
     UpdateFinished(true);
@@ -663,6 +715,51 @@ void SafeBrowsingProtocolManager::OnAddChunksComplete() {
   }
 }
 
+int SafeBrowsingProtocolManager::WriteChunkData(
+    net::IOBuffer* buffer,
+    int num_bytes,
+    const net::CompletionCallback& callback) {
+  DCHECK(CalledOnValidThread());
+  DCHECK(pending_chunk_write_callback_.is_null());
+  ParseChunkData(buffer->data(), num_bytes);
+  if (!chunk_pending_to_write_)
+    return num_bytes;
+
+  // Read no more of the response until the database has the chunks, so that
+  // parsed chunks cannot pile up in memory.
+  pending_chunk_write_callback_ = callback;
+  pending_chunk_write_bytes_ = num_bytes;
+  return net::ERR_IO_PENDING;
+}
+
+bool SafeBrowsingProtocolManager::ParseChunkData(const char* data,
+                                                int length) {
+  DCHECK(CalledOnValidThread());
+  // The body of an error response holds no chunks; OnURLFetchComplete()
+  // backs off once it has arrived.
+  if (request_.get() && request_->GetResponseCode() != 200)
+    return false;
+  chunk_bytes_parsed_ += length;
+  if (!chunk_parser_->AppendData(data, length, parsed_chunks_.get()))
+    return false;
+  WriteParsedChunks();
+  return true;
+}
+
+void SafeBrowsingProtocolManager::WriteParsedChunks() {
+  DCHECK(CalledOnValidThread());
+  if (chunk_pending_to_write_ || parsed_chunks_->empty())
+    return;
+
+  // Chunks to add to storage.  Pass ownership of |parsed_chunks_|.
+  chunk_pending_to_write_ = true;
+  delegate_->AddChunks(
+      chunk_parser_->list_name(), parsed_chunks_.release(),
+      base::Bind(&SafeBrowsingProtocolManager::OnAddChunksComplete,
+                 base::Unretained(this)));
+  parsed_chunks_.reset(new SBChunkList);
+}
+
 // static
 std::string SafeBrowsingProtocolManager::FormatList(
     const SBListChunkRanges& list) {
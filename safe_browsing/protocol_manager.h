@@ -28,10 +28,12 @@
 #include "chrome/browser/safe_browsing/protocol_manager_helper.h"
 #include "chrome/browser/safe_browsing/protocol_parser.h"
 #include "chrome/browser/safe_browsing/safe_browsing_util.h"
+#include "net/base/completion_callback.h"
 #include "net/url_request/url_fetcher_delegate.h"
 #include "url/gurl.h"
 
 namespace net {
+class IOBuffer;
 class URLFetcher;
 class URLRequestContextGetter;
 }  // namespace net
@@ -170,6 +172,8 @@ class SafeBrowsingProtocolManager : public net::URLFetcherDelegate,
   FRIEND_TEST_ALL_PREFIXES(SafeBrowsingProtocolManagerTest,
                            TestGetHashBackOffTimes);
   FRIEND_TEST_ALL_PREFIXES(SafeBrowsingProtocolManagerTest, TestNextChunkUrl);
+  FRIEND_TEST_ALL_PREFIXES(SafeBrowsingProtocolManagerTest,
+                           StreamedChunkResponse);
   FRIEND_TEST_ALL_PREFIXES(SafeBrowsingProtocolManagerTest, TestUpdateUrl);
   friend class SafeBrowsingServerTest;
   friend class SBProtocolManagerFactoryImpl;
@@ -266,6 +270,23 @@ class SafeBrowsingProtocolManager : public net::URLFetcherDelegate,
   // Called after the chunks are added to the database.
   void OnAddChunksComplete();
 
+  // The chunk request's response writer calls this with the next
+  // |num_bytes| of the response in |buffer|, as it arrives.  Parses them and
+  // returns |num_bytes|, or net::ERR_IO_PENDING if chunks are being written
+  // to the database, in which case |callback| is run once they have been.
+  int WriteChunkData(net::IOBuffer* buffer,
+                     int num_bytes,
+                     const net::CompletionCallback& callback);
+
+  // Feeds the next piece of the current chunk response to |chunk_parser_|,
+  // and passes on the chunks it completes.  Returns 'false' on a parse error,
+  // or if the response is an error rather than chunk data.
+  bool ParseChunkData(const char* data, int length);
+
+  // Gives the parsed chunks to the database, unless the previous ones are
+  // still being written, in which case they are given once that is done.
+  void WriteParsedChunks();
+
  private:
   // Map of GetHash requests to parameters which created it.
   struct FullHashDetails {
@@ -333,6 +354,22 @@ class SafeBrowsingProtocolManager : public net::URLFetcherDelegate,
   // added to the database yet.
   bool chunk_pending_to_write_;
 
+  // The response writer's callback while it is held back by
+  // |chunk_pending_to_write_|, and the number of bytes it was given.
+  net::CompletionCallback pending_chunk_write_callback_;
+  int pending_chunk_write_bytes_;
+
+  // Parses the response to the current chunk request as it arrives, so that
+  // its chunks can be written while the rest is downloaded.
+  scoped_ptr<SafeBrowsingChunkStreamParser> chunk_parser_;
+
+  // The number of bytes of the current chunk response given to
+  // |chunk_parser_|.
+  int chunk_bytes_parsed_;
+
+  // Chunks which have been parsed but not yet given to the database.
+  scoped_ptr<SBChunkList> parsed_chunks_;
+
   // The last time we successfully received an update.
   base::Time last_update_;
 
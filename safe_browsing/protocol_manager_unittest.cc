@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 //
 
+#include "base/bind.h"
 #include "base/strings/stringprintf.h"
 #include "base/test/test_simple_task_runner.h"
 #include "base/thread_task_runner_handle.h"
@@ -10,6 +11,7 @@
 #include "chrome/browser/safe_browsing/protocol_manager.h"
 #include "google_apis/google_api_keys.h"
 #include "net/base/escape.h"
+#include "net/base/io_buffer.h"
 #include "net/base/load_flags.h"
 #include "net/base/net_errors.h"
 #include "net/url_request/test_url_fetcher_factory.h"
@@ -303,6 +305,11 @@ void HandleAddChunks(
   task_runner->PostTask(FROM_HERE, callback);
 }
 
+// Records the result a held back response write completes with.
+void SetWriteResult(int* write_result, int result) {
+  *write_result = result;
+}
+
 }  // namespace
 
 // Tests that the Update protocol will be skipped if there are problems
@@ -1069,3 +1076,99 @@ TEST_F(SafeBrowsingProtocolManagerTest, MultipleRedirectResponsesWithChunks) {
 
   EXPECT_TRUE(pm->IsUpdateScheduled());
 }
+
+// Tests that a chunk response is parsed and written as it arrives.
+TEST_F(SafeBrowsingProtocolManagerTest, StreamedChunkResponse) {
+  scoped_refptr<base::TestSimpleTaskRunner> runner(
+      new base::TestSimpleTaskRunner());
+  base::ThreadTaskRunnerHandle runner_handler(runner);
+  net::TestURLFetcherFactory url_fetcher_factory;
+
+  testing::StrictMock<MockProtocolDelegate> test_delegate;
+  testing::MockFunction<void(int)> check;
+  EXPECT_CALL(test_delegate, UpdateStarted()).Times(1);
+  EXPECT_CALL(test_delegate, GetChunks(_)).WillOnce(
+      Invoke(testing::CreateFunctor(InvokeGetChunksCallback,
+                                    std::vector<SBListChunkRanges>(),
+                                    false)));
+  {
+    testing::InSequence sequence;
+    EXPECT_CALL(test_delegate, AddChunks("goog-phish-shavar", _, _)).WillOnce(
+        Invoke(HandleAddChunks));
+    EXPECT_CALL(check, Call(1));
+    EXPECT_CALL(test_delegate, AddChunks("goog-phish-shavar", _, _)).WillOnce(
+        Invoke(HandleAddChunks));
+    EXPECT_CALL(test_delegate, UpdateFinished(true)).Times(1);
+  }
+
+  scoped_ptr<SafeBrowsingProtocolManager> pm(
+      CreateProtocolManager(&test_delegate));
+
+  // Kick off initialization. This returns chunks from the DB synchronously.
+  pm->ForceScheduleNextUpdate(TimeDelta());
+  runner->RunPendingTasks();
+
+  // The update response contains a single redirect command.
+  net::TestURLFetcher* url_fetcher = url_fetcher_factory.GetFetcherByID(0);
+  ValidateUpdateFetcherRequest(url_fetcher);
+  url_fetcher->set_status(net::URLRequestStatus());
+  url_fetcher->set_response_code(200);
+  url_fetcher->SetResponseString(
+      "i:goog-phish-shavar\n"
+      "u:redirect-server.example.com/path\n");
+  url_fetcher->delegate()->OnURLFetchComplete(url_fetcher);
+
+  // The redirect response arrives in two pieces which split a chunk.
+  net::TestURLFetcher* chunk_url_fetcher =
+      url_fetcher_factory.GetFetcherByID(1);
+  ValidateRedirectFetcherRequest(
+      chunk_url_fetcher, "https://redirect-server.example.com/path");
+  const std::string first_piece("a:4:4:9\nhost\1aaaaa:5:4");
+  const std::string second_piece(":9\nhost\1bbbb");
+  scoped_refptr<net::StringIOBuffer> first_buffer(
+      new net::StringIOBuffer(first_piece));
+  const int first_size = static_cast<int>(first_piece.size());
+  scoped_refptr<net::StringIOBuffer> second_buffer(
+      new net::StringIOBuffer(second_piece));
+  const int second_size = static_cast<int>(second_piece.size());
+  int write_result = 0;
+  const net::CompletionCallback write_callback(
+      base::Bind(&SetWriteResult, &write_result));
+
+  // The body of an error response is dropped rather than parsed.
+  chunk_url_fetcher->set_response_code(500);
+  EXPECT_EQ(first_size, pm->WriteChunkData(first_buffer.get(), first_size,
+                                           write_callback));
+  EXPECT_EQ(0U, pm->chunk_parser_->buffered_size());
+  chunk_url_fetcher->set_response_code(200);
+
+  // The response writer hands each piece to WriteChunkData(), and the
+  // fetcher keeps none of it.  The first chunk is written as soon as it is
+  // complete, and the rest of the response waits for it.
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            pm->WriteChunkData(first_buffer.get(), first_size,
+                               write_callback));
+  EXPECT_EQ(5U, pm->chunk_parser_->buffered_size());
+  check.Call(1);
+
+  // Invoke the AddChunksCallback for the first chunk, which lets the
+  // response go on.
+  runner->RunPendingTasks();
+  EXPECT_EQ(first_size, write_result);
+
+  // The second chunk holds the response back in turn.
+  write_result = 0;
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            pm->WriteChunkData(second_buffer.get(), second_size,
+                               write_callback));
+  EXPECT_EQ(0U, pm->chunk_parser_->buffered_size());
+  runner->RunPendingTasks();
+  EXPECT_EQ(second_size, write_result);
+  EXPECT_FALSE(pm->IsUpdateScheduled());
+
+  // All of it has been written once the response is complete, which
+  // finishes the update.
+  chunk_url_fetcher->set_status(net::URLRequestStatus());
+  chunk_url_fetcher->delegate()->OnURLFetchComplete(chunk_url_fetcher);
+  EXPECT_TRUE(pm->IsUpdateScheduled());
+}
@@ -6,6 +6,8 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
+
 #include "base/format_macros.h"
 #include "base/logging.h"
 #include "base/strings/string_split.h"
@@ -33,8 +35,31 @@ bool GetLine(const char* input, int input_len, std::string* line) {
   }
   return false;
 }
+
+// Chunk headers are short, so a longer line is not one, and need not be
+// buffered until the response ends to find that out.
+const int kMaxChunkHeaderLength = 128;
+
+// Returns the size, header included, of the chunk at the start of |data|,
+// 0 if its header is not all there, or -1 if the header is bad.
+int ChunkSize(const char* data, int length) {
+  std::string header;
+  if (!GetLine(data, length, &header))
+    return length > kMaxChunkHeaderLength ? -1 : 0;
+
+  std::vector<std::string> header_parts;
+  base::SplitString(header, ':', &header_parts);
+  if (header_parts.size() != 4)
+    return -1;
+  const int header_len = static_cast<int>(header.length()) + 1;
+  const int chunk_len = atoi(header_parts[3].c_str());
+  if (chunk_len < 0 || chunk_len > kint32max - header_len)
+    return -1;
+  return header_len + chunk_len;
 }
 
+}  // namespace
+
 //------------------------------------------------------------------------------
 // SafeBrowsingParser implementation
 
@@ -418,3 +443,80 @@ bool SafeBrowsingProtocolParser::ReadPrefixes(
 
   return true;
 }
+
+//------------------------------------------------------------------------------
+// SafeBrowsingChunkStreamParser implementation
+
+SafeBrowsingChunkStreamParser::SafeBrowsingChunkStreamParser(
+    const std::string& list_name)
+    : list_name_(list_name),
+      chunk_size_(0),
+      failed_(false) {
+}
+
+SafeBrowsingChunkStreamParser::~SafeBrowsingChunkStreamParser() {
+}
+
+bool SafeBrowsingChunkStreamParser::AppendData(const char* data,
+                                               int length,
+                                               SBChunkList* chunks) {
+  while (!failed_ && length > 0) {
+    int used;
+    if (buffer_.empty()) {
+      // Parse chunks which arrived whole straight from |data|, and only
+      // copy the start of one which did not.
+      const int size = ChunkSize(data, length);
+      if (size < 0)
+        return Fail();
+      if (size > 0 && size <= length) {
+        if (!parser_.ParseChunk(list_name_, data, size, chunks))
+          return Fail();
+      } else {
+        buffer_.assign(data, length);
+        chunk_size_ = size;
+      }
+      used = size > 0 ? std::min(size, length) : length;
+    } else {
+      if (chunk_size_ == 0) {
+        // Take only the rest of the header, so that its size is known.
+        const char* newline =
+            static_cast<const char*>(memchr(data, '\n', length));
+        used = newline ? static_cast<int>(newline - data) + 1 : length;
+        buffer_.append(data, used);
+        const int size =
+            ChunkSize(buffer_.data(), static_cast<int>(buffer_.size()));
+        if (size < 0)
+          return Fail();
+        chunk_size_ = size;
+      } else {
+        used = static_cast<int>(
+            std::min(chunk_size_ - buffer_.size(),
+                     static_cast<size_t>(length)));
+        buffer_.append(data, used);
+      }
+
+      if (chunk_size_ > 0 && buffer_.size() == chunk_size_) {
+        if (!parser_.ParseChunk(list_name_, buffer_.data(),
+                                static_cast<int>(buffer_.size()), chunks)) {
+          return Fail();
+        }
+        buffer_.clear();
+        chunk_size_ = 0;
+      }
+    }
+    data += used;
+    length -= used;
+  }
+  return !failed_;
+}
+
+bool SafeBrowsingChunkStreamParser::Finish() const {
+  return !failed_ && buffer_.empty();
+}
+
+bool SafeBrowsingChunkStreamParser::Fail() {
+  failed_ = true;
+  buffer_.clear();
+  chunk_size_ = 0;
+  return false;
+}
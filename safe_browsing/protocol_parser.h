@@ -110,5 +110,47 @@ class SafeBrowsingProtocolParser {
   DISALLOW_COPY_AND_ASSIGN(SafeBrowsingProtocolParser);
 };
 
+// Parses the response from a chunk URL request as it arrives, rather than
+// after all of it has been received.  Only the chunk currently arriving is
+// buffered, and each chunk is parsed as soon as its last byte is in, so the
+// caller can pass chunks on to storage while the rest of the response is
+// still being downloaded.
+class SafeBrowsingChunkStreamParser {
+ public:
+  explicit SafeBrowsingChunkStreamParser(const std::string& list_name);
+  ~SafeBrowsingChunkStreamParser();
+
+  // Consumes the next |length| bytes of the response, appending the chunks
+  // they complete to |chunks|.  Returns 'false' on a parse error, after which
+  // all further data is rejected and the results should be ignored.
+  bool AppendData(const char* data, int length, SBChunkList* chunks);
+
+  // Returns 'true' if the data so far parsed and ended on a chunk boundary,
+  // as a complete response must.
+  bool Finish() const;
+
+  const std::string& list_name() const { return list_name_; }
+
+  // Bytes of the current chunk which have been received but not parsed.
+  size_t buffered_size() const { return buffer_.size(); }
+
+ private:
+  bool Fail();
+
+  const std::string list_name_;
+  SafeBrowsingProtocolParser parser_;
+
+  // The header and data received so far of a chunk that is not complete.
+  std::string buffer_;
+
+  // The size of the chunk in |buffer_|, header included, or 0 until its
+  // header is complete.
+  size_t chunk_size_;
+
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(SafeBrowsingChunkStreamParser);
+};
+
 
 #endif  // CHROME_BROWSER_SAFE_BROWSING_PROTOCOL_PARSER_H_
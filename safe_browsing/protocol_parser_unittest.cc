@@ -4,6 +4,8 @@
 //
 // Program to test the SafeBrowsing protocol parsing v2.1.
 
+#include <algorithm>
+
 #include "base/strings/stringprintf.h"
 #include "chrome/browser/safe_browsing/protocol_parser.h"
 #include "chrome/browser/safe_browsing/safe_browsing_util.h"
@@ -782,3 +784,85 @@ TEST(SafeBrowsingProtocolParsingTest, TestSubDownloadWhitelistChunk) {
   memcpy(full.full_hash, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", 32);
   EXPECT_TRUE(entry->FullHashAt(0) == full);
 }
+
+// Test that streaming a response in pieces of every size gives the same
+// chunks as parsing it whole.
+TEST(SafeBrowsingProtocolParsingTest, TestStreamChunks) {
+  std::string add_chunks("a:1:4:35\naaaax1111\0032222333344447777\00288889999"
+                         "a:2:4:0\n"
+                         "s:3:4:13\nhhhh\001");
+  add_chunks[13] = '\0';
+  const char add_chunk_id[] = { 0, 0, 0, 2 };
+  add_chunks.append(add_chunk_id, sizeof(add_chunk_id));
+  add_chunks.append("jjjj");
+  const int length = static_cast<int>(add_chunks.length());
+
+  for (int piece = 1; piece <= length; ++piece) {
+    SafeBrowsingChunkStreamParser parser(safe_browsing_util::kMalwareList);
+    SBChunkList chunks;
+    for (int offset = 0; offset < length; offset += piece) {
+      EXPECT_TRUE(parser.AppendData(add_chunks.data() + offset,
+                                    std::min(piece, length - offset),
+                                    &chunks));
+      // Only the chunk in progress is held.
+      EXPECT_LE(parser.buffered_size(), 44U);
+    }
+    EXPECT_TRUE(parser.Finish());
+    EXPECT_EQ(0U, parser.buffered_size());
+
+    ASSERT_EQ(3U, chunks.size());
+    EXPECT_EQ(1, chunks[0].chunk_number);
+    EXPECT_TRUE(chunks[0].is_add);
+    ASSERT_EQ(3U, chunks[0].hosts.size());
+    EXPECT_EQ(0x37373737, chunks[0].hosts[2].host);
+    EXPECT_EQ(0x39393939, chunks[0].hosts[2].entry->PrefixAt(1));
+
+    EXPECT_EQ(2, chunks[1].chunk_number);
+    EXPECT_TRUE(chunks[1].hosts.empty());
+
+    EXPECT_EQ(3, chunks[2].chunk_number);
+    EXPECT_FALSE(chunks[2].is_add);
+    ASSERT_EQ(1U, chunks[2].hosts.size());
+    EXPECT_EQ(0x68686868, chunks[2].hosts[0].host);
+    SBEntry* entry = chunks[2].hosts[0].entry;
+    EXPECT_TRUE(entry->IsSub());
+    ASSERT_EQ(1, entry->prefix_count());
+    EXPECT_EQ(0x6a6a6a6a, entry->PrefixAt(0));
+    EXPECT_EQ(2, entry->ChunkIdAtPrefix(0));
+  }
+}
+
+// Test that a stream which stops inside a chunk is not complete, and that
+// a bad chunk stops the stream.
+TEST(SafeBrowsingProtocolParsingTest, TestStreamErrors) {
+  const std::string truncated("a:1:4:0\na:2:4:");
+  SafeBrowsingChunkStreamParser parser(safe_browsing_util::kMalwareList);
+  SBChunkList chunks;
+  EXPECT_TRUE(parser.AppendData(truncated.data(),
+                                static_cast<int>(truncated.length()),
+                                &chunks));
+  EXPECT_EQ(1U, chunks.size());
+  EXPECT_FALSE(parser.Finish());
+
+  // This chunk delares there are 4 prefixes but actually only contains 2.
+  const std::string bad_chunk("a:1:4:10\naaaa\00411112");
+  const std::string good_chunk("a:2:4:0\n");
+  SafeBrowsingChunkStreamParser bad_parser(safe_browsing_util::kMalwareList);
+  chunks.clear();
+  EXPECT_FALSE(bad_parser.AppendData(bad_chunk.data(),
+                                     static_cast<int>(bad_chunk.length()),
+                                     &chunks));
+  EXPECT_FALSE(bad_parser.AppendData(good_chunk.data(),
+                                     static_cast<int>(good_chunk.length()),
+                                     &chunks));
+  EXPECT_FALSE(bad_parser.Finish());
+
+  // A header line that never ends is rejected before the response does.
+  SafeBrowsingChunkStreamParser garbage_parser(
+      safe_browsing_util::kMalwareList);
+  const std::string garbage(1024, 'x');
+  EXPECT_FALSE(garbage_parser.AppendData(garbage.data(),
+                                         static_cast<int>(garbage.length()),
+                                         &chunks));
+  EXPECT_EQ(0U, garbage_parser.buffered_size());
+}
@@ -61,6 +61,10 @@ const base::FilePath::CharType kBrowseDBFile[] = FILE_PATH_LITERAL(" Bloom");
 // The maximum staleness for a cached entry.
 const int kMaxStalenessMinutes = 45;
 
+// Memory budget for cached GetHash results.  Most lookups never reach
+// GetHash, so this holds a few thousand prefixes' worth.
+const size_t kFullHashCacheBytes = 256 * 1024;
+
 // Maximum number of entries we allow in any of the whitelists.
 // If a whitelist on disk contains more entries then all lookups to
 // the whitelist will be considered a match.
@@ -447,6 +451,7 @@ void SafeBrowsingDatabase::RecordFailure(FailureType failure_type) {
 SafeBrowsingDatabaseNew::SafeBrowsingDatabaseNew()
     : creation_loop_(base::MessageLoop::current()),
       browse_store_(new SafeBrowsingStoreFile),
+      full_hash_cache_(kFullHashCacheBytes),
       reset_factory_(this),
       corruption_detected_(false),
       change_detected_(false) {
@@ -472,6 +477,7 @@ SafeBrowsingDatabaseNew::SafeBrowsingDatabaseNew(
       download_whitelist_store_(download_whitelist_store),
       extension_blacklist_store_(extension_blacklist_store),
       side_effect_free_whitelist_store_(side_effect_free_whitelist_store),
+      full_hash_cache_(kFullHashCacheBytes),
       reset_factory_(this),
       corruption_detected_(false) {
   DCHECK(browse_store_.get());
@@ -507,7 +513,7 @@ void SafeBrowsingDatabaseNew::Init(const base::FilePath& filename_base) {
     // contention on the lock...
     base::AutoLock locked(lookup_lock_);
     full_browse_hashes_.clear();
-    pending_browse_hashes_.clear();
+    full_hash_cache_.Clear();
     LoadPrefixSet();
   }
 
@@ -614,8 +620,7 @@ bool SafeBrowsingDatabaseNew::ResetDatabase() {
   {
     base::AutoLock locked(lookup_lock_);
     full_browse_hashes_.clear();
-    pending_browse_hashes_.clear();
-    prefix_miss_cache_.clear();
+    full_hash_cache_.Clear();
     browse_prefix_set_.reset();
     side_effect_free_whitelist_prefix_set_.reset();
   }
@@ -643,6 +648,11 @@ bool SafeBrowsingDatabaseNew::ContainsBrowseUrl(
   if (full_hashes.empty())
     return false;
 
+  std::vector<SBPrefix> prefixes;
+  prefixes.reserve(full_hashes.size());
+  for (size_t i = 0; i < full_hashes.size(); ++i)
+    prefixes.push_back(full_hashes[i].prefix);
+
   // This function is called on the I/O thread, prevent changes to
   // filter and caches.
   base::AutoLock locked(lookup_lock_);
@@ -653,13 +663,16 @@ bool SafeBrowsingDatabaseNew::ContainsBrowseUrl(
   if (!browse_prefix_set_.get())
     return false;
 
+  browse_prefix_set_->ExistsMany(prefixes, prefix_hits);
+
+  // Collect the full hashes cached from GetHash requests.
+  const base::Time now = base::Time::Now();
+  std::vector<SBFullHashResult> cached_hits;
   size_t miss_count = 0;
-  for (size_t i = 0; i < full_hashes.size(); ++i) {
-    const SBPrefix prefix = full_hashes[i].prefix;
-    if (browse_prefix_set_->Exists(prefix)) {
-      prefix_hits->push_back(prefix);
-      if (prefix_miss_cache_.count(prefix) > 0)
-        ++miss_count;
+  for (size_t i = 0; i < prefix_hits->size(); ++i) {
+    if (full_hash_cache_.Lookup((*prefix_hits)[i], now, &cached_hits) ==
+        safe_browsing::FullHashCache::CACHED_MISS) {
+      ++miss_count;
     }
   }
 
@@ -667,15 +680,66 @@ bool SafeBrowsingDatabaseNew::ContainsBrowseUrl(
   if (miss_count == prefix_hits->size())
     return false;
 
-  // Find the matching full-hash results.  |full_browse_hashes_| are from the
-  // database, |pending_browse_hashes_| are from GetHash requests between
-  // updates.
+  // Find the matching full-hash results from the database.
   std::sort(prefix_hits->begin(), prefix_hits->end());
 
   GetCachedFullHashesForBrowse(*prefix_hits, full_browse_hashes_,
                                full_hits, last_update);
-  GetCachedFullHashesForBrowse(*prefix_hits, pending_browse_hashes_,
+  full_hits->insert(full_hits->end(), cached_hits.begin(), cached_hits.end());
+  return true;
+}
+
+bool SafeBrowsingDatabaseNew::ContainsBrowseUrls(
+    const std::vector<GURL>& urls,
+    std::vector<SBPrefix>* prefix_hits,
+    std::vector<SBFullHashResult>* full_hits,
+    base::Time last_update) {
+  prefix_hits->clear();
+  full_hits->clear();
+
+  // Hosts and paths repeat a lot across the URLs of a redirect chain or a
+  // page's resources, so only look up each prefix once.
+  std::vector<SBFullHash> full_hashes;
+  for (size_t i = 0; i < urls.size(); ++i)
+    BrowseFullHashesToCheck(urls[i], false, &full_hashes);
+  if (full_hashes.empty())
+    return false;
+
+  std::vector<SBPrefix> prefixes;
+  prefixes.reserve(full_hashes.size());
+  for (size_t i = 0; i < full_hashes.size(); ++i)
+    prefixes.push_back(full_hashes[i].prefix);
+  std::sort(prefixes.begin(), prefixes.end());
+  prefixes.erase(std::unique(prefixes.begin(), prefixes.end()),
+                 prefixes.end());
+
+  // This function is called on the I/O thread, prevent changes to
+  // filter and caches.
+  base::AutoLock locked(lookup_lock_);
+
+  if (!browse_prefix_set_.get())
+    return false;
+
+  std::vector<SBPrefix> hits;
+  browse_prefix_set_->ExistsMany(prefixes, &hits);
+
+  // Unlike ContainsBrowseUrl(), drop the cached misses one by one, so that
+  // a hit for one URL does not send the other URLs' misses to GetHash again.
+  const base::Time now = base::Time::Now();
+  std::vector<SBFullHashResult> cached_hits;
+  for (size_t i = 0; i < hits.size(); ++i) {
+    if (full_hash_cache_.Lookup(hits[i], now, &cached_hits) !=
+        safe_browsing::FullHashCache::CACHED_MISS) {
+      prefix_hits->push_back(hits[i]);
+    }
+  }
+  if (prefix_hits->empty())
+    return false;
+
+  // |prefix_hits| is sorted, since |prefixes| was.
+  GetCachedFullHashesForBrowse(*prefix_hits, full_browse_hashes_,
                                full_hits, last_update);
+  full_hits->insert(full_hits->end(), cached_hits.begin(), cached_hits.end());
   return true;
 }
 
@@ -798,18 +862,24 @@ void SafeBrowsingDatabaseNew::InsertAdd(int chunk_id, SBPrefix host,
   STATS_COUNTER("SB.HostInsert", 1);
   const int encoded_chunk_id = EncodeChunkId(chunk_id, list_id);
   const int count = entry->prefix_count();
+  std::set<SBPrefix>* touched_prefixes =
+      store == browse_store_.get() ? &browse_update_prefixes_ : NULL;
 
   DCHECK(!entry->IsSub());
   if (!count) {
     // No prefixes, use host instead.
     STATS_COUNTER("SB.PrefixAdd", 1);
     store->WriteAddPrefix(encoded_chunk_id, host);
+    if (touched_prefixes)
+      touched_prefixes->insert(host);
   } else if (entry->IsPrefix()) {
     // Prefixes only.
     for (int i = 0; i < count; i++) {
       const SBPrefix prefix = entry->PrefixAt(i);
       STATS_COUNTER("SB.PrefixAdd", 1);
       store->WriteAddPrefix(encoded_chunk_id, prefix);
+      if (touched_prefixes)
+        touched_prefixes->insert(prefix);
     }
   } else {
     // Prefixes and hashes.
@@ -820,6 +890,8 @@ void SafeBrowsingDatabaseNew::InsertAdd(int chunk_id, SBPrefix host,
 
       STATS_COUNTER("SB.PrefixAdd", 1);
       store->WriteAddPrefix(encoded_chunk_id, prefix);
+      if (touched_prefixes)
+        touched_prefixes->insert(prefix);
 
       STATS_COUNTER("SB.PrefixAddFull", 1);
       store->WriteAddHash(encoded_chunk_id, receive_time, full_hash);
@@ -869,6 +941,8 @@ void SafeBrowsingDatabaseNew::InsertSub(int chunk_id, SBPrefix host,
   STATS_COUNTER("SB.HostDelete", 1);
   const int encoded_chunk_id = EncodeChunkId(chunk_id, list_id);
   const int count = entry->prefix_count();
+  std::set<SBPrefix>* touched_prefixes =
+      store == browse_store_.get() ? &browse_update_prefixes_ : NULL;
 
   DCHECK(entry->IsSub());
   if (!count) {
@@ -876,6 +950,8 @@ void SafeBrowsingDatabaseNew::InsertSub(int chunk_id, SBPrefix host,
     STATS_COUNTER("SB.PrefixSub", 1);
     const int add_chunk_id = EncodeChunkId(entry->chunk_id(), list_id);
     store->WriteSubPrefix(encoded_chunk_id, add_chunk_id, host);
+    if (touched_prefixes)
+      touched_prefixes->insert(host);
   } else if (entry->IsPrefix()) {
     // Prefixes only.
     for (int i = 0; i < count; i++) {
@@ -885,6 +961,8 @@ void SafeBrowsingDatabaseNew::InsertSub(int chunk_id, SBPrefix host,
 
       STATS_COUNTER("SB.PrefixSub", 1);
       store->WriteSubPrefix(encoded_chunk_id, add_chunk_id, prefix);
+      if (touched_prefixes)
+        touched_prefixes->insert(prefix);
     }
   } else {
     // Prefixes and hashes.
@@ -895,6 +973,8 @@ void SafeBrowsingDatabaseNew::InsertSub(int chunk_id, SBPrefix host,
 
       STATS_COUNTER("SB.PrefixSub", 1);
       store->WriteSubPrefix(encoded_chunk_id, add_chunk_id, full_hash.prefix);
+      if (touched_prefixes)
+        touched_prefixes->insert(full_hash.prefix);
 
       STATS_COUNTER("SB.PrefixSubFull", 1);
       store->WriteSubHash(encoded_chunk_id, add_chunk_id, full_hash);
@@ -991,36 +1071,25 @@ void SafeBrowsingDatabaseNew::DeleteChunks(
 void SafeBrowsingDatabaseNew::CacheHashResults(
     const std::vector<SBPrefix>& prefixes,
     const std::vector<SBFullHashResult>& full_hits) {
-  // This is called on the I/O thread, lock against updates.
-  base::AutoLock locked(lookup_lock_);
-
-  if (full_hits.empty()) {
-    prefix_miss_cache_.insert(prefixes.begin(), prefixes.end());
-    return;
-  }
-
-  // TODO(shess): SBFullHashResult and SBAddFullHash are very similar.
-  // Refactor to make them identical.
-  const base::Time now = base::Time::Now();
-  const size_t orig_size = pending_browse_hashes_.size();
+  // Only the browse lists are looked up through the cache.
+  std::vector<SBFullHashResult> browse_hits;
   for (std::vector<SBFullHashResult>::const_iterator iter = full_hits.begin();
        iter != full_hits.end(); ++iter) {
     const int list_id = safe_browsing_util::GetListId(iter->list_name);
     if (list_id == safe_browsing_util::MALWARE ||
         list_id == safe_browsing_util::PHISH) {
-      int encoded_chunk_id = EncodeChunkId(iter->add_chunk_id, list_id);
-      SBAddFullHash add_full_hash(encoded_chunk_id, now, iter->hash);
-      pending_browse_hashes_.push_back(add_full_hash);
+      browse_hits.push_back(*iter);
     }
   }
 
-  // Sort new entries then merge with the previously-sorted entries.
-  std::vector<SBAddFullHash>::iterator
-      orig_end = pending_browse_hashes_.begin() + orig_size;
-  std::sort(orig_end, pending_browse_hashes_.end(), SBAddFullHashPrefixLess);
-  std::inplace_merge(pending_browse_hashes_.begin(),
-                     orig_end, pending_browse_hashes_.end(),
-                     SBAddFullHashPrefixLess);
+  // Results only for other lists, such as a download check's, say nothing
+  // about the browse lists.
+  if (!full_hits.empty() && browse_hits.empty())
+    return;
+
+  // This is called on the I/O thread, lock against updates.
+  base::AutoLock locked(lookup_lock_);
+  full_hash_cache_.Insert(prefixes, browse_hits, base::Time::Now());
 }
 
 bool SafeBrowsingDatabaseNew::UpdateStarted(
@@ -1133,6 +1202,7 @@ bool SafeBrowsingDatabaseNew::UpdateStarted(
 
   corruption_detected_ = false;
   change_detected_ = false;
+  browse_update_prefixes_.clear();
   return true;
 }
 
@@ -1288,15 +1358,10 @@ int64 SafeBrowsingDatabaseNew::UpdateHashPrefixStore(
 }
 
 void SafeBrowsingDatabaseNew::UpdateBrowseStore() {
-  // Copy out the pending add hashes.  Copy rather than swapping in
-  // case |ContainsBrowseURL()| is called before the new filter is complete.
-  std::vector<SBAddFullHash> pending_add_hashes;
-  {
-    base::AutoLock locked(lookup_lock_);
-    pending_add_hashes.insert(pending_add_hashes.end(),
-                              pending_browse_hashes_.begin(),
-                              pending_browse_hashes_.end());
-  }
+  // GetHash results stay in |full_hash_cache_| rather than going to the
+  // store.
+  std::vector<SBAddFullHash> empty_add_hashes;
+  std::set<SBPrefix> empty_miss_cache;
 
   // Measure the amount of IO during the filter build.
   base::IoCounters io_before, io_after;
@@ -1319,7 +1384,7 @@ void SafeBrowsingDatabaseNew::UpdateBrowseStore() {
 
   SBAddPrefixes add_prefixes;
   std::vector<SBAddFullHash> add_full_hashes;
-  if (!browse_store_->FinishUpdate(pending_add_hashes, prefix_miss_cache_,
+  if (!browse_store_->FinishUpdate(empty_add_hashes, empty_miss_cache,
                                    &add_prefixes, &add_full_hashes)) {
     RecordFailure(FAILURE_BROWSE_DATABASE_UPDATE_FINISH);
     return;
@@ -1345,19 +1410,22 @@ void SafeBrowsingDatabaseNew::UpdateBrowseStore() {
             SBAddFullHashPrefixLess);
 
   // Swap in the newly built filter and cache.
+  size_t cache_entries = 0;
   {
     base::AutoLock locked(lookup_lock_);
     full_browse_hashes_.swap(add_full_hashes);
-
-    // TODO(shess): If |CacheHashResults()| is posted between the
-    // earlier lock and this clear, those pending hashes will be lost.
-    // It could be fixed by only removing hashes which were collected
-    // at the earlier point.  I believe that is fail-safe as-is (the
-    // hash will be fetched again).
-    pending_browse_hashes_.clear();
-    prefix_miss_cache_.clear();
     browse_prefix_set_.swap(prefix_set);
+
+    // Cached results for prefixes the update removed are of no use,
+    // and those for prefixes it added or subbed items for may be
+    // stale.
+    full_hash_cache_.RemoveUnlisted(*browse_prefix_set_);
+    full_hash_cache_.RemovePrefixes(browse_update_prefixes_);
+    cache_entries = full_hash_cache_.size();
   }
+  browse_update_prefixes_.clear();
+
+  UMA_HISTOGRAM_COUNTS("SB2.FullHashCacheEntries", cache_entries);
 
   DVLOG(1) << "SafeBrowsingDatabaseImpl built prefix set in "
            << (base::TimeTicks::Now() - before).InMilliseconds()
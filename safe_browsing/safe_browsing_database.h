@@ -14,6 +14,7 @@
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/weak_ptr.h"
 #include "base/synchronization/lock.h"
+#include "chrome/browser/safe_browsing/full_hash_cache.h"
 #include "chrome/browser/safe_browsing/safe_browsing_store.h"
 
 namespace base {
@@ -98,6 +99,17 @@ class SafeBrowsingDatabase {
                                  std::vector<SBFullHashResult>* full_hits,
                                  base::Time last_update) = 0;
 
+  // Like ContainsBrowseUrl(), but checks all of |urls| with one pass over
+  // the browse filter.  Returns false if none of |urls| are in the browse
+  // database.  Otherwise |prefix_hits| holds the distinct matching prefixes,
+  // in ascending order and leaving out cached GetHash misses, and
+  // |full_hits| holds the cached full hashes for them.  This function is
+  // safe to call from threads other than the creation thread.
+  virtual bool ContainsBrowseUrls(const std::vector<GURL>& urls,
+                                  std::vector<SBPrefix>* prefix_hits,
+                                  std::vector<SBFullHashResult>* full_hits,
+                                  base::Time last_update) = 0;
+
   // Returns false if none of |urls| are in Download database. If it returns
   // true, |prefix_hits| should contain the prefixes for the URLs that were in
   // the database.  This function could ONLY be accessed from creation thread.
@@ -280,6 +292,10 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
                                  std::vector<SBPrefix>* prefix_hits,
                                  std::vector<SBFullHashResult>* full_hits,
                                  base::Time last_update) OVERRIDE;
+  virtual bool ContainsBrowseUrls(const std::vector<GURL>& urls,
+                                  std::vector<SBPrefix>* prefix_hits,
+                                  std::vector<SBFullHashResult>* full_hits,
+                                  base::Time last_update) OVERRIDE;
   virtual bool ContainsDownloadUrl(const std::vector<GURL>& urls,
                                    std::vector<SBPrefix>* prefix_hits) OVERRIDE;
   virtual bool ContainsDownloadHashPrefix(const SBPrefix& prefix) OVERRIDE;
@@ -375,7 +391,7 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
 
   // Lock for protecting access to variables that may be used on the
   // IO thread.  This includes |prefix_set_|, |full_browse_hashes_|,
-  // |pending_browse_hashes_|, |prefix_miss_cache_|, |csd_whitelist_|.
+  // |full_hash_cache_|, |csd_whitelist_|.
   base::Lock lookup_lock_;
 
   // Underlying persistent store for chunk data.
@@ -409,18 +425,20 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   SBWhitelist download_whitelist_;
   SBWhitelist extension_blacklist_;
 
-  // Cached browse store related full-hash items, ordered by prefix for
+  // Full-hash items from |browse_store_|, ordered by prefix for
   // efficient scanning.
-  // |full_browse_hashes_| are items from |browse_store_|,
-  // |pending_browse_hashes_| are items from |CacheHashResults()|, which
-  // will be pushed to the store on the next update.
   std::vector<SBAddFullHash> full_browse_hashes_;
-  std::vector<SBAddFullHash> pending_browse_hashes_;
 
-  // Cache of prefixes that returned empty results (no full hash
-  // match) to |CacheHashResults()|.  Cached to prevent asking for
-  // them every time.  Cleared on next update.
-  std::set<SBPrefix> prefix_miss_cache_;
+  // Results of GetHash requests passed to |CacheHashResults()|, both
+  // full hashes and prefixes with none.  Unlike |full_browse_hashes_|,
+  // these are kept across updates until they expire or are evicted.
+  safe_browsing::FullHashCache full_hash_cache_;
+
+  // Prefixes which the add and sub chunks of the current update write
+  // to |browse_store_|.  The server's full hashes for them may have
+  // changed, so their |full_hash_cache_| entries are dropped when the
+  // update is applied.
+  std::set<SBPrefix> browse_update_prefixes_;
 
   // Used to schedule resetting the database because of corruption.
   base::WeakPtrFactory<SafeBrowsingDatabaseNew> reset_factory_;
@@ -4,6 +4,9 @@
 //
 // Unit tests for the SafeBrowsing storage system.
 
+#include <algorithm>
+#include <set>
+
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/logging.h"
@@ -852,7 +855,7 @@ TEST_F(SafeBrowsingDatabaseTest, HashCaching) {
   PopulateDatabaseForCacheTest();
 
   // We should have both full hashes in the cache.
-  EXPECT_EQ(database_->pending_browse_hashes_.size(), 2U);
+  EXPECT_EQ(database_->full_hash_cache_.size(), 2U);
 
   // Test the cache lookup for the first prefix.
   std::string listname;
@@ -919,30 +922,26 @@ TEST_F(SafeBrowsingDatabaseTest, HashCaching) {
       &listname, &prefixes, &full_hashes, Time::Now());
   EXPECT_TRUE(full_hashes.empty());
   EXPECT_TRUE(database_->full_browse_hashes_.empty());
-  EXPECT_TRUE(database_->pending_browse_hashes_.empty());
+  EXPECT_EQ(database_->full_hash_cache_.size(), 0U);
 
   prefixes.clear();
   full_hashes.clear();
 
-  // Test that the cache won't return expired values. First we have to adjust
-  // the cached entries' received time to make them older, since the database
-  // cache insert uses Time::Now(). First, store some entries.
+  // Test that the cache won't return expired values. First, store some
+  // entries, then replace one of them with a copy received long enough ago
+  // to have expired, since the database cache insert uses Time::Now().
   PopulateDatabaseForCacheTest();
+  EXPECT_EQ(database_->full_hash_cache_.size(), 2U);
 
-  std::vector<SBAddFullHash>* hash_cache = &database_->pending_browse_hashes_;
-  EXPECT_EQ(hash_cache->size(), 2U);
-
-  // Now adjust one of the entries times to be in the past.
   base::Time expired = base::Time::Now() - base::TimeDelta::FromMinutes(60);
-  const SBPrefix key = Sha256Prefix("www.evil.com/malware.html");
-  std::vector<SBAddFullHash>::iterator iter;
-  for (iter = hash_cache->begin(); iter != hash_cache->end(); ++iter) {
-    if (iter->full_hash.prefix == key) {
-      iter->received = static_cast<int32>(expired.ToTimeT());
-      break;
-    }
-  }
-  EXPECT_TRUE(iter != hash_cache->end());
+  SBFullHashResult expired_hash;
+  expired_hash.hash = Sha256Hash("www.evil.com/malware.html");
+  expired_hash.list_name = safe_browsing_util::kMalwareList;
+  expired_hash.add_chunk_id = 1;
+  database_->full_hash_cache_.Insert(
+      std::vector<SBPrefix>(),
+      std::vector<SBFullHashResult>(1, expired_hash),
+      expired);
 
   database_->ContainsBrowseUrl(
       GURL("http://www.evil.com/malware.html"),
@@ -970,13 +969,22 @@ TEST_F(SafeBrowsingDatabaseTest, HashCaching) {
   database_->CacheHashResults(prefix_misses, empty_full_hash);
 
   // Prefixes with no full results are misses.
-  EXPECT_EQ(database_->prefix_miss_cache_.size(), 2U);
+  std::vector<SBFullHashResult> cached_hits;
+  for (size_t i = 0; i < prefix_misses.size(); ++i) {
+    EXPECT_EQ(FullHashCache::CACHED_MISS,
+              database_->full_hash_cache_.Lookup(prefix_misses[i], Time::Now(),
+                                                 &cached_hits));
+  }
 
   // Update the database.
   PopulateDatabaseForCacheTest();
 
-  // Prefix miss cache should be cleared.
-  EXPECT_TRUE(database_->prefix_miss_cache_.empty());
+  // The misses should be dropped, since their prefixes are not listed.
+  for (size_t i = 0; i < prefix_misses.size(); ++i) {
+    EXPECT_EQ(FullHashCache::NOT_CACHED,
+              database_->full_hash_cache_.Lookup(prefix_misses[i], Time::Now(),
+                                                 &cached_hits));
+  }
 
   // Cache a GetHash miss for a particular prefix, and even though the prefix is
   // in the database, it is flagged as a miss so looking up the associated URL
@@ -1069,6 +1077,125 @@ TEST_F(SafeBrowsingDatabaseTest, HashCaching) {
       Time::Now()));
 }
 
+// Test that cached GetHash results outlive updates which keep their prefix.
+TEST_F(SafeBrowsingDatabaseTest, HashCachingAcrossUpdates) {
+  PopulateDatabaseForCacheTest();
+
+  SBChunkList chunks;
+  SBChunk chunk;
+  InsertAddChunkHostPrefixUrl(&chunk, 2, "www.other.com/",
+                              "www.other.com/malware.html");
+  chunks.push_back(chunk);
+  std::vector<SBListChunkRanges> lists;
+  EXPECT_TRUE(database_->UpdateStarted(&lists));
+  database_->InsertChunks(safe_browsing_util::kMalwareList, chunks);
+  database_->UpdateFinished(true);
+
+  std::string listname;
+  std::vector<SBPrefix> prefixes;
+  std::vector<SBFullHashResult> full_hashes;
+  EXPECT_TRUE(database_->ContainsBrowseUrl(
+      GURL("http://www.evil.com/phishing.html"),
+      &listname, &prefixes, &full_hashes, Time::Now()));
+  ASSERT_EQ(full_hashes.size(), 1U);
+  EXPECT_TRUE(SBFullHashEq(full_hashes[0].hash,
+                           Sha256Hash("www.evil.com/phishing.html")));
+
+  // So do misses.
+  database_->CacheHashResults(
+      std::vector<SBPrefix>(1, Sha256Prefix("www.other.com/malware.html")),
+      std::vector<SBFullHashResult>());
+  chunk.hosts.clear();
+  InsertAddChunkHostPrefixUrl(&chunk, 3, "www.another.com/",
+                              "www.another.com/malware.html");
+  chunks.clear();
+  chunks.push_back(chunk);
+  EXPECT_TRUE(database_->UpdateStarted(&lists));
+  database_->InsertChunks(safe_browsing_util::kMalwareList, chunks);
+  database_->UpdateFinished(true);
+  EXPECT_FALSE(database_->ContainsBrowseUrl(
+      GURL("http://www.other.com/malware.html"),
+      &listname, &prefixes, &full_hashes, Time::Now()));
+
+  // An update which adds or subs items for a cached prefix drops its
+  // entry, since the server's full hashes for it may have changed.
+  chunk.hosts.clear();
+  InsertAddChunkHostPrefixUrl(&chunk, 4, "www.other.com/",
+                              "www.other.com/malware.html");
+  chunks.clear();
+  chunks.push_back(chunk);
+  SBChunk sub_chunk;
+  InsertSubChunkHostPrefixUrl(&sub_chunk, 5, 3, "www.evil.com/",
+                              "www.evil.com/phishing.html");
+  SBChunkList sub_chunks;
+  sub_chunks.push_back(sub_chunk);
+  EXPECT_TRUE(database_->UpdateStarted(&lists));
+  database_->InsertChunks(safe_browsing_util::kMalwareList, chunks);
+  database_->InsertChunks(safe_browsing_util::kMalwareList, sub_chunks);
+  database_->UpdateFinished(true);
+  prefixes.clear();
+  full_hashes.clear();
+  EXPECT_TRUE(database_->ContainsBrowseUrl(
+      GURL("http://www.other.com/malware.html"),
+      &listname, &prefixes, &full_hashes, Time::Now()));
+  EXPECT_EQ(1U, prefixes.size());
+  EXPECT_TRUE(full_hashes.empty());
+  prefixes.clear();
+  EXPECT_TRUE(database_->ContainsBrowseUrl(
+      GURL("http://www.evil.com/phishing.html"),
+      &listname, &prefixes, &full_hashes, Time::Now()));
+  EXPECT_EQ(1U, prefixes.size());
+  EXPECT_TRUE(full_hashes.empty());
+}
+
+// Test checking several URLs with one lookup.
+TEST_F(SafeBrowsingDatabaseTest, ContainsBrowseUrls) {
+  PopulateDatabaseForCacheTest();
+
+  std::vector<GURL> urls;
+  urls.push_back(GURL("http://www.evil.com/phishing.html"));
+  urls.push_back(GURL("http://www.good.com/"));
+  urls.push_back(GURL("http://www.evil.com/malware.html"));
+  urls.push_back(GURL("http://www.evil.com/phishing.html"));
+
+  // Each prefix is reported once, in order, along with its cached full hash.
+  std::vector<SBPrefix> prefix_hits;
+  std::vector<SBFullHashResult> full_hashes;
+  EXPECT_TRUE(database_->ContainsBrowseUrls(urls, &prefix_hits, &full_hashes,
+                                            Time::Now()));
+  std::vector<SBPrefix> expected_prefixes;
+  expected_prefixes.push_back(Sha256Prefix("www.evil.com/phishing.html"));
+  expected_prefixes.push_back(Sha256Prefix("www.evil.com/malware.html"));
+  std::sort(expected_prefixes.begin(), expected_prefixes.end());
+  EXPECT_EQ(expected_prefixes, prefix_hits);
+  EXPECT_EQ(2U, full_hashes.size());
+
+  EXPECT_FALSE(database_->ContainsBrowseUrls(
+      std::vector<GURL>(1, GURL("http://www.good.com/")),
+      &prefix_hits, &full_hashes, Time::Now()));
+  EXPECT_TRUE(prefix_hits.empty());
+  EXPECT_TRUE(full_hashes.empty());
+
+  // A cached GetHash miss drops just that prefix.
+  std::vector<SBPrefix> prefix_misses;
+  prefix_misses.push_back(Sha256Prefix("www.evil.com/phishing.html"));
+  database_->CacheHashResults(prefix_misses,
+                              std::vector<SBFullHashResult>());
+  EXPECT_TRUE(database_->ContainsBrowseUrls(urls, &prefix_hits, &full_hashes,
+                                            Time::Now()));
+  ASSERT_EQ(1U, prefix_hits.size());
+  EXPECT_EQ(Sha256Prefix("www.evil.com/malware.html"), prefix_hits[0]);
+  ASSERT_EQ(1U, full_hashes.size());
+  EXPECT_TRUE(SBFullHashEq(full_hashes[0].hash,
+                           Sha256Hash("www.evil.com/malware.html")));
+
+  prefix_misses[0] = Sha256Prefix("www.evil.com/malware.html");
+  database_->CacheHashResults(prefix_misses,
+                              std::vector<SBFullHashResult>());
+  EXPECT_FALSE(database_->ContainsBrowseUrls(urls, &prefix_hits, &full_hashes,
+                                             Time::Now()));
+}
+
 // Test that corrupt databases are appropriately handled, even if the
 // corruption is detected in the midst of the update.
 // TODO(shess): Disabled until ScopedLogMessageIgnorer resolved.
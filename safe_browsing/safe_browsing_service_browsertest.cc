@@ -7,6 +7,7 @@
 // service.
 
 #include <algorithm>
+#include <map>
 
 #include "base/bind.h"
 #include "base/command_line.h"
@@ -91,6 +92,16 @@ class TestSafeBrowsingDatabase :  public SafeBrowsingDatabase {
                        safe_browsing_util::kPhishingList,
                        urls, prefix_hits, full_hits);
   }
+  virtual bool ContainsBrowseUrls(const std::vector<GURL>& urls,
+                                  std::vector<SBPrefix>* prefix_hits,
+                                  std::vector<SBFullHashResult>* full_hits,
+                                  base::Time last_update) OVERRIDE {
+    prefix_hits->clear();
+    full_hits->clear();
+    return ContainsUrl(safe_browsing_util::kMalwareList,
+                       safe_browsing_util::kPhishingList,
+                       urls, prefix_hits, full_hits);
+  }
   virtual bool ContainsDownloadUrl(
       const std::vector<GURL>& urls,
       std::vector<SBPrefix>* prefix_hits) OVERRIDE {
@@ -546,6 +557,7 @@ class TestSBClient
  public:
   TestSBClient()
     : threat_type_(SB_THREAT_TYPE_SAFE),
+      pending_browse_urls_(0),
       safe_browsing_service_(g_browser_process->safe_browsing_service()) {
   }
 
@@ -553,6 +565,19 @@ class TestSBClient
     return threat_type_;
   }
 
+  // The result for each url of the last CheckBrowseUrls().
+  const std::map<GURL, SBThreatType>& browse_url_results() const {
+    return browse_url_results_;
+  }
+
+  void CheckBrowseUrls(const std::vector<GURL>& urls) {
+    browse_url_results_.clear();
+    BrowserThread::PostTask(
+        BrowserThread::IO, FROM_HERE,
+        base::Bind(&TestSBClient::CheckBrowseUrlsOnIOThread, this, urls));
+    content::RunMessageLoop();  // Will stop in OnCheckBrowseUrlResult.
+  }
+
   void CheckDownloadUrl(const std::vector<GURL>& url_chain) {
     BrowserThread::PostTask(
         BrowserThread::IO, FROM_HERE,
@@ -573,6 +598,16 @@ class TestSBClient
   friend class base::RefCountedThreadSafe<TestSBClient>;
   virtual ~TestSBClient() {}
 
+  void CheckBrowseUrlsOnIOThread(const std::vector<GURL>& urls) {
+    pending_browse_urls_ = urls.size();
+    if (safe_browsing_service_->database_manager()->
+            CheckBrowseUrls(urls, this)) {
+      BrowserThread::PostTask(
+          BrowserThread::UI, FROM_HERE,
+          base::Bind(&TestSBClient::DownloadCheckDone, this));
+    }
+  }
+
   void CheckDownloadUrlOnIOThread(const std::vector<GURL>& url_chain) {
     safe_browsing_service_->database_manager()->
         CheckDownloadUrl(url_chain, this);
@@ -583,6 +618,17 @@ class TestSBClient
         CheckDownloadHash(full_hash, this);
   }
 
+  // Called with the result of each url given to CheckBrowseUrls().
+  virtual void OnCheckBrowseUrlResult(const GURL& url,
+                                      SBThreatType threat_type) OVERRIDE {
+    browse_url_results_[url] = threat_type;
+    if (--pending_browse_urls_ == 0) {
+      BrowserThread::PostTask(
+          BrowserThread::UI, FROM_HERE,
+          base::Bind(&TestSBClient::DownloadCheckDone, this));
+    }
+  }
+
   // Called when the result of checking a download URL is known.
   virtual void OnCheckDownloadUrlResult(const std::vector<GURL>& url_chain,
                                         SBThreatType threat_type) OVERRIDE {
@@ -604,6 +650,8 @@ class TestSBClient
   }
 
   SBThreatType threat_type_;
+  std::map<GURL, SBThreatType> browse_url_results_;
+  size_t pending_browse_urls_;
   SafeBrowsingService* safe_browsing_service_;
 
   DISALLOW_COPY_AND_ASSIGN(TestSBClient);
@@ -613,6 +661,35 @@ class TestSBClient
 // SafeBrowsingService.
 namespace {
 
+IN_PROC_BROWSER_TEST_F(SafeBrowsingServiceTest, CheckBrowseUrls) {
+  GURL empty_url = test_server()->GetURL(kEmptyPage);
+  GURL malware_url = test_server()->GetURL(kMalwarePage);
+  std::vector<GURL> urls;
+  urls.push_back(empty_url);
+  urls.push_back(malware_url);
+
+  scoped_refptr<TestSBClient> client(new TestSBClient);
+  client->CheckBrowseUrls(urls);
+
+  // Nothing is in the database yet, so the check finishes synchronously.
+  EXPECT_TRUE(client->browse_url_results().empty());
+
+  SBFullHashResult full_hash_result;
+  int chunk_id = 0;
+  GenUrlFullhashResult(malware_url, safe_browsing_util::kMalwareList,
+                       chunk_id, &full_hash_result);
+  SetupResponseForUrl(malware_url, full_hash_result);
+
+  client->CheckBrowseUrls(urls);
+
+  // Every url gets a result, and only the malware url is unsafe.
+  ASSERT_EQ(2U, client->browse_url_results().size());
+  EXPECT_EQ(SB_THREAT_TYPE_SAFE,
+            client->browse_url_results().find(empty_url)->second);
+  EXPECT_EQ(SB_THREAT_TYPE_URL_MALWARE,
+            client->browse_url_results().find(malware_url)->second);
+}
+
 IN_PROC_BROWSER_TEST_F(SafeBrowsingServiceTest, CheckDownloadUrl) {
   GURL badbin_url = test_server()->GetURL(kMalwareFile);
   std::vector<GURL> badbin_urls(1, badbin_url);
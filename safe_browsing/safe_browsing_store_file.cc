@@ -4,15 +4,39 @@
 
 #include "chrome/browser/safe_browsing/safe_browsing_store_file.h"
 
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <utility>
+
 #include "base/md5.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/metrics/histogram.h"
+#include "build/build_config.h"
+
+#if defined(OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace {
 
 // NOTE(shess): kFileMagic should not be a byte-wise palindrome, so
 // that byte-order changes force corruption.
 const int32 kFileMagic = 0x600D71FE;
-const int32 kFileVersion = 7;  // SQLite storage was 6...
+const int32 kFileVersion = 8;  // SQLite storage was 6...
+
+// Magic number at the front of each delta segment.
+const int32 kDeltaMagic = 0x5EC7DE17;
+
+// An update appends its changes to the main file as a delta segment
+// rather than rewriting the file, until there are kMaxDeltaSegments
+// of them or together they are larger than 1/kMaxDeltaSizeRatio of
+// the base segment.  The next update compacts the file back into a
+// single base segment.
+const int kMaxDeltaSegments = 16;
+const int64 kMaxDeltaSizeRatio = 4;
 
 // Header at the front of the main database file.
 struct FileHeader {
@@ -28,6 +52,68 @@ struct ChunkHeader {
   uint32 add_hash_count, sub_hash_count;
 };
 
+// Header for each delta segment appended to the main database file.
+struct DeltaHeader {
+  int32 magic;
+  uint32 add_chunk_count, sub_chunk_count;
+  ChunkHeader added, removed;
+};
+
+// The items in a store, or the items an update added to or removed
+// from it.
+struct StoreItems {
+  void Swap(StoreItems* other) {
+    add_prefixes.swap(other->add_prefixes);
+    sub_prefixes.swap(other->sub_prefixes);
+    add_full_hashes.swap(other->add_full_hashes);
+    sub_full_hashes.swap(other->sub_full_hashes);
+  }
+
+  SBAddPrefixes add_prefixes;
+  SBSubPrefixes sub_prefixes;
+  std::vector<SBAddFullHash> add_full_hashes;
+  std::vector<SBSubFullHash> sub_full_hashes;
+};
+
+// Size of the items counted by |header|.
+int64 ItemsSize(const ChunkHeader& header) {
+  return header.add_prefix_count * sizeof(SBAddPrefix) +
+      header.sub_prefix_count * sizeof(SBSubPrefix) +
+      header.add_hash_count * sizeof(SBAddFullHash) +
+      header.sub_hash_count * sizeof(SBSubFullHash);
+}
+
+// Sizes of the segments described by |header|, including the header
+// and checksum.
+int64 BaseSegmentSize(const FileHeader& header) {
+  int64 size = sizeof(FileHeader);
+  size += header.add_chunk_count * sizeof(int32);
+  size += header.sub_chunk_count * sizeof(int32);
+  size += header.add_prefix_count * sizeof(SBAddPrefix);
+  size += header.sub_prefix_count * sizeof(SBSubPrefix);
+  size += header.add_hash_count * sizeof(SBAddFullHash);
+  size += header.sub_hash_count * sizeof(SBSubFullHash);
+  size += sizeof(base::MD5Digest);
+  return size;
+}
+
+int64 DeltaSegmentSize(const DeltaHeader& header) {
+  int64 size = sizeof(DeltaHeader);
+  size += header.add_chunk_count * sizeof(int32);
+  size += header.sub_chunk_count * sizeof(int32);
+  size += ItemsSize(header.added) + ItemsSize(header.removed);
+  size += sizeof(base::MD5Digest);
+  return size;
+}
+
+// Count the items in |items| into |header|.
+void CountItems(const StoreItems& items, ChunkHeader* header) {
+  header->add_prefix_count = items.add_prefixes.size();
+  header->sub_prefix_count = items.sub_prefixes.size();
+  header->add_hash_count = items.add_full_hashes.size();
+  header->sub_hash_count = items.sub_full_hashes.size();
+}
+
 // Rewind the file.  Using fseek(2) because rewind(3) errors are
 // weird.
 bool FileRewind(FILE* fp) {
@@ -36,16 +122,18 @@ bool FileRewind(FILE* fp) {
   return rv == 0;
 }
 
-// Move file read pointer forward by |bytes| relative to current position.
-bool FileSkip(size_t bytes, FILE* fp) {
-  // Although fseek takes negative values, for this case, we only want
-  // to skip forward.
-  DCHECK(static_cast<long>(bytes) >= 0);
-  if (static_cast<long>(bytes) < 0)
+// Flush what was written to |fp| through to the disk.  A segment
+// appended to the main file is only written once, unlike a file which
+// is renamed into place, so it must be on disk before the update is
+// considered done.
+bool FileFlush(FILE* fp) {
+  if (fflush(fp) != 0)
     return false;
-  int rv = fseek(fp, static_cast<long>(bytes), SEEK_CUR);
-  DCHECK_EQ(rv, 0);
-  return rv == 0;
+#if defined(OS_WIN)
+  return _commit(_fileno(fp)) == 0;
+#else
+  return fsync(fileno(fp)) == 0;
+#endif
 }
 
 // Read from |fp| into |item|, and fold the input data into the
@@ -102,6 +190,21 @@ bool ReadToContainer(CT* values, size_t count, FILE* fp,
   return true;
 }
 
+// Like ReadToContainer(), but only keep the values for which |keep|
+// returns true.  All of them are folded into the checksum.
+template <typename CT, typename PredicateT>
+bool ReadToContainerIf(CT* values, size_t count, FILE* fp,
+                       base::MD5Context* context, const PredicateT& keep) {
+  for (size_t i = 0; i < count; ++i) {
+    typename CT::value_type value;
+    if (!ReadItem(&value, fp, context))
+      return false;
+    if (keep(value))
+      values->push_back(value);
+  }
+  return true;
+}
+
 // Write all of |values| to |fp|, and fold the data into the checksum
 // in |context|, if non-NULL.  Returns true on succsess.
 template <typename CT>
@@ -118,6 +221,329 @@ bool WriteContainer(const CT& values, FILE* fp,
   return true;
 }
 
+// Read the items counted by |header| from |fp|, appending them to
+// |items|, and fold them into the checksum in |context|, if non-NULL.
+// Returns true on success.
+bool ReadStoreItems(const ChunkHeader& header, FILE* fp, StoreItems* items,
+                    base::MD5Context* context) {
+  return ReadToContainer(&items->add_prefixes, header.add_prefix_count,
+                         fp, context) &&
+      ReadToContainer(&items->sub_prefixes, header.sub_prefix_count,
+                      fp, context) &&
+      ReadToContainer(&items->add_full_hashes, header.add_hash_count,
+                      fp, context) &&
+      ReadToContainer(&items->sub_full_hashes, header.sub_hash_count,
+                      fp, context);
+}
+
+// Like ReadStoreItems(), but only keep the subs for which |keep_sub|
+// returns true.
+template <typename PredicateT>
+bool ReadStoreItemsIf(const ChunkHeader& header, FILE* fp,
+                      StoreItems* items, base::MD5Context* context,
+                      const PredicateT& keep_sub) {
+  return ReadToContainer(&items->add_prefixes, header.add_prefix_count,
+                         fp, context) &&
+      ReadToContainerIf(&items->sub_prefixes, header.sub_prefix_count,
+                        fp, context, keep_sub) &&
+      ReadToContainer(&items->add_full_hashes, header.add_hash_count,
+                      fp, context) &&
+      ReadToContainerIf(&items->sub_full_hashes, header.sub_hash_count,
+                        fp, context, keep_sub);
+}
+
+// Write all of |items| to |fp|, and fold the data into the checksum
+// in |context|, if non-NULL.  Returns true on success.
+bool WriteStoreItems(const StoreItems& items, FILE* fp,
+                     base::MD5Context* context) {
+  return WriteContainer(items.add_prefixes, fp, context) &&
+      WriteContainer(items.sub_prefixes, fp, context) &&
+      WriteContainer(items.add_full_hashes, fp, context) &&
+      WriteContainer(items.sub_full_hashes, fp, context);
+}
+
+// Order items the way SBProcessSubs() sorts them, breaking ties by
+// their bytes.  Items are written to the file byte-for-byte, so items
+// which compare equal are stored identically.
+struct ItemLess {
+  template <class T>
+  bool BytesLess(const T& a, const T& b) const {
+    return memcmp(&a, &b, sizeof(T)) < 0;
+  }
+
+  bool operator()(const SBAddPrefix& a, const SBAddPrefix& b) const {
+    if (SBAddPrefixLess(a, b))
+      return true;
+    if (SBAddPrefixLess(b, a))
+      return false;
+    return BytesLess(a, b);
+  }
+  bool operator()(const SBSubPrefix& a, const SBSubPrefix& b) const {
+    if (SBAddPrefixLess(a, b))
+      return true;
+    if (SBAddPrefixLess(b, a))
+      return false;
+    return BytesLess(a, b);
+  }
+  bool operator()(const SBAddFullHash& a, const SBAddFullHash& b) const {
+    if (SBAddPrefixHashLess(a, b))
+      return true;
+    if (SBAddPrefixHashLess(b, a))
+      return false;
+    return BytesLess(a, b);
+  }
+  bool operator()(const SBSubFullHash& a, const SBSubFullHash& b) const {
+    if (SBAddPrefixHashLess(a, b))
+      return true;
+    if (SBAddPrefixHashLess(b, a))
+      return false;
+    return BytesLess(a, b);
+  }
+};
+
+template <typename CT>
+void SortContainer(CT* values) {
+  std::sort(values->begin(), values->end(), ItemLess());
+}
+
+void SortItems(StoreItems* items) {
+  SortContainer(&items->add_prefixes);
+  SortContainer(&items->sub_prefixes);
+  SortContainer(&items->add_full_hashes);
+  SortContainer(&items->sub_full_hashes);
+}
+
+// Append the values of sorted |a| which are not in sorted |b| to
+// |difference|.  Duplicate values are matched up one for one.
+template <typename CT>
+void ContainerDifference(const CT& a, const CT& b, CT* difference) {
+  std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                      std::back_inserter(*difference), ItemLess());
+}
+
+// Calculate the items which turn the sorted |old_items| into the
+// sorted |new_items|.
+void DiffItems(const StoreItems& old_items, const StoreItems& new_items,
+               StoreItems* added, StoreItems* removed) {
+  ContainerDifference(new_items.add_prefixes, old_items.add_prefixes,
+                      &added->add_prefixes);
+  ContainerDifference(new_items.sub_prefixes, old_items.sub_prefixes,
+                      &added->sub_prefixes);
+  ContainerDifference(new_items.add_full_hashes, old_items.add_full_hashes,
+                      &added->add_full_hashes);
+  ContainerDifference(new_items.sub_full_hashes, old_items.sub_full_hashes,
+                      &added->sub_full_hashes);
+  ContainerDifference(old_items.add_prefixes, new_items.add_prefixes,
+                      &removed->add_prefixes);
+  ContainerDifference(old_items.sub_prefixes, new_items.sub_prefixes,
+                      &removed->sub_prefixes);
+  ContainerDifference(old_items.add_full_hashes, new_items.add_full_hashes,
+                      &removed->add_full_hashes);
+  ContainerDifference(old_items.sub_full_hashes, new_items.sub_full_hashes,
+                      &removed->sub_full_hashes);
+}
+
+template <typename CT>
+void RemoveFromContainer(const CT& removed, CT* values) {
+  if (removed.empty())
+    return;
+  CT remaining;
+  ContainerDifference(*values, removed, &remaining);
+  values->swap(remaining);
+}
+
+// Take the sorted |removed| out of the sorted |items|.
+void RemoveItems(const StoreItems& removed, StoreItems* items) {
+  RemoveFromContainer(removed.add_prefixes, &items->add_prefixes);
+  RemoveFromContainer(removed.sub_prefixes, &items->sub_prefixes);
+  RemoveFromContainer(removed.add_full_hashes, &items->add_full_hashes);
+  RemoveFromContainer(removed.sub_full_hashes, &items->sub_full_hashes);
+}
+
+// Returns true if |first| to |last| is sorted by ItemLess().
+template <typename IteratorT>
+bool IsSorted(IteratorT first, IteratorT last) {
+  if (first == last)
+    return true;
+  for (IteratorT next = first + 1; next != last; ++first, ++next) {
+    if (ItemLess()(*next, *first))
+      return false;
+  }
+  return true;
+}
+
+// Restore the order of |values| after items were appended to its
+// first |sorted_size| items, which were sorted.  Segments are written
+// sorted, so this is normally a linear merge.
+template <typename CT>
+void MergeAppended(size_t sorted_size, CT* values) {
+  typename CT::iterator middle = values->begin() + sorted_size;
+  if (!IsSorted(middle, values->end()))
+    std::sort(middle, values->end(), ItemLess());
+  std::inplace_merge(values->begin(), middle, values->end(), ItemLess());
+}
+
+// Likewise for all of |items|, with the sizes of its sorted part
+// counted in |sorted|.
+void MergeAppendedItems(const ChunkHeader& sorted, StoreItems* items) {
+  MergeAppended(sorted.add_prefix_count, &items->add_prefixes);
+  MergeAppended(sorted.sub_prefix_count, &items->sub_prefixes);
+  MergeAppended(sorted.add_hash_count, &items->add_full_hashes);
+  MergeAppended(sorted.sub_hash_count, &items->sub_full_hashes);
+}
+
+template <typename CT>
+void AppendContainer(const CT& values, CT* dest) {
+  dest->insert(dest->end(), values.begin(), values.end());
+}
+
+// Append copies of all of |items| to |dest|.
+void AppendItems(const StoreItems& items, StoreItems* dest) {
+  AppendContainer(items.add_prefixes, &dest->add_prefixes);
+  AppendContainer(items.sub_prefixes, &dest->sub_prefixes);
+  AppendContainer(items.add_full_hashes, &dest->add_full_hashes);
+  AppendContainer(items.sub_full_hashes, &dest->sub_full_hashes);
+}
+
+// Subs only knock out adds, and full hashes only go with prefixes,
+// which have the same add chunk and prefix.
+typedef std::pair<int32, SBPrefix> AddPrefixKey;
+
+template <class T>
+AddPrefixKey GetAddPrefixKey(const T& item) {
+  return AddPrefixKey(item.GetAddChunkId(), item.GetAddPrefix());
+}
+
+template <typename CT>
+void CollectKeys(const CT& values, std::set<AddPrefixKey>* keys) {
+  for (typename CT::const_iterator iter = values.begin();
+       iter != values.end(); ++iter) {
+    keys->insert(GetAddPrefixKey(*iter));
+  }
+}
+
+// Returns the first item of the sorted |values| whose key is not less
+// than |key|.
+template <typename CT>
+typename CT::const_iterator LowerBoundForKey(const CT& values,
+                                             const AddPrefixKey& key) {
+  typename CT::const_iterator first = values.begin();
+  typename CT::difference_type count = values.size();
+  while (count > 0) {
+    const typename CT::difference_type step = count / 2;
+    typename CT::const_iterator middle = first + step;
+    if (GetAddPrefixKey(*middle) < key) {
+      first = middle + 1;
+      count -= step + 1;
+    } else {
+      count = step;
+    }
+  }
+  return first;
+}
+
+// Append to |touched| the items of the sorted |values| which have a
+// key in |keys| or belong to a chunk in |deleted|.
+template <typename CT>
+void CollectTouched(const CT& values,
+                    const std::set<AddPrefixKey>& keys,
+                    const base::hash_set<int32>& deleted,
+                    CT* touched) {
+  for (std::set<AddPrefixKey>::const_iterator key = keys.begin();
+       key != keys.end(); ++key) {
+    for (typename CT::const_iterator iter = LowerBoundForKey(values, *key);
+         iter != values.end() && GetAddPrefixKey(*iter) == *key; ++iter) {
+      touched->push_back(*iter);
+    }
+  }
+
+  // The deleted chunks are not part of the sort order.
+  if (deleted.empty())
+    return;
+  for (typename CT::const_iterator iter = values.begin();
+       iter != values.end(); ++iter) {
+    if (deleted.count(iter->chunk_id) > 0 &&
+        keys.count(GetAddPrefixKey(*iter)) == 0) {
+      touched->push_back(*iter);
+    }
+  }
+}
+
+// Copy the items of the sorted |items| which an update adding
+// |new_items| and deleting the chunks in |add_deleted| and
+// |sub_deleted| can change into |touched|.  Subs are knocked out of
+// adds whenever an update is processed, so the original items can
+// only interact with the new items which share their add chunk and
+// prefix.
+void CollectTouchedItems(const StoreItems& items,
+                         const StoreItems& new_items,
+                         const base::hash_set<int32>& add_deleted,
+                         const base::hash_set<int32>& sub_deleted,
+                         StoreItems* touched) {
+  std::set<AddPrefixKey> keys;
+  CollectKeys(new_items.add_prefixes, &keys);
+  CollectKeys(new_items.sub_prefixes, &keys);
+  CollectKeys(new_items.add_full_hashes, &keys);
+  CollectKeys(new_items.sub_full_hashes, &keys);
+
+  CollectTouched(items.add_prefixes, keys, add_deleted,
+                 &touched->add_prefixes);
+  CollectTouched(items.sub_prefixes, keys, sub_deleted,
+                 &touched->sub_prefixes);
+  CollectTouched(items.add_full_hashes, keys, add_deleted,
+                 &touched->add_full_hashes);
+  CollectTouched(items.sub_full_hashes, keys, sub_deleted,
+                 &touched->sub_full_hashes);
+}
+
+// Fold the next |bytes| of |fp| into the checksum in |context|.
+// Returns true on success.
+bool ReadToChecksum(int64 bytes, FILE* fp, base::MD5Context* context) {
+  while (bytes > 0) {
+    char buf[4096];
+    const size_t c = static_cast<size_t>(
+        std::min(static_cast<int64>(sizeof(buf)), bytes));
+    const size_t ret = fread(buf, 1, c, fp);
+
+    // The file's size changed while reading, give up.
+    if (ret != c)
+      return false;
+    base::MD5Update(context, base::StringPiece(buf, c));
+    bytes -= c;
+  }
+  return true;
+}
+
+// Read the stored checksum from |fp| and compare it with the one
+// calculated in |context|.  Returns true if they match.
+bool ReadAndVerifyDigest(FILE* fp, base::MD5Context* context) {
+  base::MD5Digest calculated_digest;
+  base::MD5Final(&calculated_digest, context);
+
+  base::MD5Digest file_digest;
+  if (!ReadItem(&file_digest, fp, NULL))
+    return false;
+  return 0 == memcmp(&file_digest, &calculated_digest, sizeof(file_digest));
+}
+
+// Read the header of the delta segment at |offset| in |fp|, which is
+// |size| bytes long, folding it into |context|, if non-NULL.  Returns
+// false if there is no complete segment at |offset|, either because
+// it is the end of the file or because the browser went down while
+// the segment was being appended.  An incomplete segment is ignored:
+// the chunks-seen data it would have updated is in the segment, too,
+// so the server will send its chunks again.
+bool ReadDeltaHeaderAt(int64 offset, int64 size, FILE* fp,
+                       DeltaHeader* header, base::MD5Context* context) {
+  if (offset + static_cast<int64>(sizeof(*header)) > size)
+    return false;
+  if (fseek(fp, static_cast<long>(offset), SEEK_SET) != 0)
+    return false;
+  if (!ReadItem(header, fp, context))
+    return false;
+  return offset + DeltaSegmentSize(*header) <= size;
+}
+
 // Delete the chunks in |deleted| from |chunks|.
 void DeleteChunksFromSet(const base::hash_set<int32>& deleted,
                          std::set<int32>* chunks) {
@@ -131,22 +557,16 @@ void DeleteChunksFromSet(const base::hash_set<int32>& deleted,
 
 // Sanity-check the header against the file's size to make sure our
 // vectors aren't gigantic.  This doubles as a cheap way to detect
-// corruption without having to checksum the entire file.
+// corruption without having to checksum the entire file.  The base
+// segment may be followed by delta segments, so the file can be
+// larger than the header describes.
 bool FileHeaderSanityCheck(const base::FilePath& filename,
                            const FileHeader& header) {
   int64 size = 0;
   if (!file_util::GetFileSize(filename, &size))
     return false;
 
-  int64 expected_size = sizeof(FileHeader);
-  expected_size += header.add_chunk_count * sizeof(int32);
-  expected_size += header.sub_chunk_count * sizeof(int32);
-  expected_size += header.add_prefix_count * sizeof(SBAddPrefix);
-  expected_size += header.sub_prefix_count * sizeof(SBSubPrefix);
-  expected_size += header.add_hash_count * sizeof(SBAddFullHash);
-  expected_size += header.sub_hash_count * sizeof(SBSubFullHash);
-  expected_size += sizeof(base::MD5Digest);
-  if (size != expected_size)
+  if (size < BaseSegmentSize(header))
     return false;
 
   return true;
@@ -169,6 +589,57 @@ bool ReadAndVerifyHeader(const base::FilePath& filename,
 
 }  // namespace
 
+// The data in the main database file, with the delta segments
+// applied to the base segment.
+struct SafeBrowsingStoreFile::StoreContents {
+  StoreContents() : base_size(0), delta_size(0) {}
+
+  std::set<int32> add_chunks;
+  std::set<int32> sub_chunks;
+
+  // Sorted by ItemLess().
+  StoreItems items;
+
+  // Sizes of the base segment and of the complete delta segments
+  // which follow it.
+  int64 base_size;
+  int64 delta_size;
+};
+
+// Selects the stored subs which an update adding |new_items| and
+// deleting the chunks in |sub_deleted| can interact with: those which
+// share an add chunk and prefix with a new item, or are in a deleted
+// chunk.  No other stored sub can change, and only the update's
+// processing looks at subs, so an update which appends a delta
+// segment need not keep the others.  A default-constructed filter
+// selects every sub.
+class SafeBrowsingStoreFile::SubFilter {
+ public:
+  SubFilter() : keep_all_(true) {}
+  SubFilter(const StoreItems& new_items,
+            const base::hash_set<int32>& sub_deleted)
+      : keep_all_(false),
+        sub_deleted_(sub_deleted) {
+    CollectKeys(new_items.add_prefixes, &keys_);
+    CollectKeys(new_items.sub_prefixes, &keys_);
+    CollectKeys(new_items.add_full_hashes, &keys_);
+    CollectKeys(new_items.sub_full_hashes, &keys_);
+  }
+
+  template <class T>
+  bool operator()(const T& sub) const {
+    return keep_all_ || sub_deleted_.count(sub.chunk_id) > 0 ||
+        keys_.count(GetAddPrefixKey(sub)) > 0;
+  }
+
+ private:
+  bool keep_all_;
+  std::set<AddPrefixKey> keys_;
+  base::hash_set<int32> sub_deleted_;
+
+  DISALLOW_COPY_AND_ASSIGN(SubFilter);
+};
+
 // static
 void SafeBrowsingStoreFile::RecordFormatEvent(FormatEventType event_type) {
   UMA_HISTOGRAM_ENUMERATION("SB2.FormatEvent", event_type, FORMAT_EVENT_MAX);
@@ -201,7 +672,10 @@ void SafeBrowsingStoreFile::CheckForOriginalAndDelete(
 }
 
 SafeBrowsingStoreFile::SafeBrowsingStoreFile()
-    : chunks_written_(0), empty_(false), corruption_seen_(false) {}
+    : chunks_written_(0),
+      empty_(false),
+      compact_(false),
+      corruption_seen_(false) {}
 
 SafeBrowsingStoreFile::~SafeBrowsingStoreFile() {
   Close();
@@ -233,42 +707,46 @@ bool SafeBrowsingStoreFile::CheckValidity() {
   if (!file_util::GetFileSize(filename_, &size))
     return OnCorruptDatabase();
 
+  // Each segment is checksummed separately.
   base::MD5Context context;
   base::MD5Init(&context);
 
-  // Read everything except the final digest.
-  size_t bytes_left = static_cast<size_t>(size);
-  CHECK(size == static_cast<int64>(bytes_left));
-  if (bytes_left < sizeof(base::MD5Digest))
+  FileHeader header;
+  if (!ReadAndVerifyHeader(filename_, file_.get(), &header, &context))
     return OnCorruptDatabase();
-  bytes_left -= sizeof(base::MD5Digest);
-
-  // Fold the contents of the file into the checksum.
-  while (bytes_left > 0) {
-    char buf[4096];
-    const size_t c = std::min(sizeof(buf), bytes_left);
-    const size_t ret = fread(buf, 1, c, file_.get());
 
-    // The file's size changed while reading, give up.
-    if (ret != c)
-      return OnCorruptDatabase();
-    base::MD5Update(&context, base::StringPiece(buf, c));
-    bytes_left -= c;
-  }
-
-  // Calculate the digest to this point.
-  base::MD5Digest calculated_digest;
-  base::MD5Final(&calculated_digest, &context);
-
-  // Read the stored digest and verify it.
-  base::MD5Digest file_digest;
-  if (!ReadItem(&file_digest, file_.get(), NULL))
+  // Fold the rest of the base segment into the checksum and verify it.
+  int64 offset = BaseSegmentSize(header);
+  if (!ReadToChecksum(
+          offset - static_cast<int64>(sizeof(header) + sizeof(base::MD5Digest)),
+          file_.get(), &context))
     return OnCorruptDatabase();
-  if (0 != memcmp(&file_digest, &calculated_digest, sizeof(file_digest))) {
+  if (!ReadAndVerifyDigest(file_.get(), &context)) {
     RecordFormatEvent(FORMAT_EVENT_VALIDITY_CHECKSUM_FAILURE);
     return OnCorruptDatabase();
   }
 
+  // Likewise for each delta segment.
+  DeltaHeader delta;
+  base::MD5Init(&context);
+  while (ReadDeltaHeaderAt(offset, size, file_.get(), &delta, &context)) {
+    if (delta.magic != kDeltaMagic)
+      return OnCorruptDatabase();
+
+    const int64 delta_size = DeltaSegmentSize(delta);
+    if (!ReadToChecksum(
+            delta_size -
+                static_cast<int64>(sizeof(delta) + sizeof(base::MD5Digest)),
+            file_.get(), &context))
+      return OnCorruptDatabase();
+    if (!ReadAndVerifyDigest(file_.get(), &context)) {
+      RecordFormatEvent(FORMAT_EVENT_VALIDITY_CHECKSUM_FAILURE);
+      return OnCorruptDatabase();
+    }
+    offset += delta_size;
+    base::MD5Init(&context);
+  }
+
   return true;
 }
 
@@ -295,18 +773,12 @@ bool SafeBrowsingStoreFile::GetAddPrefixes(SBAddPrefixes* add_prefixes) {
   file_util::ScopedFILE file(file_util::OpenFile(filename_, "rb"));
   if (file.get() == NULL) return false;
 
-  FileHeader header;
-  if (!ReadAndVerifyHeader(filename_, file.get(), &header, NULL))
-    return OnCorruptDatabase();
-
-  size_t add_prefix_offset = header.add_chunk_count * sizeof(int32) +
-      header.sub_chunk_count * sizeof(int32);
-  if (!FileSkip(add_prefix_offset, file.get()))
-    return false;
-
-  if (!ReadToContainer(add_prefixes, header.add_prefix_count, file.get(), NULL))
+  StoreContents contents;
+  if (!ReadStore(file.get(), FORMAT_EVENT_READ_CHECKSUM_FAILURE, NULL,
+                 &contents))
     return false;
 
+  add_prefixes->swap(contents.items.add_prefixes);
   return true;
 }
 
@@ -317,22 +789,97 @@ bool SafeBrowsingStoreFile::GetAddFullHashes(
   file_util::ScopedFILE file(file_util::OpenFile(filename_, "rb"));
   if (file.get() == NULL) return false;
 
+  StoreContents contents;
+  if (!ReadStore(file.get(), FORMAT_EVENT_READ_CHECKSUM_FAILURE, NULL,
+                 &contents))
+    return false;
+
+  add_full_hashes->swap(contents.items.add_full_hashes);
+  return true;
+}
+
+bool SafeBrowsingStoreFile::ReadStore(FILE* fp,
+                                      FormatEventType checksum_failure_event,
+                                      const SubFilter* sub_filter,
+                                      StoreContents* contents) {
+  if (!FileRewind(fp))
+    return OnCorruptDatabase();
+
+  const SubFilter keep_all;
+  const SubFilter& keep_sub = sub_filter ? *sub_filter : keep_all;
+
+  int64 size = 0;
+  if (!file_util::GetFileSize(filename_, &size))
+    return OnCorruptDatabase();
+
+  base::MD5Context context;
+  base::MD5Init(&context);
+
+  // Read the file header and make sure it looks right.
   FileHeader header;
-  if (!ReadAndVerifyHeader(filename_, file.get(), &header, NULL))
+  if (!ReadAndVerifyHeader(filename_, fp, &header, &context))
     return OnCorruptDatabase();
 
-  size_t offset =
-      header.add_chunk_count * sizeof(int32) +
-      header.sub_chunk_count * sizeof(int32) +
-      header.add_prefix_count * sizeof(SBAddPrefix) +
-      header.sub_prefix_count * sizeof(SBSubPrefix);
-  if (!FileSkip(offset, file.get()))
-    return false;
+  // Read the base segment and verify its checksum.
+  ChunkHeader counts;
+  counts.add_prefix_count = header.add_prefix_count;
+  counts.sub_prefix_count = header.sub_prefix_count;
+  counts.add_hash_count = header.add_hash_count;
+  counts.sub_hash_count = header.sub_hash_count;
+  if (!ReadToContainer(&contents->add_chunks, header.add_chunk_count,
+                       fp, &context) ||
+      !ReadToContainer(&contents->sub_chunks, header.sub_chunk_count,
+                       fp, &context) ||
+      !ReadStoreItemsIf(counts, fp, &contents->items, &context, keep_sub))
+    return OnCorruptDatabase();
+
+  // Segments are written sorted, but files from before delta segments
+  // may not be.
+  ChunkHeader sorted = { 0, 0, 0, 0 };
+  MergeAppendedItems(sorted, &contents->items);
 
-  return ReadToContainer(add_full_hashes,
-                         header.add_hash_count,
-                         file.get(),
-                         NULL);
+  if (!ReadAndVerifyDigest(fp, &context)) {
+    RecordFormatEvent(checksum_failure_event);
+    return OnCorruptDatabase();
+  }
+  contents->base_size = BaseSegmentSize(header);
+
+  // Each delta segment holds the chunks-seen data as of its update,
+  // and the items the update added and removed.  An item is only
+  // removed if it was there, so the removals can all be applied at
+  // the end, whichever segment added the item.
+  StoreItems removed;
+  DeltaHeader delta;
+  base::MD5Init(&context);
+  while (ReadDeltaHeaderAt(contents->base_size + contents->delta_size, size,
+                           fp, &delta, &context)) {
+    if (delta.magic != kDeltaMagic)
+      return OnCorruptDatabase();
+
+    contents->add_chunks.clear();
+    contents->sub_chunks.clear();
+    CountItems(contents->items, &sorted);
+    if (!ReadToContainer(&contents->add_chunks, delta.add_chunk_count,
+                         fp, &context) ||
+        !ReadToContainer(&contents->sub_chunks, delta.sub_chunk_count,
+                         fp, &context) ||
+        !ReadStoreItemsIf(delta.added, fp, &contents->items, &context,
+                          keep_sub) ||
+        !ReadStoreItemsIf(delta.removed, fp, &removed, &context, keep_sub))
+      return OnCorruptDatabase();
+
+    if (!ReadAndVerifyDigest(fp, &context)) {
+      RecordFormatEvent(checksum_failure_event);
+      return OnCorruptDatabase();
+    }
+    MergeAppendedItems(sorted, &contents->items);
+    contents->delta_size += DeltaSegmentSize(delta);
+    base::MD5Init(&context);
+  }
+
+  SortItems(&removed);
+  RemoveItems(removed, &contents->items);
+  return true;
 }
 
 bool SafeBrowsingStoreFile::WriteAddHash(int32 chunk_id,
@@ -395,6 +942,7 @@ bool SafeBrowsingStoreFile::BeginUpdate() {
   CheckForOriginalAndDelete(filename_);
 
   corruption_seen_ = false;
+  compact_ = true;
 
   const base::FilePath new_filename = TemporaryFileForFilename(filename_);
   file_util::ScopedFILE new_file(file_util::OpenFile(new_filename, "wb+"));
@@ -444,6 +992,35 @@ bool SafeBrowsingStoreFile::BeginUpdate() {
                        file.get(), NULL))
     return OnCorruptDatabase();
 
+  // Each delta segment has the chunks-seen data as of its update, so
+  // the last one is current.
+  int64 size = 0;
+  if (!file_util::GetFileSize(filename_, &size))
+    return OnCorruptDatabase();
+  const int64 base_size = BaseSegmentSize(header);
+  int64 offset = base_size;
+  int delta_count = 0;
+  DeltaHeader delta;
+  while (ReadDeltaHeaderAt(offset, size, file.get(), &delta, NULL)) {
+    if (delta.magic != kDeltaMagic)
+      return OnCorruptDatabase();
+
+    add_chunks_cache_.clear();
+    sub_chunks_cache_.clear();
+    if (!ReadToContainer(&add_chunks_cache_, delta.add_chunk_count,
+                         file.get(), NULL) ||
+        !ReadToContainer(&sub_chunks_cache_, delta.sub_chunk_count,
+                         file.get(), NULL))
+      return OnCorruptDatabase();
+    offset += DeltaSegmentSize(delta);
+    ++delta_count;
+  }
+
+  // The update is appended as a delta segment unless the existing
+  // ones have grown too many or too large.
+  compact_ = delta_count >= kMaxDeltaSegments ||
+      (offset - base_size) * kMaxDeltaSizeRatio > base_size;
+
   file_.swap(file);
   new_file_.swap(new_file);
   return true;
@@ -484,64 +1061,6 @@ bool SafeBrowsingStoreFile::DoUpdate(
   CHECK(add_prefixes_result);
   CHECK(add_full_hashes_result);
 
-  SBAddPrefixes add_prefixes;
-  SBSubPrefixes sub_prefixes;
-  std::vector<SBAddFullHash> add_full_hashes;
-  std::vector<SBSubFullHash> sub_full_hashes;
-
-  // Read original data into the vectors.
-  if (!empty_) {
-    DCHECK(file_.get());
-
-    if (!FileRewind(file_.get()))
-      return OnCorruptDatabase();
-
-    base::MD5Context context;
-    base::MD5Init(&context);
-
-    // Read the file header and make sure it looks right.
-    FileHeader header;
-    if (!ReadAndVerifyHeader(filename_, file_.get(), &header, &context))
-      return OnCorruptDatabase();
-
-    // Re-read the chunks-seen data to get to the later data in the
-    // file and calculate the checksum.  No new elements should be
-    // added to the sets.
-    if (!ReadToContainer(&add_chunks_cache_, header.add_chunk_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&sub_chunks_cache_, header.sub_chunk_count,
-                         file_.get(), &context))
-      return OnCorruptDatabase();
-
-    if (!ReadToContainer(&add_prefixes, header.add_prefix_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&sub_prefixes, header.sub_prefix_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&add_full_hashes, header.add_hash_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&sub_full_hashes, header.sub_hash_count,
-                         file_.get(), &context))
-      return OnCorruptDatabase();
-
-    // Calculate the digest to this point.
-    base::MD5Digest calculated_digest;
-    base::MD5Final(&calculated_digest, &context);
-
-    // Read the stored checksum and verify it.
-    base::MD5Digest file_digest;
-    if (!ReadItem(&file_digest, file_.get(), NULL))
-      return OnCorruptDatabase();
-
-    if (0 != memcmp(&file_digest, &calculated_digest, sizeof(file_digest))) {
-      RecordFormatEvent(FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE);
-      return OnCorruptDatabase();
-    }
-
-    // Close the file so we can later rename over it.
-    file_.reset();
-  }
-  DCHECK(!file_.get());
-
   // Rewind the temporary storage.
   if (!FileRewind(new_file_.get()))
     return false;
@@ -557,7 +1076,8 @@ bool SafeBrowsingStoreFile::DoUpdate(
   UMA_HISTOGRAM_COUNTS("SB2.DatabaseUpdateKilobytes",
                        std::max(static_cast<int>(size / 1024), 1));
 
-  // Append the accumulated chunks onto the vectors read from |file_|.
+  // Read the accumulated chunks.
+  StoreItems new_items;
   for (int i = 0; i < chunks_written_; ++i) {
     ChunkHeader header;
 
@@ -570,105 +1090,176 @@ bool SafeBrowsingStoreFile::DoUpdate(
 
     // As a safety measure, make sure that the header describes a sane
     // chunk, given the remaining file size.
-    int64 expected_size = ofs + sizeof(ChunkHeader);
-    expected_size += header.add_prefix_count * sizeof(SBAddPrefix);
-    expected_size += header.sub_prefix_count * sizeof(SBSubPrefix);
-    expected_size += header.add_hash_count * sizeof(SBAddFullHash);
-    expected_size += header.sub_hash_count * sizeof(SBSubFullHash);
+    int64 expected_size = ofs + sizeof(ChunkHeader) + ItemsSize(header);
     if (expected_size > size)
       return false;
 
-    // TODO(shess): If the vectors were kept sorted, then this code
-    // could use std::inplace_merge() to merge everything together in
-    // sorted order.  That might still be slower than just sorting at
-    // the end if there were a large number of chunks.  In that case
-    // some sort of recursive binary merge might be in order (merge
-    // chunks pairwise, merge those chunks pairwise, and so on, then
-    // merge the result with the main list).
-    if (!ReadToContainer(&add_prefixes, header.add_prefix_count,
-                         new_file_.get(), NULL) ||
-        !ReadToContainer(&sub_prefixes, header.sub_prefix_count,
-                         new_file_.get(), NULL) ||
-        !ReadToContainer(&add_full_hashes, header.add_hash_count,
-                         new_file_.get(), NULL) ||
-        !ReadToContainer(&sub_full_hashes, header.sub_hash_count,
-                         new_file_.get(), NULL))
+    if (!ReadStoreItems(header, new_file_.get(), &new_items, NULL))
       return false;
   }
 
   // Append items from |pending_adds|.
-  add_full_hashes.insert(add_full_hashes.end(),
-                         pending_adds.begin(), pending_adds.end());
+  new_items.add_full_hashes.insert(new_items.add_full_hashes.end(),
+                                   pending_adds.begin(), pending_adds.end());
 
-  // Check how often a prefix was checked which wasn't in the
-  // database.
-  SBCheckPrefixMisses(add_prefixes, prefix_misses);
+  // Read original data.  Unless the file is being compacted, only the
+  // subs which the new items or the deleted chunks touch are kept.
+  StoreContents contents;
+  if (!empty_) {
+    DCHECK(file_.get());
 
-  // Knock the subs from the adds and process deleted chunks.
-  SBProcessSubs(&add_prefixes, &sub_prefixes,
-                &add_full_hashes, &sub_full_hashes,
+    scoped_ptr<SubFilter> sub_filter;
+    if (!compact_)
+      sub_filter.reset(new SubFilter(new_items, sub_del_cache_));
+    if (!ReadStore(file_.get(), FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE,
+                   sub_filter.get(), &contents))
+      return false;
+  }
+
+  // The original file is reopened for writing if the update is
+  // appended, or renamed over if it is compacted.
+  file_.reset();
+
+  // Knock the subs from the adds and process deleted chunks.  Only
+  // the original items which the new items or the deleted chunks
+  // touch can change, so the rest of the original data is left out
+  // of the processing.
+  StoreItems touched;
+  CollectTouchedItems(contents.items, new_items,
+                      add_del_cache_, sub_del_cache_, &touched);
+  AppendItems(touched, &new_items);
+  SBProcessSubs(&new_items.add_prefixes, &new_items.sub_prefixes,
+                &new_items.add_full_hashes, &new_items.sub_full_hashes,
                 add_del_cache_, sub_del_cache_);
 
+  // Work out what the update changes and apply that to the original
+  // data.
+  SortItems(&touched);
+  SortItems(&new_items);
+  StoreItems added, removed;
+  DiffItems(touched, new_items, &added, &removed);
+  StoreItems().Swap(&touched);
+  StoreItems().Swap(&new_items);
+  StoreItems& items = contents.items;
+  RemoveItems(removed, &items);
+  ChunkHeader sorted;
+  CountItems(items, &sorted);
+  AppendItems(added, &items);
+  MergeAppendedItems(sorted, &items);
+
+  // Check how often a prefix was checked which wasn't in the
+  // database.
+  SBCheckPrefixMisses(items.add_prefixes, prefix_misses);
+
   // We no longer need to track deleted chunks.
   DeleteChunksFromSet(add_del_cache_, &add_chunks_cache_);
   DeleteChunksFromSet(sub_del_cache_, &sub_chunks_cache_);
 
-  // Write the new data to new_file_.
-  if (!FileRewind(new_file_.get()))
-    return false;
+  const base::FilePath new_filename = TemporaryFileForFilename(filename_);
+  if (!compact_) {
+    // Append the changes to the original file as a delta segment.
+    // Readers ignore an incomplete segment at the end of the file, so
+    // if the browser goes down in the middle of this the file reads
+    // as it did before the update.
+    DeltaHeader delta;
+    delta.magic = kDeltaMagic;
+    delta.add_chunk_count = add_chunks_cache_.size();
+    delta.sub_chunk_count = sub_chunks_cache_.size();
+    CountItems(added, &delta.added);
+    CountItems(removed, &delta.removed);
+
+    const bool unchanged =
+        ItemsSize(delta.added) == 0 && ItemsSize(delta.removed) == 0 &&
+        add_chunks_cache_ == contents.add_chunks &&
+        sub_chunks_cache_ == contents.sub_chunks;
+    if (!unchanged) {
+      file_util::ScopedFILE file(file_util::OpenFile(filename_, "rb+"));
+      if (file.get() == NULL)
+        return false;
+
+      // Cut off any incomplete segment left by an earlier update, so
+      // that none of it can be read as part of the new one.
+      const int64 offset = contents.base_size + contents.delta_size;
+      if (fseek(file.get(), static_cast<long>(offset), SEEK_SET) != 0 ||
+          !file_util::TruncateFile(file.get()))
+        return false;
+
+      base::MD5Context context;
+      base::MD5Init(&context);
+      if (!WriteItem(delta, file.get(), &context) ||
+          !WriteContainer(add_chunks_cache_, file.get(), &context) ||
+          !WriteContainer(sub_chunks_cache_, file.get(), &context) ||
+          !WriteStoreItems(added, file.get(), &context) ||
+          !WriteStoreItems(removed, file.get(), &context))
+        return false;
+
+      base::MD5Digest digest;
+      base::MD5Final(&digest, &context);
+      if (!WriteItem(digest, file.get(), NULL) || !FileFlush(file.get()))
+        return false;
+    }
 
-  base::MD5Context context;
-  base::MD5Init(&context);
+    // The chunk data in the temporary file has already been read.
+    new_file_.reset();
+    if (!base::DeleteFile(new_filename, false) &&
+        base::PathExists(new_filename))
+      return false;
+  } else {
+    // Write all of the data to the temporary file as a single base
+    // segment, which is then renamed over the original file, so that
+    // the original file is intact if the browser goes down in the
+    // middle of the update.  The chunk data in the temporary file has
+    // already been read.
+    if (!FileRewind(new_file_.get()))
+      return false;
 
-  // Write a file header.
-  FileHeader header;
-  header.magic = kFileMagic;
-  header.version = kFileVersion;
-  header.add_chunk_count = add_chunks_cache_.size();
-  header.sub_chunk_count = sub_chunks_cache_.size();
-  header.add_prefix_count = add_prefixes.size();
-  header.sub_prefix_count = sub_prefixes.size();
-  header.add_hash_count = add_full_hashes.size();
-  header.sub_hash_count = sub_full_hashes.size();
-  if (!WriteItem(header, new_file_.get(), &context))
-    return false;
+    base::MD5Context context;
+    base::MD5Init(&context);
 
-  // Write all the chunk data.
-  if (!WriteContainer(add_chunks_cache_, new_file_.get(), &context) ||
-      !WriteContainer(sub_chunks_cache_, new_file_.get(), &context) ||
-      !WriteContainer(add_prefixes, new_file_.get(), &context) ||
-      !WriteContainer(sub_prefixes, new_file_.get(), &context) ||
-      !WriteContainer(add_full_hashes, new_file_.get(), &context) ||
-      !WriteContainer(sub_full_hashes, new_file_.get(), &context))
-    return false;
+    // Write a file header.
+    FileHeader header;
+    header.magic = kFileMagic;
+    header.version = kFileVersion;
+    header.add_chunk_count = add_chunks_cache_.size();
+    header.sub_chunk_count = sub_chunks_cache_.size();
+    header.add_prefix_count = items.add_prefixes.size();
+    header.sub_prefix_count = items.sub_prefixes.size();
+    header.add_hash_count = items.add_full_hashes.size();
+    header.sub_hash_count = items.sub_full_hashes.size();
+    if (!WriteItem(header, new_file_.get(), &context))
+      return false;
 
-  // Write the checksum at the end.
-  base::MD5Digest digest;
-  base::MD5Final(&digest, &context);
-  if (!WriteItem(digest, new_file_.get(), NULL))
-    return false;
+    // Write all the chunk data.
+    if (!WriteContainer(add_chunks_cache_, new_file_.get(), &context) ||
+        !WriteContainer(sub_chunks_cache_, new_file_.get(), &context) ||
+        !WriteStoreItems(items, new_file_.get(), &context))
+      return false;
 
-  // Trim any excess left over from the temporary chunk data.
-  if (!file_util::TruncateFile(new_file_.get()))
-    return false;
+    // Write the checksum at the end.
+    base::MD5Digest digest;
+    base::MD5Final(&digest, &context);
+    if (!WriteItem(digest, new_file_.get(), NULL))
+      return false;
 
-  // Close the file handle and swizzle the file into place.
-  new_file_.reset();
-  if (!base::DeleteFile(filename_, false) &&
-      base::PathExists(filename_))
-    return false;
+    // Trim any excess left over from the temporary chunk data.
+    if (!file_util::TruncateFile(new_file_.get()))
+      return false;
 
-  const base::FilePath new_filename = TemporaryFileForFilename(filename_);
-  if (!base::Move(new_filename, filename_))
-    return false;
+    // Close the file handle and swizzle the file into place.
+    // base::Move() replaces the original file in one step.
+    new_file_.reset();
+    if (!base::Move(new_filename, filename_))
+      return false;
+  }
 
   // Record counts before swapping to caller.
-  UMA_HISTOGRAM_COUNTS("SB2.AddPrefixes", add_prefixes.size());
-  UMA_HISTOGRAM_COUNTS("SB2.SubPrefixes", sub_prefixes.size());
+  UMA_HISTOGRAM_COUNTS("SB2.AddPrefixes", items.add_prefixes.size());
+  UMA_HISTOGRAM_COUNTS("SB2.SubPrefixes", items.sub_prefixes.size());
+  UMA_HISTOGRAM_BOOLEAN("SB2.StoreCompacted", compact_);
 
   // Pass the resulting data off to the caller.
-  add_prefixes_result->swap(add_prefixes);
-  add_full_hashes_result->swap(add_full_hashes);
+  add_prefixes_result->swap(items.add_prefixes);
+  add_full_hashes_result->swap(items.add_full_hashes);
 
   return true;
 }
@@ -53,6 +53,39 @@
 // }
 // MD5Digest checksum;      // Checksum over preceeding data.
 //
+// That is the base segment.  Rather than rewriting the file, an
+// update can append its changes as a delta segment:
+//
+// int32 magic;             // kDeltaMagic, distinct from the file magic
+//
+// uint32 add_chunk_count;   // Chunks seen as of this update.
+// uint32 sub_chunk_count;
+//
+// // Counts for the items the update added.
+// uint32 add_prefix_count;
+// uint32 sub_prefix_count;
+// uint32 add_hash_count;
+// uint32 sub_hash_count;
+//
+// // Counts for the items the update removed.
+// uint32 removed_add_prefix_count;
+// uint32 removed_sub_prefix_count;
+// uint32 removed_add_hash_count;
+// uint32 removed_sub_hash_count;
+//
+// array[add_chunk_count] { int32 chunk_id; }
+// array[sub_chunk_count] { int32 chunk_id; }
+// The added items, then the removed items, laid out as above.
+// MD5Digest checksum;      // Checksum over the delta segment.
+//
+// The file's data is the base segment's items plus every delta
+// segment's added items, minus their removed items, with the
+// chunks-seen data from the last segment.  A delta segment which runs
+// past the end of the file was cut off by a crash while it was being
+// appended, and is ignored.  Once the delta segments have grown too
+// large relative to the base segment, an update compacts the file,
+// writing all of the data as a new base segment.
+//
 // During the course of an update, uncommitted data is stored in a
 // temporary file (which is later re-used to commit).  This is an
 // array of chunks, with the count kept in memory until the end of the
@@ -86,16 +119,25 @@
 // }
 //
 // The overall transaction works like this:
-// - Open the original file to get the chunks-seen data.
+// - Open the original file to get the chunks-seen data, and decide
+//   from the sizes of its segments whether to compact it.
 // - Open a temp file for storing new chunk info.
 // - Write new chunks to the temp file.
 // - When the transaction is finished:
-//   - Read the rest of the original file's data into buffers.
-//   - Rewind the temp file and merge the new data into buffers.
-//   - Process buffers for deletions and apply subs.
-//   - Rewind and write the buffers out to temp file.
-//   - Delete original file.
-//   - Rename temp file to original filename.
+//   - Rewind the temp file and read the new data.
+//   - Read the rest of the original file's data into buffers.  Unless
+//     compacting, only the subs the new data or the deleted chunks
+//     can interact with are kept.
+//   - Process the new data, along with the original data it shares
+//     add chunks and prefixes with or which is in deleted chunks,
+//     for deletions and subs, and apply the result to the buffers.
+//   - Either:
+//     - Append the differences to the original file as a delta
+//       segment, after its last complete segment, and flush it to
+//       disk.  Delete the temp file.
+//   - Or, to compact the file:
+//     - Rewind and write the buffers out to temp file.
+//     - Rename temp file to original filename.
 
 // TODO(shess): By using a checksum, this code can avoid doing an
 // fsync(), at the possible cost of more frequently retrieving the
@@ -203,6 +245,10 @@ class SafeBrowsingStoreFile : public SafeBrowsingStore {
     FORMAT_EVENT_VALIDITY_CHECKSUM_FAILURE,
     FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE,
 
+    // The checksum did not check out in GetAddPrefixes() or
+    // GetAddFullHashes().
+    FORMAT_EVENT_READ_CHECKSUM_FAILURE,
+
     // Memory space for histograms is determined by the max.  ALWAYS
     // ADD NEW VALUES BEFORE THIS ONE.
     FORMAT_EVENT_MAX
@@ -219,6 +265,21 @@ class SafeBrowsingStoreFile : public SafeBrowsingStore {
   // practically speaking that code doesn't touch files directly.
   static void CheckForOriginalAndDelete(const base::FilePath& filename);
 
+  // The data in the main database file.  Defined in the .cc.
+  struct StoreContents;
+
+  // Selects the stored subs an update needs.  Defined in the .cc.
+  class SubFilter;
+
+  // Reads the main database file |fp| into |contents|, verifying its
+  // checksums.  If |sub_filter| is non-NULL, only the subs it selects
+  // are kept.  On failure, records |checksum_failure_event| if a
+  // checksum did not check out, and calls the corruption callback.
+  bool ReadStore(FILE* fp,
+                 FormatEventType checksum_failure_event,
+                 const SubFilter* sub_filter,
+                 StoreContents* contents);
+
   // Close all files and clear all buffers.
   bool Close();
 
@@ -272,6 +333,11 @@ class SafeBrowsingStoreFile : public SafeBrowsingStore {
   file_util::ScopedFILE new_file_;
   bool empty_;
 
+  // Whether the update rewrites the main file as a single base
+  // segment, rather than appending a delta segment to it.  Decided by
+  // BeginUpdate() from the sizes of the segments.
+  bool compact_;
+
   // Cache of chunks which have been seen.  Loaded from the database
   // on BeginUpdate() so that it can be queried during the
   // transaction.
@@ -4,6 +4,8 @@
 
 #include "chrome/browser/safe_browsing/safe_browsing_store_file.h"
 
+#include <string>
+
 #include "base/bind.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/md5.h"
@@ -44,6 +46,31 @@ class SafeBrowsingStoreFileTest : public PlatformTest {
     corruption_detected_ = true;
   }
 
+  // Run an update which adds |count| prefixes starting at |prefix| in
+  // add chunk |chunk_id|, putting the resulting add prefixes in
+  // |add_prefixes|.
+  void AddPrefixes(int32 chunk_id, SBPrefix prefix, int count,
+                   SBAddPrefixes* add_prefixes) {
+    EXPECT_TRUE(store_->BeginUpdate());
+    EXPECT_TRUE(store_->BeginChunk());
+    store_->SetAddChunk(chunk_id);
+    for (int i = 0; i < count; ++i)
+      EXPECT_TRUE(store_->WriteAddPrefix(chunk_id, prefix + i));
+    EXPECT_TRUE(store_->FinishChunk());
+
+    std::vector<SBAddFullHash> pending_adds;
+    std::set<SBPrefix> prefix_misses;
+    std::vector<SBAddFullHash> add_hashes;
+    EXPECT_TRUE(store_->FinishUpdate(pending_adds, prefix_misses,
+                                     add_prefixes, &add_hashes));
+  }
+
+  int64 StoreSize() {
+    int64 size = 0;
+    EXPECT_TRUE(file_util::GetFileSize(filename_, &size));
+    return size;
+  }
+
   base::ScopedTempDir temp_dir_;
   base::FilePath filename_;
   scoped_ptr<SafeBrowsingStoreFile> store_;
@@ -193,4 +220,217 @@ TEST_F(SafeBrowsingStoreFileTest, CheckValidityChecksum) {
   EXPECT_TRUE(store_->CancelUpdate());
 }
 
+// Test that small updates are appended to the file, and that the
+// file is compacted once they add up.
+TEST_F(SafeBrowsingStoreFileTest, DeltaSegments) {
+  // The first update writes the base segment.
+  SBAddPrefixes add_prefixes;
+  AddPrefixes(1, 0, 1000, &add_prefixes);
+  EXPECT_EQ(1000U, add_prefixes.size());
+  const int64 base_size = StoreSize();
+
+  // Add a chunk and knock out one of the first chunk's prefixes.
+  EXPECT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(2);
+  EXPECT_TRUE(store_->WriteAddPrefix(2, 5000));
+  store_->SetSubChunk(3);
+  EXPECT_TRUE(store_->WriteSubPrefix(3, 1, 7));
+  EXPECT_TRUE(store_->FinishChunk());
+  std::vector<SBAddFullHash> pending_adds;
+  std::set<SBPrefix> prefix_misses;
+  std::vector<SBAddFullHash> add_hashes;
+  EXPECT_TRUE(store_->FinishUpdate(pending_adds, prefix_misses,
+                                   &add_prefixes, &add_hashes));
+  EXPECT_EQ(1000U, add_prefixes.size());
+
+  // The changes were appended, and the temporary file is gone.
+  const int64 delta_size = StoreSize() - base_size;
+  EXPECT_GT(delta_size, 0);
+  EXPECT_LT(delta_size, base_size / 10);
+  EXPECT_FALSE(base::PathExists(
+      SafeBrowsingStoreFile::TemporaryFileForFilename(filename_)));
+
+  // Reading the store applies the changes.
+  SBAddPrefixes read_prefixes;
+  EXPECT_TRUE(store_->GetAddPrefixes(&read_prefixes));
+  std::set<SBPrefix> prefixes;
+  for (SBAddPrefixes::const_iterator iter = read_prefixes.begin();
+       iter != read_prefixes.end(); ++iter) {
+    prefixes.insert(iter->prefix);
+  }
+  EXPECT_EQ(1000U, prefixes.size());
+  EXPECT_EQ(1U, prefixes.count(5000));
+  EXPECT_EQ(0U, prefixes.count(7));
+
+  // The chunks-seen data comes from the delta segment.
+  EXPECT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->CheckAddChunk(1));
+  EXPECT_TRUE(store_->CheckAddChunk(2));
+  EXPECT_TRUE(store_->CheckSubChunk(3));
+  EXPECT_TRUE(store_->CheckValidity());
+
+  // Items can be removed by a later delta segment.
+  store_->DeleteAddChunk(2);
+  EXPECT_TRUE(store_->FinishUpdate(pending_adds, prefix_misses,
+                                   &add_prefixes, &add_hashes));
+  EXPECT_EQ(999U, add_prefixes.size());
+  EXPECT_TRUE(store_->GetAddPrefixes(&read_prefixes));
+  EXPECT_EQ(999U, read_prefixes.size());
+
+  // Enough updates compact the file, without changing the data.
+  bool compacted = false;
+  for (int i = 0; i < 20; ++i) {
+    const int64 size = StoreSize();
+    AddPrefixes(10 + i, 10000 + i * 10, 10, &add_prefixes);
+    EXPECT_EQ(999U + (i + 1) * 10, add_prefixes.size());
+    if (StoreSize() < size)
+      compacted = true;
+  }
+  EXPECT_TRUE(compacted);
+  EXPECT_TRUE(store_->GetAddPrefixes(&read_prefixes));
+  EXPECT_EQ(1199U, read_prefixes.size());
+  EXPECT_FALSE(corruption_detected_);
+}
+
+// Test that a delta segment processes the subs against the original
+// data in both directions.
+TEST_F(SafeBrowsingStoreFileTest, DeltaSubsAndAdds) {
+  SBAddPrefixes add_prefixes;
+  AddPrefixes(1, 0, 1000, &add_prefixes);
+
+  // A full hash for a prefix in the first chunk, and a sub for a
+  // chunk which has not arrived yet.
+  EXPECT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetSubChunk(3);
+  EXPECT_TRUE(store_->WriteSubPrefix(3, 2, 9000));
+  EXPECT_TRUE(store_->FinishChunk());
+  std::vector<SBAddFullHash> pending_adds;
+  SBFullHash full_hash = SBFullHashFromString("www.example.com/");
+  full_hash.prefix = 7;
+  pending_adds.push_back(SBAddFullHash(1, base::Time::Now(), full_hash));
+  std::set<SBPrefix> prefix_misses;
+  std::vector<SBAddFullHash> add_hashes;
+  EXPECT_TRUE(store_->FinishUpdate(pending_adds, prefix_misses,
+                                   &add_prefixes, &add_hashes));
+  EXPECT_EQ(1000U, add_prefixes.size());
+  EXPECT_EQ(1U, add_hashes.size());
+
+  // The stored sub knocks out the add when it arrives, and a new sub
+  // knocks out a stored prefix along with its full hash.
+  EXPECT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(2);
+  EXPECT_TRUE(store_->WriteAddPrefix(2, 9000));
+  EXPECT_TRUE(store_->WriteAddPrefix(2, 9001));
+  store_->SetSubChunk(4);
+  EXPECT_TRUE(store_->WriteSubPrefix(4, 1, 7));
+  EXPECT_TRUE(store_->FinishChunk());
+  pending_adds.clear();
+  EXPECT_TRUE(store_->FinishUpdate(pending_adds, prefix_misses,
+                                   &add_prefixes, &add_hashes));
+  EXPECT_EQ(1000U, add_prefixes.size());
+  EXPECT_TRUE(add_hashes.empty());
+
+  SBAddPrefixes read_prefixes;
+  EXPECT_TRUE(store_->GetAddPrefixes(&read_prefixes));
+  std::set<SBPrefix> prefixes;
+  for (SBAddPrefixes::const_iterator iter = read_prefixes.begin();
+       iter != read_prefixes.end(); ++iter) {
+    prefixes.insert(iter->prefix);
+  }
+  EXPECT_EQ(1000U, prefixes.size());
+  EXPECT_EQ(0U, prefixes.count(7));
+  EXPECT_EQ(0U, prefixes.count(9000));
+  EXPECT_EQ(1U, prefixes.count(9001));
+  EXPECT_TRUE(store_->GetAddFullHashes(&add_hashes));
+  EXPECT_TRUE(add_hashes.empty());
+  EXPECT_FALSE(corruption_detected_);
+}
+
+// Test that a delta segment cut off by a crash is ignored.
+TEST_F(SafeBrowsingStoreFileTest, IncompleteDeltaSegment) {
+  SBAddPrefixes add_prefixes;
+  AddPrefixes(1, 0, 1000, &add_prefixes);
+  AddPrefixes(2, 5000, 1, &add_prefixes);
+  EXPECT_EQ(1001U, add_prefixes.size());
+
+  // Chop off the end of the delta segment.
+  {
+    file_util::ScopedFILE file(file_util::OpenFile(filename_, "rb+"));
+    EXPECT_EQ(0, fseek(file.get(), -1, SEEK_END));
+    EXPECT_TRUE(file_util::TruncateFile(file.get()));
+  }
+
+  // The store is as it was before the update.
+  EXPECT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->CheckAddChunk(1));
+  EXPECT_FALSE(store_->CheckAddChunk(2));
+  EXPECT_TRUE(store_->CheckValidity());
+  EXPECT_TRUE(store_->CancelUpdate());
+  EXPECT_TRUE(store_->GetAddPrefixes(&add_prefixes));
+  EXPECT_EQ(1000U, add_prefixes.size());
+
+  // The next update replaces the incomplete segment.
+  AddPrefixes(2, 5000, 1, &add_prefixes);
+  EXPECT_EQ(1001U, add_prefixes.size());
+  EXPECT_TRUE(store_->GetAddPrefixes(&add_prefixes));
+  EXPECT_EQ(1001U, add_prefixes.size());
+  EXPECT_FALSE(corruption_detected_);
+}
+
+// Test that an appended segment leaves the complete segments alone,
+// and cuts off an incomplete one longer than itself.
+TEST_F(SafeBrowsingStoreFileTest, AppendCutsIncompleteTail) {
+  SBAddPrefixes add_prefixes;
+  AddPrefixes(1, 0, 1000, &add_prefixes);
+  const int64 base_size = StoreSize();
+  std::string base_data;
+  EXPECT_TRUE(file_util::ReadFileToString(filename_, &base_data));
+
+  AddPrefixes(2, 5000, 100, &add_prefixes);
+  const int64 long_size = StoreSize();
+  {
+    file_util::ScopedFILE file(file_util::OpenFile(filename_, "rb+"));
+    EXPECT_EQ(0, fseek(file.get(), -1, SEEK_END));
+    EXPECT_TRUE(file_util::TruncateFile(file.get()));
+  }
+
+  AddPrefixes(3, 6000, 1, &add_prefixes);
+  EXPECT_EQ(1001U, add_prefixes.size());
+  EXPECT_LT(StoreSize(), long_size);
+
+  std::string data;
+  EXPECT_TRUE(file_util::ReadFileToString(filename_, &data));
+  EXPECT_EQ(base_data, data.substr(0, static_cast<size_t>(base_size)));
+
+  EXPECT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->CheckAddChunk(1));
+  EXPECT_FALSE(store_->CheckAddChunk(2));
+  EXPECT_TRUE(store_->CheckAddChunk(3));
+  EXPECT_TRUE(store_->CheckValidity());
+  EXPECT_TRUE(store_->CancelUpdate());
+  EXPECT_FALSE(corruption_detected_);
+}
+
+// Corrupt the checksum of a delta segment.
+TEST_F(SafeBrowsingStoreFileTest, CheckValidityDeltaChecksum) {
+  SBAddPrefixes add_prefixes;
+  AddPrefixes(1, 0, 1000, &add_prefixes);
+  AddPrefixes(2, 5000, 1, &add_prefixes);
+
+  const int kOffset = -static_cast<int>(sizeof(base::MD5Digest));
+  {
+    file_util::ScopedFILE file(file_util::OpenFile(filename_, "rb+"));
+    EXPECT_EQ(0, fseek(file.get(), kOffset, SEEK_END));
+    EXPECT_GE(fputs("hello", file.get()), 0);
+  }
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_FALSE(corruption_detected_);
+  EXPECT_FALSE(store_->CheckValidity());
+  EXPECT_TRUE(corruption_detected_);
+  EXPECT_TRUE(store_->CancelUpdate());
+}
+
 }  // namespace
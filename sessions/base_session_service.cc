@@ -77,7 +77,8 @@ BaseSessionService::BaseSessionService(SessionType type,
     : profile_(profile),
       weak_factory_(this),
       pending_reset_(false),
-      commands_since_reset_(0),
+      bytes_since_reset_(0),
+      last_reset_bytes_(0),
       sequence_token_(
           content::BrowserThread::GetBlockingPool()->GetSequenceToken()) {
   if (profile) {
@@ -99,7 +100,7 @@ void BaseSessionService::DeleteLastSession() {
 
 void BaseSessionService::ScheduleCommand(SessionCommand* command) {
   DCHECK(command);
-  commands_since_reset_++;
+  bytes_since_reset_ += command->size();
   pending_commands_.push_back(command);
   StartSaveTimer();
 }
@@ -122,6 +123,12 @@ void BaseSessionService::Save() {
   if (pending_commands_.empty())
     return;
 
+  if (pending_reset_) {
+    last_reset_bytes_ = 0;
+    for (size_t i = 0; i < pending_commands_.size(); ++i)
+      last_reset_bytes_ += pending_commands_[i]->size();
+  }
+
   RunTaskOnBackendThread(
       FROM_HERE,
       base::Bind(&SessionBackend::AppendCommands, backend(),
@@ -132,7 +139,7 @@ void BaseSessionService::Save() {
   pending_commands_.clear();
 
   if (pending_reset_) {
-    commands_since_reset_ = 0;
+    bytes_since_reset_ = 0;
     pending_reset_ = false;
   }
 }
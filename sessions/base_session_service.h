@@ -74,8 +74,10 @@ class BaseSessionService : public CancelableRequestProvider {
   void set_pending_reset(bool value) { pending_reset_ = value; }
   bool pending_reset() const { return pending_reset_; }
 
-  // Returns the number of commands sent down since the last reset.
-  int commands_since_reset() const { return commands_since_reset_; }
+  // Returns the bytes of the commands sent down since the last reset, and
+  // of those the last reset wrote.
+  size_t bytes_since_reset() const { return bytes_since_reset_; }
+  size_t last_reset_bytes() const { return last_reset_bytes_; }
 
   // Schedules a command. This adds |command| to pending_commands_ and
   // invokes StartSaveTimer to start a timer that invokes Save at a later
@@ -182,8 +184,10 @@ class BaseSessionService : public CancelableRequestProvider {
   // over the commands.
   bool pending_reset_;
 
-  // The number of commands sent to the backend before doing a reset.
-  int commands_since_reset_;
+  // The bytes of the commands sent to the backend since the last reset, and
+  // of the commands the last reset wrote.
+  size_t bytes_since_reset_;
+  size_t last_reset_bytes_;
 
   // A token to make sure that all tasks will be serialized.
   base::SequencedWorkerPool::SequenceToken sequence_token_;
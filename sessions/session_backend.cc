@@ -7,16 +7,24 @@
 #include <limits>
 
 #include "base/file_util.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/files/important_file_writer.h"
 #include "base/memory/scoped_vector.h"
 #include "base/metrics/histogram.h"
 #include "base/threading/thread_restrictions.h"
 #include "net/base/file_stream.h"
 #include "net/base/net_errors.h"
+#include "third_party/zlib/zlib.h"
 
+using base::TimeDelta;
 using base::TimeTicks;
 
-// File version number.
-static const int32 kFileCurrentVersion = 1;
+// File version number. Version 2 follows each command with a checksum, and
+// may hold snapshots after the first.
+static const int32 kFileCurrentVersion = 2;
+
+// Version of files without checksums, which are still read.
+static const int32 kFileVersionWithoutChecksums = 1;
 
 // The signature at the beginning of the file = SSNS (Sessions).
 static const int32 kFileSignature = 0x53534E53;
@@ -30,11 +38,42 @@ struct FileHeader {
   int32 version;
 };
 
+// A command with this id starts a snapshot, which holds the whole state of
+// the session as of when it was written; its payload is the number of
+// commands in the snapshot, which follow it. Reading a file starts at the
+// newest complete snapshot. The services use small ids for their commands.
+const SessionCommand::id_type kSnapshotCommandId = 0xFF;
+
+uint32 Checksum(const char* data, size_t size) {
+  return crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(data),
+               size);
+}
+
+// Appends a record for a command to |data|: the size of the id and
+// contents, the id, the contents, and then a checksum of the id and
+// contents.
+void AppendRecord(SessionCommand::id_type id,
+                  const char* contents,
+                  SessionCommand::size_type content_size,
+                  std::string* data) {
+  const SessionCommand::size_type total_size = content_size + sizeof(id);
+  data->append(reinterpret_cast<const char*>(&total_size),
+               sizeof(total_size));
+  const size_t checked_start = data->size();
+  data->append(reinterpret_cast<const char*>(&id), sizeof(id));
+  data->append(contents, content_size);
+  const uint32 checksum = Checksum(data->data() + checked_start, total_size);
+  data->append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+}
+
 // SessionFileReader ----------------------------------------------------------
 
 // SessionFileReader is responsible for reading the set of SessionCommands that
 // describe a Session back from a file. SessionFileRead does minimal error
 // checking on the file (pretty much only that the header is valid).
+//
+// The file is memory mapped, so each command is copied once, straight from
+// the mapping into the SessionCommand.
 
 class SessionFileReader {
  public:
@@ -42,14 +81,10 @@ class SessionFileReader {
   typedef SessionCommand::size_type size_type;
 
   explicit SessionFileReader(const base::FilePath& path)
-      : errored_(false),
-        buffer_(SessionBackend::kFileReadBufferSize, 0),
-        buffer_position_(0),
-        available_count_(0) {
-    file_.reset(new net::FileStream(NULL));
+      : checksummed_(false),
+        position_(0) {
     if (base::PathExists(path))
-      file_->OpenSync(path,
-                      base::PLATFORM_FILE_OPEN | base::PLATFORM_FILE_READ);
+      file_.Initialize(path);
   }
   // Reads the contents of the file specified in the constructor, returning
   // true on success. It is up to the caller to free all SessionCommands
@@ -59,54 +94,87 @@ class SessionFileReader {
 
  private:
   // Reads a single command, returning it. A return value of NULL indicates
-  // either there are no commands, or there was an error. Use errored_ to
-  // distinguish the two. If NULL is returned, and there is no error, it means
-  // the end of file was successfully reached.
+  // there are no more commands: either the end of file was reached, or the
+  // rest of the file is incomplete or corrupt.
   SessionCommand* ReadCommand();
 
-  // Shifts the unused portion of buffer_ to the beginning and fills the
-  // remaining portion with data from the file. Returns false if the buffer
-  // couldn't be filled. A return value of false only signals an error if
-  // errored_ is set to true.
-  bool FillBuffer();
+  // Returns the data of the file from position_ on.
+  const char* current() const {
+    return reinterpret_cast<const char*>(file_.data()) + position_;
+  }
 
-  // Whether an error condition has been detected (
-  bool errored_;
+  // Number of bytes of the file from position_ on.
+  size_t available() const { return file_.length() - position_; }
 
-  // As we read from the file, data goes here.
-  std::string buffer_;
+  // Whether each command is followed by a checksum.
+  bool checksummed_;
 
   // The file.
-  scoped_ptr<net::FileStream> file_;
-
-  // Position in buffer_ of the data.
-  size_t buffer_position_;
+  base::MemoryMappedFile file_;
 
-  // Number of available bytes; relative to buffer_position_.
-  size_t available_count_;
+  // Position in the file of the next command.
+  size_t position_;
 
   DISALLOW_COPY_AND_ASSIGN(SessionFileReader);
 };
 
 bool SessionFileReader::Read(BaseSessionService::SessionType type,
                              std::vector<SessionCommand*>* commands) {
-  if (!file_->IsOpen())
+  if (!file_.IsValid())
     return false;
   FileHeader header;
-  int read_count;
   TimeTicks start_time = TimeTicks::Now();
-  read_count = file_->ReadUntilComplete(reinterpret_cast<char*>(&header),
-                                        sizeof(header));
-  if (read_count != sizeof(header) || header.signature != kFileSignature ||
-      header.version != kFileCurrentVersion)
+  if (available() < sizeof(header))
     return false;
+  memcpy(&header, current(), sizeof(header));
+  position_ += sizeof(header);
+  if (header.signature != kFileSignature ||
+      (header.version != kFileCurrentVersion &&
+       header.version != kFileVersionWithoutChecksums))
+    return false;
+  checksummed_ = header.version == kFileCurrentVersion;
 
   ScopedVector<SessionCommand> read_commands;
+  // Where in |read_commands| the snapshot being read starts, and how many of
+  // its commands are still to come.
+  size_t snapshot_start = 0;
+  uint32 snapshot_remaining = 0;
   SessionCommand* command;
-  while ((command = ReadCommand()) && !errored_)
-    read_commands.push_back(command);
-  if (!errored_)
-    read_commands.swap(*commands);
+  while ((command = ReadCommand())) {
+    if (checksummed_ && command->id() == kSnapshotCommandId) {
+      uint32 snapshot_size = 0;
+      const bool valid =
+          command->GetPayload(&snapshot_size, sizeof(snapshot_size));
+      delete command;
+      if (!valid) {
+        VLOG(1) << "SessionFileReader::Read, bad snapshot";
+        break;
+      }
+      if (snapshot_remaining > 0) {
+        // Drop the previous snapshot, which was cut short.
+        read_commands.erase(read_commands.begin() + snapshot_start,
+                            read_commands.end());
+      }
+      snapshot_start = read_commands.size();
+      snapshot_remaining = snapshot_size;
+    } else {
+      read_commands.push_back(command);
+      if (snapshot_remaining > 0)
+        --snapshot_remaining;
+    }
+    if (snapshot_start > 0 && snapshot_remaining == 0) {
+      // The snapshot is complete, so the commands before it are out of date.
+      read_commands.erase(read_commands.begin(),
+                          read_commands.begin() + snapshot_start);
+      snapshot_start = 0;
+    }
+  }
+  if (snapshot_remaining > 0) {
+    VLOG(1) << "SessionFileReader::Read, last snapshot incomplete";
+    read_commands.erase(read_commands.begin() + snapshot_start,
+                        read_commands.end());
+  }
+  read_commands.swap(*commands);
   if (type == BaseSessionService::TAB_RESTORE) {
     UMA_HISTOGRAM_TIMES("TabRestore.read_session_file_time",
                         TimeTicks::Now() - start_time);
@@ -114,26 +182,22 @@ bool SessionFileReader::Read(BaseSessionService::SessionType type,
     UMA_HISTOGRAM_TIMES("SessionRestore.read_session_file_time",
                         TimeTicks::Now() - start_time);
   }
-  return !errored_;
+  return true;
 }
 
 SessionCommand* SessionFileReader::ReadCommand() {
-  // Make sure there is enough in the buffer for the size of the next command.
-  if (available_count_ < sizeof(size_type)) {
-    if (!FillBuffer())
-      return NULL;
-    if (available_count_ < sizeof(size_type)) {
+  if (available() < sizeof(size_type)) {
+    if (available() > 0) {
       VLOG(1) << "SessionFileReader::ReadCommand, file incomplete";
-      // Still couldn't read a valid size for the command, assume write was
+      // Couldn't read a valid size for the command, assume write was
       // incomplete and return NULL.
-      return NULL;
     }
+    return NULL;
   }
   // Get the size of the command.
   size_type command_size;
-  memcpy(&command_size, &(buffer_[buffer_position_]), sizeof(command_size));
-  buffer_position_ += sizeof(command_size);
-  available_count_ -= sizeof(command_size);
+  memcpy(&command_size, current(), sizeof(command_size));
+  position_ += sizeof(command_size);
 
   if (command_size == 0) {
     VLOG(1) << "SessionFileReader::ReadCommand, empty command";
@@ -141,51 +205,38 @@ SessionCommand* SessionFileReader::ReadCommand() {
     return NULL;
   }
 
-  // Make sure buffer has the complete contents of the command.
-  if (command_size > available_count_) {
-    if (command_size > buffer_.size())
-      buffer_.resize((command_size / 1024 + 1) * 1024, 0);
-    if (!FillBuffer() || command_size > available_count_) {
-      // Again, assume the file was ok, and just the last chunk was lost.
-      VLOG(1) << "SessionFileReader::ReadCommand, last chunk lost";
+  // Make sure the file has the complete contents of the command.
+  const size_t record_size =
+      command_size + (checksummed_ ? sizeof(uint32) : 0);
+  if (record_size > available()) {
+    // Assume the file was ok, and just the last chunk was lost.
+    VLOG(1) << "SessionFileReader::ReadCommand, last chunk lost";
+    return NULL;
+  }
+  const char* record = current();
+  if (checksummed_) {
+    uint32 checksum;
+    memcpy(&checksum, record + command_size, sizeof(checksum));
+    if (checksum != Checksum(record, command_size)) {
+      // Treat the rest of the file as lost, like a chunk which was never
+      // written.
+      VLOG(1) << "SessionFileReader::ReadCommand, bad checksum";
       return NULL;
     }
   }
-  const id_type command_id = buffer_[buffer_position_];
+  const id_type command_id = record[0];
   // NOTE: command_size includes the size of the id, which is not part of
   // the contents of the SessionCommand.
   SessionCommand* command =
       new SessionCommand(command_id, command_size - sizeof(id_type));
   if (command_size > sizeof(id_type)) {
-    memcpy(command->contents(),
-           &(buffer_[buffer_position_ + sizeof(id_type)]),
+    memcpy(command->contents(), record + sizeof(id_type),
            command_size - sizeof(id_type));
   }
-  buffer_position_ += command_size;
-  available_count_ -= command_size;
+  position_ += record_size;
   return command;
 }
 
-bool SessionFileReader::FillBuffer() {
-  if (available_count_ > 0 && buffer_position_ > 0) {
-    // Shift buffer to beginning.
-    memmove(&(buffer_[0]), &(buffer_[buffer_position_]), available_count_);
-  }
-  buffer_position_ = 0;
-  DCHECK(buffer_position_ + available_count_ < buffer_.size());
-  int to_read = static_cast<int>(buffer_.size() - available_count_);
-  int read_count = file_->ReadUntilComplete(&(buffer_[available_count_]),
-                                            to_read);
-  if (read_count < 0) {
-    errored_ = true;
-    return false;
-  }
-  if (read_count == 0)
-    return false;
-  available_count_ += read_count;
-  return true;
-}
-
 }  // namespace
 
 // SessionBackend -------------------------------------------------------------
@@ -198,16 +249,14 @@ static const char* kLastTabSessionFileName = "Last Tabs";
 static const char* kCurrentSessionFileName = "Current Session";
 static const char* kLastSessionFileName = "Last Session";
 
-// static
-const int SessionBackend::kFileReadBufferSize = 1024;
-
 SessionBackend::SessionBackend(BaseSessionService::SessionType type,
                                const base::FilePath& path_to_dir)
     : type_(type),
       path_to_dir_(path_to_dir),
       last_session_valid_(false),
       inited_(false),
-      empty_file_(true) {
+      empty_file_(true),
+      bytes_written_in_period_(0) {
   // NOTE: this is invoked on the main thread, don't do file access here.
 }
 
@@ -227,16 +276,19 @@ void SessionBackend::AppendCommands(
     std::vector<SessionCommand*>* commands,
     bool reset_first) {
   Init();
-  // Make sure and check current_session_file_, if opening the file failed
-  // current_session_file_ will be NULL.
-  if ((reset_first && !empty_file_) || !current_session_file_.get() ||
-      !current_session_file_->IsOpen()) {
-    ResetFile();
-  }
-  // Need to check current_session_file_ again, ResetFile may fail.
-  if (current_session_file_.get() && current_session_file_->IsOpen() &&
-      !AppendCommandsToFile(current_session_file_.get(), *commands)) {
-    current_session_file_.reset(NULL);
+  if (reset_first && !empty_file_) {
+    if (!WriteSnapshot(*commands))
+      current_session_file_.reset(NULL);
+  } else {
+    // Make sure and check current_session_file_, if opening the file failed
+    // current_session_file_ will be NULL.
+    if (!current_session_file_.get() || !current_session_file_->IsOpen())
+      ResetFile();
+    // Need to check current_session_file_ again, ResetFile may fail.
+    if (current_session_file_.get() && current_session_file_->IsOpen() &&
+        !AppendCommandsToFile(current_session_file_.get(), *commands)) {
+      current_session_file_.reset(NULL);
+    }
   }
   empty_file_ = false;
   STLDeleteElements(commands);
@@ -306,45 +358,101 @@ bool SessionBackend::ReadCurrentSessionCommandsImpl(
 
 bool SessionBackend::AppendCommandsToFile(net::FileStream* file,
     const std::vector<SessionCommand*>& commands) {
+  std::string data;
+  EncodeCommands(commands, &data);
+  return WriteToFile(file, data);
+}
+
+void SessionBackend::EncodeCommands(
+    const std::vector<SessionCommand*>& commands,
+    std::string* data) {
   for (std::vector<SessionCommand*>::const_iterator i = commands.begin();
        i != commands.end(); ++i) {
-    int wrote;
+    DCHECK_NE(kSnapshotCommandId, (*i)->id());
     const size_type content_size = static_cast<size_type>((*i)->size());
     const size_type total_size =  content_size + sizeof(id_type);
     if (type_ == BaseSessionService::TAB_RESTORE)
       UMA_HISTOGRAM_COUNTS("TabRestore.command_size", total_size);
     else
       UMA_HISTOGRAM_COUNTS("SessionRestore.command_size", total_size);
-    wrote = file->WriteSync(reinterpret_cast<const char*>(&total_size),
-                            sizeof(total_size));
-    if (wrote != sizeof(total_size)) {
-      NOTREACHED() << "error writing";
-      return false;
-    }
-    id_type command_id = (*i)->id();
-    wrote = file->WriteSync(reinterpret_cast<char*>(&command_id),
-                            sizeof(command_id));
-    if (wrote != sizeof(command_id)) {
-      NOTREACHED() << "error writing";
-      return false;
-    }
-    if (content_size > 0) {
-      wrote = file->WriteSync(reinterpret_cast<char*>((*i)->contents()),
-                              content_size);
-      if (wrote != content_size) {
-        NOTREACHED() << "error writing";
-        return false;
-      }
-    }
+    AppendRecord((*i)->id(), (*i)->contents(), content_size, data);
+  }
+}
+
+bool SessionBackend::WriteToFile(net::FileStream* file,
+                                 const std::string& data) {
+  if (data.empty())
+    return true;
+  int wrote = file->WriteSync(data.data(), static_cast<int>(data.size()));
+  if (wrote != static_cast<int>(data.size())) {
+    NOTREACHED() << "error writing";
+    return false;
+  }
 #if defined(OS_CHROMEOS)
-    // TODO(gspencer): Remove this once we find a better place to do it.
-    // See issue http://crbug.com/245015
-    file->FlushSync();
+  // TODO(gspencer): Remove this once we find a better place to do it.
+  // See issue http://crbug.com/245015
+  file->FlushSync();
 #endif
-  }
+  RecordBytesWritten(data.size());
   return true;
 }
 
+bool SessionBackend::WriteSnapshot(
+    const std::vector<SessionCommand*>& commands) {
+  DCHECK(inited_);
+  std::string snapshot;
+  EncodeCommands(commands, &snapshot);
+
+  // Compact the file down to the snapshot, replacing it only once the new
+  // one is complete so that a crash leaves one or the other.
+  current_session_file_.reset(NULL);
+  const base::FilePath path = GetCurrentSessionPath();
+  FileHeader header;
+  header.signature = kFileSignature;
+  header.version = kFileCurrentVersion;
+  const std::string data =
+      std::string(reinterpret_cast<const char*>(&header), sizeof(header)) +
+      snapshot;
+  if (base::ImportantFileWriter::WriteFileAtomically(path, data)) {
+    RecordBytesWritten(data.size());
+    current_session_file_.reset(OpenForAppend(path));
+    return current_session_file_.get() != NULL;
+  }
+
+  // The old file is still there. Add the snapshot to it instead; reading
+  // the file skips what comes before the snapshot.
+  current_session_file_.reset(OpenForAppend(path));
+  if (!current_session_file_.get())
+    return false;
+  const uint32 snapshot_size = static_cast<uint32>(commands.size());
+  std::string marked_snapshot;
+  AppendRecord(kSnapshotCommandId,
+               reinterpret_cast<const char*>(&snapshot_size),
+               sizeof(snapshot_size), &marked_snapshot);
+  marked_snapshot += snapshot;
+  return WriteToFile(current_session_file_.get(), marked_snapshot);
+}
+
+void SessionBackend::RecordBytesWritten(size_t bytes) {
+  const TimeTicks now = TimeTicks::Now();
+  if (write_period_start_.is_null())
+    write_period_start_ = now;
+  bytes_written_in_period_ += bytes;
+  const TimeDelta elapsed = now - write_period_start_;
+  if (elapsed < TimeDelta::FromHours(1))
+    return;
+
+  const int kb_per_hour = static_cast<int>(
+      bytes_written_in_period_ * TimeDelta::FromHours(1).InMilliseconds() /
+      elapsed.InMilliseconds() / 1024);
+  if (type_ == BaseSessionService::TAB_RESTORE)
+    UMA_HISTOGRAM_COUNTS("TabRestore.kb_written_per_hour", kb_per_hour);
+  else
+    UMA_HISTOGRAM_COUNTS("SessionRestore.kb_written_per_hour", kb_per_hour);
+  write_period_start_ = now;
+  bytes_written_in_period_ = 0;
+}
+
 SessionBackend::~SessionBackend() {
   if (current_session_file_.get()) {
     // Destructor performs file IO because file is open in sync mode.
@@ -388,6 +496,17 @@ net::FileStream* SessionBackend::OpenAndWriteHeader(
   return file.release();
 }
 
+net::FileStream* SessionBackend::OpenForAppend(const base::FilePath& path) {
+  scoped_ptr<net::FileStream> file(new net::FileStream(NULL));
+  if (file->OpenSync(path, base::PLATFORM_FILE_OPEN |
+      base::PLATFORM_FILE_WRITE | base::PLATFORM_FILE_EXCLUSIVE_WRITE |
+      base::PLATFORM_FILE_EXCLUSIVE_READ) != net::OK)
+    return NULL;
+  if (file->SeekSync(net::FROM_END, 0) < 0)
+    return NULL;
+  return file.release();
+}
+
 base::FilePath SessionBackend::GetLastSessionPath() {
   base::FilePath path = path_to_dir_;
   if (type_ == BaseSessionService::TAB_RESTORE)
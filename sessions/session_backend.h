@@ -5,10 +5,12 @@
 #ifndef CHROME_BROWSER_SESSIONS_SESSION_BACKEND_H_
 #define CHROME_BROWSER_SESSIONS_SESSION_BACKEND_H_
 
+#include <string>
 #include <vector>
 
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/time/time.h"
 #include "chrome/browser/sessions/base_session_service.h"
 #include "chrome/browser/sessions/session_command.h"
 #include "chrome/common/cancelable_task_tracker.h"
@@ -29,16 +31,20 @@ class FileStream;
 // Each file contains an arbitrary set of commands supplied from
 // BaseSessionService. A command consists of a unique id and a stream of bytes.
 // SessionBackend does not use the id in anyway, that is used by
-// BaseSessionService.
+// BaseSessionService. Each command is written with a checksum, and reading
+// stops at the first command which does not match its checksum.
+//
+// Commands are appended to the current file until the service resets it
+// with a snapshot of its whole state. The file is then compacted: it is
+// replaced by one holding only the snapshot, written to the side so that a
+// crash leaves either the old file or the new one. If that fails the
+// snapshot is appended to the file instead, and reading the file returns
+// the newest complete snapshot and the commands after it.
 class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
  public:
   typedef SessionCommand::id_type id_type;
   typedef SessionCommand::size_type size_type;
 
-  // Initial size of the buffer used in reading the file. This is exposed
-  // for testing.
-  static const int kFileReadBufferSize;
-
   // Creates a SessionBackend. This method is invoked on the MAIN thread,
   // and does no IO. The real work is done from Init, which is invoked on
   // the file thread.
@@ -57,7 +63,7 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   bool inited() const { return inited_; }
 
   // Appends the specified commands to the current file. If reset_first is
-  // true the the current file is recreated.
+  // true the commands are a snapshot which replaces the current file.
   //
   // NOTE: this deletes SessionCommands in commands as well as the supplied
   // vector.
@@ -107,10 +113,30 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   // the file is returned.
   net::FileStream* OpenAndWriteHeader(const base::FilePath& path);
 
+  // Opens the file at |path| for appending. On success a handle to the file
+  // is returned.
+  net::FileStream* OpenForAppend(const base::FilePath& path);
+
   // Appends the specified commands to the specified file.
   bool AppendCommandsToFile(net::FileStream* file,
                             const std::vector<SessionCommand*>& commands);
 
+  // Appends the records for |commands| to |data|.
+  void EncodeCommands(const std::vector<SessionCommand*>& commands,
+                      std::string* data);
+
+  // Writes |data| to |file|, returning true on success.
+  bool WriteToFile(net::FileStream* file, const std::string& data);
+
+  // Replaces the contents of the current file with |commands|, which hold
+  // the whole state of the session. On success current_session_file_ is
+  // left open at the end of the file.
+  bool WriteSnapshot(const std::vector<SessionCommand*>& commands);
+
+  // Adds |bytes| to the count of bytes written, which is reported once an
+  // hour.
+  void RecordBytesWritten(size_t bytes);
+
   const BaseSessionService::SessionType type_;
 
   // Returns the path to the last file.
@@ -135,6 +161,10 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   // If true, the file is empty (no commands have been added to it).
   bool empty_file_;
 
+  // When the bytes written since then started to be counted, and how many.
+  base::TimeTicks write_period_start_;
+  int64 bytes_written_in_period_;
+
   DISALLOW_COPY_AND_ASSIGN(SessionBackend);
 };
 
@@ -128,8 +128,7 @@ TEST_F(SessionBackendTest, BigData) {
       new SessionBackend(BaseSessionService::SESSION_RESTORE, path_));
   std::vector<SessionCommand*> commands;
   commands.push_back(CreateCommandFromData(data[0]));
-  const SessionCommand::size_type big_size =
-      SessionBackend::kFileReadBufferSize + 100;
+  const SessionCommand::size_type big_size = 32 * 1024;
   const SessionCommand::id_type big_id = 50;
   SessionCommand* big_command = new SessionCommand(big_id, big_size);
   reinterpret_cast<char*>(big_command->contents())[0] = 'a';
@@ -207,3 +206,58 @@ TEST_F(SessionBackendTest, Truncate) {
 
   STLDeleteElements(&commands);
 }
+
+// Changes a byte of the last command written, then reads making sure only
+// the commands before it come back.
+TEST_F(SessionBackendTest, BadChecksum) {
+  scoped_refptr<SessionBackend> backend(
+      new SessionBackend(BaseSessionService::SESSION_RESTORE, path_));
+  struct TestData data[] = {
+    { 1,  "a" },
+    { 2,  "ab" },
+    { 3,  "abc" },
+  };
+  std::vector<SessionCommand*> commands;
+  for (size_t i = 0; i < arraysize(data); ++i)
+    commands.push_back(CreateCommandFromData(data[i]));
+  backend->AppendCommands(new SessionCommands(commands), false);
+  commands.clear();
+  backend = NULL;
+
+  const base::FilePath current_path = path_.AppendASCII("Current Session");
+  std::string contents;
+  ASSERT_TRUE(file_util::ReadFileToString(current_path, &contents));
+  // The last command's contents are followed by a 4 byte checksum.
+  contents[contents.size() - 5] = 'z';
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(current_path, contents.data(),
+                                 contents.size()));
+
+  backend = new SessionBackend(BaseSessionService::SESSION_RESTORE, path_);
+  backend->ReadLastSessionCommandsImpl(&commands);
+  ASSERT_EQ(2U, commands.size());
+  AssertCommandEqualsData(data[0], commands[0]);
+  AssertCommandEqualsData(data[1], commands[1]);
+  STLDeleteElements(&commands);
+}
+
+// Files written before commands had checksums are still read.
+TEST_F(SessionBackendTest, ReadVersionWithoutChecksums) {
+  const int32 header[] = { 0x53534E53, 1 };
+  std::string contents(reinterpret_cast<const char*>(header), sizeof(header));
+  const SessionCommand::size_type size = 3;
+  contents.append(reinterpret_cast<const char*>(&size), sizeof(size));
+  contents.append("\x05" "ab");
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(path_.AppendASCII("Current Session"),
+                                 contents.data(), contents.size()));
+
+  scoped_refptr<SessionBackend> backend(
+      new SessionBackend(BaseSessionService::SESSION_RESTORE, path_));
+  std::vector<SessionCommand*> commands;
+  backend->ReadLastSessionCommandsImpl(&commands);
+  ASSERT_EQ(1U, commands.size());
+  struct TestData data = { 5, "ab" };
+  AssertCommandEqualsData(data, commands[0]);
+  STLDeleteElements(&commands);
+}
@@ -19,6 +19,7 @@
 #include "base/platform_file.h"
 #include "base/stl_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
 #include "chrome/browser/browser_process.h"
 #include "chrome/browser/chrome_notification_types.h"
 #include "chrome/browser/extensions/extension_service.h"
@@ -27,6 +28,7 @@
 #include "chrome/browser/sessions/session_service.h"
 #include "chrome/browser/sessions/session_service_factory.h"
 #include "chrome/browser/sessions/session_types.h"
+#include "chrome/browser/sessions/tab_load_policy.h"
 #include "chrome/browser/ui/browser.h"
 #include "chrome/browser/ui/browser_finder.h"
 #include "chrome/browser/ui/browser_navigator.h"
@@ -80,12 +82,22 @@ std::set<SessionRestoreImpl*>* active_session_restorers = NULL;
 // Initial delay (see class decription for details).
 static const int kInitialDelayTimerMS = 100;
 
+// How long loading waits for memory to be freed before the remaining tabs are
+// left unloaded.
+static const int kMaxMemoryWaitSeconds = 60;
+
 // TabLoader is responsible for loading tabs after session restore creates
 // tabs. New tabs are loaded after the current tab finishes loading, or a delay
 // is reached (initially kInitialDelayTimerMS). If the delay is reached before
 // a tab finishes loading a new tab is loaded and the time of the delay
 // doubled.
 //
+// The order of the tabs and how many load at once are decided by
+// TabLoadPolicy. While memory is short no more tabs are loaded, and it is
+// checked again as loads finish and the timer fires. If it stays short for
+// kMaxMemoryWaitSeconds the remaining tabs are left unloaded; they don't get a
+// renderer until they are selected.
+//
 // TabLoader keeps a reference to itself when it's loading. When it has finished
 // loading, it drops the reference. If another profile is restored while the
 // TabLoader is loading, it will schedule its tabs to get loaded by the same
@@ -102,8 +114,11 @@ class TabLoader : public content::NotificationObserver,
   // starting timestamp is set to |restore_started|.
   static TabLoader* GetTabLoader(base::TimeTicks restore_started);
 
-  // Schedules a tab for loading.
-  void ScheduleLoad(NavigationController* controller);
+  // Schedules a tab for loading. |pinned| and |last_active| order the tab
+  // among the others waiting to load.
+  void ScheduleLoad(NavigationController* controller,
+                    bool pinned,
+                    base::Time last_active);
 
   // Notifies the loader that a tab has been scheduled for loading through
   // some other mechanism.
@@ -117,17 +132,34 @@ class TabLoader : public content::NotificationObserver,
  private:
   friend class base::RefCounted<TabLoader>;
 
+  // A tab waiting to load, and what decides how soon it loads.
+  struct TabToLoad {
+    NavigationController* controller;
+    TabLoadPolicy::Priority priority;
+  };
+
   typedef std::set<NavigationController*> TabsLoading;
-  typedef std::list<NavigationController*> TabsToLoad;
+  typedef std::list<TabToLoad> TabsToLoad;
   typedef std::set<RenderWidgetHost*> RenderWidgetHostSet;
 
   explicit TabLoader(base::TimeTicks restore_started);
   virtual ~TabLoader();
 
+  // Returns the position of |controller| in |tabs_to_load_|.
+  TabsToLoad::iterator FindTabToLoad(NavigationController* controller);
+
+  // Returns how many tabs may load at once, or 0 if there is no memory to
+  // load any more tabs in the background for now.
+  static size_t GetLoadBudget();
+
   // Loads the next tab. If there are no more tabs to load this deletes itself,
   // otherwise |force_load_timer_| is restarted.
   void LoadNextTab();
 
+  // Stops loading the tabs which are still waiting to; they load once they
+  // are selected.
+  void LeaveRemainingTabsUnloaded();
+
   // NotificationObserver method. Removes the specified tab and loads the next
   // tab.
   virtual void Observe(int type,
@@ -169,6 +201,9 @@ class TabLoader : public content::NotificationObserver,
   // Have we recorded the times for a tab paint?
   bool got_first_paint_;
 
+  // Have we recorded the time the first selected tab finished loading?
+  bool got_first_usable_tab_;
+
   // The set of tabs we've initiated loading on. This does NOT include the
   // selected tabs.
   TabsLoading tabs_loading_;
@@ -190,6 +225,10 @@ class TabLoader : public content::NotificationObserver,
   // The time the restore process started.
   base::TimeTicks restore_started_;
 
+  // Since when there has been no memory to load more tabs, or null if there
+  // is.
+  base::TimeTicks memory_short_since_;
+
   // Max number of tabs that were loaded in parallel (for metrics).
   size_t max_parallel_tab_loads_;
 
@@ -207,11 +246,22 @@ TabLoader* TabLoader::GetTabLoader(base::TimeTicks restore_started) {
   return shared_tab_loader;
 }
 
-void TabLoader::ScheduleLoad(NavigationController* controller) {
+void TabLoader::ScheduleLoad(NavigationController* controller,
+                             bool pinned,
+                             base::Time last_active) {
   DCHECK(controller);
-  DCHECK(find(tabs_to_load_.begin(), tabs_to_load_.end(), controller) ==
-         tabs_to_load_.end());
-  tabs_to_load_.push_back(controller);
+  DCHECK(FindTabToLoad(controller) == tabs_to_load_.end());
+  TabToLoad tab;
+  tab.controller = controller;
+  tab.priority.pinned = pinned;
+  tab.priority.last_active = last_active;
+  // Tabs which are equally important load in the order they were scheduled.
+  TabsToLoad::iterator i = tabs_to_load_.begin();
+  while (i != tabs_to_load_.end() &&
+         !TabLoadPolicy::LoadsBefore(tab.priority, i->priority)) {
+    ++i;
+  }
+  tabs_to_load_.insert(i, tab);
   RegisterForNotifications(controller);
 }
 
@@ -255,6 +305,7 @@ TabLoader::TabLoader(base::TimeTicks restore_started)
     : force_load_delay_(kInitialDelayTimerMS),
       loading_(false),
       got_first_paint_(false),
+      got_first_usable_tab_(false),
       tab_count_(0),
       restore_started_(restore_started),
       max_parallel_tab_loads_(0) {
@@ -267,9 +318,39 @@ TabLoader::~TabLoader() {
   shared_tab_loader = NULL;
 }
 
+TabLoader::TabsToLoad::iterator TabLoader::FindTabToLoad(
+    NavigationController* controller) {
+  TabsToLoad::iterator i = tabs_to_load_.begin();
+  while (i != tabs_to_load_.end() && i->controller != controller)
+    ++i;
+  return i;
+}
+
+// static
+size_t TabLoader::GetLoadBudget() {
+  return TabLoadPolicy::GetLoadBudget(
+      base::SysInfo::AmountOfPhysicalMemory(),
+      TabLoadPolicy::AmountOfAvailablePhysicalMemory(),
+      base::SysInfo::NumberOfProcessors());
+}
+
 void TabLoader::LoadNextTab() {
+  size_t load_budget = 0;
   if (!tabs_to_load_.empty()) {
-    NavigationController* tab = tabs_to_load_.front();
+    load_budget = GetLoadBudget();
+    const base::TimeTicks now = base::TimeTicks::Now();
+    if (load_budget > 0) {
+      memory_short_since_ = base::TimeTicks();
+    } else if (memory_short_since_.is_null()) {
+      memory_short_since_ = now;
+    } else if (now - memory_short_since_ >=
+               base::TimeDelta::FromSeconds(kMaxMemoryWaitSeconds)) {
+      LeaveRemainingTabsUnloaded();
+    }
+  }
+  if (!tabs_to_load_.empty() &&
+      tabs_loading_.size() < load_budget) {
+    NavigationController* tab = tabs_to_load_.front().controller;
     DCHECK(tab);
     tabs_loading_.insert(tab);
     if (tabs_loading_.size() > max_parallel_tab_loads_)
@@ -312,6 +393,13 @@ void TabLoader::LoadNextTab() {
   }
 }
 
+void TabLoader::LeaveRemainingTabsUnloaded() {
+  UMA_HISTOGRAM_COUNTS_1000("SessionRestore.TabsLeftUnloaded",
+                            tabs_to_load_.size());
+  while (!tabs_to_load_.empty())
+    RemoveTab(tabs_to_load_.front().controller);
+}
+
 void TabLoader::Observe(int type,
                         const content::NotificationSource& source,
                         const content::NotificationDetails& details) {
@@ -325,6 +413,12 @@ void TabLoader::Observe(int type,
       RenderWidgetHost* render_widget_host = GetRenderWidgetHost(tab);
       DCHECK(render_widget_host);
       render_widget_hosts_loading_.insert(render_widget_host);
+      // A tab which was selected before its turn loads by itself.
+      TabsToLoad::iterator i = FindTabToLoad(tab);
+      if (i != tabs_to_load_.end()) {
+        tabs_to_load_.erase(i);
+        tabs_loading_.insert(tab);
+      }
       break;
     }
     case content::NOTIFICATION_WEB_CONTENTS_DESTROYED: {
@@ -341,6 +435,21 @@ void TabLoader::Observe(int type,
       NavigationController* tab =
           content::Source<NavigationController>(source).ptr();
       render_widget_hosts_to_paint_.insert(GetRenderWidgetHost(tab));
+      if (!got_first_usable_tab_) {
+        Browser* browser =
+            chrome::FindBrowserWithWebContents(tab->GetWebContents());
+        if (browser && browser->tab_strip_model()->GetActiveWebContents() ==
+                tab->GetWebContents()) {
+          // The user can now use the tab in front of them.
+          got_first_usable_tab_ = true;
+          UMA_HISTOGRAM_CUSTOM_TIMES(
+              "SessionRestore.FirstUsableTab",
+              base::TimeTicks::Now() - restore_started_,
+              base::TimeDelta::FromMilliseconds(10),
+              base::TimeDelta::FromSeconds(100),
+              100);
+        }
+      }
       HandleTabClosedOrLoaded(tab);
       break;
     }
@@ -421,8 +530,7 @@ void TabLoader::RemoveTab(NavigationController* tab) {
   if (i != tabs_loading_.end())
     tabs_loading_.erase(i);
 
-  TabsToLoad::iterator j =
-      find(tabs_to_load_.begin(), tabs_to_load_.end(), tab);
+  TabsToLoad::iterator j = FindTabToLoad(tab);
   if (j != tabs_to_load_.end())
     tabs_to_load_.erase(j);
 }
@@ -1060,8 +1168,11 @@ class SessionRestoreImpl : public content::NotificationObserver {
                                                                         *file);
     }
 
-    if (schedule_load)
-      tab_loader_->ScheduleLoad(&web_contents->GetController());
+    if (schedule_load) {
+      tab_loader_->ScheduleLoad(
+          &web_contents->GetController(), tab.pinned,
+          tab.navigations.at(selected_index).timestamp());
+    }
     return web_contents;
   }
 
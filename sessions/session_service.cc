@@ -79,8 +79,11 @@ static const SessionCommand::id_type kCommandSetTabUserAgentOverride = 18;
 static const SessionCommand::id_type kCommandSessionStorageAssociated = 19;
 static const SessionCommand::id_type kCommandSetActiveWindow = 20;
 
-// Every kWritesPerReset commands triggers recreating the file.
-static const int kWritesPerReset = 250;
+// The file is rebuilt from the open browsers once the commands written since
+// the last rebuild take as much room as that rebuild did, and at least
+// kMinBytesPerReset. A rebuild then never writes more than the changes it
+// replaces, however many tabs are open.
+static const size_t kMinBytesPerReset = 64 * 1024;
 
 namespace {
 
@@ -853,9 +856,12 @@ void SessionService::RestoreSessionFromCommands(
     SessionID::id_type* active_window_id) {
   std::map<int, SessionTab*> tabs;
   std::map<int, SessionWindow*> windows;
+  IdToPendingNavigations navigations;
 
   VLOG(1) << "RestoreSessionFromCommands " << commands.size();
-  if (CreateTabsAndWindows(commands, &tabs, &windows, active_window_id)) {
+  if (CreateTabsAndWindows(commands, &tabs, &windows, &navigations,
+                           active_window_id)) {
+    DecodeNavigations(navigations, &tabs);
     AddTabsToWindows(&tabs, &windows);
     SortTabsBasedOnVisualOrderAndPrune(&windows, valid_windows);
     UpdateSelectedTabIndex(valid_windows);
@@ -922,6 +928,43 @@ std::vector<SerializedNavigationEntry>::iterator
   return navigations->end();
 }
 
+SessionService::PendingNavigations::iterator
+  SessionService::FindClosestPendingNavigationWithIndex(
+    PendingNavigations* navigations,
+    int index) {
+  DCHECK(navigations);
+  for (PendingNavigations::iterator i = navigations->begin();
+       i != navigations->end(); ++i) {
+    if (i->index >= index)
+      return i;
+  }
+  return navigations->end();
+}
+
+void SessionService::DecodeNavigations(
+    const IdToPendingNavigations& navigations,
+    IdToSessionTab* tabs) {
+  for (IdToPendingNavigations::const_iterator i = navigations.begin();
+       i != navigations.end(); ++i) {
+    if (i->second.empty())
+      continue;
+    SessionTab* tab = GetTab(i->first, tabs);
+    tab->navigations.reserve(i->second.size());
+    for (PendingNavigations::const_iterator j = i->second.begin();
+         j != i->second.end(); ++j) {
+      SerializedNavigationEntry navigation;
+      SessionID::id_type tab_id;
+      if (!RestoreUpdateTabNavigationCommand(*j->command, &navigation,
+                                             &tab_id)) {
+        VLOG(1) << "Failed reading navigation " << j->index;
+        continue;
+      }
+      navigation.set_index(j->index);
+      tab->navigations.push_back(navigation);
+    }
+  }
+}
+
 // Function used in sorting windows. Sorting is done based on window id. As
 // window ids increment for each new window, this effectively sorts by creation
 // time.
@@ -1003,6 +1046,7 @@ bool SessionService::CreateTabsAndWindows(
     const std::vector<SessionCommand*>& data,
     std::map<int, SessionTab*>* tabs,
     std::map<int, SessionWindow*>* windows,
+    IdToPendingNavigations* navigations,
     SessionID::id_type* active_window_id) {
   // If the file is corrupt (command with wrong size, or unknown command), we
   // still return true and attempt to restore what we we can.
@@ -1093,6 +1137,7 @@ bool SessionService::CreateTabsAndWindows(
             command->id() == kCommandTabClosedObsolete) {
           delete GetTab(payload.id, tabs);
           tabs->erase(payload.id);
+          navigations->erase(payload.id);
         } else {
           delete GetWindow(payload.id, windows);
           windows->erase(payload.id);
@@ -1106,10 +1151,11 @@ bool SessionService::CreateTabsAndWindows(
           VLOG(1) << "Failed reading command " << command->id();
           return true;
         }
-        SessionTab* tab = GetTab(payload.id, tabs);
-        tab->navigations.erase(
-            FindClosestNavigationWithIndex(&(tab->navigations), payload.index),
-            tab->navigations.end());
+        PendingNavigations* tab_navigations = &(*navigations)[payload.id];
+        tab_navigations->erase(
+            FindClosestPendingNavigationWithIndex(tab_navigations,
+                                                  payload.index),
+            tab_navigations->end());
         break;
       }
 
@@ -1127,12 +1173,12 @@ bool SessionService::CreateTabsAndWindows(
             std::max(-1, tab->current_navigation_index - payload.index);
 
         // And update the index of existing navigations.
-        for (std::vector<SerializedNavigationEntry>::iterator
-                 i = tab->navigations.begin();
-             i != tab->navigations.end();) {
-          i->set_index(i->index() - payload.index);
-          if (i->index() < 0)
-            i = tab->navigations.erase(i);
+        PendingNavigations* tab_navigations = &(*navigations)[payload.id];
+        for (PendingNavigations::iterator i = tab_navigations->begin();
+             i != tab_navigations->end();) {
+          i->index -= payload.index;
+          if (i->index < 0)
+            i = tab_navigations->erase(i);
           else
             ++i;
         }
@@ -1140,21 +1186,27 @@ bool SessionService::CreateTabsAndWindows(
       }
 
       case kCommandUpdateTabNavigation: {
-        SerializedNavigationEntry navigation;
+        // Only the tab and the index of the navigation are read here, which
+        // come first in the command.
+        Pickle pickle(command->contents(), static_cast<int>(command->size()));
+        PickleIterator iterator(pickle);
         SessionID::id_type tab_id;
-        if (!RestoreUpdateTabNavigationCommand(
-                *command, &navigation, &tab_id)) {
+        PendingNavigation navigation;
+        if (!pickle.ReadInt(&iterator, &tab_id) ||
+            !pickle.ReadInt(&iterator, &navigation.index)) {
           VLOG(1) << "Failed reading command " << command->id();
           return true;
         }
-        SessionTab* tab = GetTab(tab_id, tabs);
-        std::vector<SerializedNavigationEntry>::iterator i =
-            FindClosestNavigationWithIndex(&(tab->navigations),
-                                           navigation.index());
-        if (i != tab->navigations.end() && i->index() == navigation.index())
+        navigation.command = command;
+        GetTab(tab_id, tabs);
+        PendingNavigations* tab_navigations = &(*navigations)[tab_id];
+        PendingNavigations::iterator i =
+            FindClosestPendingNavigationWithIndex(tab_navigations,
+                                                  navigation.index);
+        if (i != tab_navigations->end() && i->index == navigation.index)
           *i = navigation;
         else
-          tab->navigations.insert(i, navigation);
+          tab_navigations->insert(i, navigation);
         break;
       }
 
@@ -1478,7 +1530,8 @@ void SessionService::ScheduleCommand(SessionCommand* command) {
   // Don't schedule a reset on tab closed/window closed. Otherwise we may
   // lose tabs/windows we want to restore from if we exit right after this.
   if (!pending_reset() && pending_window_close_ids_.empty() &&
-      commands_since_reset() >= kWritesPerReset &&
+      bytes_since_reset() >= std::max(kMinBytesPerReset,
+                                      last_reset_bytes()) &&
       (command->id() != kCommandTabClosed &&
        command->id() != kCommandWindowClosed)) {
     ScheduleReset();
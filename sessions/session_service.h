@@ -207,6 +207,19 @@ class SessionService : public BaseSessionService,
   typedef std::map<SessionID::id_type, SessionTab*> IdToSessionTab;
   typedef std::map<SessionID::id_type, SessionWindow*> IdToSessionWindow;
 
+  // A navigation of a tab as read from the file. Navigations are decoded only
+  // once all of the commands have been read, as most of the navigation
+  // commands in a file are overwritten or pruned by later ones.
+  struct PendingNavigation {
+    // Index of the navigation, which pruning may have shifted from the one
+    // in |command|.
+    int index;
+    const SessionCommand* command;
+  };
+  typedef std::vector<PendingNavigation> PendingNavigations;
+  typedef std::map<SessionID::id_type, PendingNavigations>
+      IdToPendingNavigations;
+
 
   // These types mirror Browser::Type, but are re-defined here because these
   // specific enumeration _values_ are written into the session database and
@@ -314,6 +327,17 @@ class SessionService : public BaseSessionService,
       std::vector<sessions::SerializedNavigationEntry>* navigations,
       int index);
 
+  // Same as FindClosestNavigationWithIndex, for navigations which are not
+  // decoded yet.
+  PendingNavigations::iterator FindClosestPendingNavigationWithIndex(
+      PendingNavigations* navigations,
+      int index);
+
+  // Decodes |navigations| and adds them to their tabs in |tabs|. Navigations
+  // which fail to decode are skipped.
+  void DecodeNavigations(const IdToPendingNavigations& navigations,
+                         IdToSessionTab* tabs);
+
   // Does the following:
   // . Deletes and removes any windows with no tabs or windows with types other
   //   than tabbed_browser or browser. NOTE: constrained windows that have
@@ -336,10 +360,13 @@ class SessionService : public BaseSessionService,
   // to delete the tabs and windows added to |tabs| and |windows|.
   //
   // This does NOT add any created SessionTabs to SessionWindow.tabs, that is
-  // done by AddTabsToWindows.
+  // done by AddTabsToWindows. Nor does it decode the navigations of the tabs:
+  // they are added to |navigations|, pointing into |data|, for
+  // DecodeNavigations.
   bool CreateTabsAndWindows(const std::vector<SessionCommand*>& data,
                             std::map<int, SessionTab*>* tabs,
                             std::map<int, SessionWindow*>* windows,
+                            IdToPendingNavigations* navigations,
                             SessionID::id_type* active_window_id);
 
   // Adds commands to commands that will recreate the state of the specified
@@ -638,6 +638,41 @@ TEST_F(SessionServiceTest, PruneFromFront) {
               tab->navigations[2].virtual_url());
 }
 
+// Makes sure a navigation which is updated is restored as last written, with
+// its index shifted by later pruning.
+TEST_F(SessionServiceTest, UpdatedNavigationReplacesEarlier) {
+  const std::string base_url("http://google.com/");
+  SessionID tab_id;
+
+  helper_.PrepareTabInWindow(window_id, tab_id, 0, true);
+  for (int i = 0; i < 3; ++i) {
+    SerializedNavigationEntry nav =
+        SerializedNavigationEntryTestHelper::CreateNavigation(
+            base_url + base::IntToString(i), "a");
+    nav.set_index(i);
+    UpdateNavigation(window_id, tab_id, nav, (i == 2));
+  }
+  SerializedNavigationEntry updated_nav =
+      SerializedNavigationEntryTestHelper::CreateNavigation(
+          base_url + "updated", "b");
+  updated_nav.set_index(2);
+  UpdateNavigation(window_id, tab_id, updated_nav, true);
+  helper_.service()->TabNavigationPathPrunedFromFront(window_id, tab_id, 1);
+
+  ScopedVector<SessionWindow> windows;
+  ReadWindows(&(windows.get()), NULL);
+
+  ASSERT_EQ(1U, windows.size());
+  ASSERT_EQ(1U, windows[0]->tabs.size());
+  SessionTab* tab = windows[0]->tabs[0];
+  ASSERT_EQ(2U, tab->navigations.size());
+  EXPECT_EQ(1, tab->current_navigation_index);
+  EXPECT_EQ(0, tab->navigations[0].index());
+  EXPECT_EQ(1, tab->navigations[1].index());
+  updated_nav.set_index(1);
+  helper_.AssertNavigationEquals(updated_nav, tab->navigations[1]);
+}
+
 // Prunes from front so that we have no entries.
 TEST_F(SessionServiceTest, PruneToEmpty) {
   const std::string base_url("http://google.com/");
@@ -0,0 +1,76 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/sessions/tab_load_policy.h"
+
+#include <algorithm>
+
+#include "base/sys_info.h"
+
+#if defined(OS_MACOSX)
+#include <mach/mach.h>
+
+#include "base/mac/scoped_mach_port.h"
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+#include "base/process/process_metrics.h"
+#endif
+
+namespace {
+
+// Memory a tab is expected to take while it loads.
+const int64 kLoadingTabBytes = 64 * 1024 * 1024;
+
+// Part of the physical memory which background loads leave free.
+const int kReservedMemoryFraction = 8;
+
+}  // namespace
+
+TabLoadPolicy::Priority::Priority() : pinned(false) {
+}
+
+// static
+bool TabLoadPolicy::LoadsBefore(const Priority& priority,
+                                const Priority& other) {
+  if (priority.pinned != other.pinned)
+    return priority.pinned;
+  return priority.last_active > other.last_active;
+}
+
+// static
+size_t TabLoadPolicy::GetLoadBudget(int64 physical_bytes,
+                                    int64 available_bytes,
+                                    int processors) {
+  const int64 headroom_bytes =
+      available_bytes - physical_bytes / kReservedMemoryFraction;
+  if (headroom_bytes < kLoadingTabBytes)
+    return 0;
+  return static_cast<size_t>(
+      std::min<int64>(headroom_bytes / kLoadingTabBytes,
+                      std::max(processors, 1)));
+}
+
+// static
+int64 TabLoadPolicy::AmountOfAvailablePhysicalMemory() {
+#if defined(OS_MACOSX)
+  // Inactive pages are given to whoever needs them before anything is paged
+  // out.
+  base::mac::ScopedMachPort host(mach_host_self());
+  vm_statistics_data_t stats;
+  mach_msg_type_number_t count = HOST_VM_INFO_COUNT;
+  if (host_statistics(host, HOST_VM_INFO,
+                      reinterpret_cast<host_info_t>(&stats),
+                      &count) == KERN_SUCCESS) {
+    return static_cast<int64>(stats.free_count + stats.inactive_count) *
+        vm_page_size;
+  }
+#elif defined(OS_LINUX) || defined(OS_ANDROID)
+  // The page cache and buffers are dropped as soon as memory is needed.
+  base::SystemMemoryInfoKB meminfo;
+  if (base::GetSystemMemoryInfo(&meminfo)) {
+    return static_cast<int64>(meminfo.free + meminfo.buffers +
+                              meminfo.cached) * 1024;
+  }
+#endif
+  return base::SysInfo::AmountOfAvailablePhysicalMemory();
+}
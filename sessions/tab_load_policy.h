@@ -0,0 +1,45 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_SESSIONS_TAB_LOAD_POLICY_H_
+#define CHROME_BROWSER_SESSIONS_TAB_LOAD_POLICY_H_
+
+#include "base/basictypes.h"
+#include "base/time/time.h"
+
+// Decides in which order session restore loads the tabs it restores in the
+// background, and how many of them it loads at once.
+class TabLoadPolicy {
+ public:
+  // What decides how soon a tab loads.
+  struct Priority {
+    Priority();
+
+    bool pinned;
+    base::Time last_active;
+  };
+
+  // Returns true if a tab with |priority| should load before one with
+  // |other|: pinned tabs load first, then the others from the most recently
+  // used down.
+  static bool LoadsBefore(const Priority& priority, const Priority& other);
+
+  // Returns how many tabs may load at once on a system with |processors|
+  // processors and |physical_bytes| of memory, of which |available_bytes|
+  // are available.  An eighth of the memory is left free.  Returns 0 if there
+  // is not enough memory left to load another tab.
+  static size_t GetLoadBudget(int64 physical_bytes,
+                              int64 available_bytes,
+                              int processors);
+
+  // Returns the physical memory which new processes may use.  Unlike
+  // base::SysInfo::AmountOfAvailablePhysicalMemory() on Linux and Mac, this
+  // includes the memory the system would reclaim from its caches.
+  static int64 AmountOfAvailablePhysicalMemory();
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(TabLoadPolicy);
+};
+
+#endif  // CHROME_BROWSER_SESSIONS_TAB_LOAD_POLICY_H_
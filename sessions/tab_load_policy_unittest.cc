@@ -0,0 +1,65 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/sessions/tab_load_policy.h"
+
+#include "base/sys_info.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+const int64 kMB = 1024 * 1024;
+
+TabLoadPolicy::Priority MakePriority(bool pinned, int64 last_active_us) {
+  TabLoadPolicy::Priority priority;
+  priority.pinned = pinned;
+  priority.last_active = base::Time::FromInternalValue(last_active_us);
+  return priority;
+}
+
+}  // namespace
+
+TEST(TabLoadPolicyTest, LoadsBefore) {
+  const TabLoadPolicy::Priority pinned_old = MakePriority(true, 1);
+  const TabLoadPolicy::Priority pinned_new = MakePriority(true, 2);
+  const TabLoadPolicy::Priority old = MakePriority(false, 1);
+  const TabLoadPolicy::Priority recent = MakePriority(false, 3);
+
+  // Pinned tabs come first, however long ago they were used.
+  EXPECT_TRUE(TabLoadPolicy::LoadsBefore(pinned_old, recent));
+  EXPECT_FALSE(TabLoadPolicy::LoadsBefore(recent, pinned_old));
+
+  // Then the most recently used.
+  EXPECT_TRUE(TabLoadPolicy::LoadsBefore(pinned_new, pinned_old));
+  EXPECT_FALSE(TabLoadPolicy::LoadsBefore(pinned_old, pinned_new));
+  EXPECT_TRUE(TabLoadPolicy::LoadsBefore(recent, old));
+  EXPECT_FALSE(TabLoadPolicy::LoadsBefore(old, recent));
+
+  // Equally important tabs keep their order.
+  EXPECT_FALSE(TabLoadPolicy::LoadsBefore(old, old));
+  EXPECT_FALSE(TabLoadPolicy::LoadsBefore(TabLoadPolicy::Priority(),
+                                          TabLoadPolicy::Priority()));
+}
+
+TEST(TabLoadPolicyTest, GetLoadBudget) {
+  // 1 GB is kept free out of 8 GB, leaving room for 16 loads of 64 MB.
+  EXPECT_EQ(16U, TabLoadPolicy::GetLoadBudget(8192 * kMB, 2048 * kMB, 32));
+  EXPECT_EQ(4U, TabLoadPolicy::GetLoadBudget(8192 * kMB, 2048 * kMB, 4));
+  EXPECT_EQ(1U, TabLoadPolicy::GetLoadBudget(8192 * kMB, 1100 * kMB, 4));
+
+  // No more tabs are loaded once memory runs short.
+  EXPECT_EQ(0U, TabLoadPolicy::GetLoadBudget(8192 * kMB, 1050 * kMB, 4));
+  EXPECT_EQ(0U, TabLoadPolicy::GetLoadBudget(8192 * kMB, 512 * kMB, 4));
+  EXPECT_EQ(0U, TabLoadPolicy::GetLoadBudget(8192 * kMB, 0, 4));
+
+  // There is always a processor.
+  EXPECT_EQ(1U, TabLoadPolicy::GetLoadBudget(8192 * kMB, 2048 * kMB, 0));
+}
+
+TEST(TabLoadPolicyTest, AmountOfAvailablePhysicalMemory) {
+  const int64 available = TabLoadPolicy::AmountOfAvailablePhysicalMemory();
+  EXPECT_GT(available, 0);
+  EXPECT_LE(available, base::SysInfo::AmountOfPhysicalMemory());
+}
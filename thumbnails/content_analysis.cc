@@ -13,12 +13,25 @@
 #include <vector>
 
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "build/build_config.h"
 #include "skia/ext/convolver.h"
 #include "skia/ext/recursive_gaussian_convolution.h"
 #include "third_party/skia/include/core/SkBitmap.h"
 #include "third_party/skia/include/core/SkSize.h"
 #include "ui/gfx/color_analysis.h"
 
+// SSE2 is always there on x86-64, and on 32-bit x86 when the compiler is
+// told it may use it.  Elsewhere the kernels below process one pixel at a
+// time.
+#if defined(ARCH_CPU_X86_64) || \
+    (defined(ARCH_CPU_X86_FAMILY) && defined(__SSE2__))
+#define USE_SSE2_KERNELS
+#include <emmintrin.h>
+#endif
+
 namespace {
 
 const float kSigmaThresholdForRecursive = 1.5f;
@@ -221,6 +234,311 @@ void ConstrainedProfileThresholding(const std::vector<float>& profile,
   }
 }
 
+// Images with fewer pixels than this per band are not worth splitting
+// across threads.
+const int kMinPixelsPerBand = 256 * 1024;
+const int kMaxBands = 8;
+
+// Column sums of up to this many rows of 8-bit pixels stay below 2^24, so
+// they come out the same whether added up in integers or in floats.
+const int kMaxExactProfileRows = (1 << 24) / 255;
+
+thumbnailing_utils::AnalysisMode g_analysis_mode =
+    thumbnailing_utils::ANALYSIS_FAST;
+
+#if defined(USE_SSE2_KERNELS)
+// Returns how much of a row of |width| pixels the kernels below process
+// with vector instructions; the rest is done one pixel at a time.
+inline int VectorWidth(int width) {
+  return g_analysis_mode == thumbnailing_utils::ANALYSIS_SCALAR ? 0 : width;
+}
+
+// Sets |sums| to grad_x * grad_x + grad_y * grad_y for the 16 pixels in
+// |grad_x| and |grad_y|, four pixels to a register.
+inline void SumSquares(__m128i grad_x, __m128i grad_y, __m128i sums[4]) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i x_low = _mm_unpacklo_epi8(grad_x, zero);
+  const __m128i x_high = _mm_unpackhi_epi8(grad_x, zero);
+  const __m128i y_low = _mm_unpacklo_epi8(grad_y, zero);
+  const __m128i y_high = _mm_unpackhi_epi8(grad_y, zero);
+  // Interleaving x and y lets one multiply-add square and sum a pixel.
+  __m128i xy = _mm_unpacklo_epi16(x_low, y_low);
+  sums[0] = _mm_madd_epi16(xy, xy);
+  xy = _mm_unpackhi_epi16(x_low, y_low);
+  sums[1] = _mm_madd_epi16(xy, xy);
+  xy = _mm_unpacklo_epi16(x_high, y_high);
+  sums[2] = _mm_madd_epi16(xy, xy);
+  xy = _mm_unpackhi_epi16(x_high, y_high);
+  sums[3] = _mm_madd_epi16(xy, xy);
+}
+
+// SSE2 has no 32-bit max.
+inline __m128i Max32(__m128i a, __m128i b) {
+  const __m128i a_greater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(a_greater, a),
+                      _mm_andnot_si128(a_greater, b));
+}
+#endif
+
+// Returns the largest gradient magnitude in a row of |width| pixels.
+unsigned MaxGradientMagnitude(const uint8* grad_x_row,
+                              const uint8* grad_y_row,
+                              int width) {
+  unsigned grad_max = 0;
+  int c = 0;
+#if defined(USE_SSE2_KERNELS)
+  __m128i max = _mm_setzero_si128();
+  for (; c + 16 <= VectorWidth(width); c += 16) {
+    __m128i sums[4];
+    SumSquares(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(grad_x_row + c)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(grad_y_row + c)),
+        sums);
+    max = Max32(Max32(max, sums[0]), Max32(sums[1], Max32(sums[2], sums[3])));
+  }
+  uint32 lanes[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), max);
+  grad_max = std::max(std::max(lanes[0], lanes[1]),
+                      std::max(lanes[2], lanes[3]));
+#endif
+  for (; c < width; ++c) {
+    unsigned grad_x = grad_x_row[c];
+    unsigned grad_y = grad_y_row[c];
+    grad_max = std::max(grad_max, grad_x * grad_x + grad_y * grad_y);
+  }
+  return grad_max;
+}
+
+// Writes the gradient magnitudes of a row of |width| pixels, shifted right
+// by |bit_shift|, to |target_row|.
+void WriteGradientMagnitude(const uint8* grad_x_row,
+                            const uint8* grad_y_row,
+                            int width,
+                            int bit_shift,
+                            uint8* target_row) {
+  int c = 0;
+#if defined(USE_SSE2_KERNELS)
+  const __m128i shift = _mm_cvtsi32_si128(bit_shift);
+  // Keeps the low byte, as the assignment to uint8 below does.
+  const __m128i low_byte = _mm_set1_epi32(0xFF);
+  for (; c + 16 <= VectorWidth(width); c += 16) {
+    __m128i sums[4];
+    SumSquares(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(grad_x_row + c)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(grad_y_row + c)),
+        sums);
+    for (int i = 0; i < 4; ++i)
+      sums[i] = _mm_and_si128(_mm_srl_epi32(sums[i], shift), low_byte);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(target_row + c),
+                     _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]),
+                                      _mm_packs_epi32(sums[2], sums[3])));
+  }
+#endif
+  for (; c < width; ++c) {
+    unsigned grad_x = grad_x_row[c];
+    unsigned grad_y = grad_y_row[c];
+    target_row[c] = (grad_x * grad_x + grad_y * grad_y) >> bit_shift;
+  }
+}
+
+// Adds a row of |width| pixels to |column_sums| and returns its sum.
+unsigned AccumulateProfileRow(const uint8* image_row,
+                              int width,
+                              uint32* column_sums) {
+  unsigned row_sum = 0;
+  int c = 0;
+#if defined(USE_SSE2_KERNELS)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i row_sums = zero;
+  for (; c + 16 <= VectorWidth(width); c += 16) {
+    const __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(image_row + c));
+    // The sum of absolute differences from zero adds up each half.
+    row_sums = _mm_add_epi64(row_sums, _mm_sad_epu8(pixels, zero));
+    const __m128i low = _mm_unpacklo_epi8(pixels, zero);
+    const __m128i high = _mm_unpackhi_epi8(pixels, zero);
+    const __m128i widened[4] = {
+      _mm_unpacklo_epi16(low, zero),
+      _mm_unpackhi_epi16(low, zero),
+      _mm_unpacklo_epi16(high, zero),
+      _mm_unpackhi_epi16(high, zero),
+    };
+    __m128i* sums = reinterpret_cast<__m128i*>(column_sums + c);
+    for (int i = 0; i < 4; ++i) {
+      _mm_storeu_si128(sums + i,
+                       _mm_add_epi32(_mm_loadu_si128(sums + i), widened[i]));
+    }
+  }
+  row_sum = _mm_cvtsi128_si32(row_sums) +
+      _mm_cvtsi128_si32(_mm_srli_si128(row_sums, 8));
+#endif
+  for (; c < width; ++c) {
+    row_sum += image_row[c];
+    column_sums[c] += image_row[c];
+  }
+  return row_sum;
+}
+
+// Returns how many bands of rows to split an image of |width| by |height|
+// pixels into.
+int GetBandCount(int width, int height) {
+  if (g_analysis_mode == thumbnailing_utils::ANALYSIS_SCALAR)
+    return 1;
+  int64 bands = static_cast<int64>(width) * height / kMinPixelsPerBand;
+  bands = std::min<int64>(bands, base::SysInfo::NumberOfProcessors());
+  bands = std::min<int64>(bands, std::min(kMaxBands, height));
+  return std::max(1, static_cast<int>(bands));
+}
+
+// Processes a band of consecutive rows of an image; see RunBands().
+class BandTask : public base::DelegateSimpleThread::Delegate {
+ public:
+  BandTask() : begin_row_(0), end_row_(0) {}
+  virtual ~BandTask() {}
+
+  void set_rows(int begin_row, int end_row) {
+    begin_row_ = begin_row;
+    end_row_ = end_row;
+  }
+
+ protected:
+  int begin_row_;
+  int end_row_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BandTask);
+};
+
+// Splits |row_count| rows into one band for each of |tasks| and runs them
+// at once, the first on the calling thread and the others on threads of
+// their own.
+template<class Task>
+void RunBands(int row_count, const std::vector<Task*>& tasks) {
+  const int band_count = static_cast<int>(tasks.size());
+  for (int i = 0; i < band_count; ++i) {
+    tasks[i]->set_rows(row_count * i / band_count,
+                       row_count * (i + 1) / band_count);
+  }
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (int i = 1; i < band_count; ++i) {
+    threads.push_back(
+        new base::DelegateSimpleThread(tasks[i], "ThumbnailAnalysis"));
+    threads.back()->Start();
+  }
+  tasks[0]->Run();
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+}
+
+class MaxGradientTask : public BandTask {
+ public:
+  MaxGradientTask(const SkBitmap& grad_x, const SkBitmap& grad_y)
+      : grad_x_(grad_x), grad_y_(grad_y), grad_max_(0) {}
+
+  virtual void Run() OVERRIDE {
+    for (int r = begin_row_; r < end_row_; ++r) {
+      grad_max_ = std::max(grad_max_, MaxGradientMagnitude(
+          grad_x_.getAddr8(0, r), grad_y_.getAddr8(0, r), grad_x_.width()));
+    }
+  }
+
+  unsigned grad_max() const { return grad_max_; }
+
+ private:
+  const SkBitmap& grad_x_;
+  const SkBitmap& grad_y_;
+  unsigned grad_max_;
+};
+
+class WriteGradientTask : public BandTask {
+ public:
+  WriteGradientTask(const SkBitmap& grad_x,
+                    const SkBitmap& grad_y,
+                    int bit_shift,
+                    SkBitmap* target)
+      : grad_x_(grad_x),
+        grad_y_(grad_y),
+        bit_shift_(bit_shift),
+        target_(target) {}
+
+  virtual void Run() OVERRIDE {
+    for (int r = begin_row_; r < end_row_; ++r) {
+      WriteGradientMagnitude(grad_x_.getAddr8(0, r), grad_y_.getAddr8(0, r),
+                             grad_x_.width(), bit_shift_,
+                             target_->getAddr8(0, r));
+    }
+  }
+
+ private:
+  const SkBitmap& grad_x_;
+  const SkBitmap& grad_y_;
+  const int bit_shift_;
+  SkBitmap* target_;
+};
+
+// Sums the rows of its band of |area| into |rows|, and their columns into
+// its own column sums, which are added up once all bands are done.
+class ProfileTask : public BandTask {
+ public:
+  ProfileTask(const SkBitmap& bitmap,
+              const gfx::Rect& area,
+              std::vector<float>* rows)
+      : bitmap_(bitmap),
+        area_(area),
+        rows_(rows),
+        column_sums_(area.width(), 0) {}
+
+  virtual void Run() OVERRIDE {
+    for (int r = begin_row_; r < end_row_; ++r) {
+      (*rows_)[r] = AccumulateProfileRow(
+          bitmap_.getAddr8(area_.x(), r + area_.y()), area_.width(),
+          &column_sums_[0]);
+    }
+  }
+
+  const std::vector<uint32>& column_sums() const { return column_sums_; }
+
+ private:
+  const SkBitmap& bitmap_;
+  const gfx::Rect area_;
+  std::vector<float>* rows_;
+  std::vector<uint32> column_sums_;
+};
+
+// Copies the runs of included columns of its band of the included rows.
+class DecimateTask : public BandTask {
+ public:
+  // |source_rows| lists the included rows, and |runs| the first byte and
+  // byte count of each run of included columns.
+  DecimateTask(const SkBitmap& bitmap,
+               const std::vector<int>& source_rows,
+               const std::vector<std::pair<size_t, size_t> >& runs,
+               SkBitmap* target)
+      : bitmap_(bitmap),
+        source_rows_(source_rows),
+        runs_(runs),
+        target_(target) {}
+
+  virtual void Run() OVERRIDE {
+    for (int target_row = begin_row_; target_row < end_row_; ++target_row) {
+      const uint8* src_row = static_cast<const uint8*>(bitmap_.getPixels()) +
+          source_rows_[target_row] * bitmap_.rowBytes();
+      uint8* insertion_target = static_cast<uint8*>(target_->getPixels()) +
+          target_row * target_->rowBytes();
+      for (size_t i = 0; i < runs_.size(); ++i) {
+        memcpy(insertion_target, src_row + runs_[i].first, runs_[i].second);
+        insertion_target += runs_[i].second;
+      }
+    }
+  }
+
+ private:
+  const SkBitmap& bitmap_;
+  const std::vector<int>& source_rows_;
+  const std::vector<std::pair<size_t, size_t> >& runs_;
+  SkBitmap* target_;
+};
+
 }  // namespace
 
 namespace thumbnailing_utils {
@@ -349,31 +667,28 @@ void ApplyGaussianGradientMagnitudeFilter(SkBitmap* input_bitmap,
         0, intermediate2.bytesPerPixel(), true);
   }
 
+  // Combining the gradients takes a pass over the whole image to find the
+  // largest magnitude and another to scale them all by it, each split into
+  // bands of rows for large images.
+  const int band_count = GetBandCount(image_size.width(), image_size.height());
+  ScopedVector<MaxGradientTask> max_tasks;
+  for (int i = 0; i < band_count; ++i)
+    max_tasks.push_back(new MaxGradientTask(intermediate, intermediate2));
+  RunBands(image_size.height(), max_tasks.get());
   unsigned grad_max = 0;
-  for (int r = 0; r < image_size.height(); ++r) {
-    const uint8* grad_x_row = intermediate.getAddr8(0, r);
-    const uint8* grad_y_row = intermediate2.getAddr8(0, r);
-    for (int c = 0; c < image_size.width(); ++c) {
-      unsigned grad_x = grad_x_row[c];
-      unsigned grad_y = grad_y_row[c];
-      grad_max = std::max(grad_max, grad_x * grad_x + grad_y * grad_y);
-    }
-  }
+  for (int i = 0; i < band_count; ++i)
+    grad_max = std::max(grad_max, max_tasks[i]->grad_max());
 
   int bit_shift = 0;
   if (grad_max > 255)
     bit_shift = static_cast<int>(
         std::log10(static_cast<float>(grad_max)) / std::log10(2.0f)) - 7;
-  for (int r = 0; r < image_size.height(); ++r) {
-    const uint8* grad_x_row = intermediate.getAddr8(0, r);
-    const uint8* grad_y_row = intermediate2.getAddr8(0, r);
-    uint8* target_row = input_bitmap->getAddr8(0, r);
-    for (int c = 0; c < image_size.width(); ++c) {
-      unsigned grad_x = grad_x_row[c];
-      unsigned grad_y = grad_y_row[c];
-      target_row[c] = (grad_x * grad_x + grad_y * grad_y) >> bit_shift;
-    }
+  ScopedVector<WriteGradientTask> write_tasks;
+  for (int i = 0; i < band_count; ++i) {
+    write_tasks.push_back(new WriteGradientTask(
+        intermediate, intermediate2, bit_shift, input_bitmap));
   }
+  RunBands(image_size.height(), write_tasks.get());
 }
 
 void ExtractImageProfileInformation(const SkBitmap& input_bitmap,
@@ -398,15 +713,32 @@ void ExtractImageProfileInformation(const SkBitmap& input_bitmap,
   rows->resize(area.height(), 0);
   columns->resize(area.width(), 0);
 
-  for (int r = 0; r < area.height(); ++r) {
-    // Points to the first byte of the row in the rectangle.
-    const uint8* image_row = input_bitmap.getAddr8(area.x(), r + area.y());
-    unsigned row_sum = 0;
-    for (int c = 0; c < area.width(); ++c, ++image_row) {
-      row_sum += *image_row;
-      (*columns)[c] += *image_row;
+  if (g_analysis_mode == ANALYSIS_SCALAR ||
+      area.height() > kMaxExactProfileRows) {
+    for (int r = 0; r < area.height(); ++r) {
+      // Points to the first byte of the row in the rectangle.
+      const uint8* image_row = input_bitmap.getAddr8(area.x(), r + area.y());
+      unsigned row_sum = 0;
+      for (int c = 0; c < area.width(); ++c, ++image_row) {
+        row_sum += *image_row;
+        (*columns)[c] += *image_row;
+      }
+      (*rows)[r] = row_sum;
+    }
+  } else if (!area.IsEmpty()) {
+    // The columns are summed in integers, band by band, so that the result
+    // does not depend on how the image was split.
+    const int band_count = GetBandCount(area.width(), area.height());
+    ScopedVector<ProfileTask> tasks;
+    for (int i = 0; i < band_count; ++i)
+      tasks.push_back(new ProfileTask(input_bitmap, area, rows));
+    RunBands(area.height(), tasks.get());
+    for (int c = 0; c < area.width(); ++c) {
+      uint32 column_sum = 0;
+      for (int i = 0; i < band_count; ++i)
+        column_sum += tasks[i]->column_sums()[c];
+      (*columns)[c] = column_sum;
     }
-    (*rows)[r] = row_sum;
   }
 
   if (apply_log) {
@@ -684,42 +1016,41 @@ SkBitmap ComputeDecimatedImage(const SkBitmap& bitmap,
   target.setConfig(bitmap.config(), target_column_count, target_row_count);
   target.allocPixels();
 
-  int target_row = 0;
+  // Every included row is made of the same runs of included columns, so
+  // they are found once rather than for each row.
+  std::vector<int> source_rows;
+  source_rows.reserve(target_row_count);
   for (int r = 0; r < bitmap.height(); ++r) {
-    if (!rows[r])
-      continue;  // We can just skip this one.
-    uint8* src_row =
-        static_cast<uint8*>(bitmap.getPixels()) + r * bitmap.rowBytes();
-    uint8* insertion_target = static_cast<uint8*>(target.getPixels()) +
-        target_row * target.rowBytes();
-    int left_copy_pixel = -1;
-    for (int c = 0; c < bitmap.width(); ++c) {
-      if (left_copy_pixel < 0 && columns[c]) {
-        left_copy_pixel = c;  // Next time we will start copying from here.
-      } else if (left_copy_pixel >= 0 && !columns[c]) {
-        // This closes a fragment we want to copy. We do it now.
-        size_t bytes_to_copy = (c - left_copy_pixel) * bitmap.bytesPerPixel();
-        memcpy(insertion_target,
-               src_row + left_copy_pixel * bitmap.bytesPerPixel(),
-               bytes_to_copy);
-        left_copy_pixel = -1;
-        insertion_target += bytes_to_copy;
-      }
-    }
-    // We can still have the tail end to process here.
-    if (left_copy_pixel >= 0) {
-      size_t bytes_to_copy =
-          (bitmap.width() - left_copy_pixel) * bitmap.bytesPerPixel();
-      memcpy(insertion_target,
-             src_row + left_copy_pixel * bitmap.bytesPerPixel(),
-             bytes_to_copy);
+    if (rows[r])
+      source_rows.push_back(r);
+  }
+  std::vector<std::pair<size_t, size_t> > runs;
+  const size_t bytes_per_pixel = bitmap.bytesPerPixel();
+  int left_copy_pixel = -1;
+  for (int c = 0; c <= bitmap.width(); ++c) {
+    const bool included = c < bitmap.width() && columns[c];
+    if (left_copy_pixel < 0 && included) {
+      left_copy_pixel = c;
+    } else if (left_copy_pixel >= 0 && !included) {
+      runs.push_back(std::make_pair(left_copy_pixel * bytes_per_pixel,
+                                    (c - left_copy_pixel) * bytes_per_pixel));
+      left_copy_pixel = -1;
     }
-    target_row++;
   }
 
+  const int band_count = GetBandCount(target.width(), target.height());
+  ScopedVector<DecimateTask> tasks;
+  for (int i = 0; i < band_count; ++i)
+    tasks.push_back(new DecimateTask(bitmap, source_rows, runs, &target));
+  RunBands(target.height(), tasks.get());
+
   return target;
 }
 
+void SetAnalysisModeForTesting(AnalysisMode mode) {
+  g_analysis_mode = mode;
+}
+
 SkBitmap CreateRetargetedThumbnailImage(
     const SkBitmap& source_bitmap,
     const gfx::Size& target_size,
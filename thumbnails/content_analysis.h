@@ -71,6 +71,18 @@ SkBitmap ComputeDecimatedImage(const SkBitmap& bitmap,
                                const std::vector<bool>& rows,
                                const std::vector<bool>& columns);
 
+// How the routines above process images.  ANALYSIS_FAST, the default, uses
+// SSE2 where the CPU has it and splits large images into bands of rows
+// processed on several threads.  ANALYSIS_SCALAR processes one pixel at a
+// time on the calling thread; its results are the same, and it is kept as
+// the reference for tests and benchmarks.
+enum AnalysisMode {
+  ANALYSIS_FAST,
+  ANALYSIS_SCALAR,
+};
+
+void SetAnalysisModeForTesting(AnalysisMode mode);
+
 // Creates a new bitmap which contains only 'interesting' areas of
 // |source_bitmap|. The |target_size| is used to estimate some computation
 // parameters, but the resulting bitmap will not necessarily be of that size.
@@ -0,0 +1,111 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Times the per-pixel steps of content-based thumbnailing, the gradient
+// magnitude, the profiles and the decimation, on snapshots of 1080p and 4K
+// screens, processed one pixel at a time on one thread and with the vector
+// kernels split across threads.
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/time/time.h"
+#include "chrome/browser/thumbnails/content_analysis.h"
+#include "chrome/test/perf/perf_test.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "ui/gfx/rect.h"
+#include "ui/gfx/size.h"
+
+namespace thumbnailing_utils {
+namespace {
+
+const int kRepeatCount = 5;
+
+// The value CreateRetargetedThumbnailImage is given for screenshots.
+const float kKernelSigma = 5.0f;
+
+// Returns an A8 bitmap of |size| with blocks of content on a flat
+// background, roughly like a page of text and pictures.
+SkBitmap CreateSnapshot(const gfx::Size& size) {
+  SkBitmap bitmap;
+  bitmap.setConfig(SkBitmap::kA8_Config, size.width(), size.height());
+  bitmap.allocPixels();
+  uint32 seed = 1;
+  for (int r = 0; r < size.height(); ++r) {
+    uint8* row = bitmap.getAddr8(0, r);
+    for (int c = 0; c < size.width(); ++c) {
+      seed = seed * 1103515245 + 12345;
+      const bool content = (r / 64) % 3 != 0 && (c / 128) % 4 != 0;
+      row[c] = content ? seed >> 24 : 200;
+    }
+  }
+  return bitmap;
+}
+
+void PrintStepTime(const std::string& step,
+                   const std::string& trace,
+                   base::TimeDelta elapsed) {
+  perf_test::PrintResult(
+      "thumbnail_" + step, "", trace,
+      static_cast<size_t>(elapsed.InMicroseconds() / kRepeatCount),
+      "us", true);
+}
+
+void TimeSteps(const gfx::Size& size, const std::string& trace) {
+  const SkBitmap snapshot = CreateSnapshot(size);
+
+  base::TimeDelta elapsed;
+  SkBitmap gradient;
+  for (int i = 0; i < kRepeatCount; ++i) {
+    snapshot.copyTo(&gradient, SkBitmap::kA8_Config);
+    base::TimeTicks start = base::TimeTicks::Now();
+    ApplyGaussianGradientMagnitudeFilter(&gradient, kKernelSigma);
+    elapsed += base::TimeTicks::Now() - start;
+  }
+  PrintStepTime("gradient", trace, elapsed);
+
+  std::vector<float> rows;
+  std::vector<float> columns;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kRepeatCount; ++i) {
+    ExtractImageProfileInformation(gradient, gfx::Rect(size),
+                                   gfx::Size(212, 132), true, &rows,
+                                   &columns);
+  }
+  PrintStepTime("profile", trace, base::TimeTicks::Now() - start);
+
+  // Keep about two thirds of the rows and columns, in short runs.
+  std::vector<bool> included_rows(size.height());
+  std::vector<bool> included_columns(size.width());
+  for (size_t i = 0; i < included_rows.size(); ++i)
+    included_rows[i] = (i / 16) % 3 != 0;
+  for (size_t i = 0; i < included_columns.size(); ++i)
+    included_columns[i] = (i / 16) % 3 != 0;
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kRepeatCount; ++i) {
+    EXPECT_FALSE(ComputeDecimatedImage(
+        snapshot, included_rows, included_columns).empty());
+  }
+  PrintStepTime("decimate", trace, base::TimeTicks::Now() - start);
+}
+
+void TimeModes(const gfx::Size& size, const std::string& trace) {
+  SetAnalysisModeForTesting(ANALYSIS_SCALAR);
+  TimeSteps(size, trace + "_scalar");
+  SetAnalysisModeForTesting(ANALYSIS_FAST);
+  TimeSteps(size, trace + "_fast");
+}
+
+TEST(ContentAnalysisPerfTest, Snapshot1080p) {
+  TimeModes(gfx::Size(1920, 1080), "1080p");
+}
+
+TEST(ContentAnalysisPerfTest, Snapshot4K) {
+  TimeModes(gfx::Size(3840, 2160), "4k");
+}
+
+}  // namespace
+}  // namespace thumbnailing_utils
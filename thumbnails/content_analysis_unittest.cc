@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <limits>
 #include <numeric>
@@ -65,6 +66,33 @@ bool CompareImageFragments(const SkBitmap& bitmap_left,
   return true;
 }
 
+// Returns an A8 bitmap of |size| filled with pseudo-random noise.
+SkBitmap CreateNoiseBitmap(const gfx::Size& size, uint32 seed) {
+  SkBitmap bitmap;
+  bitmap.setConfig(SkBitmap::kA8_Config, size.width(), size.height());
+  bitmap.allocPixels();
+  for (int r = 0; r < size.height(); ++r) {
+    uint8* row = bitmap.getAddr8(0, r);
+    for (int c = 0; c < size.width(); ++c) {
+      seed = seed * 1103515245 + 12345;
+      row[c] = seed >> 24;
+    }
+  }
+  return bitmap;
+}
+
+bool BitmapsEqual(const SkBitmap& left, const SkBitmap& right) {
+  if (left.width() != right.width() || left.height() != right.height())
+    return false;
+  for (int r = 0; r < left.height(); ++r) {
+    if (memcmp(left.getAddr(0, r), right.getAddr(0, r),
+               left.width() * left.bytesPerPixel())) {
+      return false;
+    }
+  }
+  return true;
+}
+
 float AspectDifference(const gfx::Size& reference, const gfx::Size& candidate) {
   return std::abs(static_cast<float>(candidate.width()) / candidate.height() -
                   static_cast<float>(reference.width()) / reference.height());
@@ -727,4 +755,52 @@ TEST_F(ThumbnailContentAnalysisTest, CreateRetargetedThumbnailImage) {
 
 }
 
+// The vector kernels and the banding across threads must not change any
+// result, so the fast path is checked bit for bit against the scalar one.
+// The odd width leaves a tail of pixels after the last full vector, and the
+// image is large enough to be split into bands.
+TEST_F(ThumbnailContentAnalysisTest, AnalysisModesAgree) {
+  const gfx::Size image_size(1027, 771);
+  const float kSigmas[] = { 1.0f, 5.0f };
+  for (size_t i = 0; i < arraysize(kSigmas); ++i) {
+    SkBitmap scalar = CreateNoiseBitmap(image_size, 42);
+    SkBitmap fast = CreateNoiseBitmap(image_size, 42);
+    SetAnalysisModeForTesting(ANALYSIS_SCALAR);
+    ApplyGaussianGradientMagnitudeFilter(&scalar, kSigmas[i]);
+    SetAnalysisModeForTesting(ANALYSIS_FAST);
+    ApplyGaussianGradientMagnitudeFilter(&fast, kSigmas[i]);
+    EXPECT_TRUE(BitmapsEqual(scalar, fast)) << "sigma " << kSigmas[i];
+  }
+
+  const SkBitmap noise = CreateNoiseBitmap(image_size, 7);
+  const gfx::Rect areas[] = {
+    gfx::Rect(image_size),
+    gfx::Rect(13, 5, 1001, 700),
+  };
+  for (size_t i = 0; i < arraysize(areas); ++i) {
+    std::vector<float> scalar_rows, scalar_columns, fast_rows, fast_columns;
+    SetAnalysisModeForTesting(ANALYSIS_SCALAR);
+    ExtractImageProfileInformation(noise, areas[i], gfx::Size(), false,
+                                   &scalar_rows, &scalar_columns);
+    SetAnalysisModeForTesting(ANALYSIS_FAST);
+    ExtractImageProfileInformation(noise, areas[i], gfx::Size(), false,
+                                   &fast_rows, &fast_columns);
+    EXPECT_TRUE(scalar_rows == fast_rows);
+    EXPECT_TRUE(scalar_columns == fast_columns);
+  }
+
+  std::vector<bool> rows(image_size.height());
+  std::vector<bool> columns(image_size.width());
+  for (size_t i = 0; i < rows.size(); ++i)
+    rows[i] = i % 3 != 0;
+  for (size_t i = 0; i < columns.size(); ++i)
+    columns[i] = i % 7 < 4;
+  SetAnalysisModeForTesting(ANALYSIS_SCALAR);
+  SkBitmap scalar = ComputeDecimatedImage(noise, rows, columns);
+  SetAnalysisModeForTesting(ANALYSIS_FAST);
+  SkBitmap fast = ComputeDecimatedImage(noise, rows, columns);
+  EXPECT_FALSE(fast.empty());
+  EXPECT_TRUE(BitmapsEqual(scalar, fast));
+}
+
 }  // namespace thumbnailing_utils
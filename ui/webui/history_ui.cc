@@ -760,6 +760,8 @@ void BrowsingHistoryHandler::QueryComplete(
 
   results_info_value_.SetString("term", search_text);
   results_info_value_.SetBoolean("finished", results->reached_beginning());
+  results_info_value_.SetDouble("queryDurationMs",
+                                results->query_duration().InMillisecondsF());
 
   // Add the specific dates that were searched to display them.
   // TODO(sergiu): Put today if the start is in the future.